@@ -0,0 +1,344 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        BenchStreams.cpp -- Synthetic DIO event streams for benchmarks
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include "../DioSim/DioSimWaveform.h"
+#include "BenchStreams.h"
+
+BenchStreamBuilder::BenchStreamBuilder(std::vector<DIO_EVENT>& Events,
+                                       uint32_t                InitialState)
+    : Events(Events),
+      LineState(InitialState)
+{
+}
+
+void
+BenchStreamBuilder::Drive(uint64_t Timestamp,
+                          uint32_t Line,
+                          uint32_t Level)
+{
+    uint32_t newState;
+
+    newState = (LineState & ~(1U << Line)) | (Level << Line);
+
+    if (newState == LineState) {
+        return;
+    }
+
+    if (!Events.empty() && Events.back().Timestamp == Timestamp) {
+
+        Events.back().LineState     = newState;
+        Events.back().ChangedLines ^= (newState ^ LineState);
+
+    } else {
+
+        DIO_EVENT event;
+
+        event.Timestamp    = Timestamp;
+        event.LineState    = newState;
+        event.ChangedLines = newState ^ LineState;
+
+        Events.push_back(event);
+    }
+
+    LineState = newState;
+}
+
+void
+BenchGenerateUart(std::vector<DIO_EVENT>& Events,
+                  std::vector<uint32_t>&  Payload,
+                  uint32_t                Line,
+                  uint32_t                BaudRate,
+                  size_t                  Count,
+                  uint64_t                StartTime,
+                  BenchRandom&            Random)
+{
+    BenchStreamBuilder builder(Events, 1U << Line);
+    uint64_t           time = StartTime;
+
+    //
+    // Bit times are computed from the start of each character, exactly as
+    // a UART's baud rate generator would.
+    //
+    for (size_t i = 0; i < Count; i++) {
+        uint32_t character = Random.Below(256);
+        uint64_t bitTime;
+
+        Payload.push_back(character);
+
+        for (uint32_t bit = 0; bit < 10; bit++) {
+            uint32_t level;
+
+            if (bit == 0) {
+                level = 0;
+            } else if (bit == 9) {
+                level = 1;
+            } else {
+                level = (character >> (bit - 1)) & 1;
+            }
+
+            bitTime = time + (bit * 1000000000ULL) / BaudRate;
+
+            builder.Drive(bitTime,
+                          Line,
+                          level);
+        }
+
+        time += ((10 + Random.Below(4)) * 1000000000ULL) / BaudRate;
+    }
+}
+
+void
+BenchGenerateSpi(std::vector<DIO_EVENT>& Events,
+                 std::vector<uint32_t>&  Payload,
+                 uint32_t                Base,
+                 uint32_t                ClockHz,
+                 size_t                  Count,
+                 uint64_t                StartTime,
+                 BenchRandom&            Random)
+{
+    BenchStreamBuilder builder(Events, 1U << (Base + 3));
+    uint64_t           halfPeriod = 500000000ULL / ClockHz;
+    uint64_t           time       = StartTime;
+
+    for (size_t i = 0; i < Count; i++) {
+        uint32_t mosi = Random.Below(256);
+        uint32_t miso = Random.Below(256);
+
+        Payload.push_back((miso << 8) | mosi);
+
+        if (i % 16 == 0) {
+
+            builder.Drive(time, Base + 3, 0);
+
+            time += halfPeriod;
+        }
+
+        for (int bit = 7; bit >= 0; bit--) {
+
+            //
+            // Data changes while the clock is low, and is sampled on the
+            // rising edge.
+            //
+            builder.Drive(time, Base + 1, (mosi >> bit) & 1);
+            builder.Drive(time, Base + 2, (miso >> bit) & 1);
+
+            time += halfPeriod;
+
+            builder.Drive(time, Base, 1);
+
+            time += halfPeriod;
+
+            builder.Drive(time, Base, 0);
+        }
+
+        if (i % 16 == 15 || i == Count - 1) {
+
+            time += halfPeriod;
+
+            builder.Drive(time, Base + 3, 1);
+
+            time += halfPeriod;
+        }
+    }
+}
+
+void
+BenchGenerateI2c(std::vector<DIO_EVENT>& Events,
+                 std::vector<uint32_t>&  Payload,
+                 uint32_t                Base,
+                 uint32_t                ClockHz,
+                 size_t                  Count,
+                 uint64_t                StartTime,
+                 BenchRandom&            Random)
+{
+    BenchStreamBuilder builder(Events, (1U << Base) | (1U << (Base + 1)));
+    uint64_t           quarter = 250000000ULL / ClockHz;
+    uint64_t           time    = StartTime;
+    uint32_t           scl     = Base;
+    uint32_t           sda     = Base + 1;
+
+    for (size_t i = 0; i < Count; i++) {
+        uint32_t byte;
+
+        if (i % 8 == 0) {
+
+            //
+            // START: SDA falls while SCL is high, then SCL falls
+            //
+            builder.Drive(time, sda, 0);
+            time += quarter;
+            builder.Drive(time, scl, 0);
+            time += quarter;
+
+            byte = (Random.Below(128) << 1);
+
+        } else {
+
+            byte = Random.Below(256);
+        }
+
+        Payload.push_back(byte);
+
+        //
+        // Eight data bits and the ACK, each: set SDA with SCL low, then
+        // raise and lower SCL.
+        //
+        for (int bit = 8; bit >= 0; bit--) {
+            uint32_t level = (bit == 0) ? 0 : (byte >> (bit - 1)) & 1;
+
+            builder.Drive(time, sda, level);
+            time += quarter;
+            builder.Drive(time, scl, 1);
+            time += 2 * quarter;
+            builder.Drive(time, scl, 0);
+            time += quarter;
+        }
+
+        if (i % 8 == 7 || i == Count - 1) {
+
+            //
+            // STOP: SDA low, SCL rises, then SDA rises
+            //
+            builder.Drive(time, sda, 0);
+            time += quarter;
+            builder.Drive(time, scl, 1);
+            time += quarter;
+            builder.Drive(time, sda, 1);
+            time += 4 * quarter;
+        }
+    }
+}
+
+void
+BenchGeneratePoisson(std::vector<DIO_EVENT>& Events,
+                     uint32_t                LineMask,
+                     uint64_t                MeanIntervalNs,
+                     uint64_t                TickNs,
+                     size_t                  Count,
+                     uint64_t                StartTime,
+                     BenchRandom&            Random)
+{
+    DioSimPoissonWaveform waveform(LineMask, 1e9 / MeanIntervalNs, Random.Next(), 10);
+    DioSimWaveformSource  source(UINT64_MAX, TickNs);
+    DIO_EVENT             event;
+
+    source.Add(&waveform);
+
+    while (Count != 0 && source.Read(&event, 1) != 0) {
+
+        //
+        // Skip the event that just carries the initial state
+        //
+        if (event.ChangedLines == 0) {
+            continue;
+        }
+
+        event.Timestamp += StartTime;
+
+        Events.push_back(event);
+
+        Count--;
+    }
+}
+
+void
+BenchMergeStreams(std::vector<DIO_EVENT>&              Merged,
+                  const std::vector<DIO_EVENT>* const* Streams,
+                  size_t                               StreamCount)
+{
+    std::vector<size_t>   position(StreamCount, 0);
+    std::vector<uint32_t> streamState(StreamCount, 0);
+    uint32_t              lineState = 0;
+
+    //
+    // Each stream's initial state is its first event with the changes
+    // undone.
+    //
+    for (size_t s = 0; s < StreamCount; s++) {
+
+        if (!Streams[s]->empty()) {
+
+            streamState[s] = (*Streams[s])[0].LineState ^ (*Streams[s])[0].ChangedLines;
+
+            lineState |= streamState[s];
+        }
+    }
+
+    while (true) {
+        size_t   next = StreamCount;
+        uint64_t when = UINT64_MAX;
+
+        for (size_t s = 0; s < StreamCount; s++) {
+
+            if (position[s] < Streams[s]->size() &&
+                (*Streams[s])[position[s]].Timestamp < when) {
+
+                next = s;
+                when = (*Streams[s])[position[s]].Timestamp;
+            }
+        }
+
+        if (next == StreamCount) {
+            break;
+        }
+
+        const DIO_EVENT& in = (*Streams[next])[position[next]++];
+        uint32_t         newState;
+
+        newState = (lineState & ~streamState[next]) | in.LineState;
+
+        if (!Merged.empty() && Merged.back().Timestamp == in.Timestamp) {
+
+            Merged.back().LineState     = newState;
+            Merged.back().ChangedLines ^= newState ^ lineState;
+
+        } else {
+
+            DIO_EVENT event;
+
+            event.Timestamp    = in.Timestamp;
+            event.LineState    = newState;
+            event.ChangedLines = newState ^ lineState;
+
+            Merged.push_back(event);
+        }
+
+        streamState[next] = in.LineState;
+        lineState         = newState;
+    }
+}
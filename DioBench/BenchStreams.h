@@ -0,0 +1,137 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        BenchStreams.h -- Synthetic DIO event streams for benchmarks
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <vector>
+
+#include "../DioCapture/DioEvent.h"
+#include "DioBench.h"
+
+//
+// BenchStreamBuilder
+//
+// Appends events to a stream as individual lines are driven.  Lines driven
+// at the same timestamp are merged into a single event, as the hardware's
+// change-detect latch would report them.
+//
+class BenchStreamBuilder
+{
+public:
+    BenchStreamBuilder(std::vector<DIO_EVENT>& Events,
+                       uint32_t                InitialState);
+
+    void Drive(uint64_t Timestamp,
+               uint32_t Line,
+               uint32_t Level);
+
+    uint32_t State() const
+    {
+        return LineState;
+    }
+
+private:
+    std::vector<DIO_EVENT>& Events;
+    uint32_t                LineState;
+};
+
+//
+// Each generator appends a stream carrying Count random payload values and
+// returns the payload, in order, in Payload.  Streams begin at StartTime
+// with the bus idle.
+//
+
+//
+// 8N1 UART on Line at BaudRate, with a random idle gap of 0 to 3 bit times
+// between characters.
+//
+void BenchGenerateUart(std::vector<DIO_EVENT>& Events,
+                       std::vector<uint32_t>&  Payload,
+                       uint32_t                Line,
+                       uint32_t                BaudRate,
+                       size_t                  Count,
+                       uint64_t                StartTime,
+                       BenchRandom&            Random);
+
+//
+// Mode 0 SPI, 8 bits per word, MSB first, on lines Base (SCLK), Base + 1
+// (MOSI), Base + 2 (MISO) and Base + 3 (CS), with chip select toggled every
+// 16 words.  Payload holds (MISO << 8) | MOSI for each word.
+//
+void BenchGenerateSpi(std::vector<DIO_EVENT>& Events,
+                      std::vector<uint32_t>&  Payload,
+                      uint32_t                Base,
+                      uint32_t                ClockHz,
+                      size_t                  Count,
+                      uint64_t                StartTime,
+                      BenchRandom&            Random);
+
+//
+// I2C write transactions on lines Base (SCL) and Base + 1 (SDA): START,
+// address, 7 data bytes, STOP.  Every byte is ACK'ed.  Payload holds each
+// byte on the wire, including the address byte (with its R/W bit).
+//
+void BenchGenerateI2c(std::vector<DIO_EVENT>& Events,
+                      std::vector<uint32_t>&  Payload,
+                      uint32_t                Base,
+                      uint32_t                ClockHz,
+                      size_t                  Count,
+                      uint64_t                StartTime,
+                      BenchRandom&            Random);
+
+//
+// Count events from a DioSimPoissonWaveform, at intervals averaging
+// MeanIntervalNs, each toggling one random line in LineMask (or, one time
+// in ten, several of them at once).  Timestamps are multiples of TickNs,
+// and changes in the same tick are one event.  No payload.
+//
+void BenchGeneratePoisson(std::vector<DIO_EVENT>& Events,
+                          uint32_t                LineMask,
+                          uint64_t                MeanIntervalNs,
+                          uint64_t                TickNs,
+                          size_t                  Count,
+                          uint64_t                StartTime,
+                          BenchRandom&            Random);
+
+//
+// Interleave streams that drive disjoint sets of lines into one stream, by
+// timestamp.
+//
+void BenchMergeStreams(std::vector<DIO_EVENT>&              Merged,
+                       const std::vector<DIO_EVENT>* const* Streams,
+                       size_t                               StreamCount);
@@ -0,0 +1,365 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        BrokerBench.cpp -- Fan-out, state reads and arbitration
+//                           through the device broker
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      Runs a DioBrokerServer over the simulated device, with clients on
+//      their own threads (each with its own mapping of the section, just
+//      as separate processes would have).  The field inputs are toggled
+//      one line at a time, each change waiting for the simulated ISR to
+//      publish it, so the device never loses an event and every client
+//      should see every change, in order.  We measure:
+//
+//        - fan-out: events delivered to all clients per second, events
+//          any client lost, and latency from the ISR stamping an event to
+//          a client having it
+//        - the broker's CPU time per million device events (the cost of
+//          fan-out, whatever the number of clients)
+//        - reading the line state from the shared section, against every
+//          client going to the device (IOCTL_OSRDIO_READ) for it
+//        - the round trip of a write to a claimed output line, and that
+//          claims are exclusive
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../DioBroker/DioBrokerClient.h"
+#include "../DioBroker/DioBrokerServer.h"
+#include "../DioSim/DioSimDevice.h"
+#include "DioBench.h"
+
+constexpr uint32_t BROKER_BENCH_CLIENTS     = 20;
+constexpr uint32_t BROKER_BENCH_CHANGES     = 200000;
+constexpr uint32_t BROKER_BENCH_RING        = 64 * 1024;
+constexpr uint32_t BROKER_BENCH_STATE_READS = 200000;
+constexpr uint32_t BROKER_BENCH_WRITES      = 20000;
+
+typedef struct _BROKER_BENCH_CLIENT {
+    uint64_t                Events;
+    uint64_t                Lost;
+    uint64_t                Mismatches;
+    std::vector<uint64_t>   LatencyNs;
+} BROKER_BENCH_CLIENT, *PBROKER_BENCH_CLIENT;
+
+//
+// Read events until the broker has published Total of them, checking each
+// toggles the line after the one the last toggled
+//
+static void
+ClientThread(const char*          Name,
+             uint64_t             Total,
+             std::atomic<bool>*   Ready,
+             PBROKER_BENCH_CLIENT Result)
+{
+    DioBrokerClient client;
+    DIO_EVENT       events[256];
+    uint64_t        seen = 0;
+    size_t          count;
+    uint32_t        expected = 0;
+    bool            haveExpected = false;
+
+    if (!client.Open(Name)) {
+
+        Result->Mismatches = Total;
+
+        *Ready = true;
+
+        return;
+    }
+
+    *Ready = true;
+
+    while (seen < Total) {
+
+        count = client.ReadEvents(events, 256, 1000);
+
+        if (count == 0) {
+            break;
+        }
+
+        uint64_t now = DioSimEventRing::Now();
+
+        if (client.LostEvents() != Result->Lost) {
+
+            seen         += client.LostEvents() - Result->Lost;
+            Result->Lost  = client.LostEvents();
+            haveExpected  = false;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+
+            if (haveExpected && events[i].ChangedLines != expected) {
+                Result->Mismatches++;
+            }
+
+            expected     = (events[i].ChangedLines << 1) | (events[i].ChangedLines >> 31);
+            haveExpected = true;
+        }
+
+        //
+        // One sample per batch: the newest event is the one that waited
+        // least, the oldest the one that waited most
+        //
+        Result->LatencyNs.push_back(now - events[0].Timestamp);
+
+        seen           += count;
+        Result->Events += count;
+    }
+}
+
+//
+// Read the line state Count times on each of Threads threads with Read,
+// and return the mean time per read
+//
+template <typename READ>
+static double
+TimeStateReads(uint32_t Threads,
+               uint32_t Count,
+               READ     Read)
+{
+    std::vector<std::thread> threads;
+    std::atomic<uint32_t>    sink(0);
+
+    BenchTimer timer;
+
+    for (uint32_t t = 0; t < Threads; t++) {
+
+        threads.emplace_back([&] {
+            uint32_t state = 0;
+
+            for (uint32_t i = 0; i < Count; i++) {
+                state ^= Read();
+            }
+
+            sink ^= state;
+        });
+    }
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    return (double)timer.ElapsedNs() / ((double)Threads * Count);
+}
+
+void
+BenchBroker()
+{
+    DioSimDevice                     device(BROKER_BENCH_RING, DioSimUnfilteredProfile);
+    DioBrokerSimDevice               brokerDevice(device);
+    DioBrokerServer                  broker(brokerDevice);
+    std::vector<BROKER_BENCH_CLIENT> results(BROKER_BENCH_CLIENTS);
+    std::vector<std::thread>         clients;
+    std::atomic<bool>                ready[BROKER_BENCH_CLIENTS];
+    std::string                      name;
+    PDIO_EVENT_RING                  ring;
+    uint32_t                         inputs = 0;
+
+    name = "DioBench.broker." + std::to_string(DioBrokerCurrentProcessId());
+
+    if (!broker.Start(name.c_str())) {
+
+        printf("broker: unable to start a broker called %s\n", name.c_str());
+
+        return;
+    }
+
+    //
+    // Fan-out
+    //
+    for (uint32_t i = 0; i < BROKER_BENCH_CLIENTS; i++) {
+
+        ready[i] = false;
+
+        clients.emplace_back(ClientThread,
+                             name.c_str(),
+                             (uint64_t)BROKER_BENCH_CHANGES,
+                             &ready[i],
+                             &results[i]);
+    }
+
+    for (uint32_t i = 0; i < BROKER_BENCH_CLIENTS; i++) {
+
+        while (!ready[i]) {
+            std::this_thread::yield();
+        }
+    }
+
+    ring = device.Ring().Ring();
+
+    BenchTimer       timer;
+    DIO_BROKER_STATS before = broker.Stats();
+
+    for (uint32_t i = 0; i < BROKER_BENCH_CHANGES; i++) {
+
+        uint32_t published = ring->ProducerIndex.load(std::memory_order_relaxed);
+        uint64_t errors    = device.ChangeErrorCount();
+
+        inputs ^= 1U << (i % 32);
+
+        device.Bar().SetInputs(inputs);
+
+        //
+        // Wait for the ISR to have acknowledged the change too, or the
+        // next one would be a change detect error
+        //
+        while ((ring->ProducerIndex.load(std::memory_order_acquire) == published &&
+                device.ChangeErrorCount() == errors) ||
+               device.Bar().InterruptPending()) {
+            std::this_thread::yield();
+        }
+    }
+
+    for (std::thread& client : clients) {
+        client.join();
+    }
+
+    uint64_t         elapsed = timer.ElapsedNs();
+    DIO_BROKER_STATS after   = broker.Stats();
+
+    std::vector<uint64_t> latencies;
+    uint64_t              delivered  = 0;
+    uint64_t              lost       = 0;
+    uint64_t              mismatches = 0;
+
+    for (BROKER_BENCH_CLIENT& result : results) {
+
+        delivered  += result.Events;
+        lost       += result.Lost;
+        mismatches += result.Mismatches;
+
+        latencies.insert(latencies.end(), result.LatencyNs.begin(), result.LatencyNs.end());
+    }
+
+    BenchReport("broker.fanout", "clients", BROKER_BENCH_CLIENTS, "clients");
+    BenchReport("broker.fanout", "device_events", (double)(after.Events - before.Events), "events");
+    BenchReport("broker.fanout", "device_rate", (after.Events - before.Events) * 1e3 / elapsed, "Mevents/s");
+    BenchReport("broker.fanout", "delivered_rate", delivered * 1e3 / elapsed, "Mevents/s");
+    BenchReport("broker.fanout", "lost", (double)lost, "events");
+    BenchReport("broker.fanout", "mismatches", (double)mismatches, "events");
+    BenchReport("broker.fanout", "latency_p50", BenchPercentile(latencies, 0.5) / 1e3, "us");
+    BenchReport("broker.fanout", "latency_p99", BenchPercentile(latencies, 0.99) / 1e3, "us");
+    BenchReport("broker.fanout", "broker_cpu_per_million_events",
+                (after.PumpCpuNs - before.PumpCpuNs) / 1e6 /
+                ((after.Events - before.Events) / 1e6), "ms");
+    BenchReport("broker.fanout", "device_overflows", (double)after.DeviceOverflows, "events");
+
+    //
+    // Line state: from the section, against from the device
+    //
+    {
+        std::vector<std::unique_ptr<DioBrokerClient>> readers;
+
+        for (uint32_t i = 0; i < BROKER_BENCH_CLIENTS; i++) {
+
+            readers.push_back(std::make_unique<DioBrokerClient>());
+
+            readers.back()->Open(name.c_str());
+        }
+
+        std::atomic<uint32_t> next(0);
+
+        double sharedNs = TimeStateReads(BROKER_BENCH_CLIENTS,
+                                         BROKER_BENCH_STATE_READS,
+                                         [&] {
+            thread_local DioBrokerClient* reader =
+                readers[next++ % BROKER_BENCH_CLIENTS].get();
+
+            return reader->ReadLineState().LineState;
+        });
+
+        double deviceNs = TimeStateReads(BROKER_BENCH_CLIENTS,
+                                         BROKER_BENCH_STATE_READS,
+                                         [&] {
+            return device.ReadLines();
+        });
+
+        BenchReport("broker.state", "shared_read", sharedNs, "ns");
+        BenchReport("broker.state", "device_read", deviceNs, "ns");
+    }
+
+    //
+    // Output lines: one client claims, another can't, writes round trip
+    //
+    {
+        DioBrokerClient owner;
+        DioBrokerClient other;
+        uint64_t        errors = 0;
+
+        if (!owner.Open(name.c_str()) || !other.Open(name.c_str())) {
+
+            printf("broker: unable to connect\n");
+
+            return;
+        }
+
+        errors += owner.Claim(0x000000FF) != DioBrokerStatus::Success;
+        errors += other.Claim(0x00000180) != DioBrokerStatus::Conflict;
+        errors += other.Write(0x00000001, 1) != DioBrokerStatus::NotOwner;
+        errors += other.Claim(0x00000100) != DioBrokerStatus::Success;
+
+        BenchTimer writeTimer;
+
+        for (uint32_t i = 0; i < BROKER_BENCH_WRITES; i++) {
+
+            errors += owner.Write(0x000000FF, i) != DioBrokerStatus::Success;
+        }
+
+        double writeUs = writeTimer.ElapsedNs() / 1e3 / BROKER_BENCH_WRITES;
+
+        DIO_BROKER_LINE_STATE state = owner.ReadLineState();
+
+        errors += state.OutputLines != 0x000001FF;
+        errors += (state.LineState & 0xFF) != ((BROKER_BENCH_WRITES - 1) & 0xFF);
+
+        //
+        // Closing releases the owner's lines
+        //
+        owner.Close();
+
+        errors += other.Claim(0x000000FF) != DioBrokerStatus::Success;
+
+        BenchReport("broker.outputs", "write_round_trip", writeUs, "us");
+        BenchReport("broker.outputs", "arbitration_errors", (double)errors, "errors");
+    }
+
+    broker.Stop();
+}
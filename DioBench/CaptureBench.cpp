@@ -0,0 +1,238 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        CaptureBench.cpp -- Capture file format benchmarks
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <cstdio>
+#include <cstring>
+
+#include "../DioCapture/DioCaptureReader.h"
+#include "../DioCapture/DioCaptureWriter.h"
+#include "BenchStreams.h"
+
+constexpr size_t CAPTURE_BENCH_UNITS  = 200000;
+constexpr size_t CAPTURE_BENCH_EVENTS = 2000000;
+constexpr int    CAPTURE_BENCH_PASSES = 5;
+
+static const char CaptureBenchFile[] = "DioBench.capture.tmp";
+
+//
+// CountingSink
+//
+// Discards everything written to it, so we can time the encoder alone
+//
+class CountingSink : public DioCaptureSink
+{
+public:
+    bool Write(const void* Data,
+               size_t      Length) override
+    {
+        (void)Data;
+
+        Bytes += Length;
+
+        return true;
+    }
+
+    uint64_t Bytes = 0;
+};
+
+static void
+RunCaptureBench(const char*                   Name,
+                const std::vector<DIO_EVENT>& Events,
+                uint32_t                      TickNs)
+{
+    DIO_CAPTURE_CONFIG config;
+    uint64_t           bestEncodeNs = UINT64_MAX;
+    uint64_t           bestFileNs   = UINT64_MAX;
+    uint64_t           bestReadNs   = UINT64_MAX;
+    uint64_t           fileBytes    = 0;
+    uint64_t           mismatches   = 0;
+    uint64_t           allocations;
+
+    DioCaptureDefaultConfig(&config);
+
+    config.TickNs = TickNs;
+
+    //
+    // Encoding only
+    //
+    for (int pass = 0; pass < CAPTURE_BENCH_PASSES; pass++) {
+        CountingSink     sink;
+        DioCaptureWriter writer(&sink, config);
+
+        writer.Begin();
+
+        allocations = BenchAllocationCount();
+
+        BenchTimer timer;
+
+        writer.Append(Events.data(), Events.size(), 0);
+        writer.Finish();
+
+        uint64_t elapsed = timer.ElapsedNs();
+
+        allocations = BenchAllocationCount() - allocations;
+
+        if (elapsed < bestEncodeNs) {
+            bestEncodeNs = elapsed;
+        }
+
+        fileBytes = sink.Bytes;
+    }
+
+    //
+    // Encoding and writing to a file
+    //
+    for (int pass = 0; pass < CAPTURE_BENCH_PASSES; pass++) {
+        DioCaptureFileSink sink;
+
+        if (!sink.Open(CaptureBenchFile)) {
+
+            printf("%s: unable to create %s\n", Name, CaptureBenchFile);
+
+            return;
+        }
+
+        DioCaptureWriter writer(&sink, config);
+
+        BenchTimer timer;
+
+        writer.Begin();
+        writer.Append(Events.data(), Events.size(), 0);
+        writer.Finish();
+        sink.Close();
+
+        uint64_t elapsed = timer.ElapsedNs();
+
+        if (elapsed < bestFileNs) {
+            bestFileNs = elapsed;
+        }
+    }
+
+    //
+    // Reading it back, and checking that we got exactly what we wrote
+    //
+    for (int pass = 0; pass < CAPTURE_BENCH_PASSES; pass++) {
+        DioCaptureReader reader;
+        DIO_EVENT        events[256];
+        size_t           count;
+        size_t           position = 0;
+
+        mismatches = 0;
+
+        BenchTimer timer;
+
+        if (!reader.Open(CaptureBenchFile)) {
+
+            printf("%s: unable to open %s\n", Name, CaptureBenchFile);
+
+            return;
+        }
+
+        while ((count = reader.Read(events, 256)) != 0) {
+
+            for (size_t i = 0; i < count; i++, position++) {
+
+                if (position >= Events.size() ||
+                    events[i].Timestamp != Events[position].Timestamp ||
+                    events[i].LineState != Events[position].LineState) {
+                    mismatches++;
+                }
+            }
+        }
+
+        uint64_t elapsed = timer.ElapsedNs();
+
+        if (position != Events.size()) {
+            mismatches++;
+        }
+
+        if (elapsed < bestReadNs) {
+            bestReadNs = elapsed;
+        }
+    }
+
+    remove(CaptureBenchFile);
+
+    BenchReport(Name, "events", (double)Events.size(), "events");
+    BenchReport(Name, "bytes_per_event", (double)fileBytes / Events.size(), "bytes");
+    BenchReport(Name, "compression_ratio",
+                (double)(Events.size() * sizeof(DIO_EVENT)) / fileBytes, "x");
+    BenchReport(Name, "encode_throughput", Events.size() * 1e3 / bestEncodeNs, "Mevents/s");
+    BenchReport(Name, "encode_allocations", (double)allocations, "allocs");
+    BenchReport(Name, "write_throughput", Events.size() * 1e3 / bestFileNs, "Mevents/s");
+    BenchReport(Name, "write_bandwidth", fileBytes * 1e3 / bestFileNs, "MB/s");
+    BenchReport(Name, "read_throughput", Events.size() * 1e3 / bestReadNs, "Mevents/s");
+    BenchReport(Name, "mismatches", (double)mismatches, "events");
+}
+
+void
+BenchCapture()
+{
+    BenchRandom            random(0x0D10);
+    std::vector<DIO_EVENT> uartEvents;
+    std::vector<DIO_EVENT> spiEvents;
+    std::vector<DIO_EVENT> i2cEvents;
+    std::vector<DIO_EVENT> mixedEvents;
+    std::vector<DIO_EVENT> poissonEvents;
+    std::vector<DIO_EVENT> liveEvents;
+    std::vector<uint32_t>  payload;
+
+    BenchGenerateUart(uartEvents, payload, 0, 115200, CAPTURE_BENCH_UNITS, 1000, random);
+    BenchGenerateSpi(spiEvents, payload, 8, 1000000, CAPTURE_BENCH_UNITS, 1000, random);
+    BenchGenerateI2c(i2cEvents, payload, 16, 400000, CAPTURE_BENCH_UNITS, 1000, random);
+
+    const std::vector<DIO_EVENT>* streams[] = { &uartEvents, &spiEvents, &i2cEvents };
+
+    BenchMergeStreams(mixedEvents, streams, 3);
+
+    //
+    // Random activity on all 32 lines, averaging one change every 50us:
+    // once with nanosecond timestamps and once with 100ns timestamps (the
+    // usual performance counter resolution, and so what a live capture
+    // from the driver would see).
+    //
+    BenchGeneratePoisson(poissonEvents, 0xFFFFFFFF, 50000, 1, CAPTURE_BENCH_EVENTS, 0, random);
+    BenchGeneratePoisson(liveEvents, 0xFFFFFFFF, 50000, 100, CAPTURE_BENCH_EVENTS, 0, random);
+
+    RunCaptureBench("capture.uart", uartEvents, 1);
+    RunCaptureBench("capture.spi", spiEvents, 1);
+    RunCaptureBench("capture.i2c", i2cEvents, 1);
+    RunCaptureBench("capture.mixed", mixedEvents, 1);
+    RunCaptureBench("capture.poisson", poissonEvents, 1);
+    RunCaptureBench("capture.poisson_100ns", liveEvents, 100);
+}
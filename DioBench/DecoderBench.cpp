@@ -0,0 +1,259 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DecoderBench.cpp -- Protocol decoder throughput benchmarks
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include "../DioCapture/DioUartDecoder.h"
+#include "../DioCapture/DioSpiDecoder.h"
+#include "../DioCapture/DioI2cDecoder.h"
+#include "BenchStreams.h"
+
+//
+// Number of payload units (characters, words, bytes) in each synthetic
+// stream, and the number of passes we time over it.
+//
+constexpr size_t DECODER_BENCH_UNITS  = 200000;
+constexpr int    DECODER_BENCH_PASSES = 10;
+
+//
+// CheckingSink
+//
+// Counts frames and compares the payload they carry against what the
+// generators put on the wire, for every channel.
+//
+class CheckingSink : public DioFrameSink
+{
+public:
+    CheckingSink()
+        : Expected(),
+          Position(),
+          Frames(0),
+          Mismatches(0)
+    {
+    }
+
+    void Expect(uint32_t                     Channel,
+                const std::vector<uint32_t>* Payload)
+    {
+        Expected[Channel] = Payload;
+        Position[Channel] = 0;
+    }
+
+    void Restart()
+    {
+        for (size_t& position : Position) {
+            position = 0;
+        }
+
+        Frames = 0;
+    }
+
+    void OnFrame(const DIO_FRAME& Frame) override
+    {
+        uint32_t value;
+
+        switch (Frame.Type) {
+
+            case DioFrameType::UartCharacter:
+                value = Frame.Data;
+                break;
+
+            case DioFrameType::SpiWord:
+                value = (Frame.Aux << 8) | Frame.Data;
+                break;
+
+            case DioFrameType::I2cAddress:
+                value = (Frame.Data << 1) |
+                        ((Frame.Flags & DIO_FRAME_READ) != 0 ? 1 : 0);
+                break;
+
+            case DioFrameType::I2cData:
+                value = Frame.Data;
+                break;
+
+            default:
+
+                //
+                // START/STOP conditions carry no payload
+                //
+                return;
+        }
+
+        Frames++;
+
+        const std::vector<uint32_t>* expected = Expected[Frame.Channel];
+        size_t&                      position = Position[Frame.Channel];
+
+        if (expected == nullptr ||
+            position >= expected->size() ||
+            (*expected)[position] != value ||
+            (Frame.Flags & (DIO_FRAME_PARITY_ERROR |
+                            DIO_FRAME_FRAMING_ERROR |
+                            DIO_FRAME_INCOMPLETE |
+                            DIO_FRAME_NACK)) != 0) {
+            Mismatches++;
+        }
+
+        position++;
+    }
+
+    const std::vector<uint32_t>* Expected[4];
+    size_t                       Position[4];
+    uint64_t                     Frames;
+    uint64_t                     Mismatches;
+};
+
+//
+// Time DECODER_BENCH_PASSES runs of Session over Events and report the
+// results under Name.
+//
+static void
+RunDecoderBench(const char*                   Name,
+                const std::vector<DIO_EVENT>& Events,
+                DioDecodeSession&             Session,
+                CheckingSink&                 Sink,
+                DioDecoder* const*            Decoders,
+                size_t                        DecoderCount)
+{
+    uint64_t bestNs = UINT64_MAX;
+    uint64_t allocations;
+
+    allocations = BenchAllocationCount();
+
+    for (int pass = 0; pass < DECODER_BENCH_PASSES; pass++) {
+        DioArrayEventSource source(Events.data(), Events.size());
+
+        Sink.Restart();
+
+        for (size_t d = 0; d < DecoderCount; d++) {
+            Decoders[d]->Reset(Events[0].LineState ^ Events[0].ChangedLines);
+        }
+
+        BenchTimer timer;
+
+        Session.Run(source);
+
+        uint64_t elapsed = timer.ElapsedNs();
+
+        if (elapsed < bestNs) {
+            bestNs = elapsed;
+        }
+    }
+
+    allocations = BenchAllocationCount() - allocations;
+
+    BenchReport(Name, "events", (double)Events.size(), "events");
+    BenchReport(Name, "frames", (double)Sink.Frames, "frames");
+    BenchReport(Name, "mismatches", (double)Sink.Mismatches, "frames");
+    BenchReport(Name, "time_per_event", (double)bestNs / Events.size(), "ns");
+    BenchReport(Name, "throughput", Events.size() * 1e3 / bestNs, "Mevents/s");
+    BenchReport(Name, "allocations", (double)allocations, "allocs");
+}
+
+void
+BenchDecoders()
+{
+    BenchRandom            random(0x0D10);
+    std::vector<DIO_EVENT> uartEvents;
+    std::vector<DIO_EVENT> spiEvents;
+    std::vector<DIO_EVENT> i2cEvents;
+    std::vector<DIO_EVENT> mixedEvents;
+    std::vector<uint32_t>  uartPayload;
+    std::vector<uint32_t>  spiPayload;
+    std::vector<uint32_t>  i2cPayload;
+    CheckingSink           sink;
+
+    BenchGenerateUart(uartEvents, uartPayload, 0, 115200, DECODER_BENCH_UNITS, 1000, random);
+    BenchGenerateSpi(spiEvents, spiPayload, 8, 1000000, DECODER_BENCH_UNITS, 1000, random);
+    BenchGenerateI2c(i2cEvents, i2cPayload, 16, 400000, DECODER_BENCH_UNITS, 1000, random);
+
+    const std::vector<DIO_EVENT>* streams[] = { &uartEvents, &spiEvents, &i2cEvents };
+
+    BenchMergeStreams(mixedEvents, streams, 3);
+
+    DIO_UART_CONFIG uartConfig = { 0, 115200, 8, DioParity::None, 1, false };
+    DIO_SPI_CONFIG  spiConfig  = { 8, 9, 10, 11, 0, 8, false };
+    DIO_I2C_CONFIG  i2cConfig  = { 16, 17 };
+
+    DioUartDecoder uart(uartConfig, &sink, 1);
+    DioSpiDecoder  spi(spiConfig, &sink, 2);
+    DioI2cDecoder  i2c(i2cConfig, &sink, 3);
+
+    sink.Expect(1, &uartPayload);
+    sink.Expect(2, &spiPayload);
+    sink.Expect(3, &i2cPayload);
+
+    {
+        DioDecodeSession session;
+        DioDecoder*      decoders[] = { &uart };
+
+        session.AddDecoder(&uart);
+
+        RunDecoderBench("decoders.uart", uartEvents, session, sink, decoders, 1);
+    }
+
+    {
+        DioDecodeSession session;
+        DioDecoder*      decoders[] = { &spi };
+
+        session.AddDecoder(&spi);
+
+        RunDecoderBench("decoders.spi", spiEvents, session, sink, decoders, 1);
+    }
+
+    {
+        DioDecodeSession session;
+        DioDecoder*      decoders[] = { &i2c };
+
+        session.AddDecoder(&i2c);
+
+        RunDecoderBench("decoders.i2c", i2cEvents, session, sink, decoders, 1);
+    }
+
+    //
+    // All three buses captured at once, decoded in a single pass
+    //
+    {
+        DioDecodeSession session;
+        DioDecoder*      decoders[] = { &uart, &spi, &i2c };
+
+        session.AddDecoder(&uart);
+        session.AddDecoder(&spi);
+        session.AddDecoder(&i2c);
+
+        RunDecoderBench("decoders.mixed", mixedEvents, session, sink, decoders, 3);
+    }
+}
@@ -0,0 +1,229 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioBench.cpp -- Benchmark driver program for OsrDio
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "DioBench.h"
+
+static uint64_t AllocationCount;
+
+//
+// Where results are also written as CSV (with -csv), for tracking them
+// from run to run
+//
+static FILE* CsvFile;
+
+void*
+operator new(size_t Size)
+{
+    void* memory;
+
+    AllocationCount++;
+
+    memory = malloc(Size != 0 ? Size : 1);
+
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    return memory;
+}
+
+void
+operator delete(void* Memory) noexcept
+{
+    free(Memory);
+}
+
+void
+operator delete(void* Memory,
+                size_t) noexcept
+{
+    free(Memory);
+}
+
+uint64_t
+BenchAllocationCount()
+{
+    return AllocationCount;
+}
+
+double
+BenchPercentile(std::vector<uint64_t>& Samples,
+                double                 Fraction)
+{
+    if (Samples.empty()) {
+        return 0;
+    }
+
+    size_t index = static_cast<size_t>(Fraction * (Samples.size() - 1));
+
+    std::nth_element(Samples.begin(), Samples.begin() + index, Samples.end());
+
+    return (double)Samples[index];
+}
+
+void
+BenchReport(const char* Benchmark,
+            const char* Metric,
+            double      Value,
+            const char* Unit)
+{
+    printf("%-28s %-24s %16.3f %s\n",
+           Benchmark,
+           Metric,
+           Value,
+           Unit);
+
+    if (CsvFile != nullptr) {
+
+        fprintf(CsvFile,
+                "%s,%s,%.9g,%s\n",
+                Benchmark,
+                Metric,
+                Value,
+                Unit);
+
+        fflush(CsvFile);
+    }
+}
+
+typedef struct _BENCH_ENTRY {
+    const char* Name;
+    void        (*Function)();
+} BENCH_ENTRY;
+
+static const BENCH_ENTRY BenchTable[] = {
+    { "decoders",  BenchDecoders  },
+    { "capture",   BenchCapture   },
+    { "index",     BenchIndex     },
+    { "vcd",       BenchVcd       },
+    { "linestats", BenchLineStats },
+    { "recorder",  BenchRecorder  },
+    { "broker",    BenchBroker    },
+    { "ports",     BenchPorts     },
+    { "priority",  BenchPriority  },
+    { "dpc",       BenchDpc       },
+    { "wake",      BenchWake      },
+    { "startup",   BenchStartup   },
+    { "reconfig",  BenchReconfig  },
+    { "registers", BenchRegisters },
+    { "mmio",      BenchMmio      },
+    { "soak",      BenchSoak      },
+    { "waveforms", BenchWaveforms },
+    { "filters",   BenchFilters   },
+    { "trace",     BenchTrace     },
+    { "dispatch",  BenchDispatch  },
+};
+
+int
+main(int   argc,
+     char* argv[])
+{
+    bool ranOne = false;
+    int  first  = 1;
+
+    printf("DIOBENCH -- OSRDIO Benchmarks V1.0\n");
+
+    //
+    // -csv <file> writes the results to <file> too, one per line, as
+    //
+    //      benchmark,metric,value,unit
+    //
+    if (argc > 2 && strcmp(argv[1], "-csv") == 0) {
+
+        CsvFile = fopen(argv[2], "w");
+
+        if (CsvFile == nullptr) {
+
+            printf("Unable to create %s\n", argv[2]);
+
+            return EXIT_FAILURE;
+        }
+
+        fprintf(CsvFile, "benchmark,metric,value,unit\n");
+
+        first = 3;
+    }
+
+    //
+    // With no arguments, run everything.  Otherwise run the benchmarks
+    // named on the command line.
+    //
+    for (const BENCH_ENTRY& entry : BenchTable) {
+
+        bool selected = (argc == first);
+
+        for (int i = first; i < argc; i++) {
+
+            if (strcmp(argv[i], entry.Name) == 0) {
+                selected = true;
+            }
+        }
+
+        if (selected) {
+
+            entry.Function();
+
+            ranOne = true;
+        }
+    }
+
+    if (CsvFile != nullptr) {
+        fclose(CsvFile);
+    }
+
+    if (!ranOne) {
+
+        printf("Usage: DioBench [-csv <file>] [benchmark...]\n");
+        printf("Available benchmarks:");
+
+        for (const BENCH_ENTRY& entry : BenchTable) {
+            printf(" %s", entry.Name);
+        }
+
+        printf("\n");
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
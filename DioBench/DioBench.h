@@ -0,0 +1,154 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioBench.h -- Common definitions for the OsrDio benchmarks
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      DioBench is a plain console program, written in portable C++, so
+//      that the benchmarks can be run on any host (including Linux) with
+//      the same results format.  Each benchmark is a function listed in
+//      the BenchTable in DioBench.cpp.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+//
+// BenchTimer
+//
+// Wall clock stopwatch, in nanoseconds
+//
+class BenchTimer
+{
+public:
+    BenchTimer()
+        : Start(std::chrono::steady_clock::now())
+    {
+    }
+
+    uint64_t ElapsedNs() const
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - Start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point Start;
+};
+
+//
+// Number of heap allocations made by this process so far.  DioBench
+// replaces the global operator new so that benchmarks can check that their
+// hot paths don't allocate.
+//
+uint64_t BenchAllocationCount();
+
+//
+// Report one result.  Every result is printed on its own line as
+//
+//      <benchmark> <metric> <value> <unit>
+//
+// and, if DioBench was run with -csv, written to the CSV file.
+//
+void BenchReport(const char* Benchmark,
+                 const char* Metric,
+                 double      Value,
+                 const char* Unit);
+
+//
+// The sample at Fraction (0.0 through 1.0) of the way through Samples, or 0
+// if there are none.  Samples is partially reordered.
+//
+double BenchPercentile(std::vector<uint64_t>& Samples,
+                       double                 Fraction);
+
+//
+// Simple deterministic PRNG (xorshift64*) so that synthetic streams are
+// the same on every run and every host.
+//
+class BenchRandom
+{
+public:
+    explicit BenchRandom(uint64_t Seed)
+        : State(Seed != 0 ? Seed : 0x9E3779B97F4A7C15ULL)
+    {
+    }
+
+    uint64_t Next()
+    {
+        State ^= State >> 12;
+        State ^= State << 25;
+        State ^= State >> 27;
+
+        return State * 0x2545F4914F6CDD1DULL;
+    }
+
+    uint32_t Below(uint32_t Limit)
+    {
+        return (uint32_t)(Next() % Limit);
+    }
+
+private:
+    uint64_t State;
+};
+
+//
+// The benchmarks
+//
+void BenchDecoders();
+void BenchCapture();
+void BenchIndex();
+void BenchVcd();
+void BenchLineStats();
+void BenchRecorder();
+void BenchBroker();
+void BenchPorts();
+void BenchPriority();
+void BenchDpc();
+void BenchWake();
+void BenchStartup();
+void BenchReconfig();
+void BenchRegisters();
+void BenchMmio();
+void BenchSoak();
+void BenchWaveforms();
+void BenchFilters();
+void BenchTrace();
+void BenchDispatch();
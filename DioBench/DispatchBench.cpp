@@ -0,0 +1,481 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DispatchBench.cpp -- ISR, DPC and IOCTL dispatch microbenchmarks
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      Microbenchmarks of the driver's dispatch paths: the driver's own
+//      code (DioDriverCore.h), run by the simulated device against the
+//      simulated BAR.  OsrDioEvtInterruptIsr (for our interrupt, and for
+//      one that isn't ours), the DpcForIsr, and each IOCTL that does more
+//      than copy out what the driver keeps.  We take the BAR's
+//      interrupt away from the device's ISR thread, so the ISR and the
+//      DpcForIsr run only when we call them, and time each call by itself.
+//      For each path, as dispatch.<path>:
+//
+//          ns_per_op       Mean time per call, less what timing it costs
+//
+//          p50, p99        The median and 99th percentile call
+//
+//          mmio_per_op     Register reads and writes per call, counted by
+//                          the device's register profiler (in a second
+//                          pass, so profiling doesn't add to the times)
+//
+//          allocs_per_op   Heap allocations per call
+//
+//      dispatch.read_events and dispatch.wait_ring time
+//      IOCTL_OSRDIO_READ_EVENTS and IOCTL_OSRDIO_WAIT_EVENT_RING when
+//      there's already an event for them, so they're completed as soon as
+//      they're sent.
+//
+//      dispatch.waitfor_change, dispatch.read_events_wait and
+//      dispatch.wait_ring_wait are round trips instead: from an
+//      application sending IOCTL_OSRDIO_WAITFOR_CHANGE, READ_EVENTS or
+//      WAIT_EVENT_RING to the Request being completed, with us changing an
+//      input and running the ISR and the DpcForIsr as soon as it's
+//      waiting.  Their counts include every change it took (usually one).
+//
+//      dispatch.attach_ring times IOCTL_OSRDIO_ATTACH_EVENT_RING attaching
+//      an application's ring (which is detached, untimed, between calls).
+//      dispatch.set_dpc_processor times IOCTL_OSRDIO_SET_DPC_PROCESSOR
+//      moving the DpcForIsr between processor 0 and any processor, and
+//      dispatch.save_profile IOCTL_OSRDIO_SAVE_PROFILE.  These run the
+//      driver's logic, but not what it asks of the system: retargeting the
+//      DPC and moving the worker thread (the simulator's threads don't
+//      move), or writing the profile to the registry (we keep it in
+//      memory).  Those costs are the system's, and dominate on a real
+//      machine, so time them there.
+//
+//      IOCTL_OSRDIO_GET_REGISTER_TRACE is left out: it only copies out a
+//      trace that the driver keeps in builds that profile registers, and
+//      the simulator's trace (DioSimBar's) is kept by the device model,
+//      not the driver.
+//
+//      Run DioBench -csv <file> dispatch to keep the results.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "../DioSim/DioSimDevice.h"
+#include "DioBench.h"
+
+constexpr uint32_t DISPATCH_BENCH_OPS          = 200000;
+constexpr uint32_t DISPATCH_BENCH_COUNTED_OPS  = 10000;
+constexpr uint32_t DISPATCH_BENCH_WAITS        = 20000;
+constexpr uint32_t DISPATCH_BENCH_CALIBRATIONS = 100000;
+constexpr uint32_t DISPATCH_BENCH_RING         = 1024;
+constexpr uint32_t DISPATCH_BENCH_BATCH        = 16;
+
+//
+// The whole device's handle applies profiles with port 2 as outputs, in
+// two states with different edges; the lines we change are always inputs
+// and always detected
+//
+constexpr DIO_SIM_LINE_PROFILE DispatchBenchProfiles[2] = {
+    { 0x00FF0000, 0,          0x0000FFFF, 0x0000FFFF, 0, 0 },
+    { 0x00FF0000, 0x00AA0000, 0x000000FF, 0x000000FF, 0, 0 },
+};
+
+//
+// What a BenchTimer costs: the median of many empty timings
+//
+static uint64_t
+DispatchBenchTimerOverhead()
+{
+    std::vector<uint64_t> samples(DISPATCH_BENCH_CALIBRATIONS);
+
+    for (uint64_t& sample : samples) {
+
+        BenchTimer timer;
+
+        sample = timer.ElapsedNs();
+    }
+
+    std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+
+    return samples[samples.size() / 2];
+}
+
+//
+// Register accesses the device has made so far, while profiling
+//
+static uint64_t
+DispatchBenchAccesses(DioSimDevice& Device)
+{
+    DIO_SIM_REGISTER_PROFILE profile = Device.RegisterProfile();
+    uint64_t                 accesses = 0;
+
+    for (uint32_t i = 0; i < DIO_REGISTER_COUNT; i++) {
+
+        for (uint32_t path = 0; path < DIO_SIM_PATHS; path++) {
+            accesses += profile.Accesses[i][path].Reads + profile.Accesses[i][path].Writes;
+        }
+    }
+
+    return accesses;
+}
+
+static void
+DispatchBenchReport(const char*            Name,
+                    std::vector<uint64_t>& Samples,
+                    uint64_t               Accesses,
+                    uint32_t               CountedOps,
+                    uint64_t               Allocations)
+{
+    uint64_t total = 0;
+
+    for (uint64_t sample : Samples) {
+        total += sample;
+    }
+
+    std::sort(Samples.begin(), Samples.end());
+
+    BenchReport(Name, "ns_per_op", (double)total / Samples.size(), "ns");
+    BenchReport(Name, "p50", (double)Samples[Samples.size() / 2], "ns");
+    BenchReport(Name, "p99", (double)Samples[Samples.size() * 99 / 100], "ns");
+    BenchReport(Name, "mmio_per_op", (double)Accesses / CountedOps, "count");
+    BenchReport(Name, "allocs_per_op", (double)Allocations / Samples.size(), "count");
+}
+
+//
+// Time Operation(i) DISPATCH_BENCH_OPS times, each after Prepare(i) (which
+// isn't timed), and then count its register accesses
+//
+template <typename PrepareFunction, typename OperationFunction>
+static void
+DispatchBenchRun(const char*       Name,
+                 DioSimDevice&     Device,
+                 uint64_t          TimerOverhead,
+                 PrepareFunction   Prepare,
+                 OperationFunction Operation)
+{
+    std::vector<uint64_t> samples(DISPATCH_BENCH_OPS);
+    uint64_t              allocations = 0;
+    uint64_t              accesses;
+
+    for (uint32_t i = 0; i < DISPATCH_BENCH_OPS; i++) {
+
+        Prepare(i);
+
+        uint64_t   allocationsBefore = BenchAllocationCount();
+        BenchTimer timer;
+
+        Operation(i);
+
+        uint64_t   elapsed = timer.ElapsedNs();
+
+        allocations += BenchAllocationCount() - allocationsBefore;
+
+        samples[i] = elapsed > TimerOverhead ? elapsed - TimerOverhead : 0;
+    }
+
+    accesses = DispatchBenchAccesses(Device);
+
+    for (uint32_t i = 0; i < DISPATCH_BENCH_COUNTED_OPS; i++) {
+
+        Prepare(i);
+
+        Device.SetRegisterProfiling(true);
+
+        Operation(i);
+
+        Device.SetRegisterProfiling(false);
+    }
+
+    accesses = DispatchBenchAccesses(Device) - accesses;
+
+    DispatchBenchReport(Name, samples, accesses, DISPATCH_BENCH_COUNTED_OPS, allocations);
+}
+
+//
+// Give every event in the device's event ring back, as its consumer would
+//
+static void
+DispatchBenchConsumeRing(DioSimDevice& Device)
+{
+    PDIO_EVENT_RING ring = Device.Ring().Ring();
+
+    ring->ConsumerIndex.store(ring->ProducerIndex.load(std::memory_order_acquire),
+                              std::memory_order_release);
+}
+
+//
+// A round trip: the application's thread sends Request (and then runs
+// Consume, untimed) DISPATCH_BENCH_WAITS times.  It says when it's about
+// to send each Request; we then change line 0 (and run the ISR and the
+// DpcForIsr) until the Request has been completed, letting the
+// application run first so that the Request is waiting before the change.
+//
+template <typename RequestFunction, typename ConsumeFunction>
+static void
+DispatchBenchRoundTrip(const char*     Name,
+                       DioSimDevice&   Device,
+                       uint64_t        TimerOverhead,
+                       RequestFunction Request,
+                       ConsumeFunction Consume)
+{
+    std::vector<uint64_t> samples(DISPATCH_BENCH_WAITS);
+    std::atomic<uint32_t> sent(0);
+    std::atomic<uint32_t> completed(0);
+    uint32_t              lines = 0;
+    uint64_t              allocations;
+    uint64_t              accesses;
+
+    accesses = DispatchBenchAccesses(Device);
+
+    allocations = BenchAllocationCount();
+
+    Device.SetRegisterProfiling(true);
+
+    std::thread application([&] {
+
+        for (uint32_t i = 0; i < DISPATCH_BENCH_WAITS; i++) {
+
+            sent.store(i + 1, std::memory_order_release);
+
+            BenchTimer timer;
+
+            Request();
+
+            uint64_t elapsed = timer.ElapsedNs();
+
+            samples[i] = elapsed > TimerOverhead ? elapsed - TimerOverhead : 0;
+
+            Consume();
+
+            completed.store(i + 1, std::memory_order_release);
+        }
+    });
+
+    for (uint32_t i = 0; i < DISPATCH_BENCH_WAITS; i++) {
+
+        while (sent.load(std::memory_order_acquire) <= i) {
+            std::this_thread::yield();
+        }
+
+        while (completed.load(std::memory_order_acquire) <= i) {
+
+            std::this_thread::yield();
+
+            lines ^= 1;
+
+            Device.Bar().SetInputs(lines);
+
+            Device.RunIsr();
+
+            Device.RunDpc();
+        }
+    }
+
+    application.join();
+
+    Device.SetRegisterProfiling(false);
+
+    allocations = BenchAllocationCount() - allocations;
+
+    accesses = DispatchBenchAccesses(Device) - accesses;
+
+    DispatchBenchReport(Name,
+                        samples,
+                        accesses,
+                        DISPATCH_BENCH_WAITS,
+                        allocations);
+}
+
+void
+BenchDispatch()
+{
+    DioSimDevice device(DISPATCH_BENCH_RING, DioSimUnfilteredProfile);
+    DioSimBar&   bar = device.Bar();
+    DioSimHandle whole(device);
+    DioSimHandle inputs(device, 0);
+    DioSimHandle outputs(device, 3);
+    uint64_t     overhead = DispatchBenchTimerOverhead();
+    uint32_t     lines = 0;
+    uint32_t     check = 0;
+    DIO_EVENT    events[DISPATCH_BENCH_BATCH];
+    uint32_t     eventCount;
+    bool         overflow;
+
+    auto nothing = [](uint32_t) {};
+
+    auto change = [&](uint32_t) {
+        lines ^= 1;
+        bar.SetInputs(lines);
+        device.RunIsr();
+        device.RunDpc();
+    };
+
+    //
+    // Nothing runs our ISR now but us
+    //
+    bar.SetInterruptTarget(nullptr);
+
+    outputs.SetOutputs(0xFF000000);
+
+    BenchReport("dispatch", "timer_overhead", (double)overhead, "ns");
+
+    DispatchBenchRun("dispatch.isr", device, overhead,
+                     [&](uint32_t) {
+                         device.RunDpc();
+                         lines ^= 1;
+                         bar.SetInputs(lines);
+                     },
+                     [&](uint32_t) { device.RunIsr(); });
+
+    device.RunDpc();
+
+    DispatchBenchRun("dispatch.isr_not_ours", device, overhead,
+                     nothing,
+                     [&](uint32_t) { device.RunIsr(); });
+
+    DispatchBenchRun("dispatch.dpc", device, overhead,
+                     [&](uint32_t) {
+                         lines ^= 1;
+                         bar.SetInputs(lines);
+                         device.RunIsr();
+                     },
+                     [&](uint32_t) { device.RunDpc(); });
+
+    DispatchBenchRun("dispatch.read", device, overhead,
+                     nothing,
+                     [&](uint32_t) {
+                         uint32_t lineState;
+
+                         inputs.Read(&lineState);
+
+                         check += lineState;
+                     });
+
+    DispatchBenchRun("dispatch.write", device, overhead,
+                     nothing,
+                     [&](uint32_t i) { outputs.Write((i & 1) ? 0xFF000000 : 0); });
+
+    DispatchBenchRun("dispatch.set_outputs", device, overhead,
+                     nothing,
+                     [&](uint32_t i) { outputs.SetOutputs((i & 1) ? 0x0F000000 : 0xFF000000); });
+
+    DispatchBenchRun("dispatch.apply_profile", device, overhead,
+                     nothing,
+                     [&](uint32_t i) { whole.ApplyProfile(DispatchBenchProfiles[i & 1]); });
+
+    DispatchBenchRun("dispatch.dpc_stats", device, overhead,
+                     nothing,
+                     [&](uint32_t) { check += (uint32_t)device.DpcStats().Dpc.Count; });
+
+    DispatchBenchRun("dispatch.register_profile", device, overhead,
+                     nothing,
+                     [&](uint32_t) { check += (uint32_t)device.RegisterProfile().Runs[0]; });
+
+    DispatchBenchRun("dispatch.read_events", device, overhead,
+                     change,
+                     [&](uint32_t) {
+                         whole.ReadEvents(events, DISPATCH_BENCH_BATCH, &eventCount, &overflow);
+
+                         check += eventCount;
+                     });
+
+    DispatchBenchRun("dispatch.wait_ring", device, overhead,
+                     [&](uint32_t i) {
+                         DispatchBenchConsumeRing(device);
+                         change(i);
+                     },
+                     [&](uint32_t) { whole.WaitEventRing(); });
+
+    DispatchBenchConsumeRing(device);
+
+    DispatchBenchRoundTrip("dispatch.waitfor_change", device, overhead,
+                           [&] {
+                               DIO_SIM_CHANGE change;
+
+                               inputs.WaitForChange(DioSimPriority::Normal, &change);
+                           },
+                           [] {});
+
+    //
+    // Leave nothing in the driver's event ring, or the first READ_EVENTS
+    // wouldn't wait
+    //
+    whole.ReadEvents(events, DISPATCH_BENCH_BATCH, &eventCount, &overflow);
+
+    DispatchBenchRoundTrip("dispatch.read_events_wait", device, overhead,
+                           [&] {
+                               whole.ReadEvents(events, DISPATCH_BENCH_BATCH, &eventCount, &overflow);
+
+                               check += eventCount;
+                           },
+                           [] {});
+
+    DispatchBenchConsumeRing(device);
+
+    DispatchBenchRoundTrip("dispatch.wait_ring_wait", device, overhead,
+                           [&] { whole.WaitEventRing(); },
+                           [&] { DispatchBenchConsumeRing(device); });
+
+    DispatchBenchRun("dispatch.set_dpc_processor", device, overhead,
+                     nothing,
+                     [&](uint32_t i) { whole.SetDpcProcessor((i & 1) ? DIO_SIM_ANY_PROCESSOR : 0); });
+
+    whole.SetDpcProcessor(DIO_SIM_ANY_PROCESSOR);
+
+    DispatchBenchRun("dispatch.save_profile", device, overhead,
+                     nothing,
+                     [&](uint32_t i) { whole.SaveProfile(DispatchBenchProfiles[i & 1]); });
+
+    //
+    // The application's ring takes the place of the device's own
+    //
+    DioSimEventRing application(DISPATCH_BENCH_RING);
+
+    device.DetachRing();
+
+    DispatchBenchRun("dispatch.attach_ring", device, overhead,
+                     [&](uint32_t) { whole.DetachEventRing(); },
+                     [&](uint32_t) {
+                         check += (uint32_t)whole.AttachEventRing(application.Ring(),
+                                                                  DioEventRingSize(DISPATCH_BENCH_RING));
+                     });
+
+    whole.DetachEventRing();
+
+    //
+    // Keep the results live, so nothing is optimized away
+    //
+    BenchReport("dispatch", "check", (double)(check & 1), "count");
+}
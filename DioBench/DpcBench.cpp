@@ -0,0 +1,211 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DpcBench.cpp -- How long the DpcForIsr takes, with its
+//                        processing done in place or deferred
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      An application waits for changes on each port while we change every
+//      port every DPC_BENCH_PACE_US.  The simulated driver spends
+//      DPC_BENCH_EVENT_NS on each change (as it would if it were counting
+//      them, checking triggers, or fanning them out) and
+//      DPC_BENCH_COMPLETION_NS completing each Request.
+//
+//      We report the distribution of DpcForIsr times from the driver's own
+//      histogram (IOCTL_OSRDIO_GET_DPC_STATS), and how long after each
+//      change the applications' Requests were completed, first with the
+//      work done in the DpcForIsr and then with it deferred to the worker
+//      thread.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../DioSim/DioSimDevice.h"
+#include "DioBench.h"
+
+constexpr uint32_t DPC_BENCH_CHANGES       = 5000;
+constexpr uint32_t DPC_BENCH_EVENT_NS      = 5000;
+constexpr uint32_t DPC_BENCH_COMPLETION_NS = 1000;
+constexpr uint32_t DPC_BENCH_PACE_US       = 200;
+
+//
+// Report a timing as IOCTL_OSRDIO_GET_DPC_STATS returns it: its average and
+// longest, the bucket its 99th percentile falls in, and the share of runs
+// in each bucket
+//
+static void
+ReportTiming(const char*     Name,
+             const char*     What,
+             PDIO_SIM_TIMING Timing)
+{
+    char     metric[64];
+    uint64_t counted = 0;
+    bool     p99     = false;
+
+    if (Timing->Count == 0) {
+        return;
+    }
+
+    snprintf(metric, sizeof(metric), "%s_mean", What);
+    BenchReport(Name, metric, Timing->TotalTime / 1e3 / Timing->Count, "us");
+
+    snprintf(metric, sizeof(metric), "%s_max", What);
+    BenchReport(Name, metric, Timing->MaxTime / 1e3, "us");
+
+    for (uint32_t i = 0; i < DIO_SIM_TIMING_BUCKETS; i++) {
+
+        counted += Timing->Histogram[i];
+
+        if (!p99 && counted >= Timing->Count * 99 / 100) {
+
+            snprintf(metric, sizeof(metric), "%s_p99_under", What);
+            BenchReport(Name, metric, (double)(1ULL << i), "us");
+
+            p99 = true;
+        }
+    }
+
+    for (uint32_t i = 0; i < DIO_SIM_TIMING_BUCKETS; i++) {
+
+        if (Timing->Histogram[i] == 0) {
+            continue;
+        }
+
+        snprintf(metric, sizeof(metric), "%s_under_%lluus", What, 1ULL << i);
+        BenchReport(Name, metric, 100.0 * Timing->Histogram[i] / Timing->Count, "%");
+    }
+}
+
+static void
+RunDpc(const char* Name,
+       bool        Deferred)
+{
+    DioSimDevice                               device(1024, DioSimUnfilteredProfile);
+    std::vector<std::unique_ptr<DioSimHandle>> handles;
+    std::vector<std::vector<uint64_t>>         latencies(DIO_SIM_PORT_COUNT);
+    std::vector<std::thread>                   threads;
+    std::atomic<uint64_t>                      changeTime[256];
+    std::atomic<uint32_t>                      finished(0);
+    std::atomic<bool>                          done(false);
+    std::vector<uint64_t>                      allLatencies;
+
+    device.SetEventCost(DPC_BENCH_EVENT_NS);
+    device.SetCompletionCost(DPC_BENCH_COMPLETION_NS);
+    device.SetDeferredProcessing(Deferred);
+
+    for (std::atomic<uint64_t>& time : changeTime) {
+        time = 0;
+    }
+
+    for (uint32_t port = 0; port < DIO_SIM_PORT_COUNT; port++) {
+
+        handles.emplace_back(new DioSimHandle(device, port));
+
+        threads.emplace_back([&, port] {
+            DIO_SIM_CHANGE change;
+
+            latencies[port].reserve(DPC_BENCH_CHANGES);
+
+            while (!done.load(std::memory_order_relaxed) &&
+                   handles[port]->WaitForChange(DioSimPriority::Normal, &change) ==
+                       DioSimStatus::Success) {
+
+                uint32_t index = (change.LatchedLineState >>
+                                  (port * DIO_SIM_LINES_PER_PORT)) & 0xFF;
+
+                latencies[port].push_back(change.CompletionTime - changeTime[index]);
+            }
+
+            finished++;
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    for (uint32_t i = 1; i <= DPC_BENCH_CHANGES; i++) {
+
+        while (device.Bar().InterruptPending()) {
+            std::this_thread::yield();
+        }
+
+        changeTime[i & 0xFF] = DioSimEventRing::Now();
+
+        device.Bar().SetInputs((i & 0xFF) * 0x01010101);
+
+        std::this_thread::sleep_for(std::chrono::microseconds(DPC_BENCH_PACE_US));
+    }
+
+    done = true;
+
+    while (finished != threads.size()) {
+
+        for (std::unique_ptr<DioSimHandle>& handle : handles) {
+            handle->Cancel();
+        }
+
+        std::this_thread::yield();
+    }
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    DIO_SIM_DPC_STATS stats = device.DpcStats();
+
+    ReportTiming(Name, "dpc", &stats.Dpc);
+    ReportTiming(Name, "worker", &stats.Worker);
+
+    for (std::vector<uint64_t>& portLatencies : latencies) {
+        allLatencies.insert(allLatencies.end(), portLatencies.begin(), portLatencies.end());
+    }
+
+    BenchReport(Name, "completion_p50", BenchPercentile(allLatencies, 0.5) / 1e3, "us");
+    BenchReport(Name, "completion_p99", BenchPercentile(allLatencies, 0.99) / 1e3, "us");
+    BenchReport(Name,
+                "changes_seen",
+                100.0 * allLatencies.size() / (DPC_BENCH_CHANGES * DIO_SIM_PORT_COUNT),
+                "%");
+}
+
+void
+BenchDpc()
+{
+    RunDpc("dpc.inline", false);
+    RunDpc("dpc.deferred", true);
+}
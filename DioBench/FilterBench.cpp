@@ -0,0 +1,392 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        FilterBench.cpp -- The simulated BAR's digital filters, change
+//                           detect latch and ChangeDetectError
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      Both scenarios run in virtual time, with a minimal "ISR" servicing
+//      the BAR's interrupt: it reads ChangeDetectStatusRegister and
+//      DI_ChangeDetectLatched_Register, and acknowledges what it saw.
+//
+//      filters.model plays bouncing contacts and glitchy lines into the
+//      BAR, with the large filter on them, and an ISR that takes no time.
+//      Every change the BAR latches should then be exactly one of the
+//      changes DioSimWaveformSource gives when it applies the same filters
+//      to the same waveforms, at the same time.
+//
+//      filters.overrun plays fast, unfiltered input into the BAR with an
+//      ISR that takes FILTER_BENCH_ISR_NS to get around to each interrupt.
+//      Changes that arrive before the ISR acknowledges the last one are
+//      lost, and set ChangeDetectError instead.  We work out from the
+//      stream which changes should be latched, and which interrupts should
+//      see the error, and compare.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../DioSim/DioSimClock.h"
+#include "../DioSim/DioSimPlayer.h"
+#include "../DioSim/DioSimWaveform.h"
+#include "DioBench.h"
+
+constexpr uint64_t FILTER_BENCH_MODEL_SECONDS = 60;
+constexpr uint64_t FILTER_BENCH_OVERRUN_MS    = 500;
+constexpr double   FILTER_BENCH_OVERRUN_RATE  = 200000;
+constexpr uint64_t FILTER_BENCH_ISR_NS        = 10000;
+constexpr size_t   FILTER_BENCH_READ          = 1024;
+
+//
+// Lines 0 to 7 filtered (with the large filter), the rest not
+//
+constexpr uint32_t FILTER_BENCH_FILTERS = 0x0000FFFF;
+
+typedef struct _FILTER_BENCH_CHANGE {
+    uint64_t Time;
+    uint32_t Latched;
+    bool     Error;
+} FILTER_BENCH_CHANGE;
+
+//
+// FilterBenchIsr
+//
+// Services the BAR's interrupt, DelayNs after it's asserted, and records
+// what it finds
+//
+class FilterBenchIsr : private DioSimInterruptTarget
+{
+public:
+    FilterBenchIsr(DioSimBar& Bar,
+                   uint64_t   DelayNs)
+        : Bar(Bar),
+          Delay(DelayNs),
+          Asserted(false),
+          Stopping(false)
+    {
+        Bar.SetInterruptTarget(this);
+
+        Bar.Write((uint32_t)DioSimRegister::DI_ChangeIrqRE_Register, 0xFFFFFFFF);
+        Bar.Write((uint32_t)DioSimRegister::DI_ChangeIrqFE_Register, 0xFFFFFFFF);
+        Bar.Write((uint32_t)DioSimRegister::ChangeDetectIRQ_Register,
+                  DIO_SIM_ChangeDetectIRQ_Enable | DIO_SIM_ChangeDetectErrorIRQ_Enable);
+        Bar.Write((uint32_t)DioSimRegister::GlobalInterruptEnable_Register,
+                  DIO_SIM_DI_Interrupt_Enable);
+        Bar.Write((uint32_t)DioSimRegister::Interrupt_Mask_Register, DIO_SIM_Set_CPU_Int);
+
+        Isr = DioSimClock::Thread([this] { IsrThread(); });
+    }
+
+    ~FilterBenchIsr() override
+    {
+        {
+            std::lock_guard<std::mutex> guard(Lock);
+
+            Stopping = true;
+        }
+
+        DioSimClock::Notify(Condition);
+
+        DioSimClock::Join(Isr);
+
+        Bar.SetInterruptTarget(nullptr);
+    }
+
+    std::vector<FILTER_BENCH_CHANGE> Changes;
+
+private:
+    void InterruptAsserted() override
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+
+        Asserted = true;
+
+        DioSimClock::Notify(Condition);
+    }
+
+    void IsrThread()
+    {
+        std::unique_lock<std::mutex> lock(Lock);
+
+        while (true) {
+            FILTER_BENCH_CHANGE change;
+            uint32_t            status;
+
+            DioSimClock::Wait(lock, Condition, [this] { return Asserted || Stopping; });
+
+            if (Stopping) {
+                break;
+            }
+
+            Asserted = false;
+
+            if (Delay != 0) {
+
+                DioSimClock::WaitUntil(lock,
+                                       Condition,
+                                       DioSimClock::Now() + Delay,
+                                       [this] { return Stopping; });
+            }
+
+            lock.unlock();
+
+            status = Bar.Read((uint32_t)DioSimRegister::ChangeDetectStatusRegister);
+
+            change.Time    = DioSimClock::Now();
+            change.Latched = Bar.Read((uint32_t)DioSimRegister::DI_ChangeDetectLatched_Register);
+            change.Error   = (status & DIO_SIM_ChangeDetectError) != 0;
+
+            Bar.Write((uint32_t)DioSimRegister::ChangeDetectIRQ_Register,
+                      ((status & DIO_SIM_ChangeDetectStatus) != 0 ?
+                           DIO_SIM_ChangeDetectIRQ_Acknowledge : 0) |
+                      (change.Error ? DIO_SIM_ChangeDetectErrorIRQ_Acknowledge : 0));
+
+            if ((status & DIO_SIM_ChangeDetectStatus) != 0) {
+                Changes.push_back(change);
+            }
+
+            lock.lock();
+        }
+    }
+
+    DioSimBar&              Bar;
+    uint64_t                Delay;
+    std::mutex              Lock;
+    std::condition_variable Condition;
+    bool                    Asserted;
+    bool                    Stopping;
+    std::thread             Isr;
+};
+
+static void
+ReadAll(DioEventSource&         Source,
+        std::vector<DIO_EVENT>& Events)
+{
+    DIO_EVENT events[FILTER_BENCH_READ];
+    size_t    count;
+
+    while ((count = Source.Read(events, FILTER_BENCH_READ)) != 0) {
+        Events.insert(Events.end(), events, events + count);
+    }
+}
+
+static void
+BenchFilterModel()
+{
+    DioSimBounceWaveform   bounce0(0, 20000000, 8, 1000000, 0xB0);
+    DioSimBounceWaveform   bounce1(1, 30000000, 8, 1000000, 0xB1);
+    DioSimBounceWaveform   bounce2(2, 50000000, 16, 2000000, 0xB2);
+    DioSimBounceWaveform   bounce3(3, 70000000, 4, 500000, 0xB3);
+    DioSimPoissonWaveform  glitches(0x000000F0, 800, 0x611);
+    DioSimPoissonWaveform  unfiltered(0x0000FF00, 200, 0x6F);
+    DioSimWaveformSource   raw(FILTER_BENCH_MODEL_SECONDS * 1000000000ULL);
+    DioSimWaveformSource   filtered(FILTER_BENCH_MODEL_SECONDS * 1000000000ULL);
+    std::vector<DIO_EVENT> expected;
+    uint64_t               played;
+    uint64_t               rejected;
+    uint64_t               mismatches = 0;
+    uint64_t               errors     = 0;
+    size_t                 count;
+    double                 seconds;
+
+    for (DioSimWaveformSource* source : { &raw, &filtered }) {
+
+        source->Add(&bounce0);
+        source->Add(&bounce1);
+        source->Add(&bounce2);
+        source->Add(&bounce3);
+        source->Add(&glitches);
+        source->Add(&unfiltered);
+    }
+
+    filtered.SetFilters(FILTER_BENCH_FILTERS, 0);
+
+    ReadAll(filtered, expected);
+
+    //
+    // The filter clocks count from when the BAR powers on, and the stream
+    // from when we start playing it: both at zero
+    //
+    DioSimClock::UseVirtualTime();
+
+    {
+        DioSimBar bar;
+
+        //
+        // Start the pins where the stream starts, so that the only changes
+        // are the stream's
+        //
+        bar.SetInputs(raw.InitialState());
+
+        FilterBenchIsr isr(bar, 0);
+        DioSimPlayer   player(bar);
+        BenchTimer     timer;
+
+        bar.Write((uint32_t)DioSimRegister::DI_FilterRegister_Port0and1, FILTER_BENCH_FILTERS);
+
+        played = player.Play(raw, 1.0);
+
+        //
+        // Let through whatever gets through the filters before the stream
+        // ends (the reference stops there too)
+        //
+        DioSimClock::AdvanceTo(FILTER_BENCH_MODEL_SECONDS * 1000000000ULL - 1);
+
+        seconds  = timer.ElapsedNs() / 1e9;
+        rejected = bar.FilterRejectCount();
+
+        //
+        // The first expected event just carries the initial state
+        //
+        count = isr.Changes.size();
+
+        for (size_t i = 0; i < count || i + 1 < expected.size(); i++) {
+
+            if (i >= count || i + 1 >= expected.size() ||
+                isr.Changes[i].Time != expected[i + 1].Timestamp ||
+                isr.Changes[i].Latched != expected[i + 1].LineState) {
+
+                mismatches++;
+            }
+
+            if (i < count && isr.Changes[i].Error) {
+                errors++;
+            }
+        }
+    }
+
+    DioSimClock::UseRealTime();
+
+    BenchReport("filters.model", "edges", (double)raw.Edges(), "events");
+    BenchReport("filters.model", "played", (double)played, "events");
+    BenchReport("filters.model", "rejected_pulses", (double)rejected, "events");
+    BenchReport("filters.model", "changes", (double)count, "events");
+    BenchReport("filters.model", "expected_changes", (double)(expected.size() - 1), "events");
+    BenchReport("filters.model", "mismatches", (double)mismatches, "events");
+    BenchReport("filters.model", "change_errors", (double)errors, "count");
+    BenchReport("filters.model", "speedup", FILTER_BENCH_MODEL_SECONDS / seconds, "x");
+}
+
+static void
+BenchFilterOverrun()
+{
+    DioSimPoissonWaveform            inputs(0x000000FF, FILTER_BENCH_OVERRUN_RATE, 0x0E);
+    DioSimWaveformSource             source(FILTER_BENCH_OVERRUN_MS * 1000000ULL);
+    std::vector<DIO_EVENT>           events;
+    std::vector<FILTER_BENCH_CHANGE> expected;
+    uint64_t                         acknowledged = 0;
+    uint64_t                         mismatches   = 0;
+    uint64_t                         errors       = 0;
+    size_t                           count;
+
+    source.Add(&inputs);
+
+    ReadAll(source, events);
+
+    //
+    // A change that comes once the last one has been acknowledged is
+    // latched, and the ISR sees it FILTER_BENCH_ISR_NS later.  One that
+    // comes before then is lost, and the ISR sees the error.
+    //
+    for (const DIO_EVENT& event : events) {
+
+        if (event.ChangedLines == 0) {
+            continue;
+        }
+
+        if (expected.empty() || event.Timestamp >= acknowledged) {
+
+            acknowledged = event.Timestamp + FILTER_BENCH_ISR_NS;
+
+            expected.push_back({ acknowledged, event.LineState, false });
+
+        } else {
+
+            expected.back().Error = true;
+        }
+    }
+
+    DioSimClock::UseVirtualTime();
+
+    {
+        DioSimBar bar;
+
+        source.Rewind();
+
+        bar.SetInputs(source.InitialState());
+
+        FilterBenchIsr isr(bar, FILTER_BENCH_ISR_NS);
+        DioSimPlayer   player(bar);
+
+        player.Play(source, 1.0);
+
+        DioSimClock::Advance(FILTER_BENCH_ISR_NS);
+
+        count = isr.Changes.size();
+
+        for (size_t i = 0; i < count || i < expected.size(); i++) {
+
+            if (i >= count || i >= expected.size() ||
+                isr.Changes[i].Time != expected[i].Time ||
+                isr.Changes[i].Latched != expected[i].Latched ||
+                isr.Changes[i].Error != expected[i].Error) {
+
+                mismatches++;
+            }
+
+            if (i < count && isr.Changes[i].Error) {
+                errors++;
+            }
+        }
+    }
+
+    DioSimClock::UseRealTime();
+
+    BenchReport("filters.overrun", "edges", (double)source.Edges(), "events");
+    BenchReport("filters.overrun", "changes", (double)count, "events");
+    BenchReport("filters.overrun", "overruns", (double)errors, "count");
+    BenchReport("filters.overrun", "lost", (double)(events.size() - 1 - count), "events");
+    BenchReport("filters.overrun", "mismatches", (double)mismatches, "events");
+}
+
+void
+BenchFilters()
+{
+    BenchFilterModel();
+    BenchFilterOverrun();
+}
@@ -0,0 +1,314 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        IndexBench.cpp -- Capture index query benchmarks
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "../DioCapture/DioCaptureIndex.h"
+#include "../DioCapture/DioCaptureReader.h"
+#include "../DioCapture/DioCaptureWriter.h"
+#include "BenchStreams.h"
+
+//
+// Size of the synthetic captures, how they're generated, and how many
+// queries we make against each
+//
+constexpr size_t   INDEX_BENCH_EVENTS     = 32 * 1000 * 1000;
+constexpr size_t   INDEX_BENCH_CHUNK      = 1000 * 1000;
+constexpr uint64_t INDEX_BENCH_MEAN_NS    = 20000;
+constexpr size_t   INDEX_BENCH_SAMPLES    = 4096;
+constexpr size_t   INDEX_BENCH_QUERIES    = 100000;
+constexpr size_t   INDEX_BENCH_SCANS      = 3;
+
+static const char IndexBenchFile[] = "DioBench.index.tmp";
+
+//
+// INDEX_SAMPLE
+//
+// A point in the capture where we know the answer: the state of the lines
+// at an event, and just before it.
+//
+typedef struct _INDEX_SAMPLE {
+    uint64_t    Timestamp;
+    uint32_t    StateAt;
+    uint32_t    StateBefore;
+} INDEX_SAMPLE;
+
+//
+// Write a large capture (and its index) of random activity on all lines,
+// a chunk at a time so that we never hold the whole stream in memory.
+// Returns the capture's size in bytes.
+//
+static uint64_t
+WriteIndexBenchCapture(uint32_t                   BlockPayloadBytes,
+                       std::vector<INDEX_SAMPLE>& Samples)
+{
+    BenchRandom            random(0x1D3);
+    DIO_CAPTURE_CONFIG     config;
+    DioCaptureFileSink     sink;
+    DioCaptureFileSink     indexSink;
+    std::vector<DIO_EVENT> chunk;
+    std::string            indexPath = DioCaptureIndexPath(IndexBenchFile);
+    uint64_t               time      = 0;
+    uint32_t               state     = 0;
+    size_t                 written   = 0;
+    size_t                 sampleEvery;
+
+    DioCaptureDefaultConfig(&config);
+
+    config.BlockPayloadBytes = BlockPayloadBytes;
+
+    if (!sink.Open(IndexBenchFile) || !indexSink.Open(indexPath.c_str())) {
+        return 0;
+    }
+
+    DioCaptureWriter writer(&sink, config);
+
+    writer.SetIndexSink(&indexSink);
+    writer.Begin();
+
+    sampleEvery = INDEX_BENCH_EVENTS / INDEX_BENCH_SAMPLES;
+
+    Samples.clear();
+
+    while (written < INDEX_BENCH_EVENTS) {
+
+        chunk.clear();
+
+        BenchGeneratePoisson(chunk,
+                             0xFFFFFFFF,
+                             INDEX_BENCH_MEAN_NS,
+                             1,
+                             INDEX_BENCH_CHUNK,
+                             time,
+                             random);
+
+        //
+        // Each chunk starts from all-zero lines, so carry the state over
+        // from the previous one
+        //
+        for (DIO_EVENT& event : chunk) {
+
+            event.LineState = state ^ event.ChangedLines;
+
+            if ((written % sampleEvery) == 0) {
+                Samples.push_back({ event.Timestamp, event.LineState, state });
+            }
+
+            state = event.LineState;
+
+            written++;
+        }
+
+        time = chunk.back().Timestamp;
+
+        writer.Append(chunk.data(), chunk.size(), 0);
+    }
+
+    writer.Finish();
+
+    return writer.BytesWritten();
+}
+
+static void
+RunIndexBench(const char* Name,
+              uint32_t    BlockPayloadBytes,
+              bool        CompareScan)
+{
+    std::vector<INDEX_SAMPLE> samples;
+    std::vector<uint64_t>     latencies;
+    std::string               indexPath = DioCaptureIndexPath(IndexBenchFile);
+    DioCaptureMappedReader    reader;
+    BenchRandom               random(0x5EEC);
+    uint64_t                  captureBytes;
+    uint64_t                  openIndexedNs;
+    uint64_t                  openScannedNs;
+    uint64_t                  mismatches = 0;
+    uint64_t                  totalNs    = 0;
+    uint32_t                  state;
+    size_t                    blocks;
+
+    captureBytes = WriteIndexBenchCapture(BlockPayloadBytes, samples);
+
+    if (captureBytes == 0) {
+
+        printf("%s: unable to create %s\n", Name, IndexBenchFile);
+
+        return;
+    }
+
+    //
+    // Open without the index, so the block headers must be scanned...
+    //
+    {
+        BenchTimer timer;
+
+        if (!reader.Open(IndexBenchFile, nullptr)) {
+
+            printf("%s: unable to open %s\n", Name, IndexBenchFile);
+
+            return;
+        }
+
+        openScannedNs = timer.ElapsedNs();
+    }
+
+    //
+    // ...and with it
+    //
+    {
+        BenchTimer timer;
+
+        reader.Open(IndexBenchFile, indexPath.c_str());
+
+        openIndexedNs = timer.ElapsedNs();
+    }
+
+    blocks = reader.BlockCount();
+
+    if (reader.IndexedBlocks() != blocks) {
+        mismatches++;
+    }
+
+    //
+    // Known answers first
+    //
+    for (const INDEX_SAMPLE& sample : samples) {
+
+        if (!reader.StateAt(sample.Timestamp, &state) ||
+            state != sample.StateAt) {
+            mismatches++;
+        }
+
+        if (!reader.StateAt(sample.Timestamp - 1, &state) ||
+            state != sample.StateBefore) {
+            mismatches++;
+        }
+    }
+
+    //
+    // Then time queries at random times across the whole capture
+    //
+    latencies.resize(INDEX_BENCH_QUERIES);
+
+    for (size_t i = 0; i < INDEX_BENCH_QUERIES; i++) {
+        uint64_t when;
+
+        when = reader.FirstTimestamp() +
+               random.Next() % (reader.LastTimestamp() - reader.FirstTimestamp() + 1);
+
+        BenchTimer timer;
+
+        reader.StateAt(when, &state);
+
+        latencies[i] = timer.ElapsedNs();
+        totalNs     += latencies[i];
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+
+    BenchReport(Name, "events", (double)INDEX_BENCH_EVENTS, "events");
+    BenchReport(Name, "capture_size", captureBytes / 1048576.0, "MB");
+    BenchReport(Name, "blocks", (double)blocks, "blocks");
+    BenchReport(Name, "index_size",
+                (sizeof(DIO_CAPTURE_INDEX_HEADER) +
+                 blocks * sizeof(DIO_CAPTURE_INDEX_ENTRY)) / 1024.0, "KB");
+    BenchReport(Name, "open_indexed", openIndexedNs / 1000.0, "us");
+    BenchReport(Name, "open_scanned", openScannedNs / 1000.0, "us");
+    BenchReport(Name, "query_mean", (double)totalNs / INDEX_BENCH_QUERIES, "ns");
+    BenchReport(Name, "query_p50", (double)latencies[INDEX_BENCH_QUERIES / 2], "ns");
+    BenchReport(Name, "query_p99", (double)latencies[INDEX_BENCH_QUERIES * 99 / 100], "ns");
+    BenchReport(Name, "query_max", (double)latencies.back(), "ns");
+    BenchReport(Name, "mismatches", (double)mismatches, "queries");
+
+    //
+    // For comparison, answer a few queries the hard way: reading from the
+    // start of the capture
+    //
+    if (CompareScan) {
+        uint64_t scanNs = 0;
+
+        for (size_t i = 0; i < INDEX_BENCH_SCANS; i++) {
+            DioCaptureReader scanner;
+            DIO_EVENT        events[256];
+            size_t           count;
+            uint64_t         when;
+            bool             done = false;
+
+            when = reader.FirstTimestamp() +
+                   random.Next() % (reader.LastTimestamp() - reader.FirstTimestamp() + 1);
+
+            BenchTimer timer;
+
+            scanner.Open(IndexBenchFile);
+
+            state = 0;
+
+            while (!done && (count = scanner.Read(events, 256)) != 0) {
+
+                for (size_t j = 0; j < count; j++) {
+
+                    if (events[j].Timestamp > when) {
+                        done = true;
+                        break;
+                    }
+
+                    state = events[j].LineState;
+                }
+            }
+
+            scanNs += timer.ElapsedNs();
+        }
+
+        BenchReport(Name, "scan_query_mean", scanNs / 1e3 / INDEX_BENCH_SCANS, "us");
+    }
+
+    reader.Close();
+
+    remove(indexPath.c_str());
+    remove(IndexBenchFile);
+}
+
+void
+BenchIndex()
+{
+    RunIndexBench("index.block_4k", 4 * 1024, false);
+    RunIndexBench("index.block_16k", 16 * 1024, false);
+    RunIndexBench("index.block_64k", 64 * 1024, true);
+}
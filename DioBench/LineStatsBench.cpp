@@ -0,0 +1,360 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        LineStatsBench.cpp -- Bit-plane transpose and per-line statistics benchmarks
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <cstring>
+
+#include "../DioCapture/DioLineStats.h"
+#include "BenchStreams.h"
+
+constexpr size_t LINESTATS_BENCH_UNITS  = 200000;
+constexpr size_t LINESTATS_BENCH_EVENTS = 16 * 1024 * 1024;
+constexpr int    LINESTATS_BENCH_PASSES = 3;
+
+//
+// Words per transpose in the transpose benchmark (which must divide
+// LINESTATS_BENCH_EVENTS), and the plane words that takes
+//
+constexpr size_t LINESTATS_BENCH_CHUNK       = 4096;
+constexpr size_t LINESTATS_BENCH_PLANE_WORDS = LINESTATS_BENCH_CHUNK / 64;
+
+//
+// The way we used to do it: look at every line of every event
+//
+static void
+BaselineTranspose(const uint32_t* Words,
+                  size_t          Count,
+                  uint64_t*       Planes,
+                  size_t          PlaneWords)
+{
+    memset(Planes, 0, 32 * PlaneWords * sizeof(uint64_t));
+
+    for (size_t i = 0; i < Count; i++) {
+
+        for (uint32_t line = 0; line < 32; line++) {
+
+            if ((Words[i] & (1U << line)) != 0) {
+                Planes[line * PlaneWords + i / 64] |= 1ULL << (i % 64);
+            }
+        }
+    }
+}
+
+static void
+BaselineAnalyze(const std::vector<DIO_EVENT>& Events,
+                DIO_LINE_STATS*               Stats)
+{
+    uint64_t levelSince[32];
+    uint32_t pulseValid = 0;
+    uint32_t state;
+
+    memset(Stats, 0, 32 * sizeof(DIO_LINE_STATS));
+
+    for (uint32_t line = 0; line < 32; line++) {
+
+        Stats[line].MinHighPulse = UINT64_MAX;
+        Stats[line].MinLowPulse  = UINT64_MAX;
+        levelSince[line]         = Events[0].Timestamp;
+    }
+
+    state = Events[0].LineState ^ Events[0].ChangedLines;
+
+    for (const DIO_EVENT& event : Events) {
+        uint32_t changed = event.LineState ^ state;
+
+        for (uint32_t line = 0; line < 32; line++) {
+            uint32_t        bit   = 1U << line;
+            DIO_LINE_STATS& stats = Stats[line];
+            uint64_t        width;
+            uint32_t        bucket;
+
+            if ((changed & bit) == 0) {
+                continue;
+            }
+
+            width  = event.Timestamp - levelSince[line];
+            bucket = 0;
+
+            while (bucket < 64 && (width >> bucket) != 0) {
+                bucket++;
+            }
+
+            stats.Transitions++;
+
+            if ((state & bit) != 0) {
+
+                stats.HighTime += width;
+
+                if ((pulseValid & bit) != 0) {
+                    stats.HighPulses++;
+                    stats.HighPulseHistogram[bucket]++;
+                    stats.MinHighPulse = width < stats.MinHighPulse ? width : stats.MinHighPulse;
+                    stats.MaxHighPulse = width > stats.MaxHighPulse ? width : stats.MaxHighPulse;
+                }
+
+            } else {
+
+                stats.RisingEdges++;
+                stats.LowTime += width;
+
+                if ((pulseValid & bit) != 0) {
+                    stats.LowPulses++;
+                    stats.LowPulseHistogram[bucket]++;
+                    stats.MinLowPulse = width < stats.MinLowPulse ? width : stats.MinLowPulse;
+                    stats.MaxLowPulse = width > stats.MaxLowPulse ? width : stats.MaxLowPulse;
+                }
+            }
+
+            levelSince[line]  = event.Timestamp;
+            pulseValid       |= bit;
+        }
+
+        state = event.LineState;
+    }
+
+    for (uint32_t line = 0; line < 32; line++) {
+
+        if ((state & (1U << line)) != 0) {
+            Stats[line].HighTime += Events.back().Timestamp - levelSince[line];
+        } else {
+            Stats[line].LowTime += Events.back().Timestamp - levelSince[line];
+        }
+    }
+}
+
+//
+// Transpose Words a chunk at a time, as the analyzer does, so that we're
+// timing the kernel rather than cache misses on enormous planes
+//
+static uint64_t
+TimeTranspose(const std::vector<uint32_t>& Words,
+              bool                         Baseline,
+              std::vector<uint64_t>&       Planes)
+{
+    uint64_t best = UINT64_MAX;
+
+    for (int pass = 0; pass < LINESTATS_BENCH_PASSES; pass++) {
+
+        BenchTimer timer;
+
+        for (size_t start = 0; start < Words.size(); start += LINESTATS_BENCH_CHUNK) {
+            uint64_t* planes = Planes.data() + (start / LINESTATS_BENCH_CHUNK) *
+                                               32 * LINESTATS_BENCH_PLANE_WORDS;
+
+            if (Baseline) {
+
+                BaselineTranspose(Words.data() + start,
+                                  LINESTATS_BENCH_CHUNK,
+                                  planes,
+                                  LINESTATS_BENCH_PLANE_WORDS);
+            } else {
+
+                DioTransposeToPlanes(Words.data() + start,
+                                     LINESTATS_BENCH_CHUNK,
+                                     planes,
+                                     LINESTATS_BENCH_PLANE_WORDS);
+            }
+        }
+
+        uint64_t elapsed = timer.ElapsedNs();
+
+        best = elapsed < best ? elapsed : best;
+    }
+
+    return best;
+}
+
+static void
+RunTransposeBench(const char*                  Name,
+                  const std::vector<uint32_t>& Words)
+{
+    std::vector<uint64_t> expected(Words.size() / 2);
+    std::vector<uint64_t> planes(Words.size() / 2);
+    uint64_t              baselineNs;
+    uint64_t              scalarNs;
+    uint64_t              simdNs     = 0;
+    bool                  simd       = DioSimdEnabled();
+    uint64_t              mismatches = 0;
+
+    baselineNs = TimeTranspose(Words, true, expected);
+
+    DioUseSimd(false);
+
+    scalarNs    = TimeTranspose(Words, false, planes);
+    mismatches += planes != expected;
+
+    if (simd) {
+
+        DioUseSimd(true);
+
+        simdNs      = TimeTranspose(Words, false, planes);
+        mismatches += planes != expected;
+    }
+
+    BenchReport(Name, "baseline", (double)baselineNs / Words.size(), "ns/word");
+    BenchReport(Name, "scalar", (double)scalarNs / Words.size(), "ns/word");
+
+    if (simd) {
+        BenchReport(Name, "avx2", (double)simdNs / Words.size(), "ns/word");
+        BenchReport(Name, "avx2_speedup", (double)baselineNs / simdNs, "x");
+    }
+
+    BenchReport(Name, "mismatches", (double)mismatches, "runs");
+}
+
+static void
+RunAnalyzeBench(const char*                   Name,
+                const std::vector<DIO_EVENT>& Events)
+{
+    DIO_LINE_STATS  expected[32];
+    DioLineAnalyzer analyzer;
+    uint64_t        baselineNs = UINT64_MAX;
+    uint64_t        scalarNs   = UINT64_MAX;
+    uint64_t        simdNs     = UINT64_MAX;
+    bool            simd       = DioSimdEnabled();
+    uint64_t        mismatches = 0;
+    uint64_t        allocations;
+
+    for (int pass = 0; pass < LINESTATS_BENCH_PASSES; pass++) {
+
+        BenchTimer timer;
+
+        BaselineAnalyze(Events, expected);
+
+        baselineNs = timer.ElapsedNs() < baselineNs ? timer.ElapsedNs() : baselineNs;
+    }
+
+    for (int mode = 0; mode < (simd ? 2 : 1); mode++) {
+        uint64_t& best = mode == 0 ? scalarNs : simdNs;
+
+        DioUseSimd(mode == 1);
+
+        for (int pass = 0; pass < LINESTATS_BENCH_PASSES; pass++) {
+
+            analyzer.Reset();
+
+            allocations = BenchAllocationCount();
+
+            BenchTimer timer;
+
+            analyzer.Process(Events.data(), Events.size());
+            analyzer.Finish(Events.back().Timestamp);
+
+            best        = timer.ElapsedNs() < best ? timer.ElapsedNs() : best;
+            allocations = BenchAllocationCount() - allocations;
+        }
+
+        for (uint32_t line = 0; line < 32; line++) {
+
+            if (memcmp(&analyzer.Line(line), &expected[line], sizeof(DIO_LINE_STATS)) != 0) {
+                mismatches++;
+            }
+        }
+    }
+
+    BenchReport(Name, "events", (double)Events.size(), "events");
+    BenchReport(Name, "baseline", (double)baselineNs / Events.size(), "ns/event");
+    BenchReport(Name, "scalar", (double)scalarNs / Events.size(), "ns/event");
+
+    if (simd) {
+        BenchReport(Name, "avx2", (double)simdNs / Events.size(), "ns/event");
+        BenchReport(Name, "avx2_speedup", (double)baselineNs / simdNs, "x");
+    }
+
+    BenchReport(Name, "allocations", (double)allocations, "allocs");
+    BenchReport(Name, "mismatched_lines", (double)mismatches, "lines");
+}
+
+void
+BenchLineStats()
+{
+    BenchRandom            random(0xB17);
+    std::vector<uint32_t>  words(LINESTATS_BENCH_EVENTS);
+    std::vector<DIO_EVENT> uartEvents;
+    std::vector<DIO_EVENT> spiEvents;
+    std::vector<DIO_EVENT> i2cEvents;
+    std::vector<DIO_EVENT> mixedEvents;
+    std::vector<DIO_EVENT> denseEvents(LINESTATS_BENCH_EVENTS);
+    std::vector<uint32_t>  payload;
+    bool                   simd = DioSimdEnabled();
+
+    BenchReport("linestats", "avx2_available", simd ? 1.0 : 0.0, "bool");
+
+    //
+    // Transposing dense (random) and sparse (one bit) words
+    //
+    for (uint32_t& word : words) {
+        word = (uint32_t)random.Next();
+    }
+
+    RunTransposeBench("linestats.transpose_dense", words);
+
+    for (uint32_t& word : words) {
+        word = 1U << random.Below(32);
+    }
+
+    RunTransposeBench("linestats.transpose_sparse", words);
+
+    //
+    // Full analysis of a realistic mixed protocol capture, and of a dense
+    // one in which every line is a random signal sampled every 100ns
+    //
+    BenchGenerateUart(uartEvents, payload, 0, 115200, LINESTATS_BENCH_UNITS, 1000, random);
+    BenchGenerateSpi(spiEvents, payload, 8, 1000000, LINESTATS_BENCH_UNITS, 1000, random);
+    BenchGenerateI2c(i2cEvents, payload, 16, 400000, LINESTATS_BENCH_UNITS, 1000, random);
+
+    const std::vector<DIO_EVENT>* streams[] = { &uartEvents, &spiEvents, &i2cEvents };
+
+    BenchMergeStreams(mixedEvents, streams, 3);
+
+    uint32_t state = 0;
+
+    for (size_t i = 0; i < denseEvents.size(); i++) {
+        uint32_t next = (uint32_t)random.Next();
+
+        denseEvents[i].Timestamp    = 100 * (i + 1);
+        denseEvents[i].LineState    = next;
+        denseEvents[i].ChangedLines = next ^ state;
+
+        state = next;
+    }
+
+    RunAnalyzeBench("linestats.analyze_mixed", mixedEvents);
+    RunAnalyzeBench("linestats.analyze_dense", denseEvents);
+
+    DioUseSimd(simd);
+}
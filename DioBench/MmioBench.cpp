@@ -0,0 +1,180 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        MmioBench.cpp -- Register accesses per interrupt, per
+//                         Request and per power transition
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      A register access has to cross the bus, so the number our ISR makes
+//      is what its time is mostly spent on.  With register profiling on,
+//      the field changes the input lines MMIO_BENCH_CHANGES times, and
+//      after each change an application writes the output lines and reads
+//      them back (two Requests).  We then report what
+//      IOCTL_OSRDIO_GET_REGISTER_PROFILE would: for each path (isr, dpc,
+//      ioctl, power), how many times it ran, the register reads and writes
+//      it made per run, and how long those took in the model.  Each
+//      register a path touched gets its reads and writes per run, named by
+//      its offset.
+//
+//      We do it twice.  The first time (mmio.*), an access costs only the
+//      locked call into the model, so the counts are what matter.  The
+//      second time (mmio.pcie.*), the BAR has DIO_SIM_PCIE_LATENCY, and the
+//      times are in the ratios they'd be on the hardware: each read a round
+//      trip across PCIe, each write posted and cheap.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <chrono>
+#include <thread>
+
+#include "../DioSim/DioSimDevice.h"
+#include "DioBench.h"
+
+constexpr uint32_t MMIO_BENCH_CHANGES = 2000;
+constexpr uint32_t MMIO_BENCH_PACE_US = 100;
+
+static const char* MmioBenchPathNames[DIO_SIM_PATHS] = {
+    "mmio.isr", "mmio.dpc", "mmio.ioctl", "mmio.power"
+};
+
+static const char* MmioBenchPciePathNames[DIO_SIM_PATHS] = {
+    "mmio.pcie.isr", "mmio.pcie.dpc", "mmio.pcie.ioctl", "mmio.pcie.power"
+};
+
+static void
+ReportPath(const char*                     Name,
+           const DIO_SIM_REGISTER_PROFILE& Profile,
+           uint32_t                        Path)
+{
+    uint64_t runs      = Profile.Runs[Path];
+    uint64_t reads     = 0;
+    uint64_t writes    = 0;
+    uint64_t readTime  = 0;
+    uint64_t writeTime = 0;
+    char     metric[64];
+
+    BenchReport(Name, "runs", (double)runs, "count");
+
+    if (runs == 0) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < DIO_REGISTER_COUNT; i++) {
+        reads     += Profile.Accesses[i][Path].Reads;
+        writes    += Profile.Accesses[i][Path].Writes;
+        readTime  += Profile.Accesses[i][Path].ReadTime;
+        writeTime += Profile.Accesses[i][Path].WriteTime;
+    }
+
+    BenchReport(Name, "reads", (double)reads / runs, "count");
+    BenchReport(Name, "writes", (double)writes / runs, "count");
+
+    if (reads != 0) {
+        BenchReport(Name, "read_ns", (double)readTime / reads, "ns");
+    }
+
+    if (writes != 0) {
+        BenchReport(Name, "write_ns", (double)writeTime / writes, "ns");
+    }
+
+    for (uint32_t i = 0; i < DIO_REGISTER_COUNT; i++) {
+
+        const DIO_SIM_REGISTER_ACCESSES& accesses = Profile.Accesses[i][Path];
+
+        if (accesses.Reads != 0) {
+            snprintf(metric, sizeof(metric), "0x%05x_reads", DioRegisterOffsets[i]);
+            BenchReport(Name, metric, (double)accesses.Reads / runs, "count");
+        }
+
+        if (accesses.Writes != 0) {
+            snprintf(metric, sizeof(metric), "0x%05x_writes", DioRegisterOffsets[i]);
+            BenchReport(Name, metric, (double)accesses.Writes / runs, "count");
+        }
+    }
+}
+
+static void
+MmioBenchRun(const char*                Name,
+             const char* const          PathNames[DIO_SIM_PATHS],
+             const DIO_SIM_BAR_LATENCY& Latency)
+{
+    DioSimDevice             device(1024, DioSimUnfilteredProfile);
+    DioSimHandle             handle(device, DIO_SIM_NO_PORT);
+    DIO_SIM_REGISTER_PROFILE profile;
+    uint32_t                 lineState;
+    uint32_t                 errors = 0;
+
+    device.Bar().SetLatency(Latency);
+
+    device.SetRegisterProfiling(true);
+
+    if (handle.SetOutputs(0xFF000000) != DioSimStatus::Success) {
+        errors++;
+    }
+
+    for (uint32_t i = 0; i < MMIO_BENCH_CHANGES; i++) {
+
+        device.Bar().SetInputs((i & 0xFF) * 0x00010101);
+
+        if (handle.Write((i & 0xFF) << 24) != DioSimStatus::Success ||
+            handle.Read(&lineState) != DioSimStatus::Success ||
+            (lineState >> 24) != (i & 0xFF)) {
+            errors++;
+        }
+
+        std::this_thread::sleep_for(std::chrono::microseconds(MMIO_BENCH_PACE_US));
+    }
+
+    //
+    // Let the ISR and DpcForIsr catch up before we look
+    //
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    profile = device.RegisterProfile();
+
+    for (uint32_t path = 0; path < DIO_SIM_PATHS; path++) {
+        ReportPath(PathNames[path], profile, path);
+    }
+
+    BenchReport(Name, "errors", (double)errors, "count");
+}
+
+void
+BenchMmio()
+{
+    MmioBenchRun("mmio", MmioBenchPathNames, DIO_SIM_NO_LATENCY);
+
+    MmioBenchRun("mmio.pcie", MmioBenchPciePathNames, DIO_SIM_PCIE_LATENCY);
+}
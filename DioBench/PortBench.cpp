@@ -0,0 +1,202 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        PortBench.cpp -- Interference between applications using
+//                         different ports of the device
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      Four applications (threads, each with its own handle to the
+//      simulated device) each own one port.  One of them, the victim,
+//      writes its port at a steady pace and times every write; the other
+//      three write theirs as fast as they can.  Every Request takes the
+//      simulated driver BENCH_PORT_REQUEST_NS to process, holding its Queue,
+//      which is about what an IOCTL round trip and a couple of register
+//      accesses cost on the real hardware.
+//
+//      We time the victim alone, then with the others all going through the
+//      device's one Queue (as before there were ports), then with each port
+//      on its own Queue.
+//
+//      On a machine with fewer CPUs than applications the others can only
+//      get in the victim's way when the scheduler preempts one of them in
+//      the middle of a Request, so the difference shows up in the tail
+//      (p99.9, stalls) rather than the median.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "../DioSim/DioSimDevice.h"
+#include "DioBench.h"
+
+constexpr uint32_t PORT_BENCH_WRITES     = 20000;
+constexpr uint32_t PORT_BENCH_REQUEST_NS = 2000;
+constexpr uint32_t PORT_BENCH_PACE_NS    = 10000;
+
+static void
+RunPorts(const char* Name,
+         bool        PortQueues,
+         uint32_t    Aggressors)
+{
+    DioSimDevice             device(1024, DioSimUnfilteredProfile);
+    std::vector<uint64_t>    latencies;
+    std::vector<std::thread> threads;
+    std::atomic<bool>        done(false);
+    std::atomic<uint64_t>    aggressorWrites(0);
+    std::atomic<uint64_t>    errors(0);
+
+    device.SetRequestCost(PORT_BENCH_REQUEST_NS);
+    device.SetPortQueues(PortQueues);
+
+    DioSimHandle victim(device, 0);
+
+    errors += victim.SetOutputs(DioSimPortLines(0)) != DioSimStatus::Success;
+
+    for (uint32_t port = 1; port <= Aggressors; port++) {
+
+        threads.emplace_back([&device, &done, &aggressorWrites, &errors, port] {
+            DioSimHandle handle(device, port);
+            uint64_t     writes = 0;
+
+            if (handle.SetOutputs(DioSimPortLines(port)) != DioSimStatus::Success) {
+                errors++;
+            }
+
+            while (!done.load(std::memory_order_relaxed)) {
+
+                if (handle.Write(((uint32_t)writes & 0xFF) << (port * DIO_SIM_LINES_PER_PORT)) !=
+                    DioSimStatus::Success) {
+                    errors++;
+                }
+
+                writes++;
+            }
+
+            aggressorWrites += writes;
+        });
+    }
+
+    latencies.reserve(PORT_BENCH_WRITES);
+
+    auto       next = std::chrono::steady_clock::now();
+    BenchTimer timer;
+
+    for (uint32_t i = 0; i < PORT_BENCH_WRITES; i++) {
+
+        next += std::chrono::nanoseconds(PORT_BENCH_PACE_NS);
+
+        while (std::chrono::steady_clock::now() < next) {
+        }
+
+        BenchTimer write;
+
+        errors += victim.Write(i & 0xFF) != DioSimStatus::Success;
+
+        latencies.push_back(write.ElapsedNs());
+    }
+
+    uint64_t elapsed = timer.ElapsedNs();
+
+    done = true;
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    //
+    // The other ports' lines are the other applications' business, but
+    // ours must be exactly what we last wrote
+    //
+    uint32_t lineState = 0;
+
+    victim.Read(&lineState);
+
+    errors += (lineState & 0xFF) != ((PORT_BENCH_WRITES - 1) & 0xFF);
+
+    std::sort(latencies.begin(), latencies.end());
+
+    //
+    // A write that took more than twice the cost of processing it spent
+    // the rest waiting for somebody else's Request
+    //
+    uint64_t stalls = latencies.end() -
+                      std::upper_bound(latencies.begin(),
+                                       latencies.end(),
+                                       2 * (uint64_t)PORT_BENCH_REQUEST_NS);
+
+    BenchReport(Name, "victim_write_p50", latencies[latencies.size() / 2] / 1e3, "us");
+    BenchReport(Name, "victim_write_p99", latencies[latencies.size() * 99 / 100] / 1e3, "us");
+    BenchReport(Name, "victim_write_p999", latencies[latencies.size() * 999 / 1000] / 1e3, "us");
+    BenchReport(Name, "victim_write_max", latencies.back() / 1e3, "us");
+    BenchReport(Name, "victim_stalls", (double)stalls, "writes");
+    BenchReport(Name, "other_writes", aggressorWrites * 1e3 / elapsed, "Mwrites/s");
+    BenchReport(Name, "errors", (double)errors.load(), "errors");
+}
+
+//
+// Check the rules of the port namespaces: a port handle can only reserve
+// lines on its own port, and still can't take lines somebody else has.
+//
+static void
+CheckPortRules()
+{
+    DioSimDevice device(64, DioSimUnfilteredProfile);
+    DioSimHandle port1(device, 1);
+    DioSimHandle whole(device);
+    uint64_t     errors = 0;
+
+    errors += port1.SetOutputs(DioSimPortLines(0)) != DioSimStatus::InvalidParameter;
+    errors += port1.SetOutputs(DioSimPortLines(1) | 0x1) != DioSimStatus::InvalidParameter;
+    errors += whole.SetOutputs(0x100) != DioSimStatus::Success;
+    errors += port1.SetOutputs(0x300) != DioSimStatus::SharingViolation;
+    errors += port1.SetOutputs(0x200) != DioSimStatus::Success;
+    errors += port1.Write(0x100) != DioSimStatus::SharingViolation;
+    errors += port1.Write(0x200) != DioSimStatus::Success;
+
+    BenchReport("ports.rules", "errors", (double)errors, "errors");
+}
+
+void
+BenchPorts()
+{
+    CheckPortRules();
+
+    RunPorts("ports.alone", true, 0);
+    RunPorts("ports.one_queue", false, 3);
+    RunPorts("ports.port_queues", true, 3);
+}
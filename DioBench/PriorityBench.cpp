@@ -0,0 +1,209 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        PriorityBench.cpp -- Completion latency of change waiters
+//                             in each priority class
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      Three applications watch each port: a safety monitor (realtime), a
+//      controller (normal) and a logger (background), each waiting for
+//      changes with IOCTL_OSRDIO_WAITFOR_CHANGE on its own port handle.
+//      Every change we make changes every port, and we time how long after
+//      it each application's Request was completed by the simulated driver,
+//      which takes PRIORITY_BENCH_COMPLETION_NS to complete each Request.
+//
+//      First every application waits as a normal Request, as they did
+//      before there were priority classes, so the three on each port
+//      compete for one completion per change.  Then each waits in its own
+//      class.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../DioSim/DioSimDevice.h"
+#include "DioBench.h"
+
+constexpr uint32_t PRIORITY_BENCH_CHANGES       = 5000;
+constexpr uint32_t PRIORITY_BENCH_COMPLETION_NS = 1000;
+constexpr uint32_t PRIORITY_BENCH_PACE_US       = 200;
+
+static const char* const PriorityNames[DIO_SIM_PRIORITY_COUNT] = {
+    "realtime",
+    "normal",
+    "background",
+};
+
+//
+// One application: what it waits for, and what it saw
+//
+typedef struct _PRIORITY_WAITER {
+    uint32_t              Port;
+    DioSimPriority        Priority;
+    std::vector<uint64_t> LatencyNs;
+} PRIORITY_WAITER, *PPRIORITY_WAITER;
+
+static void
+RunPriority(const char* Name,
+            bool        Classes)
+{
+    DioSimDevice                               device(1024, DioSimUnfilteredProfile);
+    std::vector<std::unique_ptr<DioSimHandle>> handles;
+    std::vector<PRIORITY_WAITER>               waiters;
+    std::vector<std::thread>                   threads;
+    std::atomic<uint64_t>                      changeTime[256];
+    std::atomic<uint32_t>                      finished(0);
+    std::atomic<bool>                          done(false);
+
+    device.SetCompletionCost(PRIORITY_BENCH_COMPLETION_NS);
+
+    for (uint32_t port = 0; port < DIO_SIM_PORT_COUNT; port++) {
+
+        for (uint32_t priority = 0; priority < DIO_SIM_PRIORITY_COUNT; priority++) {
+
+            handles.emplace_back(new DioSimHandle(device, port));
+
+            waiters.push_back({ port, static_cast<DioSimPriority>(priority), {} });
+        }
+    }
+
+    for (std::atomic<uint64_t>& time : changeTime) {
+        time = 0;
+    }
+
+    for (size_t i = 0; i < waiters.size(); i++) {
+
+        threads.emplace_back([&, i] {
+            PPRIORITY_WAITER waiter = &waiters[i];
+            DioSimPriority   priority;
+            DIO_SIM_CHANGE   change;
+
+            priority = Classes ? waiter->Priority : DioSimPriority::Normal;
+
+            waiter->LatencyNs.reserve(PRIORITY_BENCH_CHANGES);
+
+            while (!done.load(std::memory_order_relaxed) &&
+                   handles[i]->WaitForChange(priority, &change) == DioSimStatus::Success) {
+
+                uint32_t index = (change.LatchedLineState >>
+                                  (waiter->Port * DIO_SIM_LINES_PER_PORT)) & 0xFF;
+
+                waiter->LatencyNs.push_back(change.CompletionTime - changeTime[index]);
+            }
+
+            finished++;
+        });
+    }
+
+    //
+    // Give everyone time to start waiting
+    //
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    for (uint32_t i = 1; i <= PRIORITY_BENCH_CHANGES; i++) {
+
+        //
+        // Don't change the lines again until the last change has been
+        // acknowledged, or the device will report a change detect error
+        //
+        while (device.Bar().InterruptPending()) {
+            std::this_thread::yield();
+        }
+
+        changeTime[i & 0xFF] = DioSimEventRing::Now();
+
+        device.Bar().SetInputs((i & 0xFF) * 0x01010101);
+
+        std::this_thread::sleep_for(std::chrono::microseconds(PRIORITY_BENCH_PACE_US));
+    }
+
+    //
+    // Keep cancelling until everyone's noticed we're done (an application
+    // might be just about to wait again)
+    //
+    done = true;
+
+    while (finished != threads.size()) {
+
+        for (std::unique_ptr<DioSimHandle>& handle : handles) {
+            handle->Cancel();
+        }
+
+        std::this_thread::yield();
+    }
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    for (uint32_t priority = 0; priority < DIO_SIM_PRIORITY_COUNT; priority++) {
+
+        std::vector<uint64_t> latencies;
+        char                  metric[64];
+
+        for (PRIORITY_WAITER& waiter : waiters) {
+
+            if (static_cast<uint32_t>(waiter.Priority) == priority) {
+                latencies.insert(latencies.end(),
+                                 waiter.LatencyNs.begin(),
+                                 waiter.LatencyNs.end());
+            }
+        }
+
+        snprintf(metric, sizeof(metric), "%s_seen", PriorityNames[priority]);
+        BenchReport(Name,
+                    metric,
+                    100.0 * latencies.size() / (PRIORITY_BENCH_CHANGES * DIO_SIM_PORT_COUNT),
+                    "%");
+
+        snprintf(metric, sizeof(metric), "%s_p50", PriorityNames[priority]);
+        BenchReport(Name, metric, BenchPercentile(latencies, 0.5) / 1e3, "us");
+
+        snprintf(metric, sizeof(metric), "%s_p99", PriorityNames[priority]);
+        BenchReport(Name, metric, BenchPercentile(latencies, 0.99) / 1e3, "us");
+    }
+
+    BenchReport(Name, "change_errors", (double)device.ChangeErrorCount(), "errors");
+}
+
+void
+BenchPriority()
+{
+    RunPriority("priority.equal", false);
+    RunPriority("priority.classes", true);
+}
@@ -0,0 +1,162 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        ReconfigBench.cpp -- Reconfiguring the lines with separate
+//                             Requests, and with one line profile
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      An application switches the lines, RECONFIG_BENCH_SWITCHES times,
+//      between two configurations: port 0 outputs (RECONFIG_BENCH_A), and
+//      ports 0 and 1 outputs (RECONFIG_BENCH_B), with port 0 in the same
+//      state in both.  The field holds the input lines asserted.  Each
+//      Request takes RECONFIG_BENCH_REQUEST_US, for the round trip to the
+//      driver.  We run three cases:
+//
+//          ioctls  As it's always been done: IOCTL_OSRDIO_SET_OUTPUTS, then
+//                  IOCTL_OSRDIO_WRITE, with every line register rewritten
+//                  each time the lines are programmed
+//
+//          full    One IOCTL_OSRDIO_APPLY_PROFILE, still rewriting every
+//                  line register
+//
+//          diff    One IOCTL_OSRDIO_APPLY_PROFILE, writing only the
+//                  registers that change
+//
+//      For each, we report how many register writes (the ISR's included)
+//      and Requests each switch took, how long each took, and how many changes the device
+//      reported on the (unchanging) input lines: switching a line that
+//      detects changes from input to output looks like a change.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../DioSim/DioSimDevice.h"
+#include "DioBench.h"
+
+constexpr uint32_t RECONFIG_BENCH_SWITCHES   = 1000;
+constexpr uint32_t RECONFIG_BENCH_REQUEST_US = 20;
+
+constexpr DIO_SIM_LINE_PROFILE RECONFIG_BENCH_A = {
+    0x000000FF, 0x00000055, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF
+};
+
+constexpr DIO_SIM_LINE_PROFILE RECONFIG_BENCH_B = {
+    0x0000FFFF, 0x0000A555, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF
+};
+
+enum class ReconfigBenchMethod {
+    Ioctls,
+    Full,
+    Diff,
+};
+
+static void
+RunReconfig(const char*         Name,
+            ReconfigBenchMethod Method)
+{
+    DioSimDevice          device(1024);
+    DioSimHandle          handle(device, DIO_SIM_NO_PORT);
+    std::vector<uint64_t> times;
+    uint64_t              startWrites;
+    uint64_t              startEvents;
+    uint32_t              requests = 0;
+    uint32_t              errors   = 0;
+
+    device.SetLineRegisterShadow(Method == ReconfigBenchMethod::Diff);
+
+    device.Bar().SetInputs(0xFFFFFFFF);
+
+    device.SetRequestCost(RECONFIG_BENCH_REQUEST_US * 1000);
+
+    handle.ApplyProfile(RECONFIG_BENCH_A);
+
+    //
+    // Let the ISR see the field's change before we start counting
+    //
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    startWrites = device.Bar().WriteCount();
+    startEvents = device.Ring().Ring()->ProducerIndex.load();
+
+    for (uint32_t i = 0; i < RECONFIG_BENCH_SWITCHES; i++) {
+
+        const DIO_SIM_LINE_PROFILE& profile = (i & 1) == 0 ? RECONFIG_BENCH_B :
+                                                             RECONFIG_BENCH_A;
+        uint64_t                    startTime = DioSimEventRing::Now();
+
+        if (Method == ReconfigBenchMethod::Ioctls) {
+
+            if (handle.SetOutputs(profile.OutputLines) != DioSimStatus::Success ||
+                handle.Write(profile.OutputState) != DioSimStatus::Success) {
+                errors++;
+            }
+
+            requests += 2;
+
+        } else {
+
+            if (handle.ApplyProfile(profile) != DioSimStatus::Success) {
+                errors++;
+            }
+
+            requests++;
+        }
+
+        times.push_back(DioSimEventRing::Now() - startTime);
+
+        if ((device.Bar().LineLevels() & profile.OutputLines) != profile.OutputState) {
+            errors++;
+        }
+    }
+
+    BenchReport(Name, "writes", (double)(device.Bar().WriteCount() - startWrites) / RECONFIG_BENCH_SWITCHES, "count");
+    BenchReport(Name, "requests", (double)requests / RECONFIG_BENCH_SWITCHES, "count");
+    BenchReport(Name, "switch_p50", BenchPercentile(times, 0.5) / 1e3, "us");
+    BenchReport(Name, "switch_p99", BenchPercentile(times, 0.99) / 1e3, "us");
+    BenchReport(Name, "spurious_changes",
+                (double)(device.Ring().Ring()->ProducerIndex.load() - startEvents), "count");
+    BenchReport(Name, "errors", (double)errors, "count");
+}
+
+void
+BenchReconfig()
+{
+    RunReconfig("reconfig.ioctls", ReconfigBenchMethod::Ioctls);
+    RunReconfig("reconfig.full", ReconfigBenchMethod::Full);
+    RunReconfig("reconfig.diff", ReconfigBenchMethod::Diff);
+}
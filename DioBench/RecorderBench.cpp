@@ -0,0 +1,308 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        RecorderBench.cpp -- Sustained rate of recording from an event
+//                             ring, zero-copy versus copying
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      A producer thread fills a simulated event ring (exactly as the
+//      driver's ISR fills one attached with IOCTL_OSRDIO_ATTACH_EVENT_RING)
+//      as fast as the consumer will take the events, so what we measure is
+//      the most the consumer can sustain.  We compare the capture recorder
+//      (encoding in place from the ring into the async file sink's buffers)
+//      with the straightforward way of doing the same thing: copying events
+//      out of the ring with a DioEventSource and writing blocks through
+//      stdio.  Both files are read back and checked.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <thread>
+
+#include "../DioCapture/DioCaptureIndex.h"
+#include "../DioCapture/DioCaptureReader.h"
+#include "../DioCapture/DioCaptureRecorder.h"
+#include "../DioSim/DioSimEventRing.h"
+#include "BenchStreams.h"
+
+constexpr size_t   RECORDER_BENCH_EVENTS    = 2000000;
+constexpr int      RECORDER_BENCH_REPEATS   = 10;
+constexpr uint32_t RECORDER_BENCH_RING      = 65536;
+constexpr size_t   RECORDER_BENCH_BATCH     = 64;
+constexpr uint64_t RECORDER_BENCH_FREQUENCY = 10000000;
+constexpr uint64_t RECORDER_BENCH_ROTATE    = 16 * 1024 * 1024;
+
+static const char RecorderBenchPrefix[] = "DioBench.recorder";
+static const char RecorderBenchCopyFile[] = "DioBench.recorder.copy.tmp";
+
+//
+// Feed the events to the ring RECORDER_BENCH_REPEATS times over (moving the
+// timestamps along each time), in batches about the size the driver would
+// publish under load, never letting the ring overflow.
+//
+static void
+ProduceEvents(DioSimEventRing&              Ring,
+              const std::vector<DIO_EVENT>& Events)
+{
+    PDIO_EVENT_RING ring;
+    uint64_t        span;
+    DIO_EVENT       batch[RECORDER_BENCH_BATCH];
+    size_t          count;
+    uint32_t        used;
+
+    ring = Ring.Ring();
+    span = Events.back().Timestamp + 100;
+
+    for (int repeat = 0; repeat < RECORDER_BENCH_REPEATS; repeat++) {
+
+        for (size_t i = 0; i < Events.size(); i += count) {
+
+            count = std::min(RECORDER_BENCH_BATCH, Events.size() - i);
+
+            for (size_t j = 0; j < count; j++) {
+
+                batch[j]            = Events[i + j];
+                batch[j].Timestamp += span * repeat;
+            }
+
+            do {
+                used = ring->ProducerIndex.load(std::memory_order_relaxed) -
+                       ring->ConsumerIndex.load(std::memory_order_acquire);
+
+                if (used + count > ring->Capacity) {
+                    std::this_thread::yield();
+                }
+            } while (used + count > ring->Capacity);
+
+            Ring.Produce(batch, count);
+        }
+    }
+
+    Ring.Finish();
+}
+
+//
+// Read Files back in order and count the events that don't match what we
+// produced
+//
+static uint64_t
+CheckFiles(const std::vector<std::string>& Files,
+           const std::vector<DIO_EVENT>&   Events)
+{
+    DIO_EVENT events[256];
+    uint64_t  span;
+    uint64_t  position = 0;
+    uint64_t  total;
+    uint64_t  mismatches = 0;
+    size_t    count;
+
+    span  = Events.back().Timestamp + 100;
+    total = Events.size() * RECORDER_BENCH_REPEATS;
+
+    for (const std::string& file : Files) {
+        DioCaptureReader reader;
+
+        if (!reader.Open(file.c_str())) {
+
+            mismatches++;
+
+            continue;
+        }
+
+        while ((count = reader.Read(events, 256)) != 0) {
+
+            for (size_t i = 0; i < count; i++, position++) {
+
+                const DIO_EVENT& expected = Events[position % Events.size()];
+
+                if (position >= total ||
+                    events[i].Timestamp != expected.Timestamp + span * (position / Events.size()) ||
+                    events[i].LineState != expected.LineState) {
+                    mismatches++;
+                }
+            }
+        }
+    }
+
+    if (position != total) {
+        mismatches++;
+    }
+
+    return mismatches;
+}
+
+static std::vector<std::string>
+RecorderFiles()
+{
+    std::vector<std::string> files;
+
+    for (const auto& entry : std::filesystem::directory_iterator(".")) {
+
+        std::string name = entry.path().filename().string();
+
+        if (name.compare(0, sizeof(RecorderBenchPrefix) - 1, RecorderBenchPrefix) == 0 &&
+            name.size() > 5 && name.compare(name.size() - 5, 5, ".dioc") == 0) {
+            files.push_back(name);
+        }
+    }
+
+    std::sort(files.begin(), files.end());
+
+    return files;
+}
+
+static void
+ReportRate(const char* Name,
+           uint64_t    Events,
+           uint64_t    Bytes,
+           uint64_t    ElapsedNs,
+           uint64_t    CpuNs,
+           uint64_t    Mismatches)
+{
+    BenchReport(Name, "events", (double)Events, "events");
+    BenchReport(Name, "sustained_rate", Events * 1e3 / ElapsedNs, "Mevents/s");
+    BenchReport(Name, "write_bandwidth", Bytes * 1e3 / ElapsedNs, "MB/s");
+    BenchReport(Name, "cpu_per_million_events", CpuNs / 1e6 / (Events / 1e6), "ms");
+    BenchReport(Name, "mismatches", (double)Mismatches, "events");
+}
+
+void
+BenchRecorder()
+{
+    BenchRandom            random(0x0D10);
+    std::vector<DIO_EVENT> events;
+
+    //
+    // Random activity on all 32 lines at performance counter resolution
+    //
+    BenchGeneratePoisson(events, 0xFFFFFFFF, 1000, 100, RECORDER_BENCH_EVENTS, 0, random);
+
+    //
+    // The recorder: in place from the ring into the async sink
+    //
+    {
+        DioSimEventRing     ring(RECORDER_BENCH_RING, RECORDER_BENCH_FREQUENCY);
+        DIO_RECORDER_CONFIG config = DioRecorderDefaultConfig();
+        std::atomic<bool>   stop(false);
+
+        for (const std::string& file : RecorderFiles()) {
+            remove(file.c_str());
+        }
+
+        config.Prefix      = RecorderBenchPrefix;
+        config.RotateBytes = RECORDER_BENCH_ROTATE;
+
+        DioCaptureRecorder recorder(ring, config);
+
+        std::thread producer(ProduceEvents, std::ref(ring), std::cref(events));
+
+        bool ok = recorder.Run(stop);
+
+        producer.join();
+
+        DIO_RECORDER_STATS       stats = recorder.Stats();
+        std::vector<std::string> files = RecorderFiles();
+
+        ReportRate("recorder.zero_copy",
+                   stats.Events,
+                   stats.Bytes,
+                   stats.ElapsedNs,
+                   stats.CpuNs,
+                   ok ? CheckFiles(files, events) : stats.Events);
+
+        BenchReport("recorder.zero_copy", "files", (double)stats.Files, "files");
+        BenchReport("recorder.zero_copy", "overflows", (double)stats.Overflows, "events");
+        BenchReport("recorder.zero_copy", "in_place", stats.ZeroCopy ? 1 : 0, "bool");
+        BenchReport("recorder.zero_copy", "unbuffered", stats.Unbuffered ? 1 : 0, "bool");
+        BenchReport("recorder.zero_copy", "asynchronous", stats.Asynchronous ? 1 : 0, "bool");
+
+        for (const std::string& file : files) {
+            remove(file.c_str());
+            remove(DioCaptureIndexPath(file.c_str()).c_str());
+        }
+    }
+
+    //
+    // The copying path: events copied (and converted) out of the ring,
+    // blocks written through stdio
+    //
+    {
+        DioSimEventRing    ring(RECORDER_BENCH_RING, RECORDER_BENCH_FREQUENCY);
+        DioRingEventSource source(&ring);
+        DioCaptureFileSink sink;
+        DIO_CAPTURE_CONFIG config;
+
+        DioCaptureDefaultConfig(&config);
+
+        config.TickNs = 100;
+
+        if (!sink.Open(RecorderBenchCopyFile)) {
+
+            printf("recorder.copying: unable to create %s\n", RecorderBenchCopyFile);
+
+            return;
+        }
+
+        DioCaptureWriter writer(&sink, config);
+
+        std::thread producer(ProduceEvents, std::ref(ring), std::cref(events));
+
+        BenchTimer timer;
+        uint64_t   cpuNs = DioCaptureRecorder::ThreadCpuNs();
+
+        bool ok = writer.Begin() && writer.Capture(source);
+
+        sink.Close();
+
+        cpuNs = DioCaptureRecorder::ThreadCpuNs() - cpuNs;
+
+        uint64_t elapsed = timer.ElapsedNs();
+
+        producer.join();
+
+        ReportRate("recorder.copying",
+                   writer.EventsWritten(),
+                   writer.BytesWritten(),
+                   elapsed,
+                   cpuNs,
+                   ok ? CheckFiles({ RecorderBenchCopyFile }, events) : writer.EventsWritten());
+
+        remove(RecorderBenchCopyFile);
+    }
+}
@@ -0,0 +1,375 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        RegisterBench.cpp -- The cost of an access through each register
+//                             access backend, and the old structure
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      Registers used to be described by a structure (built with the
+//      REGSTRUCT macros) and accessed as READ_REGISTER_ULONG(&Bar->Field).
+//      They're now described by the types in DioRegisters.h and accessed
+//      with DioRegisterRead and DioRegisterWrite, through a backend.  That
+//      must cost nothing, so we run the ISR's register sequence (read the
+//      interrupt status, the change detect status and the latched lines,
+//      then acknowledge) REGISTER_BENCH_ISRS times, each way:
+//
+//          struct  The old way, through a REGSTRUCT-style structure laid
+//                  over memory
+//
+//          typed   DioRegisterRead and DioRegisterWrite, through a backend
+//                  that does what the driver's does, on the same memory
+//
+//          traced  The same, wrapped in the DioRegisterTracer that the
+//                  driver and simulator profile with, with a policy that
+//                  just counts accesses
+//
+//          sim     The same, through the simulator's backend
+//
+//      Volatile accesses to ordinary memory stand in for MMIO, which is
+//      what READ_REGISTER_ULONG and WRITE_REGISTER_ULONG are on x64, so
+//      the typed backend here is a stand-in for the driver's, not the
+//      driver's own (which needs the WDK).  The typed, traced and sim
+//      sequences are all RegisterBenchIsr, for their backends, and the
+//      struct sequence is RegisterBenchStructIsr.  Neither is ever inlined,
+//      so on x86 and x64 we also compare the machine code of the struct
+//      sequence with that of the typed one, byte for byte (see
+//      RegisterBenchSameCode), and report it as a pass/fail check,
+//      registers.typed same-code, which fails the gate if they differ (the
+//      benchmarks are meant to be built optimized; unoptimized, the typed
+//      accessors are calls, and it does).  On other processors the check
+//      isn't made, and isn't reported.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "../DioSim/DioSimBar.h"
+#include "DioBench.h"
+
+constexpr uint32_t REGISTER_BENCH_ISRS = 10000000;
+constexpr uint32_t REGISTER_BENCH_SIM_ISRS = 1000000;
+
+#if defined(_MSC_VER)
+#define REGISTER_BENCH_NOINLINE __declspec(noinline)
+#else
+#define REGISTER_BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+//
+// What READ_REGISTER_ULONG and WRITE_REGISTER_ULONG do on x64
+//
+static inline uint32_t
+RegisterBenchRead(volatile uint32_t* Register)
+{
+    return *Register;
+}
+
+static inline void
+RegisterBenchWrite(volatile uint32_t* Register,
+                   uint32_t           Value)
+{
+    *Register = Value;
+}
+
+//
+// REGISTER_BENCH_STRUCT
+//
+// The registers the ISR uses, laid out the way the REGSTRUCT macros laid
+// out DIO_REGISTERS: a union of structures, each padded to put its one
+// register at its offset.  It can't use the offsets in DioRegisters.h,
+// because the fields have the same names as the types there.
+//
+typedef struct _REGISTER_BENCH_STRUCT {
+    union {
+        uint8_t Pad[DIO_BAR_SIZE];
+        struct { uint8_t Pad0[0x00068]; uint32_t Volatile_Interrupt_Status_Register; };
+        struct { uint8_t Pad1[0x20540]; uint32_t ChangeDetectStatusRegister; };
+        struct { uint8_t Pad2[0x20544]; uint32_t DI_ChangeDetectLatched_Register; };
+        struct { uint8_t Pad3[0x20554]; uint32_t ChangeDetectIRQ_Register; };
+    };
+} REGISTER_BENCH_STRUCT, *PREGISTER_BENCH_STRUCT;
+
+//
+// REGISTER_BENCH_BAR
+//
+// The same memory as seen by the typed accessors.  Like the driver's
+// DIO_REGISTERS, it's never defined.
+//
+typedef struct _REGISTER_BENCH_BAR REGISTER_BENCH_BAR, *PREGISTER_BENCH_BAR;
+
+template <>
+struct DioRegisterBackend<PREGISTER_BENCH_BAR>
+{
+    typedef uint32_t Value;
+
+    static uint32_t Read(PREGISTER_BENCH_BAR Bar,
+                         unsigned int        Offset)
+    {
+        return RegisterBenchRead(reinterpret_cast<volatile uint32_t*>(reinterpret_cast<uint8_t*>(Bar) + Offset));
+    }
+
+    static void Write(PREGISTER_BENCH_BAR Bar,
+                      unsigned int        Offset,
+                      uint32_t            RegisterValue)
+    {
+        RegisterBenchWrite(reinterpret_cast<volatile uint32_t*>(reinterpret_cast<uint8_t*>(Bar) + Offset),
+                           RegisterValue);
+    }
+};
+
+//
+// The ISR's register sequence, the old way
+//
+REGISTER_BENCH_NOINLINE uint32_t
+RegisterBenchStructIsr(PREGISTER_BENCH_STRUCT Bar)
+{
+    uint32_t interruptStatus;
+    uint32_t changeDetectReg;
+    uint32_t lineState;
+
+    interruptStatus = RegisterBenchRead(&Bar->Volatile_Interrupt_Status_Register);
+    changeDetectReg = RegisterBenchRead(&Bar->ChangeDetectStatusRegister);
+    lineState       = RegisterBenchRead(&Bar->DI_ChangeDetectLatched_Register);
+
+    RegisterBenchWrite(&Bar->ChangeDetectIRQ_Register,
+                       interruptStatus | changeDetectReg);
+
+    return lineState;
+}
+
+//
+// The same sequence, through any backend
+//
+template <typename BarPointer>
+REGISTER_BENCH_NOINLINE uint32_t
+RegisterBenchIsr(BarPointer Bar)
+{
+    uint32_t interruptStatus;
+    uint32_t changeDetectReg;
+    uint32_t lineState;
+
+    interruptStatus = DioRegisterRead<Volatile_Interrupt_Status_Register>(Bar);
+    changeDetectReg = DioRegisterRead<ChangeDetectStatusRegister>(Bar);
+    lineState       = DioRegisterRead<DI_ChangeDetectLatched_Register>(Bar);
+
+    DioRegisterWrite<ChangeDetectIRQ_Register>(Bar,
+                                               interruptStatus | changeDetectReg);
+
+    return lineState;
+}
+
+//
+// RegisterBenchSameCode
+//
+// Whether the machine code of the functions at First and Second is the
+// same, byte for byte, up to the first ret (0xC3) they have in the same
+// place.  Each starts at the function's address, or where the jump there
+// goes (an incremental link puts a jump at the address).  Only for x86 and
+// x64, whose code we know how to walk; these functions are a few simple
+// instructions, with no 0xC3 that isn't a ret.
+//
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+
+#define REGISTER_BENCH_SAME_CODE 1
+
+constexpr uint32_t REGISTER_BENCH_MAX_CODE = 256;
+
+static const uint8_t*
+RegisterBenchCode(uintptr_t Function)
+{
+    const uint8_t* code = reinterpret_cast<const uint8_t*>(Function);
+
+    if (code[0] == 0xE9) {
+
+        int32_t displacement;
+
+        memcpy(&displacement, code + 1, sizeof(displacement));
+
+        code += 5 + displacement;
+    }
+
+    return code;
+}
+
+static bool
+RegisterBenchSameCode(uintptr_t First,
+                      uintptr_t Second)
+{
+    const uint8_t* first  = RegisterBenchCode(First);
+    const uint8_t* second = RegisterBenchCode(Second);
+
+    for (uint32_t i = 0; i < REGISTER_BENCH_MAX_CODE; i++) {
+
+        if (first[i] != second[i]) {
+            return false;
+        }
+
+        if (first[i] == 0xC3) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#endif
+
+//
+// REGISTER_BENCH_COUNTER
+//
+// The DioRegisterTracer policy for the traced run: it just counts the
+// accesses
+//
+typedef struct _REGISTER_BENCH_COUNTER {
+    uint64_t*   Accesses;
+
+    typedef int Stamp;
+
+    bool Enabled() const
+    {
+        return true;
+    }
+
+    int Begin() const
+    {
+        return 0;
+    }
+
+    void End(unsigned int Offset,
+             uint32_t     RegisterValue,
+             int          StartTime,
+             bool         Write) const
+    {
+        (void)Offset;
+        (void)RegisterValue;
+        (void)StartTime;
+        (void)Write;
+
+        (*Accesses)++;
+    }
+} REGISTER_BENCH_COUNTER;
+
+static void
+ReportIsrs(const char* Name,
+           uint64_t    ElapsedNs,
+           uint32_t    Isrs,
+           uint32_t    Check)
+{
+    BenchReport(Name, "isr", (double)ElapsedNs / Isrs, "ns");
+    BenchReport(Name, "access", (double)ElapsedNs / (Isrs * 4.0), "ns");
+
+    //
+    // Keep the result live, so nothing is optimized away
+    //
+    BenchReport(Name, "check", (double)(Check & 1), "count");
+}
+
+void
+BenchRegisters()
+{
+    std::vector<uint64_t> memory(DIO_BAR_SIZE / sizeof(uint64_t));
+    uint32_t              check;
+
+    {
+        PREGISTER_BENCH_STRUCT bar = reinterpret_cast<PREGISTER_BENCH_STRUCT>(memory.data());
+        BenchTimer             timer;
+
+        check = 0;
+
+        for (uint32_t i = 0; i < REGISTER_BENCH_ISRS; i++) {
+            check += RegisterBenchStructIsr(bar);
+        }
+
+        ReportIsrs("registers.struct", timer.ElapsedNs(), REGISTER_BENCH_ISRS, check);
+    }
+
+    {
+        PREGISTER_BENCH_BAR bar = reinterpret_cast<PREGISTER_BENCH_BAR>(memory.data());
+        BenchTimer          timer;
+
+        check = 0;
+
+        for (uint32_t i = 0; i < REGISTER_BENCH_ISRS; i++) {
+            check += RegisterBenchIsr(bar);
+        }
+
+        ReportIsrs("registers.typed", timer.ElapsedNs(), REGISTER_BENCH_ISRS, check);
+
+#if REGISTER_BENCH_SAME_CODE
+        uint32_t (*structIsr)(PREGISTER_BENCH_STRUCT) = RegisterBenchStructIsr;
+        uint32_t (*typedIsr)(PREGISTER_BENCH_BAR)     = RegisterBenchIsr<PREGISTER_BENCH_BAR>;
+
+        BenchReport("registers.typed", "same-code",
+                    RegisterBenchSameCode(reinterpret_cast<uintptr_t>(structIsr),
+                                          reinterpret_cast<uintptr_t>(typedIsr)) ? 1.0 : 0.0,
+                    "bool");
+#endif
+    }
+
+    {
+        uint64_t                                                    accesses = 0;
+        DioRegisterTracer<PREGISTER_BENCH_BAR, REGISTER_BENCH_COUNTER>  tracer = {
+            reinterpret_cast<PREGISTER_BENCH_BAR>(memory.data()),
+            { &accesses }
+        };
+        BenchTimer                                                  timer;
+
+        check = 0;
+
+        for (uint32_t i = 0; i < REGISTER_BENCH_ISRS; i++) {
+            check += RegisterBenchIsr(tracer);
+        }
+
+        ReportIsrs("registers.traced", timer.ElapsedNs(), REGISTER_BENCH_ISRS, check);
+
+        BenchReport("registers.traced", "traced",
+                    (double)accesses / REGISTER_BENCH_ISRS, "count");
+    }
+
+    {
+        DioSimBar  bar;
+        BenchTimer timer;
+
+        check = 0;
+
+        for (uint32_t i = 0; i < REGISTER_BENCH_SIM_ISRS; i++) {
+            check += RegisterBenchIsr(&bar);
+        }
+
+        ReportIsrs("registers.sim", timer.ElapsedNs(), REGISTER_BENCH_SIM_ISRS, check);
+    }
+}
@@ -0,0 +1,189 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        SoakBench.cpp -- An hour of input changes and idling, in
+//                         virtual time
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      With DioSimClock in virtual time, we play SOAK_BENCH_SECONDS of
+//      input changes (a SOAK_BENCH_PULSE_MS pulse on line 0 every
+//      SOAK_BENCH_PERIOD_MS, from a DioSimClockWaveform) into a simulated
+//      device with wake on change
+//      on, and an application waiting for changes.  The device idles
+//      between pulses, and each pulse wakes it.
+//
+//      We run the scenario twice, and report how long the first run took
+//      against the time it simulated, what the device did (interrupts,
+//      completed Requests, idles and wakes, time in D3, the DpcForIsr's
+//      worst time), and whether the second run came out exactly the same
+//      (down to the time each Request was completed).
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <thread>
+
+#include "../DioSim/DioSimClock.h"
+#include "../DioSim/DioSimDevice.h"
+#include "../DioSim/DioSimPlayer.h"
+#include "../DioSim/DioSimWaveform.h"
+#include "DioBench.h"
+
+constexpr uint64_t SOAK_BENCH_SECONDS    = 3600;
+constexpr uint64_t SOAK_BENCH_PERIOD_MS  = 2000;
+constexpr uint64_t SOAK_BENCH_PULSE_MS   = 20;
+constexpr uint32_t SOAK_BENCH_IDLE_US    = 100000;
+constexpr uint32_t SOAK_BENCH_RESUME_US  = 2000;
+constexpr uint32_t SOAK_BENCH_EVENT_NS   = 2000;
+constexpr uint32_t SOAK_BENCH_REQUEST_NS = 1000;
+
+typedef struct _SOAK_BENCH_RESULT {
+    uint64_t            Interrupts;
+    uint64_t            ChangeErrors;
+    uint64_t            Completions;
+    uint64_t            CompletionHash;
+    DIO_SIM_POWER_STATS Power;
+    DIO_SIM_DPC_STATS   Dpc;
+} SOAK_BENCH_RESULT;
+
+static SOAK_BENCH_RESULT
+RunSoak(DioSimWaveformSource& Source)
+{
+    SOAK_BENCH_RESULT   result = {};
+    DioSimDevice        device(1024);
+    DioSimHandle        handle(device, DIO_SIM_NO_PORT);
+    DioSimPlayer        player(device.Bar());
+    std::thread         client;
+    uint64_t            start = DioSimClock::Now();
+
+    device.SetIdleTimeout(SOAK_BENCH_IDLE_US);
+    device.SetResumeLatency(SOAK_BENCH_RESUME_US);
+    device.SetWakeOnChange(true);
+    device.SetEventCost(SOAK_BENCH_EVENT_NS);
+    device.SetRequestCost(SOAK_BENCH_REQUEST_NS);
+
+    client = DioSimClock::Thread([&] {
+        DIO_SIM_CHANGE change;
+
+        while (handle.WaitForChange(DioSimPriority::Normal, &change) ==
+                   DioSimStatus::Success) {
+
+            result.Completions++;
+            result.CompletionHash = result.CompletionHash * 1000003 ^
+                                    (change.CompletionTime - start) ^
+                                    change.LatchedLineState;
+        }
+    });
+
+    //
+    // Let the device idle after the last pulse, too
+    //
+    Source.Rewind();
+
+    player.Play(Source, 1.0);
+
+    DioSimClock::Advance(SOAK_BENCH_PERIOD_MS * 1000000ULL);
+
+    handle.Cancel();
+
+    DioSimClock::Join(client);
+
+    result.Interrupts   = device.InterruptCount();
+    result.ChangeErrors = device.ChangeErrorCount();
+    result.Power        = device.PowerStats();
+    result.Dpc          = device.DpcStats();
+
+    return result;
+}
+
+static bool
+SameResult(const SOAK_BENCH_RESULT& First,
+           const SOAK_BENCH_RESULT& Second)
+{
+    return First.Interrupts == Second.Interrupts &&
+           First.ChangeErrors == Second.ChangeErrors &&
+           First.Completions == Second.Completions &&
+           First.CompletionHash == Second.CompletionHash &&
+           First.Power.D0Time == Second.Power.D0Time &&
+           First.Power.D3Time == Second.Power.D3Time &&
+           First.Power.TransitionTime == Second.Power.TransitionTime &&
+           First.Power.Idles == Second.Power.Idles &&
+           First.Power.Wakes == Second.Power.Wakes &&
+           First.Dpc.Dpc.TotalTime == Second.Dpc.Dpc.TotalTime &&
+           First.Dpc.Dpc.MaxTime == Second.Dpc.Dpc.MaxTime;
+}
+
+void
+BenchSoak()
+{
+    DioSimClockWaveform  pulses(0,
+                                SOAK_BENCH_PERIOD_MS * 1000000ULL,
+                                SOAK_BENCH_PULSE_MS * 1000000ULL,
+                                SOAK_BENCH_PERIOD_MS * 1000000ULL / 2);
+    DioSimWaveformSource source(SOAK_BENCH_SECONDS * 1000000000ULL);
+    SOAK_BENCH_RESULT    first;
+    SOAK_BENCH_RESULT    second;
+    double               seconds;
+    double               total;
+
+    source.Add(&pulses);
+
+    DioSimClock::UseVirtualTime();
+
+    {
+        BenchTimer timer;
+
+        first   = RunSoak(source);
+        seconds = timer.ElapsedNs() / 1e9;
+    }
+
+    second = RunSoak(source);
+
+    DioSimClock::UseRealTime();
+
+    total = (double)(first.Power.D0Time + first.Power.D3Time + first.Power.TransitionTime);
+
+    BenchReport("soak", "simulated", (double)SOAK_BENCH_SECONDS, "s");
+    BenchReport("soak", "wall", seconds, "s");
+    BenchReport("soak", "speedup", SOAK_BENCH_SECONDS / seconds, "x");
+    BenchReport("soak", "changes", (double)source.PassedEdges(), "events");
+    BenchReport("soak", "interrupts", (double)first.Interrupts, "count");
+    BenchReport("soak", "change_errors", (double)first.ChangeErrors, "count");
+    BenchReport("soak", "completions", (double)first.Completions, "count");
+    BenchReport("soak", "idles", (double)first.Power.Idles, "count");
+    BenchReport("soak", "wakes", (double)first.Power.Wakes, "count");
+    BenchReport("soak", "d3", 100.0 * first.Power.D3Time / total, "%");
+    BenchReport("soak", "dpc_max", first.Dpc.Dpc.MaxTime / 1e3, "us");
+    BenchReport("soak", "reproducible", SameResult(first, second) ? 1.0 : 0.0, "bool");
+}
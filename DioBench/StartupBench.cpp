@@ -0,0 +1,165 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        StartupBench.cpp -- Bringing the output lines up in their proper
+//                            state when the device starts
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      Each run starts a simulated device and times how long it takes for
+//      the output lines (STARTUP_BENCH_LINES) to be driven to the state
+//      they're meant to be in (STARTUP_BENCH_STATE).  Until then, we count
+//      the lines as being in the wrong state: the field holds them at the
+//      opposite state while they're inputs.  We run two cases:
+//
+//          app     The device starts with no line profile, and an
+//                  application sets the lines up, as it always used to:
+//                  it reserves them (which drives them deasserted) and
+//                  then writes their state.  Each Request takes
+//                  STARTUP_BENCH_REQUEST_US, for the round trip to the
+//                  driver.
+//
+//          profile The device starts with a line profile that makes the
+//                  lines outputs in their proper state.  The application
+//                  then takes the lines over from the profile, and we
+//                  check that they never leave that state on the way.
+//
+//      For each, we report how long the device took to start, how long
+//      until the lines were in their proper state (the wrong-state window,
+//      which in the app case also includes however long the application
+//      takes to start, here none), how many Requests that took, and how
+//      many times the lines were seen in the wrong state after the device
+//      had put them in the right one.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <vector>
+
+#include "../DioSim/DioSimDevice.h"
+#include "DioBench.h"
+
+constexpr uint32_t STARTUP_BENCH_STARTS     = 100;
+constexpr uint32_t STARTUP_BENCH_LINES      = 0x000000FF;
+constexpr uint32_t STARTUP_BENCH_STATE      = 0x000000A5;
+constexpr uint32_t STARTUP_BENCH_REQUEST_US = 20;
+
+static bool
+LinesReady(DioSimDevice& Device)
+{
+    return (Device.Bar().LineLevels() & STARTUP_BENCH_LINES) == STARTUP_BENCH_STATE;
+}
+
+static void
+RunStartup(const char* Name,
+           bool        UseProfile)
+{
+    DIO_SIM_LINE_PROFILE  profile = DioSimDefaultProfile;
+    std::vector<uint64_t> startTimes;
+    std::vector<uint64_t> readyTimes;
+    uint32_t              requests = 0;
+    uint32_t              glitches = 0;
+
+    if (UseProfile) {
+        profile.OutputLines = STARTUP_BENCH_LINES;
+        profile.OutputState = STARTUP_BENCH_STATE;
+    }
+
+    for (uint32_t run = 0; run < STARTUP_BENCH_STARTS; run++) {
+
+        uint64_t startTime = DioSimEventRing::Now();
+        uint64_t startedTime;
+        uint64_t readyTime;
+
+        DioSimDevice device(1024, profile);
+
+        startedTime = DioSimEventRing::Now();
+
+        //
+        // The field holds the lines at the opposite of their proper state
+        // whenever nothing drives them
+        //
+        device.Bar().SetInputs(~STARTUP_BENCH_STATE & STARTUP_BENCH_LINES);
+
+        device.SetRequestCost(STARTUP_BENCH_REQUEST_US * 1000);
+
+        DioSimHandle handle(device, DIO_SIM_NO_PORT);
+
+        readyTime = LinesReady(device) ? startedTime : 0;
+
+        if (handle.SetOutputs(STARTUP_BENCH_LINES) != DioSimStatus::Success) {
+            BenchReport(Name, "error", 1, "count");
+            return;
+        }
+
+        requests++;
+
+        if (readyTime != 0 && !LinesReady(device)) {
+            glitches++;
+        }
+
+        handle.Write(STARTUP_BENCH_STATE);
+
+        requests++;
+
+        if (readyTime == 0 && LinesReady(device)) {
+            readyTime = DioSimEventRing::Now();
+        } else if (!LinesReady(device)) {
+            glitches++;
+        }
+
+        startTimes.push_back(startedTime - startTime);
+        readyTimes.push_back(readyTime - startTime);
+    }
+
+    //
+    // With a profile, the lines were ready before the application sent any
+    // Requests, so it needn't have sent them
+    //
+    if (UseProfile) {
+        requests = 0;
+    }
+
+    BenchReport(Name, "start_p50", BenchPercentile(startTimes, 0.5) / 1e3, "us");
+    BenchReport(Name, "ready_p50", BenchPercentile(readyTimes, 0.5) / 1e3, "us");
+    BenchReport(Name, "ready_max", BenchPercentile(readyTimes, 1.0) / 1e3, "us");
+    BenchReport(Name, "requests", (double)requests / STARTUP_BENCH_STARTS, "count");
+    BenchReport(Name, "glitches", (double)glitches, "count");
+}
+
+void
+BenchStartup()
+{
+    RunStartup("startup.app", false);
+    RunStartup("startup.profile", true);
+}
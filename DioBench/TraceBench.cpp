@@ -0,0 +1,241 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        TraceBench.cpp -- Register trace recording and replay
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      We run TRACE_BENCH_SECONDS of the simulated device in virtual time:
+//      random changes on its inputs (some through the large filter), and
+//      an application writing its output lines and reading them back, in
+//      bursts far enough apart that the device idles in D3 between them
+//      (each change waking it again).  We run it once as it is and once
+//      recording its trace, to see what recording costs, and then:
+//
+//          trace.record    How big the trace is, and what it holds
+//
+//          trace.file      Whether the trace reads back from a file just
+//                          as it was recorded
+//
+//          trace.replay    Replays the trace against a fresh model, and
+//                          counts the reads that didn't match (there
+//                          should be none), and how fast it replays
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+#include "../DioSim/DioSimDevice.h"
+#include "../DioSim/DioSimPlayer.h"
+#include "../DioSim/DioSimTrace.h"
+#include "../DioSim/DioSimWaveform.h"
+#include "DioBench.h"
+
+constexpr uint64_t TRACE_BENCH_SECONDS    = 10;
+constexpr double   TRACE_BENCH_RATE       = 2000;
+constexpr uint32_t TRACE_BENCH_BURST      = 50;
+constexpr uint64_t TRACE_BENCH_REQUEST_NS = 200000;
+constexpr uint64_t TRACE_BENCH_GAP_NS     = 30000000;
+constexpr uint32_t TRACE_BENCH_IDLE_US    = 10000;
+constexpr uint32_t TRACE_BENCH_RESUME_US  = 100;
+constexpr uint32_t TRACE_BENCH_REPLAYS    = 5;
+
+static const char TraceBenchFile[] = "DioBench.trace.tmp";
+
+//
+// The top port is the application's outputs, and the large filter is on
+// the bottom one
+//
+constexpr DIO_SIM_LINE_PROFILE TraceBenchProfile = {
+    0xFF000000, 0, 0x00FFFFFF, 0x00FFFFFF, 0x0000FFFF, 0
+};
+
+//
+// Runs the scenario, recording it with Recorder if there is one, and
+// returns how long it took
+//
+static double
+RunScenario(DioSimTraceRecorder* Recorder)
+{
+    DioSimPoissonWaveform   inputs(0x00FFFFFF, TRACE_BENCH_RATE, 0x7ACE);
+    DioSimWaveformSource    source(TRACE_BENCH_SECONDS * 1000000000ULL);
+    std::mutex              mutex;
+    std::condition_variable condition;
+    bool                    done = false;
+    std::thread             client;
+    BenchTimer              timer;
+
+    source.Add(&inputs);
+
+    DioSimClock::UseVirtualTime();
+
+    {
+        DioSimDevice device(1024, TraceBenchProfile, Recorder);
+        DioSimPlayer player(device.Bar());
+
+        device.SetIdleTimeout(TRACE_BENCH_IDLE_US);
+        device.SetResumeLatency(TRACE_BENCH_RESUME_US);
+        device.SetWakeOnChange(true);
+
+        client = DioSimClock::Thread([&] {
+            DioSimHandle                 handle(device, DIO_SIM_NO_PORT);
+            std::unique_lock<std::mutex> lock(mutex);
+            uint32_t                     lineState;
+            uint32_t                     count = 0;
+
+            //
+            // Pausing lets the rest of the simulation run (where
+            // DioSimClock::Sleep would just move the clock on)
+            //
+            auto pause = [&](uint64_t Nanoseconds) {
+                return DioSimClock::WaitUntil(lock,
+                                              condition,
+                                              DioSimClock::Now() + Nanoseconds,
+                                              [&] { return done; });
+            };
+
+            handle.SetOutputs(TraceBenchProfile.OutputLines);
+
+            while (!done) {
+
+                for (uint32_t i = 0; i < TRACE_BENCH_BURST; i++) {
+
+                    lock.unlock();
+
+                    handle.Write(++count << 24);
+
+                    handle.Read(&lineState);
+
+                    lock.lock();
+
+                    if (pause(TRACE_BENCH_REQUEST_NS)) {
+                        break;
+                    }
+                }
+
+                pause(TRACE_BENCH_GAP_NS);
+            }
+        });
+
+        player.Play(source, 1.0);
+
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+
+            done = true;
+        }
+
+        DioSimClock::Notify(condition);
+
+        DioSimClock::Join(client);
+
+        device.Bar().SetTraceRecorder(nullptr);
+    }
+
+    DioSimClock::UseRealTime();
+
+    return timer.ElapsedNs() / 1e9;
+}
+
+void
+BenchTrace()
+{
+    DioSimTraceRecorder  recorder;
+    DioSimTrace          trace;
+    DioSimTrace          saved;
+    DIO_SIM_REPLAY_STATS stats = {};
+    std::vector<uint8_t> file;
+    double               plain;
+    double               recorded;
+    double               replayed;
+    bool                 same;
+
+    plain    = RunScenario(nullptr);
+    recorded = RunScenario(&recorder);
+
+    file = recorder.File();
+
+    if (!trace.Parse(file.data(), file.size())) {
+
+        printf("trace: unable to parse the recorded trace\n");
+        return;
+    }
+
+    same = recorder.Save(TraceBenchFile) &&
+           saved.Open(TraceBenchFile) &&
+           saved.Flags() == trace.Flags() &&
+           saved.Entries().size() == trace.Entries().size();
+
+    for (size_t i = 0; same && i < trace.Entries().size(); i++) {
+        const DIO_REGISTER_TRACE_ENTRY& a = trace.Entries()[i];
+        const DIO_REGISTER_TRACE_ENTRY& b = saved.Entries()[i];
+
+        same = a.Time == b.Time && a.Kind == b.Kind && a.Offset == b.Offset && a.Value == b.Value;
+    }
+
+    remove(TraceBenchFile);
+
+    DioSimClock::UseVirtualTime();
+
+    {
+        DioSimBar         bar;
+        DioSimTraceReplay replay(bar);
+        BenchTimer        timer;
+
+        for (uint32_t i = 0; i < TRACE_BENCH_REPLAYS; i++) {
+            stats = replay.Replay(trace, 1.0);
+        }
+
+        replayed = timer.ElapsedNs() / 1e9 / TRACE_BENCH_REPLAYS;
+    }
+
+    DioSimClock::UseRealTime();
+
+    BenchReport("trace.record", "entries", (double)recorder.EntryCount(), "count");
+    BenchReport("trace.record", "bytes_per_entry", (double)file.size() / recorder.EntryCount(), "bytes");
+    BenchReport("trace.record", "reads", (double)stats.Reads, "count");
+    BenchReport("trace.record", "writes", (double)stats.Writes, "count");
+    BenchReport("trace.record", "input_changes", (double)stats.InputChanges, "count");
+    BenchReport("trace.record", "power_changes", (double)stats.PowerChanges, "count");
+    BenchReport("trace.record", "overhead", 100.0 * (recorded - plain) / plain, "%");
+    BenchReport("trace.file", "roundtrip", same ? 1.0 : 0.0, "bool");
+    BenchReport("trace.replay", "checked", (double)stats.Checked, "count");
+    BenchReport("trace.replay", "mismatches", (double)stats.Mismatches, "count");
+    BenchReport("trace.replay", "throughput", recorder.EntryCount() / replayed / 1e6, "Mentries/s");
+    BenchReport("trace.replay", "speedup", TRACE_BENCH_SECONDS / replayed, "x");
+    BenchReport("trace.replay", "vs_recording", recorded / replayed, "x");
+}
@@ -0,0 +1,275 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        VcdBench.cpp -- VCD export, import and playback benchmarks
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <cstdio>
+
+#include "../DioCapture/DioVcd.h"
+#include "../DioSim/DioSimPlayer.h"
+#include "BenchStreams.h"
+
+constexpr size_t VCD_BENCH_UNITS = 200000;
+
+//
+// Length and event rate of the stream we play into the simulator in real
+// time
+//
+constexpr size_t   VCD_BENCH_REALTIME_EVENTS  = 2000;
+constexpr uint64_t VCD_BENCH_REALTIME_MEAN_NS = 50000;
+
+static const char VcdBenchFile[] = "DioBench.vcd.tmp";
+
+//
+// A VCD file can't express two events at the same time, so the reader
+// returns one event carrying the net change.  Make the reference stream
+// look the same.
+//
+static void
+CoalesceEvents(const std::vector<DIO_EVENT>& Events,
+               std::vector<DIO_EVENT>&       Coalesced)
+{
+    uint32_t state;
+
+    Coalesced.clear();
+
+    if (Events.empty()) {
+        return;
+    }
+
+    state = Events[0].LineState ^ Events[0].ChangedLines;
+
+    for (const DIO_EVENT& event : Events) {
+
+        if (!Coalesced.empty() &&
+            Coalesced.back().Timestamp == event.Timestamp) {
+
+            Coalesced.back().LineState = event.LineState;
+
+        } else {
+
+            Coalesced.push_back(event);
+        }
+    }
+
+    //
+    // Recompute the changes, and drop instants with no net change
+    //
+    size_t kept = 0;
+
+    for (DIO_EVENT& event : Coalesced) {
+
+        event.ChangedLines = event.LineState ^ state;
+        state              = event.LineState;
+
+        if (event.ChangedLines != 0) {
+            Coalesced[kept++] = event;
+        }
+    }
+
+    Coalesced.resize(kept);
+}
+
+void
+BenchVcd()
+{
+    BenchRandom            random(0x7CD);
+    std::vector<DIO_EVENT> uartEvents;
+    std::vector<DIO_EVENT> spiEvents;
+    std::vector<DIO_EVENT> i2cEvents;
+    std::vector<DIO_EVENT> mixedEvents;
+    std::vector<DIO_EVENT> expected;
+    std::vector<uint32_t>  payload;
+    DIO_VCD_CONFIG         config;
+    uint64_t               allocations;
+    uint64_t               mismatches = 0;
+    uint64_t               writeNs;
+    uint64_t               readNs;
+    uint64_t               playNs;
+    uint64_t               fileBytes;
+    size_t                 position = 0;
+
+    BenchGenerateUart(uartEvents, payload, 0, 115200, VCD_BENCH_UNITS, 1000, random);
+    BenchGenerateSpi(spiEvents, payload, 8, 1000000, VCD_BENCH_UNITS, 1000, random);
+    BenchGenerateI2c(i2cEvents, payload, 16, 400000, VCD_BENCH_UNITS, 1000, random);
+
+    const std::vector<DIO_EVENT>* streams[] = { &uartEvents, &spiEvents, &i2cEvents };
+
+    BenchMergeStreams(mixedEvents, streams, 3);
+
+    CoalesceEvents(mixedEvents, expected);
+
+    //
+    // Export
+    //
+    {
+        DioCaptureFileSink sink;
+
+        if (!sink.Open(VcdBenchFile)) {
+
+            printf("vcd: unable to create %s\n", VcdBenchFile);
+
+            return;
+        }
+
+        DioVcdDefaultConfig(&config);
+
+        DioVcdWriter writer(&sink, config);
+
+        allocations = BenchAllocationCount();
+
+        BenchTimer timer;
+
+        writer.Append(mixedEvents.data(), mixedEvents.size());
+        writer.Finish();
+
+        writeNs     = timer.ElapsedNs();
+        allocations = BenchAllocationCount() - allocations;
+        fileBytes   = writer.BytesWritten();
+    }
+
+    BenchReport("vcd.export", "events", (double)mixedEvents.size(), "events");
+    BenchReport("vcd.export", "bytes_per_event", (double)fileBytes / mixedEvents.size(), "bytes");
+    BenchReport("vcd.export", "throughput", mixedEvents.size() * 1e3 / writeNs, "Mevents/s");
+    BenchReport("vcd.export", "bandwidth", fileBytes * 1e3 / writeNs, "MB/s");
+    BenchReport("vcd.export", "allocations", (double)allocations, "allocs");
+
+    //
+    // Import, checking that we get back what we wrote.  Once the header has
+    // been read, reading shouldn't allocate at all, however long the file.
+    //
+    {
+        DioVcdReader reader;
+        DIO_EVENT    events[256];
+        size_t       count;
+
+        BenchTimer timer;
+
+        if (!reader.Open(VcdBenchFile)) {
+
+            printf("vcd: unable to open %s\n", VcdBenchFile);
+
+            return;
+        }
+
+        allocations = BenchAllocationCount();
+
+        while ((count = reader.Read(events, 256)) != 0) {
+
+            for (size_t i = 0; i < count; i++, position++) {
+
+                if (position >= expected.size() ||
+                    events[i].Timestamp != expected[position].Timestamp ||
+                    events[i].LineState != expected[position].LineState ||
+                    events[i].ChangedLines != expected[position].ChangedLines) {
+                    mismatches++;
+                }
+            }
+        }
+
+        readNs      = timer.ElapsedNs();
+        allocations = BenchAllocationCount() - allocations;
+
+        if (position != expected.size() || reader.Malformed()) {
+            mismatches++;
+        }
+    }
+
+    BenchReport("vcd.import", "events", (double)position, "events");
+    BenchReport("vcd.import", "throughput", position * 1e3 / readNs, "Mevents/s");
+    BenchReport("vcd.import", "allocations", (double)allocations, "allocs");
+    BenchReport("vcd.import", "mismatches", (double)mismatches, "events");
+
+    //
+    // Play the file into the simulated device as fast as we can, with
+    // change detection enabled on every line
+    //
+    {
+        DioSimBar    bar;
+        DioSimPlayer player(bar);
+        DioVcdReader reader;
+        uint64_t     played;
+
+        bar.Write((uint32_t)DioSimRegister::DI_ChangeIrqRE_Register, 0xFFFFFFFF);
+        bar.Write((uint32_t)DioSimRegister::DI_ChangeIrqFE_Register, 0xFFFFFFFF);
+
+        reader.Open(VcdBenchFile);
+
+        BenchTimer timer;
+
+        played = player.Play(reader, 0.0);
+
+        playNs = timer.ElapsedNs();
+
+        BenchReport("vcd.play", "events", (double)played, "events");
+        BenchReport("vcd.play", "throughput", played * 1e3 / playNs, "Mevents/s");
+        BenchReport("vcd.play", "final_state_matches",
+                    bar.LineLevels() == expected.back().LineState ? 1.0 : 0.0, "bool");
+    }
+
+    remove(VcdBenchFile);
+
+    //
+    // And a short stream in real time, to see how closely we keep to the
+    // original timing
+    //
+    {
+        std::vector<DIO_EVENT> events;
+        DioSimBar              bar;
+        DioSimPlayer           player(bar);
+
+        BenchGeneratePoisson(events,
+                             0xFF,
+                             VCD_BENCH_REALTIME_MEAN_NS,
+                             1,
+                             VCD_BENCH_REALTIME_EVENTS,
+                             0,
+                             random);
+
+        DioArrayEventSource source(events.data(), events.size());
+
+        BenchTimer timer;
+
+        player.Play(source, 1.0);
+
+        playNs = timer.ElapsedNs();
+
+        BenchReport("vcd.play_realtime", "stream_duration",
+                    (events.back().Timestamp - events.front().Timestamp) / 1e6, "ms");
+        BenchReport("vcd.play_realtime", "play_duration", playNs / 1e6, "ms");
+        BenchReport("vcd.play_realtime", "max_lateness", player.MaxLatenessNs() / 1e3, "us");
+    }
+}
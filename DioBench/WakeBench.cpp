@@ -0,0 +1,177 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        WakeBench.cpp -- Changes on the input lines while the device
+//                         idles, with and without wake on change
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      Changes arrive on the input lines every WAKE_BENCH_PACE_MS, far
+//      apart enough for the simulated device to idle (after
+//      WAKE_BENCH_IDLE_US) between them.  Getting back to D0 takes
+//      WAKE_BENCH_RESUME_US.  We run three cases:
+//
+//          held    An application keeps a WaitForChange Request waiting.
+//                  Without wake on change, that holds the device in D0.
+//
+//          idle    The application only polls (reading the lines every
+//                  WAKE_BENCH_POLL_MS), so the device idles, and the
+//                  changes that happen while it's in D3 are lost.
+//
+//          wake    As held, but with wake on change on: the device idles
+//                  with the Request waiting, and each change wakes it.
+//
+//      For each, we report the share of changes that reached the event
+//      ring, how long after the change each one got there (for a change
+//      that woke the device, the wake-to-event latency), and how the
+//      device's time was split between D0, D3 and going between them.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "../DioSim/DioSimDevice.h"
+#include "DioBench.h"
+
+constexpr uint32_t WAKE_BENCH_CHANGES   = 40;
+constexpr uint32_t WAKE_BENCH_PACE_MS   = 50;
+constexpr uint32_t WAKE_BENCH_IDLE_US   = 10000;
+constexpr uint32_t WAKE_BENCH_RESUME_US = 2000;
+constexpr uint32_t WAKE_BENCH_POLL_MS   = 200;
+
+enum class WakeBenchClient {
+    Waiter,
+    Poller,
+};
+
+static void
+RunWake(const char*     Name,
+        WakeBenchClient Client,
+        bool            WakeOnChange)
+{
+    DioSimDevice          device(1024, DioSimUnfilteredProfile);
+    DioSimHandle          handle(device, DIO_SIM_NO_PORT);
+    uint64_t              changeTime[WAKE_BENCH_CHANGES + 1] = {};
+    std::atomic<bool>     done(false);
+    std::thread           client;
+    std::vector<uint64_t> latencies;
+    PDIO_EVENT_RING       ring;
+    uint32_t              producer;
+
+    device.SetIdleTimeout(WAKE_BENCH_IDLE_US);
+    device.SetResumeLatency(WAKE_BENCH_RESUME_US);
+    device.SetWakeOnChange(WakeOnChange);
+
+    if (Client == WakeBenchClient::Waiter) {
+
+        client = std::thread([&] {
+            DIO_SIM_CHANGE change;
+
+            while (!done.load() &&
+                   handle.WaitForChange(DioSimPriority::Normal, &change) ==
+                       DioSimStatus::Success) {
+            }
+        });
+
+    } else {
+
+        client = std::thread([&] {
+            uint32_t lineState;
+
+            while (!done.load()) {
+
+                handle.Read(&lineState);
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(WAKE_BENCH_POLL_MS));
+            }
+        });
+    }
+
+    //
+    // Each change sets the lines to its own number, so we can tell which
+    // change each event in the ring is
+    //
+    for (uint32_t i = 1; i <= WAKE_BENCH_CHANGES; i++) {
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(WAKE_BENCH_PACE_MS));
+
+        changeTime[i] = DioSimEventRing::Now();
+
+        device.Bar().SetInputs(i);
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(WAKE_BENCH_PACE_MS));
+
+    done = true;
+
+    handle.Cancel();
+
+    client.join();
+
+    ring     = device.Ring().Ring();
+    producer = ring->ProducerIndex.load();
+
+    for (uint32_t index = 0; index < producer; index++) {
+
+        const DIO_EVENT& event = ring->Events[index & (ring->Capacity - 1)];
+
+        if (event.LineState == 0 || event.LineState > WAKE_BENCH_CHANGES) {
+            continue;
+        }
+
+        latencies.push_back(event.Timestamp - changeTime[event.LineState]);
+    }
+
+    DIO_SIM_POWER_STATS power = device.PowerStats();
+    double              total = (double)(power.D0Time + power.D3Time + power.TransitionTime);
+
+    BenchReport(Name, "changes_seen", 100.0 * latencies.size() / WAKE_BENCH_CHANGES, "%");
+    BenchReport(Name, "latency_p50", BenchPercentile(latencies, 0.5) / 1e3, "us");
+    BenchReport(Name, "latency_max", BenchPercentile(latencies, 1.0) / 1e3, "us");
+    BenchReport(Name, "d0", 100.0 * power.D0Time / total, "%");
+    BenchReport(Name, "d3", 100.0 * power.D3Time / total, "%");
+    BenchReport(Name, "transition", 100.0 * power.TransitionTime / total, "%");
+    BenchReport(Name, "idles", (double)power.Idles, "count");
+    BenchReport(Name, "wakes", (double)power.Wakes, "count");
+}
+
+void
+BenchWake()
+{
+    RunWake("wake.held", WakeBenchClient::Waiter, false);
+    RunWake("wake.idle", WakeBenchClient::Poller, false);
+    RunWake("wake.wake", WakeBenchClient::Waiter, true);
+}
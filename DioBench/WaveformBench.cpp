@@ -0,0 +1,249 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        WaveformBench.cpp -- Waveform generator throughput, accuracy
+//                             and playback
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      For each kind of waveform we generate WAVEFORM_BENCH_SECONDS of
+//      input through a DioSimWaveformSource and report how many edges a
+//      second we can generate.  Then all of them mixed together on
+//      disjoint lines, played into a simulated BAR as fast as we can.
+//
+//      We also check what the generators promise: that a Poisson stream
+//      has the rate it was asked for, that a rewound source gives the same
+//      stream again, and that a bouncing contact behind the large filter
+//      gives exactly one change per actuation.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <cmath>
+
+#include "../DioSim/DioSimPlayer.h"
+#include "../DioSim/DioSimWaveform.h"
+#include "DioBench.h"
+
+constexpr uint64_t WAVEFORM_BENCH_SECONDS = 1;
+constexpr size_t   WAVEFORM_BENCH_READ    = 1024;
+
+//
+// Rate of the Poisson stream, in edges per second
+//
+constexpr double   WAVEFORM_BENCH_RATE = 10e6;
+
+//
+// The bouncing contact: actuated every 50 ms or so, bouncing for up to
+// 1 ms, behind the large filter
+//
+constexpr uint64_t WAVEFORM_BENCH_BOUNCE_SECONDS = 600;
+constexpr uint64_t WAVEFORM_BENCH_ACTUATION_NS   = 50000000;
+constexpr uint64_t WAVEFORM_BENCH_BOUNCE_NS      = 1000000;
+
+typedef struct _WAVEFORM_BENCH_RUN {
+    uint64_t Events;
+    uint64_t Hash;
+    uint32_t FinalState;
+    uint64_t ElapsedNs;
+} WAVEFORM_BENCH_RUN;
+
+//
+// Reads the whole of Source, hashing what it returns
+//
+static WAVEFORM_BENCH_RUN
+Drain(DioSimWaveformSource& Source)
+{
+    DIO_EVENT          events[WAVEFORM_BENCH_READ];
+    WAVEFORM_BENCH_RUN run = {};
+    size_t             count;
+    BenchTimer         timer;
+
+    while ((count = Source.Read(events, WAVEFORM_BENCH_READ)) != 0) {
+
+        for (size_t i = 0; i < count; i++) {
+
+            run.Hash = (run.Hash * 1000003) ^ events[i].Timestamp ^
+                       ((uint64_t)events[i].ChangedLines << 32) ^ events[i].LineState;
+        }
+
+        run.Events    += count;
+        run.FinalState = events[count - 1].LineState;
+    }
+
+    run.ElapsedNs = timer.ElapsedNs();
+
+    return run;
+}
+
+static void
+BenchOne(const char*     Name,
+         DioSimWaveform& Waveform)
+{
+    DioSimWaveformSource source(WAVEFORM_BENCH_SECONDS * 1000000000ULL);
+    WAVEFORM_BENCH_RUN   run;
+
+    source.Add(&Waveform);
+
+    run = Drain(source);
+
+    BenchReport(Name, "edges", (double)source.Edges(), "events");
+    BenchReport(Name, "throughput", source.Edges() * 1e3 / run.ElapsedNs, "Medges/s");
+}
+
+void
+BenchWaveforms()
+{
+    //
+    // Each kind on its own
+    //
+    {
+        DioSimPoissonWaveform poisson(0xFFFFFFFF, WAVEFORM_BENCH_RATE, 0x5EED, 10);
+        DioSimClockWaveform   clock(0, 1000, 500, 0, 50);
+        DioSimBurstWaveform   burst(0xFF, 64, 20, 10000, 0xB0);
+        DioSimBounceWaveform  bounce(0, 20000, 8, 500, 0xB1);
+        DioSimEncoderWaveform encoder(0, 100, 5, 0xE2);
+        DioSimBusWaveform     bus(0, 16, 16, 200, 20, 0xB5);
+
+        BenchOne("waveform.poisson", poisson);
+        BenchOne("waveform.clock", clock);
+        BenchOne("waveform.burst", burst);
+        BenchOne("waveform.bounce", bounce);
+        BenchOne("waveform.encoder", encoder);
+        BenchOne("waveform.bus", bus);
+    }
+
+    //
+    // All of them at once, on their own lines, twice over to see that we
+    // get the same stream both times, and then played into a BAR
+    //
+    {
+        DioSimPoissonWaveform poisson(0xFF000000, WAVEFORM_BENCH_RATE / 4, 0x5EED, 10);
+        DioSimClockWaveform   clock(0, 1000, 500, 0, 50);
+        DioSimBurstWaveform   burst(0x0000000E, 64, 20, 10000, 0xB0);
+        DioSimBounceWaveform  bounce(4, 20000, 8, 500, 0xB1);
+        DioSimEncoderWaveform encoder(5, 100, 5, 0xE2);
+        DioSimBusWaveform     bus(8, 12, 20, 200, 20, 0xB5);
+        DioSimWaveformSource  source(WAVEFORM_BENCH_SECONDS * 1000000000ULL);
+        WAVEFORM_BENCH_RUN    first;
+        WAVEFORM_BENCH_RUN    second;
+
+        source.Add(&poisson);
+        source.Add(&clock);
+        source.Add(&burst);
+        source.Add(&bounce);
+        source.Add(&encoder);
+        source.Add(&bus);
+
+        first = Drain(source);
+
+        source.Rewind();
+
+        second = Drain(source);
+
+        BenchReport("waveform.mixed", "edges", (double)source.Edges(), "events");
+        BenchReport("waveform.mixed", "events", (double)first.Events, "events");
+        BenchReport("waveform.mixed", "throughput", source.Edges() * 1e3 / first.ElapsedNs, "Medges/s");
+        BenchReport("waveform.mixed", "reproducible",
+                    (first.Hash == second.Hash && first.Events == second.Events) ? 1.0 : 0.0, "bool");
+
+        DioSimBar    bar;
+        DioSimPlayer player(bar);
+        uint64_t     played;
+
+        bar.Write((uint32_t)DioSimRegister::DI_ChangeIrqRE_Register, 0xFFFFFFFF);
+        bar.Write((uint32_t)DioSimRegister::DI_ChangeIrqFE_Register, 0xFFFFFFFF);
+
+        source.Rewind();
+
+        BenchTimer timer;
+
+        played = player.Play(source, 0.0);
+
+        BenchReport("waveform.play", "events", (double)played, "events");
+        BenchReport("waveform.play", "throughput", played * 1e3 / timer.ElapsedNs(), "Mevents/s");
+        BenchReport("waveform.play", "final_state_matches",
+                    bar.LineLevels() == first.FinalState ? 1.0 : 0.0, "bool");
+    }
+
+    //
+    // The Poisson stream's rate, measured over a longer stream
+    //
+    {
+        DioSimPoissonWaveform poisson(0xFFFFFFFF, WAVEFORM_BENCH_RATE, 0x5EED);
+        DioSimWaveformSource  source(10 * 1000000000ULL, 1);
+        double                rate;
+
+        source.Add(&poisson);
+
+        Drain(source);
+
+        rate = source.Edges() / 10.0;
+
+        BenchReport("waveform.poisson", "rate_error",
+                    100.0 * fabs(rate - WAVEFORM_BENCH_RATE) / WAVEFORM_BENCH_RATE, "%");
+    }
+
+    //
+    // Ten minutes of a bouncing contact, behind the large filter
+    //
+    {
+        DioSimBounceWaveform bounce(0, WAVEFORM_BENCH_ACTUATION_NS, 8, WAVEFORM_BENCH_BOUNCE_NS, 0xB1);
+        DioSimWaveformSource source(WAVEFORM_BENCH_BOUNCE_SECONDS * 1000000000ULL);
+        WAVEFORM_BENCH_RUN   run;
+        uint64_t             actuations;
+
+        source.Add(&bounce);
+        source.SetFilters(DIO_SIM_Filter_Large, 0);
+
+        run = Drain(source);
+
+        //
+        // The last actuation may not have got through the filter before
+        // the stream ended
+        //
+        actuations = bounce.Actuations();
+
+        if (source.PassedEdges() + 1 == actuations) {
+            actuations--;
+        }
+
+        BenchReport("waveform.filter", "edges", (double)source.Edges(), "events");
+        BenchReport("waveform.filter", "passed", (double)source.PassedEdges(), "events");
+        BenchReport("waveform.filter", "mismatches",
+                    (double)(source.PassedEdges() > actuations ?
+                             source.PassedEdges() - actuations :
+                             actuations - source.PassedEdges()), "events");
+        BenchReport("waveform.filter", "throughput", source.Edges() * 1e3 / run.ElapsedNs, "Medges/s");
+    }
+}
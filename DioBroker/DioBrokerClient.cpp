@@ -0,0 +1,418 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioBrokerClient.cpp -- A client of the broker: line state, events
+//                               and output lines of a shared device
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include "DioBrokerClient.h"
+
+#include <chrono>
+#include <cstring>
+
+//
+// Longest a client sleeps before it checks the broker is still there
+//
+constexpr uint32_t CLIENT_POLL_MS = 100;
+
+DioBrokerClient::DioBrokerClient()
+    : Shared(nullptr),
+      Slot(nullptr),
+      Cursor(0),
+      LastDeviceOverflows(0),
+      Overflows(0),
+      Lost(0)
+{
+}
+
+DioBrokerClient::~DioBrokerClient()
+{
+    Close();
+}
+
+bool
+DioBrokerClient::Open(const char* Name)
+{
+    PDIO_BROKER_SHARED shared;
+
+    if (!Section.Open(Name)) {
+        return false;
+    }
+
+    shared = Section.Shared();
+
+    if (shared->Signature != DIO_BROKER_SIGNATURE ||
+        shared->Version != DIO_BROKER_VERSION ||
+        shared->Size != sizeof(DIO_BROKER_SHARED) ||
+        shared->Running.load(std::memory_order_acquire) == 0) {
+        goto failed;
+    }
+
+    for (uint32_t i = 0; i < DIO_BROKER_MAX_CLIENTS; i++) {
+
+        uint32_t free = 0;
+
+        if (shared->Clients[i].InUse.compare_exchange_strong(free, 1,
+                                                             std::memory_order_acq_rel)) {
+
+            Slot = &shared->Clients[i];
+
+            if (!Doorbell.Open(DioBrokerDoorbellName(Name, i).c_str(),
+                               &Slot->Doorbell)) {
+                goto failed;
+            }
+
+            break;
+        }
+    }
+
+    if (Slot == nullptr) {
+        goto failed;
+    }
+
+    if (!BrokerDoorbell.Open(DioBrokerDoorbellName(Name, DIO_BROKER_MAX_CLIENTS).c_str(),
+                             &shared->BrokerDoorbell)) {
+        goto failed;
+    }
+
+    Slot->Waiting.store(0, std::memory_order_relaxed);
+    Slot->ProcessId.store(DioBrokerCurrentProcessId(), std::memory_order_release);
+
+    Shared              = shared;
+    Cursor              = shared->EventProducer.load(std::memory_order_acquire);
+    LastDeviceOverflows = shared->DeviceOverflows.load(std::memory_order_relaxed);
+    Overflows           = 0;
+    Lost                = 0;
+
+    return true;
+
+failed:
+
+    Doorbell.Close();
+    BrokerDoorbell.Close();
+
+    if (Slot != nullptr) {
+        Slot->InUse.store(0, std::memory_order_release);
+        Slot = nullptr;
+    }
+
+    Section.Close();
+
+    return false;
+}
+
+void
+DioBrokerClient::Close()
+{
+    if (Shared == nullptr) {
+        return;
+    }
+
+    //
+    // Give our lines back before we give up the slot, so the next client
+    // to use it doesn't find them already claimed
+    //
+    if (Connected() && OwnedLines() != 0) {
+        Request(DioBrokerCommand::Release, 0xFFFFFFFF, 0);
+    }
+
+    Doorbell.Close();
+    BrokerDoorbell.Close();
+
+    Slot->ProcessId.store(0, std::memory_order_relaxed);
+    Slot->InUse.store(0, std::memory_order_release);
+
+    Slot   = nullptr;
+    Shared = nullptr;
+
+    Section.Close();
+}
+
+bool
+DioBrokerClient::Connected() const
+{
+    return Shared != nullptr && Shared->Running.load(std::memory_order_acquire) != 0;
+}
+
+DIO_BROKER_LINE_STATE
+DioBrokerClient::ReadLineState() const
+{
+    DIO_BROKER_LINE_STATE state = {};
+    uint32_t              before;
+    uint32_t              after;
+
+    if (Shared == nullptr) {
+        return state;
+    }
+
+    do {
+
+        before = Shared->StateSequence.load(std::memory_order_acquire);
+
+        state.LineState   = Shared->LineState.load(std::memory_order_relaxed);
+        state.OutputLines = Shared->OutputLines.load(std::memory_order_relaxed);
+        state.OutputState = Shared->OutputState.load(std::memory_order_relaxed);
+        state.Timestamp   = Shared->StateTimestamp.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        after = Shared->StateSequence.load(std::memory_order_relaxed);
+
+    } while ((before & 1) != 0 || before != after);
+
+    return state;
+}
+
+//
+// Copy out whatever events are available.  The broker may be overwriting
+// the oldest of them while we copy, so once we've copied we check how far
+// it has reserved, and throw away anything it might have been writing
+// over.  EventProducer isn't enough for that: the broker writes the slots
+// before it advances EventProducer.
+//
+size_t
+DioBrokerClient::CopyEvents(PDIO_EVENT Events,
+                            size_t     Count)
+{
+    uint64_t producer;
+    uint64_t reserve;
+    uint64_t deviceOverflows;
+    size_t   available;
+    size_t   skip;
+
+    producer = Shared->EventProducer.load(std::memory_order_acquire);
+
+    if (producer - Cursor > DIO_BROKER_EVENT_CAPACITY) {
+
+        Lost   += producer - Cursor - DIO_BROKER_EVENT_CAPACITY;
+        Cursor  = producer - DIO_BROKER_EVENT_CAPACITY;
+
+        Overflows++;
+    }
+
+    available = static_cast<size_t>(producer - Cursor);
+
+    if (available > Count) {
+        available = Count;
+    }
+
+    for (size_t i = 0; i < available; i++) {
+
+        const DIO_BROKER_EVENT_SLOT& slot =
+            Shared->Events[(Cursor + i) & (DIO_BROKER_EVENT_CAPACITY - 1)];
+
+        Events[i].Timestamp    = slot.Timestamp.load(std::memory_order_relaxed);
+        Events[i].LineState    = slot.LineState.load(std::memory_order_relaxed);
+        Events[i].ChangedLines = slot.ChangedLines.load(std::memory_order_relaxed);
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    reserve = Shared->EventReserve.load(std::memory_order_relaxed);
+
+    if (reserve - Cursor > DIO_BROKER_EVENT_CAPACITY) {
+
+        //
+        // The ones from Cursor up to reserve - capacity have been (or are
+        // being) overwritten, so they may be torn; keep the rest
+        //
+        skip = static_cast<size_t>(reserve - DIO_BROKER_EVENT_CAPACITY - Cursor);
+
+        if (skip > available) {
+            skip = available;
+        }
+
+        Lost   += reserve - DIO_BROKER_EVENT_CAPACITY - Cursor;
+        Cursor  = reserve - DIO_BROKER_EVENT_CAPACITY;
+
+        Overflows++;
+
+        memmove(Events, Events + skip, (available - skip) * sizeof(DIO_EVENT));
+
+        available -= skip;
+    }
+
+    Cursor += available;
+
+    deviceOverflows = Shared->DeviceOverflows.load(std::memory_order_relaxed);
+
+    if (deviceOverflows != LastDeviceOverflows) {
+
+        Overflows += deviceOverflows - LastDeviceOverflows;
+
+        LastDeviceOverflows = deviceOverflows;
+    }
+
+    return available;
+}
+
+size_t
+DioBrokerClient::ReadEvents(PDIO_EVENT Events,
+                            size_t     Count,
+                            uint32_t   TimeoutMs)
+{
+    size_t   count;
+    uint32_t doorbell;
+    uint32_t waitMs;
+
+    if (Shared == nullptr || Count == 0) {
+        return 0;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(TimeoutMs);
+
+    while (true) {
+
+        count = CopyEvents(Events, Count);
+
+        if (count != 0 || !Connected()) {
+            return count;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+
+        if (now >= deadline) {
+            return 0;
+        }
+
+        waitMs = static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count()) + 1;
+
+        //
+        // Say we're waiting, then look once more, so the broker can't
+        // publish (and not ring) between our looking and our sleeping
+        //
+        doorbell = Slot->Doorbell.load(std::memory_order_relaxed);
+
+        Slot->Waiting.store(1, std::memory_order_seq_cst);
+
+        if (Shared->EventProducer.load(std::memory_order_seq_cst) == Cursor) {
+            Doorbell.Wait(doorbell, waitMs < CLIENT_POLL_MS ? waitMs : CLIENT_POLL_MS);
+        }
+
+        Slot->Waiting.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t
+DioBrokerClient::Read(PDIO_EVENT Events,
+                      size_t     Count)
+{
+    size_t count;
+
+    while (Connected()) {
+
+        count = ReadEvents(Events, Count, CLIENT_POLL_MS);
+
+        if (count != 0) {
+            return count;
+        }
+    }
+
+    //
+    // The broker's gone, but there may be events it published first
+    //
+    return Shared != nullptr ? CopyEvents(Events, Count) : 0;
+}
+
+DioBrokerStatus
+DioBrokerClient::Request(DioBrokerCommand Command,
+                         uint32_t         Lines,
+                         uint32_t         Values)
+{
+    uint32_t sequence;
+    uint32_t doorbell;
+
+    if (!Connected()) {
+        return DioBrokerStatus::DeviceError;
+    }
+
+    Slot->Command.store(static_cast<uint32_t>(Command), std::memory_order_relaxed);
+    Slot->Lines.store(Lines, std::memory_order_relaxed);
+    Slot->Values.store(Values, std::memory_order_relaxed);
+
+    sequence = Slot->RequestSequence.load(std::memory_order_relaxed) + 1;
+
+    Slot->RequestSequence.store(sequence, std::memory_order_release);
+
+    BrokerDoorbell.Ring();
+
+    //
+    // The broker always rings us when it responds, so there's no need for
+    // Waiting here
+    //
+    while (true) {
+
+        doorbell = Slot->Doorbell.load(std::memory_order_acquire);
+
+        if (Slot->ResponseSequence.load(std::memory_order_acquire) == sequence) {
+            break;
+        }
+
+        if (!Connected()) {
+            return DioBrokerStatus::DeviceError;
+        }
+
+        Doorbell.Wait(doorbell, CLIENT_POLL_MS);
+    }
+
+    return static_cast<DioBrokerStatus>(Slot->Status.load(std::memory_order_relaxed));
+}
+
+DioBrokerStatus
+DioBrokerClient::Claim(uint32_t Lines)
+{
+    return Request(DioBrokerCommand::Claim, Lines, 0);
+}
+
+DioBrokerStatus
+DioBrokerClient::Release(uint32_t Lines)
+{
+    return Request(DioBrokerCommand::Release, Lines, 0);
+}
+
+DioBrokerStatus
+DioBrokerClient::Write(uint32_t Lines,
+                       uint32_t Values)
+{
+    return Request(DioBrokerCommand::Write, Lines, Values);
+}
+
+uint32_t
+DioBrokerClient::OwnedLines() const
+{
+    return Slot != nullptr ? Slot->OwnedLines.load(std::memory_order_relaxed) : 0;
+}
@@ -0,0 +1,156 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioBrokerClient.h -- A client of the broker: line state, events
+//                             and output lines of a shared device
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      Reading the line state and reading events never involve the broker
+//      (or the kernel, unless there's nothing to read and the client has
+//      to sleep); they're reads of the shared section.  Claiming, releasing
+//      and writing output lines are requests the broker serves in turn,
+//      which is how it arbitrates between clients.
+//
+//      A client is used by one thread at a time.  Threads (or processes)
+//      that each want the device open their own clients.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <string>
+
+#include "DioBrokerShared.h"
+
+//
+// DIO_BROKER_LINE_STATE
+//
+// A consistent copy of the device's line state, as the broker last saw
+// it.  Timestamp is in nanoseconds, on the same clock as event timestamps.
+//
+typedef struct _DIO_BROKER_LINE_STATE {
+    uint32_t    LineState;
+    uint32_t    OutputLines;
+    uint32_t    OutputState;
+    uint64_t    Timestamp;
+} DIO_BROKER_LINE_STATE, *PDIO_BROKER_LINE_STATE;
+
+//
+// DioBrokerClient
+//
+// Also a DioEventSource, so a client can be captured, recorded or analyzed
+// exactly like the device itself.  Read returns zero once the broker has
+// stopped.  OverflowCount counts the times this client fell so far behind
+// that the broker's ring lapped it, plus the times the device lost events.
+//
+class DioBrokerClient : public DioEventSource
+{
+public:
+    DioBrokerClient();
+    ~DioBrokerClient() override;
+
+    DioBrokerClient(const DioBrokerClient&) = delete;
+    DioBrokerClient& operator=(const DioBrokerClient&) = delete;
+
+    //
+    // Connect to the broker.  Events are returned from the time Open is
+    // called; nothing older.
+    //
+    bool Open(const char* Name = DIO_BROKER_DEFAULT_NAME);
+
+    void Close();
+
+    //
+    // Whether the broker is still running
+    //
+    bool Connected() const;
+
+    DIO_BROKER_LINE_STATE ReadLineState() const;
+
+    size_t Read(PDIO_EVENT Events,
+                size_t     Count) override;
+
+    //
+    // Read, but give up (and return zero) after TimeoutMs
+    //
+    size_t ReadEvents(PDIO_EVENT Events,
+                      size_t     Count,
+                      uint32_t   TimeoutMs);
+
+    uint64_t OverflowCount() const override
+    {
+        return Overflows;
+    }
+
+    //
+    // Events lost because the broker's ring lapped this client
+    //
+    uint64_t LostEvents() const
+    {
+        return Lost;
+    }
+
+    //
+    // Output line ownership.  Claim is all or nothing: if any of Lines is
+    // owned by another client, nothing is claimed.  Write changes only
+    // Lines, all of which must be owned by this client.
+    //
+    DioBrokerStatus Claim(uint32_t Lines);
+
+    DioBrokerStatus Release(uint32_t Lines);
+
+    DioBrokerStatus Write(uint32_t Lines,
+                          uint32_t Values);
+
+    uint32_t OwnedLines() const;
+
+private:
+    DioBrokerStatus Request(DioBrokerCommand Command,
+                            uint32_t         Lines,
+                            uint32_t         Values);
+
+    size_t CopyEvents(PDIO_EVENT Events,
+                      size_t     Count);
+
+    DioBrokerSection        Section;
+    PDIO_BROKER_SHARED      Shared;
+    PDIO_BROKER_CLIENT_SLOT Slot;
+    DioBrokerDoorbell       Doorbell;
+    DioBrokerDoorbell       BrokerDoorbell;
+    uint64_t                Cursor;
+    uint64_t                LastDeviceOverflows;
+    uint64_t                Overflows;
+    uint64_t                Lost;
+};
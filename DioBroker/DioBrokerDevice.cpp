@@ -0,0 +1,133 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioBrokerDevice.cpp -- The device the broker shares: the driver
+//                               or the simulator
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include "DioBrokerDevice.h"
+#include "../DioSim/DioSimDevice.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include "../inc/OsrDio_IOCTL.h"
+#endif
+
+DioBrokerSimDevice::DioBrokerSimDevice(DioSimDevice& Device)
+    : Device(Device)
+{
+}
+
+DioEventRingSource&
+DioBrokerSimDevice::Events()
+{
+    return Device.Ring();
+}
+
+bool
+DioBrokerSimDevice::ReadLines(uint32_t* LineState)
+{
+    *LineState = Device.ReadLines();
+
+    return true;
+}
+
+bool
+DioBrokerSimDevice::SetOutputs(uint32_t OutputLines)
+{
+    return Device.SetOutputs(OutputLines);
+}
+
+bool
+DioBrokerSimDevice::WriteOutputs(uint32_t LineState)
+{
+    return Device.WriteOutputs(LineState);
+}
+
+#ifdef _WIN32
+
+bool
+DioBrokerLiveDevice::Open(uint32_t RingCapacity)
+{
+    return Ring.Open(RingCapacity);
+}
+
+bool
+DioBrokerLiveDevice::ReadLines(uint32_t* LineState)
+{
+    OSRDIO_READ_DATA data;
+
+    if (!Ring.Control(IOCTL_OSRDIO_READ,
+                      nullptr,
+                      0,
+                      &data,
+                      sizeof(data))) {
+        return false;
+    }
+
+    *LineState = data.CurrentLineState;
+
+    return true;
+}
+
+bool
+DioBrokerLiveDevice::SetOutputs(uint32_t OutputLines)
+{
+    OSRDIO_SET_OUTPUTS_DATA data;
+
+    data.OutputLines = OutputLines;
+
+    return Ring.Control(IOCTL_OSRDIO_SET_OUTPUTS,
+                        &data,
+                        sizeof(data),
+                        nullptr,
+                        0);
+}
+
+bool
+DioBrokerLiveDevice::WriteOutputs(uint32_t LineState)
+{
+    OSRDIO_WRITE_DATA data;
+
+    data.OutputLineState = LineState;
+
+    return Ring.Control(IOCTL_OSRDIO_WRITE,
+                        &data,
+                        sizeof(data),
+                        nullptr,
+                        0);
+}
+
+#endif
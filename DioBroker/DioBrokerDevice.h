@@ -0,0 +1,121 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioBrokerDevice.h -- The device the broker shares: the driver
+//                             or the simulator
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstdint>
+
+#include "../DioCapture/DioEventRing.h"
+
+//
+// DioBrokerDevice
+//
+// The operations the broker needs from the device.  Events come from an
+// event ring the broker consumes in place; the rest correspond one to one
+// with IOCTL_OSRDIO_READ, IOCTL_OSRDIO_SET_OUTPUTS and IOCTL_OSRDIO_WRITE.
+// The broker calls the line operations from one thread at a time.
+//
+class DioBrokerDevice
+{
+public:
+    virtual ~DioBrokerDevice() = default;
+
+    virtual DioEventRingSource& Events() = 0;
+
+    virtual bool ReadLines(uint32_t* LineState) = 0;
+
+    virtual bool SetOutputs(uint32_t OutputLines) = 0;
+
+    virtual bool WriteOutputs(uint32_t LineState) = 0;
+};
+
+class DioSimDevice;
+
+//
+// DioBrokerSimDevice
+//
+// The simulated device (see DioSimDevice), for running the broker, and
+// its clients, on any host.
+//
+class DioBrokerSimDevice : public DioBrokerDevice
+{
+public:
+    explicit DioBrokerSimDevice(DioSimDevice& Device);
+
+    DioEventRingSource& Events() override;
+
+    bool ReadLines(uint32_t* LineState) override;
+
+    bool SetOutputs(uint32_t OutputLines) override;
+
+    bool WriteOutputs(uint32_t LineState) override;
+
+private:
+    DioSimDevice& Device;
+};
+
+#ifdef _WIN32
+
+//
+// DioBrokerLiveDevice
+//
+// The OsrDio driver, through a DioLiveEventRing (whose handle is the only
+// one the broker opens).
+//
+class DioBrokerLiveDevice : public DioBrokerDevice
+{
+public:
+    bool Open(uint32_t RingCapacity);
+
+    DioEventRingSource& Events() override
+    {
+        return Ring;
+    }
+
+    bool ReadLines(uint32_t* LineState) override;
+
+    bool SetOutputs(uint32_t OutputLines) override;
+
+    bool WriteOutputs(uint32_t LineState) override;
+
+private:
+    DioLiveEventRing Ring;
+};
+
+#endif
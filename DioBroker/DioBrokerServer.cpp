@@ -0,0 +1,563 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioBrokerServer.cpp -- The broker: owns the device and shares it
+//                               with local clients
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include "DioBrokerServer.h"
+#include "../DioCapture/DioCaptureRecorder.h"
+
+#include <chrono>
+
+//
+// Most events the pump moves from the device's ring to the broadcast ring
+// before it publishes them
+//
+constexpr uint32_t BROKER_PUMP_BATCH = 256;
+
+//
+// How often the command thread looks for clients that have died
+//
+constexpr uint32_t BROKER_RECLAIM_MS = 100;
+
+DioBrokerServer::DioBrokerServer(DioBrokerDevice& Device)
+    : Device(Device),
+      Shared(nullptr),
+      Stopping(false),
+      Owned(),
+      HandledSequence(),
+      OutputLines(0),
+      OutputState(0),
+      EventCount(0),
+      CommandCount(0),
+      ReclaimCount(0),
+      PumpCpuNs(0)
+{
+}
+
+DioBrokerServer::~DioBrokerServer()
+{
+    Stop();
+}
+
+bool
+DioBrokerServer::Start(const char* Name)
+{
+    if (!Section.Create(Name)) {
+        return false;
+    }
+
+    this->Name = Name;
+
+    Shared = Section.Shared();
+
+    Shared->Signature       = DIO_BROKER_SIGNATURE;
+    Shared->Version         = DIO_BROKER_VERSION;
+    Shared->Size            = sizeof(DIO_BROKER_SHARED);
+    Shared->MaxClients      = DIO_BROKER_MAX_CLIENTS;
+    Shared->EventCapacity   = DIO_BROKER_EVENT_CAPACITY;
+    Shared->BrokerProcessId = DioBrokerCurrentProcessId();
+
+    for (uint32_t i = 0; i < DIO_BROKER_MAX_CLIENTS; i++) {
+
+        if (!ClientDoorbells[i].Open(DioBrokerDoorbellName(Name, i).c_str(),
+                                     &Shared->Clients[i].Doorbell)) {
+            goto failed;
+        }
+    }
+
+    if (!BrokerDoorbell.Open(DioBrokerDoorbellName(Name, DIO_BROKER_MAX_CLIENTS).c_str(),
+                             &Shared->BrokerDoorbell)) {
+        goto failed;
+    }
+
+    //
+    // Start with every line an input, whatever the last user of the
+    // device left behind
+    //
+    if (!Device.SetOutputs(0)) {
+        goto failed;
+    }
+
+    RefreshState();
+
+    Shared->Running.store(1, std::memory_order_release);
+
+    Stopping = false;
+
+    Pump     = std::thread(&DioBrokerServer::PumpThread, this);
+    Commands = std::thread(&DioBrokerServer::CommandThread, this);
+
+    return true;
+
+failed:
+
+    Section.Close();
+
+    Shared = nullptr;
+
+    return false;
+}
+
+void
+DioBrokerServer::Stop()
+{
+    if (Shared == nullptr) {
+        return;
+    }
+
+    Stopping = true;
+
+    Shared->Running.store(0, std::memory_order_release);
+
+    BrokerDoorbell.Ring();
+
+    if (Pump.joinable()) {
+        Pump.join();
+    }
+
+    if (Commands.joinable()) {
+        Commands.join();
+    }
+
+    //
+    // Wake every client, so they notice we've gone
+    //
+    for (uint32_t i = 0; i < DIO_BROKER_MAX_CLIENTS; i++) {
+
+        ClientDoorbells[i].Ring();
+        ClientDoorbells[i].Close();
+    }
+
+    BrokerDoorbell.Close();
+
+    Section.Close();
+
+    Shared = nullptr;
+}
+
+DIO_BROKER_STATS
+DioBrokerServer::Stats() const
+{
+    DIO_BROKER_STATS stats;
+
+    stats.Events           = EventCount;
+    stats.DeviceOverflows  = Shared != nullptr ? Shared->DeviceOverflows.load() : 0;
+    stats.Commands         = CommandCount;
+    stats.ReclaimedClients = ReclaimCount;
+    stats.PumpCpuNs        = PumpCpuNs;
+    stats.Clients          = 0;
+    stats.OutputLines      = Shared != nullptr ? Shared->OutputLines.load() : 0;
+
+    if (Shared != nullptr) {
+
+        for (uint32_t i = 0; i < DIO_BROKER_MAX_CLIENTS; i++) {
+
+            if (Shared->Clients[i].InUse.load(std::memory_order_relaxed)) {
+                stats.Clients++;
+            }
+        }
+    }
+
+    return stats;
+}
+
+//
+// Publish the line state under the sequence lock.  The pump and the
+// command thread both publish, so they take turns.
+//
+void
+DioBrokerServer::PublishState(uint32_t LineState,
+                              uint64_t Timestamp)
+{
+    uint32_t sequence;
+
+    std::lock_guard<std::mutex> lock(StateLock);
+
+    sequence = Shared->StateSequence.load(std::memory_order_relaxed);
+
+    Shared->StateSequence.store(sequence + 1, std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_release);
+
+    Shared->LineState.store(LineState, std::memory_order_relaxed);
+    Shared->OutputLines.store(OutputLines, std::memory_order_relaxed);
+    Shared->OutputState.store(OutputState, std::memory_order_relaxed);
+    Shared->StateTimestamp.store(Timestamp, std::memory_order_relaxed);
+
+    Shared->StateSequence.store(sequence + 2, std::memory_order_release);
+}
+
+//
+// Read the lines from the device and publish them, after we've changed
+// the outputs
+//
+void
+DioBrokerServer::RefreshState()
+{
+    uint32_t        lineState;
+    PDIO_EVENT_RING ring;
+
+    if (!Device.ReadLines(&lineState)) {
+        return;
+    }
+
+    ring = Device.Events().Ring();
+
+    PublishState(lineState,
+                 ring != nullptr ? DioTicksToNs(Device.Events().CurrentTimestamp(),
+                                                ring->TimestampFrequency) : 0);
+}
+
+void
+DioBrokerServer::PumpThread()
+{
+    DioEventRingSource& source = Device.Events();
+    PDIO_EVENT_RING     ring;
+    uint64_t            startCpuNs;
+    uint64_t            frequency;
+    uint64_t            producer;
+    uint32_t            consumer;
+    uint32_t            available;
+    uint32_t            count;
+    uint32_t            overflowCount;
+    uint32_t            lastOverflowCount;
+    uint32_t            lineState = 0;
+    uint64_t            timestamp = 0;
+
+    ring = source.Ring();
+
+    if (ring == nullptr) {
+        return;
+    }
+
+    startCpuNs        = DioCaptureRecorder::ThreadCpuNs();
+    frequency         = ring->TimestampFrequency;
+    consumer          = ring->ConsumerIndex.load(std::memory_order_relaxed);
+    lastOverflowCount = ring->OverflowCount.load(std::memory_order_relaxed);
+
+    while (!Stopping.load(std::memory_order_relaxed)) {
+
+        available = ring->ProducerIndex.load(std::memory_order_acquire) - consumer;
+
+        if (available == 0) {
+
+            if (!source.Wait(100) && source.Finished()) {
+                break;
+            }
+
+            continue;
+        }
+
+        count = available < BROKER_PUMP_BATCH ? available : BROKER_PUMP_BATCH;
+
+        overflowCount = ring->OverflowCount.load(std::memory_order_relaxed);
+
+        if (overflowCount != lastOverflowCount) {
+
+            Shared->DeviceOverflows.fetch_add(overflowCount - lastOverflowCount,
+                                              std::memory_order_relaxed);
+
+            lastOverflowCount = overflowCount;
+        }
+
+        //
+        // Copy the events into the broadcast ring, converting timestamps
+        // to nanoseconds on the way, then publish them all at once.  We
+        // reserve the slots first, so that a client copying the events
+        // we're about to overwrite knows not to trust them.
+        //
+        producer = Shared->EventProducer.load(std::memory_order_relaxed);
+
+        Shared->EventReserve.store(producer + count, std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (uint32_t i = 0; i < count; i++) {
+
+            const DIO_EVENT&       in  = ring->Events[(consumer + i) & (ring->Capacity - 1)];
+            DIO_BROKER_EVENT_SLOT& out = Shared->Events[(producer + i) & (DIO_BROKER_EVENT_CAPACITY - 1)];
+
+            lineState = in.LineState;
+            timestamp = DioTicksToNs(in.Timestamp, frequency);
+
+            out.Timestamp.store(timestamp, std::memory_order_relaxed);
+            out.LineState.store(in.LineState, std::memory_order_relaxed);
+            out.ChangedLines.store(in.ChangedLines, std::memory_order_relaxed);
+        }
+
+        EventCount.fetch_add(count, std::memory_order_relaxed);
+
+        Shared->EventProducer.store(producer + count, std::memory_order_seq_cst);
+
+        consumer += count;
+
+        ring->ConsumerIndex.store(consumer, std::memory_order_release);
+
+        PublishState(lineState, timestamp);
+
+        //
+        // Wake the clients that are waiting.  They set Waiting before they
+        // look at EventProducer, and we look at Waiting after we set it.
+        //
+        for (uint32_t i = 0; i < DIO_BROKER_MAX_CLIENTS; i++) {
+
+            if (Shared->Clients[i].Waiting.load(std::memory_order_seq_cst)) {
+                ClientDoorbells[i].Ring();
+            }
+        }
+
+        PumpCpuNs = DioCaptureRecorder::ThreadCpuNs() - startCpuNs;
+    }
+}
+
+void
+DioBrokerServer::CommandThread()
+{
+    uint32_t doorbell;
+    uint32_t sequence;
+    bool     handled;
+
+    auto nextReclaim = std::chrono::steady_clock::now();
+
+    while (!Stopping.load(std::memory_order_relaxed)) {
+
+        doorbell = Shared->BrokerDoorbell.load();
+        handled  = false;
+
+        for (uint32_t i = 0; i < DIO_BROKER_MAX_CLIENTS; i++) {
+
+            PDIO_BROKER_CLIENT_SLOT slot = &Shared->Clients[i];
+
+            if (!slot->InUse.load(std::memory_order_acquire)) {
+                continue;
+            }
+
+            sequence = slot->RequestSequence.load(std::memory_order_acquire);
+
+            if (sequence != HandledSequence[i]) {
+
+                HandleRequest(i, sequence);
+
+                handled = true;
+            }
+        }
+
+        if (std::chrono::steady_clock::now() >= nextReclaim) {
+
+            ReclaimDeadClients();
+
+            nextReclaim = std::chrono::steady_clock::now() +
+                          std::chrono::milliseconds(BROKER_RECLAIM_MS);
+        }
+
+        if (!handled) {
+            BrokerDoorbell.Wait(doorbell, BROKER_RECLAIM_MS);
+        }
+    }
+}
+
+void
+DioBrokerServer::HandleRequest(uint32_t Index,
+                               uint32_t Sequence)
+{
+    PDIO_BROKER_CLIENT_SLOT slot = &Shared->Clients[Index];
+    DioBrokerStatus         status;
+    uint32_t                lines;
+    uint32_t                values;
+
+    lines  = slot->Lines.load(std::memory_order_relaxed);
+    values = slot->Values.load(std::memory_order_relaxed);
+
+    switch (static_cast<DioBrokerCommand>(slot->Command.load(std::memory_order_relaxed))) {
+
+        case DioBrokerCommand::Claim:
+            status = ClaimLines(Index, lines);
+            break;
+
+        case DioBrokerCommand::Release:
+            status = ReleaseLines(Index, lines);
+            break;
+
+        case DioBrokerCommand::Write:
+            status = WriteLines(Index, lines, values);
+            break;
+
+        default:
+            status = DioBrokerStatus::BadRequest;
+            break;
+    }
+
+    HandledSequence[Index] = Sequence;
+
+    slot->OwnedLines.store(Owned[Index], std::memory_order_relaxed);
+    slot->Status.store(static_cast<int32_t>(status), std::memory_order_relaxed);
+    slot->ResponseSequence.store(Sequence, std::memory_order_seq_cst);
+
+    ClientDoorbells[Index].Ring();
+
+    CommandCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+//
+// Make the device's output lines the union of everyone's claims, and
+// drive them to the levels we've been asked for
+//
+bool
+DioBrokerServer::ProgramOutputs()
+{
+    uint32_t outputLines = 0;
+
+    for (uint32_t i = 0; i < DIO_BROKER_MAX_CLIENTS; i++) {
+        outputLines |= Owned[i];
+    }
+
+    OutputState &= outputLines;
+
+    if (outputLines != OutputLines) {
+
+        OutputLines = outputLines;
+
+        if (!Device.SetOutputs(OutputLines)) {
+            return false;
+        }
+    }
+
+    //
+    // The driver won't write with no output lines, and there's nothing to
+    // write anyway
+    //
+    if (OutputLines != 0 && !Device.WriteOutputs(OutputState)) {
+        return false;
+    }
+
+    RefreshState();
+
+    return true;
+}
+
+DioBrokerStatus
+DioBrokerServer::ClaimLines(uint32_t Index,
+                            uint32_t Lines)
+{
+    uint32_t others = 0;
+
+    for (uint32_t i = 0; i < DIO_BROKER_MAX_CLIENTS; i++) {
+
+        if (i != Index) {
+            others |= Owned[i];
+        }
+    }
+
+    if ((Lines & others) != 0) {
+        return DioBrokerStatus::Conflict;
+    }
+
+    Owned[Index] |= Lines;
+
+    return ProgramOutputs() ? DioBrokerStatus::Success : DioBrokerStatus::DeviceError;
+}
+
+DioBrokerStatus
+DioBrokerServer::ReleaseLines(uint32_t Index,
+                              uint32_t Lines)
+{
+    Owned[Index] &= ~Lines;
+
+    return ProgramOutputs() ? DioBrokerStatus::Success : DioBrokerStatus::DeviceError;
+}
+
+DioBrokerStatus
+DioBrokerServer::WriteLines(uint32_t Index,
+                            uint32_t Lines,
+                            uint32_t Values)
+{
+    if ((Lines & ~Owned[Index]) != 0) {
+        return DioBrokerStatus::NotOwner;
+    }
+
+    OutputState = (OutputState & ~Lines) | (Values & Lines);
+
+    return ProgramOutputs() ? DioBrokerStatus::Success : DioBrokerStatus::DeviceError;
+}
+
+//
+// A client that exits without closing leaves its slot in use, and keeps
+// its lines.  Give them back.
+//
+void
+DioBrokerServer::ReclaimDeadClients()
+{
+    uint32_t processId;
+    uint32_t sequence;
+
+    for (uint32_t i = 0; i < DIO_BROKER_MAX_CLIENTS; i++) {
+
+        PDIO_BROKER_CLIENT_SLOT slot = &Shared->Clients[i];
+
+        if (!slot->InUse.load(std::memory_order_acquire)) {
+            continue;
+        }
+
+        //
+        // Zero means the client is still setting up its slot
+        //
+        processId = slot->ProcessId.load(std::memory_order_relaxed);
+
+        if (processId == 0 || DioBrokerProcessAlive(processId)) {
+            continue;
+        }
+
+        if (Owned[i] != 0) {
+
+            Owned[i] = 0;
+
+            ProgramOutputs();
+        }
+
+        sequence = slot->RequestSequence.load(std::memory_order_relaxed);
+
+        HandledSequence[i] = sequence;
+
+        slot->OwnedLines.store(0, std::memory_order_relaxed);
+        slot->Waiting.store(0, std::memory_order_relaxed);
+        slot->ResponseSequence.store(sequence, std::memory_order_relaxed);
+        slot->ProcessId.store(0, std::memory_order_relaxed);
+        slot->InUse.store(0, std::memory_order_release);
+
+        ReclaimCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
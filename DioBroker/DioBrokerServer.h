@@ -0,0 +1,146 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioBrokerServer.h -- The broker: owns the device and shares it
+//                             with local clients
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      Two threads do the work.  The pump consumes the device's event ring
+//      in place, copies each event (once) into the shared broadcast ring,
+//      publishes the new line state, and rings the doorbells of clients
+//      that are waiting for events.  The command thread serves client
+//      requests to claim, release and write output lines, and notices
+//      clients that have died holding lines (so their lines don't stay
+//      claimed forever).  See DioBrokerShared.h for the protocol.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "DioBrokerDevice.h"
+#include "DioBrokerShared.h"
+
+//
+// DIO_BROKER_STATS
+//
+// PumpCpuNs is the CPU time used by the pump thread, which is the cost of
+// fanning events out (however many clients there are).
+//
+typedef struct _DIO_BROKER_STATS {
+    uint64_t    Events;
+    uint64_t    DeviceOverflows;
+    uint64_t    Commands;
+    uint64_t    ReclaimedClients;
+    uint64_t    PumpCpuNs;
+    uint32_t    Clients;
+    uint32_t    OutputLines;
+} DIO_BROKER_STATS, *PDIO_BROKER_STATS;
+
+class DioBrokerServer
+{
+public:
+    explicit DioBrokerServer(DioBrokerDevice& Device);
+    ~DioBrokerServer();
+
+    DioBrokerServer(const DioBrokerServer&) = delete;
+    DioBrokerServer& operator=(const DioBrokerServer&) = delete;
+
+    //
+    // Create the shared section called Name and start serving clients.
+    // Fails if another broker is already using Name.
+    //
+    bool Start(const char* Name);
+
+    void Stop();
+
+    DIO_BROKER_STATS Stats() const;
+
+private:
+    void PumpThread();
+
+    void CommandThread();
+
+    void HandleRequest(uint32_t Index,
+                       uint32_t Sequence);
+
+    DioBrokerStatus ClaimLines(uint32_t Index,
+                               uint32_t Lines);
+
+    DioBrokerStatus ReleaseLines(uint32_t Index,
+                                 uint32_t Lines);
+
+    DioBrokerStatus WriteLines(uint32_t Index,
+                               uint32_t Lines,
+                               uint32_t Values);
+
+    bool ProgramOutputs();
+
+    void ReclaimDeadClients();
+
+    void PublishState(uint32_t LineState,
+                      uint64_t Timestamp);
+
+    void RefreshState();
+
+    DioBrokerDevice&    Device;
+    DioBrokerSection    Section;
+    PDIO_BROKER_SHARED  Shared;
+    std::string         Name;
+    DioBrokerDoorbell   ClientDoorbells[DIO_BROKER_MAX_CLIENTS];
+    DioBrokerDoorbell   BrokerDoorbell;
+    std::mutex          StateLock;
+    std::atomic<bool>   Stopping;
+    std::thread         Pump;
+    std::thread         Commands;
+
+    //
+    // Our own copies of who owns what, which are what we trust (the
+    // copies in the client slots are for the clients' information)
+    //
+    uint32_t            Owned[DIO_BROKER_MAX_CLIENTS];
+    uint32_t            HandledSequence[DIO_BROKER_MAX_CLIENTS];
+    uint32_t            OutputLines;
+    uint32_t            OutputState;
+
+    std::atomic<uint64_t> EventCount;
+    std::atomic<uint64_t> CommandCount;
+    std::atomic<uint64_t> ReclaimCount;
+    std::atomic<uint64_t> PumpCpuNs;
+};
@@ -0,0 +1,449 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioBrokerShared.cpp -- The shared memory through which the broker
+//                               serves its clients
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include "DioBrokerShared.h"
+
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#endif
+#endif
+
+DioBrokerSection::DioBrokerSection()
+    : View(nullptr),
+      Owner(false)
+#ifdef _WIN32
+      , MappingHandle(nullptr)
+#endif
+{
+}
+
+DioBrokerSection::~DioBrokerSection()
+{
+    Close();
+}
+
+#ifdef _WIN32
+
+bool
+DioBrokerSection::Create(const char* Name)
+{
+    Close();
+
+    SectionName = std::string("Local\\") + Name;
+
+    MappingHandle = CreateFileMappingA(INVALID_HANDLE_VALUE,
+                                       nullptr,
+                                       PAGE_READWRITE,
+                                       0,
+                                       sizeof(DIO_BROKER_SHARED),
+                                       SectionName.c_str());
+
+    if (MappingHandle == nullptr || GetLastError() == ERROR_ALREADY_EXISTS) {
+        goto failed;
+    }
+
+    View = static_cast<PDIO_BROKER_SHARED>(MapViewOfFile(MappingHandle,
+                                                         FILE_MAP_ALL_ACCESS,
+                                                         0,
+                                                         0,
+                                                         sizeof(DIO_BROKER_SHARED)));
+    if (View == nullptr) {
+        goto failed;
+    }
+
+    Owner = true;
+
+    View = new (View) DIO_BROKER_SHARED;
+
+    return true;
+
+failed:
+
+    Close();
+
+    return false;
+}
+
+bool
+DioBrokerSection::Open(const char* Name)
+{
+    Close();
+
+    SectionName = std::string("Local\\") + Name;
+
+    MappingHandle = OpenFileMappingA(FILE_MAP_ALL_ACCESS,
+                                     FALSE,
+                                     SectionName.c_str());
+
+    if (MappingHandle == nullptr) {
+        return false;
+    }
+
+    View = static_cast<PDIO_BROKER_SHARED>(MapViewOfFile(MappingHandle,
+                                                         FILE_MAP_ALL_ACCESS,
+                                                         0,
+                                                         0,
+                                                         sizeof(DIO_BROKER_SHARED)));
+    if (View == nullptr) {
+
+        Close();
+
+        return false;
+    }
+
+    return true;
+}
+
+void
+DioBrokerSection::Close()
+{
+    if (View != nullptr) {
+        UnmapViewOfFile(View);
+    }
+
+    if (MappingHandle != nullptr) {
+        CloseHandle(MappingHandle);
+    }
+
+    View          = nullptr;
+    MappingHandle = nullptr;
+    Owner         = false;
+}
+
+#else
+
+bool
+DioBrokerSection::Create(const char* Name)
+{
+    int   fd;
+    void* view;
+
+    Close();
+
+    SectionName = std::string("/") + Name;
+
+    //
+    // A broker that died without cleaning up leaves its section behind.
+    // Nobody can be using it (we're the broker now), so start afresh.
+    //
+    shm_unlink(SectionName.c_str());
+
+    fd = shm_open(SectionName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    if (ftruncate(fd, sizeof(DIO_BROKER_SHARED)) != 0) {
+
+        close(fd);
+
+        shm_unlink(SectionName.c_str());
+
+        return false;
+    }
+
+    view = mmap(nullptr,
+                sizeof(DIO_BROKER_SHARED),
+                PROT_READ | PROT_WRITE,
+                MAP_SHARED,
+                fd,
+                0);
+
+    close(fd);
+
+    if (view == MAP_FAILED) {
+
+        shm_unlink(SectionName.c_str());
+
+        return false;
+    }
+
+    Owner = true;
+    View  = new (view) DIO_BROKER_SHARED;
+
+    return true;
+}
+
+bool
+DioBrokerSection::Open(const char* Name)
+{
+    int   fd;
+    void* view;
+
+    Close();
+
+    SectionName = std::string("/") + Name;
+
+    fd = shm_open(SectionName.c_str(), O_RDWR, 0);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    view = mmap(nullptr,
+                sizeof(DIO_BROKER_SHARED),
+                PROT_READ | PROT_WRITE,
+                MAP_SHARED,
+                fd,
+                0);
+
+    close(fd);
+
+    if (view == MAP_FAILED) {
+        return false;
+    }
+
+    View = static_cast<PDIO_BROKER_SHARED>(view);
+
+    return true;
+}
+
+void
+DioBrokerSection::Close()
+{
+    if (View != nullptr) {
+        munmap(View, sizeof(DIO_BROKER_SHARED));
+    }
+
+    if (Owner) {
+        shm_unlink(SectionName.c_str());
+    }
+
+    View  = nullptr;
+    Owner = false;
+}
+
+#endif
+
+std::string
+DioBrokerDoorbellName(const char* SectionName,
+                      uint32_t    Index)
+{
+    return std::string(SectionName) + ".Doorbell" + std::to_string(Index);
+}
+
+DioBrokerDoorbell::DioBrokerDoorbell()
+    : Word(nullptr)
+#ifdef _WIN32
+      , Event(nullptr)
+#endif
+{
+}
+
+DioBrokerDoorbell::~DioBrokerDoorbell()
+{
+    Close();
+}
+
+#ifdef _WIN32
+
+bool
+DioBrokerDoorbell::Open(const char*            Name,
+                        std::atomic<uint32_t>* Word)
+{
+    std::string name;
+
+    Close();
+
+    name = std::string("Local\\") + Name;
+
+    //
+    // Whoever gets here first creates it
+    //
+    Event = CreateEventA(nullptr,
+                         FALSE,
+                         FALSE,
+                         name.c_str());
+
+    this->Word = Word;
+
+    return Event != nullptr;
+}
+
+void
+DioBrokerDoorbell::Close()
+{
+    if (Event != nullptr) {
+        CloseHandle(Event);
+    }
+
+    Event = nullptr;
+    Word  = nullptr;
+}
+
+void
+DioBrokerDoorbell::Wait(uint32_t Expected,
+                        uint32_t TimeoutMs)
+{
+    if (Word->load() != Expected) {
+        return;
+    }
+
+    WaitForSingleObject(Event, TimeoutMs);
+}
+
+void
+DioBrokerDoorbell::Ring()
+{
+    Word->fetch_add(1);
+
+    SetEvent(Event);
+}
+
+uint32_t
+DioBrokerCurrentProcessId()
+{
+    return GetCurrentProcessId();
+}
+
+bool
+DioBrokerProcessAlive(uint32_t ProcessId)
+{
+    HANDLE process;
+    bool   alive;
+
+    process = OpenProcess(SYNCHRONIZE, FALSE, ProcessId);
+
+    if (process == nullptr) {
+        return GetLastError() == ERROR_ACCESS_DENIED;
+    }
+
+    alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+
+    CloseHandle(process);
+
+    return alive;
+}
+
+#else
+
+bool
+DioBrokerDoorbell::Open(const char*            Name,
+                        std::atomic<uint32_t>* Word)
+{
+    (void)Name;
+
+    this->Word = Word;
+
+    return true;
+}
+
+void
+DioBrokerDoorbell::Close()
+{
+    Word = nullptr;
+}
+
+//
+// The futexes are in shared memory, so they must not be "private"
+//
+void
+DioBrokerDoorbell::Wait(uint32_t Expected,
+                        uint32_t TimeoutMs)
+{
+#ifdef __linux__
+    timespec timeout;
+
+    timeout.tv_sec  = TimeoutMs / 1000;
+    timeout.tv_nsec = (TimeoutMs % 1000) * 1000000L;
+
+    syscall(SYS_futex,
+            reinterpret_cast<uint32_t*>(Word),
+            FUTEX_WAIT,
+            Expected,
+            &timeout,
+            nullptr,
+            0);
+#else
+    //
+    // No futex: poll every millisecond
+    //
+    (void)TimeoutMs;
+
+    if (Word->load() == Expected) {
+        usleep(1000);
+    }
+#endif
+}
+
+void
+DioBrokerDoorbell::Ring()
+{
+    Word->fetch_add(1);
+
+#ifdef __linux__
+    syscall(SYS_futex,
+            reinterpret_cast<uint32_t*>(Word),
+            FUTEX_WAKE,
+            INT_MAX,
+            nullptr,
+            nullptr,
+            0);
+#endif
+}
+
+uint32_t
+DioBrokerCurrentProcessId()
+{
+    return static_cast<uint32_t>(getpid());
+}
+
+bool
+DioBrokerProcessAlive(uint32_t ProcessId)
+{
+    return kill(static_cast<pid_t>(ProcessId), 0) == 0 || errno == EPERM;
+}
+
+#endif
@@ -0,0 +1,285 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioBrokerShared.h -- The shared memory through which the broker
+//                             serves its clients
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      The driver is built to be used by one application at a time: one
+//      event ring, one waiter on its PendingQueue, and an IOCTL for every
+//      read of the lines.  The broker is that one application, and it
+//      shares the device with any number of local clients through a single
+//      shared memory section.
+//
+//      The section holds:
+//
+//        - The current line state, published under a sequence lock, so
+//          clients read it without any system call or IOCTL at all.
+//
+//        - A broadcast ring of every change event.  The broker is the only
+//          writer, and never waits for readers: each client keeps its own
+//          position and, if it falls more than a ring behind, is told how
+//          many events it missed.  One slow client can't hold up the
+//          others (or the device).
+//
+//        - A slot per client, holding its doorbell (what it sleeps on when
+//          it's waiting for events or for an answer from the broker) and a
+//          one-deep mailbox for its requests to claim, release and write
+//          output lines.  The broker arbitrates those: a line belongs to
+//          at most one client at a time, and the device's output lines are
+//          the union of everyone's claims.
+//
+//      Clients and broker only ever block on doorbells.  On Linux a
+//      doorbell is a futex on a word in the section; on Windows it's a
+//      named auto-reset event.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "../DioCapture/DioEvent.h"
+
+constexpr uint32_t DIO_BROKER_SIGNATURE      = 0x4B524244;    // "DBRK"
+constexpr uint32_t DIO_BROKER_VERSION        = 2;
+constexpr uint32_t DIO_BROKER_MAX_CLIENTS    = 64;
+constexpr uint32_t DIO_BROKER_EVENT_CAPACITY = 64 * 1024;     // power of two
+
+//
+// The name of the section (and the prefix of its doorbells) when nobody
+// says otherwise
+//
+constexpr char DIO_BROKER_DEFAULT_NAME[] = "OsrDioBroker";
+
+//
+// Requests a client can make of the broker, and their results
+//
+enum class DioBrokerCommand : uint32_t {
+    None    = 0,
+    Claim   = 1,        // take ownership of Lines (all or nothing)
+    Release = 2,        // give up ownership of Lines
+    Write   = 3,        // set owned Lines to the levels in Values
+};
+
+enum class DioBrokerStatus : int32_t {
+    Success      = 0,
+    Conflict     = 1,   // a line is owned by another client
+    NotOwner     = 2,   // a line isn't owned by this client
+    DeviceError  = 3,
+    BadRequest   = 4,
+};
+
+//
+// DIO_BROKER_CLIENT_SLOT
+//
+// InUse is claimed (0 to 1) by a client, which then fills in ProcessId.
+// The client writes Command, Lines and Values and then advances
+// RequestSequence; the broker writes Status and then sets
+// ResponseSequence to match.  OwnedLines is maintained by the broker.
+//
+// Waiting is set by the client while it's about to sleep on Doorbell, so
+// the broker knows it has to ring it.
+//
+typedef struct alignas(64) _DIO_BROKER_CLIENT_SLOT {
+    std::atomic<uint32_t>   InUse;
+    std::atomic<uint32_t>   ProcessId;
+    std::atomic<uint32_t>   Doorbell;
+    std::atomic<uint32_t>   Waiting;
+
+    std::atomic<uint32_t>   Command;
+    std::atomic<uint32_t>   Lines;
+    std::atomic<uint32_t>   Values;
+    std::atomic<uint32_t>   RequestSequence;
+
+    std::atomic<int32_t>    Status;
+    std::atomic<uint32_t>   OwnedLines;
+    std::atomic<uint32_t>   ResponseSequence;
+} DIO_BROKER_CLIENT_SLOT, *PDIO_BROKER_CLIENT_SLOT;
+
+//
+// DIO_BROKER_EVENT_SLOT
+//
+// One slot in the broadcast ring.  The broker may be rewriting a slot while
+// a client copies it, so the fields are atomics (relaxed loads and stores
+// cost the same as plain ones) and clients use EventReserve to discard any
+// copy that might be torn.
+//
+typedef struct _DIO_BROKER_EVENT_SLOT {
+    std::atomic<uint64_t>   Timestamp;
+    std::atomic<uint32_t>   LineState;
+    std::atomic<uint32_t>   ChangedLines;
+} DIO_BROKER_EVENT_SLOT, *PDIO_BROKER_EVENT_SLOT;
+
+//
+// DIO_BROKER_SHARED
+//
+// The line state fields are written by the broker between two increments
+// of StateSequence (odd while it's writing).  A reader that sees the same
+// even value before and after reading them has a consistent copy.
+//
+// EventProducer counts every event ever put in the ring; the event at
+// count i is Events[i & (EventCapacity - 1)].  Before the broker writes a
+// batch of events it advances EventReserve past the end of the batch, so
+// a client that copied a slot while the broker was overwriting it can
+// tell: any event more than EventCapacity behind EventReserve may be torn.
+// Device overflows (changes the hardware or the driver dropped before
+// they got to the broker) are counted in DeviceOverflows.
+//
+typedef struct alignas(64) _DIO_BROKER_SHARED {
+    uint32_t                Signature;
+    uint32_t                Version;
+    uint32_t                Size;
+    uint32_t                MaxClients;
+    uint32_t                EventCapacity;
+    uint32_t                BrokerProcessId;
+    std::atomic<uint32_t>   Running;
+    std::atomic<uint32_t>   BrokerDoorbell;
+
+    alignas(64)
+    std::atomic<uint32_t>   StateSequence;
+    std::atomic<uint32_t>   LineState;
+    std::atomic<uint32_t>   OutputLines;
+    std::atomic<uint32_t>   OutputState;
+    std::atomic<uint64_t>   StateTimestamp;
+
+    alignas(64)
+    std::atomic<uint64_t>   EventProducer;
+    std::atomic<uint64_t>   EventReserve;
+    std::atomic<uint64_t>   DeviceOverflows;
+
+    DIO_BROKER_CLIENT_SLOT  Clients[DIO_BROKER_MAX_CLIENTS];
+
+    alignas(64)
+    DIO_BROKER_EVENT_SLOT   Events[DIO_BROKER_EVENT_CAPACITY];
+} DIO_BROKER_SHARED, *PDIO_BROKER_SHARED;
+
+//
+// DioBrokerSection
+//
+// The shared memory section itself.  The broker Creates it; clients Open
+// it.
+//
+class DioBrokerSection
+{
+public:
+    DioBrokerSection();
+    ~DioBrokerSection();
+
+    DioBrokerSection(const DioBrokerSection&) = delete;
+    DioBrokerSection& operator=(const DioBrokerSection&) = delete;
+
+    bool Create(const char* Name);
+
+    bool Open(const char* Name);
+
+    void Close();
+
+    PDIO_BROKER_SHARED Shared() const
+    {
+        return View;
+    }
+
+private:
+    std::string        SectionName;
+    PDIO_BROKER_SHARED View;
+    bool               Owner;
+#ifdef _WIN32
+    void*              MappingHandle;
+#endif
+};
+
+//
+// DioBrokerDoorbell
+//
+// Something to sleep on until someone Rings it.  Wait returns when the
+// doorbell's word is no longer Expected, when it's rung, on a timeout, or
+// (rarely) for no reason at all, so callers always check their condition
+// again.  The usual pattern is:
+//
+//      expected = doorbell word
+//      set Waiting
+//      if (condition isn't met) Wait(expected)
+//      clear Waiting
+//
+// and, on the other side: make the condition true, then if Waiting is
+// set, Ring (which advances the word, and wakes the waiter).
+//
+class DioBrokerDoorbell
+{
+public:
+    DioBrokerDoorbell();
+    ~DioBrokerDoorbell();
+
+    DioBrokerDoorbell(const DioBrokerDoorbell&) = delete;
+    DioBrokerDoorbell& operator=(const DioBrokerDoorbell&) = delete;
+
+    //
+    // Name distinguishes doorbells on platforms where they're named
+    // objects; Word is where they live on platforms where they aren't.
+    //
+    bool Open(const char*            Name,
+              std::atomic<uint32_t>* Word);
+
+    void Close();
+
+    void Wait(uint32_t Expected,
+              uint32_t TimeoutMs);
+
+    void Ring();
+
+private:
+    std::atomic<uint32_t>* Word;
+#ifdef _WIN32
+    void*                  Event;
+#endif
+};
+
+//
+// The name of the doorbell of client slot Index (or of the broker, for
+// Index DIO_BROKER_MAX_CLIENTS)
+//
+std::string DioBrokerDoorbellName(const char* SectionName,
+                                  uint32_t    Index);
+
+//
+// The ID of the calling process, and whether a process is still running
+//
+uint32_t DioBrokerCurrentProcessId();
+
+bool DioBrokerProcessAlive(uint32_t ProcessId);
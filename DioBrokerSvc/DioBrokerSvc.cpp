@@ -0,0 +1,240 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioBrokerSvc.cpp -- Broker daemon: shares one OSRDIO device
+//                            among local client processes
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      Opens the device (one handle, with an event ring attached) and
+//      serves it to any number of local clients with DioBrokerServer, until
+//      it's stopped with Ctrl+C or the requested duration is up.  Clients
+//      use DioBrokerClient to read the lines and their changes, and to
+//      claim and drive output lines.  Once a second it reports the event
+//      rate, the number of clients, and the CPU time spent fanning events
+//      out.
+//
+//      With -s (and always, on hosts other than Windows) the device is the
+//      simulator, with its inputs toggled at the given average rate.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include "../DioBroker/DioBrokerServer.h"
+#include "../DioSim/DioSimDevice.h"
+
+//
+// Events in the ring we attach to the driver.  The broker drains it as
+// fast as the ISR fills it; this is just slack for scheduling delays.
+//
+constexpr uint32_t BROKER_SVC_RING_EVENTS = 64 * 1024;
+
+static std::atomic<bool> StopRequested(false);
+
+static void
+SignalHandler(int)
+{
+    StopRequested = true;
+}
+
+static void
+Usage()
+{
+    printf("Usage: DioBrokerSvc [-n name] [-d durationSeconds] "
+           "[-s simulatedChangesPerSecond]\n");
+}
+
+//
+// Toggle a random input line of the simulated device (about) Rate times
+// a second.  Changes closer together than the ISR can service them are
+// lost, as they would be on the hardware.
+//
+static void
+SimulateField(DioSimDevice& Device,
+              uint64_t      Rate)
+{
+    uint64_t random = 0x9E3779B97F4A7C15ULL;
+    uint32_t inputs = 0;
+
+    auto interval = std::chrono::nanoseconds(1000000000ULL / (Rate != 0 ? Rate : 1));
+    auto next     = std::chrono::steady_clock::now();
+
+    while (!StopRequested) {
+
+        next += interval;
+
+        std::this_thread::sleep_until(next);
+
+        random ^= random >> 12;
+        random ^= random << 25;
+        random ^= random >> 27;
+
+        inputs ^= 1U << ((random * 0x2545F4914F6CDD1DULL) >> 59);
+
+        Device.Bar().SetInputs(inputs);
+    }
+}
+
+int
+main(int   argc,
+     char* argv[])
+{
+    std::unique_ptr<DioSimDevice>    simDevice;
+    std::unique_ptr<DioBrokerDevice> device;
+    std::thread                      simulator;
+    const char*                      name     = DIO_BROKER_DEFAULT_NAME;
+    uint64_t                         duration = 0;
+    uint64_t                         simRate  = 0;
+    bool                             simulate = false;
+
+    printf("DIOBROKERSVC -- OSRDIO Device Broker V1.0\n");
+
+    for (int i = 1; i < argc; i++) {
+
+        if (i + 1 >= argc) {
+
+            Usage();
+
+            return EXIT_FAILURE;
+        }
+
+        if (strcmp(argv[i], "-n") == 0) {
+            name = argv[++i];
+        } else if (strcmp(argv[i], "-d") == 0) {
+            duration = strtoull(argv[++i], nullptr, 0);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            simRate  = strtoull(argv[++i], nullptr, 0);
+            simulate = true;
+        } else {
+
+            Usage();
+
+            return EXIT_FAILURE;
+        }
+    }
+
+#ifdef _WIN32
+    if (!simulate) {
+
+        auto live = std::make_unique<DioBrokerLiveDevice>();
+
+        if (!live->Open(BROKER_SVC_RING_EVENTS)) {
+
+            printf("Unable to open the OSRDIO device (is another broker running?)\n");
+
+            return EXIT_FAILURE;
+        }
+
+        device = std::move(live);
+    }
+#else
+    if (!simulate) {
+
+        simulate = true;
+        simRate  = 10000;
+
+        printf("No OSRDIO device on this host; simulating %llu changes/s\n",
+               static_cast<unsigned long long>(simRate));
+    }
+#endif
+
+    if (simulate) {
+
+        simDevice = std::make_unique<DioSimDevice>(BROKER_SVC_RING_EVENTS,
+                                                   DioSimUnfilteredProfile);
+
+        device = std::make_unique<DioBrokerSimDevice>(*simDevice);
+    }
+
+    DioBrokerServer broker(*device);
+
+    if (!broker.Start(name)) {
+
+        printf("Unable to create broker %s (is another broker running?)\n", name);
+
+        return EXIT_FAILURE;
+    }
+
+    printf("Serving %s\n", name);
+
+    signal(SIGINT, SignalHandler);
+
+    if (simulate) {
+        simulator = std::thread(SimulateField, std::ref(*simDevice), simRate);
+    }
+
+    DIO_BROKER_STATS previous = broker.Stats();
+    uint64_t         seconds  = 0;
+
+    while (!StopRequested) {
+
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        DIO_BROKER_STATS stats = broker.Stats();
+
+        uint64_t events = stats.Events - previous.Events;
+        uint64_t cpuNs  = stats.PumpCpuNs - previous.PumpCpuNs;
+
+        printf("%8llu events/s %3u clients outputs 0x%08X %8.2f ms CPU/Mevent "
+               "%6llu overflows %4llu reclaimed\n",
+               static_cast<unsigned long long>(events),
+               stats.Clients,
+               stats.OutputLines,
+               events != 0 ? cpuNs / 1e6 / (events / 1e6) : 0.0,
+               static_cast<unsigned long long>(stats.DeviceOverflows),
+               static_cast<unsigned long long>(stats.ReclaimedClients));
+
+        previous = stats;
+
+        if (duration != 0 && ++seconds >= duration) {
+            StopRequested = true;
+        }
+    }
+
+    if (simulator.joinable()) {
+        simulator.join();
+    }
+
+    broker.Stop();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,723 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioAsyncFile.cpp -- Large, aligned, asynchronous file writes
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include "DioAsyncFile.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define DIO_ASYNC_FILE_URING 1
+#endif
+#endif
+
+//
+// What we need to keep track of the file and the I/O in flight on each
+// buffer.  Pending[i] is true from the time buffer i is submitted until we
+// have seen it complete.  Lengths[i] is how much was submitted.
+//
+struct DIO_ASYNC_FILE_STATE {
+#ifdef _WIN32
+    HANDLE                      File;
+    std::vector<OVERLAPPED>     Overlapped;
+#else
+    int                         File;
+#ifdef DIO_ASYNC_FILE_URING
+    int                         Ring;
+    void*                       SqRing;
+    size_t                      SqRingSize;
+    void*                       CqRing;
+    size_t                      CqRingSize;
+    io_uring_sqe*               Sqes;
+    size_t                      SqesSize;
+    unsigned*                   SqTail;
+    unsigned*                   SqMask;
+    unsigned*                   SqArray;
+    unsigned*                   CqHead;
+    unsigned*                   CqTail;
+    unsigned*                   CqMask;
+    io_uring_cqe*               Cqes;
+#endif
+#endif
+    std::vector<uint8_t>        Pending;
+    std::vector<size_t>         Lengths;
+};
+
+static size_t
+AlignUp(size_t Value)
+{
+    return (Value + DIO_ASYNC_FILE_ALIGNMENT - 1) & ~(DIO_ASYNC_FILE_ALIGNMENT - 1);
+}
+
+static size_t
+AlignDown(size_t Value)
+{
+    return Value & ~(DIO_ASYNC_FILE_ALIGNMENT - 1);
+}
+
+static uint8_t*
+AllocateAligned(size_t Length)
+{
+#ifdef _WIN32
+    return static_cast<uint8_t*>(_aligned_malloc(Length, DIO_ASYNC_FILE_ALIGNMENT));
+#else
+    return static_cast<uint8_t*>(aligned_alloc(DIO_ASYNC_FILE_ALIGNMENT, Length));
+#endif
+}
+
+static void
+FreeAligned(uint8_t* Buffer)
+{
+#ifdef _WIN32
+    _aligned_free(Buffer);
+#else
+    free(Buffer);
+#endif
+}
+
+#ifdef DIO_ASYNC_FILE_URING
+
+//
+// There's no liburing in the build, and we need very little of it, so we
+// talk to io_uring with the raw system calls.
+//
+static bool
+UringOpen(DIO_ASYNC_FILE_STATE* State,
+          unsigned              Entries)
+{
+    io_uring_params params;
+    uint8_t*        sq;
+    uint8_t*        cq;
+
+    memset(&params, 0, sizeof(params));
+
+    State->Ring = static_cast<int>(syscall(__NR_io_uring_setup, Entries, &params));
+
+    if (State->Ring < 0) {
+        return false;
+    }
+
+    State->SqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    State->CqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    State->SqesSize   = params.sq_entries * sizeof(io_uring_sqe);
+
+    State->SqRing = mmap(nullptr, State->SqRingSize, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, State->Ring, IORING_OFF_SQ_RING);
+    State->CqRing = mmap(nullptr, State->CqRingSize, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, State->Ring, IORING_OFF_CQ_RING);
+    State->Sqes   = static_cast<io_uring_sqe*>(
+                        mmap(nullptr, State->SqesSize, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, State->Ring, IORING_OFF_SQES));
+
+    if (State->SqRing == MAP_FAILED || State->CqRing == MAP_FAILED ||
+        State->Sqes == MAP_FAILED) {
+        return false;
+    }
+
+    sq = static_cast<uint8_t*>(State->SqRing);
+    cq = static_cast<uint8_t*>(State->CqRing);
+
+    State->SqTail  = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    State->SqMask  = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    State->SqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    State->CqHead  = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    State->CqTail  = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    State->CqMask  = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    State->Cqes    = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+static void
+UringClose(DIO_ASYNC_FILE_STATE* State)
+{
+    if (State->SqRing != nullptr && State->SqRing != MAP_FAILED) {
+        munmap(State->SqRing, State->SqRingSize);
+    }
+
+    if (State->CqRing != nullptr && State->CqRing != MAP_FAILED) {
+        munmap(State->CqRing, State->CqRingSize);
+    }
+
+    if (State->Sqes != nullptr && State->Sqes != MAP_FAILED) {
+        munmap(State->Sqes, State->SqesSize);
+    }
+
+    if (State->Ring >= 0) {
+        close(State->Ring);
+    }
+
+    State->Ring   = -1;
+    State->SqRing = nullptr;
+    State->CqRing = nullptr;
+    State->Sqes   = nullptr;
+}
+
+#endif
+
+DioAsyncFileSink::DioAsyncFileSink(size_t BufferBytes,
+                                   size_t BufferCount)
+    : BufferBytes(AlignUp(BufferBytes)),
+      BufferCount(BufferCount < 2 ? 2 : BufferCount),
+      Buffers(nullptr),
+      Current(0),
+      Used(0),
+      FileOffset(0),
+      Direct(false),
+      Async(false),
+      Failed(false),
+      State(nullptr)
+{
+}
+
+DioAsyncFileSink::~DioAsyncFileSink()
+{
+    Close();
+}
+
+bool
+DioAsyncFileSink::Open(const char* Path)
+{
+    Close();
+
+    Buffers = AllocateAligned(BufferBytes * BufferCount);
+    State   = new DIO_ASYNC_FILE_STATE();
+
+#ifdef _WIN32
+    State->File = INVALID_HANDLE_VALUE;
+#else
+    State->File = -1;
+#endif
+
+    if (Buffers == nullptr) {
+        goto failed;
+    }
+
+    State->Pending.assign(BufferCount, 0);
+    State->Lengths.assign(BufferCount, 0);
+
+    Current    = 0;
+    Used       = 0;
+    FileOffset = 0;
+    Failed     = false;
+
+#ifdef _WIN32
+
+    State->Overlapped.assign(BufferCount, OVERLAPPED());
+
+    for (OVERLAPPED& overlapped : State->Overlapped) {
+
+        overlapped.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+        if (overlapped.hEvent == nullptr) {
+            goto failed;
+        }
+    }
+
+    State->File = CreateFileA(Path,
+                              GENERIC_WRITE,
+                              FILE_SHARE_READ,
+                              nullptr,
+                              CREATE_ALWAYS,
+                              FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED,
+                              nullptr);
+
+    Direct = true;
+    Async  = true;
+
+    if (State->File == INVALID_HANDLE_VALUE) {
+
+        State->File = CreateFileA(Path,
+                                  GENERIC_WRITE,
+                                  FILE_SHARE_READ,
+                                  nullptr,
+                                  CREATE_ALWAYS,
+                                  FILE_FLAG_OVERLAPPED,
+                                  nullptr);
+        Direct = false;
+    }
+
+    if (State->File == INVALID_HANDLE_VALUE) {
+        goto failed;
+    }
+
+#else
+
+    State->File = open(Path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+
+    Direct = true;
+
+    if (State->File < 0) {
+
+        //
+        // tmpfs, for one, doesn't do O_DIRECT
+        //
+        State->File = open(Path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        Direct = false;
+    }
+
+    if (State->File < 0) {
+        goto failed;
+    }
+
+#ifdef DIO_ASYNC_FILE_URING
+    State->Ring   = -1;
+    State->SqRing = nullptr;
+    State->CqRing = nullptr;
+    State->Sqes   = nullptr;
+
+    Async = UringOpen(State,
+                      static_cast<unsigned>(BufferCount));
+
+    if (!Async) {
+        UringClose(State);
+    }
+#endif
+
+#endif
+
+    return true;
+
+failed:
+
+    Close();
+
+    return false;
+}
+
+bool
+DioAsyncFileSink::Close()
+{
+    bool result;
+
+    if (State == nullptr) {
+        return false;
+    }
+
+    //
+    // Write whatever is left (padded), then cut the padding off again
+    //
+    result = Flush();
+
+#ifdef _WIN32
+
+    if (State->File != INVALID_HANDLE_VALUE) {
+
+        FILE_END_OF_FILE_INFO endOfFile;
+
+        endOfFile.EndOfFile.QuadPart = static_cast<LONGLONG>(FileOffset + Used);
+
+        if (!SetFileInformationByHandle(State->File,
+                                        FileEndOfFileInfo,
+                                        &endOfFile,
+                                        sizeof(endOfFile))) {
+            result = false;
+        }
+
+        CloseHandle(State->File);
+    }
+
+    for (OVERLAPPED& overlapped : State->Overlapped) {
+
+        if (overlapped.hEvent != nullptr) {
+            CloseHandle(overlapped.hEvent);
+        }
+    }
+
+#else
+
+#ifdef DIO_ASYNC_FILE_URING
+    if (Async) {
+        UringClose(State);
+    }
+#endif
+
+    if (State->File >= 0) {
+
+        if (ftruncate(State->File, static_cast<off_t>(FileOffset + Used)) != 0) {
+            result = false;
+        }
+
+        close(State->File);
+    }
+
+#endif
+
+    delete State;
+
+    FreeAligned(Buffers);
+
+    State   = nullptr;
+    Buffers = nullptr;
+    Async   = false;
+    Direct  = false;
+
+    return result;
+}
+
+//
+// Write the first Length bytes of the current buffer at FileOffset.
+// Length is a multiple of the alignment.
+//
+bool
+DioAsyncFileSink::Submit(size_t Length)
+{
+    uint8_t* buffer;
+
+    buffer = Buffers + Current * BufferBytes;
+
+    State->Lengths[Current] = Length;
+
+#ifdef _WIN32
+
+    OVERLAPPED& overlapped = State->Overlapped[Current];
+    DWORD       written;
+
+    overlapped.Offset     = static_cast<DWORD>(FileOffset);
+    overlapped.OffsetHigh = static_cast<DWORD>(FileOffset >> 32);
+
+    ResetEvent(overlapped.hEvent);
+
+    if (!WriteFile(State->File,
+                   buffer,
+                   static_cast<DWORD>(Length),
+                   &written,
+                   &overlapped) &&
+        GetLastError() != ERROR_IO_PENDING) {
+
+        Failed = true;
+
+        return false;
+    }
+
+    State->Pending[Current] = 1;
+
+#else
+
+#ifdef DIO_ASYNC_FILE_URING
+    if (Async) {
+
+        io_uring_sqe* sqe;
+        unsigned      tail;
+        unsigned      index;
+
+        tail  = *State->SqTail;
+        index = tail & *State->SqMask;
+        sqe   = &State->Sqes[index];
+
+        memset(sqe, 0, sizeof(*sqe));
+
+        sqe->opcode    = IORING_OP_WRITE;
+        sqe->fd        = State->File;
+        sqe->addr      = reinterpret_cast<uint64_t>(buffer);
+        sqe->len       = static_cast<uint32_t>(Length);
+        sqe->off       = FileOffset;
+        sqe->user_data = Current;
+
+        State->SqArray[index] = index;
+
+        __atomic_store_n(State->SqTail, tail + 1, __ATOMIC_RELEASE);
+
+        if (syscall(__NR_io_uring_enter, State->Ring, 1, 0, 0, nullptr, 0) != 1) {
+
+            Failed = true;
+
+            return false;
+        }
+
+        State->Pending[Current] = 1;
+
+        return true;
+    }
+#endif
+
+    if (pwrite(State->File,
+               buffer,
+               Length,
+               static_cast<off_t>(FileOffset)) != static_cast<ssize_t>(Length)) {
+
+        Failed = true;
+
+        return false;
+    }
+
+#endif
+
+    return true;
+}
+
+//
+// Wait until the I/O (if any) on buffer Index is complete
+//
+bool
+DioAsyncFileSink::WaitForBuffer(size_t Index)
+{
+    if (!State->Pending[Index]) {
+        return !Failed;
+    }
+
+#ifdef _WIN32
+
+    DWORD written;
+
+    if (!GetOverlappedResult(State->File,
+                             &State->Overlapped[Index],
+                             &written,
+                             TRUE) ||
+        written != State->Lengths[Index]) {
+
+        Failed = true;
+    }
+
+    State->Pending[Index] = 0;
+
+#elif defined(DIO_ASYNC_FILE_URING)
+
+    while (State->Pending[Index]) {
+
+        unsigned head;
+        unsigned tail;
+
+        head = *State->CqHead;
+        tail = __atomic_load_n(State->CqTail, __ATOMIC_ACQUIRE);
+
+        if (head == tail) {
+
+            if (syscall(__NR_io_uring_enter, State->Ring, 0, 1,
+                        IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+                errno != EINTR) {
+
+                Failed = true;
+
+                return false;
+            }
+
+            continue;
+        }
+
+        while (head != tail) {
+
+            const io_uring_cqe& cqe = State->Cqes[head & *State->CqMask];
+            size_t              done;
+
+            done = static_cast<size_t>(cqe.user_data);
+
+            if (cqe.res < 0 || static_cast<size_t>(cqe.res) != State->Lengths[done]) {
+                Failed = true;
+            }
+
+            State->Pending[done] = 0;
+
+            head++;
+        }
+
+        __atomic_store_n(State->CqHead, head, __ATOMIC_RELEASE);
+    }
+
+#endif
+
+    return !Failed;
+}
+
+bool
+DioAsyncFileSink::WaitForAll()
+{
+    for (size_t i = 0; i < BufferCount; i++) {
+        WaitForBuffer(i);
+    }
+
+    return !Failed;
+}
+
+//
+// The current buffer is (nearly) full.  Write out as much of it as we can
+// (leaving any unaligned tail) and move on to the next buffer, taking the
+// tail with us.
+//
+bool
+DioAsyncFileSink::NextBuffer()
+{
+    size_t   aligned;
+    size_t   tail;
+    size_t   next;
+    uint8_t* from;
+
+    aligned = AlignDown(Used);
+    tail    = Used - aligned;
+
+    if (aligned == 0 || !Submit(aligned)) {
+
+        Failed = true;
+
+        return false;
+    }
+
+    from = Buffers + Current * BufferBytes + aligned;
+    next = (Current + 1) % BufferCount;
+
+    if (!WaitForBuffer(next)) {
+        return false;
+    }
+
+    memcpy(Buffers + next * BufferBytes,
+           from,
+           tail);
+
+    FileOffset += aligned;
+    Current     = next;
+    Used        = tail;
+
+    return true;
+}
+
+uint8_t*
+DioAsyncFileSink::GetBuffer(size_t Length)
+{
+    //
+    // Anything bigger than we can fit in a buffer (after the tail we might
+    // carry over) goes through Write
+    //
+    if (Failed || State == nullptr ||
+        Length > BufferBytes - DIO_ASYNC_FILE_ALIGNMENT) {
+        return nullptr;
+    }
+
+    if (Used + Length > BufferBytes && !NextBuffer()) {
+        return nullptr;
+    }
+
+    return Buffers + Current * BufferBytes + Used;
+}
+
+bool
+DioAsyncFileSink::CommitBuffer(size_t Length)
+{
+    Used += Length;
+
+    return !Failed;
+}
+
+bool
+DioAsyncFileSink::Write(const void* Data,
+                        size_t      Length)
+{
+    const uint8_t* from;
+    size_t         toCopy;
+
+    if (Failed || State == nullptr) {
+        return false;
+    }
+
+    from = static_cast<const uint8_t*>(Data);
+
+    while (Length != 0) {
+
+        if (Used == BufferBytes && !NextBuffer()) {
+            return false;
+        }
+
+        toCopy = BufferBytes - Used;
+
+        if (toCopy > Length) {
+            toCopy = Length;
+        }
+
+        memcpy(Buffers + Current * BufferBytes + Used,
+               from,
+               toCopy);
+
+        Used   += toCopy;
+        from   += toCopy;
+        Length -= toCopy;
+    }
+
+    return true;
+}
+
+//
+// Get everything written so far into the file.  The partly filled current
+// buffer is written padded with zeros, but stays current: it will be
+// written again, at the same offset, once there's more in it.
+//
+bool
+DioAsyncFileSink::Flush()
+{
+    size_t padded;
+
+    if (State == nullptr) {
+        return false;
+    }
+
+    if (Failed) {
+        return false;
+    }
+
+    if (Used != 0) {
+
+        //
+        // Wait for any earlier write of this same buffer before changing it
+        //
+        if (!WaitForBuffer(Current)) {
+            return false;
+        }
+
+        padded = AlignUp(Used);
+
+        memset(Buffers + Current * BufferBytes + Used,
+               0,
+               padded - Used);
+
+        if (!Submit(padded)) {
+            return false;
+        }
+    }
+
+    return WaitForAll();
+}
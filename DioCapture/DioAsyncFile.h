@@ -0,0 +1,149 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioAsyncFile.h -- A capture sink that writes large, aligned
+//                          blocks asynchronously
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      A recorder that's keeping up with the device at full rate can't
+//      afford to wait for each block to reach the disk, nor to have every
+//      byte copied through the file system cache.  DioAsyncFileSink keeps a
+//      few large, sector aligned buffers.  The capture writer encodes each
+//      block straight into the current buffer (see DioCaptureSink::GetBuffer)
+//      and, when a buffer fills, it's written to the file with unbuffered,
+//      asynchronous I/O while the writer carries on in the next one.
+//
+//      On Windows this uses FILE_FLAG_NO_BUFFERING and overlapped I/O.  On
+//      Linux it uses O_DIRECT and io_uring.  If either isn't available (some
+//      file systems don't support O_DIRECT, some kernels don't have
+//      io_uring) it quietly falls back to buffered and/or synchronous
+//      writes, which are slower but produce exactly the same file.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "DioCaptureWriter.h"
+
+//
+// Everything handed to unbuffered I/O (buffer address, length, and file
+// offset) is a multiple of this.  4K covers both 512 byte and 4K sector
+// disks.
+//
+constexpr size_t DIO_ASYNC_FILE_ALIGNMENT = 4096;
+
+//
+// Defaults: four 1MB buffers, so up to 3MB can be in flight while the
+// writer fills the fourth.
+//
+constexpr size_t DIO_ASYNC_FILE_BUFFER_BYTES  = 1024 * 1024;
+constexpr size_t DIO_ASYNC_FILE_BUFFER_COUNT  = 4;
+
+struct DIO_ASYNC_FILE_STATE;
+
+//
+// DioAsyncFileSink
+//
+// Open creates (or truncates) the file.  Flush waits until everything
+// written so far is in the file.  Close flushes, trims the file to the
+// number of bytes actually written (the last write is padded out to the
+// alignment), and closes it.  Once any write fails, everything after it
+// fails too.
+//
+class DioAsyncFileSink : public DioCaptureSink
+{
+public:
+    explicit DioAsyncFileSink(size_t BufferBytes = DIO_ASYNC_FILE_BUFFER_BYTES,
+                              size_t BufferCount = DIO_ASYNC_FILE_BUFFER_COUNT);
+    ~DioAsyncFileSink() override;
+
+    DioAsyncFileSink(const DioAsyncFileSink&) = delete;
+    DioAsyncFileSink& operator=(const DioAsyncFileSink&) = delete;
+
+    bool Open(const char* Path);
+
+    bool Close();
+
+    bool Write(const void* Data,
+               size_t      Length) override;
+
+    uint8_t* GetBuffer(size_t Length) override;
+
+    bool CommitBuffer(size_t Length) override;
+
+    bool Flush() override;
+
+    uint64_t BytesWritten() const
+    {
+        return FileOffset + Used;
+    }
+
+    //
+    // True if the file is being written unbuffered and asynchronously, as
+    // opposed to having fallen back to something simpler
+    //
+    bool Unbuffered() const
+    {
+        return Direct;
+    }
+
+    bool Asynchronous() const
+    {
+        return Async;
+    }
+
+private:
+    bool Submit(size_t Length);
+
+    bool WaitForBuffer(size_t Index);
+
+    bool WaitForAll();
+
+    bool NextBuffer();
+
+    size_t                BufferBytes;
+    size_t                BufferCount;
+    uint8_t*              Buffers;
+    size_t                Current;
+    size_t                Used;
+    uint64_t              FileOffset;
+    bool                  Direct;
+    bool                  Async;
+    bool                  Failed;
+    DIO_ASYNC_FILE_STATE* State;
+};
@@ -0,0 +1,243 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioCaptureFormat.cpp -- Helpers for the DIO capture file format
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <cstddef>
+
+#include "DioCaptureFormat.h"
+
+//
+// CRC-32 (IEEE 802.3, reflected, polynomial 0xEDB88320), computed a byte at
+// a time.  The table is built at compile time.
+//
+struct CRC_TABLE {
+    uint32_t Entry[256];
+
+    constexpr CRC_TABLE()
+        : Entry()
+    {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320U : 0);
+            }
+
+            Entry[i] = crc;
+        }
+    }
+};
+
+static constexpr CRC_TABLE CrcTable;
+
+uint32_t
+DioCaptureCrc32(const void* Data,
+                size_t      Length)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(Data);
+    uint32_t       crc   = 0xFFFFFFFF;
+
+    for (size_t i = 0; i < Length; i++) {
+        crc = CrcTable.Entry[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc ^ 0xFFFFFFFF;
+}
+
+void
+DioCaptureStartBlock(PDIO_CAPTURE_BLOCK_CURSOR       Cursor,
+                     const DIO_CAPTURE_BLOCK_HEADER* Header,
+                     const uint8_t*                  Payload,
+                     uint32_t                        TickNs)
+{
+    Cursor->Next       = Payload;
+    Cursor->End        = Payload + Header->PayloadLength;
+    Cursor->EventsLeft = Header->EventCount;
+    Cursor->TickNs     = TickNs;
+    Cursor->Tick       = Header->FirstTimestamp / TickNs;
+    Cursor->LineState  = Header->InitialState;
+    Cursor->Corrupt    = false;
+}
+
+size_t
+DioCaptureDecodeEvents(PDIO_CAPTURE_BLOCK_CURSOR Cursor,
+                       PDIO_EVENT                Events,
+                       size_t                    Count)
+{
+    size_t   decoded = 0;
+    uint64_t token;
+    uint64_t mask;
+    uint32_t length;
+    uint32_t changed;
+    uint32_t code;
+
+    while (decoded < Count && Cursor->EventsLeft != 0) {
+
+        length = DioCaptureDecodeVarint(Cursor->Next,
+                                        Cursor->End,
+                                        &token);
+        if (length == 0) {
+            goto corrupt;
+        }
+
+        Cursor->Next += length;
+
+        code = (uint32_t)(token & ((1U << DIO_CAPTURE_CODE_BITS) - 1));
+
+        if (code < 32) {
+
+            changed = 1U << code;
+
+        } else if (code == DIO_CAPTURE_CODE_MASK) {
+
+            length = DioCaptureDecodeVarint(Cursor->Next,
+                                            Cursor->End,
+                                            &mask);
+            if (length == 0 || mask > UINT32_MAX) {
+                goto corrupt;
+            }
+
+            Cursor->Next += length;
+
+            changed = (uint32_t)mask;
+
+        } else {
+            goto corrupt;
+        }
+
+        Cursor->Tick      += token >> DIO_CAPTURE_CODE_BITS;
+        Cursor->LineState ^= changed;
+
+        Events[decoded].Timestamp    = Cursor->Tick * Cursor->TickNs;
+        Events[decoded].LineState    = Cursor->LineState;
+        Events[decoded].ChangedLines = changed;
+
+        decoded++;
+
+        Cursor->EventsLeft--;
+    }
+
+    return decoded;
+
+corrupt:
+
+    Cursor->Corrupt    = true;
+    Cursor->EventsLeft = 0;
+
+    return decoded;
+}
+
+void
+DioCaptureSkipEvents(PDIO_CAPTURE_BLOCK_CURSOR Cursor,
+                     uint64_t                  Timestamp)
+{
+    const uint8_t* next;
+    uint64_t       token;
+    uint64_t       mask;
+    uint64_t       tick;
+    uint64_t       limit;
+    uint32_t       length;
+    uint32_t       changed;
+    uint32_t       code;
+
+    //
+    // Compare in ticks: an event is before Timestamp if its tick is before
+    // the first tick at or after Timestamp.
+    //
+    limit = Timestamp / Cursor->TickNs;
+
+    if (Timestamp % Cursor->TickNs != 0) {
+        limit++;
+    }
+
+    while (Cursor->EventsLeft != 0) {
+
+        length = DioCaptureDecodeVarint(Cursor->Next,
+                                        Cursor->End,
+                                        &token);
+        if (length == 0) {
+            goto corrupt;
+        }
+
+        tick = Cursor->Tick + (token >> DIO_CAPTURE_CODE_BITS);
+
+        if (tick >= limit) {
+
+            //
+            // Leave this event for the next decode
+            //
+            return;
+        }
+
+        next = Cursor->Next + length;
+        code = (uint32_t)(token & ((1U << DIO_CAPTURE_CODE_BITS) - 1));
+
+        if (code < 32) {
+
+            changed = 1U << code;
+
+        } else if (code == DIO_CAPTURE_CODE_MASK) {
+
+            length = DioCaptureDecodeVarint(next,
+                                            Cursor->End,
+                                            &mask);
+            if (length == 0 || mask > UINT32_MAX) {
+                goto corrupt;
+            }
+
+            next += length;
+
+            changed = (uint32_t)mask;
+
+        } else {
+            goto corrupt;
+        }
+
+        Cursor->Next       = next;
+        Cursor->Tick       = tick;
+        Cursor->LineState ^= changed;
+
+        Cursor->EventsLeft--;
+    }
+
+    return;
+
+corrupt:
+
+    Cursor->Corrupt    = true;
+    Cursor->EventsLeft = 0;
+}
@@ -0,0 +1,281 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioCaptureFormat.h -- On-disk format of DIO capture files
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      A capture file is meant to record days of DIO activity, so we
+//      store as little as possible for each event: which lines changed,
+//      and how long it has been since the previous event.
+//
+//      File layout (all fields little-endian):
+//
+//          DIO_CAPTURE_FILE_HEADER
+//          DIO_CAPTURE_BLOCK_HEADER   block 0
+//          payload                    (PayloadLength bytes)
+//          DIO_CAPTURE_BLOCK_HEADER   block 1
+//          payload
+//          ...
+//
+//      Every block can be decoded on its own: its header holds the full
+//      state of the lines before its first event and the absolute time of
+//      its first event.  A damaged block (one whose CRC doesn't match) can
+//      therefore be skipped without losing the rest of the file.
+//
+//      Event encoding
+//
+//      Timestamps are stored in "ticks" of TickNs nanoseconds each (taken
+//      from the file header).  Each event is one LEB128 varint:
+//
+//          (DeltaTicks << 6) | Code
+//
+//      DeltaTicks is the number of ticks since the previous event in the
+//      block (the first event in a block has a DeltaTicks of zero from the
+//      block's FirstTimestamp).  If exactly one line changed, Code is that
+//      line's number (0 through 31).  Otherwise Code is
+//      DIO_CAPTURE_CODE_MASK and a second varint, holding the full mask of
+//      changed lines, follows.
+//
+//      A single line changing a few microseconds after the previous event
+//      thus typically takes two or three bytes, compared to sixteen for a
+//      DIO_EVENT.
+//
+//      Index files
+//
+//      Alongside a capture, the writer can produce a sparse index (by
+//      convention, the capture's name with ".idx" appended):
+//
+//          DIO_CAPTURE_INDEX_HEADER
+//          DIO_CAPTURE_INDEX_ENTRY    block 0
+//          DIO_CAPTURE_INDEX_ENTRY    block 1
+//          ...
+//
+//      There is one fixed-size entry per block, in file (and therefore time)
+//      order, giving the block's offset in the capture, its time range and
+//      the full state of the lines at its start.  The number of entries is
+//      implied by the size of the file, so an index that was being written
+//      when the capture stopped abruptly is still usable.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "DioEvent.h"
+
+constexpr uint32_t DIO_CAPTURE_FILE_SIGNATURE  = 0x434F4944;   // "DIOC"
+constexpr uint32_t DIO_CAPTURE_BLOCK_SIGNATURE = 0x4B4C4244;   // "DBLK"
+constexpr uint32_t DIO_CAPTURE_INDEX_SIGNATURE = 0x58444944;   // "DIDX"
+constexpr uint16_t DIO_CAPTURE_VERSION         = 1;
+
+constexpr uint32_t DIO_CAPTURE_CODE_BITS = 6;
+constexpr uint32_t DIO_CAPTURE_CODE_MASK = 32;
+
+//
+// Longest possible encoding of one event: a 10-byte varint holding the
+// delta and code, followed by a 5-byte varint holding the mask.
+//
+constexpr uint32_t DIO_CAPTURE_MAX_EVENT_BYTES = 15;
+
+#pragma pack(push, 1)
+
+typedef struct _DIO_CAPTURE_FILE_HEADER {
+    uint32_t    Signature;          // DIO_CAPTURE_FILE_SIGNATURE
+    uint16_t    Version;            // DIO_CAPTURE_VERSION
+    uint16_t    HeaderSize;         // sizeof(DIO_CAPTURE_FILE_HEADER)
+    uint32_t    TickNs;             // resolution of stored timestamps
+    uint32_t    Reserved;
+    uint64_t    StartTime;          // wall clock at timestamp zero, in ns
+                                    // since 1970-01-01 UTC (0 if unknown)
+} DIO_CAPTURE_FILE_HEADER, *PDIO_CAPTURE_FILE_HEADER;
+
+//
+// Bit definitions for DIO_CAPTURE_BLOCK_HEADER Flags
+//
+constexpr uint32_t DIO_CAPTURE_BLOCK_OVERFLOW = 0x00000001;  // events were
+                                                             // lost before or
+                                                             // within block
+
+typedef struct _DIO_CAPTURE_BLOCK_HEADER {
+    uint32_t    Signature;          // DIO_CAPTURE_BLOCK_SIGNATURE
+    uint32_t    PayloadLength;
+    uint32_t    EventCount;
+    uint32_t    Flags;
+    uint64_t    FirstTimestamp;     // ns
+    uint64_t    LastTimestamp;      // ns
+    uint32_t    InitialState;       // line state before the first event
+    uint32_t    PayloadCrc;         // CRC-32 of the payload
+} DIO_CAPTURE_BLOCK_HEADER, *PDIO_CAPTURE_BLOCK_HEADER;
+
+typedef struct _DIO_CAPTURE_INDEX_HEADER {
+    uint32_t    Signature;          // DIO_CAPTURE_INDEX_SIGNATURE
+    uint16_t    Version;            // DIO_CAPTURE_VERSION
+    uint16_t    HeaderSize;         // sizeof(DIO_CAPTURE_INDEX_HEADER)
+    uint32_t    EntrySize;          // sizeof(DIO_CAPTURE_INDEX_ENTRY)
+    uint32_t    TickNs;             // must match the capture
+    uint64_t    StartTime;          // must match the capture
+} DIO_CAPTURE_INDEX_HEADER, *PDIO_CAPTURE_INDEX_HEADER;
+
+typedef struct _DIO_CAPTURE_INDEX_ENTRY {
+    uint64_t    FirstTimestamp;     // ns
+    uint64_t    LastTimestamp;      // ns
+    uint64_t    Offset;             // of the block header in the capture
+    uint32_t    InitialState;       // line state before the first event
+    uint32_t    EventCount;
+} DIO_CAPTURE_INDEX_ENTRY, *PDIO_CAPTURE_INDEX_ENTRY;
+
+#pragma pack(pop)
+
+static_assert(sizeof(DIO_CAPTURE_FILE_HEADER) == 24, "file header layout");
+static_assert(sizeof(DIO_CAPTURE_BLOCK_HEADER) == 40, "block header layout");
+static_assert(sizeof(DIO_CAPTURE_INDEX_HEADER) == 24, "index header layout");
+static_assert(sizeof(DIO_CAPTURE_INDEX_ENTRY) == 32, "index entry layout");
+
+//
+// Encoding helpers, shared by the writer and reader.
+//
+// DioCaptureEncodeVarint returns the number of bytes written.
+// DioCaptureDecodeVarint returns the number of bytes consumed, or zero if
+// the varint is truncated or too long.
+//
+inline uint32_t
+DioCaptureEncodeVarint(uint64_t Value,
+                       uint8_t* Buffer)
+{
+    uint32_t length = 0;
+
+    while (Value >= 0x80) {
+
+        Buffer[length++] = (uint8_t)(Value | 0x80);
+
+        Value >>= 7;
+    }
+
+    Buffer[length++] = (uint8_t)Value;
+
+    return length;
+}
+
+inline uint32_t
+DioCaptureDecodeVarint(const uint8_t* Buffer,
+                       const uint8_t* End,
+                       uint64_t*      Value)
+{
+    uint64_t result = 0;
+    uint32_t shift  = 0;
+    uint32_t length = 0;
+
+    while (Buffer + length < End && shift < 64) {
+        uint8_t byte = Buffer[length++];
+
+        result |= (uint64_t)(byte & 0x7F) << shift;
+
+        if ((byte & 0x80) == 0) {
+
+            *Value = result;
+
+            return length;
+        }
+
+        shift += 7;
+    }
+
+    return 0;
+}
+
+//
+// Number of the lowest set bit in a non-zero Value
+//
+inline uint32_t
+DioCaptureLowestSetBit(uint32_t Value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+
+    _BitScanForward(&index, Value);
+
+    return index;
+#else
+    return (uint32_t)__builtin_ctz(Value);
+#endif
+}
+
+uint32_t DioCaptureCrc32(const void* Data,
+                         size_t      Length);
+
+//
+// DIO_CAPTURE_BLOCK_CURSOR
+//
+// Tracks our position while decoding the events in one block's payload.
+// Initialize it with DioCaptureStartBlock, then call DioCaptureDecodeEvents
+// as many times as you like until it returns zero.
+//
+typedef struct _DIO_CAPTURE_BLOCK_CURSOR {
+    const uint8_t*  Next;
+    const uint8_t*  End;
+    uint32_t        EventsLeft;
+    uint32_t        TickNs;
+    uint64_t        Tick;
+    uint32_t        LineState;
+    bool            Corrupt;
+} DIO_CAPTURE_BLOCK_CURSOR, *PDIO_CAPTURE_BLOCK_CURSOR;
+
+void DioCaptureStartBlock(PDIO_CAPTURE_BLOCK_CURSOR       Cursor,
+                          const DIO_CAPTURE_BLOCK_HEADER* Header,
+                          const uint8_t*                  Payload,
+                          uint32_t                        TickNs);
+
+//
+// Returns the number of events decoded into Events (at most Count).  Sets
+// Cursor->Corrupt, and returns what it could, if the payload is malformed.
+//
+size_t DioCaptureDecodeEvents(PDIO_CAPTURE_BLOCK_CURSOR Cursor,
+                              PDIO_EVENT                Events,
+                              size_t                    Count);
+
+//
+// Moves the cursor past every event with a timestamp before Timestamp,
+// without returning them.  Afterwards Cursor->LineState is the state of the
+// lines just before Timestamp, and the next event decoded (if any) is the
+// first at or after it.
+//
+void DioCaptureSkipEvents(PDIO_CAPTURE_BLOCK_CURSOR Cursor,
+                          uint64_t                  Timestamp);
@@ -0,0 +1,493 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioCaptureIndex.cpp -- Random access to capture files by time
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <cstdio>
+#include <cstring>
+
+#include "DioCaptureIndex.h"
+
+std::string
+DioCaptureIndexPath(const char* CapturePath)
+{
+    return std::string(CapturePath) + ".idx";
+}
+
+DioCaptureMappedReader::DioCaptureMappedReader()
+    : Header(),
+      Entries(nullptr),
+      EntryCount(0),
+      IndexFileEntries(0),
+      NextBlock(0),
+      Cursor(),
+      Overflows(0),
+      Corrupt(0)
+{
+}
+
+bool
+DioCaptureMappedReader::Open(const char* CapturePath,
+                             const char* IndexPath)
+{
+    uint64_t offset;
+
+    Close();
+
+    if (!CaptureFile.Open(CapturePath) ||
+        CaptureFile.Length() < sizeof(DIO_CAPTURE_FILE_HEADER)) {
+        goto failed;
+    }
+
+    memcpy(&Header, CaptureFile.Data(), sizeof(Header));
+
+    if (Header.Signature != DIO_CAPTURE_FILE_SIGNATURE ||
+        Header.Version != DIO_CAPTURE_VERSION ||
+        Header.HeaderSize < sizeof(DIO_CAPTURE_FILE_HEADER) ||
+        Header.HeaderSize > CaptureFile.Length() ||
+        Header.TickNs == 0) {
+        goto failed;
+    }
+
+    offset = Header.HeaderSize;
+
+    if (IndexPath != nullptr && LoadIndex(IndexPath)) {
+        const DIO_CAPTURE_INDEX_ENTRY&  last = Entries[EntryCount - 1];
+        const DIO_CAPTURE_BLOCK_HEADER* block;
+
+        block = BlockHeader(EntryCount - 1);
+
+        if (block == nullptr) {
+
+            //
+            // The index doesn't belong to this capture
+            //
+            IndexFile.Close();
+
+            Entries          = nullptr;
+            EntryCount       = 0;
+            IndexFileEntries = 0;
+
+        } else {
+
+            offset = last.Offset + sizeof(DIO_CAPTURE_BLOCK_HEADER) +
+                     block->PayloadLength;
+        }
+    }
+
+    //
+    // If the index doesn't cover the whole capture we need our own copy of
+    // it, to which we add the blocks we find by scanning.
+    //
+    if (offset < CaptureFile.Length()) {
+
+        ScannedEntries.assign(Entries, Entries + EntryCount);
+
+        ScanBlocks(offset);
+
+        Entries    = ScannedEntries.data();
+        EntryCount = ScannedEntries.size();
+
+        IndexFile.Close();
+    }
+
+    Seek(0);
+
+    return true;
+
+failed:
+
+    Close();
+
+    return false;
+}
+
+void
+DioCaptureMappedReader::Close()
+{
+    CaptureFile.Close();
+    IndexFile.Close();
+
+    ScannedEntries.clear();
+
+    Entries           = nullptr;
+    EntryCount        = 0;
+    IndexFileEntries  = 0;
+    NextBlock         = 0;
+    Cursor.EventsLeft = 0;
+    Overflows         = 0;
+    Corrupt           = 0;
+}
+
+//
+// Map the index at IndexPath, if it's there and it describes a capture like
+// ours.  We check that the last entry points to a block in our capture
+// afterwards.
+//
+bool
+DioCaptureMappedReader::LoadIndex(const char* IndexPath)
+{
+    DIO_CAPTURE_INDEX_HEADER indexHeader;
+    uint64_t                 count;
+
+    if (!IndexFile.Open(IndexPath) ||
+        IndexFile.Length() < sizeof(DIO_CAPTURE_INDEX_HEADER)) {
+        goto failed;
+    }
+
+    memcpy(&indexHeader, IndexFile.Data(), sizeof(indexHeader));
+
+    if (indexHeader.Signature != DIO_CAPTURE_INDEX_SIGNATURE ||
+        indexHeader.Version != DIO_CAPTURE_VERSION ||
+        indexHeader.HeaderSize < sizeof(DIO_CAPTURE_INDEX_HEADER) ||
+        indexHeader.HeaderSize > IndexFile.Length() ||
+        indexHeader.EntrySize != sizeof(DIO_CAPTURE_INDEX_ENTRY) ||
+        indexHeader.TickNs != Header.TickNs ||
+        indexHeader.StartTime != Header.StartTime) {
+        goto failed;
+    }
+
+    //
+    // A partially written entry at the end is ignored
+    //
+    count = (IndexFile.Length() - indexHeader.HeaderSize) /
+            sizeof(DIO_CAPTURE_INDEX_ENTRY);
+
+    if (count == 0) {
+        goto failed;
+    }
+
+    Entries = reinterpret_cast<const DIO_CAPTURE_INDEX_ENTRY*>(
+                                IndexFile.Data() + indexHeader.HeaderSize);
+
+    EntryCount       = (size_t)count;
+    IndexFileEntries = EntryCount;
+
+    return true;
+
+failed:
+
+    IndexFile.Close();
+
+    return false;
+}
+
+//
+// Add an entry to ScannedEntries for each block from Offset to the end of
+// the capture.  Like DioCaptureReader, we stop at the first thing that
+// isn't a complete block.
+//
+void
+DioCaptureMappedReader::ScanBlocks(uint64_t Offset)
+{
+    const uint8_t*           data   = CaptureFile.Data();
+    uint64_t                 length = CaptureFile.Length();
+    DIO_CAPTURE_BLOCK_HEADER block;
+    DIO_CAPTURE_INDEX_ENTRY  entry;
+
+    while (length - Offset >= sizeof(DIO_CAPTURE_BLOCK_HEADER)) {
+
+        memcpy(&block, data + Offset, sizeof(block));
+
+        if (block.Signature != DIO_CAPTURE_BLOCK_SIGNATURE ||
+            block.PayloadLength > length - Offset - sizeof(block)) {
+            break;
+        }
+
+        entry.FirstTimestamp = block.FirstTimestamp;
+        entry.LastTimestamp  = block.LastTimestamp;
+        entry.Offset         = Offset;
+        entry.InitialState   = block.InitialState;
+        entry.EventCount     = block.EventCount;
+
+        ScannedEntries.push_back(entry);
+
+        Offset += sizeof(block) + block.PayloadLength;
+    }
+}
+
+//
+// Returns the header of the given block, or nullptr if its index entry
+// doesn't point to a complete block in the capture.
+//
+const DIO_CAPTURE_BLOCK_HEADER*
+DioCaptureMappedReader::BlockHeader(size_t Block) const
+{
+    const DIO_CAPTURE_BLOCK_HEADER* header;
+    uint64_t                        offset = Entries[Block].Offset;
+    uint64_t                        length = CaptureFile.Length();
+
+    if (offset < Header.HeaderSize ||
+        offset > length ||
+        length - offset < sizeof(DIO_CAPTURE_BLOCK_HEADER)) {
+        return nullptr;
+    }
+
+    header = reinterpret_cast<const DIO_CAPTURE_BLOCK_HEADER*>(
+                                                CaptureFile.Data() + offset);
+
+    if (header->Signature != DIO_CAPTURE_BLOCK_SIGNATURE ||
+        header->PayloadLength > length - offset - sizeof(*header) ||
+        header->FirstTimestamp != Entries[Block].FirstTimestamp) {
+        return nullptr;
+    }
+
+    return header;
+}
+
+uint64_t
+DioCaptureMappedReader::FirstTimestamp() const
+{
+    return EntryCount != 0 ? Entries[0].FirstTimestamp : 0;
+}
+
+uint64_t
+DioCaptureMappedReader::LastTimestamp() const
+{
+    return EntryCount != 0 ? Entries[EntryCount - 1].LastTimestamp : 0;
+}
+
+//
+// Returns the last block whose first event is before Timestamp, or the
+// first block if there isn't one.  Events with the same timestamp can
+// straddle a block boundary, which is why we look for a block starting
+// strictly before Timestamp.
+//
+size_t
+DioCaptureMappedReader::FindBlock(uint64_t Timestamp) const
+{
+    size_t low  = 0;
+    size_t high = EntryCount;
+
+    //
+    // Find the first block that starts at or after Timestamp...
+    //
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+
+        if (Entries[middle].FirstTimestamp < Timestamp) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    //
+    // ...and back up one
+    //
+    return low != 0 ? low - 1 : 0;
+}
+
+bool
+DioCaptureMappedReader::StartBlock(size_t Block,
+                                   bool   Verify)
+{
+    const DIO_CAPTURE_BLOCK_HEADER* header;
+    const uint8_t*                  payload;
+
+    header = BlockHeader(Block);
+
+    if (header == nullptr) {
+        return false;
+    }
+
+    payload = reinterpret_cast<const uint8_t*>(header + 1);
+
+    if (Verify &&
+        DioCaptureCrc32(payload, header->PayloadLength) != header->PayloadCrc) {
+        return false;
+    }
+
+    DioCaptureStartBlock(&Cursor,
+                         header,
+                         payload,
+                         Header.TickNs);
+
+    return true;
+}
+
+bool
+DioCaptureMappedReader::StateAt(uint64_t  Timestamp,
+                                uint32_t* LineState)
+{
+    DIO_CAPTURE_BLOCK_CURSOR saved;
+    size_t                   block;
+
+    if (EntryCount == 0) {
+        return false;
+    }
+
+    //
+    // We want the events at Timestamp too, so look for the ones before the
+    // next nanosecond
+    //
+    if (Timestamp != UINT64_MAX) {
+        Timestamp++;
+    }
+
+    block = FindBlock(Timestamp);
+
+    //
+    // Don't disturb the position of a Seek/Read in progress
+    //
+    saved = Cursor;
+
+    if (!StartBlock(block, false)) {
+
+        Cursor = saved;
+
+        return false;
+    }
+
+    DioCaptureSkipEvents(&Cursor, Timestamp);
+
+    *LineState = Cursor.LineState;
+
+    if (Cursor.Corrupt) {
+
+        Cursor = saved;
+
+        return false;
+    }
+
+    Cursor = saved;
+
+    return true;
+}
+
+void
+DioCaptureMappedReader::Seek(uint64_t Timestamp)
+{
+    size_t block;
+
+    Cursor.EventsLeft = 0;
+    NextBlock         = EntryCount;
+
+    if (EntryCount == 0) {
+        return;
+    }
+
+    block = FindBlock(Timestamp);
+
+    NextBlock = block + 1;
+
+    if (!StartBlock(block, true)) {
+
+        //
+        // Read will carry on with the next block
+        //
+        Corrupt++;
+
+        return;
+    }
+
+    DioCaptureSkipEvents(&Cursor, Timestamp);
+}
+
+size_t
+DioCaptureMappedReader::Read(PDIO_EVENT Events,
+                             size_t     Count)
+{
+    size_t total = 0;
+
+    while (total < Count) {
+
+        if (Cursor.EventsLeft == 0) {
+
+            if (NextBlock >= EntryCount) {
+                break;
+            }
+
+            if (!StartBlock(NextBlock++, true)) {
+
+                Corrupt++;
+
+                continue;
+            }
+
+            if ((BlockHeader(NextBlock - 1)->Flags &
+                                    DIO_CAPTURE_BLOCK_OVERFLOW) != 0) {
+                Overflows++;
+            }
+        }
+
+        total += DioCaptureDecodeEvents(&Cursor,
+                                        Events + total,
+                                        Count - total);
+
+        if (Cursor.Corrupt) {
+            Corrupt++;
+            Cursor.Corrupt = false;
+        }
+    }
+
+    return total;
+}
+
+bool
+DioCaptureMappedReader::WriteIndex(const char* IndexPath) const
+{
+    DIO_CAPTURE_INDEX_HEADER indexHeader;
+    FILE*                    file;
+    bool                     result;
+
+    file = fopen(IndexPath, "wb");
+
+    if (file == nullptr) {
+        return false;
+    }
+
+    memset(&indexHeader, 0, sizeof(indexHeader));
+
+    indexHeader.Signature  = DIO_CAPTURE_INDEX_SIGNATURE;
+    indexHeader.Version    = DIO_CAPTURE_VERSION;
+    indexHeader.HeaderSize = sizeof(DIO_CAPTURE_INDEX_HEADER);
+    indexHeader.EntrySize  = sizeof(DIO_CAPTURE_INDEX_ENTRY);
+    indexHeader.TickNs     = Header.TickNs;
+    indexHeader.StartTime  = Header.StartTime;
+
+    result = fwrite(&indexHeader, sizeof(indexHeader), 1, file) == 1 &&
+             fwrite(Entries,
+                    sizeof(DIO_CAPTURE_INDEX_ENTRY),
+                    EntryCount,
+                    file) == EntryCount;
+
+    if (fclose(file) != 0) {
+        result = false;
+    }
+
+    return result;
+}
@@ -0,0 +1,181 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioCaptureIndex.h -- Random access to capture files by time
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      The capture file and its index are both mapped, so looking up the
+//      state of the lines at any time costs a binary search of the index
+//      plus decoding (part of) one block.  That's O(log n + block size),
+//      regardless of how large the capture is.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "DioCaptureFormat.h"
+#include "DioMappedFile.h"
+
+//
+// The conventional name of the index for a capture: the capture's name with
+// ".idx" appended.
+//
+std::string DioCaptureIndexPath(const char* CapturePath);
+
+//
+// DioCaptureMappedReader
+//
+// Random access to a capture file.  Open maps the capture and, if it is
+// given the path to one, its index.  If there is no usable index, or the
+// index covers only part of the capture (because the capture was still
+// being written), the block headers not covered by the index are scanned
+// to build the rest of it in memory.
+//
+// StateAt answers "what were the lines at time T?".  Seek followed by Read
+// returns the events from a given time onward, so the reader can also feed
+// a decoder starting anywhere in a capture.
+//
+// Times are capture timestamps, in nanoseconds.  To look up a wall clock
+// time, subtract the StartTime in the capture's file header.
+//
+class DioCaptureMappedReader : public DioEventSource
+{
+public:
+    DioCaptureMappedReader();
+
+    DioCaptureMappedReader(const DioCaptureMappedReader&) = delete;
+    DioCaptureMappedReader& operator=(const DioCaptureMappedReader&) = delete;
+
+    //
+    // IndexPath may be nullptr, in which case the whole capture is scanned
+    //
+    bool Open(const char* CapturePath,
+              const char* IndexPath);
+
+    void Close();
+
+    const DIO_CAPTURE_FILE_HEADER& FileHeader() const
+    {
+        return Header;
+    }
+
+    size_t BlockCount() const
+    {
+        return EntryCount;
+    }
+
+    //
+    // Number of blocks whose index entries came from the index file, as
+    // opposed to being found by scanning the capture
+    //
+    size_t IndexedBlocks() const
+    {
+        return IndexFileEntries;
+    }
+
+    //
+    // Timestamps of the first and last events in the capture
+    //
+    uint64_t FirstTimestamp() const;
+    uint64_t LastTimestamp() const;
+
+    //
+    // State of the lines after every event at or before Timestamp.  For a
+    // time before the first event that's the state the capture started
+    // with.  Returns false if the capture is empty or the block holding
+    // Timestamp is damaged.
+    //
+    // For speed, this does not check the block's CRC.
+    //
+    bool StateAt(uint64_t  Timestamp,
+                 uint32_t* LineState);
+
+    //
+    // Position the reader so that Read returns events starting with the
+    // first at or after Timestamp.  Open leaves the reader positioned at
+    // the start of the capture.
+    //
+    void Seek(uint64_t Timestamp);
+
+    //
+    // Read checks the CRC of each block, and skips damaged ones, just as
+    // DioCaptureReader does
+    //
+    size_t Read(PDIO_EVENT Events,
+                size_t     Count) override;
+
+    uint64_t OverflowCount() const override
+    {
+        return Overflows;
+    }
+
+    uint64_t CorruptBlocks() const
+    {
+        return Corrupt;
+    }
+
+    //
+    // Write out the index we're using.  This is how an index is rebuilt for
+    // a capture that doesn't have one.
+    //
+    bool WriteIndex(const char* IndexPath) const;
+
+private:
+    bool LoadIndex(const char* IndexPath);
+
+    void ScanBlocks(uint64_t Offset);
+
+    size_t FindBlock(uint64_t Timestamp) const;
+
+    const DIO_CAPTURE_BLOCK_HEADER* BlockHeader(size_t Block) const;
+
+    bool StartBlock(size_t Block,
+                    bool   Verify);
+
+    DioMappedFile                        CaptureFile;
+    DioMappedFile                        IndexFile;
+    DIO_CAPTURE_FILE_HEADER              Header;
+    const DIO_CAPTURE_INDEX_ENTRY*       Entries;
+    size_t                               EntryCount;
+    size_t                               IndexFileEntries;
+    std::vector<DIO_CAPTURE_INDEX_ENTRY> ScannedEntries;
+    size_t                               NextBlock;
+    DIO_CAPTURE_BLOCK_CURSOR             Cursor;
+    uint64_t                             Overflows;
+    uint64_t                             Corrupt;
+};
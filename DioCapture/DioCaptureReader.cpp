@@ -0,0 +1,203 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioCaptureReader.cpp -- Reads DIO capture files
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <cstdlib>
+#include <cstring>
+
+#include "DioCaptureReader.h"
+
+DioCaptureReader::DioCaptureReader()
+    : File(nullptr),
+      Header(),
+      Block(),
+      Payload(nullptr),
+      PayloadSize(0),
+      Cursor(),
+      EndOfFile(true),
+      Overflows(0),
+      Corrupt(0),
+      Blocks(0)
+{
+}
+
+DioCaptureReader::~DioCaptureReader()
+{
+    Close();
+
+    free(Payload);
+}
+
+bool
+DioCaptureReader::Open(const char* Path)
+{
+    File = fopen(Path, "rb");
+
+    if (File == nullptr) {
+        return false;
+    }
+
+    if (fread(&Header, sizeof(Header), 1, File) != 1 ||
+        Header.Signature != DIO_CAPTURE_FILE_SIGNATURE ||
+        Header.Version != DIO_CAPTURE_VERSION ||
+        Header.HeaderSize < sizeof(DIO_CAPTURE_FILE_HEADER) ||
+        Header.TickNs == 0) {
+
+        Close();
+
+        return false;
+    }
+
+    //
+    // Allow for a larger header written by a later version
+    //
+    if (Header.HeaderSize > sizeof(DIO_CAPTURE_FILE_HEADER) &&
+        fseek(File, Header.HeaderSize, SEEK_SET) != 0) {
+
+        Close();
+
+        return false;
+    }
+
+    Cursor.EventsLeft = 0;
+    EndOfFile         = false;
+
+    return true;
+}
+
+void
+DioCaptureReader::Close()
+{
+    if (File != nullptr) {
+
+        fclose(File);
+
+        File = nullptr;
+    }
+
+    EndOfFile = true;
+}
+
+//
+// Read the next good block into our payload buffer and position our cursor
+// at its first event.  Returns false at the end of the file, or if the file
+// is damaged so badly that we can't find the next block.
+//
+bool
+DioCaptureReader::NextBlock()
+{
+    while (!EndOfFile) {
+
+        if (fread(&Block, sizeof(Block), 1, File) != 1 ||
+            Block.Signature != DIO_CAPTURE_BLOCK_SIGNATURE) {
+
+            EndOfFile = true;
+
+            break;
+        }
+
+        if (Block.PayloadLength > PayloadSize) {
+            uint8_t* larger;
+
+            larger = static_cast<uint8_t*>(realloc(Payload, Block.PayloadLength));
+
+            if (larger == nullptr) {
+
+                EndOfFile = true;
+
+                break;
+            }
+
+            Payload     = larger;
+            PayloadSize = Block.PayloadLength;
+        }
+
+        if (fread(Payload, 1, Block.PayloadLength, File) != Block.PayloadLength) {
+
+            EndOfFile = true;
+
+            break;
+        }
+
+        Blocks++;
+
+        if (DioCaptureCrc32(Payload, Block.PayloadLength) != Block.PayloadCrc) {
+
+            Corrupt++;
+
+            continue;
+        }
+
+        if ((Block.Flags & DIO_CAPTURE_BLOCK_OVERFLOW) != 0) {
+            Overflows++;
+        }
+
+        DioCaptureStartBlock(&Cursor,
+                             &Block,
+                             Payload,
+                             Header.TickNs);
+
+        return true;
+    }
+
+    return false;
+}
+
+size_t
+DioCaptureReader::Read(PDIO_EVENT Events,
+                       size_t     Count)
+{
+    size_t total = 0;
+
+    while (total < Count) {
+
+        if (Cursor.EventsLeft == 0 && !NextBlock()) {
+            break;
+        }
+
+        total += DioCaptureDecodeEvents(&Cursor,
+                                        Events + total,
+                                        Count - total);
+
+        if (Cursor.Corrupt) {
+            Corrupt++;
+            Cursor.Corrupt = false;
+        }
+    }
+
+    return total;
+}
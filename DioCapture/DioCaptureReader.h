@@ -0,0 +1,102 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioCaptureReader.h -- Reads DIO capture files
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstdio>
+
+#include "DioCaptureFormat.h"
+
+//
+// DioCaptureReader
+//
+// Reads a capture file from start to finish, as a DioEventSource.  Blocks
+// whose CRC doesn't match are skipped (and counted).  A block that carries
+// DIO_CAPTURE_BLOCK_OVERFLOW increments OverflowCount, so consumers of the
+// stream see the same gaps that the capture recorded.
+//
+class DioCaptureReader : public DioEventSource
+{
+public:
+    DioCaptureReader();
+    ~DioCaptureReader() override;
+
+    DioCaptureReader(const DioCaptureReader&) = delete;
+    DioCaptureReader& operator=(const DioCaptureReader&) = delete;
+
+    bool Open(const char* Path);
+
+    void Close();
+
+    const DIO_CAPTURE_FILE_HEADER& FileHeader() const
+    {
+        return Header;
+    }
+
+    size_t Read(PDIO_EVENT Events,
+                size_t     Count) override;
+
+    uint64_t OverflowCount() const override
+    {
+        return Overflows;
+    }
+
+    uint64_t CorruptBlocks() const
+    {
+        return Corrupt;
+    }
+
+    uint64_t BlocksRead() const
+    {
+        return Blocks;
+    }
+
+private:
+    bool NextBlock();
+
+    FILE*                    File;
+    DIO_CAPTURE_FILE_HEADER  Header;
+    DIO_CAPTURE_BLOCK_HEADER Block;
+    uint8_t*                 Payload;
+    size_t                   PayloadSize;
+    DIO_CAPTURE_BLOCK_CURSOR Cursor;
+    bool                     EndOfFile;
+    uint64_t                 Overflows;
+    uint64_t                 Corrupt;
+    uint64_t                 Blocks;
+};
@@ -0,0 +1,430 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioCaptureRecorder.cpp -- Records an event ring into a rotating set
+//                                  of capture files
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include "DioCaptureRecorder.h"
+#include "DioCaptureIndex.h"
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+//
+// Most events we take from the ring at once.  Stats and rotation are
+// checked between batches, and the ring slots are given back to the
+// producer after each, so this also bounds how long the producer waits to
+// get space back.
+//
+constexpr uint32_t RECORDER_BATCH_EVENTS = 4096;
+
+//
+// How long we wait for events before making sure what we have is on disk
+//
+constexpr uint32_t RECORDER_IDLE_MS = 100;
+
+static uint64_t
+SteadyNs()
+{
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+DIO_RECORDER_CONFIG
+DioRecorderDefaultConfig()
+{
+    DIO_RECORDER_CONFIG config;
+
+    config.Prefix            = "capture";
+    config.RotateBytes       = 1024ULL * 1024 * 1024;
+    config.RotateSeconds     = 0;
+    config.BlockPayloadBytes = 16 * 1024;
+    config.FileBufferBytes   = DIO_ASYNC_FILE_BUFFER_BYTES;
+
+    return config;
+}
+
+DioCaptureRecorder::DioCaptureRecorder(DioEventRingSource&        Source,
+                                       const DIO_RECORDER_CONFIG& Config)
+    : Source(Source),
+      Config(Config),
+      FileSink(Config.FileBufferBytes),
+      TickNs(1),
+      ZeroCopy(false),
+      Unbuffered(false),
+      Asynchronous(false),
+      Sequence(0),
+      FileOpenedNs(0),
+      ClosedFileBytes(0),
+      LastOverflowCount(0),
+      EventCount(0),
+      ByteCount(0),
+      FileCount(0),
+      Overflows(0),
+      ElapsedNs(0),
+      CpuNs(0)
+{
+}
+
+DioCaptureRecorder::~DioCaptureRecorder()
+{
+    CloseFile();
+}
+
+uint64_t
+DioCaptureRecorder::ThreadCpuNs()
+{
+#ifdef _WIN32
+    FILETIME creation;
+    FILETIME exit;
+    FILETIME kernel;
+    FILETIME user;
+
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+
+    return ((static_cast<uint64_t>(kernel.dwHighDateTime) << 32 | kernel.dwLowDateTime) +
+            (static_cast<uint64_t>(user.dwHighDateTime) << 32 | user.dwLowDateTime)) * 100;
+#else
+    timespec now;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) {
+        return 0;
+    }
+
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL +
+           static_cast<uint64_t>(now.tv_nsec);
+#endif
+}
+
+bool
+DioCaptureRecorder::OpenFile()
+{
+    DIO_CAPTURE_CONFIG captureConfig;
+    PDIO_EVENT_RING    ring;
+    std::time_t        now;
+    std::tm            local;
+    char               name[64];
+    uint64_t           wallNs;
+
+    ring = Source.Ring();
+
+    now = std::time(nullptr);
+
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+
+    snprintf(name,
+             sizeof(name),
+             "-%04d%02d%02d-%02d%02d%02d-%04u.dioc",
+             local.tm_year + 1900,
+             local.tm_mon + 1,
+             local.tm_mday,
+             local.tm_hour,
+             local.tm_min,
+             local.tm_sec,
+             Sequence);
+
+    FileName = Config.Prefix + name;
+
+    Sequence++;
+
+    if (!FileSink.Open(FileName.c_str()) ||
+        !IndexSink.Open(DioCaptureIndexPath(FileName.c_str()).c_str())) {
+        return false;
+    }
+
+    Unbuffered   = FileSink.Unbuffered();
+    Asynchronous = FileSink.Asynchronous();
+
+    //
+    // Timestamp zero in the ring's clock is (now on the wall clock) less
+    // (now on the ring's clock)
+    //
+    wallNs = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+
+    DioCaptureDefaultConfig(&captureConfig);
+
+    captureConfig.TickNs            = TickNs;
+    captureConfig.BlockPayloadBytes = Config.BlockPayloadBytes;
+    captureConfig.StartTime         = wallNs - DioTicksToNs(Source.CurrentTimestamp(),
+                                                            ring->TimestampFrequency);
+
+    Writer.reset(new DioCaptureWriter(&FileSink,
+                                      captureConfig));
+
+    Writer->SetIndexSink(&IndexSink);
+
+    FileOpenedNs = SteadyNs();
+
+    FileCount++;
+
+    return Writer->Begin();
+}
+
+bool
+DioCaptureRecorder::CloseFile()
+{
+    bool result;
+
+    if (!Writer) {
+        return true;
+    }
+
+    result = Writer->Finish();
+
+    ClosedFileBytes += Writer->BytesWritten();
+
+    if (!FileSink.Close()) {
+        result = false;
+    }
+
+    IndexSink.Close();
+
+    Writer.reset();
+
+    return result;
+}
+
+bool
+DioCaptureRecorder::Run(const std::atomic<bool>& Stop)
+{
+    PDIO_EVENT_RING        ring;
+    std::vector<DIO_EVENT> converted;
+    uint64_t               startNs;
+    uint64_t               startCpuNs;
+    uint64_t               frequency;
+    uint32_t               consumer;
+    uint32_t               producer;
+    uint32_t               offset;
+    uint32_t               count;
+    uint32_t               overflowCount;
+    uint32_t               flags;
+    bool                   unflushed;
+    bool                   appended;
+    bool                   result;
+
+    ring = Source.Ring();
+
+    if (ring == nullptr || ring->TimestampFrequency == 0) {
+        return false;
+    }
+
+    startNs    = SteadyNs();
+    startCpuNs = ThreadCpuNs();
+
+    //
+    // Can we store the ring's timestamps as they are?
+    //
+    frequency = ring->TimestampFrequency;
+    ZeroCopy  = frequency <= 1000000000ULL && (1000000000ULL % frequency) == 0;
+    TickNs    = ZeroCopy ? static_cast<uint32_t>(1000000000ULL / frequency) : 1;
+
+    if (!ZeroCopy) {
+        converted.resize(RECORDER_BATCH_EVENTS);
+    }
+
+    LastOverflowCount = ring->OverflowCount.load(std::memory_order_relaxed);
+
+    if (!OpenFile()) {
+        return false;
+    }
+
+    consumer  = ring->ConsumerIndex.load(std::memory_order_relaxed);
+    unflushed = false;
+    result    = true;
+
+    while (!Stop.load(std::memory_order_relaxed)) {
+
+        //
+        // Time for a new file?
+        //
+        if ((Config.RotateBytes != 0 && Writer->BytesWritten() >= Config.RotateBytes) ||
+            (Config.RotateSeconds != 0 &&
+             SteadyNs() - FileOpenedNs >= Config.RotateSeconds * 1000000000ULL)) {
+
+            if (!CloseFile() || !OpenFile()) {
+
+                result = false;
+
+                break;
+            }
+
+            unflushed = false;
+        }
+
+        producer = ring->ProducerIndex.load(std::memory_order_acquire);
+
+        if (producer == consumer) {
+
+            if (Source.Wait(RECORDER_IDLE_MS)) {
+                continue;
+            }
+
+            if (Source.Finished() &&
+                ring->ProducerIndex.load(std::memory_order_acquire) == consumer) {
+                break;
+            }
+
+            //
+            // Nothing for a while, so get what we have to the disk
+            //
+            if (unflushed) {
+
+                if (!Writer->EndBlock() || !FileSink.Flush()) {
+
+                    result = false;
+
+                    break;
+                }
+
+                unflushed = false;
+            }
+
+            continue;
+        }
+
+        //
+        // Take the events up to the end of the ring, or the batch size
+        //
+        offset = consumer & (ring->Capacity - 1);
+        count  = producer - consumer;
+
+        if (count > ring->Capacity - offset) {
+            count = ring->Capacity - offset;
+        }
+
+        if (count > RECORDER_BATCH_EVENTS) {
+            count = RECORDER_BATCH_EVENTS;
+        }
+
+        //
+        // If the producer dropped events since we last looked, mark the
+        // block that gets these
+        //
+        flags         = 0;
+        overflowCount = ring->OverflowCount.load(std::memory_order_relaxed);
+
+        if (overflowCount != LastOverflowCount) {
+
+            Overflows += overflowCount - LastOverflowCount;
+
+            LastOverflowCount = overflowCount;
+            flags             = DIO_CAPTURE_BLOCK_OVERFLOW;
+        }
+
+        if (ZeroCopy) {
+
+            appended = Writer->AppendTicks(&ring->Events[offset],
+                                           count,
+                                           flags);
+        } else {
+
+            for (uint32_t i = 0; i < count; i++) {
+
+                converted[i]           = ring->Events[offset + i];
+                converted[i].Timestamp = DioTicksToNs(converted[i].Timestamp,
+                                                      frequency);
+            }
+
+            appended = Writer->Append(converted.data(),
+                                      count,
+                                      flags);
+        }
+
+        if (!appended) {
+
+            result = false;
+
+            break;
+        }
+
+        //
+        // Done with these slots
+        //
+        consumer += count;
+
+        ring->ConsumerIndex.store(consumer, std::memory_order_release);
+
+        unflushed = true;
+
+        EventCount += count;
+        ByteCount   = ClosedFileBytes + Writer->BytesWritten();
+        ElapsedNs   = SteadyNs() - startNs;
+        CpuNs       = ThreadCpuNs() - startCpuNs;
+    }
+
+    if (!CloseFile()) {
+        result = false;
+    }
+
+    ByteCount = ClosedFileBytes;
+    ElapsedNs = SteadyNs() - startNs;
+    CpuNs     = ThreadCpuNs() - startCpuNs;
+
+    return result;
+}
+
+DIO_RECORDER_STATS
+DioCaptureRecorder::Stats() const
+{
+    DIO_RECORDER_STATS stats;
+
+    stats.Events       = EventCount;
+    stats.Bytes        = ByteCount;
+    stats.Files        = FileCount;
+    stats.Overflows    = Overflows;
+    stats.ElapsedNs    = ElapsedNs;
+    stats.CpuNs        = CpuNs;
+    stats.ZeroCopy     = ZeroCopy;
+    stats.Unbuffered   = Unbuffered;
+    stats.Asynchronous = Asynchronous;
+
+    return stats;
+}
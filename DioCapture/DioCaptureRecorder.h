@@ -0,0 +1,159 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioCaptureRecorder.h -- Records an event ring into a rotating set
+//                                of capture files
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      This is the engine of the capture service.  Events are encoded into
+//      the capture format straight out of the ring the driver fills (they
+//      aren't copied anywhere first), into the buffers of a
+//      DioAsyncFileSink (so the encoded blocks aren't copied either), which
+//      are written to disk asynchronously.  The only copy of the data is
+//      therefore the encoding itself.
+//
+//      That's only possible when the ring's timestamps can be stored as
+//      they are, which is when the ring's TimestampFrequency divides
+//      1,000,000,000 evenly (the usual 10MHz performance counter does).
+//      Otherwise, the events are converted to nanoseconds in small batches
+//      on the way through.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "DioAsyncFile.h"
+#include "DioCaptureWriter.h"
+#include "DioEventRing.h"
+
+//
+// DIO_RECORDER_CONFIG
+//
+// Files are named <Prefix>-<YYYYMMDD>-<HHMMSS>-<Sequence>.dioc, each with an
+// index alongside it (see DioCaptureIndexPath).  A new file is started when
+// the current one reaches RotateBytes or has been open for RotateSeconds;
+// zero means never, for either.
+//
+typedef struct _DIO_RECORDER_CONFIG {
+    std::string Prefix;
+    uint64_t    RotateBytes;
+    uint32_t    RotateSeconds;
+    uint32_t    BlockPayloadBytes;
+    size_t      FileBufferBytes;
+} DIO_RECORDER_CONFIG, *PDIO_RECORDER_CONFIG;
+
+DIO_RECORDER_CONFIG DioRecorderDefaultConfig();
+
+//
+// DIO_RECORDER_STATS
+//
+// CpuNs is the CPU time used by the thread that called Run, so it
+// includes encoding and issuing the writes but not the writes themselves.
+//
+typedef struct _DIO_RECORDER_STATS {
+    uint64_t    Events;
+    uint64_t    Bytes;
+    uint64_t    Files;
+    uint64_t    Overflows;
+    uint64_t    ElapsedNs;
+    uint64_t    CpuNs;
+    bool        ZeroCopy;
+    bool        Unbuffered;
+    bool        Asynchronous;
+} DIO_RECORDER_STATS, *PDIO_RECORDER_STATS;
+
+//
+// DioCaptureRecorder
+//
+// Run consumes the ring until Stop becomes true or the ring's source is
+// Finished, and returns false if a file couldn't be created or written.
+// Stats may be read from another thread while Run is running; the values
+// are updated after every batch of events.
+//
+class DioCaptureRecorder
+{
+public:
+    DioCaptureRecorder(DioEventRingSource&        Source,
+                       const DIO_RECORDER_CONFIG& Config);
+    ~DioCaptureRecorder();
+
+    DioCaptureRecorder(const DioCaptureRecorder&) = delete;
+    DioCaptureRecorder& operator=(const DioCaptureRecorder&) = delete;
+
+    bool Run(const std::atomic<bool>& Stop);
+
+    DIO_RECORDER_STATS Stats() const;
+
+    const std::string& CurrentFile() const
+    {
+        return FileName;
+    }
+
+    //
+    // CPU time used so far by the calling thread, in nanoseconds
+    //
+    static uint64_t ThreadCpuNs();
+
+private:
+    bool OpenFile();
+
+    bool CloseFile();
+
+    DioEventRingSource&               Source;
+    DIO_RECORDER_CONFIG               Config;
+    DioAsyncFileSink                  FileSink;
+    DioCaptureFileSink                IndexSink;
+    std::unique_ptr<DioCaptureWriter> Writer;
+    std::string                       FileName;
+    uint32_t                          TickNs;
+    std::atomic<bool>                 ZeroCopy;
+    std::atomic<bool>                 Unbuffered;
+    std::atomic<bool>                 Asynchronous;
+    uint32_t                          Sequence;
+    uint64_t                          FileOpenedNs;
+    uint64_t                          ClosedFileBytes;
+    uint32_t                          LastOverflowCount;
+    std::atomic<uint64_t>             EventCount;
+    std::atomic<uint64_t>             ByteCount;
+    std::atomic<uint64_t>             FileCount;
+    std::atomic<uint64_t>             Overflows;
+    std::atomic<uint64_t>             ElapsedNs;
+    std::atomic<uint64_t>             CpuNs;
+};
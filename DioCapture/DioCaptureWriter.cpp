@@ -0,0 +1,442 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioCaptureWriter.cpp -- Writes DIO capture files
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <cstdlib>
+#include <cstring>
+
+#include "DioCaptureWriter.h"
+
+//
+// Number of events DioCaptureWriter::Capture reads from its source at a time
+//
+constexpr size_t CAPTURE_READ_EVENTS = 256;
+
+void
+DioCaptureDefaultConfig(PDIO_CAPTURE_CONFIG Config)
+{
+    Config->TickNs            = 1;
+    Config->BlockPayloadBytes = 16 * 1024;
+    Config->MaxBlockDuration  = 1000000000ULL;
+    Config->StartTime         = 0;
+}
+
+DioCaptureFileSink::DioCaptureFileSink()
+    : File(nullptr)
+{
+}
+
+DioCaptureFileSink::~DioCaptureFileSink()
+{
+    Close();
+}
+
+bool
+DioCaptureFileSink::Open(const char* Path)
+{
+    File = fopen(Path, "wb");
+
+    if (File == nullptr) {
+        return false;
+    }
+
+    //
+    // Our writes are whole blocks, so stdio's buffering would only add a
+    // copy.
+    //
+    setvbuf(File, nullptr, _IONBF, 0);
+
+    return true;
+}
+
+bool
+DioCaptureFileSink::Write(const void* Data,
+                          size_t      Length)
+{
+    return fwrite(Data, 1, Length, File) == Length;
+}
+
+bool
+DioCaptureFileSink::Flush()
+{
+    return fflush(File) == 0;
+}
+
+void
+DioCaptureFileSink::Close()
+{
+    if (File != nullptr) {
+
+        fclose(File);
+
+        File = nullptr;
+    }
+}
+
+DioCaptureWriter::DioCaptureWriter(DioCaptureSink*           Sink,
+                                   const DIO_CAPTURE_CONFIG& Config)
+    : Sink(Sink),
+      IndexSink(nullptr),
+      Config(Config),
+      Buffer(nullptr),
+      Header(nullptr),
+      Payload(nullptr),
+      Next(nullptr),
+      Limit(nullptr),
+      BlockOpen(false),
+      InSinkBuffer(false),
+      PreviousTick(0),
+      BlockEndTick(0),
+      LineState(0),
+      HaveLineState(false),
+      Failed(false),
+      TotalEvents(0),
+      TotalBytes(0),
+      TotalBlocks(0)
+{
+    if (this->Config.TickNs == 0) {
+        this->Config.TickNs = 1;
+    }
+
+    //
+    // A block must have room for at least one event
+    //
+    if (this->Config.BlockPayloadBytes < DIO_CAPTURE_MAX_EVENT_BYTES) {
+        this->Config.BlockPayloadBytes = DIO_CAPTURE_MAX_EVENT_BYTES;
+    }
+}
+
+DioCaptureWriter::~DioCaptureWriter()
+{
+    free(Buffer);
+}
+
+bool
+DioCaptureWriter::Begin()
+{
+    DIO_CAPTURE_FILE_HEADER fileHeader;
+
+    Buffer = static_cast<uint8_t*>(malloc(sizeof(DIO_CAPTURE_BLOCK_HEADER) +
+                                          Config.BlockPayloadBytes));
+
+    if (Buffer == nullptr) {
+
+        Failed = true;
+
+        return false;
+    }
+
+    memset(&fileHeader, 0, sizeof(fileHeader));
+
+    fileHeader.Signature  = DIO_CAPTURE_FILE_SIGNATURE;
+    fileHeader.Version    = DIO_CAPTURE_VERSION;
+    fileHeader.HeaderSize = sizeof(DIO_CAPTURE_FILE_HEADER);
+    fileHeader.TickNs     = Config.TickNs;
+    fileHeader.StartTime  = Config.StartTime;
+
+    if (!Sink->Write(&fileHeader, sizeof(fileHeader))) {
+
+        Failed = true;
+
+        return false;
+    }
+
+    TotalBytes = sizeof(fileHeader);
+
+    if (IndexSink != nullptr) {
+        DIO_CAPTURE_INDEX_HEADER indexHeader;
+
+        memset(&indexHeader, 0, sizeof(indexHeader));
+
+        indexHeader.Signature  = DIO_CAPTURE_INDEX_SIGNATURE;
+        indexHeader.Version    = DIO_CAPTURE_VERSION;
+        indexHeader.HeaderSize = sizeof(DIO_CAPTURE_INDEX_HEADER);
+        indexHeader.EntrySize  = sizeof(DIO_CAPTURE_INDEX_ENTRY);
+        indexHeader.TickNs     = Config.TickNs;
+        indexHeader.StartTime  = Config.StartTime;
+
+        if (!IndexSink->Write(&indexHeader, sizeof(indexHeader))) {
+            IndexSink = nullptr;
+        }
+    }
+
+    return true;
+}
+
+//
+// Start a new block, whose first event is at Tick.  If the sink can give
+// us space in its own buffers, we encode the block right there.
+//
+void
+DioCaptureWriter::StartBlock(uint64_t Tick)
+{
+    uint8_t* block;
+
+    block = Sink->GetBuffer(sizeof(DIO_CAPTURE_BLOCK_HEADER) +
+                            Config.BlockPayloadBytes);
+
+    InSinkBuffer = block != nullptr;
+
+    if (!InSinkBuffer) {
+        block = Buffer;
+    }
+
+    Header  = reinterpret_cast<PDIO_CAPTURE_BLOCK_HEADER>(block);
+    Payload = block + sizeof(DIO_CAPTURE_BLOCK_HEADER);
+    Limit   = Payload + Config.BlockPayloadBytes - DIO_CAPTURE_MAX_EVENT_BYTES;
+
+    Header->Signature      = DIO_CAPTURE_BLOCK_SIGNATURE;
+    Header->PayloadLength  = 0;
+    Header->EventCount     = 0;
+    Header->Flags          = 0;
+    Header->FirstTimestamp = Tick * Config.TickNs;
+    Header->LastTimestamp  = Header->FirstTimestamp;
+    Header->InitialState   = LineState;
+    Header->PayloadCrc     = 0;
+
+    Next         = Payload;
+    PreviousTick = Tick;
+    BlockOpen    = true;
+
+    if (Config.MaxBlockDuration != 0) {
+        BlockEndTick = Tick + Config.MaxBlockDuration / Config.TickNs;
+    } else {
+        BlockEndTick = UINT64_MAX;
+    }
+}
+
+bool
+DioCaptureWriter::Append(const DIO_EVENT* Events,
+                         size_t           Count,
+                         uint32_t         Flags)
+{
+    return AppendEvents(Events, Count, Flags, false);
+}
+
+bool
+DioCaptureWriter::AppendTicks(const DIO_EVENT* Events,
+                              size_t           Count,
+                              uint32_t         Flags)
+{
+    return AppendEvents(Events, Count, Flags, true);
+}
+
+bool
+DioCaptureWriter::AppendEvents(const DIO_EVENT* Events,
+                               size_t           Count,
+                               uint32_t         Flags,
+                               bool             InTicks)
+{
+    uint64_t tick;
+    uint32_t changed;
+    uint64_t delta;
+
+    if (Failed || Buffer == nullptr) {
+        return false;
+    }
+
+    if (Count == 0) {
+        return true;
+    }
+
+    //
+    // The state of the lines before the very first event in the capture is
+    // that event's state with its changes undone.  After that we track the
+    // state ourselves, so what we store always reproduces each event's
+    // LineState exactly, even if the source lost events in between.
+    //
+    if (!HaveLineState) {
+
+        LineState     = Events[0].LineState ^ Events[0].ChangedLines;
+        HaveLineState = true;
+    }
+
+    for (size_t i = 0; i < Count; i++) {
+
+        tick = InTicks ? Events[i].Timestamp : Events[i].Timestamp / Config.TickNs;
+
+        if (BlockOpen && (Next > Limit || tick >= BlockEndTick)) {
+
+            if (!EndBlock()) {
+                return false;
+            }
+        }
+
+        if (!BlockOpen) {
+            StartBlock(tick);
+        }
+
+        Header->Flags |= Flags;
+        Flags          = 0;
+
+        //
+        // Timestamps should never go backwards.  If they do, store the
+        // event as simultaneous with the previous one.
+        //
+        if (tick > PreviousTick) {
+            delta        = tick - PreviousTick;
+            PreviousTick = tick;
+        } else {
+            delta = 0;
+        }
+
+        changed = Events[i].LineState ^ LineState;
+
+        if (changed != 0 && (changed & (changed - 1)) == 0) {
+
+            Next += DioCaptureEncodeVarint((delta << DIO_CAPTURE_CODE_BITS) |
+                                           DioCaptureLowestSetBit(changed),
+                                           Next);
+        } else {
+
+            Next += DioCaptureEncodeVarint((delta << DIO_CAPTURE_CODE_BITS) |
+                                           DIO_CAPTURE_CODE_MASK,
+                                           Next);
+
+            Next += DioCaptureEncodeVarint(changed,
+                                           Next);
+        }
+
+        LineState = Events[i].LineState;
+
+        Header->EventCount++;
+    }
+
+    TotalEvents += Count;
+
+    return true;
+}
+
+bool
+DioCaptureWriter::EndBlock()
+{
+    size_t length;
+
+    if (Failed || Buffer == nullptr) {
+        return false;
+    }
+
+    if (!BlockOpen) {
+        return true;
+    }
+
+    Header->LastTimestamp = PreviousTick * Config.TickNs;
+    Header->PayloadLength = (uint32_t)(Next - Payload);
+    Header->PayloadCrc    = DioCaptureCrc32(Payload, Header->PayloadLength);
+
+    length = sizeof(DIO_CAPTURE_BLOCK_HEADER) + Header->PayloadLength;
+
+    BlockOpen = false;
+
+    if (InSinkBuffer ? !Sink->CommitBuffer(length) : !Sink->Write(Buffer, length)) {
+
+        Failed = true;
+
+        return false;
+    }
+
+    //
+    // The index entry goes out only once its block has been written, so an
+    // index never points past the end of its capture.  Losing the index is
+    // not fatal to the capture (it can be rebuilt), so we stop maintaining
+    // it if a write fails.
+    //
+    if (IndexSink != nullptr) {
+        DIO_CAPTURE_INDEX_ENTRY entry;
+
+        entry.FirstTimestamp = Header->FirstTimestamp;
+        entry.LastTimestamp  = Header->LastTimestamp;
+        entry.Offset         = TotalBytes;
+        entry.InitialState   = Header->InitialState;
+        entry.EventCount     = Header->EventCount;
+
+        if (!IndexSink->Write(&entry, sizeof(entry))) {
+            IndexSink = nullptr;
+        }
+    }
+
+    TotalBytes += length;
+    TotalBlocks++;
+
+    return true;
+}
+
+bool
+DioCaptureWriter::Finish()
+{
+    if (!EndBlock()) {
+        return false;
+    }
+
+    if (IndexSink != nullptr) {
+        IndexSink->Flush();
+    }
+
+    return Sink->Flush();
+}
+
+bool
+DioCaptureWriter::Capture(DioEventSource& Source)
+{
+    DIO_EVENT events[CAPTURE_READ_EVENTS];
+    size_t    count;
+    uint64_t  overflows;
+    uint32_t  flags;
+
+    overflows = Source.OverflowCount();
+
+    while ((count = Source.Read(events, CAPTURE_READ_EVENTS)) != 0) {
+
+        //
+        // If the source lost events since we last looked, mark the block
+        // that will hold these events.
+        //
+        flags = 0;
+
+        if (Source.OverflowCount() != overflows) {
+
+            overflows = Source.OverflowCount();
+            flags     = DIO_CAPTURE_BLOCK_OVERFLOW;
+        }
+
+        if (!Append(events, count, flags)) {
+            return false;
+        }
+    }
+
+    return Finish();
+}
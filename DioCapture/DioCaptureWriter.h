@@ -0,0 +1,234 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioCaptureWriter.h -- Writes DIO capture files
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstdio>
+
+#include "DioCaptureFormat.h"
+
+typedef struct _DIO_CAPTURE_CONFIG {
+    uint32_t    TickNs;             // timestamps are stored in these units
+    uint32_t    BlockPayloadBytes;  // largest payload per block
+    uint64_t    MaxBlockDuration;   // ns; 0 for no limit
+    uint64_t    StartTime;          // see DIO_CAPTURE_FILE_HEADER
+} DIO_CAPTURE_CONFIG, *PDIO_CAPTURE_CONFIG;
+
+//
+// Reasonable defaults: nanosecond timestamps, 16KB blocks, and a new block
+// at least once a second (so that a live capture reaches the disk, and
+// can be indexed, at a reasonable granularity).  Smaller blocks make random
+// access faster, since a lookup decodes up to one whole block, at the cost
+// of a bigger index.
+//
+void DioCaptureDefaultConfig(PDIO_CAPTURE_CONFIG Config);
+
+//
+// DioCaptureSink
+//
+// Where a writer sends the bytes of the capture file.  Each complete block
+// (header and payload) is handed over in a single call to Write.
+//
+// A sink that has buffers of its own can avoid that copy by overriding
+// GetBuffer, which returns space for at least Length bytes (or nullptr to
+// have the writer use Write after all).  The writer builds the block in
+// that space and then calls CommitBuffer with the number of bytes it used.
+// Nothing else is called on the sink in between.
+//
+class DioCaptureSink
+{
+public:
+    virtual ~DioCaptureSink() = default;
+
+    virtual bool Write(const void* Data,
+                       size_t      Length) = 0;
+
+    virtual uint8_t* GetBuffer(size_t Length)
+    {
+        (void)Length;
+
+        return nullptr;
+    }
+
+    virtual bool CommitBuffer(size_t Length)
+    {
+        (void)Length;
+
+        return false;
+    }
+
+    virtual bool Flush()
+    {
+        return true;
+    }
+};
+
+//
+// DioCaptureFileSink
+//
+// Writes to a file using stdio.
+//
+class DioCaptureFileSink : public DioCaptureSink
+{
+public:
+    DioCaptureFileSink();
+    ~DioCaptureFileSink() override;
+
+    DioCaptureFileSink(const DioCaptureFileSink&) = delete;
+    DioCaptureFileSink& operator=(const DioCaptureFileSink&) = delete;
+
+    bool Open(const char* Path);
+
+    bool Write(const void* Data,
+               size_t      Length) override;
+
+    bool Flush() override;
+
+    void Close();
+
+private:
+    FILE* File;
+};
+
+//
+// DioCaptureWriter
+//
+// Encodes a stream of events into capture file blocks.  Events are encoded
+// directly into the block buffer, right behind the space reserved for the
+// block header, so a finished block goes to the sink without being copied.
+//
+class DioCaptureWriter
+{
+public:
+    DioCaptureWriter(DioCaptureSink*           Sink,
+                     const DIO_CAPTURE_CONFIG& Config);
+    ~DioCaptureWriter();
+
+    DioCaptureWriter(const DioCaptureWriter&) = delete;
+    DioCaptureWriter& operator=(const DioCaptureWriter&) = delete;
+
+    //
+    // Also write a sparse index (see DioCaptureFormat.h) to IndexSink.  Must
+    // be called before Begin.
+    //
+    void SetIndexSink(DioCaptureSink* IndexSink)
+    {
+        this->IndexSink = IndexSink;
+    }
+
+    //
+    // Writes the file header.  Must be called first.
+    //
+    bool Begin();
+
+    //
+    // Append events to the capture.  Flags (DIO_CAPTURE_BLOCK_xxx) are
+    // applied to the block that receives the first of these events.
+    //
+    bool Append(const DIO_EVENT* Events,
+                size_t           Count,
+                uint32_t         Flags);
+
+    //
+    // Same as Append, except that the Timestamps are already in ticks of
+    // the configured TickNs.  This lets events straight from the driver,
+    // whose timestamps are in performance counter ticks, be encoded
+    // without first being converted (and therefore copied).
+    //
+    bool AppendTicks(const DIO_EVENT* Events,
+                     size_t           Count,
+                     uint32_t         Flags);
+
+    //
+    // Write out the current block, even though it isn't full
+    //
+    bool EndBlock();
+
+    //
+    // Write out the current block and flush the sink
+    //
+    bool Finish();
+
+    //
+    // Write every event from Source to the capture, and then Finish it.
+    // Returns false if a write failed.
+    //
+    bool Capture(DioEventSource& Source);
+
+    uint64_t EventsWritten() const
+    {
+        return TotalEvents;
+    }
+
+    uint64_t BytesWritten() const
+    {
+        return TotalBytes;
+    }
+
+    uint64_t BlocksWritten() const
+    {
+        return TotalBlocks;
+    }
+
+private:
+    void StartBlock(uint64_t Tick);
+
+    bool AppendEvents(const DIO_EVENT* Events,
+                      size_t           Count,
+                      uint32_t         Flags,
+                      bool             InTicks);
+
+    DioCaptureSink*           Sink;
+    DioCaptureSink*           IndexSink;
+    DIO_CAPTURE_CONFIG        Config;
+    uint8_t*                  Buffer;
+    PDIO_CAPTURE_BLOCK_HEADER Header;
+    uint8_t*                  Payload;
+    uint8_t*                  Next;
+    uint8_t*                  Limit;
+    bool                      BlockOpen;
+    bool                      InSinkBuffer;
+    uint64_t                  PreviousTick;
+    uint64_t                  BlockEndTick;
+    uint32_t                  LineState;
+    bool                      HaveLineState;
+    bool                      Failed;
+    uint64_t                  TotalEvents;
+    uint64_t                  TotalBytes;
+    uint64_t                  TotalBlocks;
+};
@@ -0,0 +1,128 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioDecoder.cpp -- Streaming protocol decoder framework
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include "DioDecoder.h"
+
+//
+// Number of events DioDecodeSession::Run reads from its source at a time.
+// The buffer lives on the stack, so running a session never allocates.
+//
+constexpr size_t SESSION_READ_EVENTS = 256;
+
+DioDecodeSession::DioDecodeSession()
+    : Decoders(),
+      DecoderCount(0),
+      Primed(false),
+      LastEventTime(0)
+{
+}
+
+bool
+DioDecodeSession::AddDecoder(DioDecoder* Decoder)
+{
+    if (DecoderCount == DIO_MAX_DECODERS) {
+        return false;
+    }
+
+    Decoders[DecoderCount++] = Decoder;
+
+    return true;
+}
+
+void
+DioDecodeSession::Process(const DIO_EVENT* Events,
+                          size_t           Count)
+{
+    if (Count == 0) {
+        return;
+    }
+
+    //
+    // The state of the lines before the first event is the first event's
+    // state with its changes undone.
+    //
+    if (!Primed) {
+
+        for (size_t d = 0; d < DecoderCount; d++) {
+            Decoders[d]->Reset(Events[0].LineState ^ Events[0].ChangedLines);
+        }
+
+        Primed = true;
+    }
+
+    for (size_t i = 0; i < Count; i++) {
+
+        for (size_t d = 0; d < DecoderCount; d++) {
+            Decoders[d]->OnEvent(Events[i]);
+        }
+    }
+
+    LastEventTime = Events[Count - 1].Timestamp;
+}
+
+uint64_t
+DioDecodeSession::Run(DioEventSource& Source)
+{
+    DIO_EVENT events[SESSION_READ_EVENTS];
+    size_t    count;
+    uint64_t  total = 0;
+
+    while ((count = Source.Read(events, SESSION_READ_EVENTS)) != 0) {
+
+        Process(events,
+                count);
+
+        total += count;
+    }
+
+    //
+    // End of stream.  Nothing more will happen on any line, so anything
+    // still in progress that can be completed should be.
+    //
+    Flush(UINT64_MAX);
+
+    return total;
+}
+
+void
+DioDecodeSession::Flush(uint64_t Timestamp)
+{
+    for (size_t d = 0; d < DecoderCount; d++) {
+        Decoders[d]->Flush(Timestamp);
+    }
+}
@@ -0,0 +1,207 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioDecoder.h -- Streaming protocol decoder framework
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      A decoder watches a few of the DIO lines in a stream of change events
+//      and turns the transitions on those lines into protocol frames (UART
+//      characters, SPI words, I2C bytes and conditions).  Decoders are
+//      streaming: they see each event exactly once, in order, and keep only
+//      a few words of state.  Nothing in the per-event path allocates
+//      memory; frames are handed to a DioFrameSink as soon as they are
+//      complete.
+//
+//      A DioDecodeSession fans a single event stream out to any number (up
+//      to DIO_MAX_DECODERS) of decoders, so one pass over a capture can
+//      decode several buses at once.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "DioEvent.h"
+
+//
+// Used in decoder configurations for an optional line that isn't connected
+//
+constexpr uint32_t DIO_LINE_NONE = 0xFFFFFFFF;
+
+//
+// Maximum number of decoders in one DioDecodeSession
+//
+constexpr size_t DIO_MAX_DECODERS = 32;
+
+enum class DioFrameType : uint32_t {
+    UartCharacter,
+    SpiWord,
+    I2cStart,
+    I2cRepeatedStart,
+    I2cStop,
+    I2cAddress,
+    I2cData
+};
+
+//
+// Bit definitions for DIO_FRAME Flags
+//
+constexpr uint32_t DIO_FRAME_PARITY_ERROR   = 0x00000001;   // UART
+constexpr uint32_t DIO_FRAME_FRAMING_ERROR  = 0x00000002;   // UART
+constexpr uint32_t DIO_FRAME_INCOMPLETE     = 0x00000004;   // SPI
+constexpr uint32_t DIO_FRAME_NACK           = 0x00000008;   // I2C
+constexpr uint32_t DIO_FRAME_READ           = 0x00000010;   // I2C
+
+//
+// DIO_FRAME
+//
+// One decoded unit of protocol data.  Data holds the character, word or byte
+// (for an I2C address frame, the 7-bit address).  Aux holds the MISO word
+// for SPI frames, and is zero otherwise.  Channel is the value the decoder
+// was constructed with, so a sink shared by several decoders can tell their
+// frames apart.
+//
+typedef struct _DIO_FRAME {
+    uint64_t        StartTime;
+    uint64_t        EndTime;
+    DioFrameType    Type;
+    uint32_t        Channel;
+    uint32_t        Data;
+    uint32_t        Aux;
+    uint32_t        Flags;
+} DIO_FRAME, *PDIO_FRAME;
+
+class DioFrameSink
+{
+public:
+    virtual ~DioFrameSink() = default;
+
+    virtual void OnFrame(const DIO_FRAME& Frame) = 0;
+};
+
+//
+// DioDecoder
+//
+// Base class for all protocol decoders.
+//
+//  Reset       Called with the line state in effect before the first event
+//              the decoder will see.  Discards any partially decoded frame.
+//
+//  OnEvent     Called for every event in the stream, in timestamp order.
+//              Decoders ignore events that don't change the lines they
+//              watch.
+//
+//  Flush       Called when no further events will arrive before Timestamp
+//              (at the end of a stream, or periodically on a live stream).
+//              Decoders whose frames end without a final transition, such
+//              as UART, complete any frame that has finished by then.
+//
+class DioDecoder
+{
+public:
+    DioDecoder(DioFrameSink* Sink,
+               uint32_t      Channel)
+        : Sink(Sink),
+          Channel(Channel)
+    {
+    }
+
+    virtual ~DioDecoder() = default;
+
+    virtual void Reset(uint32_t LineState) = 0;
+
+    virtual void OnEvent(const DIO_EVENT& Event) = 0;
+
+    virtual void Flush(uint64_t Timestamp)
+    {
+        (void)Timestamp;
+    }
+
+protected:
+    void Emit(DIO_FRAME& Frame)
+    {
+        Frame.Channel = Channel;
+
+        Sink->OnFrame(Frame);
+    }
+
+    static uint32_t LineLevel(uint32_t LineState,
+                              uint32_t Line)
+    {
+        return (LineState >> Line) & 1;
+    }
+
+private:
+    DioFrameSink* Sink;
+    uint32_t      Channel;
+};
+
+//
+// DioDecodeSession
+//
+// Feeds one event stream to a set of decoders.  The decoders are owned by
+// the caller and must outlive the session.
+//
+class DioDecodeSession
+{
+public:
+    DioDecodeSession();
+
+    bool AddDecoder(DioDecoder* Decoder);
+
+    //
+    // Process a block of events
+    //
+    void Process(const DIO_EVENT* Events,
+                 size_t           Count);
+
+    //
+    // Pump every event from Source through the decoders, and flush them
+    // at the end of the stream.  Returns the number of events processed.
+    //
+    uint64_t Run(DioEventSource& Source);
+
+    void Flush(uint64_t Timestamp);
+
+    uint64_t LastTimestamp() const
+    {
+        return LastEventTime;
+    }
+
+private:
+    DioDecoder* Decoders[DIO_MAX_DECODERS];
+    size_t      DecoderCount;
+    bool        Primed;
+    uint64_t    LastEventTime;
+};
@@ -0,0 +1,155 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioEvent.h -- Timestamped DIO change events, and the sources that
+//                      produce streams of them.
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      Everything in the DioCapture library is plain, portable, C++ so that
+//      captures can be decoded and analyzed offline on any host (including
+//      Linux).  Only the live event source, which talks to the driver, is
+//      Windows-specific.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+//
+// DIO_EVENT
+//
+// One change of state on the DIO lines.  LineState is the state of all 32
+// lines as latched when the change occurred, and ChangedLines is a bitmap of
+// the lines that differ from the previous event.  Timestamps are always in
+// nanoseconds, regardless of where the event came from.
+//
+typedef struct _DIO_EVENT {
+    uint64_t    Timestamp;
+    uint32_t    LineState;
+    uint32_t    ChangedLines;
+} DIO_EVENT, *PDIO_EVENT;
+
+//
+// DioEventSource
+//
+// Anything that can produce a stream of events: the driver, a capture file,
+// a synthetic generator.  Read fills in up to Count events and returns the
+// number actually returned.  A return of zero means the stream has ended.
+//
+// OverflowCount returns the number of times the source has found that
+// events were lost (for example, because the driver's ring filled).  A
+// consumer that sees it change knows there is a gap in the stream.
+//
+class DioEventSource
+{
+public:
+    virtual ~DioEventSource() = default;
+
+    virtual size_t Read(PDIO_EVENT Events,
+                        size_t     Count) = 0;
+
+    virtual uint64_t OverflowCount() const
+    {
+        return 0;
+    }
+};
+
+//
+// DioArrayEventSource
+//
+// Returns the events from a caller-supplied array.  Handy for replaying
+// recorded or synthetic streams that are already in memory.
+//
+class DioArrayEventSource : public DioEventSource
+{
+public:
+    DioArrayEventSource(const DIO_EVENT* Events,
+                        size_t           Count);
+
+    size_t Read(PDIO_EVENT Events,
+                size_t     Count) override;
+
+    void Rewind()
+    {
+        Position = 0;
+    }
+
+private:
+    const DIO_EVENT* Array;
+    size_t           ArrayCount;
+    size_t           Position;
+};
+
+#ifdef _WIN32
+
+//
+// DioLiveEventSource
+//
+// Returns events from the OsrDio driver, using IOCTL_OSRDIO_READ_EVENTS.
+// Read blocks until the driver has at least one event to return.  The
+// driver's performance counter timestamps are converted to nanoseconds.
+//
+class DioLiveEventSource : public DioEventSource
+{
+public:
+    DioLiveEventSource();
+    ~DioLiveEventSource() override;
+
+    DioLiveEventSource(const DioLiveEventSource&) = delete;
+    DioLiveEventSource& operator=(const DioLiveEventSource&) = delete;
+
+    bool Open();
+
+    size_t Read(PDIO_EVENT Events,
+                size_t     Count) override;
+
+    //
+    // Number of batches the driver flagged as having lost events
+    //
+    uint64_t OverflowCount() const override
+    {
+        return Overflows;
+    }
+
+private:
+    void*    DeviceHandle;
+    uint8_t* BatchBuffer;
+    size_t   BatchBufferLength;
+    uint64_t Overflows;
+};
+
+#endif
@@ -0,0 +1,417 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioEventRing.cpp -- Event ring consumers, and the driver's
+//                            event ring
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include "DioEventRing.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <cstdlib>
+#include <cstring>
+#include "../inc/OsrDio_IOCTL.h"
+
+//
+// The ring we share with the driver must look exactly like the driver's
+//
+static_assert(sizeof(OSRDIO_EVENT) == sizeof(DIO_EVENT) &&
+              offsetof(OSRDIO_EVENT_RING, ProducerIndex) == offsetof(DIO_EVENT_RING, ProducerIndex) &&
+              offsetof(OSRDIO_EVENT_RING, OverflowCount) == offsetof(DIO_EVENT_RING, OverflowCount) &&
+              offsetof(OSRDIO_EVENT_RING, ConsumerIndex) == offsetof(DIO_EVENT_RING, ConsumerIndex) &&
+              offsetof(OSRDIO_EVENT_RING, Events) == offsetof(DIO_EVENT_RING, Events),
+              "DIO_EVENT_RING must match OSRDIO_EVENT_RING");
+#endif
+
+DioRingEventSource::DioRingEventSource(DioEventRingSource* Source)
+    : Source(Source)
+{
+}
+
+size_t
+DioRingEventSource::Read(PDIO_EVENT Events,
+                         size_t     Count)
+{
+    PDIO_EVENT_RING ring;
+    uint32_t        producer;
+    uint32_t        consumer;
+    size_t          toCopy;
+
+    ring = Source->Ring();
+
+    if (ring == nullptr || Count == 0) {
+        return 0;
+    }
+
+    consumer = ring->ConsumerIndex.load(std::memory_order_relaxed);
+
+    while (true) {
+
+        producer = ring->ProducerIndex.load(std::memory_order_acquire);
+
+        if (producer != consumer) {
+            break;
+        }
+
+        //
+        // The ring might have been filled for the last time just before
+        // the source finished, so look once more before giving up.
+        //
+        if (!Source->Wait(100) && Source->Finished()) {
+
+            if (ring->ProducerIndex.load(std::memory_order_acquire) == consumer) {
+                return 0;
+            }
+        }
+    }
+
+    toCopy = producer - consumer;
+
+    if (toCopy > Count) {
+        toCopy = Count;
+    }
+
+    for (size_t i = 0; i < toCopy; i++) {
+
+        const DIO_EVENT& in = ring->Events[(consumer + i) & (ring->Capacity - 1)];
+
+        Events[i].Timestamp    = DioTicksToNs(in.Timestamp,
+                                              ring->TimestampFrequency);
+        Events[i].LineState    = in.LineState;
+        Events[i].ChangedLines = in.ChangedLines;
+    }
+
+    ring->ConsumerIndex.store(consumer + static_cast<uint32_t>(toCopy),
+                              std::memory_order_release);
+
+    return toCopy;
+}
+
+uint64_t
+DioRingEventSource::OverflowCount() const
+{
+    PDIO_EVENT_RING ring;
+
+    ring = Source->Ring();
+
+    return ring != nullptr ? ring->OverflowCount.load(std::memory_order_relaxed) : 0;
+}
+
+#ifdef _WIN32
+
+DioLiveEventRing::DioLiveEventRing()
+    : DeviceHandle(INVALID_HANDLE_VALUE),
+      AttachEvent(nullptr),
+      WaitEvent(nullptr),
+      ControlEvent(nullptr),
+      AttachOverlapped(nullptr),
+      WaitOverlapped(nullptr),
+      AttachPending(false),
+      WaitPending(false),
+      Detached(true),
+      RingBuffer(nullptr),
+      RingLength(0)
+{
+}
+
+DioLiveEventRing::~DioLiveEventRing()
+{
+    Close();
+}
+
+bool
+DioLiveEventRing::Open(uint32_t Capacity)
+{
+    LPOVERLAPPED attach;
+
+    Close();
+
+    //
+    // Page aligned (and therefore cache line aligned) memory for the ring,
+    // which the driver locks down while it's attached
+    //
+    RingLength = DioEventRingSize(Capacity);
+
+    RingBuffer = static_cast<PDIO_EVENT_RING>(VirtualAlloc(nullptr,
+                                                           RingLength,
+                                                           MEM_COMMIT | MEM_RESERVE,
+                                                           PAGE_READWRITE));
+
+    AttachOverlapped = calloc(1, sizeof(OVERLAPPED));
+    WaitOverlapped   = calloc(1, sizeof(OVERLAPPED));
+    AttachEvent      = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    WaitEvent        = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    ControlEvent     = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+    if (RingBuffer == nullptr || AttachOverlapped == nullptr ||
+        WaitOverlapped == nullptr || AttachEvent == nullptr ||
+        WaitEvent == nullptr || ControlEvent == nullptr) {
+        goto failed;
+    }
+
+    DeviceHandle = CreateFile(LR"(\\.\OSRDIO)",
+                              GENERIC_READ | GENERIC_WRITE,
+                              0,
+                              nullptr,
+                              OPEN_EXISTING,
+                              FILE_FLAG_OVERLAPPED,
+                              nullptr);
+
+    if (DeviceHandle == INVALID_HANDLE_VALUE) {
+        goto failed;
+    }
+
+    attach         = static_cast<LPOVERLAPPED>(AttachOverlapped);
+    attach->hEvent = AttachEvent;
+
+    //
+    // The ATTACH Request stays pending for as long as the ring is attached.
+    // If it completes right away, the driver refused the ring.
+    //
+    if (DeviceIoControl(DeviceHandle,
+                        IOCTL_OSRDIO_ATTACH_EVENT_RING,
+                        nullptr,
+                        0,
+                        RingBuffer,
+                        static_cast<DWORD>(RingLength),
+                        nullptr,
+                        attach) ||
+        GetLastError() != ERROR_IO_PENDING) {
+        goto failed;
+    }
+
+    AttachPending = true;
+    Detached      = false;
+
+    return true;
+
+failed:
+
+    Close();
+
+    return false;
+}
+
+void
+DioLiveEventRing::Close()
+{
+    DWORD bytes;
+
+    if (DeviceHandle != INVALID_HANDLE_VALUE) {
+
+        //
+        // Detach the ring, and wait until the driver is done with it before
+        // we free it.
+        //
+        if (WaitPending) {
+
+            CancelIoEx(DeviceHandle,
+                       static_cast<LPOVERLAPPED>(WaitOverlapped));
+
+            GetOverlappedResult(DeviceHandle,
+                                static_cast<LPOVERLAPPED>(WaitOverlapped),
+                                &bytes,
+                                TRUE);
+        }
+
+        if (AttachPending) {
+
+            CancelIoEx(DeviceHandle,
+                       static_cast<LPOVERLAPPED>(AttachOverlapped));
+
+            GetOverlappedResult(DeviceHandle,
+                                static_cast<LPOVERLAPPED>(AttachOverlapped),
+                                &bytes,
+                                TRUE);
+        }
+
+        CloseHandle(DeviceHandle);
+
+        DeviceHandle = INVALID_HANDLE_VALUE;
+    }
+
+    if (AttachEvent != nullptr) {
+        CloseHandle(AttachEvent);
+    }
+
+    if (WaitEvent != nullptr) {
+        CloseHandle(WaitEvent);
+    }
+
+    if (ControlEvent != nullptr) {
+        CloseHandle(ControlEvent);
+    }
+
+    if (RingBuffer != nullptr) {
+        VirtualFree(RingBuffer,
+                    0,
+                    MEM_RELEASE);
+    }
+
+    free(AttachOverlapped);
+    free(WaitOverlapped);
+
+    AttachEvent      = nullptr;
+    WaitEvent        = nullptr;
+    ControlEvent     = nullptr;
+    AttachOverlapped = nullptr;
+    WaitOverlapped   = nullptr;
+    RingBuffer       = nullptr;
+    AttachPending    = false;
+    WaitPending      = false;
+    Detached         = true;
+}
+
+uint64_t
+DioLiveEventRing::CurrentTimestamp() const
+{
+    LARGE_INTEGER now;
+
+    //
+    // The driver timestamps events with the performance counter
+    //
+    QueryPerformanceCounter(&now);
+
+    return static_cast<uint64_t>(now.QuadPart);
+}
+
+bool
+DioLiveEventRing::Control(uint32_t    IoControlCode,
+                          const void* Input,
+                          uint32_t    InputLength,
+                          void*       Output,
+                          uint32_t    OutputLength)
+{
+    OVERLAPPED overlapped;
+    DWORD      bytes;
+
+    if (DeviceHandle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    memset(&overlapped, 0, sizeof(overlapped));
+
+    overlapped.hEvent = ControlEvent;
+
+    ResetEvent(ControlEvent);
+
+    //
+    // The handle is opened for overlapped I/O, so we have to supply an
+    // OVERLAPPED even to wait for the result right away
+    //
+    if (!DeviceIoControl(DeviceHandle,
+                         IoControlCode,
+                         const_cast<void*>(Input),
+                         InputLength,
+                         Output,
+                         OutputLength,
+                         nullptr,
+                         &overlapped) &&
+        GetLastError() != ERROR_IO_PENDING) {
+        return false;
+    }
+
+    return GetOverlappedResult(DeviceHandle,
+                               &overlapped,
+                               &bytes,
+                               TRUE) != FALSE;
+}
+
+bool
+DioLiveEventRing::Wait(uint32_t TimeoutMs)
+{
+    LPOVERLAPPED wait;
+    DWORD        bytes;
+
+    if (Detached) {
+        return false;
+    }
+
+    wait = static_cast<LPOVERLAPPED>(WaitOverlapped);
+
+    //
+    // A WAIT Request that timed out last time is still outstanding, and is
+    // just as good as a new one.
+    //
+    if (!WaitPending) {
+
+        ResetEvent(WaitEvent);
+
+        memset(wait, 0, sizeof(OVERLAPPED));
+
+        wait->hEvent = WaitEvent;
+
+        if (!DeviceIoControl(DeviceHandle,
+                             IOCTL_OSRDIO_WAIT_EVENT_RING,
+                             nullptr,
+                             0,
+                             nullptr,
+                             0,
+                             nullptr,
+                             wait) &&
+            GetLastError() != ERROR_IO_PENDING) {
+
+            Detached = true;
+
+            return false;
+        }
+
+        WaitPending = true;
+    }
+
+    if (WaitForSingleObject(WaitEvent, TimeoutMs) != WAIT_OBJECT_0) {
+        return false;
+    }
+
+    WaitPending = false;
+
+    if (!GetOverlappedResult(DeviceHandle,
+                             wait,
+                             &bytes,
+                             FALSE)) {
+
+        //
+        // The driver fails WAITs once the ring has been detached
+        //
+        Detached = true;
+
+        return false;
+    }
+
+    return true;
+}
+
+#endif
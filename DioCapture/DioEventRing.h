@@ -0,0 +1,228 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioEventRing.h -- Rings of events shared between a producer
+//                          and a consumer without copying
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      The layout of DIO_EVENT_RING is identical to the driver's
+//      OSRDIO_EVENT_RING (see OsrDio_IOCTL.h), so code that consumes events
+//      in place works the same on a ring attached to the real device as on
+//      one filled by the simulator.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "DioEvent.h"
+
+//
+// DIO_EVENT_RING
+//
+// A single-producer, single-consumer ring of events.  ProducerIndex and
+// ConsumerIndex are free-running counts; the event at index i is
+// Events[i & (Capacity - 1)].  The producer stores events and then
+// publishes ProducerIndex; the consumer uses the events below it in place
+// and then publishes ConsumerIndex to give their slots back.  Events the
+// producer can't store because the ring is full are counted in
+// OverflowCount.
+//
+// Timestamps are in ticks of TimestampFrequency (ticks per second), as the
+// driver stores them.
+//
+typedef struct _DIO_EVENT_RING {
+    uint64_t                TimestampFrequency;
+    uint32_t                Capacity;
+    uint32_t                Reserved;
+    uint8_t                 Pad0[48];
+
+    std::atomic<uint32_t>   ProducerIndex;
+    std::atomic<uint32_t>   OverflowCount;
+    uint8_t                 Pad1[56];
+
+    std::atomic<uint32_t>   ConsumerIndex;
+    uint8_t                 Pad2[60];
+
+    DIO_EVENT               Events[1];
+} DIO_EVENT_RING, *PDIO_EVENT_RING;
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "ring indices must be plain 32-bit values");
+
+static_assert(offsetof(DIO_EVENT_RING, ProducerIndex) == 64 &&
+              offsetof(DIO_EVENT_RING, ConsumerIndex) == 128 &&
+              offsetof(DIO_EVENT_RING, Events) == 192,
+              "DIO_EVENT_RING layout must match OSRDIO_EVENT_RING");
+
+//
+// Bytes needed for a ring of Count events
+//
+constexpr size_t
+DioEventRingSize(size_t Count)
+{
+    return offsetof(DIO_EVENT_RING, Events) + Count * sizeof(DIO_EVENT);
+}
+
+//
+// DioEventRingSource
+//
+// Anything that fills a DIO_EVENT_RING: the driver or the simulator.  The
+// consumer uses Ring() directly, and calls Wait when it finds the ring
+// empty.  Wait returns true when there are events in the ring (or might
+// be; the consumer just looks again), and false if it timed out or the
+// ring will never get any more events.  Finished tells which.
+//
+// CurrentTimestamp returns the time now, in the ring's ticks, so the
+// consumer can relate event timestamps to the wall clock.
+//
+class DioEventRingSource
+{
+public:
+    virtual ~DioEventRingSource() = default;
+
+    virtual PDIO_EVENT_RING Ring() = 0;
+
+    virtual bool Wait(uint32_t TimeoutMs) = 0;
+
+    virtual bool Finished() const = 0;
+
+    virtual uint64_t CurrentTimestamp() const = 0;
+};
+
+//
+// DioRingEventSource
+//
+// Reads the events in a ring as an ordinary DioEventSource, converting
+// their timestamps to nanoseconds.  This copies every event, so it's for
+// consumers that want the convenience, not the speed.  Read waits for
+// events and returns zero once the ring source is Finished.
+//
+class DioRingEventSource : public DioEventSource
+{
+public:
+    explicit DioRingEventSource(DioEventRingSource* Source);
+
+    size_t Read(PDIO_EVENT Events,
+                size_t     Count) override;
+
+    uint64_t OverflowCount() const override;
+
+private:
+    DioEventRingSource* Source;
+};
+
+//
+// Converts a timestamp in ticks of Frequency to nanoseconds, without
+// overflowing on counters that have been running for a while.
+//
+inline uint64_t
+DioTicksToNs(uint64_t Ticks,
+             uint64_t Frequency)
+{
+    return (Ticks / Frequency) * 1000000000ULL +
+           ((Ticks % Frequency) * 1000000000ULL) / Frequency;
+}
+
+#ifdef _WIN32
+
+//
+// DioLiveEventRing
+//
+// A ring attached to the OsrDio driver with IOCTL_OSRDIO_ATTACH_EVENT_RING,
+// which the driver's ISR fills directly.  Wait uses
+// IOCTL_OSRDIO_WAIT_EVENT_RING.  The ring is detached by Close (or the
+// destructor).
+//
+class DioLiveEventRing : public DioEventRingSource
+{
+public:
+    DioLiveEventRing();
+    ~DioLiveEventRing() override;
+
+    DioLiveEventRing(const DioLiveEventRing&) = delete;
+    DioLiveEventRing& operator=(const DioLiveEventRing&) = delete;
+
+    //
+    // Capacity is in events, and is rounded down to a power of two by the
+    // driver.
+    //
+    bool Open(uint32_t Capacity);
+
+    void Close();
+
+    PDIO_EVENT_RING Ring() override
+    {
+        return RingBuffer;
+    }
+
+    bool Wait(uint32_t TimeoutMs) override;
+
+    bool Finished() const override
+    {
+        return Detached;
+    }
+
+    uint64_t CurrentTimestamp() const override;
+
+    //
+    // Send another IOCTL (such as IOCTL_OSRDIO_WRITE) on the handle the
+    // ring is attached with, and wait for it to complete.  Call it from
+    // one thread at a time.
+    //
+    bool Control(uint32_t    IoControlCode,
+                 const void* Input,
+                 uint32_t    InputLength,
+                 void*       Output,
+                 uint32_t    OutputLength);
+
+private:
+    void*           DeviceHandle;
+    void*           AttachEvent;
+    void*           WaitEvent;
+    void*           ControlEvent;
+    void*           AttachOverlapped;
+    void*           WaitOverlapped;
+    bool            AttachPending;
+    bool            WaitPending;
+    bool            Detached;
+    PDIO_EVENT_RING RingBuffer;
+    size_t          RingLength;
+};
+
+#endif
@@ -0,0 +1,185 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioEventSource.cpp -- Event sources for the DioCapture library
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include "DioEvent.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <cstdlib>
+#include "../inc/OsrDio_IOCTL.h"
+#endif
+
+DioArrayEventSource::DioArrayEventSource(const DIO_EVENT* Events,
+                                         size_t           Count)
+    : Array(Events),
+      ArrayCount(Count),
+      Position(0)
+{
+}
+
+size_t
+DioArrayEventSource::Read(PDIO_EVENT Events,
+                          size_t     Count)
+{
+    size_t toCopy;
+
+    toCopy = ArrayCount - Position;
+
+    if (toCopy > Count) {
+        toCopy = Count;
+    }
+
+    for (size_t i = 0; i < toCopy; i++) {
+        Events[i] = Array[Position + i];
+    }
+
+    Position += toCopy;
+
+    return toCopy;
+}
+
+#ifdef _WIN32
+
+//
+// Number of events we ask the driver for in each IOCTL_OSRDIO_READ_EVENTS.
+// This matches the size of the driver's event ring, so one Request can
+// always drain it completely.
+//
+constexpr size_t LIVE_BATCH_EVENTS = 256;
+
+DioLiveEventSource::DioLiveEventSource()
+    : DeviceHandle(INVALID_HANDLE_VALUE),
+      BatchBuffer(nullptr),
+      BatchBufferLength(OSRDIO_EVENT_BATCH_SIZE(LIVE_BATCH_EVENTS)),
+      Overflows(0)
+{
+}
+
+DioLiveEventSource::~DioLiveEventSource()
+{
+    if (DeviceHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(DeviceHandle);
+    }
+
+    free(BatchBuffer);
+}
+
+bool
+DioLiveEventSource::Open()
+{
+    BatchBuffer = static_cast<uint8_t*>(malloc(BatchBufferLength));
+
+    if (BatchBuffer == nullptr) {
+        return false;
+    }
+
+    DeviceHandle = CreateFile(LR"(\\.\OSRDIO)",
+                              GENERIC_READ | GENERIC_WRITE,
+                              0,
+                              nullptr,
+                              OPEN_EXISTING,
+                              0,
+                              nullptr);
+
+    return DeviceHandle != INVALID_HANDLE_VALUE;
+}
+
+size_t
+DioLiveEventSource::Read(PDIO_EVENT Events,
+                         size_t     Count)
+{
+    POSRDIO_EVENT_BATCH batch;
+    DWORD               bytesRead;
+    DWORD               requestLength;
+    size_t              toReturn;
+
+    if (Count == 0) {
+        return 0;
+    }
+
+    //
+    // Never ask the driver for more events than the caller can take
+    //
+    if (Count > LIVE_BATCH_EVENTS) {
+        Count = LIVE_BATCH_EVENTS;
+    }
+
+    requestLength = (DWORD)OSRDIO_EVENT_BATCH_SIZE(Count);
+
+    batch = reinterpret_cast<POSRDIO_EVENT_BATCH>(BatchBuffer);
+
+    if (!DeviceIoControl(DeviceHandle,
+                         IOCTL_OSRDIO_READ_EVENTS,
+                         nullptr,
+                         0,
+                         batch,
+                         requestLength,
+                         &bytesRead,
+                         nullptr)) {
+
+        //
+        // Treat any failure as the end of the stream
+        //
+        return 0;
+    }
+
+    if ((batch->Flags & OSRDIO_BATCH_FLAG_OVERFLOW) != 0) {
+        Overflows++;
+    }
+
+    toReturn = batch->EventCount;
+
+    for (size_t i = 0; i < toReturn; i++) {
+        const OSRDIO_EVENT& in = batch->Events[i];
+
+        //
+        // Convert performance counter ticks to nanoseconds, without
+        // overflowing on counters that have been running for a while.
+        //
+        Events[i].Timestamp = (in.Timestamp / batch->TimestampFrequency) * 1000000000ULL +
+                              ((in.Timestamp % batch->TimestampFrequency) * 1000000000ULL) /
+                              batch->TimestampFrequency;
+
+        Events[i].LineState    = in.LatchedLineState;
+        Events[i].ChangedLines = in.ChangedLines;
+    }
+
+    return toReturn;
+}
+
+#endif
@@ -0,0 +1,192 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioI2cDecoder.cpp -- I2C bus decoder
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include "DioI2cDecoder.h"
+
+DioI2cDecoder::DioI2cDecoder(const DIO_I2C_CONFIG& Config,
+                             DioFrameSink*         Sink,
+                             uint32_t              Channel)
+    : DioDecoder(Sink, Channel),
+      Config(Config),
+      Scl(1),
+      Sda(1),
+      InTransfer(false),
+      AddressNext(false),
+      BitCount(0),
+      Byte(0),
+      ByteStart(0)
+{
+}
+
+void
+DioI2cDecoder::Reset(uint32_t LineState)
+{
+    Scl        = LineLevel(LineState, Config.SclLine);
+    Sda        = LineLevel(LineState, Config.SdaLine);
+    InTransfer = false;
+    BitCount   = 0;
+    Byte       = 0;
+}
+
+void
+DioI2cDecoder::OnEvent(const DIO_EVENT& Event)
+{
+    uint32_t scl;
+    uint32_t sda;
+
+    scl = LineLevel(Event.LineState, Config.SclLine);
+    sda = LineLevel(Event.LineState, Config.SdaLine);
+
+    if (scl != Scl) {
+
+        Scl = scl;
+        Sda = sda;
+
+        if (scl == 1 && InTransfer) {
+            ClockRising(Event.Timestamp);
+        }
+
+        return;
+    }
+
+    if (sda == Sda) {
+        return;
+    }
+
+    Sda = sda;
+
+    //
+    // SDA changing while SCL is low is just data setup
+    //
+    if (Scl == 0) {
+        return;
+    }
+
+    if (sda == 0) {
+
+        //
+        // SDA falling while SCL is high: START
+        //
+        EmitCondition(InTransfer ? DioFrameType::I2cRepeatedStart :
+                                   DioFrameType::I2cStart,
+                      Event.Timestamp);
+
+        InTransfer  = true;
+        AddressNext = true;
+        BitCount    = 0;
+        Byte        = 0;
+
+    } else {
+
+        //
+        // SDA rising while SCL is high: STOP
+        //
+        EmitCondition(DioFrameType::I2cStop,
+                      Event.Timestamp);
+
+        InTransfer = false;
+    }
+}
+
+void
+DioI2cDecoder::ClockRising(uint64_t Timestamp)
+{
+    DIO_FRAME frame;
+
+    if (BitCount == 0) {
+        ByteStart = Timestamp;
+    }
+
+    //
+    // Eight data bits, MSB first...
+    //
+    if (BitCount < 8) {
+
+        Byte = (Byte << 1) | Sda;
+        BitCount++;
+
+        return;
+    }
+
+    //
+    // ... and then the ninth clock carries the ACK (SDA low) from the
+    // receiver.
+    //
+    frame.StartTime = ByteStart;
+    frame.EndTime   = Timestamp;
+    frame.Aux       = 0;
+    frame.Flags     = (Sda != 0) ? DIO_FRAME_NACK : 0;
+
+    if (AddressNext) {
+
+        frame.Type = DioFrameType::I2cAddress;
+        frame.Data = Byte >> 1;
+
+        if ((Byte & 1) != 0) {
+            frame.Flags |= DIO_FRAME_READ;
+        }
+
+        AddressNext = false;
+
+    } else {
+
+        frame.Type = DioFrameType::I2cData;
+        frame.Data = Byte;
+    }
+
+    Emit(frame);
+
+    BitCount = 0;
+    Byte     = 0;
+}
+
+void
+DioI2cDecoder::EmitCondition(DioFrameType Type,
+                             uint64_t     Timestamp)
+{
+    DIO_FRAME frame;
+
+    frame.StartTime = Timestamp;
+    frame.EndTime   = Timestamp;
+    frame.Type      = Type;
+    frame.Data      = 0;
+    frame.Aux       = 0;
+    frame.Flags     = 0;
+
+    Emit(frame);
+}
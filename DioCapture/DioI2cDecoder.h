@@ -0,0 +1,86 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioI2cDecoder.h -- I2C bus decoder
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "DioDecoder.h"
+
+typedef struct _DIO_I2C_CONFIG {
+    uint32_t    SclLine;
+    uint32_t    SdaLine;
+} DIO_I2C_CONFIG, *PDIO_I2C_CONFIG;
+
+//
+// DioI2cDecoder
+//
+// Decodes one I2C bus (7-bit addressing).  Reports START, repeated START and
+// STOP conditions, the address byte following each START (with the R/W bit
+// in DIO_FRAME_READ) and each data byte.  A byte that was not acknowledged
+// is reported with DIO_FRAME_NACK.
+//
+// If SCL and SDA change in the same event, we take SDA to have changed while
+// SCL was low.  That is, on a rising SCL the new SDA is sampled and on a
+// falling SCL the SDA change is treated as ordinary data setup; in neither
+// case is it taken for a START or STOP.
+//
+class DioI2cDecoder : public DioDecoder
+{
+public:
+    DioI2cDecoder(const DIO_I2C_CONFIG& Config,
+                  DioFrameSink*         Sink,
+                  uint32_t              Channel);
+
+    void Reset(uint32_t LineState) override;
+
+    void OnEvent(const DIO_EVENT& Event) override;
+
+private:
+    void EmitCondition(DioFrameType Type,
+                       uint64_t     Timestamp);
+
+    void ClockRising(uint64_t Timestamp);
+
+    DIO_I2C_CONFIG  Config;
+    uint32_t        Scl;
+    uint32_t        Sda;
+    bool            InTransfer;
+    bool            AddressNext;
+    uint32_t        BitCount;
+    uint32_t        Byte;
+    uint64_t        ByteStart;
+};
@@ -0,0 +1,540 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioLineStats.cpp -- Per-line statistics over event streams
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#include "DioCaptureFormat.h"
+#include "DioLineStats.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DIO_LINE_STATS_AVX2 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#define AVX2_FUNCTION
+#else
+#include <cpuid.h>
+#include <immintrin.h>
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+#endif
+
+//
+// Number of events DioLineAnalyzer transposes at a time.  A multiple of 64.
+//
+constexpr size_t ANALYZER_CHUNK_EVENTS = 4096;
+constexpr size_t ANALYZER_PLANE_WORDS  = ANALYZER_CHUNK_EVENTS / 64;
+
+//
+// Number of events DioLineAnalyzer::Analyze reads from its source at a time
+//
+constexpr size_t ANALYZER_READ_EVENTS = 1024;
+
+static inline uint32_t
+PopCount64(uint64_t Value)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    return (uint32_t)__popcnt64(Value);
+#elif defined(_MSC_VER)
+    return (uint32_t)(__popcnt((uint32_t)Value) + __popcnt((uint32_t)(Value >> 32)));
+#else
+    return (uint32_t)__builtin_popcountll(Value);
+#endif
+}
+
+static inline uint32_t
+TrailingZeros64(uint64_t Value)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+
+    _BitScanForward64(&index, Value);
+
+    return index;
+#elif defined(_MSC_VER)
+    unsigned long index;
+
+    if (_BitScanForward(&index, (uint32_t)Value)) {
+        return index;
+    }
+
+    _BitScanForward(&index, (uint32_t)(Value >> 32));
+
+    return index + 32;
+#else
+    return (uint32_t)__builtin_ctzll(Value);
+#endif
+}
+
+static inline uint32_t
+LeadingZeros64(uint64_t Value)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+
+    if (!_BitScanReverse64(&index, Value)) {
+        return 64;
+    }
+
+    return 63 - index;
+#elif defined(_MSC_VER)
+    unsigned long index;
+
+    if (_BitScanReverse(&index, (uint32_t)(Value >> 32))) {
+        return 31 - index;
+    }
+
+    if (_BitScanReverse(&index, (uint32_t)Value)) {
+        return 63 - index;
+    }
+
+    return 64;
+#else
+    return Value != 0 ? (uint32_t)__builtin_clzll(Value) : 64;
+#endif
+}
+
+//
+// The portable transpose.  Rather than testing all 32 bits of every word,
+// we visit only the bits that are set, which makes this reasonably quick
+// for the sparse words we usually see (most events change a single line).
+//
+static void
+TransposeScalar(const uint32_t* Words,
+                size_t          Count,
+                uint64_t*       Planes,
+                size_t          PlaneWords,
+                size_t          Start)
+{
+    uint32_t word;
+    uint32_t line;
+
+    for (uint32_t plane = 0; plane < 32; plane++) {
+
+        memset(Planes + plane * PlaneWords + Start / 64,
+               0,
+               (PlaneWords - Start / 64) * sizeof(uint64_t));
+    }
+
+    for (size_t i = Start; i < Count; i++) {
+
+        word = Words[i];
+
+        while (word != 0) {
+
+            line  = DioCaptureLowestSetBit(word);
+            word &= word - 1;
+
+            Planes[line * PlaneWords + i / 64] |= 1ULL << (i % 64);
+        }
+    }
+}
+
+#ifdef DIO_LINE_STATS_AVX2
+
+//
+// Transpose 32 words into 32 32-bit plane slices.
+//
+// We first regroup the bytes so that each of four vectors holds the same
+// byte of all 32 words, in order.  Then the sign bits of a vector's bytes
+// are one bit-plane, which movemask extracts 32 bits at a time, and
+// shifting each byte left by one brings the next plane into the sign bits.
+//
+AVX2_FUNCTION static inline void
+Transpose32Avx2(const uint32_t* Words,
+                uint32_t*       Slices)
+{
+    const __m256i byteGroups = _mm256_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13,
+                                                2, 6, 10, 14, 3, 7, 11, 15,
+                                                0, 4, 8, 12, 1, 5, 9, 13,
+                                                2, 6, 10, 14, 3, 7, 11, 15);
+    const __m256i dwordOrder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    __m256i       v[4];
+    __m256i       t[4];
+    __m256i       bytes[4];
+
+    //
+    // Within each vector of 8 words, gather byte k of the words into
+    // quadword k
+    //
+    for (int i = 0; i < 4; i++) {
+
+        v[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Words + i * 8));
+        v[i] = _mm256_shuffle_epi8(v[i], byteGroups);
+        v[i] = _mm256_permutevar8x32_epi32(v[i], dwordOrder);
+    }
+
+    //
+    // Then a 4x4 transpose of quadwords, so bytes[k] holds byte k of all
+    // 32 words
+    //
+    t[0] = _mm256_unpacklo_epi64(v[0], v[1]);
+    t[1] = _mm256_unpackhi_epi64(v[0], v[1]);
+    t[2] = _mm256_unpacklo_epi64(v[2], v[3]);
+    t[3] = _mm256_unpackhi_epi64(v[2], v[3]);
+
+    bytes[0] = _mm256_permute2x128_si256(t[0], t[2], 0x20);
+    bytes[1] = _mm256_permute2x128_si256(t[1], t[3], 0x20);
+    bytes[2] = _mm256_permute2x128_si256(t[0], t[2], 0x31);
+    bytes[3] = _mm256_permute2x128_si256(t[1], t[3], 0x31);
+
+    for (int k = 0; k < 4; k++) {
+
+        for (int bit = 7; bit >= 0; bit--) {
+
+            Slices[k * 8 + bit] = (uint32_t)_mm256_movemask_epi8(bytes[k]);
+
+            bytes[k] = _mm256_slli_epi64(bytes[k], 1);
+        }
+    }
+}
+
+AVX2_FUNCTION static void
+TransposeAvx2(const uint32_t* Words,
+              size_t          Count,
+              uint64_t*       Planes,
+              size_t          PlaneWords)
+{
+    uint32_t low[32];
+    uint32_t high[32];
+    size_t   block;
+
+    for (block = 0; (block + 1) * 64 <= Count; block++) {
+
+        Transpose32Avx2(Words + block * 64, low);
+        Transpose32Avx2(Words + block * 64 + 32, high);
+
+        for (uint32_t plane = 0; plane < 32; plane++) {
+
+            Planes[plane * PlaneWords + block] =
+                            ((uint64_t)high[plane] << 32) | low[plane];
+        }
+    }
+
+    //
+    // The remainder (and the rest of the planes)
+    //
+    TransposeScalar(Words, Count, Planes, PlaneWords, block * 64);
+}
+
+static bool
+CpuHasAvx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+
+    __cpuid(info, 0);
+
+    if (info[0] < 7) {
+        return false;
+    }
+
+    //
+    // The CPU must support AVX2, and the OS must save the YMM registers
+    //
+    __cpuid(info, 1);
+
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 ||
+        (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#endif
+
+static std::atomic<bool> UseAvx2(
+#ifdef DIO_LINE_STATS_AVX2
+                                 CpuHasAvx2()
+#else
+                                 false
+#endif
+                                 );
+
+bool
+DioSimdEnabled()
+{
+    return UseAvx2;
+}
+
+void
+DioUseSimd(bool Enable)
+{
+#ifdef DIO_LINE_STATS_AVX2
+    UseAvx2 = Enable && CpuHasAvx2();
+#else
+    (void)Enable;
+#endif
+}
+
+void
+DioTransposeToPlanes(const uint32_t* Words,
+                     size_t          Count,
+                     uint64_t*       Planes,
+                     size_t          PlaneWords)
+{
+#ifdef DIO_LINE_STATS_AVX2
+    if (UseAvx2) {
+
+        TransposeAvx2(Words, Count, Planes, PlaneWords);
+
+        return;
+    }
+#endif
+
+    TransposeScalar(Words, Count, Planes, PlaneWords, 0);
+}
+
+DioLineAnalyzer::DioLineAnalyzer()
+{
+    ChangeWords = static_cast<uint32_t*>(malloc(ANALYZER_CHUNK_EVENTS * sizeof(uint32_t)));
+    Planes      = static_cast<uint64_t*>(malloc(32 * ANALYZER_PLANE_WORDS * sizeof(uint64_t)));
+
+    Reset();
+}
+
+DioLineAnalyzer::~DioLineAnalyzer()
+{
+    free(ChangeWords);
+    free(Planes);
+}
+
+void
+DioLineAnalyzer::Reset()
+{
+    memset(Stats, 0, sizeof(Stats));
+    memset(LevelSince, 0, sizeof(LevelSince));
+
+    for (DIO_LINE_STATS& stats : Stats) {
+
+        stats.MinHighPulse = UINT64_MAX;
+        stats.MinLowPulse  = UINT64_MAX;
+    }
+
+    Started       = false;
+    PulseValid    = 0;
+    LineState     = 0;
+    LastTimestamp = 0;
+}
+
+//
+// Line changed at Time.  Close out the level it had been at.
+//
+void
+DioLineAnalyzer::Transition(uint32_t Line,
+                            uint64_t Time)
+{
+    DIO_LINE_STATS& stats = Stats[Line];
+    uint32_t        bit   = 1U << Line;
+    uint64_t        width = Time - LevelSince[Line];
+    uint32_t        bucket;
+
+    stats.Transitions++;
+
+    //
+    // LineState still holds the level before this change
+    //
+    if ((LineState & bit) != 0) {
+
+        stats.HighTime += width;
+
+        if ((PulseValid & bit) != 0) {
+
+            bucket = 64 - LeadingZeros64(width);
+
+            stats.HighPulses++;
+            stats.HighPulseHistogram[bucket]++;
+
+            if (width < stats.MinHighPulse) {
+                stats.MinHighPulse = width;
+            }
+
+            if (width > stats.MaxHighPulse) {
+                stats.MaxHighPulse = width;
+            }
+        }
+
+    } else {
+
+        stats.RisingEdges++;
+        stats.LowTime += width;
+
+        if ((PulseValid & bit) != 0) {
+
+            bucket = 64 - LeadingZeros64(width);
+
+            stats.LowPulses++;
+            stats.LowPulseHistogram[bucket]++;
+
+            if (width < stats.MinLowPulse) {
+                stats.MinLowPulse = width;
+            }
+
+            if (width > stats.MaxLowPulse) {
+                stats.MaxLowPulse = width;
+            }
+        }
+    }
+
+    LevelSince[Line]  = Time;
+    PulseValid       |= bit;
+}
+
+void
+DioLineAnalyzer::ProcessChunk(const DIO_EVENT* Events,
+                              size_t           Count)
+{
+    uint32_t state = LineState;
+    size_t   planeWords;
+    uint64_t bits;
+    size_t   index;
+
+    //
+    // The lines that changed at each event.  As everywhere else, we work
+    // from the line states, so a gap in the stream shows up as the lines
+    // that differ across it changing.
+    //
+    for (size_t i = 0; i < Count; i++) {
+
+        ChangeWords[i] = Events[i].LineState ^ state;
+        state          = Events[i].LineState;
+    }
+
+    planeWords = (Count + 63) / 64;
+
+    DioTransposeToPlanes(ChangeWords, Count, Planes, planeWords);
+
+    for (uint32_t line = 0; line < 32; line++) {
+        const uint64_t* plane = Planes + line * planeWords;
+
+        for (size_t word = 0; word < planeWords; word++) {
+
+            bits = plane[word];
+
+            while (bits != 0) {
+
+                index = word * 64 + TrailingZeros64(bits);
+                bits &= bits - 1;
+
+                Transition(line, Events[index].Timestamp);
+
+                LineState ^= 1U << line;
+            }
+        }
+    }
+
+    LastTimestamp = Events[Count - 1].Timestamp;
+}
+
+void
+DioLineAnalyzer::Process(const DIO_EVENT* Events,
+                         size_t           Count)
+{
+    size_t chunk;
+
+    if (Count == 0) {
+        return;
+    }
+
+    if (!Started) {
+
+        //
+        // Every line has been at its initial level since the first event
+        //
+        LineState = Events[0].LineState ^ Events[0].ChangedLines;
+        Started   = true;
+
+        for (uint64_t& since : LevelSince) {
+            since = Events[0].Timestamp;
+        }
+    }
+
+    while (Count != 0) {
+
+        chunk = Count < ANALYZER_CHUNK_EVENTS ? Count : ANALYZER_CHUNK_EVENTS;
+
+        ProcessChunk(Events, chunk);
+
+        Events += chunk;
+        Count  -= chunk;
+    }
+}
+
+void
+DioLineAnalyzer::Finish(uint64_t EndTime)
+{
+    if (!Started) {
+        return;
+    }
+
+    for (uint32_t line = 0; line < 32; line++) {
+
+        if (EndTime <= LevelSince[line]) {
+            continue;
+        }
+
+        if ((LineState & (1U << line)) != 0) {
+            Stats[line].HighTime += EndTime - LevelSince[line];
+        } else {
+            Stats[line].LowTime += EndTime - LevelSince[line];
+        }
+
+        LevelSince[line] = EndTime;
+    }
+}
+
+void
+DioLineAnalyzer::Analyze(DioEventSource& Source)
+{
+    DIO_EVENT events[ANALYZER_READ_EVENTS];
+    size_t    count;
+
+    while ((count = Source.Read(events, ANALYZER_READ_EVENTS)) != 0) {
+        Process(events, count);
+    }
+
+    Finish(LastTimestamp);
+}
@@ -0,0 +1,157 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioLineStats.h -- Per-line statistics over event streams
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      Looking at each of the 32 bits of each event, one at a time, is the
+//      obvious way to find out what each line did, and it's slow.  Instead
+//      we work on a chunk of events at a time: we compute the word of lines
+//      that changed at each event, and transpose those words into 32
+//      "bit-planes", one per line, with one bit per event.  A line's plane
+//      is then a bitmap of the events at which it changed, so counting its
+//      transitions is a popcount, and finding them is a count-trailing-
+//      zeros per transition rather than a test per event.
+//
+//      The transpose has an AVX2 implementation, chosen at run time when
+//      the CPU supports it, and a portable one.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "DioEvent.h"
+
+//
+// Pulse width histograms have one bucket per power of two nanoseconds:
+// bucket n counts pulses at least 2^(n-1) ns and less than 2^n ns wide
+// (bucket zero counts pulses of zero width).
+//
+constexpr uint32_t DIO_PULSE_BUCKETS = 65;
+
+//
+// DIO_LINE_STATS
+//
+// What one line did.  HighTime and LowTime cover the whole analysis, from
+// its first event to the time given to Finish.  The pulse statistics only
+// count complete pulses, ones that both started and ended with a
+// transition we saw.
+//
+typedef struct _DIO_LINE_STATS {
+    uint64_t    Transitions;
+    uint64_t    RisingEdges;
+    uint64_t    HighTime;                           // ns
+    uint64_t    LowTime;                            // ns
+    uint64_t    HighPulses;
+    uint64_t    LowPulses;
+    uint64_t    MinHighPulse;                       // ns
+    uint64_t    MaxHighPulse;
+    uint64_t    MinLowPulse;
+    uint64_t    MaxLowPulse;
+    uint64_t    HighPulseHistogram[DIO_PULSE_BUCKETS];
+    uint64_t    LowPulseHistogram[DIO_PULSE_BUCKETS];
+} DIO_LINE_STATS, *PDIO_LINE_STATS;
+
+//
+// Transpose Count words into 32 bit-planes.  Plane n starts at
+// Planes + n * PlaneWords, and bit i of the plane (bit i % 64 of word
+// i / 64) is bit n of Words[i].  PlaneWords must be at least
+// (Count + 63) / 64.  Bits past Count are cleared.
+//
+void DioTransposeToPlanes(const uint32_t* Words,
+                          size_t          Count,
+                          uint64_t*       Planes,
+                          size_t          PlaneWords);
+
+//
+// True if DioTransposeToPlanes is using the AVX2 implementation.  Passing
+// false to DioUseSimd makes it use the portable one (for comparison).
+//
+bool DioSimdEnabled();
+
+void DioUseSimd(bool Enable);
+
+//
+// DioLineAnalyzer
+//
+// Accumulates DIO_LINE_STATS for all 32 lines over a stream of events.
+//
+class DioLineAnalyzer
+{
+public:
+    DioLineAnalyzer();
+    ~DioLineAnalyzer();
+
+    DioLineAnalyzer(const DioLineAnalyzer&) = delete;
+    DioLineAnalyzer& operator=(const DioLineAnalyzer&) = delete;
+
+    void Reset();
+
+    void Process(const DIO_EVENT* Events,
+                 size_t           Count);
+
+    //
+    // Account for the time from the last event to EndTime.  Pass the last
+    // event's timestamp if you don't know when the capture stopped.
+    //
+    void Finish(uint64_t EndTime);
+
+    //
+    // Process every event from Source, and then Finish at the last one
+    //
+    void Analyze(DioEventSource& Source);
+
+    const DIO_LINE_STATS& Line(uint32_t Line) const
+    {
+        return Stats[Line];
+    }
+
+private:
+    void ProcessChunk(const DIO_EVENT* Events,
+                      size_t           Count);
+
+    void Transition(uint32_t Line,
+                    uint64_t Time);
+
+    DIO_LINE_STATS Stats[32];
+    uint64_t       LevelSince[32];      // when each line last changed
+    bool           Started;
+    uint32_t       PulseValid;          // lines with a LevelSince from a
+                                        // transition (not the start)
+    uint32_t       LineState;
+    uint64_t       LastTimestamp;
+    uint32_t*      ChangeWords;
+    uint64_t*      Planes;
+};
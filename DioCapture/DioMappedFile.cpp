@@ -0,0 +1,213 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioMappedFile.cpp -- Read-only memory mapped files
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include "DioMappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+DioMappedFile::DioMappedFile()
+    : View(nullptr),
+      ViewLength(0)
+#ifdef _WIN32
+      , MappingHandle(nullptr)
+#endif
+{
+}
+
+DioMappedFile::~DioMappedFile()
+{
+    Close();
+}
+
+#ifdef _WIN32
+
+bool
+DioMappedFile::Open(const char* Path)
+{
+    HANDLE        fileHandle;
+    LARGE_INTEGER size;
+    bool          result = false;
+
+    Close();
+
+    fileHandle = CreateFileA(Path,
+                             GENERIC_READ,
+                             FILE_SHARE_READ | FILE_SHARE_WRITE,
+                             nullptr,
+                             OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL,
+                             nullptr);
+
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    //
+    // An empty file can't be mapped.  Nor, for that matter, can it hold
+    // anything we're interested in.
+    //
+    if (!GetFileSizeEx(fileHandle, &size) || size.QuadPart == 0) {
+        goto done;
+    }
+
+    MappingHandle = CreateFileMappingA(fileHandle,
+                                       nullptr,
+                                       PAGE_READONLY,
+                                       0,
+                                       0,
+                                       nullptr);
+
+    if (MappingHandle == nullptr) {
+        goto done;
+    }
+
+    View = static_cast<const uint8_t*>(MapViewOfFile(MappingHandle,
+                                                     FILE_MAP_READ,
+                                                     0,
+                                                     0,
+                                                     0));
+    if (View == nullptr) {
+
+        CloseHandle(MappingHandle);
+
+        MappingHandle = nullptr;
+
+        goto done;
+    }
+
+    ViewLength = size.QuadPart;
+    result     = true;
+
+done:
+
+    //
+    // The mapping keeps the file open
+    //
+    CloseHandle(fileHandle);
+
+    return result;
+}
+
+void
+DioMappedFile::Close()
+{
+    if (View != nullptr) {
+
+        UnmapViewOfFile(View);
+
+        View = nullptr;
+    }
+
+    if (MappingHandle != nullptr) {
+
+        CloseHandle(MappingHandle);
+
+        MappingHandle = nullptr;
+    }
+
+    ViewLength = 0;
+}
+
+#else
+
+bool
+DioMappedFile::Open(const char* Path)
+{
+    struct stat status;
+    void*       view;
+    int         fd;
+    bool        result = false;
+
+    Close();
+
+    fd = open(Path, O_RDONLY);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    if (fstat(fd, &status) != 0 || status.st_size == 0) {
+        goto done;
+    }
+
+    view = mmap(nullptr,
+                (size_t)status.st_size,
+                PROT_READ,
+                MAP_SHARED,
+                fd,
+                0);
+
+    if (view == MAP_FAILED) {
+        goto done;
+    }
+
+    View       = static_cast<const uint8_t*>(view);
+    ViewLength = (uint64_t)status.st_size;
+    result     = true;
+
+done:
+
+    //
+    // The mapping keeps the file open
+    //
+    close(fd);
+
+    return result;
+}
+
+void
+DioMappedFile::Close()
+{
+    if (View != nullptr) {
+
+        munmap(const_cast<uint8_t*>(View), (size_t)ViewLength);
+
+        View = nullptr;
+    }
+
+    ViewLength = 0;
+}
+
+#endif
@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioMappedFile.h -- Read-only memory mapped files
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+//
+// DioMappedFile
+//
+// Maps an entire file read-only into our address space.  Captures can be
+// many gigabytes, so on 32-bit hosts this can fail where DioCaptureReader,
+// which streams, would not.
+//
+class DioMappedFile
+{
+public:
+    DioMappedFile();
+    ~DioMappedFile();
+
+    DioMappedFile(const DioMappedFile&) = delete;
+    DioMappedFile& operator=(const DioMappedFile&) = delete;
+
+    bool Open(const char* Path);
+
+    void Close();
+
+    const uint8_t* Data() const
+    {
+        return View;
+    }
+
+    uint64_t Length() const
+    {
+        return ViewLength;
+    }
+
+private:
+    const uint8_t* View;
+    uint64_t       ViewLength;
+#ifdef _WIN32
+    void*          MappingHandle;
+#endif
+};
@@ -0,0 +1,162 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioSpiDecoder.cpp -- SPI bus decoder
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include "DioSpiDecoder.h"
+
+DioSpiDecoder::DioSpiDecoder(const DIO_SPI_CONFIG& Config,
+                             DioFrameSink*         Sink,
+                             uint32_t              Channel)
+    : DioDecoder(Sink, Channel),
+      Config(Config),
+      //
+      // CPOL == CPHA (modes 0 and 3) samples on the rising edge
+      //
+      SampleLevel(((Config.Mode >> 1) & 1) == (Config.Mode & 1) ? 1 : 0),
+      Clock(0),
+      Selected(false),
+      BitCount(0),
+      Mosi(0),
+      Miso(0),
+      WordStart(0)
+{
+}
+
+void
+DioSpiDecoder::Reset(uint32_t LineState)
+{
+    Clock    = LineLevel(LineState, Config.ClockLine);
+    Selected = Config.SelectLine == DIO_LINE_NONE ||
+               LineLevel(LineState, Config.SelectLine) == 0;
+    BitCount = 0;
+    Mosi     = 0;
+    Miso     = 0;
+}
+
+void
+DioSpiDecoder::OnEvent(const DIO_EVENT& Event)
+{
+    uint32_t clock;
+    bool     selected;
+    uint32_t before;
+
+    clock    = LineLevel(Event.LineState, Config.ClockLine);
+    selected = Config.SelectLine == DIO_LINE_NONE ||
+               LineLevel(Event.LineState, Config.SelectLine) == 0;
+
+    //
+    // Chip select changes start (or abandon) a word
+    //
+    if (selected != Selected) {
+
+        if (!selected && BitCount != 0) {
+            EmitWord(Event.Timestamp,
+                     DIO_FRAME_INCOMPLETE);
+        }
+
+        Selected = selected;
+        BitCount = 0;
+        Mosi     = 0;
+        Miso     = 0;
+    }
+
+    if (clock == Clock) {
+        return;
+    }
+
+    Clock = clock;
+
+    if (!Selected || clock != SampleLevel) {
+        return;
+    }
+
+    //
+    // Sampling edge.  Use the data lines as they were before this event.
+    //
+    before = Event.LineState ^ Event.ChangedLines;
+
+    if (BitCount == 0) {
+        WordStart = Event.Timestamp;
+    }
+
+    if (Config.LsbFirst) {
+
+        if (Config.MosiLine != DIO_LINE_NONE) {
+            Mosi |= LineLevel(before, Config.MosiLine) << BitCount;
+        }
+
+        if (Config.MisoLine != DIO_LINE_NONE) {
+            Miso |= LineLevel(before, Config.MisoLine) << BitCount;
+        }
+
+    } else {
+
+        if (Config.MosiLine != DIO_LINE_NONE) {
+            Mosi = (Mosi << 1) | LineLevel(before, Config.MosiLine);
+        }
+
+        if (Config.MisoLine != DIO_LINE_NONE) {
+            Miso = (Miso << 1) | LineLevel(before, Config.MisoLine);
+        }
+    }
+
+    if (++BitCount == Config.BitsPerWord) {
+
+        EmitWord(Event.Timestamp,
+                 0);
+
+        BitCount = 0;
+        Mosi     = 0;
+        Miso     = 0;
+    }
+}
+
+void
+DioSpiDecoder::EmitWord(uint64_t EndTime,
+                        uint32_t Flags)
+{
+    DIO_FRAME frame;
+
+    frame.StartTime = WordStart;
+    frame.EndTime   = EndTime;
+    frame.Type      = DioFrameType::SpiWord;
+    frame.Data      = Mosi;
+    frame.Aux       = Miso;
+    frame.Flags     = Flags;
+
+    Emit(frame);
+}
@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioSpiDecoder.h -- SPI bus decoder
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "DioDecoder.h"
+
+typedef struct _DIO_SPI_CONFIG {
+    uint32_t    ClockLine;
+    uint32_t    MosiLine;           // DIO_LINE_NONE if not captured
+    uint32_t    MisoLine;           // DIO_LINE_NONE if not captured
+    uint32_t    SelectLine;         // DIO_LINE_NONE if always selected
+    uint32_t    Mode;               // 0 through 3 (CPOL << 1 | CPHA)
+    uint32_t    BitsPerWord;        // 1 through 32
+    bool        LsbFirst;
+} DIO_SPI_CONFIG, *PDIO_SPI_CONFIG;
+
+//
+// DioSpiDecoder
+//
+// Decodes one SPI bus.  Data is sampled on the clock edge that the mode
+// specifies (rising in modes 0 and 3, falling in modes 1 and 2).  Chip select
+// is active low; when it is deasserted in the middle of a word, the partial
+// word is reported with DIO_FRAME_INCOMPLETE.
+//
+// The data lines are required to be stable when the sampling clock edge
+// arrives, so if a data line changes in the same event as the clock we use
+// its level from before that event.
+//
+class DioSpiDecoder : public DioDecoder
+{
+public:
+    DioSpiDecoder(const DIO_SPI_CONFIG& Config,
+                  DioFrameSink*         Sink,
+                  uint32_t              Channel);
+
+    void Reset(uint32_t LineState) override;
+
+    void OnEvent(const DIO_EVENT& Event) override;
+
+private:
+    void EmitWord(uint64_t EndTime,
+                  uint32_t Flags);
+
+    DIO_SPI_CONFIG  Config;
+    uint32_t        SampleLevel;    // clock level after the sampling edge
+    uint32_t        Clock;
+    bool            Selected;
+    uint32_t        BitCount;
+    uint32_t        Mosi;
+    uint32_t        Miso;
+    uint64_t        WordStart;
+};
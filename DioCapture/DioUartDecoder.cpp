@@ -0,0 +1,227 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioUartDecoder.cpp -- Asynchronous serial (UART) decoder
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include "DioUartDecoder.h"
+
+DioUartDecoder::DioUartDecoder(const DIO_UART_CONFIG& Config,
+                               DioFrameSink*          Sink,
+                               uint32_t               Channel)
+    : DioDecoder(Sink, Channel),
+      Config(ClampConfig(Config)),
+      FrameBits(1 + this->Config.DataBits +
+                (this->Config.Parity != DioParity::None ? 1 : 0) +
+                this->Config.StopBits),
+      Level(1),
+      InFrame(false),
+      FrameStart(0),
+      NextBit(0),
+      Data(0),
+      Ones(0),
+      Flags(0)
+{
+    //
+    // Precompute the offset of the center of each bit from the leading
+    // edge of the start bit.  Integer arithmetic keeps us exact at any
+    // baud rate.
+    //
+    for (uint32_t bit = 0; bit < MAX_FRAME_BITS; bit++) {
+        SampleOffset[bit] = ((2ULL * bit + 1) * 1000000000ULL) /
+                            (2ULL * this->Config.BaudRate);
+    }
+
+    FrameLength = (FrameBits * 1000000000ULL) / this->Config.BaudRate;
+}
+
+//
+// ClampConfig
+//
+// Bring a configuration into the range we can decode.  A zero baud rate
+// would divide by zero, and too many data or stop bits would run past the
+// end of SampleOffset, so rather than trust the caller we clamp each field
+// to the nearest legal value.
+//
+DIO_UART_CONFIG
+DioUartDecoder::ClampConfig(const DIO_UART_CONFIG& Config)
+{
+    DIO_UART_CONFIG config = Config;
+
+    config.Line = Config.Line % 32;
+
+    if (config.BaudRate == 0) {
+        config.BaudRate = 1;
+    }
+
+    if (config.DataBits < 5) {
+        config.DataBits = 5;
+    } else if (config.DataBits > 9) {
+        config.DataBits = 9;
+    }
+
+    if (config.StopBits < 1) {
+        config.StopBits = 1;
+    } else if (config.StopBits > 2) {
+        config.StopBits = 2;
+    }
+
+    if (config.Parity != DioParity::Even && config.Parity != DioParity::Odd) {
+        config.Parity = DioParity::None;
+    }
+
+    return config;
+}
+
+void
+DioUartDecoder::Reset(uint32_t LineState)
+{
+    Level   = LineLevel(LineState, Config.Line) ^ (Config.Inverted ? 1 : 0);
+    InFrame = false;
+}
+
+void
+DioUartDecoder::OnEvent(const DIO_EVENT& Event)
+{
+    uint32_t level;
+
+    level = LineLevel(Event.LineState, Config.Line) ^ (Config.Inverted ? 1 : 0);
+
+    //
+    // Not our line
+    //
+    if (level == Level) {
+        return;
+    }
+
+    //
+    // Sample any bits that were centered before this transition
+    //
+    AdvanceTo(Event.Timestamp);
+
+    Level = level;
+
+    //
+    // A transition to SPACE while idle is the leading edge of a start bit
+    //
+    if (!InFrame && Level == 0) {
+
+        InFrame    = true;
+        FrameStart = Event.Timestamp;
+        NextBit    = 0;
+        Data       = 0;
+        Ones       = 0;
+        Flags      = 0;
+    }
+}
+
+void
+DioUartDecoder::Flush(uint64_t Timestamp)
+{
+    AdvanceTo(Timestamp);
+}
+
+void
+DioUartDecoder::AdvanceTo(uint64_t Timestamp)
+{
+    while (InFrame && SampleTime(NextBit) < Timestamp) {
+        SampleBit(Level);
+    }
+}
+
+void
+DioUartDecoder::SampleBit(uint32_t Level)
+{
+    DIO_FRAME frame;
+    uint32_t  bit = NextBit++;
+
+    if (bit == 0) {
+
+        //
+        // The line must still be at SPACE in the middle of the start bit.
+        // If it isn't, the "start bit" was a glitch.
+        //
+        if (Level != 0) {
+            InFrame = false;
+        }
+
+        return;
+    }
+
+    if (bit <= Config.DataBits) {
+
+        Data |= Level << (bit - 1);
+        Ones += Level;
+
+        return;
+    }
+
+    if (Config.Parity != DioParity::None && bit == Config.DataBits + 1) {
+
+        Ones += Level;
+
+        //
+        // Even parity: the data bits plus the parity bit have an even number
+        // of ones.  Odd parity: an odd number.
+        //
+        if ((Ones & 1) != (Config.Parity == DioParity::Odd ? 1U : 0U)) {
+            Flags |= DIO_FRAME_PARITY_ERROR;
+        }
+
+        return;
+    }
+
+    //
+    // Stop bits must be MARK
+    //
+    if (Level == 0) {
+        Flags |= DIO_FRAME_FRAMING_ERROR;
+    }
+
+    if (NextBit < FrameBits) {
+        return;
+    }
+
+    frame.StartTime = FrameStart;
+    frame.EndTime   = FrameStart + FrameLength;
+    frame.Type      = DioFrameType::UartCharacter;
+    frame.Data      = Data;
+    frame.Aux       = 0;
+    frame.Flags     = Flags;
+
+    Emit(frame);
+
+    InFrame = false;
+}
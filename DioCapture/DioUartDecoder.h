@@ -0,0 +1,115 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioUartDecoder.h -- Asynchronous serial (UART) decoder
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "DioDecoder.h"
+
+enum class DioParity : uint32_t {
+    None,
+    Even,
+    Odd
+};
+
+typedef struct _DIO_UART_CONFIG {
+    uint32_t    Line;
+    uint32_t    BaudRate;
+    uint32_t    DataBits;       // 5 through 9
+    DioParity   Parity;
+    uint32_t    StopBits;       // 1 or 2
+    bool        Inverted;       // TRUE if the line idles low
+} DIO_UART_CONFIG, *PDIO_UART_CONFIG;
+
+//
+// DioUartDecoder
+//
+// Decodes one UART line (LSB first, with a start bit and 1 or 2 stop bits).
+//
+// Since we only see the line when it changes, we don't sample it on a clock.
+// Instead, when a start bit begins we compute where the middle of each bit
+// of the character will be, and each time an event arrives we "sample" the
+// bit centers that fall before it using the level the line has held since
+// the previous transition.  A character whose last bits are all 1s has no
+// transition after it, so it is only completed by a later event or by
+// Flush.
+//
+// Out of range configuration fields are clamped to the nearest legal value
+// (1 baud, 5 through 9 data bits, 1 or 2 stop bits).
+//
+class DioUartDecoder : public DioDecoder
+{
+public:
+    DioUartDecoder(const DIO_UART_CONFIG& Config,
+                   DioFrameSink*          Sink,
+                   uint32_t               Channel);
+
+    void Reset(uint32_t LineState) override;
+
+    void OnEvent(const DIO_EVENT& Event) override;
+
+    void Flush(uint64_t Timestamp) override;
+
+private:
+    uint64_t SampleTime(uint32_t Bit) const
+    {
+        return FrameStart + SampleOffset[Bit];
+    }
+
+    void AdvanceTo(uint64_t Timestamp);
+
+    void SampleBit(uint32_t Level);
+
+    static DIO_UART_CONFIG ClampConfig(const DIO_UART_CONFIG& Config);
+
+    //
+    // Longest possible character: start, 9 data, parity and 2 stop bits
+    //
+    static constexpr uint32_t MAX_FRAME_BITS = 13;
+
+    DIO_UART_CONFIG Config;
+    uint32_t        FrameBits;      // start + data + parity + stop
+    uint64_t        SampleOffset[MAX_FRAME_BITS];
+    uint64_t        FrameLength;
+    uint32_t        Level;          // logical level: 1 == idle
+    bool            InFrame;
+    uint64_t        FrameStart;
+    uint32_t        NextBit;
+    uint32_t        Data;
+    uint32_t        Ones;
+    uint32_t        Flags;
+};
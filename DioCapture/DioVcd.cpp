@@ -0,0 +1,1069 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioVcd.cpp -- Value Change Dump (VCD) export and import
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <cstdlib>
+#include <cstring>
+
+#include "DioVcd.h"
+
+//
+// Size of the buffers we format and parse text in
+//
+constexpr size_t VCD_BUFFER_SIZE = 256 * 1024;
+
+//
+// The most text one event can produce: a timestamp, and a value change for
+// each of the 32 lines
+//
+constexpr size_t VCD_MAX_EVENT_TEXT = 32 + 32 * 4;
+
+//
+// Number of events DioVcdWriter::Export reads from its source at a time
+//
+constexpr size_t VCD_READ_EVENTS = 256;
+
+//
+// VCD identifiers are strings of printable ASCII characters.  Line n gets
+// the one-character identifier VCD_FIRST_ID + n.
+//
+constexpr char   VCD_FIRST_ID = '!';
+constexpr size_t VCD_ID_CHARS = '~' - '!' + 1;
+
+void
+DioVcdDefaultConfig(PDIO_VCD_CONFIG Config)
+{
+    Config->LineMask  = 0xFFFFFFFF;
+    Config->LineNames = nullptr;
+    Config->ScopeName = "osrdio";
+}
+
+DioVcdWriter::DioVcdWriter(DioCaptureSink*       Sink,
+                           const DIO_VCD_CONFIG& Config)
+    : Sink(Sink),
+      Config(Config),
+      Used(0),
+      Started(false),
+      Failed(false),
+      LineState(0),
+      LastTimestamp(0),
+      TotalBytes(0)
+{
+    Buffer = static_cast<char*>(malloc(VCD_BUFFER_SIZE));
+
+    if (Buffer == nullptr) {
+        Failed = true;
+    }
+}
+
+DioVcdWriter::~DioVcdWriter()
+{
+    free(Buffer);
+}
+
+//
+// Hand everything we've formatted to the sink
+//
+bool
+DioVcdWriter::Drain()
+{
+    if (Used != 0) {
+
+        if (!Sink->Write(Buffer, Used)) {
+
+            Failed = true;
+
+            return false;
+        }
+
+        TotalBytes += Used;
+        Used        = 0;
+    }
+
+    return true;
+}
+
+//
+// Put and PutNumber don't check for space.  Callers make sure there is
+// enough before they start formatting.
+//
+void
+DioVcdWriter::Put(const char* Text)
+{
+    size_t length = strlen(Text);
+
+    memcpy(Buffer + Used, Text, length);
+
+    Used += length;
+}
+
+void
+DioVcdWriter::PutNumber(uint64_t Value)
+{
+    char   digits[20];
+    size_t count = 0;
+
+    do {
+        digits[count++] = (char)('0' + Value % 10);
+
+        Value /= 10;
+
+    } while (Value != 0);
+
+    while (count != 0) {
+        Buffer[Used++] = digits[--count];
+    }
+}
+
+bool
+DioVcdWriter::WriteHeader(uint32_t InitialState)
+{
+    char line[4];
+
+    Put("$version OsrDio DioCapture $end\n"
+        "$timescale 1ns $end\n"
+        "$scope module ");
+    Put(Config.ScopeName);
+    Put(" $end\n");
+
+    for (uint32_t i = 0; i < 32; i++) {
+
+        if ((Config.LineMask & (1U << i)) == 0) {
+            continue;
+        }
+
+        if (!Drain()) {
+            return false;
+        }
+
+        Put("$var wire 1 ");
+
+        Buffer[Used++] = (char)(VCD_FIRST_ID + i);
+
+        Put(" ");
+
+        if (Config.LineNames != nullptr && Config.LineNames[i] != nullptr) {
+
+            Put(Config.LineNames[i]);
+
+        } else {
+
+            Put("line");
+            PutNumber(i);
+        }
+
+        Put(" $end\n");
+    }
+
+    Put("$upscope $end\n"
+        "$enddefinitions $end\n"
+        "#0\n"
+        "$dumpvars\n");
+
+    line[2] = '\n';
+    line[3] = '\0';
+
+    for (uint32_t i = 0; i < 32; i++) {
+
+        if ((Config.LineMask & (1U << i)) != 0) {
+
+            line[0] = (InitialState & (1U << i)) != 0 ? '1' : '0';
+            line[1] = (char)(VCD_FIRST_ID + i);
+
+            Put(line);
+        }
+    }
+
+    Put("$end\n");
+
+    return Drain();
+}
+
+bool
+DioVcdWriter::Append(const DIO_EVENT* Events,
+                     size_t           Count)
+{
+    uint32_t changed;
+    uint32_t line;
+
+    if (Failed) {
+        return false;
+    }
+
+    if (Count == 0) {
+        return true;
+    }
+
+    if (!Started) {
+
+        LineState = Events[0].LineState ^ Events[0].ChangedLines;
+        Started   = true;
+
+        if (!WriteHeader(LineState)) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < Count; i++) {
+
+        //
+        // As with capture files, the changes are what we compute from the
+        // line states, so that the states come out right even if the source
+        // lost events
+        //
+        changed = (Events[i].LineState ^ LineState) & Config.LineMask;
+
+        LineState = Events[i].LineState;
+
+        if (changed == 0) {
+            continue;
+        }
+
+        if (VCD_BUFFER_SIZE - Used < VCD_MAX_EVENT_TEXT && !Drain()) {
+            return false;
+        }
+
+        //
+        // Timestamps never go backwards in a VCD file
+        //
+        if (Events[i].Timestamp > LastTimestamp) {
+
+            LastTimestamp = Events[i].Timestamp;
+
+            Buffer[Used++] = '#';
+
+            PutNumber(LastTimestamp);
+
+            Buffer[Used++] = '\n';
+        }
+
+        while (changed != 0) {
+
+            line     = DioCaptureLowestSetBit(changed);
+            changed &= changed - 1;
+
+            Buffer[Used++] = (LineState & (1U << line)) != 0 ? '1' : '0';
+            Buffer[Used++] = (char)(VCD_FIRST_ID + line);
+            Buffer[Used++] = '\n';
+        }
+    }
+
+    return true;
+}
+
+bool
+DioVcdWriter::Finish()
+{
+    if (Failed || !Drain()) {
+        return false;
+    }
+
+    return Sink->Flush();
+}
+
+bool
+DioVcdWriter::Export(DioEventSource& Source)
+{
+    DIO_EVENT events[VCD_READ_EVENTS];
+    size_t    count;
+
+    while ((count = Source.Read(events, VCD_READ_EVENTS)) != 0) {
+
+        if (!Append(events, count)) {
+            return false;
+        }
+    }
+
+    return Finish();
+}
+
+DioVcdReader::DioVcdReader()
+    : File(nullptr),
+      Buffer(nullptr),
+      Position(0),
+      Limit(0),
+      EndOfFile(true),
+      BadInput(false),
+      TimescaleMultiplier(1),
+      TimescaleDivisor(1),
+      CurrentTime(0),
+      AtEnd(true),
+      LineState(0),
+      EmittedState(0),
+      InitialLines(0),
+      LinesInUse(0)
+{
+}
+
+DioVcdReader::~DioVcdReader()
+{
+    Close();
+}
+
+void
+DioVcdReader::MapSignal(const char* Name,
+                        uint32_t    Line)
+{
+    Mappings.emplace_back(Name, Line);
+}
+
+void
+DioVcdReader::Close()
+{
+    if (File != nullptr) {
+
+        fclose(File);
+
+        File = nullptr;
+    }
+
+    free(Buffer);
+
+    Buffer = nullptr;
+
+    Variables.clear();
+    ShortIds.clear();
+    LongIds.clear();
+
+    EndOfFile = true;
+    AtEnd     = true;
+}
+
+//
+// Returns the next whitespace-delimited token in the file.  The token stays
+// valid until the next call.
+//
+bool
+DioVcdReader::NextToken(const char** Token,
+                        size_t*      Length)
+{
+    size_t start;
+    size_t end;
+
+    start = Position;
+
+    for (;;) {
+
+        //
+        // Skip leading white space
+        //
+        while (start < Limit &&
+               (Buffer[start] == ' ' || Buffer[start] == '\n' ||
+                Buffer[start] == '\r' || Buffer[start] == '\t')) {
+            start++;
+        }
+
+        end = start;
+
+        while (end < Limit &&
+               Buffer[end] != ' ' && Buffer[end] != '\n' &&
+               Buffer[end] != '\r' && Buffer[end] != '\t') {
+            end++;
+        }
+
+        if (end < Limit || (EndOfFile && end > start)) {
+
+            //
+            // A whole token
+            //
+            *Token   = Buffer + start;
+            *Length  = end - start;
+            Position = end;
+
+            return true;
+        }
+
+        if (EndOfFile) {
+
+            Position = Limit;
+
+            return false;
+        }
+
+        //
+        // We hit the end of the buffer.  Move what we have of the token to
+        // the start of the buffer and read some more after it.
+        //
+        if (start == 0 && Limit == VCD_BUFFER_SIZE) {
+
+            //
+            // A token as long as the buffer isn't VCD
+            //
+            BadInput  = true;
+            EndOfFile = true;
+
+            return false;
+        }
+
+        memmove(Buffer, Buffer + start, Limit - start);
+
+        Limit -= start;
+        start  = 0;
+
+        Limit += fread(Buffer + Limit, 1, VCD_BUFFER_SIZE - Limit, File);
+
+        if (Limit < VCD_BUFFER_SIZE) {
+            EndOfFile = true;
+        }
+    }
+}
+
+static bool
+TokenIs(const char* Token,
+        size_t      Length,
+        const char* Keyword)
+{
+    return strlen(Keyword) == Length && memcmp(Token, Keyword, Length) == 0;
+}
+
+static bool
+ParseNumber(const char* Token,
+            size_t      Length,
+            uint64_t*   Value)
+{
+    uint64_t result = 0;
+
+    if (Length == 0) {
+        return false;
+    }
+
+    for (size_t i = 0; i < Length; i++) {
+
+        if (Token[i] < '0' || Token[i] > '9') {
+            return false;
+        }
+
+        result = result * 10 + (uint64_t)(Token[i] - '0');
+    }
+
+    *Value = result;
+
+    return true;
+}
+
+//
+// Skip the remainder of a section, up to and including its $end
+//
+bool
+DioVcdReader::SkipToEnd()
+{
+    const char* token;
+    size_t      length;
+
+    while (NextToken(&token, &length)) {
+
+        if (TokenIs(token, length, "$end")) {
+            return true;
+        }
+    }
+
+    BadInput = true;
+
+    return false;
+}
+
+//
+// $timescale <number> <unit> $end, where the number and unit may also be
+// written together.  We convert to a multiplier and divisor that take
+// times in the file to nanoseconds.
+//
+bool
+DioVcdReader::ParseTimescale()
+{
+    static const struct {
+        const char* Unit;
+        uint64_t    Femtoseconds;
+    } units[] = {
+        { "s",  1000000000000000ULL },
+        { "ms", 1000000000000ULL },
+        { "us", 1000000000ULL },
+        { "ns", 1000000ULL },
+        { "ps", 1000ULL },
+        { "fs", 1ULL },
+    };
+
+    const char* token;
+    size_t      length;
+    uint64_t    number = 0;
+    uint64_t    femtoseconds;
+    size_t      digits;
+    bool        found = false;
+
+    while (NextToken(&token, &length)) {
+
+        if (TokenIs(token, length, "$end")) {
+
+            if (!found) {
+                break;
+            }
+
+            return true;
+        }
+
+        for (digits = 0; digits < length &&
+                         token[digits] >= '0' && token[digits] <= '9'; digits++) {
+        }
+
+        if (digits != 0 && !ParseNumber(token, digits, &number)) {
+            break;
+        }
+
+        if (digits == length) {
+            continue;
+        }
+
+        for (const auto& unit : units) {
+
+            if (TokenIs(token + digits, length - digits, unit.Unit)) {
+
+                femtoseconds = number * unit.Femtoseconds;
+
+                if (femtoseconds >= 1000000) {
+
+                    TimescaleMultiplier = femtoseconds / 1000000;
+                    TimescaleDivisor    = 1;
+
+                } else if (femtoseconds != 0) {
+
+                    TimescaleMultiplier = 1;
+                    TimescaleDivisor    = 1000000 / femtoseconds;
+                }
+
+                found = true;
+            }
+        }
+    }
+
+    BadInput = true;
+
+    return false;
+}
+
+//
+// $var <type> <width> <id> <reference> [<bit select>] $end
+//
+bool
+DioVcdReader::ParseVar()
+{
+    const char*  token;
+    size_t       length;
+    VCD_VARIABLE variable;
+    std::string  id;
+    uint64_t     width;
+    bool         isReal;
+    int          index;
+    int32_t      slot;
+
+    if (!NextToken(&token, &length)) {
+        goto bad;
+    }
+
+    isReal = TokenIs(token, length, "real") ||
+             TokenIs(token, length, "realtime");
+
+    if (!NextToken(&token, &length) || !ParseNumber(token, length, &width)) {
+        goto bad;
+    }
+
+    if (!NextToken(&token, &length)) {
+        goto bad;
+    }
+
+    id.assign(token, length);
+
+    if (!NextToken(&token, &length)) {
+        goto bad;
+    }
+
+    variable.Name.assign(token, length);
+    variable.Width     = isReal ? 0 : (uint32_t)width;
+    variable.FirstLine = -1;
+
+    //
+    // A second declaration of an identifier is another name for the same
+    // signal, which we already have
+    //
+    if (FindVariable(id.data(), id.size()) < 0) {
+
+        index = (int)Variables.size();
+        slot  = ShortIdSlot(id.data(), id.size());
+
+        Variables.push_back(variable);
+
+        if (slot >= 0 && index <= INT16_MAX) {
+            ShortIds[(size_t)slot] = (int16_t)index;
+        } else {
+            LongIds[id] = index;
+        }
+    }
+
+    return SkipToEnd();
+
+bad:
+
+    BadInput = true;
+
+    return false;
+}
+
+//
+// Identifiers of one or two characters (which is what most files use, as
+// the shortest ones are handed out first) are looked up in a table rather
+// than hashed.  Returns the identifier's slot in ShortIds, or -1 if it
+// doesn't have one.
+//
+int32_t
+DioVcdReader::ShortIdSlot(const char* Id,
+                          size_t      Length)
+{
+    size_t first;
+    size_t second;
+
+    if (Length == 0 || Length > 2) {
+        return -1;
+    }
+
+    first = (size_t)(uint8_t)(Id[0] - VCD_FIRST_ID);
+
+    if (first >= VCD_ID_CHARS) {
+        return -1;
+    }
+
+    if (Length == 1) {
+        return (int32_t)first;
+    }
+
+    second = (size_t)(uint8_t)(Id[1] - VCD_FIRST_ID);
+
+    if (second >= VCD_ID_CHARS) {
+        return -1;
+    }
+
+    return (int32_t)(VCD_ID_CHARS * (1 + first) + second);
+}
+
+//
+// Returns the index of the variable with the given identifier, or -1
+//
+int32_t
+DioVcdReader::FindVariable(const char* Id,
+                           size_t      Length)
+{
+    int32_t slot = ShortIdSlot(Id, Length);
+
+    if (slot >= 0 && (ShortIds[(size_t)slot] >= 0 || LongIds.empty())) {
+        return ShortIds[(size_t)slot];
+    }
+
+    auto entry = LongIds.find(std::string(Id, Length));
+
+    return entry != LongIds.end() ? entry->second : -1;
+}
+
+//
+// Decide which lines each variable drives (see the class description)
+//
+void
+DioVcdReader::AssignLines()
+{
+    uint32_t next = 0;
+
+    LinesInUse = 0;
+
+    if (!Mappings.empty()) {
+
+        for (const auto& mapping : Mappings) {
+
+            for (VCD_VARIABLE& variable : Variables) {
+
+                if (variable.Name == mapping.first && variable.Width != 0 &&
+                    mapping.second + variable.Width <= 32) {
+
+                    variable.FirstLine = (int32_t)mapping.second;
+
+                    LinesInUse |= (uint32_t)(((1ULL << variable.Width) - 1)
+                                                        << mapping.second);
+                }
+            }
+        }
+
+        return;
+    }
+
+    for (VCD_VARIABLE& variable : Variables) {
+        char* end;
+        long  line;
+
+        if (variable.Width != 1 ||
+            variable.Name.compare(0, 4, "line") != 0 ||
+            variable.Name.size() == 4) {
+            continue;
+        }
+
+        line = strtol(variable.Name.c_str() + 4, &end, 10);
+
+        if (*end == '\0' && line >= 0 && line < 32 &&
+            (LinesInUse & (1U << line)) == 0) {
+
+            variable.FirstLine = (int32_t)line;
+
+            LinesInUse |= 1U << line;
+        }
+    }
+
+    for (VCD_VARIABLE& variable : Variables) {
+        uint32_t mask;
+
+        if (variable.FirstLine >= 0 || variable.Width == 0) {
+            continue;
+        }
+
+        //
+        // Find the next run of free lines wide enough
+        //
+        for (; next + variable.Width <= 32; next++) {
+
+            mask = (uint32_t)(((1ULL << variable.Width) - 1) << next);
+
+            if ((LinesInUse & mask) == 0) {
+
+                variable.FirstLine = (int32_t)next;
+
+                LinesInUse |= mask;
+
+                next += variable.Width;
+
+                break;
+            }
+        }
+    }
+}
+
+bool
+DioVcdReader::Open(const char* Path)
+{
+    const char* token;
+    size_t      length;
+    uint64_t    time;
+
+    Close();
+
+    BadInput            = false;
+    TimescaleMultiplier = 1;
+    TimescaleDivisor    = 1;
+    LineState           = 0;
+
+    File   = fopen(Path, "rb");
+    Buffer = static_cast<char*>(malloc(VCD_BUFFER_SIZE));
+
+    if (File == nullptr || Buffer == nullptr) {
+        goto failed;
+    }
+
+    Position  = 0;
+    Limit     = 0;
+    EndOfFile = false;
+
+    //
+    // -1 for identifiers of one and two characters that aren't in use
+    //
+    ShortIds.assign(VCD_ID_CHARS * (VCD_ID_CHARS + 1), (int16_t)-1);
+
+    //
+    // The header
+    //
+    for (;;) {
+
+        if (!NextToken(&token, &length)) {
+            goto failed;
+        }
+
+        if (TokenIs(token, length, "$enddefinitions")) {
+
+            if (!SkipToEnd()) {
+                goto failed;
+            }
+
+            break;
+        }
+
+        if (TokenIs(token, length, "$timescale")) {
+
+            if (!ParseTimescale()) {
+                goto failed;
+            }
+
+        } else if (TokenIs(token, length, "$var")) {
+
+            if (!ParseVar()) {
+                goto failed;
+            }
+
+        } else if (length != 0 && token[0] == '$') {
+
+            //
+            // $date, $version, $comment, $scope, $upscope...
+            //
+            if (!SkipToEnd()) {
+                goto failed;
+            }
+
+        } else {
+            goto failed;
+        }
+    }
+
+    AssignLines();
+
+    //
+    // Everything up to the end of the first time step is the initial state
+    //
+    AtEnd = !ParseUntilTime(&time);
+
+    if (!AtEnd) {
+
+        CurrentTime = time;
+        AtEnd       = !ParseUntilTime(&time);
+    }
+
+    InitialLines = LineState;
+    EmittedState = LineState;
+
+    if (!AtEnd) {
+        CurrentTime = time;
+    }
+
+    return true;
+
+failed:
+
+    Close();
+
+    return false;
+}
+
+//
+// Apply a value, given as a string of bits (most significant first) to a
+// variable
+//
+void
+DioVcdReader::SetValue(int32_t     Variable,
+                       const char* Bits,
+                       size_t      Length)
+{
+    const VCD_VARIABLE& variable = Variables[(size_t)Variable];
+    uint32_t            value    = 0;
+    uint32_t            mask;
+
+    if (variable.FirstLine < 0) {
+        return;
+    }
+
+    //
+    // If there are fewer bits than the variable is wide, VCD says to
+    // extend on the left with zeros (or with x or z, which read as zero to
+    // us anyway)
+    //
+    if (Length > variable.Width) {
+
+        Bits   += Length - variable.Width;
+        Length  = variable.Width;
+    }
+
+    for (size_t i = 0; i < Length; i++) {
+        value = (value << 1) | (Bits[i] == '1' ? 1U : 0U);
+    }
+
+    mask = (uint32_t)(((1ULL << variable.Width) - 1) << variable.FirstLine);
+
+    LineState = (LineState & ~mask) | ((value << variable.FirstLine) & mask);
+}
+
+//
+// Process value changes until we reach the next timestamp, which we return
+// in nanoseconds.  Returns false at the end of the file.
+//
+bool
+DioVcdReader::ParseUntilTime(uint64_t* Time)
+{
+    const char* token;
+    size_t      length;
+    const char* bits;
+    size_t      bitCount;
+    int32_t     variable;
+    uint64_t    time;
+
+    while (NextToken(&token, &length)) {
+
+        switch (token[0]) {
+
+            case '#':
+
+                if (!ParseNumber(token + 1, length - 1, &time)) {
+
+                    BadInput = true;
+
+                    return false;
+                }
+
+                *Time = time * TimescaleMultiplier / TimescaleDivisor;
+
+                return true;
+
+            case '0':
+            case '1':
+            case 'x':
+            case 'X':
+            case 'z':
+            case 'Z':
+
+                variable = FindVariable(token + 1, length - 1);
+
+                if (variable >= 0) {
+                    SetValue(variable, token, 1);
+                }
+                break;
+
+            case 'b':
+            case 'B':
+
+                bits     = token + 1;
+                bitCount = length - 1;
+
+                //
+                // The bits are in the token we were just given, which the
+                // next NextToken may move.  Values are at most 32 bits
+                // wide for us, so keep the low 32.
+                //
+                {
+                    char value[32];
+
+                    if (bitCount > sizeof(value)) {
+
+                        bits     += bitCount - sizeof(value);
+                        bitCount  = sizeof(value);
+                    }
+
+                    memcpy(value, bits, bitCount);
+
+                    if (!NextToken(&token, &length)) {
+
+                        BadInput = true;
+
+                        return false;
+                    }
+
+                    variable = FindVariable(token, length);
+
+                    if (variable >= 0) {
+                        SetValue(variable, value, bitCount);
+                    }
+                }
+                break;
+
+            case 'r':
+            case 'R':
+
+                //
+                // Real values have nothing to do with us, but we do need
+                // to skip the identifier
+                //
+                if (!NextToken(&token, &length)) {
+
+                    BadInput = true;
+
+                    return false;
+                }
+                break;
+
+            case '$':
+
+                if (TokenIs(token, length, "$comment")) {
+
+                    if (!SkipToEnd()) {
+                        return false;
+                    }
+                }
+
+                //
+                // $dumpvars, $dumpall, $dumpon, $dumpoff and their $ends
+                // just bracket value changes
+                //
+                break;
+
+            default:
+
+                BadInput = true;
+                break;
+        }
+    }
+
+    return false;
+}
+
+size_t
+DioVcdReader::Read(PDIO_EVENT Events,
+                   size_t     Count)
+{
+    size_t   total = 0;
+    uint64_t time;
+
+    while (total < Count && !AtEnd) {
+
+        //
+        // Gather all of the changes at CurrentTime
+        //
+        AtEnd = !ParseUntilTime(&time);
+
+        if (LineState != EmittedState) {
+
+            Events[total].Timestamp    = CurrentTime;
+            Events[total].LineState    = LineState;
+            Events[total].ChangedLines = LineState ^ EmittedState;
+
+            EmittedState = LineState;
+
+            total++;
+        }
+
+        if (!AtEnd) {
+            CurrentTime = time;
+        }
+    }
+
+    return total;
+}
@@ -0,0 +1,250 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioVcd.h -- Value Change Dump (VCD) export and import
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      VCD (IEEE 1364) is the lingua franca of waveform viewers, so
+//      exporting to it lets a capture be examined in GTKWave and friends.
+//      Importing it lets recorded field waveforms, from us or from any
+//      other tool, be played into the simulator.
+//
+//      Both directions stream through fixed-size buffers, so the size of
+//      the file doesn't matter: hundreds of millions of events take no more
+//      memory than a hundred.
+//
+//      Timestamps in the VCD files we write are in nanoseconds.  The values
+//      at the first timestamp in a VCD file are its initial state, not an
+//      event.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DioCaptureWriter.h"
+
+//
+// DIO_VCD_CONFIG
+//
+// LineNames, if not nullptr, is an array of 32 names.  Lines without a name
+// (or all of them, if there's no array) are called "line0" through "line31".
+//
+typedef struct _DIO_VCD_CONFIG {
+    uint32_t            LineMask;       // lines to include in the file
+    const char* const*  LineNames;
+    const char*         ScopeName;      // module holding the lines
+} DIO_VCD_CONFIG, *PDIO_VCD_CONFIG;
+
+//
+// All lines, with the default names, in a module called "osrdio"
+//
+void DioVcdDefaultConfig(PDIO_VCD_CONFIG Config);
+
+//
+// DioVcdWriter
+//
+// Writes a stream of events as a VCD file.  The header, and the initial
+// state of the lines, are written along with the first events.
+//
+class DioVcdWriter
+{
+public:
+    DioVcdWriter(DioCaptureSink*       Sink,
+                 const DIO_VCD_CONFIG& Config);
+    ~DioVcdWriter();
+
+    DioVcdWriter(const DioVcdWriter&) = delete;
+    DioVcdWriter& operator=(const DioVcdWriter&) = delete;
+
+    bool Append(const DIO_EVENT* Events,
+                size_t           Count);
+
+    //
+    // Write out anything buffered and flush the sink
+    //
+    bool Finish();
+
+    //
+    // Write every event from Source, and then Finish
+    //
+    bool Export(DioEventSource& Source);
+
+    uint64_t BytesWritten() const
+    {
+        return TotalBytes;
+    }
+
+private:
+    bool WriteHeader(uint32_t InitialState);
+
+    bool Drain();
+
+    void Put(const char* Text);
+
+    void PutNumber(uint64_t Value);
+
+    DioCaptureSink* Sink;
+    DIO_VCD_CONFIG  Config;
+    char*           Buffer;
+    size_t          Used;
+    bool            Started;
+    bool            Failed;
+    uint32_t        LineState;
+    uint64_t        LastTimestamp;
+    uint64_t        TotalBytes;
+};
+
+//
+// DioVcdReader
+//
+// Reads a VCD file as a stream of events.
+//
+// By default, each 1-bit variable named "line<n>" becomes line n, and the
+// remaining variables (in the order they're declared) take the remaining
+// lines, a vector taking as many consecutive lines as it has bits.  Use
+// MapSignal before Open to choose exactly which signals become which lines
+// instead.
+//
+// Values other than 0 and 1 (x, z) read as 0.  Real variables are ignored.
+//
+class DioVcdReader : public DioEventSource
+{
+public:
+    DioVcdReader();
+    ~DioVcdReader() override;
+
+    DioVcdReader(const DioVcdReader&) = delete;
+    DioVcdReader& operator=(const DioVcdReader&) = delete;
+
+    //
+    // Map the signal with the given name (ignoring scopes) to Line, or for
+    // a vector, to consecutive lines starting at Line
+    //
+    void MapSignal(const char* Name,
+                   uint32_t    Line);
+
+    //
+    // Opens the file and reads its header.  Returns false if it isn't a
+    // VCD file we understand.
+    //
+    bool Open(const char* Path);
+
+    void Close();
+
+    //
+    // State of the lines at the first timestamp in the file
+    //
+    uint32_t InitialState() const
+    {
+        return InitialLines;
+    }
+
+    //
+    // Mask of the lines that have a signal mapped to them
+    //
+    uint32_t MappedLines() const
+    {
+        return LinesInUse;
+    }
+
+    size_t Read(PDIO_EVENT Events,
+                size_t     Count) override;
+
+    //
+    // True if the file ended in the middle of something, or contained
+    // something we couldn't parse
+    //
+    bool Malformed() const
+    {
+        return BadInput;
+    }
+
+private:
+    typedef struct _VCD_VARIABLE {
+        std::string Name;
+        uint32_t    Width;
+        int32_t     FirstLine;      // -1 if not mapped
+    } VCD_VARIABLE;
+
+    bool NextToken(const char** Token,
+                   size_t*      Length);
+
+    bool SkipToEnd();
+
+    bool ParseTimescale();
+
+    bool ParseVar();
+
+    void AssignLines();
+
+    static int32_t ShortIdSlot(const char* Id,
+                               size_t      Length);
+
+    int32_t FindVariable(const char* Id,
+                         size_t      Length);
+
+    void SetValue(int32_t     Variable,
+                  const char* Bits,
+                  size_t      Length);
+
+    bool ParseUntilTime(uint64_t* Time);
+
+    FILE*                                File;
+    char*                                Buffer;
+    size_t                               Position;
+    size_t                               Limit;
+    bool                                 EndOfFile;
+    bool                                 BadInput;
+
+    uint64_t                             TimescaleMultiplier;
+    uint64_t                             TimescaleDivisor;
+
+    std::vector<VCD_VARIABLE>            Variables;
+    std::vector<int16_t>                 ShortIds;
+    std::unordered_map<std::string, int> LongIds;
+    std::vector<std::pair<std::string, uint32_t>> Mappings;
+
+    uint64_t                             CurrentTime;
+    bool                                 AtEnd;
+    uint32_t                             LineState;
+    uint32_t                             EmittedState;
+    uint32_t                             InitialLines;
+    uint32_t                             LinesInUse;
+};
@@ -0,0 +1,289 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioCaptureSvc.cpp -- Capture daemon: records every change on
+//                             the DIO lines to rotating capture files
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      Attaches an event ring to the driver (IOCTL_OSRDIO_ATTACH_EVENT_RING)
+//      and records everything the ISR puts in it, using DioCaptureRecorder,
+//      until it's stopped with Ctrl+C or the requested duration is up.
+//      Once a second it reports the sustained event rate, the bandwidth to
+//      disk, the CPU time spent per million events, and any overflows.
+//
+//      With -s (and always, on hosts other than Windows) the events come
+//      from a simulated ring instead, filled at the given average rate.
+//      That's handy for sizing disks and checking rotation without the
+//      hardware.
+//
+//      This is a plain console program.  To run it unattended, start it
+//      from a service wrapper or the task scheduler.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include "../DioCapture/DioCaptureRecorder.h"
+#include "../DioSim/DioSimEventRing.h"
+
+//
+// Events in the ring we attach to the driver.  1M events (16MB) covers
+// more than a tenth of a second at the fastest rate the hardware can
+// interrupt, which is more than enough to ride out a disk hiccup.
+//
+constexpr uint32_t CAPTURE_SVC_RING_EVENTS = 1024 * 1024;
+
+static std::atomic<bool> StopRequested(false);
+
+static void
+SignalHandler(int)
+{
+    StopRequested = true;
+}
+
+static void
+Usage()
+{
+    printf("Usage: DioCaptureSvc [-o prefix] [-r rotateMB] [-t rotateSeconds]\n"
+           "                     [-d durationSeconds] [-s simulatedEventsPerSecond]\n");
+}
+
+//
+// Fill the simulated ring with events at (about) Rate per second, each
+// toggling one random line, stamped with the time they're produced.  We
+// produce a millisecond's worth at a time.
+//
+static void
+SimulateEvents(DioSimEventRing& Ring,
+               uint64_t         Rate)
+{
+    DIO_EVENT  batch[256];
+    uint64_t   random = 0x9E3779B97F4A7C15ULL;
+    uint64_t   owed   = 0;
+    uint64_t   now;
+    uint32_t   lineState = 0;
+    size_t     count;
+
+    auto next = std::chrono::steady_clock::now();
+
+    while (!StopRequested) {
+
+        next += std::chrono::milliseconds(1);
+
+        std::this_thread::sleep_until(next);
+
+        owed += Rate;
+        now   = DioSimEventRing::Now();
+
+        while (owed >= 1000) {
+
+            count = 0;
+
+            while (owed >= 1000 && count < 256) {
+
+                random ^= random >> 12;
+                random ^= random << 25;
+                random ^= random >> 27;
+
+                batch[count].ChangedLines = 1U << ((random * 0x2545F4914F6CDD1DULL) >> 59);
+
+                lineState ^= batch[count].ChangedLines;
+
+                batch[count].LineState = lineState;
+                batch[count].Timestamp = now - (owed / 1000);
+
+                owed -= 1000;
+                count++;
+            }
+
+            Ring.Produce(batch, count);
+        }
+    }
+
+    Ring.Finish();
+}
+
+int
+main(int   argc,
+     char* argv[])
+{
+    DIO_RECORDER_CONFIG                 config = DioRecorderDefaultConfig();
+    std::unique_ptr<DioEventRingSource> source;
+    std::thread                         simulator;
+    uint64_t                            duration = 0;
+    uint64_t                            simRate  = 0;
+    bool                                simulate = false;
+    bool                                result;
+
+    printf("DIOCAPTURESVC -- OSRDIO Capture Daemon V1.0\n");
+
+    config.Prefix = "dio";
+
+    for (int i = 1; i < argc; i++) {
+
+        if (i + 1 >= argc) {
+
+            Usage();
+
+            return EXIT_FAILURE;
+        }
+
+        if (strcmp(argv[i], "-o") == 0) {
+            config.Prefix = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0) {
+            config.RotateBytes = strtoull(argv[++i], nullptr, 0) * 1024 * 1024;
+        } else if (strcmp(argv[i], "-t") == 0) {
+            config.RotateSeconds = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        } else if (strcmp(argv[i], "-d") == 0) {
+            duration = strtoull(argv[++i], nullptr, 0);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            simRate  = strtoull(argv[++i], nullptr, 0);
+            simulate = true;
+        } else {
+
+            Usage();
+
+            return EXIT_FAILURE;
+        }
+    }
+
+#ifdef _WIN32
+    if (!simulate) {
+
+        auto live = std::make_unique<DioLiveEventRing>();
+
+        if (!live->Open(CAPTURE_SVC_RING_EVENTS)) {
+
+            printf("Unable to attach an event ring to the OSRDIO device\n");
+
+            return EXIT_FAILURE;
+        }
+
+        source = std::move(live);
+    }
+#else
+    if (!simulate) {
+
+        simulate = true;
+        simRate  = 100000;
+
+        printf("No OSRDIO device on this host; simulating %llu events/s\n",
+               static_cast<unsigned long long>(simRate));
+    }
+#endif
+
+    if (simulate) {
+
+        auto sim = std::make_unique<DioSimEventRing>(CAPTURE_SVC_RING_EVENTS,
+                                                     10000000);
+
+        simulator = std::thread(SimulateEvents, std::ref(*sim), simRate);
+
+        source = std::move(sim);
+    }
+
+    signal(SIGINT, SignalHandler);
+
+    DioCaptureRecorder recorder(*source, config);
+
+    //
+    // Report once a second, and stop when the time's up
+    //
+    std::thread monitor([&recorder, duration] {
+        DIO_RECORDER_STATS previous = recorder.Stats();
+        uint64_t           seconds  = 0;
+
+        while (!StopRequested) {
+
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+
+            DIO_RECORDER_STATS stats = recorder.Stats();
+
+            uint64_t events = stats.Events - previous.Events;
+            uint64_t cpuNs  = stats.CpuNs - previous.CpuNs;
+
+            printf("%8llu events/s %8.2f MB/s %8.2f ms CPU/Mevent %6llu overflows\n",
+                   static_cast<unsigned long long>(events),
+                   (stats.Bytes - previous.Bytes) / 1e6,
+                   events != 0 ? cpuNs / 1e6 / (events / 1e6) : 0.0,
+                   static_cast<unsigned long long>(stats.Overflows));
+
+            previous = stats;
+
+            if (duration != 0 && ++seconds >= duration) {
+                StopRequested = true;
+            }
+        }
+    });
+
+    result = recorder.Run(StopRequested);
+
+    StopRequested = true;
+
+    monitor.join();
+
+    if (simulator.joinable()) {
+        simulator.join();
+    }
+
+    DIO_RECORDER_STATS stats = recorder.Stats();
+
+    printf("Recorded %llu events (%llu bytes) in %llu file(s), %llu overflows, "
+           "%.2f ms CPU per million events%s%s\n",
+           static_cast<unsigned long long>(stats.Events),
+           static_cast<unsigned long long>(stats.Bytes),
+           static_cast<unsigned long long>(stats.Files),
+           static_cast<unsigned long long>(stats.Overflows),
+           stats.Events != 0 ? stats.CpuNs / 1e6 / (stats.Events / 1e6) : 0.0,
+           stats.ZeroCopy ? ", in place" : "",
+           stats.Unbuffered ? ", unbuffered" : "");
+
+    if (!result) {
+
+        printf("Capture failed writing %s\n",
+               recorder.CurrentFile().c_str());
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
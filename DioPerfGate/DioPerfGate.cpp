@@ -0,0 +1,906 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioPerfGate.cpp -- Performance regression gate for the OsrDio
+//                           benchmarks
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      Runs the simulator benchmarks (or the ones named) several times,
+//      with DioBench -csv, and either saves what they measured as a
+//      baseline (-save) or compares it with one saved before (-compare),
+//      reporting the metrics that have got significantly worse or better.
+//
+//      A baseline is a CSV file with one line per metric: its benchmark,
+//      name and unit, and the number of runs, mean and standard deviation
+//      of its values.  Baselines depend on the host, so keep one per
+//      machine you gate on.
+//
+//      Correctness checks aren't measurements, and aren't compared with
+//      the baseline at all (see GateIsCheck): any run with a mismatch or an
+//      error, or with a pass/fail result (unit bool) of 0, fails the gate,
+//      whatever the other runs said.  We won't save a baseline from runs
+//      that failed a check either.
+//
+//      Whether any other metric is gated, and which way is worse, goes by
+//      its unit (see GateDirection): times, including latency percentiles,
+//      are worse when they go up, and throughputs (anything per second)
+//      and speedups when they go down.  Allocations and register accesses
+//      per operation are worse when they go up.  Other metrics (counts of
+//      events and the like) describe the run, and aren't gated.
+//
+//      The runs give a mean and standard deviation for each metric, from
+//      which we take a 95% confidence interval of the change in the mean
+//      (Welch's t interval, since the two sets of runs needn't be the same
+//      size or equally noisy).  A metric has regressed when that whole
+//      interval is on the worse side of no change, and the change is at
+//      least the threshold (10% by default).  Metrics that don't vary
+//      from run to run (register accesses, allocations, and most results
+//      in virtual time) are compared exactly.
+//
+//      The report lists only the checks that failed and the metrics that
+//      changed, and a summary; it can also be written to a file (-report)
+//      to go with the change.  We exit with EXIT_FAILURE if a check failed
+//      or anything regressed.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+constexpr uint32_t GATE_DEFAULT_RUNS      = 5;
+constexpr double   GATE_DEFAULT_THRESHOLD = 10.0;
+
+static const char GateRunFile[] = "DioPerfGate.run.tmp";
+
+//
+// The simulator benchmarks, which are what we gate on unless told
+// otherwise.  The others measure the host's disks and sockets as much as
+// our code.
+//
+static const char* const GateDefaultBenchmarks[] = {
+    "ports",
+    "priority",
+    "dpc",
+    "wake",
+    "startup",
+    "reconfig",
+    "registers",
+    "mmio",
+    "soak",
+    "waveforms",
+    "filters",
+    "trace",
+    "dispatch",
+};
+
+//
+// GATE_METRIC
+//
+// One metric: its values from each run (as they're gathered), or their
+// summary (as it's saved in a baseline)
+//
+typedef struct _GATE_METRIC {
+    std::string         Benchmark;
+    std::string         Name;
+    std::string         Unit;
+    std::vector<double> Values;
+    uint32_t            Runs;
+    double              Mean;
+    double              StdDev;
+} GATE_METRIC, *PGATE_METRIC;
+
+//
+// GATE_RESULTS
+//
+// Metrics in the order DioBench reported them, with an index by
+// "benchmark metric"
+//
+typedef struct _GATE_RESULTS {
+    std::vector<GATE_METRIC>      Metrics;
+    std::map<std::string, size_t> Index;
+} GATE_RESULTS, *PGATE_RESULTS;
+
+enum class GateDirection {
+    NotGated,
+    LowerIsBetter,
+    HigherIsBetter,
+};
+
+enum class GateVerdict {
+    Unchanged,
+    Regressed,
+    Improved,
+};
+
+static void
+Usage()
+{
+    printf("Usage: DioPerfGate [-runs n] [-threshold percent] [-bench DioBench]\n"
+           "                   [-report file] {-save | -compare} baseline [benchmark...]\n");
+}
+
+static PGATE_METRIC
+GateFind(GATE_RESULTS&      Results,
+         const std::string& Benchmark,
+         const std::string& Name)
+{
+    auto entry = Results.Index.find(Benchmark + " " + Name);
+
+    if (entry == Results.Index.end()) {
+        return nullptr;
+    }
+
+    return &Results.Metrics[entry->second];
+}
+
+static PGATE_METRIC
+GateAdd(GATE_RESULTS&      Results,
+        const std::string& Benchmark,
+        const std::string& Name,
+        const std::string& Unit)
+{
+    PGATE_METRIC metric = GateFind(Results, Benchmark, Name);
+
+    if (metric != nullptr) {
+        return metric;
+    }
+
+    Results.Index[Benchmark + " " + Name] = Results.Metrics.size();
+
+    Results.Metrics.push_back(GATE_METRIC{ Benchmark, Name, Unit, {}, 0, 0, 0 });
+
+    return &Results.Metrics.back();
+}
+
+//
+// Split a CSV line (none of our fields have commas or quotes in them)
+//
+static std::vector<std::string>
+GateSplit(const char* Line)
+{
+    std::vector<std::string> fields(1);
+
+    for (const char* c = Line; *c != '\0' && *c != '\r' && *c != '\n'; c++) {
+
+        if (*c == ',') {
+            fields.emplace_back();
+        } else {
+            fields.back() += *c;
+        }
+    }
+
+    return fields;
+}
+
+//
+// Add the values from one run of DioBench -csv to Results
+//
+static bool
+GateReadRun(const char*   Path,
+            GATE_RESULTS& Results)
+{
+    FILE* file;
+    char  line[512];
+    bool  header = true;
+
+    file = fopen(Path, "r");
+
+    if (file == nullptr) {
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), file) != nullptr) {
+
+        std::vector<std::string> fields = GateSplit(line);
+
+        if (header) {
+            header = false;
+            continue;
+        }
+
+        if (fields.size() != 4) {
+            continue;
+        }
+
+        GateAdd(Results, fields[0], fields[1], fields[3])->Values.push_back(atof(fields[2].c_str()));
+    }
+
+    fclose(file);
+
+    return !header;
+}
+
+//
+// Run DioBench Runs times, gathering every metric's values
+//
+static bool
+GateRunBenchmarks(const std::string&              Bench,
+                  uint32_t                        Runs,
+                  const std::vector<const char*>& Benchmarks,
+                  GATE_RESULTS&                   Results)
+{
+    std::string command = "\"" + Bench + "\" -csv " + GateRunFile;
+
+    for (const char* benchmark : Benchmarks) {
+        command += std::string(" ") + benchmark;
+    }
+
+#if defined(_WIN32)
+    command += " > NUL";
+#else
+    command += " > /dev/null";
+#endif
+
+    for (uint32_t run = 0; run < Runs; run++) {
+
+        printf("Run %u of %u...\n", run + 1, Runs);
+
+        fflush(stdout);
+
+        if (system(command.c_str()) != 0 || !GateReadRun(GateRunFile, Results)) {
+
+            printf("Unable to run %s\n", Bench.c_str());
+
+            remove(GateRunFile);
+
+            return false;
+        }
+    }
+
+    remove(GateRunFile);
+
+    for (GATE_METRIC& metric : Results.Metrics) {
+
+        double sum     = 0;
+        double squares = 0;
+
+        for (double value : metric.Values) {
+            sum += value;
+        }
+
+        metric.Runs = static_cast<uint32_t>(metric.Values.size());
+        metric.Mean = sum / metric.Runs;
+
+        for (double value : metric.Values) {
+            squares += (value - metric.Mean) * (value - metric.Mean);
+        }
+
+        metric.StdDev = metric.Runs > 1 ? sqrt(squares / (metric.Runs - 1)) : 0;
+    }
+
+    return true;
+}
+
+static bool
+GateSaveBaseline(const char*         Path,
+                 const GATE_RESULTS& Results)
+{
+    FILE* file;
+
+    file = fopen(Path, "w");
+
+    if (file == nullptr) {
+        return false;
+    }
+
+    fprintf(file, "benchmark,metric,unit,runs,mean,stddev\n");
+
+    for (const GATE_METRIC& metric : Results.Metrics) {
+
+        fprintf(file,
+                "%s,%s,%s,%u,%.9g,%.9g\n",
+                metric.Benchmark.c_str(),
+                metric.Name.c_str(),
+                metric.Unit.c_str(),
+                metric.Runs,
+                metric.Mean,
+                metric.StdDev);
+    }
+
+    return fclose(file) == 0;
+}
+
+static bool
+GateLoadBaseline(const char*   Path,
+                 GATE_RESULTS& Results)
+{
+    FILE* file;
+    char  line[512];
+    bool  header = true;
+
+    file = fopen(Path, "r");
+
+    if (file == nullptr) {
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), file) != nullptr) {
+
+        std::vector<std::string> fields = GateSplit(line);
+        PGATE_METRIC             metric;
+
+        if (header) {
+            header = false;
+            continue;
+        }
+
+        if (fields.size() != 6) {
+            continue;
+        }
+
+        metric = GateAdd(Results, fields[0], fields[1], fields[2]);
+
+        metric->Runs   = static_cast<uint32_t>(strtoul(fields[3].c_str(), nullptr, 10));
+        metric->Mean   = atof(fields[4].c_str());
+        metric->StdDev = atof(fields[5].c_str());
+    }
+
+    fclose(file);
+
+    return !header;
+}
+
+static bool
+GateEndsWith(const std::string& String,
+             const char*        Suffix)
+{
+    size_t length = strlen(Suffix);
+
+    return String.size() >= length &&
+           String.compare(String.size() - length, length, Suffix) == 0;
+}
+
+//
+// Whether a metric is a correctness check, by its name (mismatches or
+// errors) or its unit (bool), whatever unit it's counted in
+//
+static bool
+GateIsCheck(const GATE_METRIC& Metric)
+{
+    return Metric.Unit == "bool" ||
+           GateEndsWith(Metric.Name, "mismatches") ||
+           GateEndsWith(Metric.Name, "errors");
+}
+
+//
+// Whether one run's value of a check failed it
+//
+static bool
+GateCheckFailed(const GATE_METRIC& Metric,
+                double             Value)
+{
+    return Metric.Unit == "bool" ? Value == 0 : Value != 0;
+}
+
+//
+// Which way a metric is worse, by its unit (and, for the counts that are
+// per operation, its name)
+//
+static GateDirection
+GateDirectionOf(const GATE_METRIC& Metric)
+{
+    static const char* const timeUnits[] = {
+        "ns", "us", "ms", "s", "ns/word", "ns/event",
+    };
+
+    const std::string& unit = Metric.Unit;
+
+    for (const char* timeUnit : timeUnits) {
+
+        if (unit == timeUnit) {
+            return GateDirection::LowerIsBetter;
+        }
+    }
+
+    if (unit == "allocs") {
+        return GateDirection::LowerIsBetter;
+    }
+
+    if (unit == "count" && Metric.Name.find("_per_op") != std::string::npos) {
+        return GateDirection::LowerIsBetter;
+    }
+
+    if (unit == "x" ||
+        (unit.size() > 2 && unit.compare(unit.size() - 2, 2, "/s") == 0)) {
+
+        return GateDirection::HigherIsBetter;
+    }
+
+    return GateDirection::NotGated;
+}
+
+//
+// The two-sided 95% critical value of Student's t distribution with
+// Degrees degrees of freedom
+//
+static double
+GateTCritical(double Degrees)
+{
+    static const double table[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+         2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+         2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+
+    if (Degrees < 1) {
+        return table[0];
+    }
+
+    if (Degrees <= 30) {
+        return table[static_cast<uint32_t>(Degrees) - 1];
+    }
+
+    if (Degrees <= 60) {
+        return 2.000;
+    }
+
+    if (Degrees <= 120) {
+        return 1.980;
+    }
+
+    return 1.960;
+}
+
+//
+// Compare Current with Baseline.  Change is the change in the mean,
+// Low and High its 95% confidence interval, all as fractions of the
+// baseline's mean (or, if that's zero, absolute).
+//
+static GateVerdict
+GateCompare(const GATE_METRIC& Baseline,
+            const GATE_METRIC& Current,
+            GateDirection      Direction,
+            double             Threshold,
+            double*            Change,
+            double*            Low,
+            double*            High)
+{
+    double difference = Current.Mean - Baseline.Mean;
+    double scale      = Baseline.Mean != 0 ? fabs(Baseline.Mean) : 1;
+    double margin     = 0;
+    bool   significant;
+    bool   worse;
+
+    //
+    // Welch's t interval, if both have the runs to give one
+    //
+    if (Baseline.Runs > 1 && Current.Runs > 1) {
+
+        double baselineVariance = Baseline.StdDev * Baseline.StdDev / Baseline.Runs;
+        double currentVariance  = Current.StdDev * Current.StdDev / Current.Runs;
+        double variance         = baselineVariance + currentVariance;
+
+        if (variance > 0) {
+
+            double degrees = variance * variance /
+                             (baselineVariance * baselineVariance / (Baseline.Runs - 1) +
+                              currentVariance * currentVariance / (Current.Runs - 1));
+
+            margin = GateTCritical(degrees) * sqrt(variance);
+        }
+    }
+
+    *Change = difference / scale;
+    *Low    = (difference - margin) / scale;
+    *High   = (difference + margin) / scale;
+
+    significant = (difference - margin > 0) || (difference + margin < 0);
+
+    if (!significant) {
+        return GateVerdict::Unchanged;
+    }
+
+    if (Baseline.Mean != 0 && fabs(*Change) * 100 < Threshold) {
+        return GateVerdict::Unchanged;
+    }
+
+    worse = (Direction == GateDirection::LowerIsBetter) ? (difference > 0) : (difference < 0);
+
+    return worse ? GateVerdict::Regressed : GateVerdict::Improved;
+}
+
+//
+// Print the report, and keep it to write to a file
+//
+static void
+GateReport(std::string& Report,
+           const char*  Format,
+           ...)
+{
+    char    line[512];
+    va_list arguments;
+
+    va_start(arguments, Format);
+
+    vsnprintf(line, sizeof(line), Format, arguments);
+
+    va_end(arguments);
+
+    printf("%s", line);
+
+    Report += line;
+}
+
+static void
+GateReportChange(std::string&       Report,
+                 const char*        Verdict,
+                 const GATE_METRIC& Baseline,
+                 const GATE_METRIC& Current,
+                 double             Change,
+                 double             Low,
+                 double             High)
+{
+    char name[128];
+
+    snprintf(name, sizeof(name), "%s %s", Current.Benchmark.c_str(), Current.Name.c_str());
+
+    if (Baseline.Mean != 0) {
+
+        GateReport(Report,
+                   "%-10s %-44s %12.3f -> %12.3f %-10s %+7.1f%% (95%% CI %+.1f%% to %+.1f%%)\n",
+                   Verdict,
+                   name,
+                   Baseline.Mean,
+                   Current.Mean,
+                   Current.Unit.c_str(),
+                   Change * 100,
+                   Low * 100,
+                   High * 100);
+    } else {
+
+        GateReport(Report,
+                   "%-10s %-44s %12.3f -> %12.3f %-10s\n",
+                   Verdict,
+                   name,
+                   Baseline.Mean,
+                   Current.Mean,
+                   Current.Unit.c_str());
+    }
+}
+
+//
+// Report every check that failed in any run, returning how many did
+//
+static uint32_t
+GateCheckRuns(std::string&        Report,
+              const GATE_RESULTS& Results,
+              uint32_t*           Checks)
+{
+    uint32_t failed = 0;
+
+    *Checks = 0;
+
+    for (const GATE_METRIC& metric : Results.Metrics) {
+
+        uint32_t failedRuns = 0;
+        double   value      = 0;
+        char     name[128];
+
+        if (!GateIsCheck(metric)) {
+            continue;
+        }
+
+        (*Checks)++;
+
+        for (double runValue : metric.Values) {
+
+            if (GateCheckFailed(metric, runValue)) {
+
+                if (failedRuns == 0) {
+                    value = runValue;
+                }
+
+                failedRuns++;
+            }
+        }
+
+        if (failedRuns == 0) {
+            continue;
+        }
+
+        snprintf(name, sizeof(name), "%s %s", metric.Benchmark.c_str(), metric.Name.c_str());
+
+        GateReport(Report,
+                   "%-10s %-44s %12.3f %-10s in %u of %zu runs\n",
+                   "FAILED",
+                   name,
+                   value,
+                   metric.Unit.c_str(),
+                   failedRuns,
+                   metric.Values.size());
+
+        failed++;
+    }
+
+    return failed;
+}
+
+//
+// The benchmark's group: its name up to the first dot
+//
+static std::string
+GateGroup(const std::string& Benchmark)
+{
+    return Benchmark.substr(0, Benchmark.find('.'));
+}
+
+int
+main(int   argc,
+     char* argv[])
+{
+    std::vector<const char*> benchmarks;
+    GATE_RESULTS             current;
+    GATE_RESULTS             baseline;
+    std::string              bench;
+    std::string              report;
+    const char*              baselinePath = nullptr;
+    const char*              reportPath   = nullptr;
+    uint32_t                 runs         = GATE_DEFAULT_RUNS;
+    double                   threshold    = GATE_DEFAULT_THRESHOLD;
+    bool                     save         = false;
+    uint32_t                 regressed    = 0;
+    uint32_t                 improved     = 0;
+    uint32_t                 unchanged    = 0;
+    uint32_t                 notGated     = 0;
+    uint32_t                 added        = 0;
+    uint32_t                 missing      = 0;
+    uint32_t                 checks;
+    uint32_t                 failed;
+
+    printf("DIOPERFGATE -- OSRDIO Performance Regression Gate V1.0\n");
+
+    //
+    // DioBench is built next to us
+    //
+    bench = argv[0];
+
+    bench.erase(bench.find_last_of("/\\") == std::string::npos ? 0 : bench.find_last_of("/\\") + 1);
+
+#if defined(_WIN32)
+    bench += "DioBench.exe";
+#else
+    bench = (bench.empty() ? "./" : bench) + "DioBench";
+#endif
+
+    for (int i = 1; i < argc; i++) {
+
+        if (argv[i][0] != '-') {
+
+            benchmarks.push_back(argv[i]);
+
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+
+            Usage();
+
+            return EXIT_FAILURE;
+        }
+
+        if (strcmp(argv[i], "-runs") == 0) {
+            runs = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        } else if (strcmp(argv[i], "-threshold") == 0) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-bench") == 0) {
+            bench = argv[++i];
+        } else if (strcmp(argv[i], "-report") == 0) {
+            reportPath = argv[++i];
+        } else if (strcmp(argv[i], "-save") == 0) {
+            save         = true;
+            baselinePath = argv[++i];
+        } else if (strcmp(argv[i], "-compare") == 0) {
+            save         = false;
+            baselinePath = argv[++i];
+        } else {
+
+            Usage();
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (baselinePath == nullptr || runs == 0) {
+
+        Usage();
+
+        return EXIT_FAILURE;
+    }
+
+    if (benchmarks.empty()) {
+        benchmarks.assign(std::begin(GateDefaultBenchmarks), std::end(GateDefaultBenchmarks));
+    }
+
+    if (!save && !GateLoadBaseline(baselinePath, baseline)) {
+
+        printf("Unable to read the baseline %s\n", baselinePath);
+
+        return EXIT_FAILURE;
+    }
+
+    if (!GateRunBenchmarks(bench, runs, benchmarks, current)) {
+        return EXIT_FAILURE;
+    }
+
+    if (save) {
+
+        if (GateCheckRuns(report, current, &checks) != 0) {
+
+            printf("FAIL: not saving a baseline from runs that failed their checks\n");
+
+            return EXIT_FAILURE;
+        }
+
+        if (!GateSaveBaseline(baselinePath, current)) {
+
+            printf("Unable to write the baseline %s\n", baselinePath);
+
+            return EXIT_FAILURE;
+        }
+
+        printf("Saved %zu metrics from %u runs to %s\n",
+               current.Metrics.size(),
+               runs,
+               baselinePath);
+
+        return EXIT_SUCCESS;
+    }
+
+    GateReport(report,
+               "Compared %u runs with the baseline %s, at a threshold of %.1f%%\n\n",
+               runs,
+               baselinePath,
+               threshold);
+
+    failed = GateCheckRuns(report, current, &checks);
+
+    for (const GATE_METRIC& metric : current.Metrics) {
+
+        PGATE_METRIC  before = GateFind(baseline, metric.Benchmark, metric.Name);
+        GateDirection direction;
+        double        change;
+        double        low;
+        double        high;
+
+        if (GateIsCheck(metric)) {
+            continue;
+        }
+
+        if (before == nullptr) {
+
+            added++;
+
+            continue;
+        }
+
+        direction = GateDirectionOf(metric);
+
+        if (direction == GateDirection::NotGated) {
+
+            notGated++;
+
+            continue;
+        }
+
+        switch (GateCompare(*before, metric, direction, threshold, &change, &low, &high)) {
+
+            case GateVerdict::Regressed:
+
+                GateReportChange(report, "REGRESSED", *before, metric, change, low, high);
+
+                regressed++;
+
+                break;
+
+            case GateVerdict::Improved:
+
+                GateReportChange(report, "improved", *before, metric, change, low, high);
+
+                improved++;
+
+                break;
+
+            default:
+
+                unchanged++;
+
+                break;
+        }
+    }
+
+    //
+    // Metrics in the baseline that we no longer report, from benchmarks
+    // we ran
+    //
+    for (const GATE_METRIC& metric : baseline.Metrics) {
+
+        if (GateFind(current, metric.Benchmark, metric.Name) != nullptr) {
+            continue;
+        }
+
+        for (const GATE_METRIC& other : current.Metrics) {
+
+            if (GateGroup(other.Benchmark) == GateGroup(metric.Benchmark)) {
+
+                GateReport(report,
+                           "%-10s %s %s\n",
+                           "MISSING",
+                           metric.Benchmark.c_str(),
+                           metric.Name.c_str());
+
+                missing++;
+
+                break;
+            }
+        }
+    }
+
+    GateReport(report,
+               "%s%u of %u checks failed, %u regressed, %u improved, %u unchanged, "
+               "%u not gated, %u new, %u missing\n",
+               (failed + regressed + improved + missing) != 0 ? "\n" : "",
+               failed,
+               checks,
+               regressed,
+               improved,
+               unchanged,
+               notGated,
+               added,
+               missing);
+
+    GateReport(report, "%s\n", (failed + regressed + missing) != 0 ? "FAIL" : "PASS");
+
+    if (reportPath != nullptr) {
+
+        FILE* file = fopen(reportPath, "w");
+
+        if (file == nullptr || fputs(report.c_str(), file) < 0) {
+            printf("Unable to write the report %s\n", reportPath);
+        }
+
+        if (file != nullptr) {
+            fclose(file);
+        }
+    }
+
+    return (failed + regressed + missing) != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
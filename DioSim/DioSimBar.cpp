@@ -0,0 +1,933 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioSimBar.cpp -- Model of the NI PCIe-6509 register BAR
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <algorithm>
+#include <cstdint>
+
+#include "DioSimBar.h"
+#include "DioSimClock.h"
+#include "DioSimTrace.h"
+
+//
+// What the CHInCh (the board's PCIe interface) identifies itself as
+//
+constexpr uint32_t DIO_SIM_CHINCH_ID = 0xC0107AD0;
+
+static uint64_t
+BusTime()
+{
+    return DioSimClock::Now();
+}
+
+//
+// Keep the host waiting on the bus.  Never called with the lock held, so
+// the field side isn't held up too.
+//
+static void
+WaitUntil(uint64_t Time)
+{
+    uint64_t now = BusTime();
+
+    if (Time > now) {
+        DioSimClock::Spend(Time - now);
+    }
+}
+
+DioSimBar::DioSimBar()
+    : InterruptTarget(nullptr),
+      Writes(0),
+      TraceRecorder(nullptr),
+      TraceOrigin(0),
+      LatencyModeled(false),
+      FilteredLines(0),
+      FilterPending(0),
+      FilterRejects(0),
+      FilterWaitDue(0),
+      FilterStopping(false),
+      FieldInputs(0),
+      FilteredInputs(0),
+      InD3(false),
+      PmeEnabled(false),
+      PmeStatus(false),
+      PowerOnTime(0),
+      PowerOnWrites(0),
+      Scratchpad(0),
+      Scrap(0)
+{
+    for (uint64_t& interval : FilterInterval) {
+        interval = 0;
+    }
+
+    SetLatency(DIO_SIM_NO_LATENCY);
+
+    Reset();
+
+    FilterClock = DioSimClock::Thread([this] { FilterClockThread(); });
+}
+
+DioSimBar::~DioSimBar()
+{
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+
+        FilterStopping = true;
+    }
+
+    DioSimClock::Notify(FilterCondition);
+
+    DioSimClock::Join(FilterClock);
+}
+
+void
+DioSimBar::SetLatency(const DIO_SIM_BAR_LATENCY& Latency)
+{
+    std::lock_guard<std::mutex> guard(Lock);
+
+    for (DIO_SIM_BAR_LATENCY& latency : Latencies) {
+        latency = Latency;
+    }
+
+    UpdateLatencyModeledLocked();
+}
+
+void
+DioSimBar::SetRegisterLatency(uint32_t                   Offset,
+                              const DIO_SIM_BAR_LATENCY& Latency)
+{
+    std::lock_guard<std::mutex> guard(Lock);
+
+    Latencies[DioRegisterIndex(Offset)] = Latency;
+
+    UpdateLatencyModeledLocked();
+}
+
+//
+// With no latency anywhere, accesses skip the bus model (and reading the
+// clock) entirely
+//
+void
+DioSimBar::UpdateLatencyModeledLocked()
+{
+    LatencyModeled = false;
+
+    for (const DIO_SIM_BAR_LATENCY& latency : Latencies) {
+
+        if (latency.ReadNs != 0 ||
+            latency.WriteNs != 0 ||
+            latency.PostingNs != 0) {
+
+            LatencyModeled = true;
+        }
+    }
+}
+
+//
+// When a read issued now would reach the device: once the writes posted
+// ahead of it have landed
+//
+uint64_t
+DioSimBar::FlushTimeLocked() const
+{
+    uint64_t now = BusTime();
+
+    if (!PostedWrites.empty() && PostedWrites.back().Due > now) {
+        return PostedWrites.back().Due;
+    }
+
+    return now;
+}
+
+//
+// Bring the device up to Now: land the posted writes that have reached it,
+// in the order they were issued, and pass the filtered changes that are
+// due, each in its turn
+//
+void
+DioSimBar::CatchUpLocked(uint64_t Now)
+{
+    while (true) {
+        uint64_t writeDue  = PostedWrites.empty() ? DIO_SIM_FOREVER : PostedWrites.front().Due;
+        uint64_t filterDue = NextFilterDueLocked();
+
+        if (writeDue > Now && filterDue > Now) {
+            break;
+        }
+
+        if (writeDue <= filterDue) {
+
+            DIO_SIM_POSTED_WRITE write = PostedWrites.front();
+
+            PostedWrites.pop_front();
+
+            WriteLocked(write.Offset, write.Value);
+
+        } else {
+
+            ApplyFiltersLocked(filterDue);
+        }
+    }
+}
+
+//
+// The field has changed the Changed lines.  Unfiltered lines pass straight
+// through.  A filtered line's new level is passed on the second tick of
+// its filter clock after Now, unless it changes back before then.
+//
+void
+DioSimBar::FilterInputsLocked(uint32_t Changed,
+                              uint64_t Now)
+{
+    uint32_t direct = Changed & ~FilteredLines;
+    uint64_t earliest;
+
+    FilteredInputs = (FilteredInputs & ~direct) | (FieldInputs & direct);
+
+    Changed &= FilteredLines;
+
+    if (Changed == 0) {
+        return;
+    }
+
+    earliest = NextFilterDueLocked();
+
+    for (uint32_t line = 0; line < 32; line++) {
+        uint32_t bit = 1U << line;
+        uint64_t interval;
+
+        if ((Changed & bit) == 0) {
+            continue;
+        }
+
+        if ((FilterPending & bit) != 0) {
+
+            //
+            // Back where it was before the filter passed it on
+            //
+            FilterPending &= ~bit;
+            FilterRejects++;
+
+            continue;
+        }
+
+        interval        = FilterInterval[line];
+        FilterDue[line] = PowerOnTime + ((Now - PowerOnTime) / interval + 2) * interval;
+        FilterPending  |= bit;
+
+        if (FilterDue[line] < earliest) {
+            earliest = FilterDue[line];
+        }
+    }
+
+    //
+    // Wake the filter clock if it's waiting for a later change than this
+    //
+    if (earliest < FilterWaitDue) {
+        DioSimClock::Notify(FilterCondition);
+    }
+}
+
+//
+// The filter settings may have changed.  A line whose setting did loses
+// any new level its filter was about to pass, and starts again from the
+// level the field has it at now.
+//
+void
+DioSimBar::UpdateFiltersLocked()
+{
+    uint32_t changed = 0;
+
+    FilteredLines = 0;
+
+    for (uint32_t line = 0; line < 32; line++) {
+        uint64_t interval = DioSimFilterIntervalNs(FilterPort0and1, FilterPort2and3, line);
+
+        if (interval != FilterInterval[line]) {
+
+            FilterInterval[line] = interval;
+            changed             |= 1U << line;
+        }
+
+        if (interval != 0) {
+            FilteredLines |= 1U << line;
+        }
+    }
+
+    FilterPending &= ~changed;
+
+    changed &= FieldInputs ^ FilteredInputs;
+
+    if (changed != 0) {
+        FilterInputsLocked(changed, BusTime());
+    }
+}
+
+uint64_t
+DioSimBar::NextFilterDueLocked() const
+{
+    uint64_t due = DIO_SIM_FOREVER;
+
+    for (uint32_t pending = FilterPending; pending != 0; pending &= pending - 1) {
+        uint32_t line = 0;
+
+        while ((pending & (1U << line)) == 0) {
+            line++;
+        }
+
+        if (FilterDue[line] < due) {
+            due = FilterDue[line];
+        }
+    }
+
+    return due;
+}
+
+//
+// Pass on the new levels of the lines whose filters have seen them on two
+// ticks by Due.  The change detection logic sees them all at once.
+//
+void
+DioSimBar::ApplyFiltersLocked(uint64_t Due)
+{
+    uint32_t previous   = LevelsLocked();
+    bool     wasPending = InterruptPendingLocked();
+    uint32_t passed     = 0;
+
+    for (uint32_t line = 0; line < 32; line++) {
+
+        if ((FilterPending & (1U << line)) != 0 && FilterDue[line] <= Due) {
+            passed |= 1U << line;
+        }
+    }
+
+    FilterPending  &= ~passed;
+    FilteredInputs ^= passed;
+
+    DetectChangesLocked(previous);
+
+    UpdateInterruptLocked(wasPending);
+}
+
+//
+// The filter clock: passes on each filtered change when it's due
+//
+void
+DioSimBar::FilterClockThread()
+{
+    std::unique_lock<std::mutex> lock(Lock);
+
+    while (!FilterStopping) {
+        uint64_t due = NextFilterDueLocked();
+
+        FilterWaitDue = due;
+
+        DioSimClock::WaitUntil(lock, FilterCondition, due, [&] {
+            return FilterStopping || NextFilterDueLocked() < due;
+        });
+
+        FilterWaitDue = 0;
+
+        CatchUpLocked(BusTime());
+    }
+}
+
+void
+DioSimBar::SetInterruptTarget(DioSimInterruptTarget* Target)
+{
+    std::lock_guard<std::mutex> guard(Lock);
+
+    InterruptTarget = Target;
+}
+
+void
+DioSimBar::SetTraceRecorder(DioSimTraceRecorder* Recorder)
+{
+    std::lock_guard<std::mutex> guard(Lock);
+
+    TraceRecorder = Recorder;
+
+    if (Recorder == nullptr) {
+        return;
+    }
+
+    TraceOrigin = PowerOnTime;
+
+    Recorder->Begin(DIO_REGISTER_TRACE_HAS_INPUTS |
+                    (Writes.load(std::memory_order_relaxed) != PowerOnWrites ?
+                         DIO_REGISTER_TRACE_PARTIAL : 0));
+
+    TraceLocked(DIO_REGISTER_TRACE_INPUTS, 0, FieldInputs);
+}
+
+//
+// Record an entry in the trace, if we're recording one, at the time it
+// happens on the bus
+//
+void
+DioSimBar::TraceLocked(uint32_t Kind,
+                       uint32_t Offset,
+                       uint32_t Value)
+{
+    if (TraceRecorder != nullptr) {
+
+        TraceRecorder->Record({ BusTime() - TraceOrigin, Kind, Offset, Value });
+    }
+}
+
+void
+DioSimBar::Reset()
+{
+    std::lock_guard<std::mutex> guard(Lock);
+
+    TraceLocked(DIO_REGISTER_TRACE_POWER, 0, DIO_REGISTER_TRACE_POWER_ON);
+
+    PostedWrites.clear();
+
+    ResetLocked();
+
+    PowerOnTime   = DioSimClock::Now();
+    PowerOnWrites = Writes.load(std::memory_order_relaxed);
+    Scratchpad  = 0;
+    Scrap      = 0;
+}
+
+//
+// What a software reset (through the Joint_Reset_Register) does
+//
+void
+DioSimBar::ResetLocked()
+{
+    OutputLatch           = 0;
+    Direction             = 0;
+    FilterPort0and1       = 0;
+    FilterPort2and3       = 0;
+    RisingEdgeEnable      = 0;
+    FallingEdgeEnable     = 0;
+    LatchedLines          = 0;
+    ChangeStatus          = false;
+    ChangeError           = false;
+    ChangeIrqEnabled      = false;
+    ChangeErrorIrqEnabled = false;
+    DiInterruptEnabled    = false;
+    CpuInterruptEnabled   = false;
+
+    UpdateFiltersLocked();
+}
+
+//
+// The levels on the pins, and the levels the device sees (the inputs
+// after filtering)
+//
+uint32_t
+DioSimBar::PinLevelsLocked() const
+{
+    return (FieldInputs & ~Direction) | (OutputLatch & Direction);
+}
+
+uint32_t
+DioSimBar::LevelsLocked() const
+{
+    return (FilteredInputs & ~Direction) | (OutputLatch & Direction);
+}
+
+//
+// The change detection logic: any enabled edge on the lines sets the
+// change status and latches the state of the lines.  If the previous change
+// hasn't been acknowledged yet, it sets the error bit instead, and the
+// latched state is that of the earlier change.
+//
+void
+DioSimBar::DetectChangesLocked(uint32_t Previous)
+{
+    uint32_t current = LevelsLocked();
+    uint32_t edges;
+
+    if (InD3 && !PmeEnabled) {
+        return;
+    }
+
+    edges = (~Previous & current & RisingEdgeEnable) |
+            (Previous & ~current & FallingEdgeEnable);
+
+    if (edges == 0) {
+        return;
+    }
+
+    if (ChangeStatus) {
+
+        ChangeError = true;
+
+    } else {
+
+        ChangeStatus = true;
+        LatchedLines = current;
+    }
+}
+
+bool
+DioSimBar::InterruptPendingLocked() const
+{
+    bool source;
+
+    source = (ChangeStatus && ChangeIrqEnabled) ||
+             (ChangeError && ChangeErrorIrqEnabled);
+
+    return source && DiInterruptEnabled && CpuInterruptEnabled;
+}
+
+void
+DioSimBar::UpdateInterruptLocked(bool WasPending)
+{
+    //
+    // In D3, an enabled change source signals a wake, once
+    //
+    if (InD3) {
+
+        if (PmeEnabled &&
+            !PmeStatus &&
+            ((ChangeStatus && ChangeIrqEnabled) ||
+             (ChangeError && ChangeErrorIrqEnabled))) {
+
+            PmeStatus = true;
+
+            if (InterruptTarget != nullptr) {
+                InterruptTarget->WakeSignaled();
+            }
+        }
+
+        return;
+    }
+
+    if (!WasPending &&
+        InterruptPendingLocked() &&
+        InterruptTarget != nullptr) {
+
+        InterruptTarget->InterruptAsserted();
+    }
+}
+
+bool
+DioSimBar::InterruptPending()
+{
+    std::lock_guard<std::mutex> guard(Lock);
+
+    if (!PostedWrites.empty() || FilterPending != 0) {
+        CatchUpLocked(BusTime());
+    }
+
+    return InterruptPendingLocked();
+}
+
+void
+DioSimBar::EnterD3(bool WakeEnable)
+{
+    std::lock_guard<std::mutex> guard(Lock);
+
+    //
+    // The config write that changes the power state can't pass the writes
+    // posted before it
+    //
+    CatchUpLocked(FlushTimeLocked());
+
+    TraceLocked(DIO_REGISTER_TRACE_POWER,
+                0,
+                WakeEnable ? DIO_REGISTER_TRACE_D3_WAKE : DIO_REGISTER_TRACE_D3);
+
+    InD3       = true;
+    PmeEnabled = WakeEnable;
+    PmeStatus  = false;
+
+    //
+    // A change caught just before we got here wakes us straight away
+    //
+    UpdateInterruptLocked(false);
+}
+
+void
+DioSimBar::EnterD0()
+{
+    std::lock_guard<std::mutex> guard(Lock);
+
+    CatchUpLocked(FlushTimeLocked());
+
+    TraceLocked(DIO_REGISTER_TRACE_POWER, 0, DIO_REGISTER_TRACE_D0);
+
+    InD3       = false;
+    PmeEnabled = false;
+    PmeStatus  = false;
+
+    //
+    // If our interrupt was left enabled, and has a cause, it's asserted
+    // now
+    //
+    UpdateInterruptLocked(false);
+}
+
+uint32_t
+DioSimBar::LineLevels()
+{
+    std::lock_guard<std::mutex> guard(Lock);
+
+    if (!PostedWrites.empty() || FilterPending != 0) {
+        CatchUpLocked(BusTime());
+    }
+
+    return PinLevelsLocked();
+}
+
+uint64_t
+DioSimBar::FilterRejectCount()
+{
+    std::lock_guard<std::mutex> guard(Lock);
+
+    return FilterRejects;
+}
+
+void
+DioSimBar::SetInputs(uint32_t Lines)
+{
+    std::lock_guard<std::mutex> guard(Lock);
+    uint32_t                    previous;
+    bool                        wasPending;
+    uint32_t                    changed;
+
+    if (!PostedWrites.empty() || FilterPending != 0) {
+        CatchUpLocked(BusTime());
+    }
+
+    previous   = LevelsLocked();
+    wasPending = InterruptPendingLocked();
+    changed    = FieldInputs ^ Lines;
+
+    TraceLocked(DIO_REGISTER_TRACE_INPUTS, 0, Lines);
+
+    FieldInputs = Lines;
+
+    if (changed != 0) {
+        FilterInputsLocked(changed, (changed & FilteredLines) != 0 ? BusTime() : 0);
+    }
+
+    DetectChangesLocked(previous);
+
+    UpdateInterruptLocked(wasPending);
+}
+
+//
+// A read is non-posted: it flushes the writes ahead of it, and the host
+// waits for its completion.  The value is the register's when the read
+// reaches the device, which (as the device has nothing else to do) we
+// take to be as soon as the writes ahead of it have landed.  The filters
+// have moved on by then, too.
+//
+uint32_t
+DioSimBar::Read(uint32_t Offset)
+{
+    uint64_t arrival;
+    uint64_t completion;
+    uint32_t value;
+
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+
+        if (!LatencyModeled && PostedWrites.empty() && FilterPending == 0) {
+
+            value = ReadLocked(Offset);
+
+            TraceLocked(DIO_REGISTER_TRACE_READ, Offset, value);
+
+            return value;
+        }
+
+        arrival    = FlushTimeLocked();
+        completion = arrival + Latencies[DioRegisterIndex(Offset)].ReadNs;
+
+        CatchUpLocked(arrival);
+
+        value = ReadLocked(Offset);
+
+        TraceLocked(DIO_REGISTER_TRACE_READ, Offset, value);
+    }
+
+    WaitUntil(completion);
+
+    return value;
+}
+
+uint32_t
+DioSimBar::ReadLocked(uint32_t Offset)
+{
+    if (InD3) {
+        return 0xFFFFFFFF;
+    }
+
+    switch (static_cast<DioSimRegister>(Offset)) {
+
+        case DioSimRegister::CHInCh_Identification_Register:
+            return DIO_SIM_CHINCH_ID;
+
+        case DioSimRegister::Interrupt_Status_Register:
+        case DioSimRegister::Volatile_Interrupt_Status_Register:
+
+            //
+            // The volatile status is also supposed to acknowledge the
+            // interrupt at the CHInCh.  Our interrupt is purely a function
+            // of the change detection state, so there's nothing to do: it
+            // goes away when the host acknowledges the change.
+            //
+            return InterruptPendingLocked() ? (DIO_SIM_Int | DIO_SIM_STC3_Int) : 0;
+
+        case DioSimRegister::Scrap_Register:
+            return Scrap;
+
+        case DioSimRegister::ScratchpadRegister:
+            return Scratchpad;
+
+        case DioSimRegister::TimeSincePowerUpRegister:
+
+            //
+            // We count microseconds (and wrap, as a 32-bit counter does)
+            //
+            return static_cast<uint32_t>((DioSimClock::Now() - PowerOnTime) / 1000);
+
+        case DioSimRegister::Static_Digital_Output_Register:
+            return OutputLatch;
+
+        case DioSimRegister::DIO_Direction_Register:
+            return Direction;
+
+        case DioSimRegister::Static_Digital_Input_Register:
+            return LevelsLocked();
+
+        case DioSimRegister::ChangeDetectStatusRegister:
+            return (ChangeStatus ? DIO_SIM_ChangeDetectStatus : 0) |
+                   (ChangeError ? DIO_SIM_ChangeDetectError : 0);
+
+        case DioSimRegister::DI_ChangeDetectLatched_Register:
+            return LatchedLines;
+
+        case DioSimRegister::DI_FilterRegister_Port0and1:
+            return FilterPort0and1;
+
+        case DioSimRegister::DI_FilterRegister_Port2and3:
+            return FilterPort2and3;
+
+        default:
+
+            //
+            // Everything else (including the registers the driver never
+            // reads) reads as zero
+            //
+            return 0;
+    }
+}
+
+//
+// A write is posted: the host only waits for it to be issued, and it lands
+// PostingNs later (but never ahead of a write issued before it)
+//
+void
+DioSimBar::Write(uint32_t Offset,
+                 uint32_t Value)
+{
+    uint64_t now;
+    uint64_t issued;
+
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        const DIO_SIM_BAR_LATENCY&  latency = Latencies[DioRegisterIndex(Offset)];
+
+        Writes.fetch_add(1, std::memory_order_relaxed);
+
+        TraceLocked(DIO_REGISTER_TRACE_WRITE, Offset, Value);
+
+        if (!LatencyModeled && PostedWrites.empty() && FilterPending == 0) {
+
+            WriteLocked(Offset, Value);
+            return;
+        }
+
+        now = BusTime();
+
+        CatchUpLocked(now);
+
+        issued = now + latency.WriteNs;
+
+        if (latency.PostingNs == 0 && PostedWrites.empty()) {
+
+            WriteLocked(Offset, Value);
+
+        } else {
+
+            DIO_SIM_POSTED_WRITE write;
+
+            write.Offset = Offset;
+            write.Value  = Value;
+            write.Due    = now + latency.PostingNs;
+
+            if (!PostedWrites.empty()) {
+                write.Due = std::max(write.Due, PostedWrites.back().Due);
+            }
+
+            PostedWrites.push_back(write);
+        }
+    }
+
+    WaitUntil(issued);
+}
+
+//
+// The write reaching the device
+//
+void
+DioSimBar::WriteLocked(uint32_t Offset,
+                       uint32_t Value)
+{
+    uint32_t previous   = LevelsLocked();
+    bool     wasPending = InterruptPendingLocked();
+
+    if (InD3) {
+        return;
+    }
+
+    switch (static_cast<DioSimRegister>(Offset)) {
+
+        case DioSimRegister::Interrupt_Mask_Register:
+
+            if ((Value & DIO_SIM_Set_CPU_Int) != 0) {
+                CpuInterruptEnabled = true;
+            }
+
+            if ((Value & DIO_SIM_Clear_CPU_Int) != 0) {
+                CpuInterruptEnabled = false;
+            }
+            break;
+
+        case DioSimRegister::Scrap_Register:
+            Scrap = Value;
+            break;
+
+        case DioSimRegister::ScratchpadRegister:
+            Scratchpad = Value;
+            break;
+
+        case DioSimRegister::Joint_Reset_Register:
+
+            if ((Value & DIO_SIM_Software_Reset) != 0) {
+                ResetLocked();
+            }
+            break;
+
+        case DioSimRegister::GlobalInterruptEnable_Register:
+
+            if ((Value & DIO_SIM_DI_Interrupt_Enable) != 0) {
+                DiInterruptEnabled = true;
+            }
+
+            if ((Value & DIO_SIM_DI_Interrupt_Disable) != 0) {
+                DiInterruptEnabled = false;
+            }
+            break;
+
+        case DioSimRegister::Static_Digital_Output_Register:
+            OutputLatch = Value;
+            break;
+
+        case DioSimRegister::DIO_Direction_Register:
+            Direction = Value;
+            break;
+
+        case DioSimRegister::DI_ChangeIrqRE_Register:
+            RisingEdgeEnable = Value;
+            break;
+
+        case DioSimRegister::DI_ChangeIrqFE_Register:
+            FallingEdgeEnable = Value;
+            break;
+
+        case DioSimRegister::DI_FilterRegister_Port0and1:
+            FilterPort0and1 = Value;
+            UpdateFiltersLocked();
+            break;
+
+        case DioSimRegister::DI_FilterRegister_Port2and3:
+            FilterPort2and3 = Value;
+            UpdateFiltersLocked();
+            break;
+
+        case DioSimRegister::ChangeDetectIRQ_Register:
+
+            if ((Value & DIO_SIM_ChangeDetectIRQ_Acknowledge) != 0) {
+                ChangeStatus = false;
+            }
+
+            if ((Value & DIO_SIM_ChangeDetectErrorIRQ_Acknowledge) != 0) {
+                ChangeError = false;
+            }
+
+            if ((Value & DIO_SIM_ChangeDetectIRQ_Enable) != 0) {
+                ChangeIrqEnabled = true;
+            }
+
+            if ((Value & DIO_SIM_ChangeDetectIRQ_Disable) != 0) {
+                ChangeIrqEnabled = false;
+            }
+
+            if ((Value & DIO_SIM_ChangeDetectErrorIRQ_Enable) != 0) {
+                ChangeErrorIrqEnabled = true;
+            }
+
+            if ((Value & DIO_SIM_ChangeDetectErrorIRQ_Disable) != 0) {
+                ChangeErrorIrqEnabled = false;
+            }
+            break;
+
+        default:
+
+            //
+            // Writes to anything else are ignored
+            //
+            break;
+    }
+
+    //
+    // Changing the direction or output of a line can change its level,
+    // which the change detection logic sees like any other change
+    //
+    DetectChangesLocked(previous);
+
+    UpdateInterruptLocked(wasPending);
+}
@@ -0,0 +1,447 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioSimBar.h -- Model of the NI PCIe-6509 register BAR
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      This is a behavioral model of the parts of the PCIe-6509 that the
+//      OsrDio driver uses: the static digital I/O registers, the change
+//      detection logic and the interrupt path from it to the host.  It
+//      lets us exercise (and benchmark) the driver's logic, and replay
+//      recorded field signals, without the hardware.
+//
+//      The model is driven from two sides.  The "host" side reads and
+//      writes registers by their offset in the BAR, just as the driver
+//      does.  The "field" side sets the levels on the 32 external lines.
+//
+//      Register names and bit definitions are as in the NI documentation
+//      (and in DioRegisters.h, which the driver uses too).  DioSimBar is
+//      also a backend for DioRegisterRead and DioRegisterWrite, so code
+//      written against those runs unchanged against the model.
+//
+//      We also model the device's PCI power states, which are set through
+//      its config space rather than the BAR.  In D3 the BAR reads as all
+//      ones and ignores writes, and the change detection logic only keeps
+//      running if the device is enabled to wake (PME_En).  A change it
+//      catches then signals a wake (PME) instead of an interrupt.
+//
+//      By default a register access costs only the locked call into the
+//      model.  SetLatency (and SetRegisterLatency, per register) give it
+//      the costs of the bus instead, so that benchmarks see the ratios the
+//      hardware would: a read is a non-posted round trip, and the host
+//      waits for its completion, while a write is posted and the host
+//      moves on as soon as it's issued.  A posted write reaches the model
+//      PostingNs later, in the order it was issued, and until then the
+//      device (and the field) still sees the old value.  As on PCIe, a
+//      read can't pass the writes ahead of it, so it flushes them first,
+//      and its completion waits for the last of them to land.
+//
+//      Posted writes are delivered lazily: each access of any kind, from
+//      either side, first applies the ones that have become due.
+//
+//      The inputs pass through the device's digital filters before
+//      anything else sees them.  Each line's filter samples it on the ticks
+//      of a clock with the interval its filter setting selects (counted
+//      from power on), and passes a new level once two ticks in a row have
+//      seen it.  A pulse that's gone before then is rejected.  So, as on
+//      the hardware, the change detection logic and the input register see
+//      a filtered line change up to two intervals after the field changes
+//      it, and lines passed on the same tick change together, as one
+//      change.  A thread (the "filter clock") applies each filtered change
+//      when it's due, so that it interrupts the host on time even if
+//      nothing else touches the BAR.
+//
+//      All of the model's time (the latencies, the filters and
+//      TimeSincePowerUpRegister) is DioSimClock's, so it runs in virtual
+//      time along with the rest of the simulator.
+//
+//      Everything that happens to the BAR can be recorded as a register
+//      trace (see DioSimTrace.h), in the order the model sees it.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "../inc/DioRegisters.h"
+
+//
+// Offsets, in the BAR, of the registers we model (as DioRegisters.h
+// describes them).  Some offsets hold one register when read and another
+// when written.
+//
+enum class DioSimRegister : uint32_t {
+    CHInCh_Identification_Register     = ::CHInCh_Identification_Register::Offset,
+    Interrupt_Mask_Register            = ::Interrupt_Mask_Register::Offset,
+    Interrupt_Status_Register          = ::Interrupt_Status_Register::Offset,
+    Volatile_Interrupt_Status_Register = ::Volatile_Interrupt_Status_Register::Offset,
+    Scrap_Register                     = ::Scrap_Register::Offset,
+    PCI_Subsystem_ID_Access_Register   = ::PCI_Subsystem_ID_Access_Register::Offset,
+    ScratchpadRegister                 = ::ScratchpadRegister::Offset,
+    Signature_Register                 = ::Signature_Register::Offset,
+    Joint_Reset_Register               = ::Joint_Reset_Register::Offset,
+    TimeSincePowerUpRegister           = ::TimeSincePowerUpRegister::Offset,
+    GlobalInterruptStatus_Register     = ::GlobalInterruptStatus_Register::Offset,
+    GlobalInterruptEnable_Register     = ::GlobalInterruptEnable_Register::Offset,
+    Static_Digital_Output_Register     = ::Static_Digital_Output_Register::Offset,
+    DIO_Direction_Register             = ::DIO_Direction_Register::Offset,
+    Static_Digital_Input_Register      = ::Static_Digital_Input_Register::Offset,
+    ChangeDetectStatusRegister         = ::ChangeDetectStatusRegister::Offset,
+    DI_ChangeIrqRE_Register            = ::DI_ChangeIrqRE_Register::Offset,
+    DI_ChangeDetectLatched_Register    = ::DI_ChangeDetectLatched_Register::Offset,
+    DI_ChangeIrqFE_Register            = ::DI_ChangeIrqFE_Register::Offset,
+    DI_FilterRegister_Port0and1        = ::DI_FilterRegister_Port0and1::Offset,
+    DI_FilterRegister_Port2and3        = ::DI_FilterRegister_Port2and3::Offset,
+    ChangeDetectIRQ_Register           = ::ChangeDetectIRQ_Register::Offset,
+};
+
+//
+// Bit definitions, for the registers whose bits the model interprets
+//
+// Interrupt_Mask_Register
+constexpr uint32_t DIO_SIM_Set_CPU_Int                     = 1U << 31;
+constexpr uint32_t DIO_SIM_Clear_CPU_Int                   = 1U << 30;
+
+// Volatile_Interrupt_Status_Register, Interrupt_Status_Register
+constexpr uint32_t DIO_SIM_Int                             = 1U << 31;
+constexpr uint32_t DIO_SIM_STC3_Int                        = 1U << 11;
+
+// GlobalInterruptEnable_Register
+constexpr uint32_t DIO_SIM_DI_Interrupt_Disable            = 1U << 22;
+constexpr uint32_t DIO_SIM_DI_Interrupt_Enable             = 1U << 6;
+
+// ChangeDetectIRQ_Register
+constexpr uint32_t DIO_SIM_ChangeDetectErrorIRQ_Enable     = 1U << 7;
+constexpr uint32_t DIO_SIM_ChangeDetectErrorIRQ_Disable    = 1U << 6;
+constexpr uint32_t DIO_SIM_ChangeDetectIRQ_Enable          = 1U << 5;
+constexpr uint32_t DIO_SIM_ChangeDetectIRQ_Disable         = 1U << 4;
+constexpr uint32_t DIO_SIM_ChangeDetectErrorIRQ_Acknowledge = 1U << 1;
+constexpr uint32_t DIO_SIM_ChangeDetectIRQ_Acknowledge     = 1U << 0;
+
+// ChangeDetectStatusRegister
+constexpr uint32_t DIO_SIM_ChangeDetectError               = 1U << 1;
+constexpr uint32_t DIO_SIM_ChangeDetectStatus              = 1U << 0;
+
+// Joint_Reset_Register
+constexpr uint32_t DIO_SIM_Software_Reset                  = 1U << 0;
+
+// DI_FilterRegister_Port0and1, DI_FilterRegister_Port2and3: two bits per
+// line, lines 0 to 15 in the first and 16 to 31 in the second
+constexpr uint32_t DIO_SIM_Filter_None                     = 0;
+constexpr uint32_t DIO_SIM_Filter_Small                    = 1;
+constexpr uint32_t DIO_SIM_Filter_Medium                   = 2;
+constexpr uint32_t DIO_SIM_Filter_Large                    = 3;
+
+//
+// The interval of each filter setting, in nanoseconds.  A filtered input
+// only takes a new level once it has been sampled at that level on two
+// ticks in a row of a clock with this period.  So pulses shorter than one
+// interval are always rejected, and pulses longer than two are always
+// accepted (for the large filter, under 2.54 ms and over 5.08 ms).
+//
+constexpr uint64_t DIO_SIM_FILTER_INTERVAL_NS[] = { 0, 2540, 160000, 2540000 };
+
+inline uint64_t
+DioSimFilterIntervalNs(uint32_t FilterPort0and1,
+                       uint32_t FilterPort2and3,
+                       uint32_t Line)
+{
+    uint32_t filters = (Line < 16) ? FilterPort0and1 : FilterPort2and3;
+
+    return DIO_SIM_FILTER_INTERVAL_NS[(filters >> ((Line % 16) * 2)) & 3];
+}
+
+//
+// DIO_SIM_BAR_LATENCY
+//
+// What an access to a register costs the host, in nanoseconds.  ReadNs is
+// the round trip of a read, which the host waits for.  WriteNs is what
+// issuing a (posted) write costs the host, and PostingNs is how long the
+// write then takes to reach the device.
+//
+typedef struct _DIO_SIM_BAR_LATENCY {
+    uint32_t ReadNs;
+    uint32_t WriteNs;
+    uint32_t PostingNs;
+} DIO_SIM_BAR_LATENCY, *PDIO_SIM_BAR_LATENCY;
+
+//
+// No cost beyond the model's own (the default)
+//
+constexpr DIO_SIM_BAR_LATENCY DIO_SIM_NO_LATENCY = { 0, 0, 0 };
+
+//
+// Typical of a PCIe device behind a root port or a switch: about a
+// microsecond for a read, and next to nothing for a write
+//
+constexpr DIO_SIM_BAR_LATENCY DIO_SIM_PCIE_LATENCY = { 1000, 50, 500 };
+
+class DioSimTraceRecorder;
+
+//
+// DioSimInterruptTarget
+//
+// Told when the device's interrupt to the host is asserted.  The interrupt
+// is level-triggered: it stays asserted until the host clears its cause.
+// Called with the BAR's lock held, so it must not touch the BAR itself
+// (typically it just signals the thread that plays the part of the ISR).
+//
+// WakeSignaled is called, the same way, when the device signals a wake
+// from D3.
+//
+class DioSimInterruptTarget
+{
+public:
+    virtual ~DioSimInterruptTarget() = default;
+
+    virtual void InterruptAsserted() = 0;
+
+    virtual void WakeSignaled()
+    {
+    }
+};
+
+//
+// DioSimBar
+//
+// All members may be called from any thread.
+//
+class DioSimBar
+{
+public:
+    DioSimBar();
+    ~DioSimBar();
+
+    DioSimBar(const DioSimBar&) = delete;
+    DioSimBar& operator=(const DioSimBar&) = delete;
+
+    void SetInterruptTarget(DioSimInterruptTarget* Target);
+
+    //
+    // Record every register access, input change and power state change
+    // from now on with Recorder (or stop, with nullptr), timed from power
+    // on.  The trace starts with the inputs as they are now, and is
+    // partial unless nothing has been written since power on.  Recorder
+    // must stay attached until it, or we, are done with.
+    //
+    void SetTraceRecorder(DioSimTraceRecorder* Recorder);
+
+    //
+    // Host side: register access by offset in the BAR
+    //
+    uint32_t Read(uint32_t Offset);
+
+    void Write(uint32_t Offset,
+               uint32_t Value);
+
+    //
+    // The cost of accessing every register, or of one register by its
+    // offset.  Writes already posted keep the latency they were posted
+    // with.
+    //
+    void SetLatency(const DIO_SIM_BAR_LATENCY& Latency);
+
+    void SetRegisterLatency(uint32_t                   Offset,
+                            const DIO_SIM_BAR_LATENCY& Latency);
+
+    //
+    // How many register writes the host has made (counted when they're
+    // issued, not when they land)
+    //
+    uint64_t WriteCount() const
+    {
+        return Writes.load(std::memory_order_relaxed);
+    }
+
+    //
+    // Field side: set the levels on the external lines.  Lines configured
+    // as outputs are driven by the device, so their bits are ignored until
+    // those lines become inputs again.
+    //
+    void SetInputs(uint32_t Lines);
+
+    //
+    // The levels actually on the lines: the field's for input lines, and
+    // our own for outputs.  Before filtering.
+    //
+    uint32_t LineLevels();
+
+    //
+    // How many pulses on the inputs the filters have rejected
+    //
+    uint64_t FilterRejectCount();
+
+    bool InterruptPending();
+
+    //
+    // Config side: PCI power management.  The registers keep their values
+    // through D3 (the device doesn't reset on the way back to D0).
+    //
+    void EnterD3(bool WakeEnable);
+
+    void EnterD0();
+
+    //
+    // Power-on state.  The field inputs are unaffected, and
+    // TimeSincePowerUpRegister starts counting again from zero.
+    //
+    void Reset();
+
+private:
+    typedef struct _DIO_SIM_POSTED_WRITE {
+        uint32_t Offset;
+        uint32_t Value;
+        uint64_t Due;
+    } DIO_SIM_POSTED_WRITE;
+
+    uint32_t ReadLocked(uint32_t Offset);
+
+    void WriteLocked(uint32_t Offset,
+                     uint32_t Value);
+
+    uint64_t FlushTimeLocked() const;
+
+    void CatchUpLocked(uint64_t Now);
+
+    void FilterInputsLocked(uint32_t Changed,
+                            uint64_t Now);
+
+    void UpdateFiltersLocked();
+
+    uint64_t NextFilterDueLocked() const;
+
+    void ApplyFiltersLocked(uint64_t Due);
+
+    void FilterClockThread();
+
+    void UpdateLatencyModeledLocked();
+
+    void ResetLocked();
+
+    uint32_t PinLevelsLocked() const;
+
+    uint32_t LevelsLocked() const;
+
+    void DetectChangesLocked(uint32_t Previous);
+
+    bool InterruptPendingLocked() const;
+
+    void UpdateInterruptLocked(bool WasPending);
+
+    void TraceLocked(uint32_t Kind,
+                     uint32_t Offset,
+                     uint32_t Value);
+
+    std::mutex             Lock;
+    DioSimInterruptTarget* InterruptTarget;
+    std::atomic<uint64_t>  Writes;
+    DioSimTraceRecorder*   TraceRecorder;
+    uint64_t               TraceOrigin;
+
+    //
+    // Indexed by DioRegisterIndex.  The last entry is for offsets that
+    // aren't registers.
+    //
+    DIO_SIM_BAR_LATENCY              Latencies[DIO_REGISTER_COUNT + 1];
+    bool                             LatencyModeled;
+    std::deque<DIO_SIM_POSTED_WRITE> PostedWrites;
+
+    //
+    // The filters: each line's interval, when the lines with a new level
+    // waiting to be passed will have been sampled twice (FilterPending),
+    // and when the filter clock thread is next due to wake
+    //
+    uint64_t                FilterInterval[32];
+    uint32_t                FilteredLines;
+    uint64_t                FilterDue[32];
+    uint32_t                FilterPending;
+    uint64_t                FilterRejects;
+    uint64_t                FilterWaitDue;
+    bool                    FilterStopping;
+    std::condition_variable FilterCondition;
+    std::thread             FilterClock;
+
+    uint32_t FieldInputs;
+    uint32_t FilteredInputs;
+    uint32_t OutputLatch;
+    uint32_t Direction;
+    uint32_t FilterPort0and1;
+    uint32_t FilterPort2and3;
+    uint32_t RisingEdgeEnable;
+    uint32_t FallingEdgeEnable;
+    uint32_t LatchedLines;
+    bool     ChangeStatus;
+    bool     ChangeError;
+    bool     ChangeIrqEnabled;
+    bool     ChangeErrorIrqEnabled;
+    bool     DiInterruptEnabled;
+    bool     CpuInterruptEnabled;
+    bool     InD3;
+    bool     PmeEnabled;
+    bool     PmeStatus;
+    uint64_t PowerOnTime;
+    uint64_t PowerOnWrites;
+    uint32_t Scratchpad;
+    uint32_t Scrap;
+};
+
+//
+// The simulator's DioRegisterBackend: registers read and written through
+// a DioSimBar* go to the model
+//
+template <>
+struct DioRegisterBackend<DioSimBar*>
+{
+    typedef uint32_t Value;
+
+    static uint32_t Read(DioSimBar*   Bar,
+                         unsigned int Offset)
+    {
+        return Bar->Read(Offset);
+    }
+
+    static void Write(DioSimBar*   Bar,
+                      unsigned int Offset,
+                      uint32_t     RegisterValue)
+    {
+        Bar->Write(Offset, RegisterValue);
+    }
+};
@@ -0,0 +1,436 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioSimClock.cpp -- The simulator's clock, in real or virtual time
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <vector>
+
+#include "DioSimClock.h"
+
+//
+// The clock's state.  Runner is the thread whose turn it is (if any), and
+// ReadyQueue the threads waiting for a turn, in the order they were woken.
+// Both, and Waiters, are protected by ClockLock, which is only ever taken
+// last.  Self is the current thread, if it's one of the simulation's.
+//
+static std::atomic<bool>                   VirtualTime(false);
+static std::atomic<uint64_t>               VirtualNow(0);
+static std::mutex                          ClockLock;
+static std::condition_variable             TurnCondition;
+static PDIO_SIM_CLOCK_THREAD               Runner;
+static std::deque<PDIO_SIM_CLOCK_THREAD>   ReadyQueue;
+static std::vector<PDIO_SIM_CLOCK_WAITER>  Waiters;
+static thread_local PDIO_SIM_CLOCK_THREAD  Self;
+
+uint64_t
+DioSimClock::Now()
+{
+    if (VirtualTime.load(std::memory_order_relaxed)) {
+        return VirtualNow.load(std::memory_order_relaxed);
+    }
+
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+bool
+DioSimClock::Virtual()
+{
+    return VirtualTime.load(std::memory_order_relaxed);
+}
+
+void
+DioSimClock::UseVirtualTime(uint64_t Start)
+{
+    std::lock_guard<std::mutex> lock(ClockLock);
+
+    Self   = new DIO_SIM_CLOCK_THREAD();
+    Runner = Self;
+
+    VirtualNow  = Start;
+    VirtualTime = true;
+}
+
+void
+DioSimClock::UseRealTime()
+{
+    std::lock_guard<std::mutex> lock(ClockLock);
+
+    VirtualTime = false;
+
+    Runner = nullptr;
+
+    ReadyQueue.clear();
+
+    delete Self;
+    Self = nullptr;
+}
+
+void
+DioSimClock::Spend(uint64_t Nanoseconds)
+{
+    uint64_t until;
+
+    if (Nanoseconds == 0) {
+        return;
+    }
+
+    if (Virtual()) {
+
+        VirtualNow.fetch_add(Nanoseconds, std::memory_order_relaxed);
+        return;
+    }
+
+    until = Now() + Nanoseconds;
+
+    while (Now() < until) {
+    }
+}
+
+void
+DioSimClock::Sleep(uint64_t Nanoseconds)
+{
+    if (Virtual()) {
+
+        VirtualNow.fetch_add(Nanoseconds, std::memory_order_relaxed);
+        return;
+    }
+
+    std::this_thread::sleep_for(std::chrono::nanoseconds(Nanoseconds));
+}
+
+//
+// The rest hold ClockLock.  Give the turn to the next thread in line (or
+// to no one).
+//
+static void
+PassTurnLocked()
+{
+    if (ReadyQueue.empty()) {
+
+        Runner = nullptr;
+
+    } else {
+
+        Runner = ReadyQueue.front();
+
+        ReadyQueue.pop_front();
+
+        Runner->Queued = false;
+    }
+
+    TurnCondition.notify_all();
+}
+
+static void
+QueueLocked(PDIO_SIM_CLOCK_THREAD Thread)
+{
+    if (Thread == nullptr || Thread->Queued) {
+        return;
+    }
+
+    Thread->Queued = true;
+
+    ReadyQueue.push_back(Thread);
+
+    if (Runner == nullptr) {
+        PassTurnLocked();
+    }
+}
+
+static void
+WakeWaiterLocked(PDIO_SIM_CLOCK_WAITER Waiter)
+{
+    if (Waiter->Woken) {
+        return;
+    }
+
+    Waiter->Woken = true;
+
+    QueueLocked(Waiter->Thread);
+
+    Waiter->Condition->notify_all();
+}
+
+static void
+WakeDueWaitersLocked()
+{
+    uint64_t now = VirtualNow;
+
+    for (PDIO_SIM_CLOCK_WAITER waiter : Waiters) {
+
+        if (waiter->Deadline <= now) {
+            WakeWaiterLocked(waiter);
+        }
+    }
+}
+
+void
+DioSimClock::Settle()
+{
+    PDIO_SIM_CLOCK_THREAD self = Self;
+
+    if (!Virtual()) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(ClockLock);
+
+    while (true) {
+
+        //
+        // Spending a cost may have taken the clock past a deadline
+        //
+        WakeDueWaitersLocked();
+
+        if (ReadyQueue.empty()) {
+            return;
+        }
+
+        PassTurnLocked();
+
+        TurnCondition.wait(lock, [] { return Runner == nullptr; });
+
+        Runner = self;
+    }
+}
+
+void
+DioSimClock::AdvanceTo(uint64_t Time)
+{
+    uint64_t now;
+
+    if (!Virtual()) {
+
+        now = Now();
+
+        if (Time > now) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(Time - now));
+        }
+
+        return;
+    }
+
+    Settle();
+
+    while (true) {
+
+        uint64_t next = Time;
+
+        {
+            std::lock_guard<std::mutex> lock(ClockLock);
+
+            now = Now();
+
+            for (PDIO_SIM_CLOCK_WAITER waiter : Waiters) {
+
+                if (waiter->Deadline > now) {
+                    next = std::min(next, waiter->Deadline);
+                }
+            }
+
+            if (next > now) {
+                VirtualNow = next;
+            }
+        }
+
+        Settle();
+
+        if (next >= Time) {
+            return;
+        }
+    }
+}
+
+void
+DioSimClock::Join(std::thread& Thread)
+{
+    //
+    // Let it run to the end
+    //
+    if (Virtual() && Self != nullptr) {
+        Settle();
+    }
+
+    Thread.join();
+}
+
+void
+DioSimClock::Notify(std::condition_variable& Condition)
+{
+    if (Virtual()) {
+
+        std::lock_guard<std::mutex> lock(ClockLock);
+
+        for (PDIO_SIM_CLOCK_WAITER waiter : Waiters) {
+
+            if (waiter->Condition == &Condition) {
+                WakeWaiterLocked(waiter);
+            }
+        }
+    }
+
+    Condition.notify_all();
+}
+
+//
+// A new thread gets in line for its first turn when it's started, so it
+// runs in the same order every time
+//
+PDIO_SIM_CLOCK_THREAD
+DioSimClock::ThreadStarting()
+{
+    PDIO_SIM_CLOCK_THREAD thread;
+
+    if (!Virtual()) {
+        return nullptr;
+    }
+
+    thread = new DIO_SIM_CLOCK_THREAD();
+
+    std::lock_guard<std::mutex> lock(ClockLock);
+
+    QueueLocked(thread);
+
+    return thread;
+}
+
+void
+DioSimClock::ThreadEntered(PDIO_SIM_CLOCK_THREAD Thread)
+{
+    Self = Thread;
+
+    if (Thread == nullptr) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(ClockLock);
+
+    TurnCondition.wait(lock, [Thread] { return Runner == Thread; });
+}
+
+void
+DioSimClock::ThreadExiting()
+{
+    if (Self == nullptr) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(ClockLock);
+
+    if (Runner == Self) {
+        PassTurnLocked();
+    }
+
+    delete Self;
+    Self = nullptr;
+}
+
+void
+DioSimClock::BeginWait(PDIO_SIM_CLOCK_WAITER Waiter)
+{
+    std::lock_guard<std::mutex> lock(ClockLock);
+
+    Waiter->Thread = Self;
+    Waiter->Woken  = false;
+
+    Waiters.push_back(Waiter);
+}
+
+void
+DioSimClock::Idle(PDIO_SIM_CLOCK_WAITER Waiter)
+{
+    std::lock_guard<std::mutex> lock(ClockLock);
+
+    if (Waiter->Thread != nullptr && Runner == Waiter->Thread) {
+        PassTurnLocked();
+    }
+}
+
+bool
+DioSimClock::Woken(PDIO_SIM_CLOCK_WAITER Waiter)
+{
+    std::lock_guard<std::mutex> lock(ClockLock);
+
+    return Waiter->Woken;
+}
+
+//
+// Wait for our turn.  If we weren't woken (we found we were Ready on our
+// own), we get in line now.
+//
+void
+DioSimClock::Resume(PDIO_SIM_CLOCK_WAITER Waiter)
+{
+    PDIO_SIM_CLOCK_THREAD thread = Waiter->Thread;
+
+    std::unique_lock<std::mutex> lock(ClockLock);
+
+    if (thread != nullptr) {
+
+        if (!Waiter->Woken) {
+            QueueLocked(thread);
+        }
+
+        TurnCondition.wait(lock, [thread] { return Runner == thread; });
+    }
+
+    Waiter->Woken = false;
+}
+
+void
+DioSimClock::EndWait(PDIO_SIM_CLOCK_WAITER Waiter)
+{
+    PDIO_SIM_CLOCK_THREAD thread = Waiter->Thread;
+
+    std::lock_guard<std::mutex> lock(ClockLock);
+
+    Waiters.erase(std::find(Waiters.begin(), Waiters.end(), Waiter));
+
+    //
+    // We have our turn, so we don't need to be in line for another
+    //
+    if (thread != nullptr && thread->Queued) {
+
+        ReadyQueue.erase(std::find(ReadyQueue.begin(), ReadyQueue.end(), thread));
+
+        thread->Queued = false;
+    }
+}
@@ -0,0 +1,269 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioSimClock.h -- The simulator's clock, in real or virtual time
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      Everything in the simulator that takes or reads time goes through
+//      DioSimClock: timestamps, the costs the simulated driver spends, its
+//      timers (the power policy's idle timeout, for example), the BAR's
+//      latencies and TimeSincePowerUpRegister, and the player's waits for
+//      each event.
+//
+//      In real time (the default), the clock is std::chrono::steady_clock,
+//      waits are condition variable waits and costs are spent spinning.
+//
+//      In virtual time, the clock only moves when something moves it, and
+//      the simulation's threads (the thread that switched to virtual time,
+//      which runs the scenario, and those it starts with Thread) take
+//      turns: only one of them runs at a time, until it waits.  Spending a
+//      cost moves the clock on at once.  Otherwise, it stands still until
+//      the scenario calls AdvanceTo, which steps it from one timer's
+//      deadline to the next, letting every thread that has something to
+//      do run at each step.  Threads get their turns in the order they
+//      were woken, so an hour of idle timeouts and input changes takes as
+//      long as the work done at each step, and comes out the same every
+//      run.
+//
+//      For this to work, the simulation's threads must wait with Wait and
+//      WaitUntil, wake each other with Notify, and join each other with
+//      Join.  Choose the time before creating any simulated devices.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+//
+// A deadline that never comes
+//
+constexpr uint64_t DIO_SIM_FOREVER = UINT64_MAX;
+
+//
+// In virtual time, how often (in real time) a waiting thread checks
+// whether it missed a wake
+//
+constexpr uint32_t DIO_SIM_CLOCK_POLL_MS = 1;
+
+//
+// DIO_SIM_CLOCK_THREAD and DIO_SIM_CLOCK_WAITER
+//
+// One of the simulation's threads, and a thread waiting in virtual time.
+// Thread is null for threads that aren't part of the simulation.
+//
+typedef struct _DIO_SIM_CLOCK_THREAD {
+    bool    Queued;
+} DIO_SIM_CLOCK_THREAD, *PDIO_SIM_CLOCK_THREAD;
+
+typedef struct _DIO_SIM_CLOCK_WAITER {
+    std::condition_variable*    Condition;
+    uint64_t                    Deadline;
+    PDIO_SIM_CLOCK_THREAD       Thread;
+    bool                        Woken;
+} DIO_SIM_CLOCK_WAITER, *PDIO_SIM_CLOCK_WAITER;
+
+//
+// DioSimClock
+//
+// All members may be called from any thread.  The time is in nanoseconds.
+//
+class DioSimClock
+{
+public:
+    static uint64_t Now();
+
+    static bool Virtual();
+
+    //
+    // Switch to virtual time, starting at Start, with the calling thread
+    // running the scenario, or back to real time
+    //
+    static void UseVirtualTime(uint64_t Start = 0);
+
+    static void UseRealTime();
+
+    //
+    // The current thread is busy (Spend) or asleep (Sleep) for Nanoseconds.
+    // In virtual time both just move the clock on.
+    //
+    static void Spend(uint64_t Nanoseconds);
+
+    static void Sleep(uint64_t Nanoseconds);
+
+    //
+    // Virtual time, called by the scenario: let every thread that has
+    // something to do run until it waits, then (for AdvanceTo) move the
+    // clock on to Time, a deadline at a time.  In real time, AdvanceTo just
+    // sleeps until Time and Settle does nothing.
+    //
+    static void Settle();
+
+    static void AdvanceTo(uint64_t Time);
+
+    static void Advance(uint64_t Nanoseconds)
+    {
+        AdvanceTo(Now() + Nanoseconds);
+    }
+
+    //
+    // Start a thread that takes part in the simulation, and wait for one
+    // to exit
+    //
+    template <typename Function>
+    static std::thread Thread(Function Body)
+    {
+        PDIO_SIM_CLOCK_THREAD thread = ThreadStarting();
+
+        return std::thread([Body, thread]() mutable {
+
+            ThreadEntered(thread);
+
+            Body();
+
+            ThreadExiting();
+        });
+    }
+
+    static void Join(std::thread& Thread);
+
+    //
+    // Wait on Condition, holding Lock, until Ready returns true (or, for
+    // WaitUntil, the clock reaches Deadline).  WaitUntil returns Ready's
+    // verdict.
+    //
+    template <typename Predicate>
+    static void Wait(std::unique_lock<std::mutex>& Lock,
+                     std::condition_variable&      Condition,
+                     Predicate                     Ready)
+    {
+        WaitUntil(Lock, Condition, DIO_SIM_FOREVER, Ready);
+    }
+
+    template <typename Predicate>
+    static bool WaitUntil(std::unique_lock<std::mutex>& Lock,
+                          std::condition_variable&      Condition,
+                          uint64_t                      Deadline,
+                          Predicate                     Ready);
+
+    //
+    // Wake everyone waiting on Condition
+    //
+    static void Notify(std::condition_variable& Condition);
+
+private:
+    static PDIO_SIM_CLOCK_THREAD ThreadStarting();
+
+    static void ThreadEntered(PDIO_SIM_CLOCK_THREAD Thread);
+
+    static void ThreadExiting();
+
+    static void BeginWait(PDIO_SIM_CLOCK_WAITER Waiter);
+
+    static void Idle(PDIO_SIM_CLOCK_WAITER Waiter);
+
+    static bool Woken(PDIO_SIM_CLOCK_WAITER Waiter);
+
+    static void Resume(PDIO_SIM_CLOCK_WAITER Waiter);
+
+    static void EndWait(PDIO_SIM_CLOCK_WAITER Waiter);
+};
+
+template <typename Predicate>
+bool
+DioSimClock::WaitUntil(std::unique_lock<std::mutex>& Lock,
+                       std::condition_variable&      Condition,
+                       uint64_t                      Deadline,
+                       Predicate                     Ready)
+{
+    DIO_SIM_CLOCK_WAITER waiter;
+
+    if (!Virtual()) {
+
+        uint64_t now;
+
+        if (Deadline == DIO_SIM_FOREVER) {
+
+            Condition.wait(Lock, Ready);
+            return true;
+        }
+
+        now = Now();
+
+        return Condition.wait_for(Lock,
+                                  std::chrono::nanoseconds(Deadline > now ? Deadline - now : 0),
+                                  Ready);
+    }
+
+    //
+    // We give up our turn while we wait.  Whoever makes us Ready wakes us
+    // with Notify (and Settle wakes us at our Deadline), which queues us
+    // for another turn.  We poll as well, in case a Notify comes between
+    // our looking and our waiting (or something makes us Ready without
+    // one).  We can't hold Lock while we wait for our turn, as whoever has
+    // it may need it.
+    //
+    waiter.Condition = &Condition;
+    waiter.Deadline  = Deadline;
+
+    BeginWait(&waiter);
+
+    while (!Ready() && Now() < Deadline) {
+
+        Idle(&waiter);
+
+        //
+        // Whoever we gave our turn to may already have woken us
+        //
+        while (!Woken(&waiter) && !Ready()) {
+
+            Condition.wait_for(Lock, std::chrono::milliseconds(DIO_SIM_CLOCK_POLL_MS));
+        }
+
+        Lock.unlock();
+
+        Resume(&waiter);
+
+        Lock.lock();
+    }
+
+    EndWait(&waiter);
+
+    return Ready();
+}
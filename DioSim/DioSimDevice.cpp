@@ -0,0 +1,1594 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioSimDevice.cpp -- The simulated device, running the
+//                            driver's logic against the register model
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <algorithm>
+
+#include "DioSimDevice.h"
+
+//
+// The driver's core (DioDriverCore.h) runs against our device's context,
+// and gets from us what it gets from WDF and the machine in the driver
+//
+template <>
+struct DioCoreBackend<PDIO_SIM_DEVICE_CONTEXT>
+{
+    typedef DioSimStatus                      Status;
+    typedef DIO_EVENT                         Event;
+    typedef PDIO_EVENT_RING                   EventRingPointer;
+    typedef DioSimDevice::PDIO_SIM_EVENT_READ EventRequest;
+
+    static constexpr DioSimStatus Success            = DioSimStatus::Success;
+    static constexpr DioSimStatus SharingViolation   = DioSimStatus::SharingViolation;
+    static constexpr DioSimStatus InvalidDeviceState = DioSimStatus::InvalidDeviceState;
+    static constexpr DioSimStatus InvalidParameter   = DioSimStatus::InvalidParameter;
+    static constexpr uint32_t     EventRingSize      = DIO_SIM_DRIVER_RING_SIZE;
+
+    static DIO_SIM_PROFILED_BAR Bar(PDIO_SIM_DEVICE_CONTEXT Device,
+                                    unsigned int            Path)
+    {
+        return Device->Device->RegisterBar(static_cast<DioSimPath>(Path));
+    }
+
+    static bool ShadowLineRegisters(PDIO_SIM_DEVICE_CONTEXT Device)
+    {
+        return Device->Device->LineRegisterShadow;
+    }
+
+    static void AcquireOutputLock(PDIO_SIM_DEVICE_CONTEXT Device)
+    {
+        Device->Device->OutputLock.lock();
+    }
+
+    static void ReleaseOutputLock(PDIO_SIM_DEVICE_CONTEXT Device)
+    {
+        Device->Device->OutputLock.unlock();
+    }
+
+    static void AcquireInterruptLock(PDIO_SIM_DEVICE_CONTEXT Device)
+    {
+        Device->Device->InterruptLock.lock();
+    }
+
+    static void ReleaseInterruptLock(PDIO_SIM_DEVICE_CONTEXT Device)
+    {
+        Device->Device->InterruptLock.unlock();
+    }
+
+    static void AcquireEventLock(PDIO_SIM_DEVICE_CONTEXT Device)
+    {
+        Device->Device->EventLock.lock();
+    }
+
+    static void ReleaseEventLock(PDIO_SIM_DEVICE_CONTEXT Device)
+    {
+        Device->Device->EventLock.unlock();
+    }
+
+    static uint32_t Exchange(std::atomic<uint32_t>* Target,
+                             uint32_t               Value)
+    {
+        return Target->exchange(Value);
+    }
+
+    static uint32_t Or(std::atomic<uint32_t>* Target,
+                       uint32_t               Value)
+    {
+        return Target->fetch_or(Value);
+    }
+
+    static uint32_t Load(std::atomic<uint32_t>* Target)
+    {
+        return Target->load();
+    }
+
+    //
+    // Our timestamps are the simulator's nanoseconds.  The core makes one
+    // event for each change it records, so we count them here.
+    //
+    static DIO_EVENT MakeEvent(PDIO_SIM_DEVICE_CONTEXT Device,
+                               uint32_t                LineState,
+                               uint32_t                ChangedLines)
+    {
+        Device->Device->Changes.fetch_add(1, std::memory_order_relaxed);
+
+        return { DioSimEventRing::Now(), LineState, ChangedLines };
+    }
+
+    static uint64_t TimestampFrequency(PDIO_SIM_DEVICE_CONTEXT Device)
+    {
+        (void)Device;
+
+        return 1000000000ULL;
+    }
+
+    static size_t RingSize(unsigned long long Count)
+    {
+        return DioEventRingSize(static_cast<size_t>(Count));
+    }
+
+    //
+    // As the driver's InterlockedExchange does, the store orders the
+    // events before it.  A consumer of our own ring may be asleep waiting
+    // for it.
+    //
+    static void PublishRing(PDIO_SIM_DEVICE_CONTEXT Device,
+                            PDIO_EVENT_RING         Ring,
+                            uint32_t                Head)
+    {
+        Ring->ProducerIndex.store(Head, std::memory_order_seq_cst);
+
+        if (Ring == Device->Device->EventRing.Ring()) {
+            Device->Device->EventRing.WakeConsumer();
+        }
+    }
+
+    //
+    // Our ISR thread runs the DpcForIsr when it's done, once for however
+    // many changes were recorded before it
+    //
+    static void QueueDpc(PDIO_SIM_DEVICE_CONTEXT Device)
+    {
+        Device->Device->DpcQueued = true;
+
+        Device->Device->UnprocessedChanges.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    //
+    // The changes it was queued for are counted already.  Our ISR thread
+    // runs it once it's woken.
+    //
+    static void RequeueDpc(PDIO_SIM_DEVICE_CONTEXT Device)
+    {
+        Device->Device->DpcQueued = true;
+
+        Device->Device->InterruptAsserted();
+    }
+
+    static bool ProcessorExists(PDIO_SIM_DEVICE_CONTEXT Device,
+                                unsigned int            Processor)
+    {
+        (void)Device;
+
+        return Processor < std::max(std::thread::hardware_concurrency(), 1U);
+    }
+
+    //
+    // Our DpcForIsr is queued by setting DpcQueued.  One that's running
+    // already (on our ISR thread, or RunDpc's) isn't waited for: the
+    // driver's DPC is safe to run alongside itself, as it does when it's
+    // moved between processors.
+    //
+    static bool CancelTargetedDpc(PDIO_SIM_DEVICE_CONTEXT Device)
+    {
+        std::lock_guard<std::mutex> lock(Device->Device->InterruptLock);
+
+        bool wasQueued = Device->Device->DpcQueued;
+
+        Device->Device->DpcQueued = false;
+
+        return wasQueued;
+    }
+
+    //
+    // Our threads have no affinity to change
+    //
+    static bool TargetDpc(PDIO_SIM_DEVICE_CONTEXT Device,
+                          unsigned int            Processor)
+    {
+        (void)Device;
+        (void)Processor;
+
+        return true;
+    }
+
+    static DioSimStatus SaveProfile(PDIO_SIM_DEVICE_CONTEXT Device,
+                                    PDIO_SIM_LINE_PROFILE   Profile)
+    {
+        std::lock_guard<std::mutex> lock(Device->Device->ProfileLock);
+
+        Device->Device->StoredProfile = *Profile;
+
+        return DioSimStatus::Success;
+    }
+
+    //
+    // The worker and the work item aren't woken until the DpcForIsr
+    // returns (see InterruptDpc)
+    //
+    static void WakeWorker(PDIO_SIM_DEVICE_CONTEXT Device)
+    {
+        std::lock_guard<std::mutex> lock(Device->Device->WaitLock);
+
+        Device->Device->WorkerQueued = true;
+    }
+
+    static void QueueWorkItem(PDIO_SIM_DEVICE_CONTEXT Device)
+    {
+        std::lock_guard<std::mutex> lock(Device->Device->WaitLock);
+
+        Device->Device->WorkItemQueued = true;
+    }
+
+    static void CountInterrupt(PDIO_SIM_DEVICE_CONTEXT Device)
+    {
+        Device->Device->Interrupts.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void CountMissedChange(PDIO_SIM_DEVICE_CONTEXT Device)
+    {
+        Device->Device->ChangeErrors.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    //
+    // The time the driver spends on each change it processes
+    //
+    static void BeginProcessing(PDIO_SIM_DEVICE_CONTEXT Device)
+    {
+        DioSimClock::Spend(Device->Device->EventCostNs.load(std::memory_order_relaxed) *
+                           Device->Device->UnprocessedChanges.exchange(0));
+    }
+
+    static bool ChangeRequestsWaiting(PDIO_SIM_DEVICE_CONTEXT Device,
+                                      unsigned int            Priority,
+                                      unsigned int            Port)
+    {
+        std::lock_guard<std::mutex> lock(Device->Device->WaitLock);
+
+        return !Device->Device->PendingQueueFor(Priority, Port).empty();
+    }
+
+    static void CompleteChangeRequest(PDIO_SIM_DEVICE_CONTEXT Device,
+                                      unsigned int            Priority,
+                                      unsigned int            Port,
+                                      uint32_t                LineState)
+    {
+        Device->Device->CompleteChangeRequest(Device->Device->PendingQueueFor(Priority, Port),
+                                              LineState);
+    }
+
+    static bool NextEventRequest(PDIO_SIM_DEVICE_CONTEXT Device,
+                                 EventRequest*           Request,
+                                 PDIO_EVENT*             Events,
+                                 unsigned int*           Capacity)
+    {
+        std::lock_guard<std::mutex> lock(Device->Device->WaitLock);
+
+        if (Device->Device->EventQueue.empty()) {
+            return false;
+        }
+
+        *Request = Device->Device->EventQueue.front();
+
+        Device->Device->EventQueue.pop_front();
+
+        *Events   = (*Request)->Events;
+        *Capacity = (*Request)->Count;
+
+        return true;
+    }
+
+    static void CompleteEventRequest(PDIO_SIM_DEVICE_CONTEXT Device,
+                                     EventRequest            Request,
+                                     PDIO_EVENT              Events,
+                                     unsigned int            Count,
+                                     bool                    Overflow)
+    {
+        std::lock_guard<std::mutex> lock(Device->Device->WaitLock);
+
+        (void)Events;
+
+        Request->EventCount = Count;
+        Request->Overflow   = Overflow;
+        Request->Status     = DioSimStatus::Success;
+        Request->Done       = true;
+    }
+
+    static bool CompleteRingWaitRequest(PDIO_SIM_DEVICE_CONTEXT Device,
+                                        DioSimStatus            RequestStatus)
+    {
+        std::lock_guard<std::mutex> lock(Device->Device->WaitLock);
+
+        if (Device->Device->RingWaitQueue.empty()) {
+            return false;
+        }
+
+        Device->Device->RingWaitQueue.front()->Status = RequestStatus;
+        Device->Device->RingWaitQueue.front()->Done   = true;
+
+        Device->Device->RingWaitQueue.pop_front();
+
+        return true;
+    }
+};
+
+DioSimRegisterProfiler::DioSimRegisterProfiler()
+    : Enable(false),
+      Runs(),
+      Accesses()
+{
+}
+
+void
+DioSimRegisterProfiler::Run(DioSimPath Path)
+{
+    if (Enabled()) {
+        Runs[static_cast<uint32_t>(Path)].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+//
+// DioUtilProfileAccess
+//
+void
+DioSimRegisterProfiler::Access(DioSimPath   Path,
+                               unsigned int Offset,
+                               uint64_t     StartTime,
+                               bool         Write)
+{
+    uint64_t               elapsed = DioSimEventRing::Now() - StartTime;
+    unsigned int           index   = DioRegisterIndex(Offset);
+    DIO_SIM_ACCESS_COUNTS* accesses;
+
+    if (index >= DIO_REGISTER_COUNT) {
+        return;
+    }
+
+    accesses = &Accesses[index][static_cast<uint32_t>(Path)];
+
+    if (Write) {
+        accesses->Writes.fetch_add(1, std::memory_order_relaxed);
+        accesses->WriteTime.fetch_add(elapsed, std::memory_order_relaxed);
+    } else {
+        accesses->Reads.fetch_add(1, std::memory_order_relaxed);
+        accesses->ReadTime.fetch_add(elapsed, std::memory_order_relaxed);
+    }
+}
+
+DIO_SIM_REGISTER_PROFILE
+DioSimRegisterProfiler::Profile() const
+{
+    DIO_SIM_REGISTER_PROFILE profile;
+
+    for (uint32_t path = 0; path < DIO_SIM_PATHS; path++) {
+
+        profile.Runs[path] = Runs[path].load(std::memory_order_relaxed);
+
+        for (uint32_t i = 0; i < DIO_REGISTER_COUNT; i++) {
+
+            const DIO_SIM_ACCESS_COUNTS& accesses = Accesses[i][path];
+
+            profile.Accesses[i][path].Reads     = accesses.Reads.load(std::memory_order_relaxed);
+            profile.Accesses[i][path].Writes    = accesses.Writes.load(std::memory_order_relaxed);
+            profile.Accesses[i][path].ReadTime  = accesses.ReadTime.load(std::memory_order_relaxed);
+            profile.Accesses[i][path].WriteTime = accesses.WriteTime.load(std::memory_order_relaxed);
+        }
+    }
+
+    return profile;
+}
+
+DioSimDevice::DioSimDevice(uint32_t                    RingCapacity,
+                           const DIO_SIM_LINE_PROFILE& Profile,
+                           DioSimTraceRecorder*        Recorder)
+    : EventRing(RingCapacity),
+      DeviceFile{ 0, DIO_SIM_NO_PORT, DioSimPortLines(DIO_SIM_NO_PORT), true, true },
+      RequestCostNs(0),
+      PortQueues(true),
+      LineRegisterShadow(true),
+      Context{},
+      InterruptConnected(false),
+      DpcQueued(false),
+      UnprocessedChanges(0),
+      IsrRequested(false),
+      Stopping(false),
+      Interrupts(0),
+      Changes(0),
+      ChangeErrors(0),
+      CompletionCostNs(0),
+      EventCostNs(0),
+      RingFile(nullptr),
+      WorkItemQueued(false),
+      WorkItemStopping(false),
+      WorkerQueued(false),
+      WorkerStopping(false),
+      Stats{},
+      StoredProfile(Profile),
+      IdleTimeoutUs(0),
+      ResumeLatencyUs(0),
+      DevicePowerState(PowerState::D0),
+      PowerReferences(0),
+      IdleSince(DioSimEventRing::Now()),
+      PowerStateSince(DioSimEventRing::Now()),
+      WakeRequested(false),
+      PowerStopping(false),
+      PowerStatistics{}
+{
+    PDIO_EVENT_RING ring = EventRing.Ring();
+
+    if (Recorder != nullptr) {
+        SimBar.SetTraceRecorder(Recorder);
+    }
+
+    Context.Device       = this;
+    Context.Profile      = Profile;
+    Context.DpcProcessor = DIO_SIM_ANY_PROCESSOR;
+
+    //
+    // OsrDioEvtDevicePrepareHardware, with Profile as the line profile it
+    // loaded
+    //
+    DioCoreStartLines(&Context);
+
+    ProfileRun(DioSimPath::Power);
+
+    DioCoreDeviceReset(&Context);
+
+    //
+    // Our ring is attached as if by our own handle, until DetachRing
+    //
+    DioCoreAttachEventRing(&Context,
+                           ring,
+                           ring->Capacity);
+
+    RingFile = &DeviceFile;
+
+    SimBar.SetInterruptTarget(this);
+
+    WorkItem = DioSimClock::Thread([this] { WorkItemThread(); });
+
+    Worker = DioSimClock::Thread([this] { WorkerThread(); });
+
+    Isr = DioSimClock::Thread([this] { IsrThread(); });
+
+    //
+    // OsrDioEvtDeviceD0Entry, then OsrDioEvtInterruptEnable
+    //
+    ProfileRun(DioSimPath::Power);
+
+    DioCoreD0Entry(&Context);
+
+    {
+        std::lock_guard<std::mutex> lock(InterruptLock);
+
+        DioCoreInterruptEnable(&Context);
+
+        InterruptConnected = true;
+    }
+
+    Power = DioSimClock::Thread([this] { PowerThread(); });
+}
+
+DioSimDevice::~DioSimDevice()
+{
+    //
+    // The BAR's filter clock outlives us, so stop it telling us about
+    // interrupts first
+    //
+    SimBar.SetInterruptTarget(nullptr);
+
+    {
+        std::lock_guard<std::mutex> lock(PowerLock);
+
+        PowerStopping = true;
+    }
+
+    DioSimClock::Notify(PowerCondition);
+
+    DioSimClock::Join(Power);
+
+    {
+        std::lock_guard<std::mutex> lock(IsrLock);
+
+        Stopping = true;
+    }
+
+    DioSimClock::Notify(IsrCondition);
+
+    DioSimClock::Join(Isr);
+
+    {
+        std::lock_guard<std::mutex> lock(WaitLock);
+
+        WorkerStopping = true;
+    }
+
+    DioSimClock::Notify(WorkerCondition);
+
+    DioSimClock::Join(Worker);
+
+    {
+        std::lock_guard<std::mutex> lock(WaitLock);
+
+        WorkItemStopping = true;
+    }
+
+    DioSimClock::Notify(WorkItemCondition);
+
+    DioSimClock::Join(WorkItem);
+
+    //
+    // Nothing will complete the Requests that are still waiting now
+    //
+    Cancel(nullptr);
+
+    SimBar.SetInterruptTarget(nullptr);
+
+    EventRing.Finish();
+}
+
+uint32_t
+DioSimDevice::ReadLines()
+{
+    uint32_t lineState = 0;
+
+    Read(&DeviceFile, &lineState);
+
+    return lineState;
+}
+
+bool
+DioSimDevice::WriteOutputs(uint32_t LineState)
+{
+    return Write(&DeviceFile, LineState) == DioSimStatus::Success;
+}
+
+bool
+DioSimDevice::SetOutputs(uint32_t OutputLines)
+{
+    return SetOutputs(&DeviceFile, OutputLines) == DioSimStatus::Success;
+}
+
+//
+// The pending queue for WaitForChange Requests of class Priority on Port
+// (or on the whole device)
+//
+DioSimDevice::DIO_SIM_WAIT_QUEUE&
+DioSimDevice::PendingQueueFor(uint32_t Priority,
+                              uint32_t Port)
+{
+    if (Port == DIO_SIM_NO_PORT) {
+        return PendingQueue[Priority];
+    }
+
+    return PortPendingQueue[Port][Priority];
+}
+
+//
+// The Queue File's Requests are processed on
+//
+std::mutex&
+DioSimDevice::QueueFor(PDIO_SIM_FILE File)
+{
+    if (File->Port == DIO_SIM_NO_PORT || !PortQueues) {
+        return DeviceQueue;
+    }
+
+    return PortQueue[File->Port];
+}
+
+//
+// Take as long as a Request takes
+//
+void
+DioSimDevice::ProcessRequest()
+{
+    ProfileRun(DioSimPath::Ioctl);
+
+    DioSimClock::Spend(RequestCostNs.load(std::memory_order_relaxed));
+}
+
+DioSimStatus
+DioSimDevice::Read(PDIO_SIM_FILE File,
+                   uint32_t*     LineState)
+{
+    PowerReference              power(*this);
+    std::lock_guard<std::mutex> queue(QueueFor(File));
+
+    ProcessRequest();
+
+    *LineState = DioCoreReadLines(&Context);
+
+    return DioSimStatus::Success;
+}
+
+DioSimStatus
+DioSimDevice::Write(PDIO_SIM_FILE File,
+                    uint32_t      LineState)
+{
+    PowerReference              power(*this);
+    std::lock_guard<std::mutex> queue(QueueFor(File));
+
+    ProcessRequest();
+
+    return DioCoreWriteOutputs(&Context, File, LineState);
+}
+
+DioSimStatus
+DioSimDevice::SetOutputs(PDIO_SIM_FILE File,
+                         uint32_t      OutputLines)
+{
+    PowerReference              power(*this);
+    std::lock_guard<std::mutex> queue(QueueFor(File));
+
+    ProcessRequest();
+
+    if ((OutputLines & ~File->PortLines) != 0) {
+        return DioSimStatus::InvalidParameter;
+    }
+
+    return DioCoreSetOutputLines(&Context, File, OutputLines, true);
+}
+
+//
+// OsrDioEvtFileCleanup, which holds the device in D0 (WdfDeviceStopIdle)
+// while it gives back the handle's lines
+//
+void
+DioSimDevice::Cleanup(PDIO_SIM_FILE File)
+{
+    Cancel(File);
+
+    if (File->OutputLines != 0) {
+
+        PowerReference power(*this);
+
+        ProfileRun(DioSimPath::Ioctl);
+
+        DioCoreSetOutputLines(&Context, File, 0, true);
+    }
+}
+
+//
+// IOCTL_OSRDIO_APPLY_PROFILE
+//
+DioSimStatus
+DioSimDevice::ApplyProfile(PDIO_SIM_FILE               File,
+                           const DIO_SIM_LINE_PROFILE& Profile)
+{
+    if (!File->WriteAccess) {
+        return DioSimStatus::AccessDenied;
+    }
+
+    PowerReference              power(*this);
+    std::lock_guard<std::mutex> queue(QueueFor(File));
+
+    ProcessRequest();
+
+    if (File->Port != DIO_SIM_NO_PORT) {
+        return DioSimStatus::InvalidDeviceRequest;
+    }
+
+    return DioCoreApplyProfile(&Context, File, &Profile);
+}
+
+//
+// What the I/O Manager and our EvtIoDeviceControl check before
+// SET_DPC_PROCESSOR and SAVE_PROFILE: a handle opened for writing, to the
+// whole device, by an administrator
+//
+DioSimStatus
+DioSimDevice::CheckSettingsAccess(PDIO_SIM_FILE File)
+{
+    if (!File->WriteAccess) {
+        return DioSimStatus::AccessDenied;
+    }
+
+    if (File->Port != DIO_SIM_NO_PORT) {
+        return DioSimStatus::InvalidDeviceRequest;
+    }
+
+    if (!File->Administrator) {
+        return DioSimStatus::AccessDenied;
+    }
+
+    return DioSimStatus::Success;
+}
+
+//
+// IOCTL_OSRDIO_SET_DPC_PROCESSOR.  Our worker thread is woken to move
+// with the DPC, as the driver's is.
+//
+DioSimStatus
+DioSimDevice::SetDpcProcessor(PDIO_SIM_FILE File,
+                              uint32_t      Processor)
+{
+    DioSimStatus status = CheckSettingsAccess(File);
+
+    if (status != DioSimStatus::Success) {
+        return status;
+    }
+
+    {
+        PowerReference              power(*this);
+        std::lock_guard<std::mutex> queue(QueueFor(File));
+
+        ProcessRequest();
+
+        status = DioCoreSetDpcProcessor(&Context, Processor);
+    }
+
+    if (Context.DeferredProcessing) {
+        DioSimClock::Notify(WorkerCondition);
+    }
+
+    return status;
+}
+
+//
+// IOCTL_OSRDIO_SAVE_PROFILE
+//
+DioSimStatus
+DioSimDevice::SaveProfile(PDIO_SIM_FILE               File,
+                          const DIO_SIM_LINE_PROFILE& Profile)
+{
+    DioSimStatus status = CheckSettingsAccess(File);
+
+    if (status != DioSimStatus::Success) {
+        return status;
+    }
+
+    PowerReference              power(*this);
+    std::lock_guard<std::mutex> queue(QueueFor(File));
+
+    ProcessRequest();
+
+    return DioCoreSaveProfile(&Context, &Profile);
+}
+
+DIO_SIM_LINE_PROFILE
+DioSimDevice::SavedProfile()
+{
+    std::lock_guard<std::mutex> lock(ProfileLock);
+
+    return StoredProfile;
+}
+
+//
+// IOCTL_OSRDIO_ATTACH_EVENT_RING.  The driver keeps the Request, and
+// detaches the ring when it's cancelled; we keep File instead.
+//
+DioSimStatus
+DioSimDevice::AttachEventRing(PDIO_SIM_FILE   File,
+                              PDIO_EVENT_RING Ring,
+                              size_t          Length)
+{
+    PowerReference              power(*this);
+    std::lock_guard<std::mutex> queue(QueueFor(File));
+    uint32_t                    capacity;
+
+    ProcessRequest();
+
+    if (File->Port != DIO_SIM_NO_PORT) {
+        return DioSimStatus::InvalidDeviceRequest;
+    }
+
+    capacity = DioCoreRingCapacity(&Context, Length);
+
+    if (capacity == 0) {
+        return DioSimStatus::InvalidBufferSize;
+    }
+
+    if (!DioCoreAttachEventRing(&Context, Ring, capacity)) {
+        return DioSimStatus::DeviceBusy;
+    }
+
+    std::lock_guard<std::mutex> lock(WaitLock);
+
+    RingFile = File;
+
+    return DioSimStatus::Success;
+}
+
+//
+// OsrDioEvtRingCanceledOnQueue, if File's ring is attached
+//
+void
+DioSimDevice::DetachEventRing(PDIO_SIM_FILE File)
+{
+    {
+        std::lock_guard<std::mutex> lock(WaitLock);
+
+        if (RingFile == nullptr || (File != nullptr && RingFile != File)) {
+            return;
+        }
+
+        RingFile = nullptr;
+    }
+
+    DioCoreDetachEventRing(&Context);
+
+    DioSimClock::Notify(WaitCondition);
+}
+
+//
+// IOCTL_OSRDIO_WAITFOR_CHANGE.  Once the Request is on its pending queue we
+// return from the driver (letting go of the Queue), and wait as the
+// application would.  The pending queues are power-managed (so the waiting
+// Request holds the device in D0) unless wake on change is on.
+//
+DioSimStatus
+DioSimDevice::WaitForChange(PDIO_SIM_FILE   File,
+                            DioSimPriority  Priority,
+                            PDIO_SIM_CHANGE Change)
+{
+    DIO_SIM_WAIT wait{ File, Change, DioSimStatus::Success, false };
+    uint32_t     priority = static_cast<uint32_t>(Priority);
+    bool         holdsPower;
+
+    {
+        PowerReference              power(*this);
+        std::lock_guard<std::mutex> queue(QueueFor(File));
+
+        ProcessRequest();
+
+        if (priority >= DIO_SIM_PRIORITY_COUNT) {
+            return DioSimStatus::InvalidParameter;
+        }
+
+        if (!DioCoreCanWaitForChange(&Context, File->PortLines)) {
+            return DioSimStatus::NoneMapped;
+        }
+
+        holdsPower = !Context.WakeOnChange;
+
+        if (holdsPower) {
+            PowerReferenceAcquire();
+        }
+
+        std::lock_guard<std::mutex> lock(WaitLock);
+
+        PendingQueueFor(priority, File->Port).push_back(&wait);
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(WaitLock);
+
+        DioSimClock::Wait(lock, WaitCondition, [&wait] { return wait.Done; });
+    }
+
+    if (holdsPower) {
+        PowerReferenceRelease();
+    }
+
+    return wait.Status;
+}
+
+//
+// IOCTL_OSRDIO_READ_EVENTS.  As in the driver, the Request goes on the
+// event queue and is completed right away if there are events already;
+// otherwise the DpcForIsr completes it.
+//
+DioSimStatus
+DioSimDevice::ReadEvents(PDIO_SIM_FILE File,
+                         PDIO_EVENT    Events,
+                         uint32_t      Count,
+                         uint32_t*     EventCount,
+                         bool*         Overflow)
+{
+    DIO_SIM_EVENT_READ read{ File, Events, Count, 0, false, DioSimStatus::Success, false };
+    bool               holdsPower;
+
+    {
+        PowerReference              power(*this);
+        std::lock_guard<std::mutex> queue(QueueFor(File));
+
+        ProcessRequest();
+
+        if (File->Port != DIO_SIM_NO_PORT) {
+            return DioSimStatus::InvalidDeviceRequest;
+        }
+
+        if (Count == 0) {
+            return DioSimStatus::InvalidBufferSize;
+        }
+
+        holdsPower = !Context.WakeOnChange;
+
+        if (holdsPower) {
+            PowerReferenceAcquire();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(WaitLock);
+
+            EventQueue.push_back(&read);
+        }
+
+        DioCoreCompleteEventRequests(&Context);
+    }
+
+    //
+    // Which may have completed other waiting Requests, as well as ours
+    //
+    DioSimClock::Notify(WaitCondition);
+
+    {
+        std::unique_lock<std::mutex> lock(WaitLock);
+
+        DioSimClock::Wait(lock, WaitCondition, [&read] { return read.Done; });
+    }
+
+    if (holdsPower) {
+        PowerReferenceRelease();
+    }
+
+    *EventCount = read.EventCount;
+    *Overflow   = read.Overflow;
+
+    return read.Status;
+}
+
+//
+// IOCTL_OSRDIO_WAIT_EVENT_RING
+//
+DioSimStatus
+DioSimDevice::WaitEventRing(PDIO_SIM_FILE File)
+{
+    DIO_SIM_WAIT wait{ File, nullptr, DioSimStatus::Success, false };
+    bool         holdsPower;
+
+    {
+        PowerReference              power(*this);
+        std::lock_guard<std::mutex> queue(QueueFor(File));
+
+        ProcessRequest();
+
+        if (File->Port != DIO_SIM_NO_PORT) {
+            return DioSimStatus::InvalidDeviceRequest;
+        }
+
+        holdsPower = !Context.WakeOnChange;
+
+        if (holdsPower) {
+            PowerReferenceAcquire();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(WaitLock);
+
+            RingWaitQueue.push_back(&wait);
+        }
+
+        DioCoreCompleteRingWaitRequests(&Context, false);
+    }
+
+    //
+    // Which may have completed other waiting Requests, as well as ours
+    //
+    DioSimClock::Notify(WaitCondition);
+
+    {
+        std::unique_lock<std::mutex> lock(WaitLock);
+
+        DioSimClock::Wait(lock, WaitCondition, [&wait] { return wait.Done; });
+    }
+
+    if (holdsPower) {
+        PowerReferenceRelease();
+    }
+
+    return wait.Status;
+}
+
+//
+// Cancel File's waiting Requests, and its ring's attach Request.  If File
+// is null, we cancel every waiting Request, but leave the ring attached.
+//
+void
+DioSimDevice::Cancel(PDIO_SIM_FILE File)
+{
+    {
+        std::lock_guard<std::mutex> lock(WaitLock);
+
+        for (uint32_t priority = 0; priority < DIO_SIM_PRIORITY_COUNT; priority++) {
+
+            CancelWaits(PendingQueue[priority], File);
+
+            for (uint32_t port = 0; port < DIO_SIM_PORT_COUNT; port++) {
+                CancelWaits(PortPendingQueue[port][priority], File);
+            }
+        }
+
+        CancelWaits(RingWaitQueue, File);
+
+        for (auto read = EventQueue.begin(); read != EventQueue.end(); ) {
+
+            if (File != nullptr && (*read)->File != File) {
+                ++read;
+                continue;
+            }
+
+            (*read)->Status = DioSimStatus::Cancelled;
+            (*read)->Done   = true;
+
+            read = EventQueue.erase(read);
+        }
+    }
+
+    DioSimClock::Notify(WaitCondition);
+
+    if (File != nullptr) {
+        DetachEventRing(File);
+    }
+}
+
+void
+DioSimDevice::CancelWaits(DIO_SIM_WAIT_QUEUE& Queue,
+                          PDIO_SIM_FILE       File)
+{
+    for (auto wait = Queue.begin(); wait != Queue.end(); ) {
+
+        if (File != nullptr && (*wait)->File != File) {
+            ++wait;
+            continue;
+        }
+
+        (*wait)->Status = DioSimStatus::Cancelled;
+        (*wait)->Done   = true;
+
+        wait = Queue.erase(wait);
+    }
+}
+
+//
+// Called by the BAR, with its lock held, so all we can do is wake our ISR
+//
+void
+DioSimDevice::InterruptAsserted()
+{
+    {
+        std::lock_guard<std::mutex> lock(IsrLock);
+
+        IsrRequested = true;
+    }
+
+    DioSimClock::Notify(IsrCondition);
+}
+
+void
+DioSimDevice::IsrThread()
+{
+    while (true) {
+
+        {
+            std::unique_lock<std::mutex> lock(IsrLock);
+
+            DioSimClock::Wait(lock, IsrCondition, [this] { return IsrRequested || Stopping; });
+
+            if (Stopping) {
+                return;
+            }
+
+            IsrRequested = false;
+        }
+
+        //
+        // The interrupt is level triggered, so keep servicing it until
+        // it goes away (unless it's been disconnected, with the device on
+        // its way to D3)
+        //
+        bool dpcQueued;
+
+        {
+            std::lock_guard<std::mutex> lock(InterruptLock);
+
+            if (InterruptConnected) {
+
+                while (ServiceInterrupt()) {
+                }
+            }
+
+            dpcQueued = DpcQueued;
+            DpcQueued = false;
+        }
+
+        if (dpcQueued) {
+            InterruptDpc();
+        }
+    }
+}
+
+bool
+DioSimDevice::RunIsr()
+{
+    std::lock_guard<std::mutex> lock(InterruptLock);
+
+    return InterruptConnected && ServiceInterrupt();
+}
+
+bool
+DioSimDevice::RunDpc()
+{
+    {
+        std::lock_guard<std::mutex> lock(InterruptLock);
+
+        if (!DpcQueued) {
+            return false;
+        }
+
+        DpcQueued = false;
+    }
+
+    InterruptDpc();
+
+    return true;
+}
+
+//
+// OsrDioEvtInterruptIsr, holding InterruptLock.  Returns false if the
+// interrupt wasn't ours (that is, there's nothing more to do).
+//
+bool
+DioSimDevice::ServiceInterrupt()
+{
+    ProfileRun(DioSimPath::Isr);
+
+    return DioCoreServiceInterrupt(&Context);
+}
+
+//
+// OsrDioEvtInterruptDpc.  The Requests it completes aren't woken until
+// WakeWaiters, as the I/O Manager's completion APCs don't run until the
+// driver returns.
+//
+void
+DioSimDevice::InterruptDpc()
+{
+    uint64_t startTime = DioSimEventRing::Now();
+
+    ProfileRun(DioSimPath::Dpc);
+
+    DioCoreDpc(&Context);
+
+    RecordTiming(&Stats.Dpc, startTime);
+
+    //
+    // Nothing can run before a real DpcForIsr returns, so we don't wake
+    // anyone (who might take our CPU) until we've stopped the clock
+    //
+    if (Context.DeferredProcessing) {
+        DioSimClock::Notify(WorkerCondition);
+    } else {
+        WakeWaiters();
+    }
+}
+
+//
+// OsrDioWorkerThread
+//
+void
+DioSimDevice::WorkerThread()
+{
+    while (true) {
+
+        uint64_t startTime;
+
+        {
+            std::unique_lock<std::mutex> lock(WaitLock);
+
+            DioSimClock::Wait(lock, WorkerCondition, [this] { return WorkerQueued || WorkerStopping; });
+
+            if (WorkerStopping) {
+                return;
+            }
+
+            WorkerQueued = false;
+        }
+
+        startTime = DioSimEventRing::Now();
+
+        DioCoreWorker(&Context);
+
+        RecordTiming(&Stats.Worker, startTime);
+
+        WakeWaiters();
+    }
+}
+
+void
+DioSimDevice::WakeWaiters()
+{
+    DioSimClock::Notify(WaitCondition);
+
+    DioSimClock::Notify(WorkItemCondition);
+}
+
+//
+// DioUtilRecordTiming
+//
+void
+DioSimDevice::RecordTiming(PDIO_SIM_TIMING Timing,
+                           uint64_t        StartTime)
+{
+    uint64_t elapsed      = DioSimEventRing::Now() - StartTime;
+    uint64_t microseconds = elapsed / 1000;
+    uint32_t bucket       = 0;
+
+    while (microseconds != 0 && bucket < DIO_SIM_TIMING_BUCKETS - 1) {
+
+        microseconds >>= 1;
+        bucket++;
+    }
+
+    std::lock_guard<std::mutex> lock(StatsLock);
+
+    Timing->Count++;
+    Timing->TotalTime += elapsed;
+    Timing->MaxTime    = std::max(Timing->MaxTime, elapsed);
+
+    Timing->Histogram[bucket]++;
+}
+
+DIO_SIM_DPC_STATS
+DioSimDevice::DpcStats()
+{
+    std::lock_guard<std::mutex> lock(StatsLock);
+
+    DIO_SIM_DPC_STATS stats = Stats;
+
+    stats.DeferredProcessing = Context.DeferredProcessing;
+
+    {
+        std::lock_guard<std::mutex> interrupt(InterruptLock);
+
+        stats.DpcProcessor = Context.DpcProcessor;
+    }
+
+    return stats;
+}
+
+//
+// OsrDioEvtBackgroundWorkItem
+//
+void
+DioSimDevice::WorkItemThread()
+{
+    while (true) {
+
+        {
+            std::unique_lock<std::mutex> lock(WaitLock);
+
+            DioSimClock::Wait(lock, WorkItemCondition, [this] { return WorkItemQueued || WorkItemStopping; });
+
+            if (WorkItemStopping) {
+                return;
+            }
+
+            WorkItemQueued = false;
+        }
+
+        DioCoreBackgroundWork(&Context);
+
+        DioSimClock::Notify(WaitCondition);
+    }
+}
+
+//
+// DioUtilCompleteChangeRequest.  The Request is done (though not yet woken)
+// when we've taken as long as completing it takes.
+//
+void
+DioSimDevice::CompleteChangeRequest(DIO_SIM_WAIT_QUEUE& Queue,
+                                    uint32_t            LineState)
+{
+    PDIO_SIM_WAIT wait;
+
+    {
+        std::lock_guard<std::mutex> lock(WaitLock);
+
+        if (Queue.empty()) {
+            return;
+        }
+
+        wait = Queue.front();
+
+        Queue.pop_front();
+    }
+
+    DioSimClock::Spend(CompletionCostNs.load(std::memory_order_relaxed));
+
+    std::lock_guard<std::mutex> lock(WaitLock);
+
+    wait->Change->LatchedLineState = LineState;
+    wait->Change->CompletionTime   = DioSimEventRing::Now();
+    wait->Status                   = DioSimStatus::Success;
+    wait->Done                     = true;
+}
+
+//
+// Take a power reference, waiting for the device to be in D0.  If it's
+// idle, that brings it back.
+//
+void
+DioSimDevice::PowerReferenceAcquire()
+{
+    if (IdleTimeoutUs == 0) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(PowerLock);
+
+    PowerReferences++;
+
+    if (DevicePowerState != PowerState::D0) {
+
+        DioSimClock::Notify(PowerCondition);
+
+        DioSimClock::Wait(lock, PowerCondition, [this] { return DevicePowerState == PowerState::D0; });
+    }
+}
+
+void
+DioSimDevice::PowerReferenceRelease()
+{
+    if (IdleTimeoutUs == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(PowerLock);
+
+    if (--PowerReferences == 0) {
+
+        IdleSince = DioSimEventRing::Now();
+
+        DioSimClock::Notify(PowerCondition);
+    }
+}
+
+//
+// Called by the BAR, with its lock held, when a change wakes the device
+//
+void
+DioSimDevice::WakeSignaled()
+{
+    {
+        std::lock_guard<std::mutex> lock(PowerLock);
+
+        WakeRequested = true;
+    }
+
+    DioSimClock::Notify(PowerCondition);
+}
+
+//
+// Charge the time since the last change of state to the state we're
+// leaving, holding PowerLock
+//
+void
+DioSimDevice::SetPowerStateLocked(PowerState State)
+{
+    uint64_t now     = DioSimEventRing::Now();
+    uint64_t elapsed = now - PowerStateSince;
+
+    switch (DevicePowerState) {
+
+        case PowerState::D0:
+            PowerStatistics.D0Time += elapsed;
+            break;
+
+        case PowerState::D3:
+            PowerStatistics.D3Time += elapsed;
+            break;
+
+        default:
+            PowerStatistics.TransitionTime += elapsed;
+            break;
+    }
+
+    DevicePowerState = State;
+    PowerStateSince  = now;
+}
+
+DIO_SIM_POWER_STATS
+DioSimDevice::PowerStats()
+{
+    std::lock_guard<std::mutex> lock(PowerLock);
+
+    SetPowerStateLocked(DevicePowerState);
+
+    return PowerStatistics;
+}
+
+//
+// WDF's power policy: idle the device once it's had no power references
+// for the idle timeout, and bring it back when it gets one, or signals a
+// wake
+//
+void
+DioSimDevice::PowerThread()
+{
+    std::unique_lock<std::mutex> lock(PowerLock);
+
+    while (!PowerStopping) {
+
+        if (DevicePowerState == PowerState::D0) {
+
+            uint64_t timeout   = IdleTimeoutUs * 1000ULL;
+            uint64_t now       = DioSimEventRing::Now();
+            uint64_t idleSince = IdleSince;
+
+            if (timeout == 0 || PowerReferences != 0) {
+
+                DioSimClock::Wait(lock, PowerCondition, [this] {
+                    return PowerStopping || (PowerReferences == 0 && IdleTimeoutUs != 0);
+                });
+                continue;
+            }
+
+            if (now - idleSince < timeout) {
+
+                DioSimClock::WaitUntil(lock, PowerCondition, idleSince + timeout, [this, idleSince] {
+                    return PowerStopping || PowerReferences != 0 || IdleSince != idleSince;
+                });
+                continue;
+            }
+
+            SetPowerStateLocked(PowerState::GoingToD3);
+
+            lock.unlock();
+
+            PowerDown();
+
+            lock.lock();
+
+            PowerStatistics.Idles++;
+
+            SetPowerStateLocked(PowerState::D3);
+
+            continue;
+        }
+
+        if (PowerReferences == 0 && !WakeRequested) {
+
+            DioSimClock::Wait(lock, PowerCondition, [this] {
+                return PowerStopping || PowerReferences != 0 || WakeRequested;
+            });
+            continue;
+        }
+
+        bool wake = WakeRequested;
+
+        if (wake) {
+            PowerStatistics.Wakes++;
+        }
+
+        WakeRequested = false;
+
+        SetPowerStateLocked(PowerState::GoingToD0);
+
+        lock.unlock();
+
+        PowerUp(wake);
+
+        lock.lock();
+
+        SetPowerStateLocked(PowerState::D0);
+
+        IdleSince = DioSimEventRing::Now();
+
+        DioSimClock::Notify(PowerCondition);
+    }
+}
+
+//
+// OsrDioEvtDeviceArmWakeFromS0 (with wake on change on), then
+// OsrDioEvtInterruptDisable and OsrDioEvtDeviceD0Exit, then into D3
+//
+void
+DioSimDevice::PowerDown()
+{
+    bool armed;
+
+    ProfileRun(DioSimPath::Power);
+
+    armed = DioCoreArmWake(&Context);
+
+    {
+        std::lock_guard<std::mutex> lock(InterruptLock);
+
+        DioCoreInterruptDisable(&Context);
+
+        InterruptConnected = false;
+    }
+
+    DioCoreD0Exit(&Context);
+
+    SimBar.EnterD3(armed);
+}
+
+//
+// Back to D0 (which takes the resume latency), then (if our device
+// signalled the wake) OsrDioEvtDeviceWakeFromS0Triggered, then
+// OsrDioEvtDeviceD0Entry, OsrDioEvtInterruptEnable and
+// OsrDioEvtDeviceDisarmWakeFromS0
+//
+void
+DioSimDevice::PowerUp(bool Wake)
+{
+    bool dpcQueued;
+
+    DioSimClock::Sleep(ResumeLatencyUs * 1000ULL);
+
+    ProfileRun(DioSimPath::Power);
+
+    SimBar.EnterD0();
+
+    if (Wake) {
+        DioCoreWakeTriggered(&Context);
+    }
+
+    DioCoreD0Entry(&Context);
+
+    {
+        std::lock_guard<std::mutex> lock(InterruptLock);
+
+        DioCoreInterruptEnable(&Context);
+
+        InterruptConnected = true;
+
+        dpcQueued = DpcQueued;
+    }
+
+    DioCoreDisarmWake(&Context);
+
+    //
+    // Have our ISR thread run the DpcForIsr for the change that woke us
+    //
+    if (dpcQueued) {
+        InterruptAsserted();
+    }
+}
+
+DioSimHandle::DioSimHandle(DioSimDevice& Device,
+                           uint32_t      Port,
+                           DioSimAccess  Access)
+    : Device(Device),
+      File{ 0,
+            Port < DIO_SIM_PORT_COUNT ? Port : DIO_SIM_NO_PORT,
+            0,
+            Access == DioSimAccess::Administrator,
+            Access != DioSimAccess::Read }
+{
+    File.PortLines = DioSimPortLines(File.Port);
+}
+
+DioSimHandle::~DioSimHandle()
+{
+    Device.Cleanup(&File);
+}
@@ -0,0 +1,989 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioSimDevice.h -- The simulated device, running the
+//                          driver's logic against the register model
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      DioSimBar models the hardware; this runs the OsrDio driver against
+//      it.  The driver's logic isn't copied here: everything it does to the
+//      device, and to the state it keeps about it, is in DioDriverCore.h,
+//      which the driver and we both run.  We supply what WDF and the
+//      machine supply the driver (see DioCoreBackend<PDIO_SIM_DEVICE_CONTEXT>
+//      in DioSimDevice.cpp): the BAR, the clock, the locks, the Requests,
+//      and the threads that play the parts of the ISR, the DpcForIsr, the
+//      worker thread, the work item and the power policy.  Our context
+//      (DIO_SIM_DEVICE_CONTEXT) has the same fields as the driver's.
+//
+//      Anything written against the driver's interface can thus be run,
+//      end to end, against the simulator by driving the BAR's field inputs.
+//
+//      One thread plays the part of the interrupt: when the BAR asserts it,
+//      the thread runs the driver's ISR, and then its DpcForIsr if the ISR
+//      queued it.  A second thread plays the part of the driver's work item,
+//      and a third its worker thread, which the DpcForIsr hands its work to
+//      when processing is deferred (though ours runs at normal priority).
+//      The DpcForIsr and the worker are timed as the driver times them.
+//      Our event ring (Ring()) is attached to the device as
+//      IOCTL_OSRDIO_ATTACH_EVENT_RING attaches an application's, until
+//      DetachRing; a handle can then attach its own (AttachEventRing).
+//
+//      Handles (DioSimHandle) model the driver's file objects: each one
+//      reserves its own output lines (taking them over from the line
+//      profile the device was started with, if it has them), and may be
+//      opened on one of the ports.  Their Requests are serialized the way
+//      the driver's Queues serialize them, taking as long as SetRequestCost
+//      says, so we can see how applications sharing the device get in each
+//      other's way.
+//
+//      A fourth thread plays the part of WDF's power policy: with an idle
+//      timeout set, it idles the device in D3 once no Requests are in
+//      progress, and brings it back to D0 when a Request needs it or (with
+//      wake on change on) when a change on an input line signals a wake.
+//      It runs the driver's wake arming, EvtInterruptDisable/Enable and
+//      D0Exit/D0Entry on the way, and keeps the device's power-state
+//      residency.
+//
+//      Register accesses can be profiled, as the driver's are in builds
+//      that profile them (see IOCTL_OSRDIO_GET_REGISTER_PROFILE): each one
+//      goes through a DIO_SIM_PROFILED_BAR, the same DioRegisterTracer the
+//      driver profiles with, that says which of the driver's paths (ISR,
+//      DPC, IOCTL, power) is making it.
+//
+//      All of our threads, waits and costs go through DioSimClock, so the
+//      device runs just as well in virtual time: its idle timeout, resume
+//      latency and the costs set below are then counted out on the
+//      virtual clock.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "../inc/DioDriverCore.h"
+#include "DioSimBar.h"
+#include "DioSimClock.h"
+#include "DioSimEventRing.h"
+
+//
+// The driver's ports (OSRDIO_PORT_COUNT and friends)
+//
+constexpr uint32_t DIO_SIM_PORT_COUNT     = DIO_CORE_PORT_COUNT;
+constexpr uint32_t DIO_SIM_LINES_PER_PORT = DIO_CORE_LINES_PER_PORT;
+constexpr uint32_t DIO_SIM_NO_PORT        = DIO_CORE_NO_PORT;
+
+constexpr uint32_t
+DioSimPortLines(uint32_t Port)
+{
+    return DioCorePortLines(Port);
+}
+
+//
+// The results of the line IOCTLs, as the driver returns them
+//
+enum class DioSimStatus {
+    Success,
+    InvalidParameter,       // STATUS_INVALID_PARAMETER
+    InvalidDeviceState,     // STATUS_INVALID_DEVICE_STATE
+    InvalidDeviceRequest,   // STATUS_INVALID_DEVICE_REQUEST
+    SharingViolation,       // STATUS_SHARING_VIOLATION
+    NoneMapped,             // STATUS_NONE_MAPPED
+    InvalidBufferSize,      // STATUS_INVALID_BUFFER_SIZE
+    Cancelled,              // STATUS_CANCELLED
+    AccessDenied,           // STATUS_ACCESS_DENIED
+    DeviceBusy,             // STATUS_DEVICE_BUSY
+};
+
+//
+// What a handle may do: what it was opened for, and whether its opener was
+// an administrator (OSRDIO_FILE_CONTEXT's Administrator).  The IOCTLs that
+// change settings need FILE_WRITE_ACCESS.
+//
+enum class DioSimAccess {
+    Read,
+    ReadWrite,
+    Administrator,
+};
+
+//
+// IOCTL_OSRDIO_WAITFOR_CHANGE's priority classes (OSRDIO_PRIORITY_xxx)
+//
+enum class DioSimPriority {
+    Realtime,
+    Normal,
+    Background,
+};
+
+constexpr uint32_t DIO_SIM_PRIORITY_COUNT = DIO_CORE_PRIORITY_COUNT;
+
+//
+// IOCTL_OSRDIO_SET_DPC_PROCESSOR's untargeted DpcForIsr
+// (OSRDIO_ANY_PROCESSOR)
+//
+constexpr uint32_t DIO_SIM_ANY_PROCESSOR = DIO_CORE_ANY_PROCESSOR;
+
+//
+// The size of the driver's own event ring (OSRDIO_EVENT_RING_SIZE)
+//
+constexpr uint32_t DIO_SIM_DRIVER_RING_SIZE = 256;
+
+//
+// DIO_SIM_CHANGE
+//
+// What IOCTL_OSRDIO_WAITFOR_CHANGE returns (OSRDIO_CHANGE_DATA), and when
+// (DioSimEventRing::Now) the simulated driver completed it
+//
+typedef struct _DIO_SIM_CHANGE {
+    uint32_t    LatchedLineState;
+    uint64_t    CompletionTime;
+} DIO_SIM_CHANGE, *PDIO_SIM_CHANGE;
+
+//
+// DIO_SIM_FILE
+//
+// The driver's OSRDIO_FILE_CONTEXT, and whether the handle was opened for
+// writing (which the I/O Manager checks for the driver)
+//
+typedef struct _DIO_SIM_FILE {
+    uint32_t    OutputLines;
+    uint32_t    Port;
+    uint32_t    PortLines;
+    bool        Administrator;
+    bool        WriteAccess;
+} DIO_SIM_FILE, *PDIO_SIM_FILE;
+
+//
+// DIO_SIM_TIMING and DIO_SIM_DPC_STATS
+//
+// IOCTL_OSRDIO_GET_DPC_STATS's OSRDIO_TIMING and OSRDIO_DPC_STATS, with
+// times in nanoseconds.  The histogram's buckets are the driver's.
+//
+constexpr uint32_t DIO_SIM_TIMING_BUCKETS = 16;
+
+typedef struct _DIO_SIM_TIMING {
+    uint64_t    Count;
+    uint64_t    TotalTime;
+    uint64_t    MaxTime;
+    uint64_t    Histogram[DIO_SIM_TIMING_BUCKETS];
+} DIO_SIM_TIMING, *PDIO_SIM_TIMING;
+
+typedef struct _DIO_SIM_DPC_STATS {
+    bool            DeferredProcessing;
+    uint32_t        DpcProcessor;
+    DIO_SIM_TIMING  Dpc;
+    DIO_SIM_TIMING  Worker;
+} DIO_SIM_DPC_STATS, *PDIO_SIM_DPC_STATS;
+
+//
+// DIO_SIM_POWER_STATS
+//
+// How long (in nanoseconds) the device has spent in D0, in D3, and going
+// between them; how many times it has idled; and how many times it came
+// back to D0 because it signaled a wake
+//
+typedef struct _DIO_SIM_POWER_STATS {
+    uint64_t    D0Time;
+    uint64_t    D3Time;
+    uint64_t    TransitionTime;
+    uint64_t    Idles;
+    uint64_t    Wakes;
+} DIO_SIM_POWER_STATS, *PDIO_SIM_POWER_STATS;
+
+//
+// DIO_SIM_LINE_PROFILE
+//
+// The driver's OSRDIO_LINE_PROFILE: the state the lines come up in when
+// the device is started.  DioSimDefaultProfile is what the driver uses
+// when its hardware key has no profile.
+//
+typedef struct _DIO_SIM_LINE_PROFILE {
+    uint32_t    OutputLines;
+    uint32_t    OutputState;
+    uint32_t    RisingEdges;
+    uint32_t    FallingEdges;
+    uint32_t    FilterPort0and1;
+    uint32_t    FilterPort2and3;
+} DIO_SIM_LINE_PROFILE, *PDIO_SIM_LINE_PROFILE;
+
+constexpr DIO_SIM_LINE_PROFILE DioSimDefaultProfile = {
+    0, 0, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF
+};
+
+//
+// The default with the input filters off, for when the field changes the
+// inputs faster than the filters would pass them (every few microseconds,
+// in most of the benchmarks)
+//
+constexpr DIO_SIM_LINE_PROFILE DioSimUnfilteredProfile = {
+    0, 0, 0xFFFFFFFF, 0xFFFFFFFF, 0, 0
+};
+
+//
+// The driver's register access paths (OSRDIO_REGISTER_PATH_xxx)
+//
+enum class DioSimPath : uint32_t {
+    Isr,
+    Dpc,
+    Ioctl,
+    Power,
+};
+
+constexpr uint32_t DIO_SIM_PATHS = 4;
+
+//
+// DIO_SIM_REGISTER_ACCESSES and DIO_SIM_REGISTER_PROFILE
+//
+// IOCTL_OSRDIO_GET_REGISTER_PROFILE's OSRDIO_REGISTER_ACCESSES and
+// OSRDIO_REGISTER_PROFILE, with times in nanoseconds.  Accesses[n] is for
+// the register at DioRegisterOffsets[n].
+//
+typedef struct _DIO_SIM_REGISTER_ACCESSES {
+    uint64_t    Reads;
+    uint64_t    Writes;
+    uint64_t    ReadTime;
+    uint64_t    WriteTime;
+} DIO_SIM_REGISTER_ACCESSES, *PDIO_SIM_REGISTER_ACCESSES;
+
+typedef struct _DIO_SIM_REGISTER_PROFILE {
+    uint64_t                    Runs[DIO_SIM_PATHS];
+    DIO_SIM_REGISTER_ACCESSES   Accesses[DIO_REGISTER_COUNT][DIO_SIM_PATHS];
+} DIO_SIM_REGISTER_PROFILE, *PDIO_SIM_REGISTER_PROFILE;
+
+//
+// DioSimRegisterProfiler
+//
+// Keeps a DIO_SIM_REGISTER_PROFILE, while it's enabled.  Anything may be
+// called from any thread.
+//
+class DioSimRegisterProfiler
+{
+public:
+    DioSimRegisterProfiler();
+
+    DioSimRegisterProfiler(const DioSimRegisterProfiler&) = delete;
+    DioSimRegisterProfiler& operator=(const DioSimRegisterProfiler&) = delete;
+
+    bool Enabled() const
+    {
+        return Enable.load(std::memory_order_relaxed);
+    }
+
+    void SetEnabled(bool Enabled)
+    {
+        Enable = Enabled;
+    }
+
+    void Run(DioSimPath Path);
+
+    void Access(DioSimPath   Path,
+                unsigned int Offset,
+                uint64_t     StartTime,
+                bool         Write);
+
+    DIO_SIM_REGISTER_PROFILE Profile() const;
+
+private:
+    typedef struct _DIO_SIM_ACCESS_COUNTS {
+        std::atomic<uint64_t>   Reads;
+        std::atomic<uint64_t>   Writes;
+        std::atomic<uint64_t>   ReadTime;
+        std::atomic<uint64_t>   WriteTime;
+    } DIO_SIM_ACCESS_COUNTS;
+
+    std::atomic<bool>       Enable;
+    std::atomic<uint64_t>   Runs[DIO_SIM_PATHS];
+    DIO_SIM_ACCESS_COUNTS   Accesses[DIO_REGISTER_COUNT][DIO_SIM_PATHS];
+};
+
+//
+// DIO_SIM_REGISTER_TRACER and DIO_SIM_PROFILED_BAR
+//
+// The driver's DIO_REGISTER_PROFILER and DIO_PROFILED_BAR: the bar the
+// simulated driver accesses registers through is a DioRegisterTracer
+// whose policy counts and times each access (as code on Path) when
+// Profiler is enabled
+//
+typedef struct _DIO_SIM_REGISTER_TRACER {
+    DioSimRegisterProfiler* Profiler;
+    DioSimPath              Path;
+
+    typedef uint64_t Stamp;
+
+    bool Enabled() const
+    {
+        return Profiler->Enabled();
+    }
+
+    uint64_t Begin() const
+    {
+        return DioSimEventRing::Now();
+    }
+
+    void End(unsigned int Offset,
+             uint32_t     RegisterValue,
+             uint64_t     StartTime,
+             bool         Write) const
+    {
+        (void)RegisterValue;
+
+        Profiler->Access(Path, Offset, StartTime, Write);
+    }
+} DIO_SIM_REGISTER_TRACER;
+
+typedef DioRegisterTracer<DioSimBar*, DIO_SIM_REGISTER_TRACER> DIO_SIM_PROFILED_BAR;
+
+//
+// DIO_SIM_LINE_REGISTERS
+//
+// The driver's DIO_LINE_REGISTERS
+//
+typedef struct _DIO_SIM_LINE_REGISTERS {
+    uint32_t    FilterPort0and1;
+    uint32_t    FilterPort2and3;
+    uint32_t    Output;
+    uint32_t    Direction;
+    uint32_t    RisingEdges;
+    uint32_t    FallingEdges;
+} DIO_SIM_LINE_REGISTERS;
+
+class DioSimDevice;
+
+//
+// DIO_SIM_DEVICE_CONTEXT
+//
+// The driver's OSRDIO_DEVICE_CONTEXT: the fields DioDriverCore.h uses, by
+// the same names, protected the same way.  What the driver protects with
+// OutputLock and its interrupt lock, we protect with DioSimDevice's
+// OutputLock and InterruptLock.  The fields the driver uses Interlocked
+// operations on are atomic here.
+//
+typedef struct _DIO_SIM_DEVICE_CONTEXT {
+    DioSimDevice*           Device;
+
+    //
+    // Protected by OutputLock
+    //
+    uint32_t                OutputLineMask;
+    uint32_t                OutputLineState;
+    uint32_t                SavedOutputLineState;
+    DIO_SIM_LINE_PROFILE    Profile;
+    uint32_t                ProfileOutputLines;
+
+    //
+    // Protected by OutputLock and InterruptLock (written holding both)
+    //
+    DIO_SIM_LINE_REGISTERS  LineRegisters;
+    bool                    LineRegistersValid;
+
+    //
+    // Protected by InterruptLock
+    //
+    std::atomic<uint32_t>   LatchedInputLineState;
+    DIO_EVENT               EventRing[DIO_SIM_DRIVER_RING_SIZE];
+    uint32_t                EventRingHead;
+    uint32_t                EventRingTail;
+    bool                    EventRingOverflow;
+    PDIO_EVENT_RING         SharedRing;
+    uint32_t                SharedRingMask;
+    uint32_t                SharedRingHead;
+    uint32_t                DpcProcessor;
+
+    //
+    // Interlocked
+    //
+    std::atomic<uint32_t>   DpcChangedLines;
+    std::atomic<uint32_t>   WorkerChangedLines;
+    std::atomic<uint32_t>   WorkerLineState;
+    std::atomic<uint32_t>   BackgroundChangedLines;
+    std::atomic<uint32_t>   BackgroundLineState;
+    std::atomic<bool>       DeferredProcessing;
+
+    //
+    // Only touched by the power policy (and WakeOnChange by whoever sets
+    // it)
+    //
+    std::atomic<bool>       WakeOnChange;
+    bool                    WakeArmed;
+    bool                    ChangeDetectLeftArmed;
+    bool                    WakeChangeLatched;
+    bool                    WakeTriggered;
+} DIO_SIM_DEVICE_CONTEXT, *PDIO_SIM_DEVICE_CONTEXT;
+
+//
+// DioSimDevice
+//
+// Constructing it starts the device (as PrepareHardware, D0Entry and
+// EvtInterruptEnable do), with the lines as Profile says.  With a
+// Recorder, everything that happens to the device's BAR is traced, from
+// power on (see DioSimBar::SetTraceRecorder).
+//
+// All members may be called from any thread.
+//
+class DioSimDevice : private DioSimInterruptTarget
+{
+    friend struct DioCoreBackend<PDIO_SIM_DEVICE_CONTEXT>;
+
+public:
+    explicit DioSimDevice(uint32_t                    RingCapacity,
+                          const DIO_SIM_LINE_PROFILE& Profile = DioSimDefaultProfile,
+                          DioSimTraceRecorder*        Recorder = nullptr);
+    ~DioSimDevice() override;
+
+    DioSimDevice(const DioSimDevice&) = delete;
+    DioSimDevice& operator=(const DioSimDevice&) = delete;
+
+    DioSimBar& Bar()
+    {
+        return SimBar;
+    }
+
+    DioSimEventRing& Ring()
+    {
+        return EventRing;
+    }
+
+    //
+    // IOCTL_OSRDIO_READ, IOCTL_OSRDIO_WRITE and IOCTL_OSRDIO_SET_OUTPUTS,
+    // on the device's own handle (to the whole device).  WriteOutputs fails
+    // if no lines are outputs, as the driver does.
+    //
+    uint32_t ReadLines();
+
+    bool WriteOutputs(uint32_t LineState);
+
+    bool SetOutputs(uint32_t OutputLines);
+
+    //
+    // The same IOCTLs, and EvtFileCleanup, on File (see DioSimHandle)
+    //
+    DioSimStatus Read(PDIO_SIM_FILE File,
+                      uint32_t*     LineState);
+
+    DioSimStatus Write(PDIO_SIM_FILE File,
+                       uint32_t      LineState);
+
+    DioSimStatus SetOutputs(PDIO_SIM_FILE File,
+                            uint32_t      OutputLines);
+
+    void Cleanup(PDIO_SIM_FILE File);
+
+    //
+    // IOCTL_OSRDIO_APPLY_PROFILE on File
+    //
+    DioSimStatus ApplyProfile(PDIO_SIM_FILE               File,
+                              const DIO_SIM_LINE_PROFILE& Profile);
+
+    //
+    // IOCTL_OSRDIO_SET_DPC_PROCESSOR and IOCTL_OSRDIO_SAVE_PROFILE on File.
+    // Only an administrator's handle to the whole device, opened for
+    // writing, may use them.  Processors are numbered up to
+    // std::thread::hardware_concurrency, but our threads don't move: only
+    // the driver's retargeting of its DPC is run.  The saved profile is
+    // kept for SavedProfile, where the driver writes it to its hardware
+    // key.
+    //
+    DioSimStatus SetDpcProcessor(PDIO_SIM_FILE File,
+                                 uint32_t      Processor);
+
+    DioSimStatus SaveProfile(PDIO_SIM_FILE               File,
+                             const DIO_SIM_LINE_PROFILE& Profile);
+
+    DIO_SIM_LINE_PROFILE SavedProfile();
+
+    //
+    // IOCTL_OSRDIO_ATTACH_EVENT_RING on File: Ring (Length bytes of it)
+    // is filled by our ISR until DetachEventRing (cancelling the attach
+    // Request) or Cancel.  Fails with DeviceBusy while another ring is
+    // attached, our own included (see DetachRing).
+    //
+    DioSimStatus AttachEventRing(PDIO_SIM_FILE   File,
+                                 PDIO_EVENT_RING Ring,
+                                 size_t          Length);
+
+    void DetachEventRing(PDIO_SIM_FILE File);
+
+    void DetachRing()
+    {
+        DetachEventRing(&DeviceFile);
+    }
+
+    //
+    // IOCTL_OSRDIO_WAITFOR_CHANGE on File.  Blocks until the Request is
+    // completed, by a change or by Cancel (CancelIoEx on File).
+    //
+    DioSimStatus WaitForChange(PDIO_SIM_FILE   File,
+                               DioSimPriority  Priority,
+                               PDIO_SIM_CHANGE Change);
+
+    //
+    // IOCTL_OSRDIO_READ_EVENTS on File.  Blocks until the driver's event
+    // ring has at least one event in it (or Cancel), then returns up to
+    // Count of them in Events and their number in EventCount.  Overflow
+    // says whether the driver's ring overflowed since the previous batch.
+    // Timestamps are the simulator's nanoseconds, not performance counter
+    // ticks.
+    //
+    DioSimStatus ReadEvents(PDIO_SIM_FILE File,
+                            PDIO_EVENT    Events,
+                            uint32_t      Count,
+                            uint32_t*     EventCount,
+                            bool*         Overflow);
+
+    //
+    // IOCTL_OSRDIO_WAIT_EVENT_RING on File.  Blocks until the attached ring
+    // has events in it that its consumer hasn't given back, or Cancel.
+    //
+    DioSimStatus WaitEventRing(PDIO_SIM_FILE File);
+
+    //
+    // Cancel File's waiting Requests (WaitForChange, ReadEvents and
+    // WaitEventRing), and detach its ring.  With a null File, every
+    // handle's waiting Requests are cancelled, and the ring stays.
+    //
+    void Cancel(PDIO_SIM_FILE File);
+
+    //
+    // How long the driver takes to process each Request (holding its
+    // Queue), and whether ports have their own Queues (as they do) or
+    // share the device's (as they did before there were ports)
+    //
+    void SetRequestCost(uint32_t Nanoseconds)
+    {
+        RequestCostNs = Nanoseconds;
+    }
+
+    void SetPortQueues(bool Enable)
+    {
+        PortQueues = Enable;
+    }
+
+    //
+    // Whether the line registers are only written when their values
+    // change (as they are), or all rewritten whenever the lines are
+    // programmed (as they were)
+    //
+    void SetLineRegisterShadow(bool Enable)
+    {
+        LineRegisterShadow = Enable;
+    }
+
+    //
+    // How long completing each WaitForChange Request takes the driver
+    //
+    void SetCompletionCost(uint32_t Nanoseconds)
+    {
+        CompletionCostNs = Nanoseconds;
+    }
+
+    //
+    // How long the driver spends on each change it processes after the
+    // ISR (counting it, checking triggers, and so on), and whether that
+    // processing (and completing Requests) is done in the DpcForIsr or
+    // deferred to the worker thread
+    //
+    void SetEventCost(uint32_t Nanoseconds)
+    {
+        EventCostNs = Nanoseconds;
+    }
+
+    void SetDeferredProcessing(bool Enable)
+    {
+        Context.DeferredProcessing = Enable;
+    }
+
+    //
+    // IOCTL_OSRDIO_GET_DPC_STATS
+    //
+    DIO_SIM_DPC_STATS DpcStats();
+
+    //
+    // The device's idle settings.  With an idle timeout, the device idles
+    // once it's had no Requests in progress for that long, and takes
+    // ResumeLatency to get back to D0.  Requests waiting for a change keep
+    // it in D0 unless wake on change is on (the driver's WakeOnChange).
+    // Set these before sending any Requests.  By default the device never
+    // idles, as if idling had been turned off in Device Manager.
+    //
+    void SetIdleTimeout(uint32_t Microseconds)
+    {
+        IdleTimeoutUs = Microseconds;
+    }
+
+    void SetResumeLatency(uint32_t Microseconds)
+    {
+        ResumeLatencyUs = Microseconds;
+    }
+
+    void SetWakeOnChange(bool Enable)
+    {
+        Context.WakeOnChange = Enable;
+    }
+
+    DIO_SIM_POWER_STATS PowerStats();
+
+    //
+    // IOCTL_OSRDIO_GET_REGISTER_PROFILE.  Register accesses are only
+    // profiled while profiling is enabled (it's off to start with).
+    //
+    void SetRegisterProfiling(bool Enable)
+    {
+        Profiler.SetEnabled(Enable);
+    }
+
+    DIO_SIM_REGISTER_PROFILE RegisterProfile() const
+    {
+        return Profiler.Profile();
+    }
+
+    //
+    // Number of times our ISR has run, how many changes the driver has
+    // recorded, and how many times the ISR found the change detect error
+    // set (a change was missed).  A change is counted while the interrupt
+    // lock is held, so one that's counted after an attach or detach
+    // returns was recorded after it.
+    //
+    uint64_t InterruptCount() const
+    {
+        return Interrupts.load(std::memory_order_relaxed);
+    }
+
+    uint64_t ChangeCount() const
+    {
+        return Changes.load(std::memory_order_relaxed);
+    }
+
+    uint64_t ChangeErrorCount() const
+    {
+        return ChangeErrors.load(std::memory_order_relaxed);
+    }
+
+    //
+    // Run our ISR (OsrDioEvtInterruptIsr) once, on the calling thread,
+    // returning false if the interrupt wasn't ours; and run the DpcForIsr,
+    // if the ISR has queued it, returning false if it hadn't.  These are
+    // for microbenchmarks, which take the BAR's interrupt away from our
+    // ISR thread (Bar().SetInterruptTarget(nullptr)) so that they can time
+    // each one by itself.
+    //
+    bool RunIsr();
+
+    bool RunDpc();
+
+private:
+    void InterruptAsserted() override;
+
+    void WakeSignaled() override;
+
+    void IsrThread();
+
+    bool ServiceInterrupt();
+
+    //
+    // A power reference, as a Request on a power-managed Queue (or
+    // WdfDeviceStopIdle) holds one: taking it waits for the device to be
+    // in D0
+    //
+    class PowerReference
+    {
+    public:
+        explicit PowerReference(DioSimDevice& Device)
+            : Device(Device)
+        {
+            Device.PowerReferenceAcquire();
+        }
+
+        ~PowerReference()
+        {
+            Device.PowerReferenceRelease();
+        }
+
+        PowerReference(const PowerReference&) = delete;
+        PowerReference& operator=(const PowerReference&) = delete;
+
+    private:
+        DioSimDevice& Device;
+    };
+
+    enum class PowerState {
+        D0,
+        GoingToD3,
+        D3,
+        GoingToD0,
+    };
+
+    void PowerReferenceAcquire();
+
+    void PowerReferenceRelease();
+
+    void PowerThread();
+
+    void PowerDown();
+
+    void PowerUp(bool Wake);
+
+    void SetPowerStateLocked(PowerState State);
+
+    //
+    // A WaitForChange Request, on one of the pending queues
+    //
+    typedef struct _DIO_SIM_WAIT {
+        PDIO_SIM_FILE   File;
+        PDIO_SIM_CHANGE Change;
+        DioSimStatus    Status;
+        bool            Done;
+    } DIO_SIM_WAIT, *PDIO_SIM_WAIT;
+
+    typedef std::deque<PDIO_SIM_WAIT> DIO_SIM_WAIT_QUEUE;
+
+    //
+    // A ReadEvents Request, on the event queue
+    //
+    typedef struct _DIO_SIM_EVENT_READ {
+        PDIO_SIM_FILE   File;
+        PDIO_EVENT      Events;
+        uint32_t        Count;
+        uint32_t        EventCount;
+        bool            Overflow;
+        DioSimStatus    Status;
+        bool            Done;
+    } DIO_SIM_EVENT_READ, *PDIO_SIM_EVENT_READ;
+
+    typedef std::deque<PDIO_SIM_EVENT_READ> DIO_SIM_EVENT_QUEUE;
+
+    void InterruptDpc();
+
+    void WorkerThread();
+
+    void WorkItemThread();
+
+    void WakeWaiters();
+
+    void RecordTiming(PDIO_SIM_TIMING Timing,
+                      uint64_t        StartTime);
+
+    void CompleteChangeRequest(DIO_SIM_WAIT_QUEUE& Queue,
+                               uint32_t            LineState);
+
+    void CancelWaits(DIO_SIM_WAIT_QUEUE& Queue,
+                     PDIO_SIM_FILE       File);
+
+    DIO_SIM_WAIT_QUEUE& PendingQueueFor(uint32_t Priority,
+                                        uint32_t Port);
+
+    std::mutex& QueueFor(PDIO_SIM_FILE File);
+
+    void ProcessRequest();
+
+    //
+    // The driver's DioUtilBar and DioUtilProfileRun
+    //
+    DioSimStatus CheckSettingsAccess(PDIO_SIM_FILE File);
+
+    DIO_SIM_PROFILED_BAR RegisterBar(DioSimPath Path)
+    {
+        return { &SimBar, { &Profiler, Path } };
+    }
+
+    void ProfileRun(DioSimPath Path)
+    {
+        Profiler.Run(Path);
+    }
+
+    DioSimBar               SimBar;
+    DioSimRegisterProfiler  Profiler;
+    DioSimEventRing         EventRing;
+    DIO_SIM_FILE            DeviceFile;
+    std::mutex              DeviceQueue;
+    std::mutex              PortQueue[DIO_SIM_PORT_COUNT];
+    std::atomic<uint32_t>   RequestCostNs;
+    std::atomic<bool>       PortQueues;
+    std::atomic<bool>       LineRegisterShadow;
+
+    //
+    // The driver's locks: OutputLock, then InterruptLock (the interrupt
+    // lock, held by our ISR and by EvtInterruptEnable and Disable), and
+    // EventLock, then InterruptLock.  InterruptLock also protects
+    // InterruptConnected and DpcQueued.  The pending queues, the event and
+    // ring wait queues, the worker's and the work item's flags, and the
+    // handle whose ring is attached, are protected by WaitLock, the
+    // timings by StatsLock, and the saved profile by ProfileLock.
+    //
+    DIO_SIM_DEVICE_CONTEXT  Context;
+    std::mutex              OutputLock;
+    std::mutex              InterruptLock;
+    std::mutex              EventLock;
+    bool                    InterruptConnected;
+    bool                    DpcQueued;
+    std::atomic<uint32_t>   UnprocessedChanges;
+    std::mutex              IsrLock;
+    std::condition_variable IsrCondition;
+    bool                    IsrRequested;
+    bool                    Stopping;
+    std::atomic<uint64_t>   Interrupts;
+    std::atomic<uint64_t>   Changes;
+    std::atomic<uint64_t>   ChangeErrors;
+    std::thread             Isr;
+    std::atomic<uint32_t>   CompletionCostNs;
+    std::atomic<uint32_t>   EventCostNs;
+    std::mutex              WaitLock;
+    std::condition_variable WaitCondition;
+    DIO_SIM_WAIT_QUEUE      PendingQueue[DIO_SIM_PRIORITY_COUNT];
+    DIO_SIM_WAIT_QUEUE      PortPendingQueue[DIO_SIM_PORT_COUNT][DIO_SIM_PRIORITY_COUNT];
+    DIO_SIM_EVENT_QUEUE     EventQueue;
+    DIO_SIM_WAIT_QUEUE      RingWaitQueue;
+    PDIO_SIM_FILE           RingFile;
+    std::condition_variable WorkItemCondition;
+    bool                    WorkItemQueued;
+    bool                    WorkItemStopping;
+    std::thread             WorkItem;
+    std::condition_variable WorkerCondition;
+    bool                    WorkerQueued;
+    bool                    WorkerStopping;
+    std::thread             Worker;
+    std::mutex              StatsLock;
+    DIO_SIM_DPC_STATS       Stats;
+    std::mutex              ProfileLock;
+    DIO_SIM_LINE_PROFILE    StoredProfile;
+
+    //
+    // The power policy's state is protected by PowerLock
+    //
+    std::atomic<uint32_t>   IdleTimeoutUs;
+    std::atomic<uint32_t>   ResumeLatencyUs;
+    std::mutex              PowerLock;
+    std::condition_variable PowerCondition;
+    PowerState              DevicePowerState;
+    uint32_t                PowerReferences;
+    uint64_t                IdleSince;
+    uint64_t                PowerStateSince;
+    bool                    WakeRequested;
+    bool                    PowerStopping;
+    DIO_SIM_POWER_STATS     PowerStatistics;
+    std::thread             Power;
+};
+
+//
+// DioSimHandle
+//
+// A handle to the simulated device, opened on one of its ports, or on the
+// whole device (DIO_SIM_NO_PORT), with Access.  Closing it gives back its
+// output lines.
+//
+class DioSimHandle
+{
+public:
+    explicit DioSimHandle(DioSimDevice& Device,
+                          uint32_t      Port = DIO_SIM_NO_PORT,
+                          DioSimAccess  Access = DioSimAccess::Administrator);
+    ~DioSimHandle();
+
+    DioSimHandle(const DioSimHandle&) = delete;
+    DioSimHandle& operator=(const DioSimHandle&) = delete;
+
+    DioSimStatus Read(uint32_t* LineState)
+    {
+        return Device.Read(&File, LineState);
+    }
+
+    DioSimStatus Write(uint32_t LineState)
+    {
+        return Device.Write(&File, LineState);
+    }
+
+    DioSimStatus SetOutputs(uint32_t OutputLines)
+    {
+        return Device.SetOutputs(&File, OutputLines);
+    }
+
+    DioSimStatus ApplyProfile(const DIO_SIM_LINE_PROFILE& Profile)
+    {
+        return Device.ApplyProfile(&File, Profile);
+    }
+
+    DioSimStatus SetDpcProcessor(uint32_t Processor)
+    {
+        return Device.SetDpcProcessor(&File, Processor);
+    }
+
+    DioSimStatus SaveProfile(const DIO_SIM_LINE_PROFILE& Profile)
+    {
+        return Device.SaveProfile(&File, Profile);
+    }
+
+    DioSimStatus AttachEventRing(PDIO_EVENT_RING Ring,
+                                 size_t          Length)
+    {
+        return Device.AttachEventRing(&File, Ring, Length);
+    }
+
+    void DetachEventRing()
+    {
+        Device.DetachEventRing(&File);
+    }
+
+    DioSimStatus WaitForChange(DioSimPriority  Priority,
+                               PDIO_SIM_CHANGE Change)
+    {
+        return Device.WaitForChange(&File, Priority, Change);
+    }
+
+    DioSimStatus ReadEvents(PDIO_EVENT Events,
+                            uint32_t   Count,
+                            uint32_t*  EventCount,
+                            bool*      Overflow)
+    {
+        return Device.ReadEvents(&File, Events, Count, EventCount, Overflow);
+    }
+
+    DioSimStatus WaitEventRing()
+    {
+        return Device.WaitEventRing(&File);
+    }
+
+    void Cancel()
+    {
+        Device.Cancel(&File);
+    }
+
+private:
+    DioSimDevice& Device;
+    DIO_SIM_FILE  File;
+};
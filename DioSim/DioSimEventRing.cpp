@@ -0,0 +1,238 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioSimEventRing.cpp -- An event ring filled the way the driver's
+//                               ISR fills one
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include "DioSimEventRing.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+DioSimEventRing::DioSimEventRing(uint32_t Capacity,
+                                 uint64_t TimestampFrequency)
+    : RingBuffer(nullptr),
+      Mask(0),
+      Head(0),
+      Waiting(false),
+      Done(false)
+{
+    size_t length;
+    void*  memory;
+
+    //
+    // Like the driver, use the largest power of two that fits
+    //
+    while (Capacity & (Capacity - 1)) {
+        Capacity &= Capacity - 1;
+    }
+
+    if (Capacity < 2) {
+        Capacity = 2;
+    }
+
+    length = (DioEventRingSize(Capacity) + 4095) & ~static_cast<size_t>(4095);
+
+#ifdef _WIN32
+    memory = _aligned_malloc(length, 4096);
+#else
+    memory = aligned_alloc(4096, length);
+#endif
+
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    memset(memory, 0, length);
+
+    RingBuffer = new (memory) DIO_EVENT_RING;
+
+    RingBuffer->TimestampFrequency = TimestampFrequency;
+    RingBuffer->Capacity           = Capacity;
+    RingBuffer->ProducerIndex      = 0;
+    RingBuffer->OverflowCount      = 0;
+    RingBuffer->ConsumerIndex      = 0;
+
+    Mask = Capacity - 1;
+}
+
+DioSimEventRing::~DioSimEventRing()
+{
+    RingBuffer->~DIO_EVENT_RING();
+
+#ifdef _WIN32
+    _aligned_free(RingBuffer);
+#else
+    free(RingBuffer);
+#endif
+}
+
+uint64_t
+DioSimEventRing::Now()
+{
+    return DioSimClock::Now();
+}
+
+uint64_t
+DioSimEventRing::CurrentTimestamp() const
+{
+    uint64_t now;
+    uint64_t frequency;
+
+    now       = Now();
+    frequency = RingBuffer->TimestampFrequency;
+
+    return (now / 1000000000ULL) * frequency +
+           ((now % 1000000000ULL) * frequency) / 1000000000ULL;
+}
+
+size_t
+DioSimEventRing::Produce(const DIO_EVENT* Events,
+                         size_t           Count)
+{
+    uint32_t consumer;
+    uint64_t frequency;
+    size_t   stored;
+
+    frequency = RingBuffer->TimestampFrequency;
+    consumer  = RingBuffer->ConsumerIndex.load(std::memory_order_acquire);
+    stored    = 0;
+
+    for (size_t i = 0; i < Count; i++) {
+
+        if (Head - consumer > Mask) {
+
+            //
+            // Full as of the last time we looked.  Look again before
+            // giving up on the event, as the ISR would.
+            //
+            consumer = RingBuffer->ConsumerIndex.load(std::memory_order_acquire);
+
+            if (Head - consumer > Mask) {
+
+                RingBuffer->OverflowCount.fetch_add(1, std::memory_order_relaxed);
+
+                continue;
+            }
+        }
+
+        DIO_EVENT& event = RingBuffer->Events[Head & Mask];
+
+        if (frequency == 1000000000ULL) {
+            event.Timestamp = Events[i].Timestamp;
+        } else {
+            event.Timestamp = (Events[i].Timestamp / 1000000000ULL) * frequency +
+                              ((Events[i].Timestamp % 1000000000ULL) * frequency) /
+                              1000000000ULL;
+        }
+
+        event.LineState    = Events[i].LineState;
+        event.ChangedLines = Events[i].ChangedLines;
+
+        Head++;
+        stored++;
+    }
+
+    //
+    // Publish the whole batch at once, as the driver would if it took
+    // several changes in one interrupt, and wake the consumer (the
+    // simulated DpcForIsr)
+    //
+    if (stored != 0) {
+
+        RingBuffer->ProducerIndex.store(Head, std::memory_order_seq_cst);
+
+        WakeConsumer();
+    }
+
+    return stored;
+}
+
+void
+DioSimEventRing::Finish()
+{
+    Done.store(true);
+
+    std::lock_guard<std::mutex> lock(WaitLock);
+
+    DioSimClock::Notify(WaitCondition);
+}
+
+void
+DioSimEventRing::WakeConsumer()
+{
+    //
+    // Only bother with the lock if someone's waiting.  The consumer sets
+    // Waiting before it looks at ProducerIndex, and we look at Waiting
+    // after we set ProducerIndex, so one of us always sees the other.
+    //
+    if (Waiting.load(std::memory_order_seq_cst)) {
+
+        std::lock_guard<std::mutex> lock(WaitLock);
+
+        DioSimClock::Notify(WaitCondition);
+    }
+}
+
+bool
+DioSimEventRing::Wait(uint32_t TimeoutMs)
+{
+    bool available;
+
+    std::unique_lock<std::mutex> lock(WaitLock);
+
+    Waiting.store(true, std::memory_order_seq_cst);
+
+    available = DioSimClock::WaitUntil(lock,
+                                       WaitCondition,
+                                       DioSimClock::Now() + TimeoutMs * 1000000ULL,
+                                       [this] {
+        return Done.load() ||
+               RingBuffer->ProducerIndex.load(std::memory_order_seq_cst) !=
+               RingBuffer->ConsumerIndex.load(std::memory_order_relaxed);
+    });
+
+    Waiting.store(false, std::memory_order_relaxed);
+
+    return available &&
+           RingBuffer->ProducerIndex.load(std::memory_order_acquire) !=
+           RingBuffer->ConsumerIndex.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,117 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioSimEventRing.h -- An event ring filled the way the driver's
+//                             ISR fills one
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include "../DioCapture/DioEventRing.h"
+#include "DioSimClock.h"
+
+//
+// DioSimEventRing
+//
+// A DIO_EVENT_RING, and the producer side of the protocol the driver's ISR
+// follows for IOCTL_OSRDIO_ATTACH_EVENT_RING: events are stored and then
+// ProducerIndex published, events that don't fit are dropped and counted
+// in OverflowCount.  Consumers can't tell it from a ring attached to the
+// device, so they can be run (and measured) without one.
+//
+// Produce takes events with nanosecond timestamps (from any generator) and
+// stores them in ticks of TimestampFrequency.  Call it from one thread
+// only.  Finish tells consumers there will be no more events.
+//
+// Timestamps produced by Now are nanoseconds of the simulator's clock
+// (DioSimClock), converted to ticks, so generators can stamp events as
+// they happen.
+//
+class DioSimEventRing : public DioEventRingSource
+{
+public:
+    explicit DioSimEventRing(uint32_t Capacity,
+                             uint64_t TimestampFrequency = 1000000000ULL);
+    ~DioSimEventRing() override;
+
+    DioSimEventRing(const DioSimEventRing&) = delete;
+    DioSimEventRing& operator=(const DioSimEventRing&) = delete;
+
+    PDIO_EVENT_RING Ring() override
+    {
+        return RingBuffer;
+    }
+
+    bool Wait(uint32_t TimeoutMs) override;
+
+    bool Finished() const override
+    {
+        return Done.load();
+    }
+
+    uint64_t CurrentTimestamp() const override;
+
+    //
+    // Returns the number of events stored; the rest were overflows
+    //
+    size_t Produce(const DIO_EVENT* Events,
+                   size_t           Count);
+
+    void Finish();
+
+    //
+    // Nanoseconds on the clock CurrentTimestamp uses
+    //
+    static uint64_t Now();
+
+    //
+    // Wake a consumer waiting for events, for a producer that publishes
+    // ProducerIndex itself (as the simulated driver's ISR does)
+    //
+    void WakeConsumer();
+
+private:
+    PDIO_EVENT_RING         RingBuffer;
+    uint32_t                Mask;
+    uint32_t                Head;
+    std::atomic<bool>       Waiting;
+    std::atomic<bool>       Done;
+    std::mutex              WaitLock;
+    std::condition_variable WaitCondition;
+};
@@ -0,0 +1,137 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioSimPlayer.cpp -- Plays event streams into the simulated device's inputs
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <chrono>
+#include <thread>
+
+#include "DioSimClock.h"
+#include "DioSimPlayer.h"
+
+//
+// Number of events we read from the source at a time
+//
+constexpr size_t PLAYER_READ_EVENTS = 256;
+
+//
+// We sleep until this close to an event's time, and then spin, because
+// sleeps are only as precise as the host's timer
+//
+constexpr uint64_t PLAYER_SPIN_NS = 200000;
+
+DioSimPlayer::DioSimPlayer(DioSimBar& Bar)
+    : Bar(Bar),
+      MaxLateness(0)
+{
+}
+
+uint64_t
+DioSimPlayer::Play(DioEventSource& Source,
+                   double          Speed)
+{
+    using clock = std::chrono::steady_clock;
+
+    DIO_EVENT         events[PLAYER_READ_EVENTS];
+    size_t            count;
+    uint64_t          played = 0;
+    uint64_t          firstTimestamp = 0;
+    clock::time_point start;
+    uint64_t          virtualStart = 0;
+
+    MaxLateness = 0;
+
+    while ((count = Source.Read(events, PLAYER_READ_EVENTS)) != 0) {
+
+        if (played == 0) {
+
+            firstTimestamp = events[0].Timestamp;
+            start          = clock::now();
+            virtualStart   = DioSimClock::Now();
+        }
+
+        for (size_t i = 0; i < count; i++) {
+
+            if (DioSimClock::Virtual()) {
+
+                if (Speed > 0.0) {
+
+                    uint64_t offset;
+
+                    offset = (uint64_t)((events[i].Timestamp - firstTimestamp) / Speed);
+
+                    DioSimClock::AdvanceTo(virtualStart + offset);
+
+                } else {
+
+                    DioSimClock::Settle();
+                }
+
+            } else if (Speed > 0.0) {
+                clock::time_point due;
+                clock::time_point now;
+                uint64_t          offset;
+
+                offset = (uint64_t)((events[i].Timestamp - firstTimestamp) / Speed);
+                due    = start + std::chrono::nanoseconds(offset);
+                now    = clock::now();
+
+                if (due - now > std::chrono::nanoseconds(PLAYER_SPIN_NS)) {
+
+                    std::this_thread::sleep_until(due -
+                                    std::chrono::nanoseconds(PLAYER_SPIN_NS));
+                }
+
+                while ((now = clock::now()) < due) {
+                    // spin
+                }
+
+                offset = (uint64_t)std::chrono::duration_cast<
+                                    std::chrono::nanoseconds>(now - due).count();
+
+                if (offset > MaxLateness) {
+                    MaxLateness = offset;
+                }
+            }
+
+            Bar.SetInputs(events[i].LineState);
+        }
+
+        played += count;
+    }
+
+    return played;
+}
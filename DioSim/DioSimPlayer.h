@@ -0,0 +1,82 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioSimPlayer.h -- Plays event streams into the simulated device's inputs
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "../DioCapture/DioEvent.h"
+#include "DioSimBar.h"
+
+//
+// DioSimPlayer
+//
+// Reads events from any DioEventSource (a capture, a VCD file, a generator)
+// and sets the simulated device's field inputs to each event's LineState at
+// the event's time, relative to the first event.
+//
+// Speed scales the timing: 1.0 is real time, 2.0 twice as fast, and zero
+// means "as fast as possible" (no waiting at all).
+//
+// In virtual time (see DioSimClock), the player runs the scenario: it
+// advances the clock to each event's time, so the stream takes as long
+// as the simulator takes to process it.  With a Speed of zero, it still
+// lets the simulator settle before each event.
+//
+class DioSimPlayer
+{
+public:
+    explicit DioSimPlayer(DioSimBar& Bar);
+
+    //
+    // Plays the whole stream, and returns the number of events played
+    //
+    uint64_t Play(DioEventSource& Source,
+                  double          Speed);
+
+    //
+    // How late, at worst, we were in setting the inputs for an event.  Only
+    // meaningful when the stream was played with a non-zero Speed.
+    //
+    uint64_t MaxLatenessNs() const
+    {
+        return MaxLateness;
+    }
+
+private:
+    DioSimBar& Bar;
+    uint64_t   MaxLateness;
+};
@@ -0,0 +1,386 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioSimTrace.cpp -- Records the simulated device's register accesses,
+//                           and replays register traces against it
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include "DioSimClock.h"
+#include "DioSimTrace.h"
+
+//
+// Our traces' timestamps are DioSimClock's nanoseconds
+//
+constexpr uint64_t TRACE_NS_PER_SECOND = 1000000000;
+
+//
+// We sleep until this close to an entry's time, and then spin, as
+// DioSimPlayer does
+//
+constexpr uint64_t TRACE_SPIN_NS = 200000;
+
+DioSimTraceRecorder::DioSimTraceRecorder()
+    : Count(0),
+      LastTime(0),
+      Flags(0)
+{
+}
+
+void
+DioSimTraceRecorder::Begin(uint32_t Flags)
+{
+    Encoded.clear();
+
+    Count       = 0;
+    LastTime    = 0;
+    this->Flags = Flags;
+}
+
+void
+DioSimTraceRecorder::Record(const DIO_REGISTER_TRACE_ENTRY& Entry)
+{
+    uint8_t  buffer[DIO_REGISTER_TRACE_MAX_ENTRY_BYTES];
+    uint32_t length;
+
+    length = DioRegisterTraceEncode(Entry, LastTime, buffer);
+
+    Encoded.insert(Encoded.end(), buffer, buffer + length);
+
+    Count++;
+    LastTime = Entry.Time;
+}
+
+std::vector<uint8_t>
+DioSimTraceRecorder::File() const
+{
+    DIO_REGISTER_TRACE_HEADER header = DioRegisterTraceHeader(TRACE_NS_PER_SECOND, Flags);
+    std::vector<uint8_t>      file(sizeof(header) + sizeof(DioRegisterOffsets));
+
+    memcpy(file.data(), &header, sizeof(header));
+
+    for (uint32_t i = 0; i < DIO_REGISTER_COUNT; i++) {
+        uint32_t offset = DioRegisterOffsets[i];
+
+        memcpy(file.data() + sizeof(header) + i * sizeof(offset), &offset, sizeof(offset));
+    }
+
+    file.insert(file.end(), Encoded.begin(), Encoded.end());
+
+    return file;
+}
+
+bool
+DioSimTraceRecorder::Save(const char* Path) const
+{
+    std::vector<uint8_t> file = File();
+    FILE*                stream;
+    bool                 written;
+
+    stream = fopen(Path, "wb");
+
+    if (stream == nullptr) {
+        return false;
+    }
+
+    written = fwrite(file.data(), 1, file.size(), stream) == file.size();
+
+    if (fclose(stream) != 0) {
+        written = false;
+    }
+
+    return written;
+}
+
+DioSimTrace::DioSimTrace()
+    : TraceFlags(0)
+{
+}
+
+bool
+DioSimTrace::Open(const char* Path)
+{
+    std::vector<uint8_t> file;
+    uint8_t              buffer[64 * 1024];
+    FILE*                stream;
+    size_t               length;
+    bool                 failed;
+
+    stream = fopen(Path, "rb");
+
+    if (stream == nullptr) {
+        return false;
+    }
+
+    while ((length = fread(buffer, 1, sizeof(buffer), stream)) != 0) {
+        file.insert(file.end(), buffer, buffer + length);
+    }
+
+    failed = ferror(stream) != 0;
+
+    fclose(stream);
+
+    return !failed && Parse(file.data(), file.size());
+}
+
+bool
+DioSimTrace::Parse(const uint8_t* Data,
+                   size_t         Length)
+{
+    DIO_REGISTER_TRACE_HEADER header;
+    std::vector<uint32_t>     offsets;
+    const uint8_t*            next;
+    const uint8_t*            end = Data + Length;
+    uint64_t                  previous = 0;
+
+    TraceEntries.clear();
+    TraceFlags = 0;
+
+    if (Length < sizeof(header)) {
+        return false;
+    }
+
+    memcpy(&header, Data, sizeof(header));
+
+    if (header.Signature != DIO_REGISTER_TRACE_SIGNATURE ||
+        header.Version != DIO_REGISTER_TRACE_VERSION ||
+        header.HeaderSize < sizeof(header) ||
+        header.Frequency == 0 ||
+        header.RegisterCount > DIO_REGISTER_TRACE_OTHER ||
+        Length - header.HeaderSize < (size_t)header.RegisterCount * sizeof(uint32_t)) {
+
+        return false;
+    }
+
+    offsets.resize(header.RegisterCount);
+
+    if (header.RegisterCount != 0) {
+        memcpy(offsets.data(), Data + header.HeaderSize, header.RegisterCount * sizeof(uint32_t));
+    }
+
+    next = Data + header.HeaderSize + header.RegisterCount * sizeof(uint32_t);
+
+    while (next < end) {
+        DIO_REGISTER_TRACE_ENTRY entry;
+        uint32_t                 length;
+
+        length = DioRegisterTraceDecode(next,
+                                        end,
+                                        previous,
+                                        offsets.data(),
+                                        header.RegisterCount,
+                                        &entry);
+
+        if (length == 0) {
+
+            TraceEntries.clear();
+            return false;
+        }
+
+        next     += length;
+        previous  = entry.Time;
+
+        //
+        // In nanoseconds, without overflowing for the driver's performance
+        // counter ticks
+        //
+        entry.Time = (entry.Time / header.Frequency) * TRACE_NS_PER_SECOND +
+                     (entry.Time % header.Frequency) * TRACE_NS_PER_SECOND / header.Frequency;
+
+        TraceEntries.push_back(entry);
+    }
+
+    TraceFlags = header.Flags;
+
+    return true;
+}
+
+//
+// Whether what the register at Offset reads depends on the inputs
+//
+static bool
+DependsOnInputs(uint32_t Offset)
+{
+    switch (static_cast<DioSimRegister>(Offset)) {
+
+        case DioSimRegister::Interrupt_Status_Register:
+        case DioSimRegister::Volatile_Interrupt_Status_Register:
+        case DioSimRegister::Static_Digital_Input_Register:
+        case DioSimRegister::ChangeDetectStatusRegister:
+        case DioSimRegister::DI_ChangeDetectLatched_Register:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+DioSimTraceReplay::DioSimTraceReplay(DioSimBar& Bar)
+    : Bar(Bar)
+{
+}
+
+DIO_SIM_REPLAY_STATS
+DioSimTraceReplay::Replay(const DioSimTrace& Trace,
+                          double             Speed)
+{
+    using clock = std::chrono::steady_clock;
+
+    const std::vector<DIO_REGISTER_TRACE_ENTRY>& entries = Trace.Entries();
+    DIO_SIM_REPLAY_STATS                         stats = {};
+    clock::time_point                            start;
+    uint64_t                                     virtualStart;
+    bool                                         checkInputs;
+    bool                                         checkTime;
+
+    stats.FirstMismatch = DIO_SIM_NO_MISMATCH;
+
+    checkInputs = (Trace.Flags() & DIO_REGISTER_TRACE_HAS_INPUTS) != 0;
+    checkTime   = checkInputs && DioSimClock::Virtual() && Speed == 1.0;
+
+    //
+    // Time zero is power on
+    //
+    Bar.Reset();
+
+    start        = clock::now();
+    virtualStart = DioSimClock::Now();
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        const DIO_REGISTER_TRACE_ENTRY& entry = entries[i];
+        uint32_t                        value;
+
+        if (DioSimClock::Virtual()) {
+
+            if (Speed > 0.0) {
+
+                DioSimClock::AdvanceTo(virtualStart + (uint64_t)(entry.Time / Speed));
+
+            } else {
+
+                DioSimClock::Settle();
+            }
+
+        } else if (Speed > 0.0) {
+            clock::time_point due;
+            clock::time_point now;
+            uint64_t          lateness;
+
+            due = start + std::chrono::nanoseconds((uint64_t)(entry.Time / Speed));
+            now = clock::now();
+
+            if (due - now > std::chrono::nanoseconds(TRACE_SPIN_NS)) {
+
+                std::this_thread::sleep_until(due -
+                                std::chrono::nanoseconds(TRACE_SPIN_NS));
+            }
+
+            while ((now = clock::now()) < due) {
+                // spin
+            }
+
+            lateness = (uint64_t)std::chrono::duration_cast<
+                                std::chrono::nanoseconds>(now - due).count();
+
+            if (lateness > stats.MaxLateness) {
+                stats.MaxLateness = lateness;
+            }
+        }
+
+        switch (entry.Kind) {
+
+            case DIO_REGISTER_TRACE_READ:
+
+                value = Bar.Read(entry.Offset);
+
+                stats.Reads++;
+
+                if ((DependsOnInputs(entry.Offset) && !checkInputs) ||
+                    (entry.Offset == TimeSincePowerUpRegister::Offset && !checkTime)) {
+                    break;
+                }
+
+                stats.Checked++;
+
+                if (value != entry.Value) {
+
+                    if (stats.Mismatches++ == 0) {
+
+                        stats.FirstMismatch      = i;
+                        stats.FirstMismatchValue = value;
+                    }
+                }
+                break;
+
+            case DIO_REGISTER_TRACE_WRITE:
+
+                Bar.Write(entry.Offset, entry.Value);
+
+                stats.Writes++;
+                break;
+
+            case DIO_REGISTER_TRACE_INPUTS:
+
+                Bar.SetInputs(entry.Value);
+
+                stats.InputChanges++;
+                break;
+
+            default:
+
+                if (entry.Value == DIO_REGISTER_TRACE_POWER_ON) {
+
+                    Bar.Reset();
+
+                } else if (entry.Value == DIO_REGISTER_TRACE_D0) {
+
+                    Bar.EnterD0();
+
+                } else {
+
+                    Bar.EnterD3(entry.Value == DIO_REGISTER_TRACE_D3_WAKE);
+                }
+
+                stats.PowerChanges++;
+                break;
+        }
+    }
+
+    return stats;
+}
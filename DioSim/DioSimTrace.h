@@ -0,0 +1,211 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioSimTrace.h -- Records the simulated device's register accesses,
+//                         and replays register traces against it
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      A DioSimBar records to a DioSimTraceRecorder (see SetTraceRecorder)
+//      every register access from the host, every change the field makes
+//      on the input lines, and every change in its power state, with its
+//      time on DioSimClock.  The trace is in the format of
+//      DioRegisterTrace.h, so it can be saved, and it's replayed just like
+//      a trace captured from the driver.
+//
+//      DioSimTraceReplay replays a trace against a DioSimBar: it makes each
+//      access, sets the inputs, or changes the power state at its time,
+//      and checks each value read against the one in the trace.  In
+//      virtual time it reproduces the trace's timing exactly while running
+//      as fast as the model does, so a trace recorded from the simulator
+//      replays with every read matching, and a trace replays in a fraction
+//      of the time it took to record.
+//
+//      What a read returns can depend on things the trace may not have:
+//
+//          The inputs.  Only the simulator sees them, so a trace from the
+//          driver (without DIO_REGISTER_TRACE_HAS_INPUTS) can't tell us
+//          what the input lines, change detection and interrupt status
+//          registers should read, and we don't check them.
+//
+//          The time since power on (TimeSincePowerUpRegister).  Only the
+//          simulator's traces start at power on, and we only check it for
+//          them, in virtual time at a Speed of 1.0.
+//
+//          Whatever came before, for a partial trace
+//          (DIO_REGISTER_TRACE_PARTIAL), which starts with the device in a
+//          state we can't know.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../inc/DioRegisterTrace.h"
+#include "DioSimBar.h"
+
+//
+// DioSimTraceRecorder
+//
+// Holds one trace, encoded as it's recorded.  A DioSimBar calls Begin when
+// the recorder is attached to it, and Record (with its lock held) for each
+// entry, so the recorder must stay attached to just that BAR.  Only look
+// at the trace once it's been detached.
+//
+class DioSimTraceRecorder
+{
+public:
+    DioSimTraceRecorder();
+
+    DioSimTraceRecorder(const DioSimTraceRecorder&) = delete;
+    DioSimTraceRecorder& operator=(const DioSimTraceRecorder&) = delete;
+
+    //
+    // Start again, with a trace with the given flags
+    // (DIO_REGISTER_TRACE_xxx)
+    //
+    void Begin(uint32_t Flags);
+
+    //
+    // Entry's time is in nanoseconds
+    //
+    void Record(const DIO_REGISTER_TRACE_ENTRY& Entry);
+
+    uint64_t EntryCount() const
+    {
+        return Count;
+    }
+
+    //
+    // The trace, as it would be in a file
+    //
+    std::vector<uint8_t> File() const;
+
+    bool Save(const char* Path) const;
+
+private:
+    std::vector<uint8_t> Encoded;
+    uint64_t             Count;
+    uint64_t             LastTime;
+    uint32_t             Flags;
+};
+
+//
+// DioSimTrace
+//
+// A trace, read from a file or from memory and decoded.  Open and Parse
+// return false if it isn't a trace we understand, or is malformed.
+//
+class DioSimTrace
+{
+public:
+    DioSimTrace();
+
+    bool Open(const char* Path);
+
+    bool Parse(const uint8_t* Data,
+               size_t         Length);
+
+    //
+    // The entries, with their times converted to nanoseconds
+    //
+    const std::vector<DIO_REGISTER_TRACE_ENTRY>& Entries() const
+    {
+        return TraceEntries;
+    }
+
+    uint32_t Flags() const
+    {
+        return TraceFlags;
+    }
+
+private:
+    std::vector<DIO_REGISTER_TRACE_ENTRY> TraceEntries;
+    uint32_t                              TraceFlags;
+};
+
+typedef struct _DIO_SIM_REPLAY_STATS {
+    uint64_t Reads;
+    uint64_t Writes;
+    uint64_t InputChanges;
+    uint64_t PowerChanges;
+
+    //
+    // Reads whose values we could check (see above), and how many of
+    // those didn't match the trace
+    //
+    uint64_t Checked;
+    uint64_t Mismatches;
+
+    //
+    // The index in the trace of the first read that didn't match, and what
+    // it read instead
+    //
+    uint64_t FirstMismatch;
+    uint32_t FirstMismatchValue;
+
+    //
+    // How late the latest entry was, in nanoseconds (in real time, with a
+    // Speed above zero)
+    //
+    uint64_t MaxLateness;
+} DIO_SIM_REPLAY_STATS, *PDIO_SIM_REPLAY_STATS;
+
+constexpr uint64_t DIO_SIM_NO_MISMATCH = UINT64_MAX;
+
+//
+// DioSimTraceReplay
+//
+// Replays traces against Bar, resetting it first (as at power on).
+//
+// Speed scales the timing, as it does for DioSimPlayer: 1.0 is the trace's
+// own timing, 2.0 twice as fast, and zero means "as fast as possible" (in
+// virtual time, letting the simulator settle before each entry).  Only at
+// 1.0 does the model see the accesses at the times the trace says, so
+// only then can we expect every read to match.
+//
+class DioSimTraceReplay
+{
+public:
+    explicit DioSimTraceReplay(DioSimBar& Bar);
+
+    DIO_SIM_REPLAY_STATS Replay(const DioSimTrace& Trace,
+                                double             Speed);
+
+private:
+    DioSimBar& Bar;
+};
@@ -0,0 +1,754 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioSimWaveform.cpp -- Synthetic input waveforms for driving the
+//                              simulated device
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <cmath>
+
+#include "../DioCapture/DioCaptureFormat.h"
+#include "DioSimWaveform.h"
+
+static inline uint32_t
+PopCount(uint32_t Value)
+{
+#ifdef _MSC_VER
+    return (uint32_t)__popcnt(Value);
+#else
+    return (uint32_t)__builtin_popcount(Value);
+#endif
+}
+
+//
+// Fills in LineList with the numbers of the lines in Lines, and returns
+// how many there are
+//
+static uint32_t
+ListLines(uint32_t  Lines,
+          uint32_t* LineList)
+{
+    uint32_t count = 0;
+
+    for (uint32_t line = 0; line < 32; line++) {
+
+        if ((Lines & (1U << line)) != 0) {
+            LineList[count++] = line;
+        }
+    }
+
+    return count;
+}
+
+//
+// Sorts a waveform's pending edges by time (there are only ever a few)
+//
+static void
+SortEdges(PDIO_SIM_EDGE Edges,
+          uint32_t      Count)
+{
+    for (uint32_t i = 1; i < Count; i++) {
+        DIO_SIM_EDGE edge = Edges[i];
+        uint32_t     j    = i;
+
+        while (j > 0 && Edges[j - 1].Time > edge.Time) {
+
+            Edges[j] = Edges[j - 1];
+            j--;
+        }
+
+        Edges[j] = edge;
+    }
+}
+
+double
+DioSimRandom::Exponential(double Mean)
+{
+    //
+    // By inversion: -mean * ln(U), U in (0, 1]
+    //
+    return -Mean * log(Uniform());
+}
+
+DioSimPoissonWaveform::DioSimPoissonWaveform(uint32_t Lines,
+                                             double   RateHz,
+                                             uint64_t Seed,
+                                             uint32_t MultiLinePercent)
+    : DioSimWaveform(Lines, 0),
+      MeanIntervalNs(RateHz > 0.0 ? 1e9 / RateHz : 0.0),
+      RandomSeed(Seed),
+      MultiLine(MultiLinePercent),
+      Random(Seed)
+{
+    LineCount = ListLines(Lines, LineList);
+
+    Rewind();
+}
+
+bool
+DioSimPoissonWaveform::Next(uint64_t& Time,
+                            uint32_t& State)
+{
+    uint32_t changed;
+
+    if (LineCount == 0 || MeanIntervalNs == 0.0) {
+        return false;
+    }
+
+    //
+    // Keep the clock in floating point, so that rounding each interval to
+    // a whole nanosecond doesn't skew the rate when intervals are short
+    //
+    Clock += Random.Exponential(MeanIntervalNs);
+
+    changed = 1U << LineList[Random.Below(LineCount)];
+
+    if (MultiLine != 0 && Random.Below(100) < MultiLine) {
+        changed |= (uint32_t)Random.Next() & Lines();
+    }
+
+    LineState ^= changed;
+
+    Time  = (uint64_t)Clock;
+    State = LineState;
+
+    return true;
+}
+
+void
+DioSimPoissonWaveform::Rewind()
+{
+    Random.Reseed(RandomSeed);
+
+    Clock     = 0.0;
+    LineState = 0;
+}
+
+DioSimClockWaveform::DioSimClockWaveform(uint32_t Line,
+                                         uint64_t PeriodNs,
+                                         uint64_t HighNs,
+                                         uint64_t PhaseNs,
+                                         uint64_t JitterNs,
+                                         uint64_t Seed)
+    : DioSimWaveform(1U << Line, 0),
+      LineBit(1U << Line),
+      RandomSeed(Seed),
+      Random(Seed)
+{
+    Period = (PeriodNs < 2) ? 2 : PeriodNs;
+    High   = (HighNs < 1) ? 1 : (HighNs >= Period) ? Period - 1 : HighNs;
+    Phase  = PhaseNs % Period;
+
+    //
+    // Jitter mustn't be able to move an edge past the one after it
+    //
+    Jitter = (High < Period - High) ? High - 1 : Period - High - 1;
+
+    if (JitterNs < Jitter) {
+        Jitter = JitterNs;
+    }
+
+    Rewind();
+}
+
+bool
+DioSimClockWaveform::Next(uint64_t& Time,
+                          uint32_t& State)
+{
+    Time = Cycle * Period + Phase + (Rising ? 0 : High);
+
+    if (Jitter != 0) {
+        Time += Random.Next() % (Jitter + 1);
+    }
+
+    if (Rising) {
+
+        State  = LineBit;
+        Rising = false;
+
+    } else {
+
+        State  = 0;
+        Rising = true;
+        Cycle++;
+    }
+
+    return true;
+}
+
+void
+DioSimClockWaveform::Rewind()
+{
+    Random.Reseed(RandomSeed);
+
+    Cycle  = 0;
+    Rising = true;
+}
+
+DioSimBurstWaveform::DioSimBurstWaveform(uint32_t Lines,
+                                         uint32_t BurstEdges,
+                                         uint64_t EdgeIntervalNs,
+                                         uint64_t GapNs,
+                                         uint64_t Seed)
+    : DioSimWaveform(Lines, 0),
+      Edges(BurstEdges != 0 ? BurstEdges : 1),
+      EdgeInterval(EdgeIntervalNs != 0 ? EdgeIntervalNs : 1),
+      Gap(GapNs != 0 ? GapNs : 1),
+      RandomSeed(Seed),
+      Random(Seed)
+{
+    LineCount = ListLines(Lines, LineList);
+
+    Rewind();
+}
+
+bool
+DioSimBurstWaveform::Next(uint64_t& Time,
+                          uint32_t& State)
+{
+    if (LineCount == 0) {
+        return false;
+    }
+
+    LineState ^= 1U << LineList[Random.Below(LineCount)];
+
+    Time  = EdgeTime;
+    State = LineState;
+
+    if (++EdgeInBurst == Edges) {
+
+        EdgeInBurst = 0;
+        EdgeTime   += Gap;
+
+    } else {
+
+        EdgeTime += EdgeInterval;
+    }
+
+    return true;
+}
+
+void
+DioSimBurstWaveform::Rewind()
+{
+    Random.Reseed(RandomSeed);
+
+    EdgeTime    = 0;
+    EdgeInBurst = 0;
+    LineState   = 0;
+}
+
+DioSimBounceWaveform::DioSimBounceWaveform(uint32_t Line,
+                                           uint64_t MeanIntervalNs,
+                                           uint32_t MaxBounces,
+                                           uint64_t MaxBounceNs,
+                                           uint64_t Seed)
+    : DioSimWaveform(1U << Line, 0),
+      LineBit(1U << Line),
+      MeanInterval(MeanIntervalNs >= 2 ? MeanIntervalNs : 2),
+      Bounces(MaxBounces < DIO_SIM_MAX_BOUNCES ? MaxBounces : DIO_SIM_MAX_BOUNCES),
+      MaxBounce(MaxBounceNs != 0 ? MaxBounceNs : 1),
+      RandomSeed(Seed),
+      Random(Seed)
+{
+    Rewind();
+}
+
+bool
+DioSimBounceWaveform::Next(uint64_t& Time,
+                           uint32_t& State)
+{
+    if (PendingNext == PendingCount) {
+        uint64_t time;
+        uint32_t bounces;
+
+        //
+        // Work out the whole of the next actuation: the contact changes,
+        // then each bounce takes it back to where it was and then forward
+        // again
+        //
+        time    = SettledTime + MeanInterval / 2 + Random.Next() % (MeanInterval + 1);
+        bounces = Random.Below(Bounces + 1);
+
+        PendingCount = 0;
+        PendingNext  = 0;
+
+        Pending[PendingCount++] = { time, LineBit };
+
+        for (uint32_t i = 0; i < bounces; i++) {
+
+            time += 1 + Random.Next() % MaxBounce;
+
+            Pending[PendingCount++] = { time, LineBit };
+
+            time += 1 + Random.Next() % MaxBounce;
+
+            Pending[PendingCount++] = { time, LineBit };
+        }
+
+        SettledTime = time;
+
+        ActuationCount++;
+    }
+
+    LineState ^= Pending[PendingNext].Lines;
+
+    Time  = Pending[PendingNext++].Time;
+    State = LineState;
+
+    return true;
+}
+
+void
+DioSimBounceWaveform::Rewind()
+{
+    Random.Reseed(RandomSeed);
+
+    SettledTime    = 0;
+    ActuationCount = 0;
+    PendingCount   = 0;
+    PendingNext    = 0;
+    LineState      = 0;
+}
+
+//
+// The levels of A (bit 0) and B (bit 1) at each step of the quadrature
+// cycle.  Going forward, A changes first.
+//
+static const uint32_t EncoderPhases[4] = { 0, 1, 3, 2 };
+
+DioSimEncoderWaveform::DioSimEncoderWaveform(uint32_t LineA,
+                                             uint64_t StepIntervalNs,
+                                             uint32_t ReversePercent,
+                                             uint64_t Seed)
+    : DioSimWaveform(3U << LineA, 0),
+      FirstLine(LineA),
+      StepInterval(StepIntervalNs != 0 ? StepIntervalNs : 1),
+      Reverse(ReversePercent),
+      RandomSeed(Seed),
+      Random(Seed)
+{
+    Rewind();
+}
+
+bool
+DioSimEncoderWaveform::Next(uint64_t& Time,
+                            uint32_t& State)
+{
+    if (Reverse != 0 && Random.Below(100) < Reverse) {
+        Forward = !Forward;
+    }
+
+    Phase     = (Phase + (Forward ? 1 : 3)) & 3;
+    Steps    += Forward ? 1 : -1;
+    StepTime += StepInterval;
+
+    Time  = StepTime;
+    State = EncoderPhases[Phase] << FirstLine;
+
+    return true;
+}
+
+void
+DioSimEncoderWaveform::Rewind()
+{
+    Random.Reseed(RandomSeed);
+
+    StepTime = 0;
+    Phase    = 0;
+    Forward  = true;
+    Steps    = 0;
+}
+
+//
+// The lines of a bus Width wide from Base (stopping at line 31)
+//
+static uint32_t
+BusLines(uint32_t Base,
+         uint32_t Width)
+{
+    if (Base >= 32) {
+        return 0;
+    }
+
+    if (Width >= 32 - Base) {
+        return 0xFFFFFFFF << Base;
+    }
+
+    return ((1U << Width) - 1) << Base;
+}
+
+DioSimBusWaveform::DioSimBusWaveform(uint32_t BaseLine,
+                                     uint32_t Width,
+                                     uint32_t StrobeLine,
+                                     uint64_t WordIntervalNs,
+                                     uint64_t SkewNs,
+                                     uint64_t Seed)
+    : DioSimWaveform(BusLines(BaseLine, Width) |
+                         (StrobeLine < 32 ? 1U << StrobeLine : 0),
+                     0),
+      DataLines(BusLines(BaseLine, Width) & ~(StrobeLine < 32 ? 1U << StrobeLine : 0)),
+      StrobeBit(StrobeLine < 32 ? 1U << StrobeLine : 0),
+      WordInterval(WordIntervalNs >= 4 ? WordIntervalNs : 4),
+      RandomSeed(Seed),
+      Random(Seed)
+{
+    Skew = (SkewNs < WordInterval / 4) ? SkewNs : WordInterval / 4;
+
+    Rewind();
+}
+
+bool
+DioSimBusWaveform::Next(uint64_t& Time,
+                        uint32_t& State)
+{
+    if (DataLines == 0 && StrobeBit == 0) {
+        return false;
+    }
+
+    //
+    // A word that happens to be the same as the last one, with no strobe,
+    // has no edges at all, so keep going until we find one that does
+    //
+    while (PendingNext == PendingCount) {
+        uint32_t dataState = LineState & DataLines;
+        uint32_t changed;
+
+        changed = ((uint32_t)Random.Next() & DataLines) ^ dataState;
+
+        PendingCount = 0;
+        PendingNext  = 0;
+
+        for (uint32_t lines = changed; lines != 0; lines &= lines - 1) {
+            uint64_t time = WordTime;
+
+            if (Skew != 0) {
+                time += Random.Next() % (Skew + 1);
+            }
+
+            Pending[PendingCount++] = { time, lines & (0U - lines) };
+        }
+
+        if (StrobeBit != 0) {
+
+            Pending[PendingCount++] = { WordTime + Skew + WordInterval / 4, StrobeBit };
+            Pending[PendingCount++] = { WordTime + Skew + 3 * WordInterval / 4, StrobeBit };
+        }
+
+        SortEdges(Pending, PendingCount);
+
+        WordTime += WordInterval;
+    }
+
+    LineState ^= Pending[PendingNext].Lines;
+
+    Time  = Pending[PendingNext++].Time;
+    State = LineState;
+
+    return true;
+}
+
+void
+DioSimBusWaveform::Rewind()
+{
+    Random.Reseed(RandomSeed);
+
+    WordTime     = 0;
+    PendingCount = 0;
+    PendingNext  = 0;
+    LineState    = 0;
+}
+
+DioSimWaveformSource::DioSimWaveformSource(uint64_t DurationNs,
+                                           uint64_t TickNs)
+    : Duration(DurationNs),
+      Tick(TickNs != 0 ? TickNs : 1),
+      SlotCount(0),
+      UsedLines(0),
+      FilteredLines(0)
+{
+    for (uint64_t& interval : FilterInterval) {
+        interval = 0;
+    }
+
+    Rewind();
+}
+
+bool
+DioSimWaveformSource::Add(DioSimWaveform* Waveform)
+{
+    if (SlotCount == DIO_SIM_MAX_WAVEFORMS ||
+        (Waveform->Lines() & UsedLines) != 0) {
+        return false;
+    }
+
+    Slots[SlotCount++].Waveform = Waveform;
+
+    UsedLines |= Waveform->Lines();
+
+    return true;
+}
+
+void
+DioSimWaveformSource::SetFilters(uint32_t FilterPort0and1,
+                                 uint32_t FilterPort2and3)
+{
+    FilteredLines = 0;
+
+    for (uint32_t line = 0; line < 32; line++) {
+
+        FilterInterval[line] = DioSimFilterIntervalNs(FilterPort0and1,
+                                                      FilterPort2and3,
+                                                      line);
+
+        if (FilterInterval[line] != 0) {
+            FilteredLines |= 1U << line;
+        }
+    }
+}
+
+uint32_t
+DioSimWaveformSource::InitialState() const
+{
+    uint32_t state = 0;
+
+    for (size_t i = 0; i < SlotCount; i++) {
+        state |= Slots[i].Waveform->InitialState();
+    }
+
+    return state;
+}
+
+void
+DioSimWaveformSource::Rewind()
+{
+    Started     = false;
+    Ended       = false;
+    HeldValid   = false;
+    InputEdges  = 0;
+    OutputEdges = 0;
+}
+
+void
+DioSimWaveformSource::Fetch(WAVEFORM_SLOT& Slot)
+{
+    uint64_t time;
+
+    if (!Slot.Waveform->Next(time, Slot.State)) {
+
+        Slot.Ended = true;
+
+        return;
+    }
+
+    Slot.Time = time - time % Tick;
+}
+
+//
+// Adds a change (already made to OutputState) to the held event, and
+// returns true if that meant the event held before it was complete and
+// was written to Out
+//
+bool
+DioSimWaveformSource::Commit(uint64_t   Time,
+                             uint32_t   Changed,
+                             PDIO_EVENT Out)
+{
+    bool written = false;
+
+    if (Held.Timestamp == Time) {
+
+        Held.LineState     = OutputState;
+        Held.ChangedLines ^= Changed;
+
+        return false;
+    }
+
+    //
+    // Changes that cancelled each other out leave an event with nothing
+    // in it, which we drop (all but the first, which starts the stream)
+    //
+    if (Held.ChangedLines != 0 || Held.Timestamp == 0) {
+
+        *Out = Held;
+
+        OutputEdges += PopCount(Held.ChangedLines);
+
+        written = true;
+    }
+
+    Held.Timestamp    = Time;
+    Held.LineState    = OutputState;
+    Held.ChangedLines = Changed;
+
+    return written;
+}
+
+size_t
+DioSimWaveformSource::Read(PDIO_EVENT Events,
+                           size_t     Count)
+{
+    size_t count = 0;
+
+    if (!Started) {
+
+        for (size_t i = 0; i < SlotCount; i++) {
+
+            Slots[i].Waveform->Rewind();
+            Slots[i].Ended = false;
+
+            Fetch(Slots[i]);
+        }
+
+        InputState   = InitialState();
+        OutputState  = InputState;
+        PendingLines = 0;
+
+        Held.Timestamp    = 0;
+        Held.LineState    = OutputState;
+        Held.ChangedLines = 0;
+
+        HeldValid = true;
+        Started   = true;
+    }
+
+    while (count < Count && !Ended) {
+        WAVEFORM_SLOT* next = nullptr;
+        uint64_t       when = UINT64_MAX;
+        uint64_t       due  = UINT64_MAX;
+        uint32_t       changed;
+        uint32_t       direct;
+
+        for (size_t i = 0; i < SlotCount; i++) {
+
+            if (!Slots[i].Ended && Slots[i].Time < when) {
+
+                next = &Slots[i];
+                when = Slots[i].Time;
+            }
+        }
+
+        for (uint32_t lines = PendingLines; lines != 0; lines &= lines - 1) {
+            uint32_t line = DioCaptureLowestSetBit(lines);
+
+            if (FilterDue[line] < due) {
+                due = FilterDue[line];
+            }
+        }
+
+        if ((when < due ? when : due) >= Duration) {
+
+            Ended = true;
+
+            break;
+        }
+
+        //
+        // A filtered line that's been stable long enough changes before
+        // any change on the inputs at the same time is sampled
+        //
+        if (due <= when) {
+
+            changed = 0;
+
+            for (uint32_t lines = PendingLines; lines != 0; lines &= lines - 1) {
+                uint32_t line = DioCaptureLowestSetBit(lines);
+
+                if (FilterDue[line] == due) {
+                    changed |= 1U << line;
+                }
+            }
+
+            PendingLines &= ~changed;
+            OutputState  ^= changed;
+
+            if (Commit(due, changed, &Events[count])) {
+                count++;
+            }
+
+            continue;
+        }
+
+        changed     = (InputState ^ next->State) & next->Waveform->Lines();
+        InputState ^= changed;
+        InputEdges += PopCount(changed);
+
+        Fetch(*next);
+
+        //
+        // A filtered line takes its new level on the second tick of its
+        // filter clock that sees it, unless it changes back first
+        //
+        for (uint32_t lines = changed & FilteredLines; lines != 0; lines &= lines - 1) {
+            uint32_t line     = DioCaptureLowestSetBit(lines);
+            uint64_t interval = FilterInterval[line];
+
+            if ((PendingLines & (1U << line)) != 0) {
+
+                PendingLines &= ~(1U << line);
+
+            } else {
+
+                FilterDue[line] = (when / interval + 2) * interval;
+                PendingLines   |= 1U << line;
+            }
+        }
+
+        direct = changed & ~FilteredLines;
+
+        if (direct != 0) {
+
+            OutputState ^= direct;
+
+            if (Commit(when, direct, &Events[count])) {
+                count++;
+            }
+        }
+    }
+
+    if (Ended && HeldValid && count < Count) {
+
+        if (Held.ChangedLines != 0 || Held.Timestamp == 0) {
+
+            Events[count++] = Held;
+
+            OutputEdges += PopCount(Held.ChangedLines);
+        }
+
+        HeldValid = false;
+    }
+
+    return count;
+}
@@ -0,0 +1,516 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioSimWaveform.h -- Synthetic input waveforms for driving the
+//                            simulated device
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      A waveform generates the changes on some set of lines: random edges,
+//      a clock, bursts, a bouncing contact, a quadrature encoder, a parallel
+//      bus.  A DioSimWaveformSource mixes any number of them, on disjoint
+//      lines, into one event stream that can be played into the simulated
+//      device (with DioSimPlayer), written to a capture, or fed straight to
+//      a decoder.
+//
+//      Everything is generated as it's read, so streams can be as long as
+//      we like (hours of input at millions of edges per second) without
+//      ever being held in memory.  Every random choice comes from a
+//      DioSimRandom seeded by the caller, so the same waveforms give the
+//      same stream on every run and every host.
+//
+//      The source can also apply the device's digital filters (as set in
+//      its DI_FilterRegister_Port0and1 and DI_FilterRegister_Port2and3
+//      registers), so that the stream is what the change detection logic
+//      would see, not what's on the wire.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../DioCapture/DioEvent.h"
+#include "DioSimBar.h"
+
+//
+// Most waveforms a source can mix (they must drive disjoint lines)
+//
+constexpr size_t DIO_SIM_MAX_WAVEFORMS = 32;
+
+//
+// The resolution of generated timestamps, by default: the period of the
+// device's 100 MHz clock
+//
+constexpr uint64_t DIO_SIM_WAVEFORM_TICK_NS = 10;
+
+//
+// For a waveform's optional line, when it shouldn't have one
+//
+constexpr uint32_t DIO_SIM_NO_LINE = 0xFFFFFFFF;
+
+//
+// Most bounces DioSimBounceWaveform makes per actuation
+//
+constexpr uint32_t DIO_SIM_MAX_BOUNCES = 16;
+
+//
+// DioSimRandom
+//
+// Simple deterministic PRNG (xorshift64*), so that generated streams are the
+// same on every run and every host
+//
+class DioSimRandom
+{
+public:
+    explicit DioSimRandom(uint64_t Seed)
+    {
+        Reseed(Seed);
+    }
+
+    void Reseed(uint64_t Seed)
+    {
+        State = (Seed != 0) ? Seed : 0x9E3779B97F4A7C15ULL;
+    }
+
+    uint64_t Next()
+    {
+        State ^= State >> 12;
+        State ^= State << 25;
+        State ^= State >> 27;
+
+        return State * 0x2545F4914F6CDD1DULL;
+    }
+
+    uint32_t Below(uint32_t Limit)
+    {
+        return (uint32_t)(Next() % Limit);
+    }
+
+    //
+    // Uniform in (0, 1]
+    //
+    double Uniform()
+    {
+        return ((Next() >> 11) + 1) * (1.0 / 9007199254740992.0);
+    }
+
+    //
+    // Exponentially distributed, averaging Mean (the interval between
+    // the events of a Poisson process)
+    //
+    double Exponential(double Mean);
+
+private:
+    uint64_t State;
+};
+
+//
+// DIO_SIM_EDGE
+//
+// A change a waveform has worked out but not yet returned: Lines toggle at
+// Time
+//
+typedef struct _DIO_SIM_EDGE {
+    uint64_t Time;
+    uint32_t Lines;
+} DIO_SIM_EDGE, *PDIO_SIM_EDGE;
+
+//
+// DioSimWaveform
+//
+// Base class for all waveforms.  A waveform drives the lines in Lines(),
+// starting at InitialState() (of which only the bits in Lines() count).
+//
+//  Next        Returns the time of the waveform's next change, and the
+//              state of its lines after it, or false if it has no more.
+//              Times are in nanoseconds from the start of the waveform,
+//              and never go backwards.  Several changes may have the same
+//              time.
+//
+//  Rewind      Starts the waveform again, exactly as it was first
+//              generated.
+//
+class DioSimWaveform
+{
+public:
+    DioSimWaveform(uint32_t Lines,
+                   uint32_t InitialState)
+        : LineMask(Lines),
+          Initial(InitialState & Lines)
+    {
+    }
+
+    virtual ~DioSimWaveform() = default;
+
+    uint32_t Lines() const
+    {
+        return LineMask;
+    }
+
+    uint32_t InitialState() const
+    {
+        return Initial;
+    }
+
+    virtual bool Next(uint64_t& Time,
+                      uint32_t& State) = 0;
+
+    virtual void Rewind() = 0;
+
+private:
+    uint32_t LineMask;
+    uint32_t Initial;
+};
+
+//
+// DioSimPoissonWaveform
+//
+// Edges at exponentially distributed (Poisson process) intervals,
+// averaging RateHz edges a second.  Each toggles one random line in Lines
+// or, MultiLinePercent of the time, several of them at once.
+//
+class DioSimPoissonWaveform : public DioSimWaveform
+{
+public:
+    DioSimPoissonWaveform(uint32_t Lines,
+                          double   RateHz,
+                          uint64_t Seed,
+                          uint32_t MultiLinePercent = 0);
+
+    bool Next(uint64_t& Time,
+              uint32_t& State) override;
+
+    void Rewind() override;
+
+private:
+    uint32_t     LineList[32];
+    uint32_t     LineCount;
+    double       MeanIntervalNs;
+    uint64_t     RandomSeed;
+    uint32_t     MultiLine;
+    DioSimRandom Random;
+    double       Clock;
+    uint32_t     LineState;
+};
+
+//
+// DioSimClockWaveform
+//
+// A clock on Line: it rises PhaseNs into every PeriodNs, and falls HighNs
+// later.  Each edge is then delayed by a random 0 to JitterNs (no more than
+// keeps the edges in order).
+//
+class DioSimClockWaveform : public DioSimWaveform
+{
+public:
+    DioSimClockWaveform(uint32_t Line,
+                        uint64_t PeriodNs,
+                        uint64_t HighNs,
+                        uint64_t PhaseNs  = 0,
+                        uint64_t JitterNs = 0,
+                        uint64_t Seed     = 1);
+
+    bool Next(uint64_t& Time,
+              uint32_t& State) override;
+
+    void Rewind() override;
+
+private:
+    uint32_t     LineBit;
+    uint64_t     Period;
+    uint64_t     High;
+    uint64_t     Phase;
+    uint64_t     Jitter;
+    uint64_t     RandomSeed;
+    DioSimRandom Random;
+    uint64_t     Cycle;
+    bool         Rising;
+};
+
+//
+// DioSimBurstWaveform
+//
+// Bursts of BurstEdges edges, EdgeIntervalNs apart, each toggling one
+// random line in Lines, with GapNs of quiet between the bursts.
+//
+class DioSimBurstWaveform : public DioSimWaveform
+{
+public:
+    DioSimBurstWaveform(uint32_t Lines,
+                        uint32_t BurstEdges,
+                        uint64_t EdgeIntervalNs,
+                        uint64_t GapNs,
+                        uint64_t Seed);
+
+    bool Next(uint64_t& Time,
+              uint32_t& State) override;
+
+    void Rewind() override;
+
+private:
+    uint32_t     LineList[32];
+    uint32_t     LineCount;
+    uint32_t     Edges;
+    uint64_t     EdgeInterval;
+    uint64_t     Gap;
+    uint64_t     RandomSeed;
+    DioSimRandom Random;
+    uint64_t     EdgeTime;
+    uint32_t     EdgeInBurst;
+    uint32_t     LineState;
+};
+
+//
+// DioSimBounceWaveform
+//
+// A mechanical contact on Line, actuated at random intervals of half to
+// one and a half times MeanIntervalNs (counted from when the contact last
+// settled).  Each actuation bounces up to MaxBounces times (at most
+// DIO_SIM_MAX_BOUNCES) before it settles: the contact briefly returns to
+// its old level, and each bounce and each gap between them lasts a random
+// 1 to MaxBounceNs.
+//
+// Filtered with an interval longer than MaxBounceNs, and with half of
+// MeanIntervalNs longer than two intervals, each actuation is exactly one
+// change.
+//
+class DioSimBounceWaveform : public DioSimWaveform
+{
+public:
+    DioSimBounceWaveform(uint32_t Line,
+                         uint64_t MeanIntervalNs,
+                         uint32_t MaxBounces,
+                         uint64_t MaxBounceNs,
+                         uint64_t Seed);
+
+    bool Next(uint64_t& Time,
+              uint32_t& State) override;
+
+    void Rewind() override;
+
+    //
+    // Number of actuations generated so far
+    //
+    uint64_t Actuations() const
+    {
+        return ActuationCount;
+    }
+
+private:
+    uint32_t     LineBit;
+    uint64_t     MeanInterval;
+    uint32_t     Bounces;
+    uint64_t     MaxBounce;
+    uint64_t     RandomSeed;
+    DioSimRandom Random;
+    uint64_t     SettledTime;
+    uint64_t     ActuationCount;
+    DIO_SIM_EDGE Pending[2 * DIO_SIM_MAX_BOUNCES + 1];
+    uint32_t     PendingCount;
+    uint32_t     PendingNext;
+    uint32_t     LineState;
+};
+
+//
+// DioSimEncoderWaveform
+//
+// A quadrature encoder on LineA and LineA + 1 (B), stepping every
+// StepIntervalNs.  Forward, A leads B.  Before each step the encoder
+// reverses direction ReversePercent of the time.
+//
+class DioSimEncoderWaveform : public DioSimWaveform
+{
+public:
+    DioSimEncoderWaveform(uint32_t LineA,
+                          uint64_t StepIntervalNs,
+                          uint32_t ReversePercent,
+                          uint64_t Seed);
+
+    bool Next(uint64_t& Time,
+              uint32_t& State) override;
+
+    void Rewind() override;
+
+    //
+    // Steps forward less steps back, so far
+    //
+    int64_t Position() const
+    {
+        return Steps;
+    }
+
+private:
+    uint32_t     FirstLine;
+    uint64_t     StepInterval;
+    uint32_t     Reverse;
+    uint64_t     RandomSeed;
+    DioSimRandom Random;
+    uint64_t     StepTime;
+    uint32_t     Phase;
+    bool         Forward;
+    int64_t      Steps;
+};
+
+//
+// DioSimBusWaveform
+//
+// A parallel bus on Width lines from BaseLine.  Every WordIntervalNs a
+// random word is put on the bus, with each data line that changes doing so
+// up to SkewNs late (no more than a quarter of a word).  If StrobeLine is
+// not DIO_SIM_NO_LINE, a strobe on it rises a quarter of a word after the
+// data is stable and falls half a word later.
+//
+class DioSimBusWaveform : public DioSimWaveform
+{
+public:
+    DioSimBusWaveform(uint32_t BaseLine,
+                      uint32_t Width,
+                      uint32_t StrobeLine,
+                      uint64_t WordIntervalNs,
+                      uint64_t SkewNs,
+                      uint64_t Seed);
+
+    bool Next(uint64_t& Time,
+              uint32_t& State) override;
+
+    void Rewind() override;
+
+private:
+    uint32_t     DataLines;
+    uint32_t     StrobeBit;
+    uint64_t     WordInterval;
+    uint64_t     Skew;
+    uint64_t     RandomSeed;
+    DioSimRandom Random;
+    uint64_t     WordTime;
+    DIO_SIM_EDGE Pending[34];
+    uint32_t     PendingCount;
+    uint32_t     PendingNext;
+    uint32_t     LineState;
+};
+
+//
+// DioSimWaveformSource
+//
+// Mixes waveforms on disjoint lines into one stream of events.  The
+// waveforms are owned by the caller, and must outlive the source.
+//
+// The stream begins with an event at time zero carrying the initial state
+// of the lines (and no ChangedLines, unless something changes then too), so
+// a player starts its clock at zero.  Timestamps are rounded down to
+// multiples of TickNs, and changes with the same timestamp are merged into
+// one event.  The stream ends at DurationNs, or when all of the waveforms
+// have ended.
+//
+class DioSimWaveformSource : public DioEventSource
+{
+public:
+    DioSimWaveformSource(uint64_t DurationNs,
+                         uint64_t TickNs = DIO_SIM_WAVEFORM_TICK_NS);
+
+    DioSimWaveformSource(const DioSimWaveformSource&) = delete;
+    DioSimWaveformSource& operator=(const DioSimWaveformSource&) = delete;
+
+    //
+    // Fails if the waveform drives a line another one already does, or
+    // if there are already DIO_SIM_MAX_WAVEFORMS
+    //
+    bool Add(DioSimWaveform* Waveform);
+
+    //
+    // Filter the lines as the device would, with these values in its
+    // filter registers (the default is no filtering)
+    //
+    void SetFilters(uint32_t FilterPort0and1,
+                    uint32_t FilterPort2and3);
+
+    uint32_t InitialState() const;
+
+    size_t Read(PDIO_EVENT Events,
+                size_t     Count) override;
+
+    //
+    // Start the stream again, from the beginning
+    //
+    void Rewind();
+
+    //
+    // Number of edges the waveforms generated, and the number that made
+    // it into the stream (the rest were removed by the filters, or
+    // cancelled by another edge on the same line in the same tick)
+    //
+    uint64_t Edges() const
+    {
+        return InputEdges;
+    }
+
+    uint64_t PassedEdges() const
+    {
+        return OutputEdges;
+    }
+
+private:
+    typedef struct _WAVEFORM_SLOT {
+        DioSimWaveform* Waveform;
+        uint64_t        Time;
+        uint32_t        State;
+        bool            Ended;
+    } WAVEFORM_SLOT;
+
+    void Fetch(WAVEFORM_SLOT& Slot);
+
+    bool Commit(uint64_t   Time,
+                uint32_t   Changed,
+                PDIO_EVENT Out);
+
+    uint64_t      Duration;
+    uint64_t      Tick;
+    WAVEFORM_SLOT Slots[DIO_SIM_MAX_WAVEFORMS];
+    size_t        SlotCount;
+    uint32_t      UsedLines;
+    uint64_t      FilterInterval[32];
+    uint32_t      FilteredLines;
+    uint64_t      FilterDue[32];
+    uint32_t      PendingLines;
+    uint32_t      InputState;
+    uint32_t      OutputState;
+    DIO_EVENT     Held;
+    bool          HeldValid;
+    bool          Started;
+    bool          Ended;
+    uint64_t      InputEdges;
+    uint64_t      OutputEdges;
+};
@@ -0,0 +1,1293 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioStress.cpp -- Concurrency stress test for the simulated
+//                         driver
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      Runs the driver's core (DioDriverCore.h), as the simulated device
+//      runs it against the simulated BAR, on all of its paths at once, as
+//      hard as they'll go, for as long as it's told to:
+//
+//          - a field thread changes the inputs, so the device's ISR thread
+//            takes interrupts and runs the DpcForIsr
+//
+//          - more threads run the ISR and the DpcForIsr themselves
+//            (RunIsr and RunDpc), as other processors would when the
+//            interrupt is shared or the DpcForIsr is queued again while
+//            it's running
+//
+//          - many Request threads, each with a handle to a random port (or
+//            the whole device) opened with random access, send random
+//            IOCTLs: reads, writes, SetOutputs, ApplyProfile,
+//            WaitForChange, ReadEvents, WaitEventRing, SetDpcProcessor,
+//            SaveProfile, AttachEventRing and the statistics, now and then
+//            closing their handle and opening another
+//
+//          - a consumer reads the device's event ring as an application
+//            does, in place, without locks
+//
+//          - a canceller cancels waiting Requests, and another thread
+//            changes the costs of Requests, completions and register
+//            accesses as it goes
+//
+//          - a second device stresses the ring publish.  Its field numbers
+//            every change it makes, its ISR runs on three threads, and an
+//            administrator moves its DpcForIsr from processor to processor
+//            (the driver's cancel, retarget and requeue).  An application
+//            attaches rings of random sizes to it with
+//            IOCTL_OSRDIO_ATTACH_EVENT_RING (allocated to exactly the
+//            length it gives, so AddressSanitizer catches a store past the
+//            end), reads them in place, and detaches them by cancelling
+//            the Request or closing its handle.  Now and then a ring is
+//            hostile and scribbles on its ConsumerIndex, which the driver
+//            must survive without writing outside the ring.
+//
+//      The first device idles between Requests (if the seed says so), so
+//      power transitions race with all of that too.  Every thread pauses
+//      at random (not at all, yield, spin or sleep) between steps, so each
+//      run interleaves them differently.  The seed (printed, or given with
+//      -s) decides the devices' settings and every thread's choices, but
+//      not how the threads interleave.
+//
+//      Each thread checks what it can: every status is one the driver
+//      could return for what was asked (and who asked), a handle reads
+//      back the state it wrote to its outputs, WaitForChange completes no
+//      earlier than it was sent, the DPC statistics never go backwards and
+//      show the processor the DpcForIsr was moved to, and the event ring
+//      gives its events in time order.  The ring publish is checked too:
+//      each ring's events are whole, in the order the field made the
+//      changes, and every change recorded while the ring was attached was
+//      either published or counted as an overflow.  We exit with
+//      EXIT_FAILURE if any check failed, and abort if we can't shut down
+//      (which means a deadlock).
+//
+//      Know what this does and doesn't test.  The driver's logic is the
+//      driver's own: the ISR, the ring publish and reservation, the
+//      DpcForIsr's hand-off to the worker thread and the work item, the
+//      output line reservations, and the DPC retargeting all run the code
+//      OsrDio.cpp runs.  What's simulated is what it runs on: the locks,
+//      the DPC, the worker thread and the Queues are DioSimDevice's, so a
+//      clean run says the core is race free under DioSimDevice's locking,
+//      which follows the driver's, not that WDF's is the same.
+//
+//      Build it with DioStress.vcxproj (msbuild /p:EnableASAN=true for
+//      AddressSanitizer), or on Linux with the Makefile here, whose tsan
+//      and asan targets build it with ThreadSanitizer and with
+//      AddressSanitizer and UndefinedBehaviorSanitizer, which catch the
+//      data races and memory errors the checks can't.  "make check" runs
+//      all three.  Run it with -d for the duration in seconds (10 by
+//      default) and -t for the number of Request threads (16 by default).
+//
+///////////////////////////////////////////////////////////////////////////////
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "../DioCapture/DioEventRing.h"
+#include "../DioSim/DioSimDevice.h"
+#include "../DioSim/DioSimWaveform.h"
+
+constexpr uint32_t STRESS_DEFAULT_SECONDS  = 10;
+constexpr uint32_t STRESS_DEFAULT_THREADS  = 16;
+constexpr uint32_t STRESS_ISR_THREADS      = 2;
+constexpr uint32_t STRESS_RING_EVENTS      = 4096;
+constexpr uint32_t STRESS_SHUTDOWN_SECONDS = 30;
+constexpr uint32_t STRESS_MAX_REPORTS      = 20;
+
+//
+// STRESS_STATS
+//
+// What the threads have done, and how many checks have failed
+//
+typedef struct _STRESS_STATS {
+    std::atomic<uint64_t>   Requests;
+    std::atomic<uint64_t>   Waits;
+    std::atomic<uint64_t>   WaitsCompleted;
+    std::atomic<uint64_t>   WaitsCancelled;
+    std::atomic<uint64_t>   Reopens;
+    std::atomic<uint64_t>   InputChanges;
+    std::atomic<uint64_t>   Interrupts;
+    std::atomic<uint64_t>   Dpcs;
+    std::atomic<uint64_t>   Cancels;
+    std::atomic<uint64_t>   Events;
+    std::atomic<uint64_t>   QueuedEvents;
+    std::atomic<uint64_t>   RingEvents;
+    std::atomic<uint64_t>   RingOverflows;
+    std::atomic<uint64_t>   RingAttaches;
+    std::atomic<uint64_t>   RingHostile;
+    std::atomic<uint64_t>   DpcMoves;
+    std::atomic<uint64_t>   Failures;
+} STRESS_STATS;
+
+static STRESS_STATS          StressStats;
+static std::atomic<bool>     StressStopping(false);
+static std::atomic<uint32_t> StressRequesters(0);
+static std::mutex            StressReportLock;
+
+static void
+Usage()
+{
+    printf("Usage: DioStress [-d seconds] [-t requestThreads] [-s seed]\n");
+}
+
+//
+// A check failed.  We report the first few.
+//
+static void
+StressFailure(const char* Format,
+              ...)
+{
+    va_list arguments;
+
+    if (StressStats.Failures.fetch_add(1) >= STRESS_MAX_REPORTS) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(StressReportLock);
+
+    va_start(arguments, Format);
+
+    printf("FAILED: ");
+    vprintf(Format, arguments);
+    printf("\n");
+
+    va_end(arguments);
+}
+
+//
+// Let the other threads in, or not, at random
+//
+static void
+StressPause(DioSimRandom& Random)
+{
+    volatile uint32_t sink = 0;
+
+    switch (Random.Below(16)) {
+
+        case 10:
+        case 11:
+        case 12:
+        case 13:
+
+            std::this_thread::yield();
+
+            break;
+
+        case 14:
+
+            std::this_thread::sleep_for(std::chrono::microseconds(1 + Random.Below(20)));
+
+            break;
+
+        case 15:
+
+            for (uint32_t spin = Random.Below(1000); spin != 0; spin--) {
+                sink = sink + 1;
+            }
+
+            break;
+
+        default:
+
+            break;
+    }
+}
+
+static const char*
+StressStatusName(DioSimStatus Status)
+{
+    switch (Status) {
+        case DioSimStatus::Success:              return "Success";
+        case DioSimStatus::InvalidParameter:     return "InvalidParameter";
+        case DioSimStatus::InvalidDeviceState:   return "InvalidDeviceState";
+        case DioSimStatus::InvalidDeviceRequest: return "InvalidDeviceRequest";
+        case DioSimStatus::SharingViolation:     return "SharingViolation";
+        case DioSimStatus::NoneMapped:           return "NoneMapped";
+        case DioSimStatus::InvalidBufferSize:    return "InvalidBufferSize";
+        case DioSimStatus::Cancelled:            return "Cancelled";
+        case DioSimStatus::AccessDenied:         return "AccessDenied";
+        case DioSimStatus::DeviceBusy:           return "DeviceBusy";
+    }
+
+    return "unknown";
+}
+
+//
+// Check that a Request's status is one of those it could have
+//
+static bool
+StressCheckStatus(uint32_t                            Thread,
+                  const char*                         Request,
+                  DioSimStatus                        Status,
+                  std::initializer_list<DioSimStatus> Allowed)
+{
+    for (DioSimStatus allowed : Allowed) {
+
+        if (Status == allowed) {
+            return true;
+        }
+    }
+
+    StressFailure("thread %u: %s returned %s",
+                  Thread,
+                  Request,
+                  StressStatusName(Status));
+
+    return false;
+}
+
+//
+// Changes the inputs: usually one line, now and then many at once
+//
+static void
+StressField(DioSimDevice& Device,
+            uint64_t      Seed)
+{
+    DioSimRandom random(Seed);
+    uint32_t     lines = 0;
+
+    while (!StressStopping) {
+
+        lines ^= 1U << random.Below(32);
+
+        if (random.Below(8) == 0) {
+            lines ^= static_cast<uint32_t>(random.Next());
+        }
+
+        Device.Bar().SetInputs(lines);
+
+        StressStats.InputChanges++;
+
+        StressPause(random);
+    }
+}
+
+//
+// Another processor taking the interrupt, and running the DpcForIsr
+//
+static void
+StressInterrupts(DioSimDevice& Device,
+                 uint64_t      Seed)
+{
+    DioSimRandom random(Seed);
+
+    while (!StressStopping) {
+
+        if (Device.RunIsr()) {
+            StressStats.Interrupts++;
+        }
+
+        StressPause(random);
+
+        if (Device.RunDpc()) {
+            StressStats.Dpcs++;
+        }
+
+        StressPause(random);
+    }
+}
+
+//
+// The application reading the event ring
+//
+static void
+StressConsumer(DioSimDevice& Device)
+{
+    DioRingEventSource source(&Device.Ring());
+    DIO_EVENT          events[256];
+    uint64_t           lastTimestamp = 0;
+    size_t             count;
+
+    while ((count = source.Read(events, 256)) != 0) {
+
+        for (size_t i = 0; i < count; i++) {
+
+            if (events[i].Timestamp < lastTimestamp) {
+
+                StressFailure("event ring: event at %llu ns follows one at %llu ns",
+                              static_cast<unsigned long long>(events[i].Timestamp),
+                              static_cast<unsigned long long>(lastTimestamp));
+            }
+
+            lastTimestamp = events[i].Timestamp;
+        }
+
+        StressStats.Events += count;
+    }
+}
+
+//
+// The ring stress's line state for change number Sequence: the low half
+// counts changes, and the high half is a function of the low half, so the
+// application can tell each event it reads is whole.  Change 0 is all
+// lines low, as the device starts.
+//
+static uint32_t
+StressRingLines(uint32_t Sequence)
+{
+    uint32_t count = Sequence & 0xFFFF;
+
+    return count | ((count * 40503U) & 0xFFFF) << 16;
+}
+
+static bool
+StressRingLinesValid(uint32_t LineState)
+{
+    return StressRingLines(LineState) == LineState;
+}
+
+//
+// The ring stress's field: each change is the next StressRingLines
+//
+static void
+StressRingField(DioSimDevice& Device,
+                uint64_t      Seed)
+{
+    DioSimRandom random(Seed);
+    uint32_t     sequence = 0;
+
+    while (!StressStopping) {
+
+        Device.Bar().SetInputs(StressRingLines(++sequence));
+
+        StressStats.InputChanges++;
+
+        StressPause(random);
+    }
+}
+
+//
+// Changes the driver has accounted for, by recording them or by counting
+// them as missed
+//
+static uint64_t
+StressRingChanges(DioSimDevice& Device)
+{
+    return Device.ChangeCount() + Device.ChangeErrorCount();
+}
+
+//
+// Check the events from Consumer up to Producer, in place, returning the
+// new ConsumerIndex.  Last is the previous event read from the ring (with
+// a Timestamp of 0 if there wasn't one).  Changes the driver missed, or
+// that didn't fit, leave gaps in the count, but it never goes backwards.
+//
+static uint32_t
+StressRingCheck(PDIO_EVENT_RING Ring,
+                uint32_t        Consumer,
+                uint32_t        Producer,
+                PDIO_EVENT      Last)
+{
+    StressStats.RingEvents += Producer - Consumer;
+
+    for (; Consumer != Producer; Consumer++) {
+
+        DIO_EVENT event = Ring->Events[Consumer & (Ring->Capacity - 1)];
+        bool      valid;
+
+        valid = StressRingLinesValid(event.LineState) &&
+                StressRingLinesValid(event.LineState ^ event.ChangedLines);
+
+        if (valid && Last->Timestamp != 0) {
+
+            uint32_t step = (event.LineState - Last->LineState) & 0xFFFF;
+
+            valid = step != 0 && step < 0x8000 && event.Timestamp >= Last->Timestamp;
+        }
+
+        if (!valid) {
+
+            StressFailure("ring publish: event %u (line state 0x%08X, changed 0x%08X, "
+                          "at %llu ns) after line state 0x%08X at %llu ns",
+                          Consumer,
+                          event.LineState,
+                          event.ChangedLines,
+                          static_cast<unsigned long long>(event.Timestamp),
+                          Last->LineState,
+                          static_cast<unsigned long long>(Last->Timestamp));
+        }
+
+        *Last = event;
+    }
+
+    return Consumer;
+}
+
+//
+// The application: attach a ring with IOCTL_OSRDIO_ATTACH_EVENT_RING, read
+// events out of it in place for a while (sometimes waiting for them with
+// IOCTL_OSRDIO_WAIT_EVENT_RING), detach it by cancelling the Request or
+// closing the handle, and free it, over and over.  The rings are small,
+// so they fill and wrap, and allocated to the length we give the driver,
+// so AddressSanitizer catches any store outside one, or into one that's
+// been freed.
+//
+// Now and then the application is hostile, and scribbles on ConsumerIndex
+// instead of reading: the driver trusts nothing it can write, so it must
+// still only store inside the ring.
+//
+static void
+StressRingApplication(DioSimDevice& Device,
+                      uint32_t      Thread,
+                      uint64_t      Seed)
+{
+    DioSimRandom                  random(Seed);
+    std::unique_ptr<DioSimHandle> handle;
+
+    while (!StressStopping) {
+
+        uint32_t        capacity = 2U << random.Below(8);
+        bool            hostile  = random.Below(8) == 0;
+        uint32_t        steps    = random.Below(2000);
+        size_t          length   = DioEventRingSize(capacity) + random.Below(sizeof(DIO_EVENT));
+        void*           memory   = operator new(length);
+        PDIO_EVENT_RING ring     = new (memory) DIO_EVENT_RING;
+        DIO_EVENT       last     = {};
+        uint32_t        consumer = 0;
+        uint32_t        producer;
+        uint64_t        changesBefore;
+        uint64_t        changesAttached;
+        uint64_t        changesDetaching;
+        uint64_t        changesAfter;
+        uint64_t        accounted;
+        DioSimStatus    status;
+
+        if (handle == nullptr) {
+            handle = std::make_unique<DioSimHandle>(Device);
+        }
+
+        //
+        // Now and then, a buffer too small for a ring
+        //
+        if (random.Below(32) == 0) {
+
+            status = handle->AttachEventRing(ring, DioEventRingSize(1));
+
+            StressCheckStatus(Thread, "AttachEventRing", status, { DioSimStatus::InvalidBufferSize });
+        }
+
+        changesBefore = StressRingChanges(Device);
+
+        status = handle->AttachEventRing(ring, length);
+
+        changesAttached = StressRingChanges(Device);
+
+        if (StressCheckStatus(Thread, "AttachEventRing", status, { DioSimStatus::Success })) {
+
+            if (ring->Capacity != capacity) {
+
+                StressFailure("thread %u: a %zu byte ring has room for %u events, not %u",
+                              Thread,
+                              length,
+                              ring->Capacity,
+                              capacity);
+            }
+
+            StressStats.RingAttaches++;
+
+            if (hostile) {
+                StressStats.RingHostile++;
+            }
+        }
+
+        for (uint32_t step = 0; step < steps && !StressStopping; step++) {
+
+            if (hostile) {
+
+                ring->ConsumerIndex.store(static_cast<uint32_t>(random.Next()),
+                                          std::memory_order_release);
+
+            } else {
+
+                if (random.Below(64) == 0) {
+
+                    status = handle->WaitEventRing();
+
+                    StressCheckStatus(Thread, "WaitEventRing", status, { DioSimStatus::Success,
+                                                                         DioSimStatus::Cancelled });
+                }
+
+                producer = ring->ProducerIndex.load(std::memory_order_acquire);
+
+                consumer = StressRingCheck(ring, consumer, producer, &last);
+
+                ring->ConsumerIndex.store(consumer, std::memory_order_release);
+            }
+
+            StressPause(random);
+        }
+
+        changesDetaching = StressRingChanges(Device);
+
+        if (random.Below(4) == 0) {
+
+            handle.reset();
+
+        } else {
+
+            handle->DetachEventRing();
+        }
+
+        changesAfter = StressRingChanges(Device);
+
+        //
+        // The driver is done with the ring now, so whatever's in it is
+        // everything it published, and what it didn't publish it counted.
+        // That's every change recorded while the ring was attached: at
+        // least those counted after the attach returned and before we
+        // detached, and at most those counted from before we attached to
+        // after the detach returned.
+        //
+        if (!hostile && status == DioSimStatus::Success) {
+
+            producer = ring->ProducerIndex.load(std::memory_order_acquire);
+
+            consumer = StressRingCheck(ring, consumer, producer, &last);
+
+            accounted = producer + static_cast<uint64_t>(ring->OverflowCount.load());
+
+            if (accounted < changesDetaching - changesAttached ||
+                accounted > changesAfter - changesBefore) {
+
+                StressFailure("ring publish: %u events published and %u overflows, "
+                              "of between %llu and %llu changes recorded while attached",
+                              producer,
+                              ring->OverflowCount.load(),
+                              static_cast<unsigned long long>(changesDetaching - changesAttached),
+                              static_cast<unsigned long long>(changesAfter - changesBefore));
+            }
+
+            StressStats.RingOverflows += ring->OverflowCount.load();
+        }
+
+        ring->~DIO_EVENT_RING();
+
+        operator delete(memory);
+    }
+
+    handle.reset();
+
+    StressRequesters--;
+}
+
+//
+// The processors IOCTL_OSRDIO_SET_DPC_PROCESSOR may target, and a random
+// processor to ask for: usually one of them, sometimes any processor, and
+// now and then one that doesn't exist
+//
+static uint32_t
+StressProcessors()
+{
+    return std::max(std::thread::hardware_concurrency(), 1U);
+}
+
+static uint32_t
+StressProcessor(DioSimRandom& Random)
+{
+    uint32_t processor = Random.Below(StressProcessors() + 2);
+
+    if (processor == StressProcessors()) {
+        return DIO_SIM_ANY_PROCESSOR;
+    }
+
+    return processor;
+}
+
+//
+// An administrator moving the DpcForIsr from processor to processor: the
+// driver takes the DPC off its queue, retargets it and queues it again,
+// racing the ISRs that queue it and the DPCs that run
+//
+static void
+StressDpcProcessors(DioSimDevice& Device,
+                    uint32_t      Thread,
+                    uint64_t      Seed)
+{
+    DioSimRandom random(Seed);
+    DioSimHandle handle(Device);
+
+    while (!StressStopping) {
+
+        uint32_t     processor = StressProcessor(random);
+        DioSimStatus status    = handle.SetDpcProcessor(processor);
+
+        if (processor != DIO_SIM_ANY_PROCESSOR && processor >= StressProcessors()) {
+
+            StressCheckStatus(Thread, "SetDpcProcessor", status, { DioSimStatus::InvalidParameter });
+
+        } else if (StressCheckStatus(Thread, "SetDpcProcessor", status, { DioSimStatus::Success })) {
+
+            if (Device.DpcStats().DpcProcessor != processor) {
+
+                StressFailure("thread %u: DpcForIsr moved to processor %u, but the "
+                              "statistics say %u",
+                              Thread,
+                              processor,
+                              Device.DpcStats().DpcProcessor);
+            }
+
+            StressStats.DpcMoves++;
+        }
+
+        StressPause(random);
+    }
+}
+
+//
+// What the settings IOCTLs (SET_DPC_PROCESSOR and SAVE_PROFILE) return for
+// a handle opened with Access on Port, if what's asked is valid
+//
+static DioSimStatus
+StressSettingsStatus(DioSimAccess Access,
+                     uint32_t     Port)
+{
+    if (Access == DioSimAccess::Read) {
+        return DioSimStatus::AccessDenied;
+    }
+
+    if (Port != DIO_SIM_NO_PORT) {
+        return DioSimStatus::InvalidDeviceRequest;
+    }
+
+    if (Access != DioSimAccess::Administrator) {
+        return DioSimStatus::AccessDenied;
+    }
+
+    return DioSimStatus::Success;
+}
+
+//
+// A random line profile, for ApplyProfile: a few output lines in a random
+// state, random edges, and the small and medium filters on some lines
+//
+static DIO_SIM_LINE_PROFILE
+StressProfile(DioSimRandom& Random)
+{
+    DIO_SIM_LINE_PROFILE profile;
+    uint32_t             filters[2];
+
+    for (uint32_t& filter : filters) {
+
+        filter = 0;
+
+        for (uint32_t line = 0; line < 16; line++) {
+            filter |= (Random.Below(8) == 0 ? 1 + Random.Below(2) : 0) << (line * 2);
+        }
+    }
+
+    profile.OutputLines     = static_cast<uint32_t>(Random.Next() & Random.Next() & Random.Next());
+    profile.OutputState     = static_cast<uint32_t>(Random.Next());
+    profile.RisingEdges     = static_cast<uint32_t>(Random.Next());
+    profile.FallingEdges    = static_cast<uint32_t>(Random.Next());
+    profile.FilterPort0and1 = filters[0];
+    profile.FilterPort2and3 = filters[1];
+
+    return profile;
+}
+
+//
+// An application sending Requests on its handle.  Outputs are the lines it
+// has as outputs, and (once Known) State the state it has set them to.
+//
+static void
+StressRequests(DioSimDevice& Device,
+               uint32_t      Thread,
+               uint64_t      Seed)
+{
+    DioSimRandom                  random(Seed);
+    std::unique_ptr<DioSimHandle> handle;
+    uint32_t                      port      = DIO_SIM_NO_PORT;
+    DioSimAccess                  access    = DioSimAccess::Administrator;
+    uint32_t                      portLines = 0;
+    uint32_t                      outputs   = 0;
+    uint32_t                      state     = 0;
+    bool                          known     = false;
+    uint64_t                      lastDpcs  = 0;
+
+    while (!StressStopping) {
+
+        uint32_t     choice = random.Below(100);
+        DioSimStatus status;
+
+        if (handle == nullptr || choice == 99) {
+
+            handle.reset();
+
+            port = random.Below(DIO_SIM_PORT_COUNT + 1);
+
+            if (port == DIO_SIM_PORT_COUNT) {
+                port = DIO_SIM_NO_PORT;
+            }
+
+            access    = static_cast<DioSimAccess>(std::min(random.Below(4), 2U));
+            handle    = std::make_unique<DioSimHandle>(Device, port, access);
+            portLines = DioSimPortLines(port);
+            outputs   = 0;
+            known     = false;
+
+            StressStats.Reopens++;
+
+            continue;
+        }
+
+        StressStats.Requests++;
+
+        if (choice < 25) {
+
+            uint32_t lineState = 0;
+
+            status = handle->Read(&lineState);
+
+            StressCheckStatus(Thread, "Read", status, { DioSimStatus::Success });
+
+            if (known && ((lineState ^ state) & outputs) != 0) {
+
+                StressFailure("thread %u: read %08x, but its outputs %08x were set to %08x",
+                              Thread,
+                              lineState,
+                              outputs,
+                              state & outputs);
+            }
+
+        } else if (choice < 45) {
+
+            uint32_t lineState = static_cast<uint32_t>(random.Next()) & portLines;
+
+            status = handle->Write(lineState);
+
+            if (StressCheckStatus(Thread, "Write", status, { DioSimStatus::Success,
+                                                              DioSimStatus::InvalidDeviceState,
+                                                              DioSimStatus::SharingViolation })) {
+
+                if ((status == DioSimStatus::InvalidDeviceState) != (outputs == 0)) {
+
+                    StressFailure("thread %u: Write returned %s with outputs %08x",
+                                  Thread,
+                                  StressStatusName(status),
+                                  outputs);
+                }
+
+                if (status == DioSimStatus::Success) {
+
+                    state = lineState;
+                    known = true;
+                }
+            }
+
+        } else if (choice < 55) {
+
+            uint32_t outputLines = static_cast<uint32_t>(random.Next() & random.Next()) & portLines;
+            bool     invalid     = false;
+
+            //
+            // Now and then, lines that aren't ours to ask for
+            //
+            if (port != DIO_SIM_NO_PORT && random.Below(20) == 0) {
+
+                outputLines |= 1U << ((port + 1 + random.Below(DIO_SIM_PORT_COUNT - 1)) % DIO_SIM_PORT_COUNT *
+                                      DIO_SIM_LINES_PER_PORT + random.Below(DIO_SIM_LINES_PER_PORT));
+                invalid      = true;
+            }
+
+            status = handle->SetOutputs(outputLines);
+
+            if (invalid) {
+
+                StressCheckStatus(Thread, "SetOutputs", status, { DioSimStatus::InvalidParameter });
+
+            } else if (StressCheckStatus(Thread, "SetOutputs", status, { DioSimStatus::Success,
+                                                                         DioSimStatus::SharingViolation }) &&
+                       status == DioSimStatus::Success) {
+
+                outputs = outputLines;
+                known   = false;
+            }
+
+        } else if (choice < 63) {
+
+            DIO_SIM_CHANGE change = {};
+            uint64_t       sent   = DioSimEventRing::Now();
+
+            status = handle->WaitForChange(static_cast<DioSimPriority>(random.Below(DIO_SIM_PRIORITY_COUNT)),
+                                           &change);
+
+            StressStats.Waits++;
+
+            StressCheckStatus(Thread, "WaitForChange", status, { DioSimStatus::Success,
+                                                                 DioSimStatus::Cancelled,
+                                                                 DioSimStatus::NoneMapped });
+
+            if (status == DioSimStatus::Success) {
+
+                StressStats.WaitsCompleted++;
+
+                if (change.CompletionTime < sent) {
+
+                    StressFailure("thread %u: WaitForChange sent at %llu ns completed at %llu ns",
+                                  Thread,
+                                  static_cast<unsigned long long>(sent),
+                                  static_cast<unsigned long long>(change.CompletionTime));
+                }
+
+            } else if (status == DioSimStatus::Cancelled) {
+
+                StressStats.WaitsCancelled++;
+            }
+
+        } else if (choice < 68) {
+
+            DIO_SIM_LINE_PROFILE profile = StressProfile(random);
+
+            status = handle->ApplyProfile(profile);
+
+            if (access == DioSimAccess::Read) {
+
+                StressCheckStatus(Thread, "ApplyProfile", status, { DioSimStatus::AccessDenied });
+
+            } else if (port != DIO_SIM_NO_PORT) {
+
+                StressCheckStatus(Thread, "ApplyProfile", status, { DioSimStatus::InvalidDeviceRequest });
+
+            } else if (StressCheckStatus(Thread, "ApplyProfile", status, { DioSimStatus::Success,
+                                                                           DioSimStatus::SharingViolation }) &&
+                       status == DioSimStatus::Success) {
+
+                outputs = profile.OutputLines;
+                state   = profile.OutputState;
+                known   = true;
+            }
+
+        } else if (choice < 73) {
+
+            DIO_SIM_DPC_STATS stats = Device.DpcStats();
+
+            if (stats.Dpc.Count < lastDpcs) {
+
+                StressFailure("thread %u: DPC count went from %llu to %llu",
+                              Thread,
+                              static_cast<unsigned long long>(lastDpcs),
+                              static_cast<unsigned long long>(stats.Dpc.Count));
+            }
+
+            lastDpcs = stats.Dpc.Count;
+
+        } else if (choice < 75) {
+
+            Device.RegisterProfile();
+
+            Device.PowerStats();
+
+        } else if (choice < 76) {
+
+            Device.SetRegisterProfiling(random.Below(2) == 0);
+
+        } else if (choice < 80) {
+
+            DIO_EVENT events[8];
+            uint32_t  count     = random.Below(9);
+            uint32_t  readCount = 0;
+            bool      overflow  = false;
+
+            status = handle->ReadEvents(events, count, &readCount, &overflow);
+
+            if (port != DIO_SIM_NO_PORT) {
+
+                StressCheckStatus(Thread, "ReadEvents", status, { DioSimStatus::InvalidDeviceRequest });
+
+            } else if (count == 0) {
+
+                StressCheckStatus(Thread, "ReadEvents", status, { DioSimStatus::InvalidBufferSize });
+
+            } else if (StressCheckStatus(Thread, "ReadEvents", status, { DioSimStatus::Success,
+                                                                         DioSimStatus::Cancelled }) &&
+                       status == DioSimStatus::Success) {
+
+                if (readCount == 0 || readCount > count) {
+
+                    StressFailure("thread %u: ReadEvents returned %u events for a %u event buffer",
+                                  Thread,
+                                  readCount,
+                                  count);
+                }
+
+                StressStats.QueuedEvents += readCount;
+            }
+
+        } else if (choice < 82) {
+
+            status = handle->WaitEventRing();
+
+            if (port != DIO_SIM_NO_PORT) {
+
+                StressCheckStatus(Thread, "WaitEventRing", status, { DioSimStatus::InvalidDeviceRequest });
+
+            } else {
+
+                StressCheckStatus(Thread, "WaitEventRing", status, { DioSimStatus::Success,
+                                                                     DioSimStatus::Cancelled });
+            }
+
+        } else if (choice < 84) {
+
+            uint32_t processor = StressProcessor(random);
+
+            status = handle->SetDpcProcessor(processor);
+
+            if (StressSettingsStatus(access, port) != DioSimStatus::Success) {
+
+                StressCheckStatus(Thread, "SetDpcProcessor", status, { StressSettingsStatus(access, port) });
+
+            } else if (processor != DIO_SIM_ANY_PROCESSOR && processor >= StressProcessors()) {
+
+                StressCheckStatus(Thread, "SetDpcProcessor", status, { DioSimStatus::InvalidParameter });
+
+            } else {
+
+                StressCheckStatus(Thread, "SetDpcProcessor", status, { DioSimStatus::Success });
+            }
+
+        } else if (choice < 85) {
+
+            status = handle->SaveProfile(StressProfile(random));
+
+            StressCheckStatus(Thread, "SaveProfile", status, { StressSettingsStatus(access, port) });
+
+        } else if (choice < 86) {
+
+            //
+            // The device's own ring is always attached
+            //
+            void*           memory = operator new(DioEventRingSize(4));
+            PDIO_EVENT_RING ring   = new (memory) DIO_EVENT_RING;
+
+            status = handle->AttachEventRing(ring, DioEventRingSize(4));
+
+            StressCheckStatus(Thread, "AttachEventRing", status, { port != DIO_SIM_NO_PORT ?
+                                                                       DioSimStatus::InvalidDeviceRequest :
+                                                                       DioSimStatus::DeviceBusy });
+
+            ring->~DIO_EVENT_RING();
+
+            operator delete(memory);
+        }
+
+        StressPause(random);
+    }
+
+    //
+    // Closing the handle gives back its lines
+    //
+    handle.reset();
+
+    StressRequesters--;
+}
+
+//
+// CancelIoEx, on everyone's waiting Requests
+//
+static void
+StressCanceller(DioSimDevice& Device,
+                uint64_t      Seed)
+{
+    DioSimRandom random(Seed);
+
+    while (!StressStopping) {
+
+        std::this_thread::sleep_for(std::chrono::microseconds(100 + random.Below(2000)));
+
+        Device.Cancel(nullptr);
+
+        StressStats.Cancels++;
+    }
+}
+
+//
+// Change what things cost, as load elsewhere on the machine would
+//
+static void
+StressCosts(DioSimDevice& Device,
+            uint64_t      Seed)
+{
+    DioSimRandom random(Seed);
+
+    while (!StressStopping) {
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1 + random.Below(10)));
+
+        Device.SetRequestCost(random.Below(4) == 0 ? random.Below(2000) : 0);
+        Device.SetCompletionCost(random.Below(4) == 0 ? random.Below(2000) : 0);
+        Device.SetEventCost(random.Below(4) == 0 ? random.Below(2000) : 0);
+
+        Device.Bar().SetLatency(random.Below(2) == 0 ? DIO_SIM_NO_LATENCY : DIO_SIM_PCIE_LATENCY);
+    }
+}
+
+int
+main(int   argc,
+     char* argv[])
+{
+    std::vector<std::thread> threads;
+    std::vector<std::thread> requestThreads;
+    std::thread              consumer;
+    std::thread              watchdog;
+    std::mutex               watchdogLock;
+    std::condition_variable  watchdogCondition;
+    bool                     finished   = false;
+    uint32_t                 seconds    = STRESS_DEFAULT_SECONDS;
+    uint32_t                 requesters = STRESS_DEFAULT_THREADS;
+    uint64_t                 seed;
+
+    printf("DIOSTRESS -- OSRDIO Concurrency Stress Test V1.0\n");
+
+    seed = static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+
+    for (int i = 1; i < argc; i++) {
+
+        if (i + 1 >= argc) {
+
+            Usage();
+
+            return EXIT_FAILURE;
+        }
+
+        if (strcmp(argv[i], "-d") == 0) {
+            seconds = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        } else if (strcmp(argv[i], "-t") == 0) {
+            requesters = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        } else if (strcmp(argv[i], "-s") == 0) {
+            seed = strtoull(argv[++i], nullptr, 0);
+        } else {
+
+            Usage();
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    //
+    // If we can't shut down, something's deadlocked
+    //
+    watchdog = std::thread([&] {
+
+        std::unique_lock<std::mutex> lock(watchdogLock);
+
+        if (!watchdogCondition.wait_for(lock,
+                                        std::chrono::seconds(seconds + STRESS_SHUTDOWN_SECONDS),
+                                        [&] { return finished; })) {
+
+            printf("FAILED: still running %u seconds after we should have stopped; "
+                   "deadlocked?\n",
+                   STRESS_SHUTDOWN_SECONDS);
+
+            fflush(stdout);
+
+            abort();
+        }
+    });
+
+    {
+        DioSimRandom random(seed);
+        DioSimDevice device(STRESS_RING_EVENTS, DioSimUnfilteredProfile);
+        DioSimDevice ringDevice(STRESS_RING_EVENTS, DioSimUnfilteredProfile);
+        uint32_t     idleTimeout = random.Below(3) == 0 ? 0 : 50 + random.Below(1000);
+        bool         deferred    = random.Below(2) == 0;
+        bool         portQueues  = random.Below(2) == 0;
+        bool         shadow      = random.Below(2) == 0;
+        bool         wake        = random.Below(2) == 0;
+
+        printf("Seed %llu: %u Request threads for %u seconds, idle timeout %u us%s, "
+               "%s processing, %s queues, line register shadow %s\n",
+               static_cast<unsigned long long>(seed),
+               requesters,
+               seconds,
+               idleTimeout,
+               wake ? " (wake on change)" : "",
+               deferred ? "deferred" : "DPC",
+               portQueues ? "port" : "shared",
+               shadow ? "on" : "off");
+
+        fflush(stdout);
+
+        device.SetDeferredProcessing(deferred);
+        device.SetPortQueues(portQueues);
+        device.SetLineRegisterShadow(shadow);
+        device.SetIdleTimeout(idleTimeout);
+        device.SetResumeLatency(10 + random.Below(100));
+        device.SetWakeOnChange(wake);
+
+        //
+        // The ring stress's application attaches its own rings
+        //
+        ringDevice.SetDeferredProcessing(deferred);
+        ringDevice.DetachRing();
+
+        consumer = std::thread(StressConsumer, std::ref(device));
+
+        threads.emplace_back(StressField, std::ref(device), random.Next());
+
+        for (uint32_t i = 0; i < STRESS_ISR_THREADS; i++) {
+            threads.emplace_back(StressInterrupts, std::ref(device), random.Next());
+        }
+
+        threads.emplace_back(StressCanceller, std::ref(device), random.Next());
+
+        threads.emplace_back(StressCosts, std::ref(device), random.Next());
+
+        threads.emplace_back(StressRingField, std::ref(ringDevice), random.Next());
+
+        for (uint32_t i = 0; i < STRESS_ISR_THREADS; i++) {
+            threads.emplace_back(StressInterrupts, std::ref(ringDevice), random.Next());
+        }
+
+        threads.emplace_back(StressDpcProcessors, std::ref(ringDevice), requesters + 1, random.Next());
+
+        //
+        // The ring application counts as a Request thread, as it may be
+        // waiting for its ring when we stop
+        //
+        StressRequesters = requesters + 1;
+
+        threads.emplace_back(StressRingApplication, std::ref(ringDevice), requesters, random.Next());
+
+        for (uint32_t i = 0; i < requesters; i++) {
+            requestThreads.emplace_back(StressRequests, std::ref(device), i, random.Next());
+        }
+
+        for (uint32_t second = 1; second <= seconds; second++) {
+
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+
+            printf("%4us %10llu requests %10llu input changes %10llu interrupts %10llu events\n",
+                   second,
+                   static_cast<unsigned long long>(StressStats.Requests.load()),
+                   static_cast<unsigned long long>(StressStats.InputChanges.load()),
+                   static_cast<unsigned long long>(device.InterruptCount()),
+                   static_cast<unsigned long long>(StressStats.Events.load()));
+
+            fflush(stdout);
+        }
+
+        //
+        // Stop, cancelling the Requests that are waiting until every
+        // Request thread has noticed
+        //
+        StressStopping = true;
+
+        while (StressRequesters != 0) {
+
+            device.Cancel(nullptr);
+
+            ringDevice.Cancel(nullptr);
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        for (std::thread& thread : requestThreads) {
+            thread.join();
+        }
+
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        device.Ring().Finish();
+
+        consumer.join();
+
+        printf("\n%llu requests (%llu waits: %llu completed, %llu cancelled), %llu handles opened\n"
+               "%llu input changes, %llu interrupts (%llu on other processors), %llu DPCs on other processors\n"
+               "%llu events read (%llu by READ_EVENTS), %llu overflows, %llu change errors, %llu cancels, %llu idles, %llu wakes\n"
+               "Ring publish: %llu changes, %llu events read, %llu overflows, %llu rings (%llu hostile), "
+               "%llu DPC moves\n",
+               static_cast<unsigned long long>(StressStats.Requests.load()),
+               static_cast<unsigned long long>(StressStats.Waits.load()),
+               static_cast<unsigned long long>(StressStats.WaitsCompleted.load()),
+               static_cast<unsigned long long>(StressStats.WaitsCancelled.load()),
+               static_cast<unsigned long long>(StressStats.Reopens.load()),
+               static_cast<unsigned long long>(StressStats.InputChanges.load()),
+               static_cast<unsigned long long>(device.InterruptCount()),
+               static_cast<unsigned long long>(StressStats.Interrupts.load()),
+               static_cast<unsigned long long>(StressStats.Dpcs.load()),
+               static_cast<unsigned long long>(StressStats.Events.load()),
+               static_cast<unsigned long long>(StressStats.QueuedEvents.load()),
+               static_cast<unsigned long long>(device.Ring().Ring()->OverflowCount.load()),
+               static_cast<unsigned long long>(device.ChangeErrorCount()),
+               static_cast<unsigned long long>(StressStats.Cancels.load()),
+               static_cast<unsigned long long>(device.PowerStats().Idles),
+               static_cast<unsigned long long>(device.PowerStats().Wakes),
+               static_cast<unsigned long long>(ringDevice.ChangeCount()),
+               static_cast<unsigned long long>(StressStats.RingEvents.load()),
+               static_cast<unsigned long long>(StressStats.RingOverflows.load()),
+               static_cast<unsigned long long>(StressStats.RingAttaches.load()),
+               static_cast<unsigned long long>(StressStats.RingHostile.load()),
+               static_cast<unsigned long long>(StressStats.DpcMoves.load()));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(watchdogLock);
+
+        finished = true;
+    }
+
+    watchdogCondition.notify_all();
+
+    watchdog.join();
+
+    if (StressStats.Failures != 0) {
+
+        printf("FAIL: %llu checks failed (seed %llu)\n",
+               static_cast<unsigned long long>(StressStats.Failures.load()),
+               static_cast<unsigned long long>(seed));
+
+        return EXIT_FAILURE;
+    }
+
+    printf("PASS\n");
+
+    return EXIT_SUCCESS;
+}
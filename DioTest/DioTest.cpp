@@ -8,11 +8,13 @@
 //
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <thread>
 #include <windows.h>
 
 #include <cfgmgr32.h>
 #include "..\inc\OsrDio_IOCTL.h"
+#include "..\inc\DioRegisterTrace.h"
 
 
 HANDLE
@@ -152,6 +154,156 @@ done:
     CloseHandle(awaitHandle);
 }
 
+//
+// Show one of the timings returned by IOCTL_OSRDIO_GET_DPC_STATS
+//
+static void
+PrintTiming(const char*    Name,
+            POSRDIO_TIMING Timing,
+            LONGLONG       Frequency)
+{
+    printf("%s: %llu runs",
+           Name,
+           Timing->Count);
+
+    if (Timing->Count == 0) {
+        printf("\n");
+        return;
+    }
+
+    printf(", average %.2fus, longest %.2fus\n",
+           Timing->TotalTime * 1e6 / Frequency / Timing->Count,
+           Timing->MaxTime * 1e6 / Frequency);
+
+    for (ULONG i = 0; i < OSRDIO_TIMING_BUCKETS; i++) {
+
+        if (Timing->Histogram[i] == 0) {
+            continue;
+        }
+
+        if (i == OSRDIO_TIMING_BUCKETS - 1) {
+            printf("\t>= %6luus: %llu\n", 1UL << (i - 1), Timing->Histogram[i]);
+        } else {
+            printf("\t<  %6luus: %llu\n", 1UL << i, Timing->Histogram[i]);
+        }
+    }
+}
+
+//
+// Show what IOCTL_OSRDIO_GET_REGISTER_PROFILE returned: for each path that
+// has run, how many times it ran and, for each register it accessed, how
+// many reads and writes it made per run and how long they took on average
+//
+static void
+PrintRegisterProfile(POSRDIO_REGISTER_PROFILE Profile)
+{
+    static const char* pathNames[OSRDIO_REGISTER_PATHS] = {
+        "ISR", "DPC", "IOCTL", "Power"
+    };
+
+    for (ULONG path = 0; path < OSRDIO_REGISTER_PATHS; path++) {
+
+        ULONGLONG runs = Profile->Runs[path];
+
+        printf("%s: %llu runs\n",
+               pathNames[path],
+               runs);
+
+        if (runs == 0) {
+            continue;
+        }
+
+        for (ULONG i = 0; i < Profile->RegisterCount && i < OSRDIO_PROFILE_REGISTERS; i++) {
+            POSRDIO_REGISTER_ACCESSES accesses = &Profile->Accesses[i][path];
+
+            if (accesses->Reads == 0 && accesses->Writes == 0) {
+                continue;
+            }
+
+            printf("\t0x%05lx  %8.2f reads/run",
+                   Profile->Offset[i],
+                   (double)accesses->Reads / runs);
+
+            if (accesses->Reads != 0) {
+                printf(" (%7.3fus each)",
+                       accesses->ReadTime * 1e6 / Profile->Frequency / accesses->Reads);
+            } else {
+                printf("                ");
+            }
+
+            printf("  %8.2f writes/run",
+                   (double)accesses->Writes / runs);
+
+            if (accesses->Writes != 0) {
+                printf(" (%7.3fus each)",
+                       accesses->WriteTime * 1e6 / Profile->Frequency / accesses->Writes);
+            }
+
+            printf("\n");
+        }
+    }
+}
+
+//
+// Save what IOCTL_OSRDIO_GET_REGISTER_TRACE returned as a register trace
+// file (see DioRegisterTrace.h), which DioSimTraceReplay can replay
+// against the simulator
+//
+static bool
+SaveRegisterTrace(POSRDIO_REGISTER_TRACE Trace,
+                  const char*            Path)
+{
+    DIO_REGISTER_TRACE_HEADER header;
+    FILE*                     file;
+    uint8_t                   buffer[DIO_REGISTER_TRACE_MAX_ENTRY_BYTES];
+    uint64_t                  previous = 0;
+    bool                      written;
+
+    header = DioRegisterTraceHeader(Trace->Frequency,
+                                    Trace->Recorded > Trace->EntryCount ?
+                                        DIO_REGISTER_TRACE_PARTIAL : 0);
+
+    file = fopen(Path, "wb");
+
+    if (file == nullptr) {
+        return false;
+    }
+
+    written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(DioRegisterOffsets, sizeof(DioRegisterOffsets), 1, file) == 1;
+
+    for (ULONG i = 0; written && i < Trace->EntryCount; i++) {
+        POSRDIO_REGISTER_TRACE_ENTRY traceEntry = &Trace->Entries[i];
+        DIO_REGISTER_TRACE_ENTRY     entry;
+        uint32_t                     length;
+
+        entry.Time   = traceEntry->Time;
+        entry.Kind   = traceEntry->Kind;
+        entry.Offset = 0;
+        entry.Value  = traceEntry->Value;
+
+        if (entry.Kind != OSRDIO_TRACE_POWER) {
+
+            if (traceEntry->Register >= Trace->RegisterCount) {
+                continue;
+            }
+
+            entry.Offset = Trace->Offset[traceEntry->Register];
+        }
+
+        length = DioRegisterTraceEncode(entry, previous, buffer);
+
+        written  = fwrite(buffer, length, 1, file) == 1;
+        previous = entry.Time;
+    }
+
+    if (fclose(file) != 0) {
+        written = false;
+    }
+
+    return written;
+}
+
 int
 main(int   argc,
      char* argv[])
@@ -192,6 +344,10 @@ main(int   argc,
             printf("\t 2. Set output mask\n");
             printf("\t 3. Set lines to assert\n");
             printf("\t 4. Register COS notify\n");
+            printf("\t 5. Show DPC statistics\n");
+            printf("\t 6. Set DPC processor\n");
+            printf("\t 7. Show register profile\n");
+            printf("\t 8. Save register trace\n");
             printf("\t Enter zero to exit\n");
 
             printf("\nEnter operation to perform: ");
@@ -341,6 +497,195 @@ main(int   argc,
 
                 break;
             }
+
+            case 5: {
+                OSRDIO_DPC_STATS statsBuffer;
+
+                if (!DeviceIoControl(deviceHandle,
+                                     IOCTL_OSRDIO_GET_DPC_STATS,
+                                     nullptr,
+                                     0,
+                                     &statsBuffer,
+                                     sizeof(OSRDIO_DPC_STATS),
+                                     &bytesRead,
+                                     nullptr)) {
+
+                    lastErrorStatus = GetLastError();
+
+                    printf("DeviceIoControl IOCTL_OSRDIO_GET_DPC_STATS failed with error 0x%lx\n",
+                           lastErrorStatus);
+
+                    exit(lastErrorStatus);
+                }
+
+                printf("Deferred processing is %s\n",
+                       statsBuffer.DeferredProcessing ? "ON" : "OFF");
+
+                PrintTiming("DpcForIsr",
+                            &statsBuffer.Dpc,
+                            statsBuffer.Frequency);
+
+                PrintTiming("Worker thread",
+                            &statsBuffer.Worker,
+                            statsBuffer.Frequency);
+
+                if (statsBuffer.DpcProcessor == OSRDIO_ANY_PROCESSOR) {
+                    printf("DpcForIsr runs on any processor\n");
+                } else {
+                    printf("DpcForIsr runs on processor %lu\n",
+                           statsBuffer.DpcProcessor);
+                }
+
+                printf("Processor        ISRs        DPCs\n");
+
+                for (ULONG i = 0; i < OSRDIO_STATS_PROCESSORS; i++) {
+
+                    if (statsBuffer.IsrCount[i] == 0 &&
+                        statsBuffer.DpcCount[i] == 0) {
+                        continue;
+                    }
+
+                    printf("%9lu %11llu %11llu\n",
+                           i,
+                           statsBuffer.IsrCount[i],
+                           statsBuffer.DpcCount[i]);
+                }
+
+                break;
+            }
+
+            case 6: {
+                OSRDIO_DPC_PROCESSOR_DATA processorBuffer;
+
+                printf("Enter processor number (-1 for any): ");
+
+                fgets(inputBuffer,
+                      sizeof(inputBuffer),
+                      stdin);
+
+                processorBuffer.Processor = strtoul(inputBuffer,
+                                                    nullptr,
+                                                    10);
+
+                if (!DeviceIoControl(deviceHandle,
+                                     IOCTL_OSRDIO_SET_DPC_PROCESSOR,
+                                     &processorBuffer,
+                                     sizeof(OSRDIO_DPC_PROCESSOR_DATA),
+                                     nullptr,
+                                     0,
+                                     &bytesWritten,
+                                     nullptr)) {
+
+                    lastErrorStatus = GetLastError();
+
+                    printf("DeviceIoControl IOCTL_OSRDIO_SET_DPC_PROCESSOR failed with error 0x%lx\n",
+                           lastErrorStatus);
+
+                    break;
+                }
+
+                break;
+            }
+
+            case 7: {
+                OSRDIO_REGISTER_PROFILE profileBuffer;
+
+                if (!DeviceIoControl(deviceHandle,
+                                     IOCTL_OSRDIO_GET_REGISTER_PROFILE,
+                                     nullptr,
+                                     0,
+                                     &profileBuffer,
+                                     sizeof(OSRDIO_REGISTER_PROFILE),
+                                     &bytesRead,
+                                     nullptr)) {
+
+                    lastErrorStatus = GetLastError();
+
+                    if (lastErrorStatus == ERROR_NOT_SUPPORTED) {
+                        printf("This build of the driver doesn't profile register accesses\n");
+                        break;
+                    }
+
+                    printf("DeviceIoControl IOCTL_OSRDIO_GET_REGISTER_PROFILE failed with error 0x%lx\n",
+                           lastErrorStatus);
+
+                    exit(lastErrorStatus);
+                }
+
+                PrintRegisterProfile(&profileBuffer);
+
+                break;
+            }
+
+            case 8: {
+                POSRDIO_REGISTER_TRACE traceBuffer;
+                char*                  newline;
+
+                printf("Enter file name: ");
+
+                if (fgets(inputBuffer,
+                          sizeof(inputBuffer),
+                          stdin) == nullptr) {
+                    break;
+                }
+
+                newline = strchr(inputBuffer, '\n');
+
+                if (newline != nullptr) {
+                    *newline = '\0';
+                }
+
+                //
+                // Too big for the stack
+                //
+                traceBuffer = (POSRDIO_REGISTER_TRACE)malloc(sizeof(OSRDIO_REGISTER_TRACE));
+
+                if (traceBuffer == nullptr) {
+                    printf("Unable to allocate the trace buffer\n");
+                    break;
+                }
+
+                if (!DeviceIoControl(deviceHandle,
+                                     IOCTL_OSRDIO_GET_REGISTER_TRACE,
+                                     nullptr,
+                                     0,
+                                     traceBuffer,
+                                     sizeof(OSRDIO_REGISTER_TRACE),
+                                     &bytesRead,
+                                     nullptr)) {
+
+                    lastErrorStatus = GetLastError();
+
+                    free(traceBuffer);
+
+                    if (lastErrorStatus == ERROR_NOT_SUPPORTED) {
+                        printf("This build of the driver doesn't trace register accesses\n");
+                        break;
+                    }
+
+                    printf("DeviceIoControl IOCTL_OSRDIO_GET_REGISTER_TRACE failed with error 0x%lx\n",
+                           lastErrorStatus);
+
+                    exit(lastErrorStatus);
+                }
+
+                if (SaveRegisterTrace(traceBuffer, inputBuffer)) {
+
+                    printf("Saved %lu of %llu entries to %s\n",
+                           traceBuffer->EntryCount,
+                           traceBuffer->Recorded,
+                           inputBuffer);
+                } else {
+
+                    printf("Unable to write %s\n",
+                           inputBuffer);
+                }
+
+                free(traceBuffer);
+
+                break;
+            }
+
             default: {
 
                 break;
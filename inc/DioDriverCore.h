@@ -0,0 +1,1675 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioDriverCore.h -- The driver's device logic, shared by the driver
+//                           and the simulator
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      Everything the OsrDio driver does to the device, and to the state it
+//      keeps about it, apart from talking to WDF: programming the lines and
+//      reserving them for handles, the ISR's handling of a change (the
+//      event ring, the application's ring, and the hand-off to the
+//      DpcForIsr), what the DpcForIsr, the worker thread and the background
+//      work item do with it, and the device's power and wake callbacks.
+//      The driver's callbacks (OsrDio.cpp) call these, and so does the
+//      simulator's model of the driver (DioSimDevice), against the
+//      simulated BAR.  There's only the one copy.
+//
+//      Like DioRegisters.h, this uses nothing but the language itself.
+//      Each function is a template on the type of its Device, a pointer
+//      to the device's context: the driver's OSRDIO_DEVICE_CONTEXT, or the
+//      simulator's DIO_SIM_DEVICE_CONTEXT.  The context's fields are used
+//      by name (see OSRDIO_DEVICE_CONTEXT for what each is, and how it's
+//      protected), and everything else (the locks, the interlocked
+//      operations, the Requests, the DPC) is done through the device's
+//      DioCoreBackend.  All of it is resolved at compile time.
+//
+//      The locks are the driver's: OutputLock, then the interrupt lock,
+//      and EventLock, then the interrupt lock.  Functions that don't take
+//      a lock say what their caller must hold.  None of these count a run
+//      of their path (DioUtilProfileRun); the callers do.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "DioRegisters.h"
+
+// ReSharper disable CppInconsistentNaming
+
+//
+// The device's ports (OSRDIO_PORT_COUNT and friends), the classes of
+// IOCTL_OSRDIO_WAITFOR_CHANGE Requests (OSRDIO_PRIORITY_xxx), the
+// processor our DpcForIsr runs on when it isn't targeted
+// (OSRDIO_ANY_PROCESSOR) and the paths that access the registers
+// (OSRDIO_REGISTER_PATH_xxx)
+//
+constexpr unsigned int DIO_CORE_PORT_COUNT     = 4;
+constexpr unsigned int DIO_CORE_LINES_PER_PORT = 8;
+constexpr unsigned int DIO_CORE_NO_PORT        = 0xFFFFFFFF;
+
+constexpr unsigned int
+DioCorePortLines(unsigned int Port)
+{
+    return Port == DIO_CORE_NO_PORT ? 0xFFFFFFFF : 0xFFU << (Port * DIO_CORE_LINES_PER_PORT);
+}
+
+constexpr unsigned int DIO_CORE_PRIORITY_REALTIME   = 0;
+constexpr unsigned int DIO_CORE_PRIORITY_NORMAL     = 1;
+constexpr unsigned int DIO_CORE_PRIORITY_BACKGROUND = 2;
+constexpr unsigned int DIO_CORE_PRIORITY_COUNT      = 3;
+
+constexpr unsigned int DIO_CORE_ANY_PROCESSOR = 0xFFFFFFFF;
+
+constexpr unsigned int DIO_CORE_PATH_ISR   = 0;
+constexpr unsigned int DIO_CORE_PATH_DPC   = 1;
+constexpr unsigned int DIO_CORE_PATH_IOCTL = 2;
+constexpr unsigned int DIO_CORE_PATH_POWER = 3;
+
+// ReSharper restore CppInconsistentNaming
+
+//
+// DioCoreBackend
+//
+// What the core needs from whatever it's running in, for a Device of type
+// DevicePointer.  Each backend is a specialization that provides:
+//
+//      Status                      The type of a Request's status, and
+//      Success, SharingViolation,  its values for those
+//      InvalidDeviceState,
+//      InvalidParameter
+//
+//      Event, EventRingPointer     The type of an event (OSRDIO_EVENT),
+//                                  and of a pointer to an application's
+//                                  ring of them (POSRDIO_EVENT_RING)
+//
+//      EventRequest                An IOCTL_OSRDIO_READ_EVENTS Request
+//
+//      EventRingSize               The number of entries in the Device's
+//                                  EventRing (a power of two)
+//
+//      Bar(Device, Path)           The bar (see DioRegisterBackend) for code
+//                                  on Path to access the registers through
+//
+//      ShadowLineRegisters(Device) Whether to only write the line registers
+//                                  whose values change (see LineRegisters)
+//
+//      AcquireOutputLock(Device), ReleaseOutputLock(Device),
+//      AcquireInterruptLock(Device), ReleaseInterruptLock(Device),
+//      AcquireEventLock(Device), ReleaseEventLock(Device)
+//
+//      Exchange(Target, Value), Or(Target, Value), Load(Target)
+//                                  Interlocked operations on the context's
+//                                  fields that have them, returning the
+//                                  previous value
+//
+//      MakeEvent(Device, LineState, ChangedLines)
+//                                  An event, timestamped now
+//
+//      TimestampFrequency(Device)  The frequency of events' timestamps
+//
+//      RingSize(Count)             The size in bytes of an application's
+//                                  ring with room for Count events
+//
+//      PublishRing(Device, Ring, Head)
+//                                  Publish Head as Ring's ProducerIndex,
+//                                  after the events stored before it
+//
+//      QueueDpc(Device)            Queue our DpcForIsr (called holding the
+//                                  interrupt lock)
+//
+//      RequeueDpc(Device)          Queue it again, for changes already
+//                                  counted, after CancelTargetedDpc took it
+//                                  off its queue (called holding the
+//                                  interrupt lock)
+//
+//      ProcessorExists(Device, Processor)
+//                                  Whether there's a processor with index
+//                                  Processor to target our DpcForIsr at
+//
+//      CancelTargetedDpc(Device)   Take our targeted DPC off its queue,
+//                                  waiting for it if it's running, and
+//                                  return whether it was queued
+//
+//      TargetDpc(Device, Processor)
+//                                  Target it at Processor, returning false
+//                                  if that can't be done
+//
+//      SaveProfile(Device, Profile)
+//                                  Store Profile where the Device's next
+//                                  start will load it from
+//
+//      WakeWorker(Device)          Have our worker thread run
+//
+//      QueueWorkItem(Device)       Queue our background work item
+//
+//      CountInterrupt(Device), CountMissedChange(Device)
+//                                  Count an interrupt from our device, and
+//                                  a change it missed
+//
+//      BeginProcessing(Device)     Called as processing of the changes
+//                                  recorded so far starts
+//
+//      ChangeRequestsWaiting(Device, Priority, Port)
+//                                  Whether an IOCTL_OSRDIO_WAITFOR_CHANGE
+//                                  Request of class Priority is waiting
+//                                  for a change on Port (or on any line,
+//                                  with DIO_CORE_NO_PORT)
+//
+//      CompleteChangeRequest(Device, Priority, Port, LineState)
+//                                  Complete the next one, with LineState
+//
+//      NextEventRequest(Device, &Request, &Events, &Capacity)
+//                                  Take the next IOCTL_OSRDIO_READ_EVENTS
+//                                  Request, with room for Capacity Events,
+//                                  returning false if there isn't one
+//
+//      CompleteEventRequest(Device, Request, Events, Count, Overflow)
+//                                  Complete it with the first Count Events
+//
+//      CompleteRingWaitRequest(Device, Status)
+//                                  Complete the next
+//                                  IOCTL_OSRDIO_WAIT_EVENT_RING Request with
+//                                  Status, returning false if there isn't
+//                                  one
+//
+// The driver's (in OsrDio.h) is for a POSRDIO_DEVICE_CONTEXT.  The
+// simulator's (in DioSimDevice.cpp) is for a PDIO_SIM_DEVICE_CONTEXT.
+//
+template <typename DevicePointer>
+struct DioCoreBackend;
+
+//
+// DioCoreWriteLineRegister
+//
+// Writes Value to Register (one of the line registers), as code on Path,
+// unless LastValue (the register's entry in Device's LineRegisters) says
+// it's already there.
+//
+template <typename Register, typename DevicePointer, typename RegisterValue, typename NewValue>
+inline void
+DioCoreWriteLineRegister(DevicePointer  Device,
+                         unsigned int   Path,
+                         RegisterValue* LastValue,
+                         NewValue       Value)
+{
+    if (Device->LineRegistersValid && *LastValue == Value) {
+        return;
+    }
+
+    DioRegisterWrite<Register>(DioCoreBackend<DevicePointer>::Bar(Device, Path),
+                               Value);
+
+    *LastValue = Value;
+}
+
+//
+// DioCoreProgramLines
+//
+// Set the line directions (indicating which lines are used for input and
+// which for output) as well as the digtal filters for the input lines.  Also
+// program the device to interrupt whenever the state of one of the
+// input lines changes (in the directions our line profile asks for).
+//
+// The output lines' state is written first, so a line that becomes an
+// output is driven to its proper state from the start (we don't count on
+// the state surviving a software reset).  Lines becoming outputs stop
+// detecting changes before they're switched, so switching them doesn't
+// look like a change on an input line.
+//
+// Only the registers whose values change are written, unless we don't know
+// what's in them (after a software reset), in which case they all are.
+// The writes are profiled as Path's.
+//
+// Called holding OutputLock and the interrupt lock, or from a power
+// callback (see OutputLock).
+//
+template <typename DevicePointer>
+inline void
+DioCoreProgramLines(DevicePointer Device,
+                    unsigned int  Path)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    if (!Backend::ShadowLineRegisters(Device)) {
+        Device->LineRegistersValid = false;
+    }
+
+    if (Device->LineRegistersValid) {
+
+        DioCoreWriteLineRegister<DI_ChangeIrqRE_Register>(Device,
+                                                          Path,
+                                                          &Device->LineRegisters.RisingEdges,
+                                                          Device->LineRegisters.RisingEdges &
+                                                          ~Device->OutputLineMask);
+
+        DioCoreWriteLineRegister<DI_ChangeIrqFE_Register>(Device,
+                                                          Path,
+                                                          &Device->LineRegisters.FallingEdges,
+                                                          Device->LineRegisters.FallingEdges &
+                                                          ~Device->OutputLineMask);
+    }
+
+    //
+    // Set digital filters on the input lines as our profile says (by
+    // default, to maximum filtering, to eliminate noise-related artifacts
+    // from showing-up on input lines during state changes).
+    //
+    DioCoreWriteLineRegister<DI_FilterRegister_Port0and1>(Device,
+                                                          Path,
+                                                          &Device->LineRegisters.FilterPort0and1,
+                                                          Device->Profile.FilterPort0and1);
+
+    DioCoreWriteLineRegister<DI_FilterRegister_Port2and3>(Device,
+                                                          Path,
+                                                          &Device->LineRegisters.FilterPort2and3,
+                                                          Device->Profile.FilterPort2and3);
+
+    DioCoreWriteLineRegister<Static_Digital_Output_Register>(Device,
+                                                             Path,
+                                                             &Device->LineRegisters.Output,
+                                                             Device->OutputLineState);
+
+    //
+    // Tell the device which lines are Digital Inputs and which are Digital
+    // Outputs
+    //
+    DioCoreWriteLineRegister<DIO_Direction_Register>(Device,
+                                                     Path,
+                                                     &Device->LineRegisters.Direction,
+                                                     Device->OutputLineMask);
+
+    //
+    // Having set the OUTPUT lines, set the remaining lines (which are
+    // INPUT lines) to detect state changes, on "rising edges" and
+    // "falling edges"
+    //
+    DioCoreWriteLineRegister<DI_ChangeIrqRE_Register>(Device,
+                                                      Path,
+                                                      &Device->LineRegisters.RisingEdges,
+                                                      ~Device->OutputLineMask &
+                                                      Device->Profile.RisingEdges);
+
+    DioCoreWriteLineRegister<DI_ChangeIrqFE_Register>(Device,
+                                                      Path,
+                                                      &Device->LineRegisters.FallingEdges,
+                                                      ~Device->OutputLineMask &
+                                                      Device->Profile.FallingEdges);
+
+    Device->LineRegistersValid = Backend::ShadowLineRegisters(Device);
+}
+
+//
+// DioCoreReserveOutputLines
+//
+// Make OutputLines the lines reserved for output by the handle with File,
+// unless some of them are reserved by another handle, and fix up LineState
+// (the output lines' state) to match.  Lines newly reserved, and lines
+// given up, are deasserted; other lines keep their state.  The exception
+// is our line profile's output lines: the handle takes them from the
+// profile, and gives them back, without a glitch.  Those it takes keep
+// their state, and those it gives back go back to the profile's.
+//
+// Called holding OutputLock.  Doesn't touch the device.
+//
+template <typename DevicePointer, typename FilePointer, typename LineStatePointer>
+inline typename DioCoreBackend<DevicePointer>::Status
+DioCoreReserveOutputLines(DevicePointer    Device,
+                          FilePointer      File,
+                          unsigned int     OutputLines,
+                          LineStatePointer LineState)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    unsigned int otherLines;
+    unsigned int takenLines;
+    unsigned int returnedLines;
+    unsigned int changedLines;
+
+    otherLines = Device->OutputLineMask &
+                 ~File->OutputLines &
+                 ~Device->ProfileOutputLines;
+
+    if ((OutputLines & otherLines) != 0) {
+
+        return Backend::SharingViolation;
+    }
+
+    takenLines    = OutputLines & Device->ProfileOutputLines;
+    returnedLines = File->OutputLines & ~OutputLines &
+                    Device->Profile.OutputLines;
+    changedLines  = (OutputLines ^ File->OutputLines) &
+                    ~takenLines & ~returnedLines;
+
+    Device->ProfileOutputLines =
+        (Device->ProfileOutputLines & ~takenLines) | returnedLines;
+
+    File->OutputLines      = OutputLines;
+    Device->OutputLineMask = otherLines | OutputLines |
+                             Device->ProfileOutputLines;
+
+    //
+    // Deassert the lines changing hands before we change their direction
+    // (and put the lines going back to the profile in its state)
+    //
+    *LineState = (*LineState & Device->OutputLineMask &
+                  ~changedLines & ~returnedLines) |
+                 (Device->Profile.OutputState & returnedLines);
+
+    return Backend::Success;
+}
+
+//
+// DioCoreSetOutputLines
+//
+// Make OutputLines the lines reserved for output by the handle with File
+// (see DioCoreReserveOutputLines), and program the device to match,
+// holding the interrupt lock so our ISR never sees it half done.
+//
+// If the device isn't in D0, we don't touch it: we just fix up the state
+// that D0Entry and EvtInterruptEnable program into it.
+//
+template <typename DevicePointer, typename FilePointer>
+inline typename DioCoreBackend<DevicePointer>::Status
+DioCoreSetOutputLines(DevicePointer Device,
+                      FilePointer   File,
+                      unsigned int  OutputLines,
+                      bool          DeviceInD0)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    typename Backend::Status status;
+
+    Backend::AcquireOutputLock(Device);
+
+    status = DioCoreReserveOutputLines(Device,
+                                       File,
+                                       OutputLines,
+                                       DeviceInD0 ?
+                                           &Device->OutputLineState :
+                                           &Device->SavedOutputLineState);
+
+    if (status == Backend::Success && DeviceInD0) {
+
+        Backend::AcquireInterruptLock(Device);
+
+        DioCoreProgramLines(Device,
+                            DIO_CORE_PATH_IOCTL);
+
+        Backend::ReleaseInterruptLock(Device);
+    }
+
+    Backend::ReleaseOutputLock(Device);
+
+    return status;
+}
+
+//
+// DioCoreApplyProfile
+//
+// Reconfigures the device, in one go, as Profile says: its output lines
+// become the lines reserved by the handle with File (as with
+// DioCoreReserveOutputLines), they're set to its output state, and its
+// edges and filters become the device's.  Only the registers that change
+// are written, holding the interrupt lock, so our ISR sees the device
+// either as it was or as Profile says, never in between.
+//
+// The device must be in D0.
+//
+template <typename DevicePointer, typename FilePointer, typename ProfilePointer>
+inline typename DioCoreBackend<DevicePointer>::Status
+DioCoreApplyProfile(DevicePointer  Device,
+                    FilePointer    File,
+                    ProfilePointer Profile)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    typename Backend::Status status;
+
+    Backend::AcquireOutputLock(Device);
+
+    status = DioCoreReserveOutputLines(Device,
+                                       File,
+                                       Profile->OutputLines,
+                                       &Device->OutputLineState);
+
+    if (status == Backend::Success) {
+
+        Device->OutputLineState =
+            (Device->OutputLineState & ~Profile->OutputLines) |
+            (Profile->OutputState & Profile->OutputLines);
+
+        Device->Profile.RisingEdges     = Profile->RisingEdges;
+        Device->Profile.FallingEdges    = Profile->FallingEdges;
+        Device->Profile.FilterPort0and1 = Profile->FilterPort0and1;
+        Device->Profile.FilterPort2and3 = Profile->FilterPort2and3;
+
+        Backend::AcquireInterruptLock(Device);
+
+        DioCoreProgramLines(Device,
+                            DIO_CORE_PATH_IOCTL);
+
+        Backend::ReleaseInterruptLock(Device);
+    }
+
+    Backend::ReleaseOutputLock(Device);
+
+    return status;
+}
+
+//
+// DioCoreReadLines
+//
+// IOCTL_OSRDIO_READ: the current state of the lines
+//
+template <typename DevicePointer>
+inline unsigned int
+DioCoreReadLines(DevicePointer Device)
+{
+    return DioRegisterRead<Static_Digital_Input_Register>(DioCoreBackend<DevicePointer>::Bar(Device,
+                                                                                             DIO_CORE_PATH_IOCTL));
+}
+
+//
+// DioCoreWriteOutputs
+//
+// IOCTL_OSRDIO_WRITE: assert LinesToAssert, of the lines reserved by the
+// handle with File, and deassert its others.  Every other handle's lines
+// are left the way they were.  The device must be in D0.
+//
+template <typename DevicePointer, typename FilePointer>
+inline typename DioCoreBackend<DevicePointer>::Status
+DioCoreWriteOutputs(DevicePointer Device,
+                    FilePointer   File,
+                    unsigned int  LinesToAssert)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    unsigned int outputLineState;
+
+    //
+    // We can't write anything if this handle hasn't reserved any lines for
+    // output
+    //
+    if (File->OutputLines == 0) {
+
+        return Backend::InvalidDeviceState;
+    }
+
+    Backend::AcquireOutputLock(Device);
+
+    //
+    // Asserting somebody else's output line is an error.  Lines that aren't
+    // outputs at all, we ignore (as we always have).
+    //
+    if ((LinesToAssert & Device->OutputLineMask & ~File->OutputLines) != 0) {
+
+        Backend::ReleaseOutputLock(Device);
+
+        return Backend::SharingViolation;
+    }
+
+    outputLineState  = Device->OutputLineState & ~File->OutputLines;
+    outputLineState |= LinesToAssert & File->OutputLines;
+
+    //
+    // The line registers are only ever written holding both OutputLock and
+    // the interrupt lock (see LineRegisters)
+    //
+    Backend::AcquireInterruptLock(Device);
+
+    DioCoreWriteLineRegister<Static_Digital_Output_Register>(Device,
+                                                             DIO_CORE_PATH_IOCTL,
+                                                             &Device->LineRegisters.Output,
+                                                             outputLineState);
+
+    Device->OutputLineState = outputLineState;
+
+    Backend::ReleaseInterruptLock(Device);
+
+    Backend::ReleaseOutputLock(Device);
+
+    return Backend::Success;
+}
+
+//
+// DioCoreCanWaitForChange
+//
+// Whether any of PortLines (the lines of the handle's port, or all of them)
+// are inputs, that an IOCTL_OSRDIO_WAITFOR_CHANGE Request could wait to see
+// a change on.  Another handle can be changing its reservation right now,
+// so we look holding OutputLock.
+//
+template <typename DevicePointer>
+inline bool
+DioCoreCanWaitForChange(DevicePointer Device,
+                        unsigned int  PortLines)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    unsigned int outputLineMask;
+
+    Backend::AcquireOutputLock(Device);
+
+    outputLineMask = Device->OutputLineMask;
+
+    Backend::ReleaseOutputLock(Device);
+
+    return (PortLines & ~outputLineMask) != 0;
+}
+
+//
+// DioCoreRecordChange
+//
+// Records a change on the input lines, with the state of the lines latched
+// when it happened: in our event ring (and the application's, if one's
+// attached), and for our DpcForIsr, which we queue to complete the Requests
+// waiting for it.  Called holding the interrupt lock, from our ISR, and from
+// EvtInterruptEnable when a change woke our device.
+//
+template <typename DevicePointer>
+inline void
+DioCoreRecordChange(DevicePointer Device,
+                    unsigned int  LineState)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    unsigned int                       changedLines;
+    typename Backend::Event            newEvent;
+    typename Backend::EventRingPointer ring;
+
+    //
+    // Record a timestamped event in the event ring.  If the ring is full,
+    // we drop the event and remember that we did, so the next batch
+    // returned to the user can say so.
+    //
+    changedLines = LineState ^ Device->LatchedInputLineState;
+
+    newEvent = Backend::MakeEvent(Device,
+                                  LineState,
+                                  changedLines);
+
+    if ((Device->EventRingHead - Device->EventRingTail) <
+        Backend::EventRingSize) {
+
+        Device->EventRing[Device->EventRingHead &
+                          (Backend::EventRingSize - 1)] = newEvent;
+
+        Device->EventRingHead++;
+
+    } else {
+
+        Device->EventRingOverflow = true;
+    }
+
+    //
+    // And, if the application has attached a ring of its own, store the
+    // event there too.  We trust nothing the application can write:
+    // ConsumerIndex only decides whether the ring is full, and we always
+    // mask the index we store at.  The event is stored before the new
+    // ProducerIndex is published.
+    //
+    ring = Device->SharedRing;
+
+    if (ring != nullptr) {
+
+        if ((Device->SharedRingHead - ring->ConsumerIndex) <=
+            Device->SharedRingMask) {
+
+            ring->Events[Device->SharedRingHead &
+                         Device->SharedRingMask] = newEvent;
+
+            Device->SharedRingHead++;
+
+            Backend::PublishRing(Device,
+                                 ring,
+                                 Device->SharedRingHead);
+
+        } else {
+
+            ring->OverflowCount++;
+        }
+    }
+
+    //
+    // Save the state of the lines at change, for returning to the user
+    //
+    Device->LatchedInputLineState = LineState;
+
+    //
+    // Tell the DpcForIsr which lines changed, so it knows which ports'
+    // waiters to complete, and queue it to return the data to the user and
+    // notify them of this state change
+    //
+    Backend::Or(&Device->DpcChangedLines,
+                changedLines);
+
+    Backend::QueueDpc(Device);
+}
+
+//
+// DioCoreChangeMissed
+//
+// The device caught a change before the previous one was ACK'ed, so the
+// event stream is missing at least one change.  Called holding the
+// interrupt lock.
+//
+template <typename DevicePointer>
+inline void
+DioCoreChangeMissed(DevicePointer Device)
+{
+    Device->EventRingOverflow = true;
+
+    if (Device->SharedRing != nullptr) {
+        Device->SharedRing->OverflowCount++;
+    }
+
+    DioCoreBackend<DevicePointer>::CountMissedChange(Device);
+}
+
+//
+// DioCoreServiceInterrupt
+//
+// Our ISR's work: returns false if our device didn't cause the interrupt.
+// Called holding the interrupt lock.
+//
+template <typename DevicePointer>
+inline bool
+DioCoreServiceInterrupt(DevicePointer Device)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    unsigned int interruptStatus;
+    unsigned int changeDetectReg;
+    unsigned int lineState;
+
+    //
+    // Get the pending interrupt status
+    //
+    // If an interrupt is being request from the device to the host, this
+    // will also acknowledge (and clear) that interrupt
+    //
+    interruptStatus =
+        DioRegisterRead<Volatile_Interrupt_Status_Register>(Backend::Bar(Device, DIO_CORE_PATH_ISR));
+
+    //
+    // Is there an interrupt pending from this device?
+    //
+    if ((interruptStatus & Vol_Int) == 0) {
+        return false;
+    }
+
+    Backend::CountInterrupt(Device);
+
+    //
+    // So... Our device interrupted.  Find out why.
+    //
+    // Is the interrupt because a Digital Input line state change was
+    // detected?
+    //
+    changeDetectReg =
+        DioRegisterRead<ChangeDetectStatusRegister>(Backend::Bar(Device, DIO_CORE_PATH_ISR));
+
+    if ((changeDetectReg & ChangeDetectStatus) != 0 &&
+        (changeDetectReg & ChangeDetectError) == 0) {
+
+        //
+        // Yes... the state of one of the Digital Input lines has changed,
+        // AND the ERROR bit is not set.  Read the latched state of the
+        // lines at the change, and record it.
+        //
+        lineState =
+            DioRegisterRead<DI_ChangeDetectLatched_Register>(Backend::Bar(Device, DIO_CORE_PATH_ISR));
+
+        DioCoreRecordChange(Device,
+                            lineState);
+    }
+
+    //
+    // Acknowledge (and clear) the condition that caused the interrupt.
+    // Doing this "resets" the Digital Input state change logic, and will
+    // cause it to recognize new state changes.
+    //
+    if (changeDetectReg & ChangeDetectStatus) {
+
+        DioRegisterWrite<ChangeDetectIRQ_Register>(Backend::Bar(Device, DIO_CORE_PATH_ISR),
+                                                   ChangeDetectIRQ_Acknowledge);
+    }
+
+    //
+    // If there was an error on the Digital Input lines, this would also
+    // cause an interrupt. If there IS an error, ACK and clear that error
+    // (so we will get notification of subsequent line state changes)
+    //
+    if (changeDetectReg & ChangeDetectError) {
+
+        DioCoreChangeMissed(Device);
+
+        DioRegisterWrite<ChangeDetectIRQ_Register>(Backend::Bar(Device, DIO_CORE_PATH_ISR),
+                                                   ChangeDetectErrorIRQ_Acknowledge);
+    }
+
+    return true;
+}
+
+//
+// DioCoreResetDeviceInterrupts
+//
+// ACKs, clears, and leave DISabled all device interrupts
+//
+template <typename DevicePointer>
+inline void
+DioCoreResetDeviceInterrupts(DevicePointer Device)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    //
+    // Software reset the device.  After that, we don't know what's in the
+    // line registers.
+    //
+    DioRegisterWrite<Joint_Reset_Register>(Backend::Bar(Device, DIO_CORE_PATH_POWER),
+                                           Software_Reset);
+
+    Device->LineRegistersValid = false;
+
+    //
+    // Disable and acknowledge all interrupts (per NI Spec, section 2)
+    //
+    DioRegisterWrite<Interrupt_Mask_Register>(Backend::Bar(Device, DIO_CORE_PATH_POWER),
+                                              (Clear_CPU_Int | Clear_STC3_Int));
+
+    DioRegisterWrite<GlobalInterruptEnable_Register>(Backend::Bar(Device, DIO_CORE_PATH_POWER),
+                                                     (DI_Interrupt_Disable |
+                                                      WatchdogTimer_Interrupt_Disable));
+
+    DioRegisterWrite<ChangeDetectIRQ_Register>(Backend::Bar(Device, DIO_CORE_PATH_POWER),
+                                               (ChangeDetectIRQ_Acknowledge |
+                                                ChangeDetectIRQ_Disable |
+                                                ChangeDetectErrorIRQ_Acknowledge |
+                                                ChangeDetectErrorIRQ_Disable));
+}
+
+//
+// DioCoreEnableDeviceInterrupts
+//
+// Enables the Digital Inputs to interrupt the device's interrupt controller,
+// and the device's interrupt controller to interrupt the host.
+//
+template <typename DevicePointer>
+inline void
+DioCoreEnableDeviceInterrupts(DevicePointer Device)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    //
+    // Enable interrupts from the Digital Inputs
+    //
+    DioRegisterWrite<GlobalInterruptEnable_Register>(Backend::Bar(Device, DIO_CORE_PATH_POWER),
+                                                     DI_Interrupt_Enable);
+
+    //
+    // And enable interrupts as a result of state changes on the Digital Input
+    // lines
+    //
+    DioRegisterWrite<ChangeDetectIRQ_Register>(Backend::Bar(Device, DIO_CORE_PATH_POWER),
+                                               (ChangeDetectErrorIRQ_Enable |
+                                                ChangeDetectIRQ_Enable));
+
+    //
+    // Enable interrupts from the device to the host
+    //
+    DioRegisterWrite<Interrupt_Mask_Register>(Backend::Bar(Device, DIO_CORE_PATH_POWER),
+                                              (Set_CPU_Int | Set_STC3_Int));
+}
+
+//
+// DioCoreDeviceReset
+//
+// Puts the device in a known, pristine, condition... ready to accept user
+// commands.  All previous settings on the device are lost/reset.
+//
+template <typename DevicePointer>
+inline void
+DioCoreDeviceReset(DevicePointer Device)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    //
+    // Reset/Clear/ACK any interrupts on the device
+    //
+    DioCoreResetDeviceInterrupts(Device);
+
+    //
+    // Set all lines for INPUT, and ensure the output line state is
+    // set to "all lines DEASSERTED"
+    //
+    DioRegisterWrite<DIO_Direction_Register>(Backend::Bar(Device, DIO_CORE_PATH_POWER),
+                                             0x00000000);
+
+    //
+    // Reset the device's idea of the output line state, just in case it
+    // "remembers" a previous state from when the output lines were enabled.
+    //
+    DioRegisterWrite<Static_Digital_Output_Register>(Backend::Bar(Device, DIO_CORE_PATH_POWER),
+                                                     0x00000000);
+
+    //
+    // Set the change detect registers to zeros.  We set these to functional
+    // values when we set the OUTPUT mask.
+    //
+    DioRegisterWrite<DI_ChangeIrqRE_Register>(Backend::Bar(Device, DIO_CORE_PATH_POWER),
+                                              0x00000000);
+
+    DioRegisterWrite<DI_ChangeIrqFE_Register>(Backend::Bar(Device, DIO_CORE_PATH_POWER),
+                                              0x00000000);
+}
+
+//
+// DioCoreStartLines
+//
+// At PrepareHardware, with Device's Profile loaded: the lines come up as
+// the profile says.  Its output lines are outputs, in its state (which
+// D0Entry will restore), and all the others are inputs.  With no profile,
+// that's all the lines as inputs.  No handle has reserved any lines yet,
+// so the profile holds all of its own.
+//
+template <typename DevicePointer>
+inline void
+DioCoreStartLines(DevicePointer Device)
+{
+    Device->OutputLineMask     = Device->Profile.OutputLines;
+    Device->ProfileOutputLines = Device->Profile.OutputLines;
+
+    Device->SavedOutputLineState = Device->Profile.OutputState &
+                                   Device->Profile.OutputLines;
+    Device->OutputLineState      = Device->SavedOutputLineState;
+}
+
+//
+// DioCoreD0Entry
+//
+// Restore the output lines' state, now the device is back in D0
+//
+template <typename DevicePointer>
+inline void
+DioCoreD0Entry(DevicePointer Device)
+{
+    DioRegisterWrite<Static_Digital_Output_Register>(DioCoreBackend<DevicePointer>::Bar(Device,
+                                                                                        DIO_CORE_PATH_POWER),
+                                                     Device->SavedOutputLineState);
+
+    Device->OutputLineState = Device->SavedOutputLineState;
+
+    //
+    // The line registers may not have kept their values in D3
+    //
+    Device->LineRegistersValid = false;
+}
+
+//
+// DioCoreD0Exit
+//
+// Save the output lines' state, as the device is about to leave D0.
+//
+// EvtInterruptDisable has run by now, and (unless we're armed to wake) has
+// software reset the device, which deasserts its outputs.  So we don't
+// read the lines back: we save the state we last programmed, which every
+// write to the output register goes through.
+//
+template <typename DevicePointer>
+inline void
+DioCoreD0Exit(DevicePointer Device)
+{
+    Device->SavedOutputLineState = Device->OutputLineState &
+                                   Device->OutputLineMask;
+}
+
+//
+// DioCoreArmWake
+//
+// Before the device idles in D3: returns whether it's to be armed to wake
+// on a change (see OsrDioEvtDeviceArmWakeFromS0).  If, the last time we
+// idled, a change was caught but our device didn't signal the wake, then a
+// change can't wake it, and from then on we refuse to arm.
+//
+template <typename DevicePointer>
+inline bool
+DioCoreArmWake(DevicePointer Device)
+{
+    if (Device->WakeChangeLatched && !Device->WakeTriggered) {
+        Device->WakeOnChange = false;
+    }
+
+    Device->WakeChangeLatched = false;
+    Device->WakeTriggered     = false;
+
+    if (!Device->WakeOnChange) {
+        return false;
+    }
+
+    Device->WakeArmed = true;
+
+    return true;
+}
+
+//
+// DioCoreWakeTriggered, DioCoreDisarmWake
+//
+// Our device signalled a wake while idling armed; and it's back in D0
+// after idling armed
+//
+template <typename DevicePointer>
+inline void
+DioCoreWakeTriggered(DevicePointer Device)
+{
+    Device->WakeTriggered = true;
+}
+
+template <typename DevicePointer>
+inline void
+DioCoreDisarmWake(DevicePointer Device)
+{
+    Device->WakeArmed = false;
+}
+
+//
+// DioCoreInterruptEnable
+//
+// EvtInterruptEnable's work: reset the device's interrupt logic, enable its
+// interrupts, and program the lines.  Called holding the interrupt lock.
+//
+template <typename DevicePointer>
+inline void
+DioCoreInterruptEnable(DevicePointer Device)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    unsigned int changeDetectReg;
+    bool         wakeChange;
+    unsigned int wakeLineState = 0;
+
+    //
+    // If we left change detection running when we idled (because our
+    // device was armed to wake), see whether it caught a change before we
+    // reset it.  That change is probably what woke us.
+    //
+    wakeChange = false;
+
+    if (Device->ChangeDetectLeftArmed) {
+
+        Device->ChangeDetectLeftArmed = false;
+
+        changeDetectReg =
+            DioRegisterRead<ChangeDetectStatusRegister>(Backend::Bar(Device, DIO_CORE_PATH_POWER));
+
+        if (changeDetectReg & ChangeDetectStatus) {
+
+            wakeChange = true;
+
+            Device->WakeChangeLatched = true;
+
+            wakeLineState =
+                DioRegisterRead<DI_ChangeDetectLatched_Register>(Backend::Bar(Device, DIO_CORE_PATH_POWER));
+        }
+
+        //
+        // More than one change while we were idle means we missed some
+        //
+        if (changeDetectReg & ChangeDetectError) {
+
+            DioCoreChangeMissed(Device);
+        }
+    }
+
+    //
+    // Set the device's interrupt logic to a known state, ACK'ing any
+    // outstanding interrupts and ensuring no interrupts are enabled.
+    //
+    DioCoreResetDeviceInterrupts(Device);
+
+    //
+    // And enable interrupts from the Digital Inputs, from State Changes,
+    // and from the card to the host.
+    //
+    DioCoreEnableDeviceInterrupts(Device);
+
+    //
+    // Tell the device that we're interested in getting an interrupt when
+    // the state of any of the input lines changes.
+    //
+    DioCoreProgramLines(Device,
+                        DIO_CORE_PATH_POWER);
+
+    //
+    // If a change happened while we were idle, report it now, just as our
+    // ISR would have (compared against the lines as they were before we
+    // idled).  The next change is compared against its latched state.
+    // Otherwise, establish the line state that the first change event will
+    // be compared against when we compute its mask of changed lines.
+    //
+    if (wakeChange) {
+
+        DioCoreRecordChange(Device,
+                            wakeLineState);
+
+    } else {
+
+        Device->LatchedInputLineState =
+            DioRegisterRead<Static_Digital_Input_Register>(Backend::Bar(Device, DIO_CORE_PATH_POWER));
+    }
+}
+
+//
+// DioCoreInterruptDisable
+//
+// EvtInterruptDisable's work.  Called holding the interrupt lock.
+//
+template <typename DevicePointer>
+inline void
+DioCoreInterruptDisable(DevicePointer Device)
+{
+    //
+    // If we're idling armed to wake, the change detection logic is what
+    // wakes us, so we leave it running (and leave any change it's already
+    // caught for EvtInterruptEnable).  We only stop it interrupting the
+    // host: a change while we're idle signals a wake instead.
+    //
+    if (Device->WakeArmed) {
+
+        DioRegisterWrite<Interrupt_Mask_Register>(DioCoreBackend<DevicePointer>::Bar(Device,
+                                                                                     DIO_CORE_PATH_POWER),
+                                                  Clear_CPU_Int);
+
+        Device->ChangeDetectLeftArmed = true;
+
+        return;
+    }
+
+    //
+    // ACK and disable any pending interrupts
+    //
+    DioCoreResetDeviceInterrupts(Device);
+}
+
+//
+// DioCoreCompleteChangeRequests
+//
+// Completes the next IOCTL_OSRDIO_WAITFOR_CHANGE Request of class Priority
+// waiting for any change (every change interrupt completes one, as it always
+// has), and the next one waiting on each port with lines in ChangedLines.
+//
+template <typename DevicePointer>
+inline void
+DioCoreCompleteChangeRequests(DevicePointer Device,
+                              unsigned int  Priority,
+                              unsigned int  ChangedLines,
+                              unsigned int  LineState)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    Backend::CompleteChangeRequest(Device,
+                                   Priority,
+                                   DIO_CORE_NO_PORT,
+                                   LineState);
+
+    for (unsigned int port = 0; port < DIO_CORE_PORT_COUNT; port++) {
+
+        if ((ChangedLines & DioCorePortLines(port)) != 0) {
+
+            Backend::CompleteChangeRequest(Device,
+                                           Priority,
+                                           port,
+                                           LineState);
+        }
+    }
+}
+
+//
+// DioCoreChangeRequestsWaiting
+//
+// Whether DioCoreCompleteChangeRequests, for Priority and ChangedLines,
+// would find a Request to complete.  The answer can be out of date as soon
+// as we return, so this is only good for skipping work that would find
+// nothing to do.
+//
+template <typename DevicePointer>
+inline bool
+DioCoreChangeRequestsWaiting(DevicePointer Device,
+                             unsigned int  Priority,
+                             unsigned int  ChangedLines)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    if (Backend::ChangeRequestsWaiting(Device,
+                                       Priority,
+                                       DIO_CORE_NO_PORT)) {
+        return true;
+    }
+
+    for (unsigned int port = 0; port < DIO_CORE_PORT_COUNT; port++) {
+
+        if ((ChangedLines & DioCorePortLines(port)) != 0 &&
+            Backend::ChangeRequestsWaiting(Device,
+                                           Priority,
+                                           port)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//
+// DioCoreCompleteEventRequests
+//
+// Completes IOCTL_OSRDIO_READ_EVENTS Requests for as long as there are both
+// Requests waiting and events in the event ring.  Each Request receives as
+// many events as fit in its buffer.
+//
+// Called both when a Request arrives and from our DpcForIsr.  EventLock
+// serializes those callers, and we hold the interrupt lock only while we
+// touch the ring itself.
+//
+template <typename DevicePointer>
+inline void
+DioCoreCompleteEventRequests(DevicePointer Device)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    typename Backend::EventRequest request;
+    typename Backend::Event*       events;
+    unsigned int                   capacity;
+    unsigned int                   eventsAvailable;
+    unsigned int                   eventsToCopy;
+    bool                           overflow;
+
+    Backend::AcquireEventLock(Device);
+
+    while (true) {
+
+        //
+        // Don't bother dequeuing a Request if there's nothing to give it
+        //
+        Backend::AcquireInterruptLock(Device);
+
+        eventsAvailable = Device->EventRingHead - Device->EventRingTail;
+
+        Backend::ReleaseInterruptLock(Device);
+
+        if (eventsAvailable == 0) {
+            break;
+        }
+
+        //
+        // If no one is waiting, the events stay in the ring until someone
+        // asks for them
+        //
+        if (!Backend::NextEventRequest(Device,
+                                       &request,
+                                       &events,
+                                       &capacity)) {
+            break;
+        }
+
+        //
+        // Copy the events out of the ring.  The ISR may have added more
+        // since we looked, but it can never remove any.
+        //
+        Backend::AcquireInterruptLock(Device);
+
+        eventsAvailable = Device->EventRingHead - Device->EventRingTail;
+        eventsToCopy    = capacity < eventsAvailable ? capacity : eventsAvailable;
+
+        for (unsigned int index = 0; index < eventsToCopy; index++) {
+
+            events[index] =
+                Device->EventRing[(Device->EventRingTail + index) &
+                                  (Backend::EventRingSize - 1)];
+        }
+
+        Device->EventRingTail += eventsToCopy;
+
+        overflow = Device->EventRingOverflow;
+
+        Device->EventRingOverflow = false;
+
+        Backend::ReleaseInterruptLock(Device);
+
+        Backend::CompleteEventRequest(Device,
+                                      request,
+                                      events,
+                                      eventsToCopy,
+                                      overflow);
+    }
+
+    Backend::ReleaseEventLock(Device);
+}
+
+//
+// DioCoreCompleteRingWaitRequests
+//
+// Completes IOCTL_OSRDIO_WAIT_EVENT_RING Requests if the application's
+// event ring has events in it.  If the ring has been Detached (or was never
+// attached) the Requests are failed instead, because nothing will ever
+// wake them.
+//
+template <typename DevicePointer>
+inline void
+DioCoreCompleteRingWaitRequests(DevicePointer Device,
+                                bool          Detached)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    typename Backend::Status           status;
+    typename Backend::EventRingPointer ring;
+    bool                               available;
+
+    while (true) {
+
+        Backend::AcquireInterruptLock(Device);
+
+        ring = Device->SharedRing;
+
+        if (ring == nullptr || Detached) {
+
+            status    = Backend::InvalidDeviceState;
+            available = true;
+
+        } else {
+
+            status    = Backend::Success;
+            available = (ring->ConsumerIndex != Device->SharedRingHead);
+        }
+
+        Backend::ReleaseInterruptLock(Device);
+
+        if (!available) {
+            break;
+        }
+
+        if (!Backend::CompleteRingWaitRequest(Device,
+                                              status)) {
+            break;
+        }
+    }
+}
+
+//
+// DioCoreRingCapacity
+//
+// The number of events in an application's ring of Length bytes: the
+// largest power of two that fits.  0 if it's too small to hold two, or
+// larger than 4GB, as we don't want to deal with those.
+//
+template <typename DevicePointer>
+inline unsigned int
+DioCoreRingCapacity(DevicePointer      Device,
+                    unsigned long long Length)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    unsigned int capacity;
+
+    (void)Device;
+
+    if (Length < Backend::RingSize(2) ||
+        Length > 0xFFFFFFFFULL) {
+        return 0;
+    }
+
+    capacity = 2;
+
+    while (Backend::RingSize(static_cast<unsigned long long>(capacity) * 2) <= Length) {
+        capacity *= 2;
+    }
+
+    return capacity;
+}
+
+//
+// DioCoreAttachEventRing
+//
+// IOCTL_OSRDIO_ATTACH_EVENT_RING: initialize the application's Ring, with
+// room for Capacity (from DioCoreRingCapacity) events, and hand it to our
+// ISR.  Returns false if there's a ring attached already.  Ring must stay
+// where it is until DioCoreDetachEventRing.
+//
+template <typename DevicePointer>
+inline bool
+DioCoreAttachEventRing(DevicePointer                                            Device,
+                       typename DioCoreBackend<DevicePointer>::EventRingPointer Ring,
+                       unsigned int                                             Capacity)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    bool attached;
+
+    Ring->TimestampFrequency = Backend::TimestampFrequency(Device);
+    Ring->Capacity           = Capacity;
+    Ring->Reserved           = 0;
+    Ring->ProducerIndex      = 0;
+    Ring->OverflowCount      = 0;
+    Ring->ConsumerIndex      = 0;
+
+    Backend::AcquireInterruptLock(Device);
+
+    attached = (Device->SharedRing == nullptr);
+
+    if (attached) {
+
+        Device->SharedRing     = Ring;
+        Device->SharedRingMask = Capacity - 1;
+        Device->SharedRingHead = 0;
+    }
+
+    Backend::ReleaseInterruptLock(Device);
+
+    return attached;
+}
+
+//
+// DioCoreDetachEventRing
+//
+// Stop using the application's ring, and fail the Requests waiting for
+// events in it.  Once we return, our ISR won't touch the ring again.
+//
+template <typename DevicePointer>
+inline void
+DioCoreDetachEventRing(DevicePointer Device)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    Backend::AcquireInterruptLock(Device);
+
+    Device->SharedRing = nullptr;
+
+    Backend::ReleaseInterruptLock(Device);
+
+    DioCoreCompleteRingWaitRequests(Device,
+                                    true);
+}
+
+//
+// DioCoreSetDpcProcessor
+//
+// IOCTL_OSRDIO_SET_DPC_PROCESSOR: target our DpcForIsr at Processor, or let
+// it run wherever our ISR ran (DIO_CORE_ANY_PROCESSOR).
+//
+// A DPC can't be retargeted while it's queued, so we first stop the ISR
+// queuing the targeted DPC, then take it off its queue (waiting for it, if
+// it's running), retarget it, and queue it again if we took it off.  The
+// caller serializes calls to us.
+//
+template <typename DevicePointer>
+inline typename DioCoreBackend<DevicePointer>::Status
+DioCoreSetDpcProcessor(DevicePointer Device,
+                       unsigned int  Processor)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    bool wasQueued;
+
+    if (Processor != DIO_CORE_ANY_PROCESSOR &&
+        !Backend::ProcessorExists(Device,
+                                  Processor)) {
+
+        return Backend::InvalidParameter;
+    }
+
+    Backend::AcquireInterruptLock(Device);
+
+    Device->DpcProcessor = DIO_CORE_ANY_PROCESSOR;
+
+    Backend::ReleaseInterruptLock(Device);
+
+    wasQueued = Backend::CancelTargetedDpc(Device);
+
+    if (Processor != DIO_CORE_ANY_PROCESSOR &&
+        !Backend::TargetDpc(Device,
+                            Processor)) {
+
+        Processor = DIO_CORE_ANY_PROCESSOR;
+    }
+
+    Backend::AcquireInterruptLock(Device);
+
+    Device->DpcProcessor = Processor;
+
+    //
+    // If we took the DPC off its queue, the changes it was queued for are
+    // still waiting to be processed
+    //
+    if (wasQueued) {
+
+        Backend::RequeueDpc(Device);
+    }
+
+    Backend::ReleaseInterruptLock(Device);
+
+    //
+    // Wake the worker thread (if there is one) so it can move too
+    //
+    Backend::WakeWorker(Device);
+
+    return Backend::Success;
+}
+
+//
+// DioCoreSaveProfile
+//
+// IOCTL_OSRDIO_SAVE_PROFILE: save Profile, to be loaded the next time our
+// device starts.  Only the state of its output lines is saved.
+//
+template <typename DevicePointer, typename ProfilePointer>
+inline typename DioCoreBackend<DevicePointer>::Status
+DioCoreSaveProfile(DevicePointer  Device,
+                   ProfilePointer Profile)
+{
+    auto savedProfile = *Profile;
+
+    savedProfile.OutputState &= savedProfile.OutputLines;
+
+    return DioCoreBackend<DevicePointer>::SaveProfile(Device,
+                                                      &savedProfile);
+}
+
+//
+// DioCoreProcessChanges
+//
+// Everything that has to be done after our ISR has recorded some changes:
+// the work of our DpcForIsr, done there or in our worker thread.
+//
+// ChangedLines are the lines that changed (since we were last called), and
+// LineState their latest state.
+//
+template <typename DevicePointer>
+inline void
+DioCoreProcessChanges(DevicePointer Device,
+                      unsigned int  ChangedLines,
+                      unsigned int  LineState)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    Backend::BeginProcessing(Device);
+
+    //
+    // Return any newly recorded events to IOCTL_OSRDIO_READ_EVENTS Requests
+    //
+    DioCoreCompleteEventRequests(Device);
+
+    //
+    // ...and wake anyone waiting for events in the application's ring
+    //
+    DioCoreCompleteRingWaitRequests(Device,
+                                    false);
+
+    //
+    // Complete an IOCTL_OSRDIO_WAITFOR_CHANGE Request waiting for any
+    // change, and one for each port with lines that changed: realtime
+    // Requests first, then normal ones
+    //
+    DioCoreCompleteChangeRequests(Device,
+                                  DIO_CORE_PRIORITY_REALTIME,
+                                  ChangedLines,
+                                  LineState);
+
+    DioCoreCompleteChangeRequests(Device,
+                                  DIO_CORE_PRIORITY_NORMAL,
+                                  ChangedLines,
+                                  LineState);
+
+    //
+    // Background Requests are left for our work item, which we only queue
+    // if there's one it could complete.  A background Request that
+    // arrives after we've looked waits for the next change, as it would
+    // have anyway.
+    //
+    if (!DioCoreChangeRequestsWaiting(Device,
+                                      DIO_CORE_PRIORITY_BACKGROUND,
+                                      ChangedLines)) {
+        return;
+    }
+
+    Backend::Exchange(&Device->BackgroundLineState,
+                      LineState);
+
+    //
+    // If there were lines already waiting for our work item, it's been
+    // queued and hasn't taken them yet, so it'll see these along with them
+    //
+    if (Backend::Or(&Device->BackgroundChangedLines,
+                    ChangedLines) == 0) {
+
+        Backend::QueueWorkItem(Device);
+    }
+}
+
+//
+// DioCoreDpc
+//
+// Our DpcForIsr's work: process the changes our ISR has recorded, or, if
+// our processing is deferred, hand them to our worker thread
+//
+template <typename DevicePointer>
+inline void
+DioCoreDpc(DevicePointer Device)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    unsigned int changedLines;
+    unsigned int lineState;
+
+    changedLines = Backend::Exchange(&Device->DpcChangedLines,
+                                     0);
+
+    lineState = Device->LatchedInputLineState;
+
+    if (Device->DeferredProcessing) {
+
+        //
+        // If the worker is still busy with earlier changes, it'll see
+        // these lines along with those when it looks again
+        //
+        Backend::Exchange(&Device->WorkerLineState,
+                          lineState);
+
+        Backend::Or(&Device->WorkerChangedLines,
+                    changedLines);
+
+        Backend::WakeWorker(Device);
+
+    } else {
+
+        DioCoreProcessChanges(Device,
+                              changedLines,
+                              lineState);
+    }
+}
+
+//
+// DioCoreWorker
+//
+// One run of our worker thread, when our processing is deferred
+//
+template <typename DevicePointer>
+inline void
+DioCoreWorker(DevicePointer Device)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    unsigned int changedLines;
+    unsigned int lineState;
+
+    //
+    // Take the lines first, so a change that comes in while we're working
+    // wakes us again
+    //
+    changedLines = Backend::Exchange(&Device->WorkerChangedLines,
+                                     0);
+
+    lineState = Backend::Load(&Device->WorkerLineState);
+
+    DioCoreProcessChanges(Device,
+                          changedLines,
+                          lineState);
+}
+
+//
+// DioCoreBackgroundWork
+//
+// Our background work item's work: complete the background
+// IOCTL_OSRDIO_WAITFOR_CHANGE Requests, once the others have been
+// completed
+//
+template <typename DevicePointer>
+inline void
+DioCoreBackgroundWork(DevicePointer Device)
+{
+    typedef DioCoreBackend<DevicePointer> Backend;
+
+    unsigned int changedLines;
+
+    //
+    // Take the lines first, so a change that comes in while we're working
+    // queues us again
+    //
+    changedLines = Backend::Exchange(&Device->BackgroundChangedLines,
+                                     0);
+
+    DioCoreCompleteChangeRequests(Device,
+                                  DIO_CORE_PRIORITY_BACKGROUND,
+                                  changedLines,
+                                  Backend::Load(&Device->BackgroundLineState));
+}
@@ -0,0 +1,335 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioRegisterTrace.h -- Register trace files: a compact record of
+//                              register accesses, for replay against DioSim
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      A register trace records every access to the device's registers, in
+//      order, with when it was made.  Traces come from the driver
+//      (IOCTL_OSRDIO_GET_REGISTER_TRACE, saved by DioTest) or from the
+//      simulator's model of the device (DioSimTraceRecorder), and
+//      DioSimTraceReplay replays them against the model.  Besides reads and
+//      writes, a trace can record changes on the input lines (which only
+//      the simulator sees) and in the device's power state.
+//
+//      This is for applications and the simulator, not the driver (which
+//      returns its trace as OSRDIO_REGISTER_TRACE entries).
+//
+//      File layout (all fields little-endian):
+//
+//          DIO_REGISTER_TRACE_HEADER
+//          uint32_t                    Offsets[RegisterCount]
+//          entries
+//
+//      Offsets[n] is the offset (in the device's BAR) of the register that
+//      slot n stands for, so a trace can still be read after the register
+//      map (DioRegisterOffsets) changes.
+//
+//      Entry encoding
+//
+//      Timestamps are in ticks of 1/Frequency seconds (from the header),
+//      counted from when the device was reset: at power on, for the
+//      simulator's traces, and when the driver started the device, for
+//      the driver's.  As in a capture file, each entry is LEB128 varints:
+//
+//          (DeltaTicks << 7) | (Kind << 5) | Slot
+//          Value
+//          Offset                      (only if Slot is
+//                                      DIO_REGISTER_TRACE_OTHER)
+//
+//      DeltaTicks is the number of ticks since the previous entry (or since
+//      time zero, for the first).  Kind is DIO_REGISTER_TRACE_READ and so
+//      on.  For reads and writes, Slot is the register's slot in Offsets,
+//      or DIO_REGISTER_TRACE_OTHER for an offset that isn't in it.  For
+//      inputs and power, it's zero.
+//
+//      A status read a few microseconds after the previous access thus
+//      typically takes three or four bytes, compared to the sixteen of an
+//      OSRDIO_REGISTER_TRACE_ENTRY.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstdint>
+
+#include "DioRegisters.h"
+
+constexpr uint32_t DIO_REGISTER_TRACE_SIGNATURE = 0x52545244;  // "DRTR"
+constexpr uint16_t DIO_REGISTER_TRACE_VERSION   = 1;
+
+//
+// Entry kinds.  Value is the value read or written, the levels now on the
+// input lines (DIO_REGISTER_TRACE_INPUTS), or the device's new power state
+// (DIO_REGISTER_TRACE_POWER).
+//
+constexpr uint32_t DIO_REGISTER_TRACE_READ   = 0;
+constexpr uint32_t DIO_REGISTER_TRACE_WRITE  = 1;
+constexpr uint32_t DIO_REGISTER_TRACE_INPUTS = 2;
+constexpr uint32_t DIO_REGISTER_TRACE_POWER  = 3;
+
+//
+// Values of DIO_REGISTER_TRACE_POWER entries: D0, D3 (possibly armed to
+// wake), or reset at power on (which starts D0 again, with the registers
+// at their power-on values)
+//
+constexpr uint32_t DIO_REGISTER_TRACE_D0        = 0;
+constexpr uint32_t DIO_REGISTER_TRACE_D3        = 3;
+constexpr uint32_t DIO_REGISTER_TRACE_D3_WAKE   = 0x103;
+constexpr uint32_t DIO_REGISTER_TRACE_POWER_ON  = 0x200;
+
+constexpr uint32_t DIO_REGISTER_TRACE_SLOT_BITS = 5;
+constexpr uint32_t DIO_REGISTER_TRACE_OTHER     = (1 << DIO_REGISTER_TRACE_SLOT_BITS) - 1;
+constexpr uint32_t DIO_REGISTER_TRACE_CODE_BITS = DIO_REGISTER_TRACE_SLOT_BITS + 2;
+
+static_assert(DIO_REGISTER_COUNT < DIO_REGISTER_TRACE_OTHER,
+              "a trace entry's slot can't hold every register");
+
+//
+// Longest possible encoding of one entry: a 10-byte varint holding the
+// delta and code, followed by two 5-byte varints
+//
+constexpr uint32_t DIO_REGISTER_TRACE_MAX_ENTRY_BYTES = 20;
+
+//
+// Bit definitions for DIO_REGISTER_TRACE_HEADER Flags
+//
+constexpr uint32_t DIO_REGISTER_TRACE_HAS_INPUTS = 0x00000001;  // every change
+                                                                // on the inputs
+                                                                // is recorded
+constexpr uint32_t DIO_REGISTER_TRACE_PARTIAL    = 0x00000002;  // accesses were
+                                                                // lost before
+                                                                // the first
+                                                                // entry
+
+#pragma pack(push, 1)
+
+typedef struct _DIO_REGISTER_TRACE_HEADER {
+    uint32_t    Signature;          // DIO_REGISTER_TRACE_SIGNATURE
+    uint16_t    Version;            // DIO_REGISTER_TRACE_VERSION
+    uint16_t    HeaderSize;         // sizeof(DIO_REGISTER_TRACE_HEADER)
+    uint64_t    Frequency;          // ticks per second
+    uint32_t    RegisterCount;      // entries in Offsets
+    uint32_t    Flags;
+} DIO_REGISTER_TRACE_HEADER, *PDIO_REGISTER_TRACE_HEADER;
+
+#pragma pack(pop)
+
+static_assert(sizeof(DIO_REGISTER_TRACE_HEADER) == 24, "trace header layout");
+
+//
+// One entry, decoded
+//
+typedef struct _DIO_REGISTER_TRACE_ENTRY {
+    uint64_t    Time;               // ticks
+    uint32_t    Kind;               // DIO_REGISTER_TRACE_READ and so on
+    uint32_t    Offset;             // of the register (reads and writes)
+    uint32_t    Value;
+} DIO_REGISTER_TRACE_ENTRY, *PDIO_REGISTER_TRACE_ENTRY;
+
+//
+// DioRegisterTraceHeader
+//
+// The header for a trace with timestamps in ticks of 1/Frequency seconds,
+// and our register map as its Offsets
+//
+inline DIO_REGISTER_TRACE_HEADER
+DioRegisterTraceHeader(uint64_t Frequency,
+                       uint32_t Flags)
+{
+    DIO_REGISTER_TRACE_HEADER header;
+
+    header.Signature     = DIO_REGISTER_TRACE_SIGNATURE;
+    header.Version       = DIO_REGISTER_TRACE_VERSION;
+    header.HeaderSize    = sizeof(DIO_REGISTER_TRACE_HEADER);
+    header.Frequency     = Frequency;
+    header.RegisterCount = DIO_REGISTER_COUNT;
+    header.Flags         = Flags;
+
+    return header;
+}
+
+//
+// Encoding helpers, shared by everything that writes or reads traces.
+//
+// DioRegisterTraceEncode encodes Entry, which follows an entry at
+// PreviousTime, with our register map's slots.  It returns the number of
+// bytes written.
+//
+// DioRegisterTraceDecode decodes the entry at Buffer, which follows an
+// entry at PreviousTime, with the slots of a trace whose Offsets are
+// given.  It returns the number of bytes consumed, or zero if the entry is
+// truncated or malformed.
+//
+inline uint32_t
+DioRegisterTraceEncodeVarint(uint64_t Value,
+                             uint8_t* Buffer)
+{
+    uint32_t length = 0;
+
+    while (Value >= 0x80) {
+
+        Buffer[length++] = (uint8_t)(Value | 0x80);
+
+        Value >>= 7;
+    }
+
+    Buffer[length++] = (uint8_t)Value;
+
+    return length;
+}
+
+inline uint32_t
+DioRegisterTraceDecodeVarint(const uint8_t* Buffer,
+                             const uint8_t* End,
+                             uint64_t*      Value)
+{
+    uint64_t value = 0;
+    uint32_t length = 0;
+
+    while (Buffer + length < End && length < 10) {
+        uint8_t byte = Buffer[length];
+
+        value |= (uint64_t)(byte & 0x7F) << (7 * length);
+
+        length++;
+
+        if ((byte & 0x80) == 0) {
+
+            *Value = value;
+
+            return length;
+        }
+    }
+
+    return 0;
+}
+
+inline uint32_t
+DioRegisterTraceEncode(const DIO_REGISTER_TRACE_ENTRY& Entry,
+                       uint64_t                        PreviousTime,
+                       uint8_t*                        Buffer)
+{
+    uint32_t slot   = 0;
+    uint32_t length = 0;
+
+    if (Entry.Kind == DIO_REGISTER_TRACE_READ || Entry.Kind == DIO_REGISTER_TRACE_WRITE) {
+
+        slot = DioRegisterIndex(Entry.Offset);
+
+        if (slot == DIO_REGISTER_COUNT) {
+            slot = DIO_REGISTER_TRACE_OTHER;
+        }
+    }
+
+    length += DioRegisterTraceEncodeVarint(((Entry.Time - PreviousTime) << DIO_REGISTER_TRACE_CODE_BITS) |
+                                               (Entry.Kind << DIO_REGISTER_TRACE_SLOT_BITS) |
+                                               slot,
+                                           Buffer + length);
+
+    length += DioRegisterTraceEncodeVarint(Entry.Value,
+                                           Buffer + length);
+
+    if (slot == DIO_REGISTER_TRACE_OTHER) {
+
+        length += DioRegisterTraceEncodeVarint(Entry.Offset,
+                                               Buffer + length);
+    }
+
+    return length;
+}
+
+inline uint32_t
+DioRegisterTraceDecode(const uint8_t*            Buffer,
+                       const uint8_t*            End,
+                       uint64_t                  PreviousTime,
+                       const uint32_t*           Offsets,
+                       uint32_t                  RegisterCount,
+                       DIO_REGISTER_TRACE_ENTRY* Entry)
+{
+    uint64_t code;
+    uint64_t value;
+    uint32_t slot;
+    uint32_t used;
+    uint32_t length;
+
+    length = DioRegisterTraceDecodeVarint(Buffer, End, &code);
+
+    if (length == 0) {
+        return 0;
+    }
+
+    used = DioRegisterTraceDecodeVarint(Buffer + length, End, &value);
+
+    if (used == 0 || value > 0xFFFFFFFF) {
+        return 0;
+    }
+
+    length += used;
+
+    slot = (uint32_t)(code & DIO_REGISTER_TRACE_OTHER);
+
+    Entry->Time   = PreviousTime + (code >> DIO_REGISTER_TRACE_CODE_BITS);
+    Entry->Kind   = (uint32_t)(code >> DIO_REGISTER_TRACE_SLOT_BITS) & 3;
+    Entry->Offset = 0;
+    Entry->Value  = (uint32_t)value;
+
+    if (Entry->Kind == DIO_REGISTER_TRACE_READ || Entry->Kind == DIO_REGISTER_TRACE_WRITE) {
+
+        if (slot == DIO_REGISTER_TRACE_OTHER) {
+
+            used = DioRegisterTraceDecodeVarint(Buffer + length, End, &value);
+
+            if (used == 0 || value > 0xFFFFFFFF) {
+                return 0;
+            }
+
+            length += used;
+
+            Entry->Offset = (uint32_t)value;
+
+        } else if (slot < RegisterCount) {
+
+            Entry->Offset = Offsets[slot];
+
+        } else {
+
+            return 0;
+        }
+    }
+
+    return length;
+}
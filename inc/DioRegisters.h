@@ -0,0 +1,400 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//    (C) Copyright 2020 OSR Open Systems Resources, Inc.
+//    All Rights Reserved
+//
+//    This software is supplied for instructional purposes only.
+//
+//    OSR Open Systems Resources, Inc. (OSR) expressly disclaims any warranty
+//    for this software.  THIS SOFTWARE IS PROVIDED  "AS IS" WITHOUT WARRANTY
+//    OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING, WITHOUT LIMITATION,
+//    THE IMPLIED WARRANTIES OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR
+//    PURPOSE.  THE ENTIRE RISK ARISING FROM THE USE OF THIS SOFTWARE REMAINS
+//    WITH YOU.  OSR's entire liability and your exclusive remedy shall not
+//    exceed the price paid for this material.  In no event shall OSR or its
+//    suppliers be liable for any damages whatsoever (including, without
+//    limitation, damages for loss of business profit, business interruption,
+//    loss of business information, or any other pecuniary loss) arising out
+//    of the use or inability to use this software, even if OSR has been
+//    advised of the possibility of such damages.  Because some states/
+//    jurisdictions do not allow the exclusion or limitation of liability for
+//    consequential or incidental damages, the above limitation may not apply
+//    to you.
+//
+//    OSR Open Systems Resources, Inc.
+//    889 Elm St, Sixth Floor
+//    Manchester, NH 03101
+//    email bugs to: bugs@osr.com
+//
+//
+//    MODULE:
+//
+//        DioRegisters.h -- The PCIe-6509's registers, and typed access
+//                          to them through a backend chosen at compile
+//                          time
+//
+//    AUTHOR(S):
+//
+//        OSR Open Systems Resources, Inc.
+//
+//    NOTES:
+//
+//      Shared by the driver and the (portable) simulator, so this uses
+//      nothing but the language itself.  So is the driver's logic that uses
+//      these registers (see DioDriverCore.h).
+//
+//      Each register is described by a type (see DioRegister) that carries
+//      its offset in the BAR, its width, and whether it can be read,
+//      written or both.  DioRegisterRead and DioRegisterWrite access a
+//      register through a "bar", whose type picks the backend that does the
+//      work (see DioRegisterBackend): the driver's does MMIO, the
+//      simulator's goes to its model of the device, and DioRegisterTracer
+//      wraps either one to profile or trace the accesses.  It's all
+//      resolved at compile time, so an access through the driver's backend
+//      compiles to just what READ_REGISTER_ULONG or WRITE_REGISTER_ULONG of
+//      the register's address would.
+//
+///////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+// ReSharper disable CppInconsistentNaming
+
+//
+// The size of the device memory area on the NI PCIe-6509
+//
+constexpr unsigned int DIO_BAR_SIZE = 512 * 1024;
+
+//
+// DioRegisterAccess
+//
+// Whether a register can be read, written, or both.  Some offsets hold one
+// register when read and another when written (0x20540 is
+// ChangeDetectStatusRegister when read, and DI_ChangeIrqRE_Register when
+// written), so each of those is described as two registers.
+//
+enum class DioRegisterAccess {
+    Read,
+    Write,
+    ReadWrite,
+};
+
+//
+// DioRegister
+//
+// Describes one register: its offset in the BAR, its width in bytes, and
+// how it can be accessed.  It has nothing in it but constants.
+//
+template <unsigned int Offset_, unsigned int Width_, DioRegisterAccess Access_>
+struct DioRegister
+{
+    static constexpr unsigned int      Offset = Offset_;
+    static constexpr unsigned int      Width  = Width_;
+    static constexpr DioRegisterAccess Access = Access_;
+
+    static constexpr bool CanRead  = Access_ != DioRegisterAccess::Write;
+    static constexpr bool CanWrite = Access_ != DioRegisterAccess::Read;
+
+    static_assert(Offset_ + Width_ <= DIO_BAR_SIZE,
+                  "register is outside the BAR");
+};
+
+//
+// The registers are all 32-bits wide
+//
+template <unsigned int Offset_, DioRegisterAccess Access_ = DioRegisterAccess::ReadWrite>
+using DioRegister32 = DioRegister<Offset_, 4, Access_>;
+
+//
+// The register map.  All register names are as specified in the NI
+// documentation.
+//
+//                                                                      OFFSET
+//      REGISTER NAME                                                   from BAR 0
+//      ==============================                                  ==========
+using CHInCh_Identification_Register     = DioRegister32<0x00000, DioRegisterAccess::Read>;
+
+using Static_Digital_Input_Register      = DioRegister32<0x20530, DioRegisterAccess::Read>;
+
+using Static_Digital_Output_Register     = DioRegister32<0x204B0>;
+using DIO_Direction_Register             = DioRegister32<0x204B4>;
+using DI_FilterRegister_Port0and1        = DioRegister32<0x2054C>;
+using DI_FilterRegister_Port2and3        = DioRegister32<0x20550>;
+
+//
+// DIO Change of State (RE = "Rising Edge", FE "Falling Edge")
+// and DIO Interrupt Registers
+//
+using ChangeDetectStatusRegister         = DioRegister32<0x20540, DioRegisterAccess::Read>;
+using DI_ChangeIrqRE_Register            = DioRegister32<0x20540, DioRegisterAccess::Write>;
+using DI_ChangeIrqFE_Register            = DioRegister32<0x20544, DioRegisterAccess::Write>;
+using DI_ChangeDetectLatched_Register    = DioRegister32<0x20544, DioRegisterAccess::Read>;
+
+using GlobalInterruptStatus_Register     = DioRegister32<0x20070>;
+using GlobalInterruptEnable_Register     = DioRegister32<0x20078>;
+using DI_Interrupt_Status_Register       = DioRegister32<0x2007E>;
+using ChangeDetectIRQ_Register           = DioRegister32<0x20554>;
+
+//
+// Board-Wide Interrupt Controller Registers
+//
+using Interrupt_Mask_Register            = DioRegister32<0x0005C>;
+using Interrupt_Status_Register          = DioRegister32<0x00060>;
+using Volatile_Interrupt_Status_Register = DioRegister32<0x00068>;
+using IntForwarding_ControlStatus        = DioRegister32<0x22204>;
+using IntForwarding_DestinationReg       = DioRegister32<0x22208>;
+
+//
+// Miscellaneous Board-Level Registers
+//
+using Scrap_Register                     = DioRegister32<0x00200>;
+using PCI_Subsystem_ID_Access_Register   = DioRegister32<0x010AC>;
+using ScratchpadRegister                 = DioRegister32<0x20004>;
+using Signature_Register                 = DioRegister32<0x20060>;
+using Joint_Reset_Register               = DioRegister32<0x20064, DioRegisterAccess::Write>;
+using TimeSincePowerUpRegister           = DioRegister32<0x20064, DioRegisterAccess::Read>;
+
+//
+// DioRegisterOffsets
+//
+// Every offset in the map, once each (a read-only and a write-only
+// register can share one), in ascending order.  DioRegisterIndex returns
+// an offset's position in the list, or DIO_REGISTER_COUNT if it isn't in
+// it, so per-register data can be kept in an array.
+//
+constexpr unsigned int DioRegisterOffsets[] = {
+    CHInCh_Identification_Register::Offset,
+    Interrupt_Mask_Register::Offset,
+    Interrupt_Status_Register::Offset,
+    Volatile_Interrupt_Status_Register::Offset,
+    Scrap_Register::Offset,
+    PCI_Subsystem_ID_Access_Register::Offset,
+    ScratchpadRegister::Offset,
+    Signature_Register::Offset,
+    Joint_Reset_Register::Offset,
+    GlobalInterruptStatus_Register::Offset,
+    GlobalInterruptEnable_Register::Offset,
+    DI_Interrupt_Status_Register::Offset,
+    Static_Digital_Output_Register::Offset,
+    DIO_Direction_Register::Offset,
+    Static_Digital_Input_Register::Offset,
+    ChangeDetectStatusRegister::Offset,
+    DI_ChangeDetectLatched_Register::Offset,
+    DI_FilterRegister_Port0and1::Offset,
+    DI_FilterRegister_Port2and3::Offset,
+    ChangeDetectIRQ_Register::Offset,
+    IntForwarding_ControlStatus::Offset,
+    IntForwarding_DestinationReg::Offset,
+};
+
+constexpr unsigned int DIO_REGISTER_COUNT = sizeof(DioRegisterOffsets) / sizeof(DioRegisterOffsets[0]);
+
+constexpr unsigned int
+DioRegisterIndex(unsigned int Offset)
+{
+    for (unsigned int i = 0; i < DIO_REGISTER_COUNT; i++) {
+
+        if (DioRegisterOffsets[i] == Offset) {
+            return i;
+        }
+    }
+
+    return DIO_REGISTER_COUNT;
+}
+
+constexpr unsigned int BIT_NUMBER(int x)
+{
+    return 1U << x;
+}
+
+//
+// Bit definitions for above registers
+//
+// (all names as specified in the NI documentation)
+//
+
+// Bit Definitions: Interrupt_Mask_Register
+constexpr unsigned int Set_CPU_Int     = BIT_NUMBER(31);
+constexpr unsigned int Clear_CPU_Int   = BIT_NUMBER(30);
+constexpr unsigned int Set_STC3_Int    = BIT_NUMBER(11);
+constexpr unsigned int Clear_STC3_Int  = BIT_NUMBER(10);
+
+// Bit Definitions: GlobalInterruptEnable_Register
+constexpr unsigned int WatchdogTimer_Interrupt_Disable = BIT_NUMBER(26);
+constexpr unsigned int DI_Interrupt_Disable            = BIT_NUMBER(22);
+constexpr unsigned int WatchdogTimer_Interrupt_Enable  = BIT_NUMBER(10);
+constexpr unsigned int DI_Interrupt_Enable             = BIT_NUMBER(6);
+
+
+// Bit Definitions: ChangeDetectIRQ_Register
+constexpr unsigned int ChangeDetectErrorIRQ_Enable         = BIT_NUMBER(7);
+constexpr unsigned int ChangeDetectErrorIRQ_Disable        = BIT_NUMBER(6);
+constexpr unsigned int ChangeDetectIRQ_Enable              = BIT_NUMBER(5);
+constexpr unsigned int ChangeDetectIRQ_Disable             = BIT_NUMBER(4);
+constexpr unsigned int ChangeDetectErrorIRQ_Acknowledge    = BIT_NUMBER(1);
+constexpr unsigned int ChangeDetectIRQ_Acknowledge         = BIT_NUMBER(0);
+
+// Bit Definitions: Joint_Reset_Register
+constexpr unsigned int Software_Reset  = BIT_NUMBER(0);
+
+
+// Bit Defintions: ChangeDetectStatusRegister
+constexpr unsigned int ChangeDetectError   = BIT_NUMBER(1);
+constexpr unsigned int ChangeDetectStatus  = BIT_NUMBER(0);
+
+//
+// Bit Definitions: Interrupt_Status_Register
+//
+constexpr unsigned int Int             = BIT_NUMBER(31);
+constexpr unsigned int Additional_Int  = BIT_NUMBER(30);
+constexpr unsigned int External        = BIT_NUMBER(29);
+constexpr unsigned int DAQ_STC3_Int    = BIT_NUMBER(11);
+
+//
+// Bit Definitions: Volatile_Interrupt_Status_Register
+//
+constexpr unsigned int Vol_Int             = BIT_NUMBER(31);
+constexpr unsigned int Vol_Additional_Int  = BIT_NUMBER(30);
+constexpr unsigned int Vol_External        = BIT_NUMBER(29);
+constexpr unsigned int Vol_STC3_Int        = BIT_NUMBER(11);
+
+//
+// Bit Definitions: DI_FilterRegister_Port0and1, DI_FilterRegister_Port2and3
+//
+constexpr unsigned int Filter_Large_All_Lines = 0xFFFFFFFF;
+
+// ReSharper restore CppInconsistentNaming
+
+//
+// DioRegisterBackend
+//
+// How registers are actually read and written through a bar of type
+// BarPointer.  Each backend is a specialization that provides:
+//
+//      Value                       The type of a register's value
+//
+//      Read(Bar, Offset)           Returns the value of the register at
+//                                  Offset in Bar
+//
+//      Write(Bar, Offset, RegisterValue)
+//                                  Writes RegisterValue to the register at
+//                                  Offset in Bar
+//
+// The driver's (in OsrDio.h) is for its mapped BAR, a PDIO_REGISTERS.  The
+// simulator's (in DioSimBar.h) is for a DioSimBar*.
+//
+template <typename BarPointer>
+struct DioRegisterBackend;
+
+//
+// DioRegisterRead, DioRegisterWrite
+//
+// Read or write Register in Bar, with Bar's backend.  Reading a write-only
+// register, or writing a read-only one, doesn't compile.
+//
+template <typename Register, typename BarPointer>
+inline typename DioRegisterBackend<BarPointer>::Value
+DioRegisterRead(BarPointer Bar)
+{
+    static_assert(Register::CanRead,
+                  "register is write-only");
+    static_assert(Register::Width == sizeof(typename DioRegisterBackend<BarPointer>::Value),
+                  "register isn't the backend's width");
+
+    return DioRegisterBackend<BarPointer>::Read(Bar,
+                                                Register::Offset);
+}
+
+template <typename Register, typename BarPointer>
+inline void
+DioRegisterWrite(BarPointer                                     Bar,
+                 typename DioRegisterBackend<BarPointer>::Value RegisterValue)
+{
+    static_assert(Register::CanWrite,
+                  "register is read-only");
+    static_assert(Register::Width == sizeof(typename DioRegisterBackend<BarPointer>::Value),
+                  "register isn't the backend's width");
+
+    DioRegisterBackend<BarPointer>::Write(Bar,
+                                          Register::Offset,
+                                          RegisterValue);
+}
+
+//
+// DioRegisterTracer
+//
+// A bar that passes every access on to another one (Inner, of any type
+// with a backend), and tells Trace about it.  Tracer is the policy: a
+// small type, copied with the bar, that provides
+//
+//      Stamp                       The type of what Begin returns
+//
+//      Enabled()                   Whether to trace accesses right now (if
+//                                  not, they go straight to Inner)
+//
+//      Begin()                     Called before an access
+//
+//      End(Offset, RegisterValue, Stamp, Write)
+//                                  Called after it, with the register's
+//                                  offset, the value read or written, what
+//                                  Begin returned, and whether it was a
+//                                  write
+//
+// The driver's register profiling (DIO_PROFILED_BAR, in OsrDio.h) and the
+// simulator's (DIO_SIM_PROFILED_BAR) are both DioRegisterTracers, so they
+// count and time the same accesses the same way.
+//
+template <typename InnerPointer, typename Tracer>
+struct DioRegisterTracer
+{
+    InnerPointer Inner;
+    Tracer       Trace;
+};
+
+template <typename InnerPointer, typename Tracer>
+struct DioRegisterBackend<DioRegisterTracer<InnerPointer, Tracer>>
+{
+    typedef typename DioRegisterBackend<InnerPointer>::Value Value;
+
+    static Value Read(const DioRegisterTracer<InnerPointer, Tracer>& Bar,
+                      unsigned int                                   Offset)
+    {
+        typename Tracer::Stamp stamp;
+        Value                  value;
+
+        if (!Bar.Trace.Enabled()) {
+            return DioRegisterBackend<InnerPointer>::Read(Bar.Inner,
+                                                          Offset);
+        }
+
+        stamp = Bar.Trace.Begin();
+
+        value = DioRegisterBackend<InnerPointer>::Read(Bar.Inner,
+                                                       Offset);
+
+        Bar.Trace.End(Offset, value, stamp, false);
+
+        return value;
+    }
+
+    static void Write(const DioRegisterTracer<InnerPointer, Tracer>& Bar,
+                      unsigned int                                   Offset,
+                      Value                                          RegisterValue)
+    {
+        typename Tracer::Stamp stamp;
+
+        if (!Bar.Trace.Enabled()) {
+            DioRegisterBackend<InnerPointer>::Write(Bar.Inner,
+                                                    Offset,
+                                                    RegisterValue);
+            return;
+        }
+
+        stamp = Bar.Trace.Begin();
+
+        DioRegisterBackend<InnerPointer>::Write(Bar.Inner,
+                                                Offset,
+                                                RegisterValue);
+
+        Bar.Trace.End(Offset, RegisterValue, stamp, true);
+    }
+};
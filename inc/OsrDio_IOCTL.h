@@ -60,6 +60,41 @@ DEFINE_GUID(GUID_DEVINTERFACE_OSRDIO,
 //
 #define FILE_DEVICE_OSRDIO 0xD056
 
+//
+// Port namespaces
+//
+// The 32 lines we support are four 8-line ports.  Opening the device with a
+// port name appended to its interface path (for example, the path returned
+// for GUID_DEVINTERFACE_OSRDIO followed by "\Port2") gives a handle that's
+// limited to that port's lines, and whose Requests are processed on the
+// port's own Queue.  An application using one port never waits behind
+// another application's Requests to another port.  Opening the device
+// itself (with no name) gives a handle for all the lines, as always.
+//
+// On a port handle:
+//
+//      IOCTL_OSRDIO_READ returns the state of all the lines.
+//
+//      IOCTL_OSRDIO_SET_OUTPUTS may only reserve lines in the port
+//      (others fail with STATUS_INVALID_PARAMETER).
+//
+//      IOCTL_OSRDIO_WAITFOR_CHANGE completes when an input line in the port
+//      changes.
+//
+//      The event IOCTLs (IOCTL_OSRDIO_READ_EVENTS, ATTACH_EVENT_RING and
+//      WAIT_EVENT_RING) are device-wide, and fail with
+//      STATUS_INVALID_DEVICE_REQUEST.
+//
+#define OSRDIO_PORT_COUNT       4
+#define OSRDIO_LINES_PER_PORT   8
+
+#define OSRDIO_PORT_LINES(_port_)  (0xFFUL << ((_port_) * OSRDIO_LINES_PER_PORT))
+
+//
+// The names of the ports are this followed by the port number
+//
+#define OSRDIO_PORT_NAME_PREFIX L"Port"
+
 //
 // Device control codes - Values between 2048 and 4095 arbitrarily chosen
 //
@@ -90,9 +125,9 @@ typedef struct _OSRDIO_READ_DATA {
 //
 // IOCTL_OSRDIO_WRITE
 //
-// Sets the state of lines that have been previously set to output. Lines that
-// have not been previously set to output (using IOCTL_OSRDIO_SET_OUTPUTS) are
-// ignored.
+// Sets the state of the output lines reserved by this handle (using
+// IOCTL_OSRDIO_SET_OUTPUTS).  Output lines reserved by other handles are
+// left as they are, and lines that are not outputs are ignored.
 //
 // Input Buffer:
 //
@@ -101,6 +136,10 @@ typedef struct _OSRDIO_READ_DATA {
 //      indicates that the corresponding line should be ASSERTED, a 0 indicates
 //      the corresponding line should be DEASSERTED.
 //
+//      Asserting a line that's reserved by another handle fails with
+//      STATUS_SHARING_VIOLATION (ERROR_SHARING_VIOLATION), and nothing is
+//      written.
+//
 //      Current line state can be read with IOCTL_OSRDIO_READ.
 //
 // Output Buffer:
@@ -116,14 +155,22 @@ typedef struct OSRDIO_WRITE_DATA {
 //
 // IOCTL_OSRDIO_SET_OUTPUTS
 //
-// Sets which lines are to be used for OUTPUT (sending) DIO signals.
+// Sets which lines are to be used for OUTPUT (sending) DIO signals by this
+// handle.  Each handle reserves its own output lines: the lines used for
+// output by the device are all the lines reserved by all open handles, and
+// a handle's lines return to input when it's closed.
 //
 // Input Buffer:
 //
 //      OSRDIO_SET_OUTPUTS_DATA structure. The OutputLines field contains
 //      a bitmap indicating which lines are to be used for output (1 indicates
 //      corresponding line is used for output). Lines not set for output are
-//      implicitly set for use as input.
+//      implicitly set for use as input (unless reserved by another handle).
+//
+//      If any of the lines is reserved by another handle, the request fails
+//      with STATUS_SHARING_VIOLATION (ERROR_SHARING_VIOLATION) and this
+//      handle's reservation is unchanged.  Lines newly reserved start out
+//      DEASSERTED.
 //
 // Output Buffer:
 //      (none)
@@ -139,10 +186,37 @@ typedef struct _OSRDIO_SET_OUTPUTS_DATA {
 //
 // Awaits a state change on one of the input lines. When one or more
 // lines changes from DEASSSERTED to ASSERTED, the bitmask of all the line's
-// states is returned.
+// states is returned.  On a port handle, only changes to the port's lines
+// complete the Request.
+//
+// Each change completes one waiting Request in each priority class, in
+// order: OSRDIO_PRIORITY_REALTIME Requests first, then
+// OSRDIO_PRIORITY_NORMAL.  OSRDIO_PRIORITY_BACKGROUND Requests are
+// completed afterwards, at PASSIVE_LEVEL, so they never delay the others;
+// if several changes happen before a background Request is completed it
+// sees them as one, with the latest line state.
+//
+// Waiting Requests keep the device in D0, so no change is missed, unless
+// the WakeOnChange value in the device's hardware key (see the INF) is 1.
+// Then the device may idle in D3 while Requests wait: a change on an input
+// line wakes it, and is returned (with the lines' state latched when it
+// happened) once the device is back in D0.  If the lines change more than
+// once before the device is back, only the first change is seen, and the
+// change event stream says events were lost.  If the device's bus can't
+// wake it from D3, it doesn't idle at all.
+//
+// We have no documentation that the PCIe-6509's change detection raises
+// PME in D3, which is why WakeOnChange is 0 unless it's set.  The driver
+// checks it works, too: if it finds a change was caught while the device
+// was idle, but the device didn't signal the wake, it keeps the device in
+// D0 from then on (until the device is removed and added again).  That
+// change is returned late (when the device woke for something else), but
+// it isn't lost.
 //
 // Input Buffer:
-//      (none)
+//      (optional) OSRDIO_WAITFOR_CHANGE_DATA structure, with the priority
+//      class of the Request.  Without one the Request is
+//      OSRDIO_PRIORITY_NORMAL, as all Requests used to be.
 //
 // Output Buffer:
 //
@@ -158,7 +232,453 @@ typedef struct _OSRDIO_CHANGE_DATA {
     ULONG   LatchedLineState;
 } OSRDIO_CHANGE_DATA, *POSRDIO_COS_DATA;
 
+#define OSRDIO_PRIORITY_REALTIME    0
+#define OSRDIO_PRIORITY_NORMAL      1
+#define OSRDIO_PRIORITY_BACKGROUND  2
+#define OSRDIO_PRIORITY_COUNT       3
+
+typedef struct _OSRDIO_WAITFOR_CHANGE_DATA {
+    ULONG   Priority;
+} OSRDIO_WAITFOR_CHANGE_DATA, *POSRDIO_WAITFOR_CHANGE_DATA;
+
 
 #define IOCTL_OSRDIO_WAITFOR_CHANGE   CTL_CODE(FILE_DEVICE_OSRDIO, 2052, METHOD_BUFFERED, FILE_ANY_ACCESS)
 
 
+
+//
+// IOCTL_OSRDIO_READ_EVENTS
+//
+// Retrieves a batch of timestamped change-of-state events.  Unlike
+// IOCTL_OSRDIO_WAITFOR_CHANGE (which returns only the most recent latched
+// state) every change detected by the ISR is recorded, in order, in a ring
+// inside the driver.  This Request completes as soon as at least one event
+// is available, returning as many events as will fit in the output buffer.
+// Events that have not yet been retrieved remain in the ring for the next
+// Request, so an application that keeps one of these Requests outstanding
+// sees a continuous stream.
+//
+// Input Buffer:
+//      (none)
+//
+// Output Buffer:
+//
+//      OSRDIO_EVENT_BATCH structure, followed by space for additional
+//      OSRDIO_EVENT structures.  Use OSRDIO_EVENT_BATCH_SIZE(n) to size a
+//      buffer for n events.  On completion, EventCount indicates the number
+//      of valid entries in Events.  Timestamps are in units of the
+//      performance counter, whose frequency (in ticks per second) is
+//      returned in TimestampFrequency.  If the driver's ring overflowed
+//      since the previous batch was returned, OSRDIO_BATCH_FLAG_OVERFLOW is
+//      set in Flags.
+//
+typedef struct _OSRDIO_EVENT {
+    ULONGLONG   Timestamp;
+    ULONG       LatchedLineState;
+    ULONG       ChangedLines;
+} OSRDIO_EVENT, *POSRDIO_EVENT;
+
+#define OSRDIO_BATCH_FLAG_OVERFLOW  0x00000001
+
+typedef struct _OSRDIO_EVENT_BATCH {
+    ULONGLONG       TimestampFrequency;
+    ULONG           Flags;
+    ULONG           EventCount;
+    OSRDIO_EVENT    Events[1];
+} OSRDIO_EVENT_BATCH, *POSRDIO_EVENT_BATCH;
+
+#define OSRDIO_EVENT_BATCH_SIZE(_count_) \
+    (FIELD_OFFSET(OSRDIO_EVENT_BATCH, Events) + ((_count_) * sizeof(OSRDIO_EVENT)))
+
+#define IOCTL_OSRDIO_READ_EVENTS   CTL_CODE(FILE_DEVICE_OSRDIO, 2053, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+//
+// IOCTL_OSRDIO_ATTACH_EVENT_RING
+//
+// Attaches an application-allocated ring to the device, into which the ISR
+// stores every change event directly.  This is for applications (such as a
+// capture recorder) that need to consume events at rates where copying
+// them through IOCTL_OSRDIO_READ_EVENTS would dominate: the application
+// reads events straight out of the ring, in place, and only needs to
+// call into the driver when the ring is empty.
+//
+// The ring is the output buffer of this Request, which is locked down and
+// mapped into the kernel's address space for as long as the Request is
+// outstanding.  This Request is NOT completed until the ring is detached,
+// which happens when the application cancels it (CancelIoEx) or closes the
+// handle it was sent on.  Only one ring can be attached to a device at a
+// time; attempts to attach another fail with STATUS_DEVICE_BUSY.
+//
+// Input Buffer:
+//      (none)
+//
+// Output Buffer:
+//
+//      OSRDIO_EVENT_RING structure, followed by space for additional
+//      OSRDIO_EVENT structures.  Use OSRDIO_EVENT_RING_BUFFER_SIZE(n) to size a
+//      buffer for n events.  The buffer should be page aligned.  The driver
+//      uses the largest power of two number of events that fit, and sets
+//      Capacity to that number.  The driver initializes the header when the
+//      ring is attached.
+//
+//      The ring is single-producer (the ISR) and single-consumer (the
+//      application).  ProducerIndex and ConsumerIndex are free-running
+//      counts of events; the event at index i is Events[i & (Capacity - 1)].
+//      The driver only writes ProducerIndex and OverflowCount, and the
+//      application only writes ConsumerIndex.  The driver stores an event
+//      before it publishes the new ProducerIndex, so an application that
+//      reads ProducerIndex (with acquire semantics) may read every event
+//      below it.  The application advances ConsumerIndex (with release
+//      semantics) once it's done with events, giving their slots back.
+//
+//      If the ring is full, the event is dropped and OverflowCount is
+//      incremented.  OverflowCount is also incremented when the hardware
+//      reports that it missed a change.  Events that are dropped from the
+//      ring are still delivered to IOCTL_OSRDIO_READ_EVENTS.
+//
+//      Each group of fields written by a different party is on its own
+//      cache line, so the producer and consumer don't contend.
+//
+typedef struct _OSRDIO_EVENT_RING {
+    ULONGLONG           TimestampFrequency;
+    ULONG               Capacity;
+    ULONG               Reserved;
+    UCHAR               Pad0[48];
+
+    volatile ULONG      ProducerIndex;
+    volatile ULONG      OverflowCount;
+    UCHAR               Pad1[56];
+
+    volatile ULONG      ConsumerIndex;
+    UCHAR               Pad2[60];
+
+    OSRDIO_EVENT        Events[1];
+} OSRDIO_EVENT_RING, *POSRDIO_EVENT_RING;
+
+#define OSRDIO_EVENT_RING_BUFFER_SIZE(_count_) \
+    (FIELD_OFFSET(OSRDIO_EVENT_RING, Events) + ((_count_) * sizeof(OSRDIO_EVENT)))
+
+#define IOCTL_OSRDIO_ATTACH_EVENT_RING  CTL_CODE(FILE_DEVICE_OSRDIO, 2054, METHOD_OUT_DIRECT, FILE_ANY_ACCESS)
+
+//
+// IOCTL_OSRDIO_WAIT_EVENT_RING
+//
+// Waits for the attached event ring to have something in it.  Completes
+// as soon as ProducerIndex differs from ConsumerIndex (which may be right
+// away).  Fails with STATUS_INVALID_DEVICE_STATE if no ring is attached.
+//
+// Input Buffer:
+//      (none)
+//
+// Output Buffer:
+//      (none)
+//
+#define IOCTL_OSRDIO_WAIT_EVENT_RING    CTL_CODE(FILE_DEVICE_OSRDIO, 2055, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+//
+// IOCTL_OSRDIO_GET_DPC_STATS
+//
+// Returns how long the driver's DpcForIsr has been taking, and (when
+// deferred processing is on) how long its worker thread takes to do the
+// DpcForIsr's work, and which processors our ISR and DpcForIsr have run on.
+//
+// Deferred processing is turned on by setting the DeferredProcessing value
+// in the device's hardware key to 1 (see the INF).  With it on, the
+// DpcForIsr only takes the lines that changed from the ISR and wakes a
+// real-time priority thread, which completes the Requests waiting for
+// events and changes.  That keeps the time we spend at DISPATCH_LEVEL
+// short (and the same however much there is to do), at the cost of a
+// thread switch before the Requests are completed.  Changes that arrive
+// while the thread is busy are processed together.
+//
+// Input Buffer:
+//      (none)
+//
+// Output Buffer:
+//      OSRDIO_DPC_STATS structure.  Times are in performance counter ticks,
+//      Frequency per second.  Histogram[0] counts the runs that took less
+//      than 1us, Histogram[n] those that took at least 2^(n-1)us and less
+//      than 2^n us, and the last bucket everything longer.  IsrCount[n]
+//      and DpcCount[n] count the ISRs and DpcForIsrs that ran on processor
+//      index n (the last entry also counts any processors beyond it).
+//      DpcProcessor is the processor the DpcForIsr is targeted to, or
+//      OSRDIO_ANY_PROCESSOR.  The counts are updated as the driver runs,
+//      so they may not quite agree with each other.
+//
+#define OSRDIO_TIMING_BUCKETS   16
+#define OSRDIO_STATS_PROCESSORS 64
+
+#define OSRDIO_ANY_PROCESSOR    0xFFFFFFFF
+
+typedef struct _OSRDIO_TIMING {
+    ULONGLONG   Count;
+    ULONGLONG   TotalTime;
+    ULONGLONG   MaxTime;
+    ULONGLONG   Histogram[OSRDIO_TIMING_BUCKETS];
+} OSRDIO_TIMING, *POSRDIO_TIMING;
+
+typedef struct _OSRDIO_DPC_STATS {
+    LONGLONG        Frequency;
+    ULONG           DeferredProcessing;
+    ULONG           DpcProcessor;
+    OSRDIO_TIMING   Dpc;
+    OSRDIO_TIMING   Worker;
+    ULONGLONG       IsrCount[OSRDIO_STATS_PROCESSORS];
+    ULONGLONG       DpcCount[OSRDIO_STATS_PROCESSORS];
+} OSRDIO_DPC_STATS, *POSRDIO_DPC_STATS;
+
+#define IOCTL_OSRDIO_GET_DPC_STATS      CTL_CODE(FILE_DEVICE_OSRDIO, 2056, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+//
+// Processor affinity
+//
+// By default, Windows decides which processors our interrupt is delivered
+// to, and our DpcForIsr runs on whichever processor our ISR ran on.  To
+// keep DIO processing away from other devices' interrupts (or on a
+// processor set aside for it), set these values in the device's hardware
+// key (see the INF).  Processors are given by their system-wide index.
+//
+//      InterruptPolicy     A WDF_INTERRUPT_POLICY: 0 for the machine
+//                          default, 1 for all processors close to the
+//                          device, 2 for one processor close to it, 3 for
+//                          all processors in the machine
+//
+//      InterruptProcessor  The one processor to deliver our interrupt to
+//                          (overrides InterruptPolicy)
+//
+//      DpcProcessor        The processor to run our DpcForIsr (and, with
+//                          deferred processing, our worker thread) on
+//
+// The interrupt settings are applied when the device is started.
+// DpcProcessor can also be changed while the device is running with
+// IOCTL_OSRDIO_SET_DPC_PROCESSOR.
+//
+
+//
+// IOCTL_OSRDIO_SET_DPC_PROCESSOR
+//
+// Targets our DpcForIsr (and worker thread) at a processor, or lets it
+// run wherever our ISR ran (OSRDIO_ANY_PROCESSOR).  Fails with
+// STATUS_INVALID_PARAMETER if there's no such processor.  The setting
+// lasts until the device is removed; to keep it, set DpcProcessor.
+//
+// It moves work for every application using the device, so it's only for
+// handles opened for writing by an administrator (an elevated process).
+// On any other handle it fails with STATUS_ACCESS_DENIED.
+//
+// Input Buffer:
+//      OSRDIO_DPC_PROCESSOR_DATA structure
+//
+// Output Buffer:
+//      (none)
+//
+typedef struct _OSRDIO_DPC_PROCESSOR_DATA {
+    ULONG   Processor;
+} OSRDIO_DPC_PROCESSOR_DATA, *POSRDIO_DPC_PROCESSOR_DATA;
+
+#define IOCTL_OSRDIO_SET_DPC_PROCESSOR  CTL_CODE(FILE_DEVICE_OSRDIO, 2057, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+
+//
+// Line profile
+//
+// The state the lines come up in when the device is started, kept in the
+// device's hardware key (see the INF), so outputs are driven to the right
+// state as soon as the device starts, without waiting for an application
+// to open it and set them.  The lines come up as inputs (hardware reset)
+// and go straight to their profile state: an output's state is written
+// before it's made an output.
+//
+//      OutputLines         The lines that are outputs
+//
+//      OutputState         The state of each of those lines
+//
+//      RisingEdges         The input lines that report a change when they
+//      FallingEdges        go from deasserted to asserted, and from
+//                          asserted to deasserted
+//
+//      FilterPort0and1     The digital filter settings for the input lines
+//      FilterPort2and3     on ports 0 and 1, and on ports 2 and 3, as
+//                          written to the device's filter registers
+//
+// The profile's output lines aren't reserved by any handle.  A handle
+// reserves them (IOCTL_OSRDIO_SET_OUTPUTS) as it would any other line,
+// except that they keep their state; when it gives them up, they go back
+// to the profile, in their profile state.  The profile is read when the
+// device is started, so a new one takes effect the next time it is.
+//
+typedef struct _OSRDIO_LINE_PROFILE {
+    ULONG   OutputLines;
+    ULONG   OutputState;
+    ULONG   RisingEdges;
+    ULONG   FallingEdges;
+    ULONG   FilterPort0and1;
+    ULONG   FilterPort2and3;
+} OSRDIO_LINE_PROFILE, *POSRDIO_LINE_PROFILE;
+
+//
+// IOCTL_OSRDIO_SAVE_PROFILE
+//
+// Saves a line profile in the device's hardware key, for the next time the
+// device is started.  Only for handles to the whole device, opened for
+// writing by an administrator (an elevated process); on any other handle
+// it fails with STATUS_ACCESS_DENIED.
+//
+// Input Buffer:
+//      OSRDIO_LINE_PROFILE structure
+//
+// Output Buffer:
+//      (none)
+//
+#define IOCTL_OSRDIO_SAVE_PROFILE       CTL_CODE(FILE_DEVICE_OSRDIO, 2058, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+
+//
+// IOCTL_OSRDIO_APPLY_PROFILE
+//
+// Reconfigures the lines, in one Request, as a line profile says: the
+// profile's output lines become the lines this handle reserves (as with
+// IOCTL_OSRDIO_SET_OUTPUTS, so it fails with STATUS_SHARING_VIOLATION if
+// another handle has any of them), they're set to its output state, and
+// its edges and filters become the device's.  Only the registers whose
+// values change are written, and our ISR sees the device either as it was
+// or as the profile says, never in between.  Only for handles to the whole
+// device, opened for writing (on others it fails with
+// STATUS_ACCESS_DENIED).
+//
+// The edges and filters last until the device is next started, when those
+// of the saved profile (see IOCTL_OSRDIO_SAVE_PROFILE) are used again.
+//
+// Input Buffer:
+//      OSRDIO_LINE_PROFILE structure
+//
+// Output Buffer:
+//      (none)
+//
+#define IOCTL_OSRDIO_APPLY_PROFILE      CTL_CODE(FILE_DEVICE_OSRDIO, 2059, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+
+//
+// IOCTL_OSRDIO_GET_REGISTER_PROFILE
+//
+// Returns how many times the driver has read and written each of the
+// device's registers, and how long those accesses took, broken down by the
+// code that made them:
+//
+//      OSRDIO_REGISTER_PATH_ISR    Our ISR
+//      OSRDIO_REGISTER_PATH_DPC    Our DpcForIsr and worker thread
+//      OSRDIO_REGISTER_PATH_IOCTL  Processing Requests (including closing
+//                                  a handle)
+//      OSRDIO_REGISTER_PATH_POWER  Starting the device and moving it in
+//                                  and out of D0
+//
+// Runs[n] is the number of times path n has run, so Reads / Runs is the
+// number of register reads per interrupt, per Request, and so on.  A
+// device register access has to cross the bus (a read waits for the
+// device to answer), so these are usually what our ISR spends its time on.
+//
+// Profiling is built into checked (DBG) builds of the driver, or any build
+// with OSRDIO_REGISTER_PROFILING defined to 1.  Other builds fail this
+// Request with STATUS_NOT_SUPPORTED, and access the registers directly.
+//
+// Input Buffer:
+//      (none)
+//
+// Output Buffer:
+//      OSRDIO_REGISTER_PROFILE structure.  Offset[n] is the offset (in the
+//      device's BAR) of the register that Accesses[n] counts accesses to,
+//      for the first RegisterCount entries.  Times are in performance
+//      counter ticks, Frequency per second, and include the time taken to
+//      read the performance counter.  The counts are updated as the driver
+//      runs, so they may not quite agree with each other.
+//
+#define OSRDIO_REGISTER_PATH_ISR    0
+#define OSRDIO_REGISTER_PATH_DPC    1
+#define OSRDIO_REGISTER_PATH_IOCTL  2
+#define OSRDIO_REGISTER_PATH_POWER  3
+#define OSRDIO_REGISTER_PATHS       4
+
+#define OSRDIO_PROFILE_REGISTERS    24
+
+typedef struct _OSRDIO_REGISTER_ACCESSES {
+    ULONGLONG   Reads;
+    ULONGLONG   Writes;
+    ULONGLONG   ReadTime;
+    ULONGLONG   WriteTime;
+} OSRDIO_REGISTER_ACCESSES, *POSRDIO_REGISTER_ACCESSES;
+
+typedef struct _OSRDIO_REGISTER_PROFILE {
+    LONGLONG                    Frequency;
+    ULONG                       RegisterCount;
+    ULONG                       Offset[OSRDIO_PROFILE_REGISTERS];
+    ULONGLONG                   Runs[OSRDIO_REGISTER_PATHS];
+    OSRDIO_REGISTER_ACCESSES    Accesses[OSRDIO_PROFILE_REGISTERS][OSRDIO_REGISTER_PATHS];
+} OSRDIO_REGISTER_PROFILE, *POSRDIO_REGISTER_PROFILE;
+
+#define IOCTL_OSRDIO_GET_REGISTER_PROFILE   CTL_CODE(FILE_DEVICE_OSRDIO, 2060, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+//
+// IOCTL_OSRDIO_GET_REGISTER_TRACE
+//
+// Returns the driver's latest register accesses, in the order they were
+// made, so that the exact sequence of reads and writes around a problem
+// seen on the hardware can be replayed against the simulator (DioTest
+// saves it as a register trace file, see DioRegisterTrace.h).
+//
+// The driver starts the trace when it starts the device, just before it
+// resets it, and keeps the latest OSRDIO_REGISTER_TRACE_ENTRIES entries:
+// one for each register access, and one for each change of the device's
+// power state (at D0Entry and D0Exit).  Recorded is the number of entries
+// since the device was started.  If that's more than EntryCount, the
+// oldest have been lost, and the trace starts part way through.
+//
+// As with the register profile, only builds that profile register
+// accesses keep the trace.  Other builds fail this Request with
+// STATUS_NOT_SUPPORTED.
+//
+// Input Buffer:
+//      (none)
+//
+// Output Buffer:
+//      OSRDIO_REGISTER_TRACE structure, returned up to the end of its
+//      last entry.  Entries are oldest first.  Register is the entry's
+//      register, as an index into Offset (as in OSRDIO_REGISTER_PROFILE),
+//      Kind is OSRDIO_TRACE_xxx, and Path is the OSRDIO_REGISTER_PATH_xxx
+//      of the code that made the access.  A power entry's Value is
+//      OSRDIO_TRACE_D0 or the D3 state it's for.  Times are in performance
+//      counter ticks (Frequency per second) since the trace started, and
+//      are when each access began.  The trace is copied while the driver
+//      goes on adding to it, so on a busy device some entries may be
+//      overwritten as it's copied.  Those (and any being written just
+//      then) are left out, so EntryCount can be less than both Recorded
+//      and OSRDIO_REGISTER_TRACE_ENTRIES, but no entry is ever torn.
+//
+// The kinds and power states have the same values as the
+// DIO_REGISTER_TRACE_xxx ones of register trace files.
+//
+#define OSRDIO_REGISTER_TRACE_ENTRIES   4096
+
+#define OSRDIO_TRACE_READ       0
+#define OSRDIO_TRACE_WRITE      1
+#define OSRDIO_TRACE_POWER      3
+
+#define OSRDIO_TRACE_D0         0x000
+#define OSRDIO_TRACE_D3         0x003
+#define OSRDIO_TRACE_D3_WAKE    0x103
+
+typedef struct _OSRDIO_REGISTER_TRACE_ENTRY {
+    ULONGLONG   Time;
+    ULONG       Value;
+    UCHAR       Register;
+    UCHAR       Kind;
+    UCHAR       Path;
+    UCHAR       Reserved;
+} OSRDIO_REGISTER_TRACE_ENTRY, *POSRDIO_REGISTER_TRACE_ENTRY;
+
+typedef struct _OSRDIO_REGISTER_TRACE {
+    LONGLONG                    Frequency;
+    ULONG                       RegisterCount;
+    ULONG                       Offset[OSRDIO_PROFILE_REGISTERS];
+    ULONGLONG                   Recorded;
+    ULONG                       EntryCount;
+    OSRDIO_REGISTER_TRACE_ENTRY Entries[OSRDIO_REGISTER_TRACE_ENTRIES];
+} OSRDIO_REGISTER_TRACE, *POSRDIO_REGISTER_TRACE;
+
+#define IOCTL_OSRDIO_GET_REGISTER_TRACE     CTL_CODE(FILE_DEVICE_OSRDIO, 2061, METHOD_BUFFERED, FILE_ANY_ACCESS)
@@ -202,16 +202,44 @@ OsrDioEvtDriverDeviceAdd(WDFDRIVER       Driver,
 {
     NTSTATUS                              status;
     WDF_PNPPOWER_EVENT_CALLBACKS          pnpPowerCallbacks;
+    WDF_POWER_POLICY_EVENT_CALLBACKS      powerPolicyCallbacks;
     WDF_OBJECT_ATTRIBUTES                 objAttributes;
+    WDF_FILEOBJECT_CONFIG                 fileConfig;
+    WDF_OBJECT_ATTRIBUTES                 fileAttributes;
     WDFDEVICE                             device;
     POSRDIO_DEVICE_CONTEXT                devContext;
     WDF_IO_QUEUE_CONFIG                   queueConfig;
     WDF_INTERRUPT_CONFIG                  interruptConfig;
+    WDF_WORKITEM_CONFIG                   workItemConfig;
+    WDF_OBJECT_ATTRIBUTES                 workItemAttributes;
     WDF_DEVICE_POWER_POLICY_IDLE_SETTINGS idleSettings;
+    WDFKEY                                parametersKey;
+    ULONG                                 interruptPolicy;
+    ULONG                                 interruptProcessor;
+    ULONG                                 dpcProcessor;
+    WDF_DPC_CONFIG                        dpcConfig;
+    WDF_TRI_STATE                         waitQueuesPowerManaged;
+    WDF_OBJECT_ATTRIBUTES                 dpcAttributes;
+    WDF_OBJECT_ATTRIBUTES                 lockAttributes;
 
 #pragma warning(suppress: 26485)   // "No array to pointer decay"
     DECLARE_CONST_UNICODE_STRING(dosDeviceName,
                                  LR"(\DosDevices\OSRDIO)");
+#pragma warning(suppress: 26485)
+    DECLARE_CONST_UNICODE_STRING(deferredProcessingName,
+                                 L"DeferredProcessing");
+#pragma warning(suppress: 26485)
+    DECLARE_CONST_UNICODE_STRING(wakeOnChangeName,
+                                 L"WakeOnChange");
+#pragma warning(suppress: 26485)
+    DECLARE_CONST_UNICODE_STRING(interruptPolicyName,
+                                 L"InterruptPolicy");
+#pragma warning(suppress: 26485)
+    DECLARE_CONST_UNICODE_STRING(interruptProcessorName,
+                                 L"InterruptProcessor");
+#pragma warning(suppress: 26485)
+    DECLARE_CONST_UNICODE_STRING(dpcProcessorName,
+                                 L"DpcProcessor");
 
     UNREFERENCED_PARAMETER(Driver);
 
@@ -260,6 +288,39 @@ OsrDioEvtDriverDeviceAdd(WDFDRIVER       Driver,
     WdfDeviceInitSetPnpPowerEventCallbacks(DeviceInit,
                                            &pnpPowerCallbacks);
 
+    //
+    // If our device is allowed to wake itself when an input changes (see
+    // WakeOnChange, below), WDF calls these to arm it to do that before
+    // it idles, and to disarm it when it's back in D0.
+    //
+    WDF_POWER_POLICY_EVENT_CALLBACKS_INIT(&powerPolicyCallbacks);
+
+    powerPolicyCallbacks.EvtDeviceArmWakeFromS0    = OsrDioEvtDeviceArmWakeFromS0;
+    powerPolicyCallbacks.EvtDeviceDisarmWakeFromS0 = OsrDioEvtDeviceDisarmWakeFromS0;
+    powerPolicyCallbacks.EvtDeviceWakeFromS0Triggered = OsrDioEvtDeviceWakeFromS0Triggered;
+
+    WdfDeviceInitSetPowerPolicyEventCallbacks(DeviceInit,
+                                              &powerPolicyCallbacks);
+
+    //
+    // Each handle (WDFFILEOBJECT) keeps track of the port it was opened on
+    // and the output lines it has reserved, in its own context, and gives
+    // the lines back when it's closed.  Cleanup (rather than Close) is
+    // called when the last user handle is closed, even if there are still
+    // Requests in progress on it.
+    //
+    WDF_FILEOBJECT_CONFIG_INIT(&fileConfig,
+                               OsrDioEvtDeviceFileCreate,
+                               WDF_NO_EVENT_CALLBACK,
+                               OsrDioEvtFileCleanup);
+
+    WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&fileAttributes,
+                                            OSRDIO_FILE_CONTEXT);
+
+    WdfDeviceInitSetFileObjectConfig(DeviceInit,
+                                     &fileConfig,
+                                     &fileAttributes);
+
     //
     // And now instantiate the WDFDEVICE Object.
     //
@@ -323,59 +384,350 @@ OsrDioEvtDriverDeviceAdd(WDFDRIVER       Driver,
 
     devContext->WdfDevice = device;
 
+    //
+    // Our settings are in our device's hardware key, where our INF puts
+    // them.  Any that aren't there get their defaults.
+    //
+    status = WdfDeviceOpenRegistryKey(device,
+                                      PLUGPLAY_REGKEY_DEVICE,
+                                      KEY_READ,
+                                      WDF_NO_OBJECT_ATTRIBUTES,
+                                      &parametersKey);
+
+    if (!NT_SUCCESS(status)) {
+#if DBG
+        DbgPrint("WdfDeviceOpenRegistryKey failed 0x%0x, using defaults\n",
+                 status);
+#endif
+        parametersKey = nullptr;
+    }
+
+    //
+    // Is our DpcForIsr's work to be done by a worker thread?
+    //
+    KeInitializeEvent(&devContext->WorkerEvent,
+                      SynchronizationEvent,
+                      FALSE);
+
+    devContext->DeferredProcessing =
+        DioUtilQueryParameter(parametersKey,
+                              &deferredProcessingName,
+                              0) != 0;
+
+    devContext->DpcStats.DeferredProcessing = devContext->DeferredProcessing;
+
+#if DBG
+    DbgPrint("Deferred processing is %s\n",
+             devContext->DeferredProcessing ? "ON" : "OFF");
+#endif
+
+    //
+    // Can our device wake itself from idle when an input changes?  We have
+    // nothing from NI that says the PCIe-6509's change detection raises
+    // PME in D3, so we don't assume it does: it's off unless the
+    // WakeOnChange value turns it on, and even then we check that it works
+    // (see OsrDioEvtDeviceArmWakeFromS0).
+    //
+    devContext->WakeOnChange =
+        DioUtilQueryParameter(parametersKey,
+                              &wakeOnChangeName,
+                              0) != 0;
+
+    //
+    // Requests on power-managed Queues keep our device in D0.  When it
+    // can't wake itself, that's what we want for Requests waiting for a
+    // change (or for change events), because our device can't see changes
+    // in D3.  When it can, we let it idle while they wait.
+    //
+    waitQueuesPowerManaged = devContext->WakeOnChange ? WdfFalse : WdfUseDefault;
+
+    //
+    // And where do our interrupt and DpcForIsr go?
+    //
+    interruptPolicy = DioUtilQueryParameter(parametersKey,
+                                            &interruptPolicyName,
+                                            0);
+
+    interruptProcessor = DioUtilQueryParameter(parametersKey,
+                                               &interruptProcessorName,
+                                               OSRDIO_ANY_PROCESSOR);
+
+    dpcProcessor = DioUtilQueryParameter(parametersKey,
+                                         &dpcProcessorName,
+                                         OSRDIO_ANY_PROCESSOR);
+
+    if (parametersKey != nullptr) {
+
+        WdfRegistryClose(parametersKey);
+    }
+
     //
     // Configure a queue to handle incoming requests
     //
-    // We use a single, default, queue for receiving Requests, and we only
-    // support IRP_MJ_DEVICE_CONTROL.
+    // We use a default queue for receiving Requests, and we only support
+    // IRP_MJ_DEVICE_CONTROL.  All it does is send each Request on to the
+    // Queue for the handle's port (or for the whole device), so it can
+    // dispatch Requests in parallel.
     //
 
     //
     // We don't have Object Attributes for our Queue that we need to specify
     //
+    WDF_IO_QUEUE_CONFIG_INIT_DEFAULT_QUEUE(&queueConfig,
+                                           WdfIoQueueDispatchParallel);
+
+    queueConfig.EvtIoDeviceControl = OsrDioEvtIoDispatchToQueue;
+
+    status = WdfIoQueueCreate(device,
+                              &queueConfig,
+                              WDF_NO_OBJECT_ATTRIBUTES,
+                              WDF_NO_HANDLE);
+
+    if (!NT_SUCCESS(status)) {
+#if DBG
+        DbgPrint("WdfIoQueueCreate for default queue failed 0x%0x\n",
+                 status);
+#endif
+        goto done;
+    }
 
+    //
+    // The Queues that actually process Requests: one for handles to the
+    // whole device, and one for each port.
     //
     // With Sequential Dispatching, we will only get one request at a time
-    // from our Queue.
+    // from each Queue.
     // 
-    WDF_IO_QUEUE_CONFIG_INIT_DEFAULT_QUEUE(&queueConfig,
-                                           WdfIoQueueDispatchSequential);
+    WDF_IO_QUEUE_CONFIG_INIT(&queueConfig,
+                             WdfIoQueueDispatchSequential);
 
     queueConfig.EvtIoDeviceControl = OsrDioEvtIoDeviceControl;
 
     status = WdfIoQueueCreate(device,
                               &queueConfig,
                               WDF_NO_OBJECT_ATTRIBUTES,
-                              WDF_NO_HANDLE);
+                              &devContext->DeviceQueue);
 
     if (!NT_SUCCESS(status)) {
 #if DBG
-        DbgPrint("WdfIoQueueCreate for default queue failed 0x%0x\n",
+        DbgPrint("WdfIoQueueCreate for device queue failed 0x%0x\n",
+                 status);
+#endif
+        goto done;
+    }
+
+    for (ULONG port = 0; port < OSRDIO_PORT_COUNT; port++) {
+
+        status = WdfIoQueueCreate(device,
+                                  &queueConfig,
+                                  WDF_NO_OBJECT_ATTRIBUTES,
+                                  &devContext->PortQueue[port]);
+
+        if (!NT_SUCCESS(status)) {
+#if DBG
+            DbgPrint("WdfIoQueueCreate for port %lu queue failed 0x%0x\n",
+                     port,
+                     status);
+#endif
+            goto done;
+        }
+    }
+
+    //
+    // We also create manual Queues to hold Requests that are waiting for
+    // a state change to happen on one of the input lines: one for each
+    // priority class...
+    //
+    WDF_IO_QUEUE_CONFIG_INIT(&queueConfig,
+                             WdfIoQueueDispatchManual);
+
+    queueConfig.PowerManaged = waitQueuesPowerManaged;
+
+    for (ULONG priority = 0; priority < OSRDIO_PRIORITY_COUNT; priority++) {
+
+        status = WdfIoQueueCreate(devContext->WdfDevice,
+                                  &queueConfig,
+                                  WDF_NO_OBJECT_ATTRIBUTES,
+                                  &devContext->PendingQueue[priority]);
+
+        if (!NT_SUCCESS(status)) {
+
+            DbgPrint("WdfIoQueueCreate for Rx Queue failed 0x%0x\n",
+                     status);
+
+            goto done;
+        }
+
+        //
+        // ...and one for each class on each port, for Requests waiting for
+        // a state change on one of the port's input lines
+        //
+        for (ULONG port = 0; port < OSRDIO_PORT_COUNT; port++) {
+
+            status = WdfIoQueueCreate(devContext->WdfDevice,
+                                      &queueConfig,
+                                      WDF_NO_OBJECT_ATTRIBUTES,
+                                      &devContext->PortPendingQueue[port][priority]);
+
+            if (!NT_SUCCESS(status)) {
+#if DBG
+                DbgPrint("WdfIoQueueCreate for port %lu pending queue failed 0x%0x\n",
+                         port,
+                         status);
+#endif
+                goto done;
+            }
+        }
+    }
+
+    //
+    // Background Requests are completed by a work item, at PASSIVE_LEVEL,
+    // after the DpcForIsr has completed the others.  Its parent is our
+    // WDFDEVICE, so WDF waits for it to finish before the device goes away.
+    //
+    WDF_WORKITEM_CONFIG_INIT(&workItemConfig,
+                             OsrDioEvtBackgroundWorkItem);
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&workItemAttributes);
+
+    workItemAttributes.ParentObject = device;
+
+    status = WdfWorkItemCreate(&workItemConfig,
+                               &workItemAttributes,
+                               &devContext->BackgroundWorkItem);
+
+    if (!NT_SUCCESS(status)) {
+#if DBG
+        DbgPrint("WdfWorkItemCreate failed 0x%0x\n",
+                 status);
+#endif
+        goto done;
+    }
+
+    //
+    // And another manual Queue to hold IOCTL_OSRDIO_READ_EVENTS Requests
+    // until there are timestamped change events to return to them.
+    //
+    WDF_IO_QUEUE_CONFIG_INIT(&queueConfig,
+                             WdfIoQueueDispatchManual);
+
+    queueConfig.PowerManaged = waitQueuesPowerManaged;
+
+    status = WdfIoQueueCreate(devContext->WdfDevice,
+                              &queueConfig,
+                              WDF_NO_OBJECT_ATTRIBUTES,
+                              &devContext->EventQueue);
+
+    if (!NT_SUCCESS(status)) {
+#if DBG
+        DbgPrint("WdfIoQueueCreate for Event Queue failed 0x%0x\n",
+                 status);
+#endif
+        goto done;
+    }
+
+    //
+    // A manual Queue to hold the IOCTL_OSRDIO_ATTACH_EVENT_RING Request for
+    // as long as the application's ring is attached.  We need to know when
+    // that Request is canceled, so we can stop using the ring.
+    //
+    WDF_IO_QUEUE_CONFIG_INIT(&queueConfig,
+                             WdfIoQueueDispatchManual);
+
+    queueConfig.EvtIoCanceledOnQueue = OsrDioEvtRingCanceledOnQueue;
+    queueConfig.PowerManaged         = waitQueuesPowerManaged;
+
+    status = WdfIoQueueCreate(devContext->WdfDevice,
+                              &queueConfig,
+                              WDF_NO_OBJECT_ATTRIBUTES,
+                              &devContext->RingQueue);
+
+    if (!NT_SUCCESS(status)) {
+#if DBG
+        DbgPrint("WdfIoQueueCreate for Ring Queue failed 0x%0x\n",
                  status);
 #endif
         goto done;
     }
 
     //
-    // We also create a manual Queue to hold Requests that are waiting for
-    // a state change to happen on one of the input lines.
+    // And one more for IOCTL_OSRDIO_WAIT_EVENT_RING Requests, which wait
+    // for the application's ring to have events in it.
     //
     WDF_IO_QUEUE_CONFIG_INIT(&queueConfig,
                              WdfIoQueueDispatchManual);
 
+    queueConfig.PowerManaged = waitQueuesPowerManaged;
+
     status = WdfIoQueueCreate(devContext->WdfDevice,
                               &queueConfig,
                               WDF_NO_OBJECT_ATTRIBUTES,
-                              &devContext->PendingQueue);
+                              &devContext->RingWaitQueue);
 
     if (!NT_SUCCESS(status)) {
+#if DBG
+        DbgPrint("WdfIoQueueCreate for Ring Wait Queue failed 0x%0x\n",
+                 status);
+#endif
+        goto done;
+    }
+
+    //
+    // The event ring can be drained both from our (sequential) default
+    // Queue and from our DpcForIsr, so we serialize its consumers with a
+    // spin lock.  Like our Queues, our locks are parented to our
+    // WDFDEVICE, so they go away with it instead of accumulating on the
+    // WDFDRIVER each time a device is removed.
+    //
+    WDF_OBJECT_ATTRIBUTES_INIT(&lockAttributes);
+
+    lockAttributes.ParentObject = device;
 
-        DbgPrint("WdfIoQueueCreate for Rx Queue failed 0x%0x\n",
+    status = WdfSpinLockCreate(&lockAttributes,
+                               &devContext->EventLock);
+
+    if (!NT_SUCCESS(status)) {
+#if DBG
+        DbgPrint("WdfSpinLockCreate for Event Lock failed 0x%0x\n",
                  status);
+#endif
+        goto done;
+    }
+
+    //
+    // Output line reservations can change when a handle is closed, at the
+    // same time as we're processing a Request from our default Queue, so
+    // we serialize changes to them (and to the output registers) with
+    // another spin lock.
+    //
+    status = WdfSpinLockCreate(&lockAttributes,
+                               &devContext->OutputLock);
 
+    if (!NT_SUCCESS(status)) {
+#if DBG
+        DbgPrint("WdfSpinLockCreate for Output Lock failed 0x%0x\n",
+                 status);
+#endif
         goto done;
     }
 
+    //
+    // Event timestamps are performance counter values taken in our ISR.
+    // Remember the counter frequency so we can give it to our users.
+    //
+    (void)KeQueryPerformanceCounter(&devContext->TimestampFrequency);
+
+    devContext->DpcStats.Frequency = devContext->TimestampFrequency.QuadPart;
+
+#if OSRDIO_REGISTER_PROFILING
+    devContext->RegisterProfile.Frequency     = devContext->TimestampFrequency.QuadPart;
+    devContext->RegisterProfile.RegisterCount = DIO_REGISTER_COUNT;
+
+    for (ULONG i = 0; i < DIO_REGISTER_COUNT; i++) {
+        devContext->RegisterProfile.Offset[i] = DioRegisterOffsets[i];
+    }
+#endif
+
     //
     // Create an interrupt object that will later be associated with the
     // device's interrupt resource and connected by the Framework to our ISR.
@@ -408,6 +760,51 @@ OsrDioEvtDriverDeviceAdd(WDFDRIVER       Driver,
         goto done;
     }
 
+    //
+    // Tell WDF which processors we'd like our interrupt delivered to.  It
+    // asks the PnP Manager for them when our resources are assigned.
+    //
+    DioUtilSetInterruptPolicy(devContext,
+                              interruptPolicy,
+                              interruptProcessor);
+
+    //
+    // And create the DPC we queue instead of our DpcForIsr when we want it
+    // to run on a particular processor.  WDF doesn't let us target the
+    // DpcForIsr itself.
+    //
+    WDF_DPC_CONFIG_INIT(&dpcConfig,
+                        OsrDioEvtTargetedDpc);
+
+    dpcConfig.AutomaticSerialization = FALSE;
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&dpcAttributes);
+
+    dpcAttributes.ParentObject = device;
+
+    status = WdfDpcCreate(&dpcConfig,
+                          &dpcAttributes,
+                          &devContext->TargetedDpc);
+
+    if (!NT_SUCCESS(status)) {
+#if DBG
+        DbgPrint("WdfDpcCreate failed 0x%0x\n",
+                 status);
+#endif
+        goto done;
+    }
+
+    devContext->DpcProcessor = OSRDIO_ANY_PROCESSOR;
+
+    if (dpcProcessor != OSRDIO_ANY_PROCESSOR) {
+
+        //
+        // A bad setting isn't worth failing to start over
+        //
+        (void)DioCoreSetDpcProcessor(devContext,
+                                     dpcProcessor);
+    }
+
     //
     // Initialize our idle policy
     //
@@ -416,15 +813,28 @@ OsrDioEvtDriverDeviceAdd(WDFDRIVER       Driver,
     // admin users to specify whether our device should idle in low-power
     // state.
     //
+    // Unless WakeOnChange is set, our device can't wake itself.  If it is,
+    // a change on an input line wakes it (see OsrDioEvtDeviceArmWakeFromS0),
+    // and we don't let the user turn that off: if they could, changes that
+    // happen while we're idle would be lost.
+    //
     WDF_DEVICE_POWER_POLICY_IDLE_SETTINGS_INIT(&idleSettings,
-                                               IdleCannotWakeFromS0);
+                                               devContext->WakeOnChange ?
+                                                   IdleCanWakeFromS0 :
+                                                   IdleCannotWakeFromS0);
+
+    if (devContext->WakeOnChange) {
+
+        idleSettings.UserControlOfWakeSettings = WakeDoNotAllowUserControl;
+    }
 
     //
     // After 10 seconds of no activity, declare our device idle
     // Note that "idle" in this context means that the driver does not have
     // any Requests in progress.  So, while we have a Request on the
     // PendingQueue (waiting to be informed of a line state change), WDF
-    // will *not* idle the device. Recall that a device can always be
+    // will *not* idle the device (unless WakeOnChange is set, when the
+    // PendingQueue isn't power-managed). Recall that a device can always be
     // made to enter into, and remain in, D0-Working by calling
     // WdfDeviceStopIdle.
     //
@@ -433,6 +843,30 @@ OsrDioEvtDriverDeviceAdd(WDFDRIVER       Driver,
     status = WdfDeviceAssignS0IdleSettings(device,
                                            &idleSettings);
 
+    if (!NT_SUCCESS(status) && devContext->WakeOnChange) {
+
+        //
+        // Our bus says our device can't wake from the state it idles in
+        // (it has no PME support there).  The Requests that wait for
+        // changes are on Queues that aren't power-managed, so they
+        // wouldn't keep our device in D0, and changes would be lost while
+        // it idled.  Rather than lose them, we don't idle at all.
+        //
+#if DBG
+        DbgPrint("Can't idle with wake (0x%0x), not idling\n",
+                 status);
+#endif
+        devContext->WakeOnChange = FALSE;
+
+        WDF_DEVICE_POWER_POLICY_IDLE_SETTINGS_INIT(&idleSettings,
+                                                   IdleCannotWakeFromS0);
+
+        idleSettings.Enabled = WdfFalse;
+
+        status = WdfDeviceAssignS0IdleSettings(device,
+                                               &idleSettings);
+    }
+
     if (!NT_SUCCESS(status)) {
 #if DBG
         DbgPrint("WdfDeviceAssignS0IdleSettings failed 0x%0x\n",
@@ -606,22 +1040,39 @@ OsrDioEvtDevicePrepareHardware(WDFDEVICE    Device,
     }
 
     //
-    // We initialize all Digital I/O lines as inputs.
-    // That means there are NO lines are curerntly set to be used for
-    // output.
+    // The lines come up as our line profile (if there is one) says, and
+    // D0Entry puts the output lines in its state
     //
-    devContext->OutputLineMask = 0;
+    DioUtilLoadProfile(devContext);
+
+    DioCoreStartLines(devContext);
+
+    DioUtilProfileRun(devContext,
+                      OSRDIO_REGISTER_PATH_POWER);
 
     //
-    // And when we power-on, we want the output lines to initially
-    // all be DE-ASSERTED
+    // The register trace starts with the device's reset, so it can be
+    // replayed from a known state
     //
-    devContext->SavedOutputLineState = 0;
+    DioUtilTraceStart(devContext);
 
     //
     // Put the device is a known state, with all interrupts disabled
     //
-    DioUtilDeviceReset(devContext);
+    DioCoreDeviceReset(devContext);
+
+    //
+    // If our DpcForIsr's work is deferred, start the thread that does it
+    // before our interrupt can be connected
+    //
+    if (devContext->DeferredProcessing) {
+
+        status = DioUtilStartWorker(devContext);
+
+        if (!NT_SUCCESS(status)) {
+            goto done;
+        }
+    }
 
     status = STATUS_SUCCESS;
 
@@ -656,6 +1107,12 @@ OsrDioEvtDeviceReleaseHardware(WDFDEVICE    Device,
 
     devContext = OsrDioGetContextFromDevice(Device);
 
+    //
+    // Our interrupt has been disconnected (and our DpcForIsr has finished)
+    // so there's nothing more for the worker thread to do
+    //
+    DioUtilStopWorker(devContext);
+
     if (devContext->DevBase != nullptr) {
 
         MmUnmapIoSpace(devContext->DevBase,
@@ -707,12 +1164,17 @@ OsrDioEvtDeviceD0Entry(WDFDEVICE              Device,
 
     devContext = OsrDioGetContextFromDevice(Device);
 
+    DioUtilProfileRun(devContext,
+                      OSRDIO_REGISTER_PATH_POWER);
+
+    DioUtilTracePower(devContext,
+                      OSRDIO_TRACE_D0);
+
 #if DBG
     DbgPrint("Restoring Output Line state = 0x%08x\n",
              devContext->SavedOutputLineState);
 #endif
-    WRITE_REGISTER_ULONG(&devContext->DevBase->Static_Digital_Output_Register,
-                         devContext->SavedOutputLineState);
+    DioCoreD0Entry(devContext);
 
     return STATUS_SUCCESS;
 }
@@ -736,7 +1198,6 @@ OsrDioEvtDeviceD0Exit(WDFDEVICE              Device,
                       WDF_POWER_DEVICE_STATE TargetState)
 {
     POSRDIO_DEVICE_CONTEXT devContext;
-    ULONG                  outputLineState;
 
 #if DBG
     DbgPrint("D0Exit...\n");
@@ -746,76 +1207,295 @@ OsrDioEvtDeviceD0Exit(WDFDEVICE              Device,
 
     devContext = OsrDioGetContextFromDevice(Device);
 
-    outputLineState =
-        READ_REGISTER_ULONG(&devContext->DevBase->Static_Digital_Input_Register);
+    DioUtilProfileRun(devContext,
+                      OSRDIO_REGISTER_PATH_POWER);
 
-    outputLineState &= devContext->OutputLineMask;
-
-    devContext->SavedOutputLineState = outputLineState;
+    DioCoreD0Exit(devContext);
 
 #if DBG
     DbgPrint("Saved Output Line state = 0x%08x\n",
              devContext->SavedOutputLineState);
 #endif
 
+    DioUtilTracePower(devContext,
+                      devContext->WakeArmed ? OSRDIO_TRACE_D3_WAKE : OSRDIO_TRACE_D3);
+
     return STATUS_SUCCESS;
 }
 
 //
-// OsrDioEvtInterruptEnable
+// OsrDioEvtDeviceArmWakeFromS0
 //
-// Called by WDF to ask us to enable hardware interrupts on our device.
+// Called (only if WakeOnChange is set) before our device idles in D3,
+// while it's still in D0.  A change on an input line is our wake signal,
+// so there's nothing to program here: we just note that we're armed, so
+// that EvtInterruptDisable leaves change detection running.  The bus driver
+// arms the wake signal itself (PME) on our device.
+//
+// Nothing we have says a change really does raise PME on the PCIe-6509,
+// so we check.  If, the last time we idled, a change was caught but our
+// device didn't signal the wake (we were woken for some other reason, and
+// found the change waiting), then a change can't wake it.  From then on we
+// refuse to arm, so WDF keeps our device in D0, and changes are seen as
+// they happen.  (A change that arrives as we're already waking can look
+// the same, and turn wake off needlessly; that costs power, not changes.)
 //
 // INPUTS:
-//  Interrupt           Handle to our WDFINTERRUPT object
-//  Device              the usual
+//  Device          Handle to our WDFDEVICE
 //
 NTSTATUS
-OsrDioEvtInterruptEnable(WDFINTERRUPT Interrupt,
-                         WDFDEVICE    Device)
+OsrDioEvtDeviceArmWakeFromS0(WDFDEVICE Device)
 {
     POSRDIO_DEVICE_CONTEXT devContext;
 
 #if DBG
-    DbgPrint("EvtInterruptEnable\n");
+    DbgPrint("ArmWakeFromS0...\n");
 #endif
 
-    UNREFERENCED_PARAMETER(Interrupt);
-
     devContext = OsrDioGetContextFromDevice(Device);
 
-    //
-    // Set the device's interrupt logic to a known state, ACK'ing any
-    // outstanding interrupts and ensuring no interrupts are enabled.
-    //
-    DioUtilResetDeviceInterrupts(devContext);
-
-    //
-    // And enable interrupts from the Digital Inputs, from State Changes,
-    // and from the card to the host.
-    //
-    DioUtilEnableDeviceInterrupts(devContext);
+    if (!DioCoreArmWake(devContext)) {
 
-    //
-    // Tell the device that we're interested in getting an interrupt when
-    // the state of any of the input lines changes.
-    //
-    DioUtilProgramLineDirectionAndChangeMasks(devContext);
+#if DBG
+        DbgPrint("Not armed to wake, staying in D0\n");
+#endif
+        return STATUS_NOT_SUPPORTED;
+    }
 
     return STATUS_SUCCESS;
 }
 
 //
-// OsrDioEvtInterruptDisable
+// OsrDioEvtDeviceWakeFromS0Triggered
 //
-// Called by WDF to ask us to DISABLE interrupt on our device.
+// Called when our device signalled a wake while idling armed.  Noted for
+// OsrDioEvtDeviceArmWakeFromS0's check.
 //
 // INPUTS:
-//  Interrupt       Handle to our WDFINTERRUPT object
-//  Device          the usual
+//  Device          Handle to our WDFDEVICE
 //
-NTSTATUS
-OsrDioEvtInterruptDisable(WDFINTERRUPT Interrupt,
+VOID
+OsrDioEvtDeviceWakeFromS0Triggered(WDFDEVICE Device)
+{
+    POSRDIO_DEVICE_CONTEXT devContext;
+
+#if DBG
+    DbgPrint("WakeFromS0Triggered...\n");
+#endif
+
+    devContext = OsrDioGetContextFromDevice(Device);
+
+    DioCoreWakeTriggered(devContext);
+}
+
+//
+// OsrDioEvtDeviceDisarmWakeFromS0
+//
+// Called when our device is back in D0 after idling armed to wake.
+//
+// INPUTS:
+//  Device          Handle to our WDFDEVICE
+//
+VOID
+OsrDioEvtDeviceDisarmWakeFromS0(WDFDEVICE Device)
+{
+    POSRDIO_DEVICE_CONTEXT devContext;
+
+#if DBG
+    DbgPrint("DisarmWakeFromS0...\n");
+#endif
+
+    devContext = OsrDioGetContextFromDevice(Device);
+
+    DioCoreDisarmWake(devContext);
+}
+
+//
+// OsrDioEvtDeviceFileCreate
+//
+// Called when a handle to our device is opened.  If the user opened one of
+// our ports (by putting the port's name after the device's name) we
+// remember which; otherwise the handle is for the whole device.
+//
+// INPUTS:
+//  Device          Handle to our WDFDEVICE
+//  Request         The create Request, which we complete
+//  FileObject      Handle to the WDFFILEOBJECT being created
+//
+VOID
+OsrDioEvtDeviceFileCreate(WDFDEVICE     Device,
+                          WDFREQUEST    Request,
+                          WDFFILEOBJECT FileObject)
+{
+    POSRDIO_FILE_CONTEXT fileContext;
+    PUNICODE_STRING      fileName;
+    NTSTATUS             status;
+
+#pragma warning(suppress: 26485)   // "No array to pointer decay"
+    DECLARE_CONST_UNICODE_STRING(port0Name, L"\\" OSRDIO_PORT_NAME_PREFIX L"0");
+#pragma warning(suppress: 26485)
+    DECLARE_CONST_UNICODE_STRING(port1Name, L"\\" OSRDIO_PORT_NAME_PREFIX L"1");
+#pragma warning(suppress: 26485)
+    DECLARE_CONST_UNICODE_STRING(port2Name, L"\\" OSRDIO_PORT_NAME_PREFIX L"2");
+#pragma warning(suppress: 26485)
+    DECLARE_CONST_UNICODE_STRING(port3Name, L"\\" OSRDIO_PORT_NAME_PREFIX L"3");
+
+    const UNICODE_STRING* portNames[] = { &port0Name, &port1Name, &port2Name, &port3Name };
+
+    static_assert(ARRAYSIZE(portNames) == OSRDIO_PORT_COUNT,
+                  "A name is needed for every port");
+
+    UNREFERENCED_PARAMETER(Device);
+
+    fileContext = OsrDioGetContextFromFileObject(FileObject);
+
+    fileContext->OutputLines   = 0;
+    fileContext->Port          = OSRDIO_NO_PORT;
+    fileContext->PortLines     = 0xFFFFFFFF;
+    fileContext->Administrator = DioUtilCallerIsAdministrator(Request);
+
+    fileName = WdfFileObjectGetFileName(FileObject);
+
+    if (fileName == nullptr || fileName->Length == 0) {
+
+        status = STATUS_SUCCESS;
+
+        goto done;
+    }
+
+    //
+    // The name is "\Port<n>".  Compare it to each of ours.
+    //
+    status = STATUS_OBJECT_NAME_NOT_FOUND;
+
+    for (ULONG port = 0; port < OSRDIO_PORT_COUNT; port++) {
+
+        if (RtlEqualUnicodeString(fileName,
+                                  portNames[port],
+                                  TRUE)) {
+
+            fileContext->Port      = port;
+            fileContext->PortLines = OSRDIO_PORT_LINES(port);
+
+            status = STATUS_SUCCESS;
+
+            break;
+        }
+    }
+
+#if DBG
+    DbgPrint("FileCreate: %wZ, status 0x%0x\n",
+             fileName,
+             status);
+#endif
+
+done:
+
+    WdfRequestComplete(Request,
+                       status);
+}
+
+//
+// OsrDioEvtFileCleanup
+//
+// Called when the last handle to one of our File Objects is closed.  We
+// give back any output lines reserved with this File Object, so they
+// return to being inputs (unless, of course, they're reserved by
+// somebody else).
+//
+// INPUTS:
+//  FileObject      Handle to the WDFFILEOBJECT being cleaned up
+//
+VOID
+OsrDioEvtFileCleanup(WDFFILEOBJECT FileObject)
+{
+    WDFDEVICE              device;
+    POSRDIO_DEVICE_CONTEXT devContext;
+    POSRDIO_FILE_CONTEXT   fileContext;
+    NTSTATUS               status;
+
+    fileContext = OsrDioGetContextFromFileObject(FileObject);
+
+    if (fileContext->OutputLines == 0) {
+        return;
+    }
+
+#if DBG
+    DbgPrint("FileCleanup: releasing output lines 0x%08lx\n",
+             fileContext->OutputLines);
+#endif
+
+    device     = WdfFileObjectGetDevice(FileObject);
+    devContext = OsrDioGetContextFromDevice(device);
+
+    DioUtilProfileRun(devContext,
+                      OSRDIO_REGISTER_PATH_IOCTL);
+
+    //
+    // We're not called from our power-managed Queue, so the device might
+    // be idle in D3.  Bring it back to D0 so we can reprogram it.  If we
+    // can't (because it's going away, say), we just forget the lines: we
+    // program the direction register from OutputLineMask every time we
+    // enable interrupts, on the way back into D0.
+    //
+    status = WdfDeviceStopIdle(device, TRUE);
+
+    (void)DioCoreSetOutputLines(devContext,
+                                fileContext,
+                                0,
+                                NT_SUCCESS(status));
+
+    if (NT_SUCCESS(status)) {
+        WdfDeviceResumeIdle(device);
+    }
+}
+
+//
+// OsrDioEvtInterruptEnable
+//
+// Called by WDF to ask us to enable hardware interrupts on our device.
+//
+// INPUTS:
+//  Interrupt           Handle to our WDFINTERRUPT object
+//  Device              the usual
+//
+NTSTATUS
+OsrDioEvtInterruptEnable(WDFINTERRUPT Interrupt,
+                         WDFDEVICE    Device)
+{
+    POSRDIO_DEVICE_CONTEXT devContext;
+
+#if DBG
+    DbgPrint("EvtInterruptEnable\n");
+#endif
+
+    UNREFERENCED_PARAMETER(Interrupt);
+
+    devContext = OsrDioGetContextFromDevice(Device);
+
+    DioUtilProfileRun(devContext,
+                      OSRDIO_REGISTER_PATH_POWER);
+
+    //
+    // Reset the device's interrupt logic, enable its interrupts, and
+    // program the lines (reporting any change that woke us, first)
+    //
+    DioCoreInterruptEnable(devContext);
+
+    return STATUS_SUCCESS;
+}
+
+//
+// OsrDioEvtInterruptDisable
+//
+// Called by WDF to ask us to DISABLE interrupt on our device.
+//
+// INPUTS:
+//  Interrupt       Handle to our WDFINTERRUPT object
+//  Device          the usual
+//
+NTSTATUS
+OsrDioEvtInterruptDisable(WDFINTERRUPT Interrupt,
                           WDFDEVICE    Device)
 {
     POSRDIO_DEVICE_CONTEXT devContext;
@@ -828,14 +1508,70 @@ OsrDioEvtInterruptDisable(WDFINTERRUPT Interrupt,
 
     devContext = OsrDioGetContextFromDevice(Device);
 
+    DioUtilProfileRun(devContext,
+                      OSRDIO_REGISTER_PATH_POWER);
+
     //
-    // ACK and disable any pending interrupts
+    // ACK and disable any pending interrupts, unless we're idling armed to
+    // wake, in which case change detection keeps running
     //
-    DioUtilResetDeviceInterrupts(devContext);
+    DioCoreInterruptDisable(devContext);
 
     return STATUS_SUCCESS;
 }
 
+//
+// OsrDioEvtIoDispatchToQueue
+//
+// Our default Queue's device control callback.  We send each Request to the
+// Queue that processes Requests for its handle: its port's, or the whole
+// device's.
+//
+// INPUTS:
+//  Queue        The queue from which the request is being dispatched
+//  Request      The WDFREQUEST that describes this I/O request
+//  OutputBufferLength, InputBufferLength, and IoControlCode
+//
+VOID
+OsrDioEvtIoDispatchToQueue(WDFQUEUE   Queue,
+                           WDFREQUEST Request,
+                           size_t     OutputBufferLength,
+                           size_t     InputBufferLength,
+                           ULONG      IoControlCode)
+{
+    POSRDIO_DEVICE_CONTEXT devContext;
+    POSRDIO_FILE_CONTEXT   fileContext;
+    WDFQUEUE               targetQueue;
+    NTSTATUS               status;
+
+    UNREFERENCED_PARAMETER(OutputBufferLength);
+    UNREFERENCED_PARAMETER(InputBufferLength);
+    UNREFERENCED_PARAMETER(IoControlCode);
+
+    devContext  = OsrDioGetContextFromDevice(WdfIoQueueGetDevice(Queue));
+    fileContext = OsrDioGetContextFromFileObject(WdfRequestGetFileObject(Request));
+
+    if (fileContext->Port == OSRDIO_NO_PORT) {
+        targetQueue = devContext->DeviceQueue;
+    } else {
+        targetQueue = devContext->PortQueue[fileContext->Port];
+    }
+
+    status = WdfRequestForwardToIoQueue(Request,
+                                        targetQueue);
+
+    if (!NT_SUCCESS(status)) {
+
+#if DBG
+        DbgPrint("WdfRequestForwardToIoQueue failed 0x%0x\n",
+                 status);
+#endif
+
+        WdfRequestComplete(Request,
+                           status);
+    }
+}
+
 //
 // OsrDioEvtIoDeviceControl
 //
@@ -850,10 +1586,12 @@ OsrDioEvtInterruptDisable(WDFINTERRUPT Interrupt,
 //
 // WDF calls us at this entry point when we have a device control to process.
 // Note that back in OsrDioEvtDevceAdd, when we created and initialized our
-// default Queue, we set the queue dispatch type to be SEQUENTIAL.  This means
-// that WDF will send our driver ONE REQUEST AT A TIME from this Queue, and
-// will not call us with another request until we're "done" processing the
-// current Request.
+// device and port Queues, we set the queue dispatch type to be SEQUENTIAL.
+// This means that WDF will send our driver ONE REQUEST AT A TIME from each
+// Queue, and will not call us with another request from that Queue until
+// we're "done" processing the current Request.  (Requests from different
+// Queues can be processed at the same time, so what's shared between them
+// is protected by a lock: OutputLock, EventLock, or the interrupt lock.)
 //
 // What's interesting is that this does NOT imply that we must complete
 // every Request synchronously (that is, in its EvtIoxxx callback).  Look at
@@ -870,6 +1608,7 @@ OsrDioEvtIoDeviceControl(WDFQUEUE   Queue,
                          ULONG      IoControlCode)
 {
     POSRDIO_DEVICE_CONTEXT devContext;
+    POSRDIO_FILE_CONTEXT   fileContext;
     NTSTATUS               status;
     ULONG                  bytesReadorWritten;
 
@@ -877,12 +1616,39 @@ OsrDioEvtIoDeviceControl(WDFQUEUE   Queue,
     DbgPrint("OsrDioEvtIoDeviceControl\n");
 #endif
 
-    UNREFERENCED_PARAMETER(InputBufferLength);
+    //
+    // Get a pointer to our WDFDEVICE Context, and to the context of the
+    // handle the Request was sent on
+    //
+    devContext  = OsrDioGetContextFromDevice(WdfIoQueueGetDevice(Queue));
+    fileContext = OsrDioGetContextFromFileObject(WdfRequestGetFileObject(Request));
+
+    DioUtilProfileRun(devContext,
+                      OSRDIO_REGISTER_PATH_IOCTL);
 
     //
-    // Get a pointer to our WDFDEVICE Context
+    // The event IOCTLs are about every line on the device, so they're only
+    // for handles to the whole device.  So is moving our DpcForIsr (which
+    // also means it's only done from one Queue at a time), and so is saving
+    // or applying a line profile (its edges and filters are for every line).
     //
-    devContext = OsrDioGetContextFromDevice(WdfIoQueueGetDevice(Queue));
+    if (fileContext->Port != OSRDIO_NO_PORT &&
+        (IoControlCode == IOCTL_OSRDIO_READ_EVENTS ||
+         IoControlCode == IOCTL_OSRDIO_ATTACH_EVENT_RING ||
+         IoControlCode == IOCTL_OSRDIO_WAIT_EVENT_RING ||
+         IoControlCode == IOCTL_OSRDIO_SET_DPC_PROCESSOR ||
+         IoControlCode == IOCTL_OSRDIO_SAVE_PROFILE ||
+         IoControlCode == IOCTL_OSRDIO_APPLY_PROFILE)) {
+
+#if DBG
+        DbgPrint("ERROR! Event IOCTL 0x%0x on a port handle\n",
+                 IoControlCode);
+#endif
+        status             = STATUS_INVALID_DEVICE_REQUEST;
+        bytesReadorWritten = 0;
+
+        goto done;
+    }
 
     //
     // Switch based on the control code specified by the user when they
@@ -916,8 +1682,7 @@ OsrDioEvtIoDeviceControl(WDFQUEUE   Queue,
             // Get the current line state from the device and return it in the
             // user's output buffer.
             //
-            readBuffer->CurrentLineState =
-                READ_REGISTER_ULONG(&devContext->DevBase->Static_Digital_Input_Register);
+            readBuffer->CurrentLineState = DioCoreReadLines(devContext);
 
             status             = STATUS_SUCCESS;
             bytesReadorWritten = sizeof(OSRDIO_READ_DATA);
@@ -928,28 +1693,9 @@ OsrDioEvtIoDeviceControl(WDFQUEUE   Queue,
         case IOCTL_OSRDIO_WRITE: {
 
             POSRDIO_WRITE_DATA writeBuffer;
-            ULONG              linesToAssert;
 #if DBG
             DbgPrint("Ioctl: IOCTL_OSRDIO_WRITE\n");
 #endif
-            //
-            // We can't write anything if there are no lines set to output
-            //
-            if (devContext->OutputLineMask == 0) {
-
-#if DBG
-                DbgPrint("ERROR! Write with output line mask set to zero\n");
-#endif
-                //
-                // STATUS_INVALID_DEVICE_STATE becomes ERROR_BAD_COMMAND in
-                // Win32.
-                //
-                status = STATUS_INVALID_DEVICE_STATE;
-                bytesReadorWritten = 0;
-
-                goto done;
-            }
-
             status = WdfRequestRetrieveInputBuffer(Request,
                                                    sizeof(OSRDIO_WRITE_DATA),
                                                    (PVOID*)&writeBuffer,
@@ -968,20 +1714,29 @@ OsrDioEvtIoDeviceControl(WDFQUEUE   Queue,
             }
 
             //
-            // Get the bitmask of lines the user wants to assert
+            // Assert the lines the user wants asserted, of those this
+            // handle has reserved, and leave the other handles' lines the
+            // way they were.  With no lines reserved, there's nothing to
+            // write: STATUS_INVALID_DEVICE_STATE becomes ERROR_BAD_COMMAND
+            // in Win32.  Asserting somebody else's output line is
+            // STATUS_SHARING_VIOLATION.
             //
-            linesToAssert = writeBuffer->OutputLineState;
+            status = DioCoreWriteOutputs(devContext,
+                                         fileContext,
+                                         writeBuffer->OutputLineState);
 
-            //
-            // Only allow the user to set to "1" those lines that have
-            // previously been set as outline lines
-            //
-            linesToAssert &= devContext->OutputLineMask;
+            if (!NT_SUCCESS(status)) {
 
-            WRITE_REGISTER_ULONG(&devContext->DevBase->Static_Digital_Output_Register,
-                                 linesToAssert);
+#if DBG
+                DbgPrint("ERROR! Write of lines 0x%08lx failed 0x%08lx\n",
+                         writeBuffer->OutputLineState,
+                         status);
+#endif
+                bytesReadorWritten = 0;
+
+                goto done;
+            }
 
-            status             = STATUS_SUCCESS;
             bytesReadorWritten = sizeof(OSRDIO_WRITE_DATA);
 
             break;
@@ -1010,17 +1765,45 @@ OsrDioEvtIoDeviceControl(WDFQUEUE   Queue,
             }
 
             //
-            // Get the mask of lines that the user wants to set to Output
+            // A port handle can only use its port's lines
             //
-            devContext->OutputLineMask = outputsBuffer->OutputLines;
+            if ((outputsBuffer->OutputLines & ~fileContext->PortLines) != 0) {
+
+#if DBG
+                DbgPrint("ERROR! Output lines 0x%08lx aren't all in port %lu\n",
+                         outputsBuffer->OutputLines,
+                         fileContext->Port);
+#endif
+                status             = STATUS_INVALID_PARAMETER;
+                bytesReadorWritten = 0;
+
+                goto done;
+            }
 
             //
-            // Program the output mask on the device (and enable related
-            // state-change interrupts)
+            // Reserve the lines that the user wants to set to Output for
+            // this handle, and program the device's output mask (which is
+            // all the handles' lines) and related state-change interrupts.
+            // We're called from our power-managed Queue, so the device is
+            // in D0.
             //
-            DioUtilProgramLineDirectionAndChangeMasks(devContext);
+            status = DioCoreSetOutputLines(devContext,
+                                           fileContext,
+                                           outputsBuffer->OutputLines,
+                                           true);
+
+            if (!NT_SUCCESS(status)) {
+
+#if DBG
+                DbgPrint("ERROR! Output lines 0x%08lx already reserved by another handle\n",
+                         outputsBuffer->OutputLines);
+#endif
+
+                bytesReadorWritten = 0;
+
+                goto done;
+            }
 
-            status             = STATUS_SUCCESS;
             bytesReadorWritten = sizeof(OSRDIO_SET_OUTPUTS_DATA);
 
             break;
@@ -1028,14 +1811,19 @@ OsrDioEvtIoDeviceControl(WDFQUEUE   Queue,
 
 
         case IOCTL_OSRDIO_WAITFOR_CHANGE: {
+
+            POSRDIO_WAITFOR_CHANGE_DATA waitBuffer;
+            ULONG                       priority;
 #if DBG
             DbgPrint("Ioctl: IOCTL_OSRDIO_WAITFOR_CHANGE\n");
 #endif
             //
-            // Before doing anything... Be sure some lines are
-            // set for input that we could wait to see a change on.
+            // Before doing anything... Be sure some lines (of this
+            // handle's port, if it's a port handle) are set for input that
+            // we could wait to see a change on.
             //
-            if ((~devContext->OutputLineMask) == 0) {
+            if (!DioCoreCanWaitForChange(devContext,
+                                         fileContext->PortLines)) {
 
 #if DBG
                 DbgPrint("ERROR!  No lines set to inputs. Can't wait for change\n");
@@ -1070,17 +1858,59 @@ OsrDioEvtIoDeviceControl(WDFQUEUE   Queue,
                 goto done;
             }
 
+            //
+            // The priority class is optional.  Without it, the Request is
+            // normal.
+            //
+            priority = OSRDIO_PRIORITY_NORMAL;
+
+            if (InputBufferLength != 0) {
+
+                status = WdfRequestRetrieveInputBuffer(Request,
+                                                       sizeof(OSRDIO_WAITFOR_CHANGE_DATA),
+                                                       (PVOID*)&waitBuffer,
+                                                       nullptr);
+
+                if (!NT_SUCCESS(status)) {
+
+#if DBG
+                    DbgPrint("WdfRequestRetrieveInputBuffer failed 0x%0x\n",
+                             status);
+#endif
+                    bytesReadorWritten = 0;
+
+                    goto done;
+                }
+
+                priority = waitBuffer->Priority;
+
+                if (priority >= OSRDIO_PRIORITY_COUNT) {
+
+#if DBG
+                    DbgPrint("ERROR! Invalid priority %lu on WAITFOR\n",
+                             priority);
+#endif
+                    status             = STATUS_INVALID_PARAMETER;
+                    bytesReadorWritten = 0;
+
+                    goto done;
+                }
+            }
+
 #if DBG
-            DbgPrint("Queueing Request %p, waiting for state change\n",
-                     Request);
+            DbgPrint("Queueing Request %p, priority %lu, waiting for state change\n",
+                     Request,
+                     priority);
 #endif
 
             //
-            // Forward the Request to the PendingQueue, where it'll wait for
-            // the Change Of State interrupt.
+            // Forward the Request to its class's PendingQueue (or its
+            // port's), where it'll wait for the Change Of State interrupt.
             //
             status = WdfRequestForwardToIoQueue(Request,
-                                                devContext->PendingQueue);
+                                                fileContext->Port == OSRDIO_NO_PORT ?
+                                                    devContext->PendingQueue[priority] :
+                                                    devContext->PortPendingQueue[fileContext->Port][priority]);
 
             if (!NT_SUCCESS(status)) {
 
@@ -1096,231 +1926,1284 @@ OsrDioEvtIoDeviceControl(WDFQUEUE   Queue,
             //
             // Request has been successfully forwarded to the PendingQueue.
             // We now return WITH THAT REQUEST IN PROGRESS.  We'll complete
-            // it later, in our DpcForIsr, after a state change triggers an
+            // it later, in our DpcForIsr (or, for a background Request, the
+            // work item it queues), after a state change triggers an
             // interrupt and our ISR queues a callback to our DpcForIsr.
             //
             goto doneDoNotComplete;
         }
 
-        default: {
+        case IOCTL_OSRDIO_READ_EVENTS: {
 #if DBG
-            DbgPrint("Received IOCTL 0x%x\n",
-                     IoControlCode);
+            DbgPrint("Ioctl: IOCTL_OSRDIO_READ_EVENTS\n");
 #endif
             //
-            // STATUS_INVALID_PARAMETER becomes ERROR_INVALID_PARAMETER
-            // in Win32
+            // The user's buffer must have room for at least one event
             //
-            status             = STATUS_INVALID_PARAMETER;
-            bytesReadorWritten = 0;
+            if (OutputBufferLength < OSRDIO_EVENT_BATCH_SIZE(1)) {
 
-            break;
-        }
-    }
+#if DBG
+                DbgPrint("ERROR! Invalid output buffer size on READ_EVENTS\n");
+#endif
+                status             = STATUS_INVALID_BUFFER_SIZE;
+                bytesReadorWritten = 0;
 
-done:
+                goto done;
+            }
 
-    WdfRequestCompleteWithInformation(Request,
+            //
+            // Park the Request on the EventQueue.  If there are already
+            // events in the ring, the call below will complete it right
+            // away.  Otherwise, it will be completed by our DpcForIsr.
+            //
+            status = WdfRequestForwardToIoQueue(Request,
+                                                devContext->EventQueue);
+
+            if (!NT_SUCCESS(status)) {
+
+                bytesReadorWritten = 0;
+
+                goto done;
+            }
+
+            DioCoreCompleteEventRequests(devContext);
+
+            goto doneDoNotComplete;
+        }
+
+        case IOCTL_OSRDIO_ATTACH_EVENT_RING: {
+            PMDL               mdl;
+            POSRDIO_EVENT_RING ring;
+            ULONG              capacity;
+
+#if DBG
+            DbgPrint("Ioctl: IOCTL_OSRDIO_ATTACH_EVENT_RING\n");
+#endif
+            bytesReadorWritten = 0;
+
+            //
+            // The ring must have room for at least two events, and we don't
+            // want to deal with anything larger than 4GB.  We use the
+            // largest power of two number of events that fits.
+            //
+            capacity = DioCoreRingCapacity(devContext,
+                                           OutputBufferLength);
+
+            if (capacity == 0) {
+
+#if DBG
+                DbgPrint("ERROR! Invalid output buffer size on ATTACH_EVENT_RING\n");
+#endif
+                status = STATUS_INVALID_BUFFER_SIZE;
+
+                goto done;
+            }
+
+            //
+            // Map the application's (already locked) buffer into kernel
+            // virtual address space, so our ISR can write to it in any
+            // process context.
+            //
+            status = WdfRequestRetrieveOutputWdmMdl(Request,
+                                                    &mdl);
+
+            if (!NT_SUCCESS(status)) {
+
+                goto done;
+            }
+
+            ring = (POSRDIO_EVENT_RING)
+                        MmGetSystemAddressForMdlSafe(mdl,
+                                                     NormalPagePriority |
+                                                     MdlMappingNoExecute);
+
+            if (ring == nullptr) {
+
+                status = STATUS_INSUFFICIENT_RESOURCES;
+
+                goto done;
+            }
+
+            //
+            // Hand the ring to our ISR, unless there's one already
+            //
+            if (!DioCoreAttachEventRing(devContext,
+                                        ring,
+                                        capacity)) {
+
+#if DBG
+                DbgPrint("ERROR! An event ring is already attached\n");
+#endif
+                status = STATUS_DEVICE_BUSY;
+
+                goto done;
+            }
+
+            //
+            // The Request stays on the RingQueue (keeping the buffer locked
+            // and mapped) until it's canceled.
+            //
+            status = WdfRequestForwardToIoQueue(Request,
+                                                devContext->RingQueue);
+
+            if (!NT_SUCCESS(status)) {
+
+                DioCoreDetachEventRing(devContext);
+
+                goto done;
+            }
+
+            goto doneDoNotComplete;
+        }
+
+        case IOCTL_OSRDIO_WAIT_EVENT_RING: {
+#if DBG
+            DbgPrint("Ioctl: IOCTL_OSRDIO_WAIT_EVENT_RING\n");
+#endif
+            bytesReadorWritten = 0;
+
+            //
+            // Park the Request on the RingWaitQueue.  If there's already
+            // something in the ring (or there's no ring) the call below
+            // completes it right away.  Otherwise, our DpcForIsr will.
+            //
+            status = WdfRequestForwardToIoQueue(Request,
+                                                devContext->RingWaitQueue);
+
+            if (!NT_SUCCESS(status)) {
+
+                goto done;
+            }
+
+            DioCoreCompleteRingWaitRequests(devContext,
+                                            false);
+
+            goto doneDoNotComplete;
+        }
+
+        case IOCTL_OSRDIO_GET_DPC_STATS: {
+            POSRDIO_DPC_STATS statsBuffer;
+#if DBG
+            DbgPrint("Ioctl: IOCTL_OSRDIO_GET_DPC_STATS\n");
+#endif
+            bytesReadorWritten = 0;
+
+            status = WdfRequestRetrieveOutputBuffer(Request,
+                                                    sizeof(OSRDIO_DPC_STATS),
+                                                    (PVOID*)&statsBuffer,
+                                                    nullptr);
+
+            if (!NT_SUCCESS(status)) {
+
+                goto done;
+            }
+
+            //
+            // The counts are still being updated, so this is a snapshot
+            // rather than a consistent set
+            //
+            devContext->DpcStats.DpcProcessor = devContext->DpcProcessor;
+
+            RtlCopyMemory(statsBuffer,
+                          &devContext->DpcStats,
+                          sizeof(OSRDIO_DPC_STATS));
+
+            bytesReadorWritten = sizeof(OSRDIO_DPC_STATS);
+
+            break;
+        }
+
+        case IOCTL_OSRDIO_GET_REGISTER_PROFILE: {
+#if OSRDIO_REGISTER_PROFILING
+            POSRDIO_REGISTER_PROFILE profileBuffer;
+#endif
+#if DBG
+            DbgPrint("Ioctl: IOCTL_OSRDIO_GET_REGISTER_PROFILE\n");
+#endif
+            bytesReadorWritten = 0;
+
+#if OSRDIO_REGISTER_PROFILING
+            status = WdfRequestRetrieveOutputBuffer(Request,
+                                                    sizeof(OSRDIO_REGISTER_PROFILE),
+                                                    (PVOID*)&profileBuffer,
+                                                    nullptr);
+
+            if (!NT_SUCCESS(status)) {
+
+                goto done;
+            }
+
+            //
+            // As with the DPC statistics, this is a snapshot
+            //
+            RtlCopyMemory(profileBuffer,
+                          &devContext->RegisterProfile,
+                          sizeof(OSRDIO_REGISTER_PROFILE));
+
+            bytesReadorWritten = sizeof(OSRDIO_REGISTER_PROFILE);
+
+            break;
+#else
+            status = STATUS_NOT_SUPPORTED;
+
+            goto done;
+#endif
+        }
+
+        case IOCTL_OSRDIO_GET_REGISTER_TRACE: {
+#if OSRDIO_REGISTER_PROFILING
+            POSRDIO_REGISTER_TRACE traceBuffer;
+#endif
+#if DBG
+            DbgPrint("Ioctl: IOCTL_OSRDIO_GET_REGISTER_TRACE\n");
+#endif
+            bytesReadorWritten = 0;
+
+#if OSRDIO_REGISTER_PROFILING
+            status = WdfRequestRetrieveOutputBuffer(Request,
+                                                    sizeof(OSRDIO_REGISTER_TRACE),
+                                                    (PVOID*)&traceBuffer,
+                                                    nullptr);
+
+            if (!NT_SUCCESS(status)) {
+
+                goto done;
+            }
+
+            traceBuffer->Frequency     = devContext->RegisterProfile.Frequency;
+            traceBuffer->RegisterCount = devContext->RegisterProfile.RegisterCount;
+
+            RtlCopyMemory(traceBuffer->Offset,
+                          devContext->RegisterProfile.Offset,
+                          sizeof(traceBuffer->Offset));
+
+            //
+            // Oldest first.  We don't stop our ISR (or anyone else) adding
+            // to the trace while we copy it; what they overwrite is left
+            // out.
+            //
+            DioUtilTraceCopy(&devContext->RegisterTrace,
+                             traceBuffer);
+
+            bytesReadorWritten = FIELD_OFFSET(OSRDIO_REGISTER_TRACE, Entries) +
+                                 traceBuffer->EntryCount * sizeof(OSRDIO_REGISTER_TRACE_ENTRY);
+
+            break;
+#else
+            status = STATUS_NOT_SUPPORTED;
+
+            goto done;
+#endif
+        }
+
+        case IOCTL_OSRDIO_SET_DPC_PROCESSOR: {
+            POSRDIO_DPC_PROCESSOR_DATA processorBuffer;
+#if DBG
+            DbgPrint("Ioctl: IOCTL_OSRDIO_SET_DPC_PROCESSOR\n");
+#endif
+            bytesReadorWritten = 0;
+
+            //
+            // Only an administrator may move our DpcForIsr (the I/O
+            // Manager has already checked the handle is open for writing)
+            //
+            if (!fileContext->Administrator) {
+
+#if DBG
+                DbgPrint("ERROR! SET_DPC_PROCESSOR from a non-administrator\n");
+#endif
+                status = STATUS_ACCESS_DENIED;
+
+                goto done;
+            }
+
+            status = WdfRequestRetrieveInputBuffer(Request,
+                                                   sizeof(OSRDIO_DPC_PROCESSOR_DATA),
+                                                   (PVOID*)&processorBuffer,
+                                                   nullptr);
+
+            if (!NT_SUCCESS(status)) {
+
+                goto done;
+            }
+
+            status = DioCoreSetDpcProcessor(devContext,
+                                            processorBuffer->Processor);
+
+            break;
+        }
+
+        case IOCTL_OSRDIO_SAVE_PROFILE: {
+            POSRDIO_LINE_PROFILE profileBuffer;
+#if DBG
+            DbgPrint("Ioctl: IOCTL_OSRDIO_SAVE_PROFILE\n");
+#endif
+            bytesReadorWritten = 0;
+
+            //
+            // The saved profile drives the outputs whenever the device
+            // starts, so only an administrator may change it
+            //
+            if (!fileContext->Administrator) {
+
+#if DBG
+                DbgPrint("ERROR! SAVE_PROFILE from a non-administrator\n");
+#endif
+                status = STATUS_ACCESS_DENIED;
+
+                goto done;
+            }
+
+            status = WdfRequestRetrieveInputBuffer(Request,
+                                                   sizeof(OSRDIO_LINE_PROFILE),
+                                                   (PVOID*)&profileBuffer,
+                                                   nullptr);
+
+            if (!NT_SUCCESS(status)) {
+
+                goto done;
+            }
+
+            status = DioCoreSaveProfile(devContext,
+                                        profileBuffer);
+
+            break;
+        }
+
+        case IOCTL_OSRDIO_APPLY_PROFILE: {
+            POSRDIO_LINE_PROFILE profileBuffer;
+#if DBG
+            DbgPrint("Ioctl: IOCTL_OSRDIO_APPLY_PROFILE\n");
+#endif
+            bytesReadorWritten = 0;
+
+            status = WdfRequestRetrieveInputBuffer(Request,
+                                                   sizeof(OSRDIO_LINE_PROFILE),
+                                                   (PVOID*)&profileBuffer,
+                                                   nullptr);
+
+            if (!NT_SUCCESS(status)) {
+
+                goto done;
+            }
+
+            //
+            // We're called from our power-managed Queue, so the device is
+            // in D0
+            //
+            status = DioCoreApplyProfile(devContext,
+                                         fileContext,
+                                         profileBuffer);
+
+            if (!NT_SUCCESS(status)) {
+
+#if DBG
+                DbgPrint("ERROR! Output lines 0x%08lx already reserved by another handle\n",
+                         profileBuffer->OutputLines);
+#endif
+                goto done;
+            }
+
+            break;
+        }
+
+        default: {
+#if DBG
+            DbgPrint("Received IOCTL 0x%x\n",
+                     IoControlCode);
+#endif
+            //
+            // STATUS_INVALID_PARAMETER becomes ERROR_INVALID_PARAMETER
+            // in Win32
+            //
+            status             = STATUS_INVALID_PARAMETER;
+            bytesReadorWritten = 0;
+
+            break;
+        }
+    }
+
+done:
+
+    WdfRequestCompleteWithInformation(Request,
                                       status,
                                       bytesReadorWritten);
 doneDoNotComplete:
 
-    return;
+    return;
+}
+
+//
+// OsrDioEvtInterruptIsr
+//
+// This is our driver's interrupt service routine.
+//
+// INPUTS:
+//  Interrupt       Handle to our WDFINTERRUPT object describing this Interrupt
+//
+//  MessageId       The zero-based message number of the MSI/MSI-x message
+//                  we're processing.  This device only has one MSI, so there's
+//                  no need to check the message ID that's passed to us.
+//
+BOOLEAN
+OsrDioEvtInterruptIsr(WDFINTERRUPT Interrupt,
+                      ULONG        MessageID)
+{
+    POSRDIO_DEVICE_CONTEXT devContext;
+
+#if DBG
+    DbgPrint("ISR...\n");
+#endif
+
+    UNREFERENCED_PARAMETER(MessageID);
+
+    devContext = OsrDioGetContextFromDevice(WdfInterruptGetDevice(Interrupt));
+
+    DioUtilProfileRun(devContext,
+                      OSRDIO_REGISTER_PATH_ISR);
+
+    //
+    // If our device caused this interrupt, record any change it caught,
+    // queue our DpcForIsr to tell the user about it, and ACK it.  If it
+    // didn't, we return FALSE to the Windows Interrupt Dispatcher.
+    //
+    if (!DioCoreServiceInterrupt(devContext)) {
+
+#if DBG
+        DbgPrint("Not our interrupt\n");
+#endif
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+//
+// OsrDioEvtInterruptDpc
+//
+// This is our DpcForIsr function, where we complete any processing that was
+// started in our ISR.  Or, if our processing is deferred, where we hand it
+// to our worker thread.
+//
+// INPUTS:
+//  Interrupt       WDFINTERRUPT related to this call
+//  Device          WDFDEVICE handle
+//
+VOID
+OsrDioEvtInterruptDpc(WDFINTERRUPT Interrupt,
+                      WDFOBJECT    Device)
+{
+    POSRDIO_DEVICE_CONTEXT devContext;
+    LONGLONG               startTime;
+
+    UNREFERENCED_PARAMETER(Interrupt);
+
+    startTime = KeQueryPerformanceCounter(nullptr).QuadPart;
+
+#if DBG
+    DbgPrint("DPC for ISR...\n");
+#endif
+
+    devContext = OsrDioGetContextFromDevice(Device);
+
+    DioUtilProfileRun(devContext,
+                      OSRDIO_REGISTER_PATH_DPC);
+
+    InterlockedIncrement64((volatile LONG64*)&devContext->DpcStats.DpcCount[
+        min(KeGetCurrentProcessorIndex(), OSRDIO_STATS_PROCESSORS - 1)]);
+
+    DioCoreDpc(devContext);
+
+    DioUtilRecordTiming(&devContext->DpcStats.Dpc,
+                        devContext->DpcStats.Frequency,
+                        startTime);
+}
+
+//
+// OsrDioEvtTargetedDpc
+//
+// The DPC our ISR queues instead of our DpcForIsr when the DpcForIsr is
+// meant to run on a particular processor.  It does just what the DpcForIsr
+// does.
+//
+// INPUTS:
+//  Dpc             Our WDFDPC, whose parent is our WDFDEVICE
+//
+VOID
+OsrDioEvtTargetedDpc(WDFDPC Dpc)
+{
+    WDFOBJECT device;
+
+    device = WdfDpcGetParentObject(Dpc);
+
+    OsrDioEvtInterruptDpc(OsrDioGetContextFromDevice(device)->WdfInterrupt,
+                          device);
+}
+
+//
+// OsrDioWorkerThread
+//
+// When our processing is deferred, this real-time priority thread does
+// what our DpcForIsr would otherwise do, every time the DpcForIsr sets
+// WorkerEvent.  It runs until DioUtilStopWorker sets WorkerStop.
+//
+// INPUTS:
+//  Context         Our device context
+//
+VOID
+OsrDioWorkerThread(PVOID Context)
+{
+    POSRDIO_DEVICE_CONTEXT devContext;
+    LONGLONG               startTime;
+    ULONG                  processor;
+    ULONG                  affinityProcessor = OSRDIO_ANY_PROCESSOR;
+    GROUP_AFFINITY         affinity;
+    GROUP_AFFINITY         previousAffinity;
+    PROCESSOR_NUMBER       processorNumber;
+
+    devContext = static_cast<POSRDIO_DEVICE_CONTEXT>(Context);
+
+    (void)KeSetPriorityThread(KeGetCurrentThread(),
+                              LOW_REALTIME_PRIORITY);
+
+    while (TRUE) {
+
+        (void)KeWaitForSingleObject(&devContext->WorkerEvent,
+                                    Executive,
+                                    KernelMode,
+                                    FALSE,
+                                    nullptr);
+
+        if (InterlockedCompareExchange(&devContext->WorkerStop, 0, 0) != 0) {
+            break;
+        }
+
+        //
+        // We run where the DpcForIsr runs, so if it's been moved, move
+        // with it
+        //
+        processor = devContext->DpcProcessor;
+
+        if (processor != affinityProcessor) {
+
+            if (affinityProcessor != OSRDIO_ANY_PROCESSOR) {
+
+                KeRevertToUserGroupAffinityThread(&previousAffinity);
+            }
+
+            affinityProcessor = OSRDIO_ANY_PROCESSOR;
+
+            if (processor != OSRDIO_ANY_PROCESSOR &&
+                NT_SUCCESS(KeGetProcessorNumberFromIndex(processor,
+                                                         &processorNumber))) {
+
+                RtlZeroMemory(&affinity,
+                              sizeof(affinity));
+
+                affinity.Group = processorNumber.Group;
+                affinity.Mask  = AFFINITY_MASK(processorNumber.Number);
+
+                KeSetSystemGroupAffinityThread(&affinity,
+                                               &previousAffinity);
+
+                affinityProcessor = processor;
+            }
+        }
+
+        startTime = KeQueryPerformanceCounter(nullptr).QuadPart;
+
+        DioCoreWorker(devContext);
+
+        DioUtilRecordTiming(&devContext->DpcStats.Worker,
+                            devContext->DpcStats.Frequency,
+                            startTime);
+    }
+
+    if (affinityProcessor != OSRDIO_ANY_PROCESSOR) {
+
+        KeRevertToUserGroupAffinityThread(&previousAffinity);
+    }
+
+#if DBG
+    DbgPrint("Worker thread exiting\n");
+#endif
+
+    (void)PsTerminateSystemThread(STATUS_SUCCESS);
+}
+
+//
+// OsrDioEvtBackgroundWorkItem
+//
+// Queued by our DpcForIsr to complete OSRDIO_PRIORITY_BACKGROUND
+// IOCTL_OSRDIO_WAITFOR_CHANGE Requests, at PASSIVE_LEVEL, once the others
+// have been completed.
+//
+// INPUTS:
+//  WorkItem        Our WDFWORKITEM, whose parent is our WDFDEVICE
+//
+VOID
+OsrDioEvtBackgroundWorkItem(WDFWORKITEM WorkItem)
+{
+    POSRDIO_DEVICE_CONTEXT devContext;
+
+    devContext = OsrDioGetContextFromDevice(WdfWorkItemGetParentObject(WorkItem));
+
+    DioCoreBackgroundWork(devContext);
+}
+
+//
+// Utility Routines
+//
+// We would ordinarily locate these in a separate module from the mainline
+// driver code. But given that this example driver is so short, it seems
+// more convenient to just put there here.
+//
+
+
+#if OSRDIO_REGISTER_PROFILING
+
+//
+// DioUtilProfileAccess
+//
+// Count an access to the register at Offset, made by Profiler's path, that
+// started at StartTime (a performance counter value) and has just
+// finished.  Called from every path, including our ISR, so everything is
+// updated with interlocked operations.
+//
+_Use_decl_annotations_
+VOID
+DioUtilProfileAccess(const DIO_REGISTER_PROFILER& Profiler,
+                     ULONG                        Offset,
+                     ULONG                        RegisterValue,
+                     LARGE_INTEGER                StartTime,
+                     BOOLEAN                      Write)
+{
+    POSRDIO_REGISTER_ACCESSES    accesses;
+    POSRDIO_REGISTER_TRACE_ENTRY entry;
+    LONGLONG                     elapsed;
+    ULONG                        index;
+
+    elapsed = KeQueryPerformanceCounter(nullptr).QuadPart - StartTime.QuadPart;
+
+    index = DioRegisterIndex(Offset);
+
+    if (index >= DIO_REGISTER_COUNT || Profiler.Path >= OSRDIO_REGISTER_PATHS) {
+        return;
+    }
+
+    accesses = &Profiler.Profile->Accesses[index][Profiler.Path];
+
+    if (Write) {
+
+        InterlockedIncrement64((volatile LONG64*)&accesses->Writes);
+
+        InterlockedAdd64((volatile LONG64*)&accesses->WriteTime,
+                         elapsed);
+    } else {
+
+        InterlockedIncrement64((volatile LONG64*)&accesses->Reads);
+
+        InterlockedAdd64((volatile LONG64*)&accesses->ReadTime,
+                         elapsed);
+    }
+
+    DioUtilTraceRecord(Profiler.Trace,
+                       StartTime,
+                       RegisterValue,
+                       (UCHAR)index,
+                       Write ? OSRDIO_TRACE_WRITE : OSRDIO_TRACE_READ,
+                       (UCHAR)Profiler.Path);
+}
+
+//
+// DioUtilTraceRecord
+//
+// Record an entry in Trace (overwriting the oldest, once it's full) for
+// something that happened at Time (a performance counter value).  Called
+// from every path, including our ISR, so the entry is claimed with an
+// interlocked operation.  Its slot's Sequence is 0 while we write it, so
+// DioUtilTraceCopy can tell if it copied the slot part way through.
+//
+_Use_decl_annotations_
+VOID
+DioUtilTraceRecord(PDIO_REGISTER_TRACE_RING Trace,
+                   LARGE_INTEGER            Time,
+                   ULONG                    Value,
+                   UCHAR                    Register,
+                   UCHAR                    Kind,
+                   UCHAR                    Path)
+{
+    PDIO_REGISTER_TRACE_SLOT slot;
+    LONG64                   next;
+
+    next = InterlockedIncrement64(&Trace->Next) - 1;
+
+    slot = &Trace->Slots[next & (OSRDIO_REGISTER_TRACE_ENTRIES - 1)];
+
+    InterlockedExchange64(&slot->Sequence,
+                          0);
+
+    slot->Entry.Time     = Time.QuadPart - Trace->StartTime.QuadPart;
+    slot->Entry.Value    = Value;
+    slot->Entry.Register = Register;
+    slot->Entry.Kind     = Kind;
+    slot->Entry.Path     = Path;
+    slot->Entry.Reserved = 0;
+
+    InterlockedExchange64(&slot->Sequence,
+                          next + 1);
+}
+
+//
+// DioUtilTraceCopy
+//
+// Copy the latest entries in Trace to TraceBuffer, oldest first, without
+// stopping anyone adding to it meanwhile (so we never hold our interrupt
+// lock for the length of the copy).  We take Next once, copy the entries
+// below it, and keep each only if its slot's Sequence says it held that
+// entry both before and after we copied it: entries that were overwritten,
+// or were still being written, are left out.
+//
+_Use_decl_annotations_
+VOID
+DioUtilTraceCopy(PDIO_REGISTER_TRACE_RING Trace,
+                 POSRDIO_REGISTER_TRACE   TraceBuffer)
+{
+    PDIO_REGISTER_TRACE_SLOT slot;
+    LONG64                   first;
+    LONG64                   next;
+    LONG64                   sequence;
+    ULONG                    count;
+
+    first = Trace->First;
+    next  = InterlockedCompareExchange64(&Trace->Next,
+                                         0,
+                                         0);
+
+    if (next - first > OSRDIO_REGISTER_TRACE_ENTRIES) {
+        first = next - OSRDIO_REGISTER_TRACE_ENTRIES;
+    }
+
+    count = 0;
+
+    for (LONG64 n = first; n < next; n++) {
+
+        slot = &Trace->Slots[n & (OSRDIO_REGISTER_TRACE_ENTRIES - 1)];
+
+        sequence = InterlockedCompareExchange64(&slot->Sequence,
+                                                0,
+                                                0);
+
+        if (sequence != n + 1) {
+            continue;
+        }
+
+        TraceBuffer->Entries[count] = slot->Entry;
+
+        KeMemoryBarrier();
+
+        if (slot->Sequence != sequence) {
+            continue;
+        }
+
+        count++;
+    }
+
+    TraceBuffer->Recorded   = (ULONGLONG)(next - Trace->First);
+    TraceBuffer->EntryCount = count;
+}
+
+#endif
+
+//
+// DioUtilRecordTiming
+//
+// Count a run of our DpcForIsr or worker thread that started at StartTime
+// (a performance counter value) and has just finished.  Either can run on
+// more than one processor at once, so everything is updated with
+// interlocked operations.
+//
+_Use_decl_annotations_
+VOID
+DioUtilRecordTiming(POSRDIO_TIMING Timing,
+                    LONGLONG       Frequency,
+                    LONGLONG       StartTime)
+{
+    LONGLONG  elapsed;
+    LONGLONG  maxTime;
+    ULONGLONG microseconds;
+    ULONG     bucket;
+
+    elapsed = KeQueryPerformanceCounter(nullptr).QuadPart - StartTime;
+
+    InterlockedIncrement64((volatile LONG64*)&Timing->Count);
+
+    InterlockedAdd64((volatile LONG64*)&Timing->TotalTime,
+                     elapsed);
+
+    maxTime = (LONGLONG)Timing->MaxTime;
+
+    while (elapsed > maxTime) {
+
+        LONGLONG previous;
+
+        previous = InterlockedCompareExchange64((volatile LONG64*)&Timing->MaxTime,
+                                                elapsed,
+                                                maxTime);
+
+        if (previous == maxTime) {
+            break;
+        }
+
+        maxTime = previous;
+    }
+
+    //
+    // Histogram[n] is for times under 2^n microseconds
+    //
+    microseconds = (ULONGLONG)elapsed * 1000000 / (ULONGLONG)Frequency;
+    bucket       = 0;
+
+    while (microseconds != 0 && bucket < OSRDIO_TIMING_BUCKETS - 1) {
+
+        microseconds >>= 1;
+        bucket++;
+    }
+
+    InterlockedIncrement64((volatile LONG64*)&Timing->Histogram[bucket]);
 }
 
 //
-// OsrDioEvtInterruptIsr
+// DioUtilQueryParameter
 //
-// This is our driver's interrupt service routine.
+// Returns the ULONG value ValueName from Key (our device's hardware key),
+// or DefaultValue if it isn't there (or we couldn't open the key).
 //
-// INPUTS:
-//  Interrupt       Handle to our WDFINTERRUPT object describing this Interrupt
+_Use_decl_annotations_
+ULONG
+DioUtilQueryParameter(WDFKEY           Key,
+                      PCUNICODE_STRING ValueName,
+                      ULONG            DefaultValue)
+{
+    NTSTATUS status;
+    ULONG    value;
+
+    if (Key == nullptr) {
+        return DefaultValue;
+    }
+
+    status = WdfRegistryQueryULong(Key,
+                                   ValueName,
+                                   &value);
+
+    if (!NT_SUCCESS(status)) {
+        return DefaultValue;
+    }
+
+#if DBG
+    DbgPrint("%wZ = 0x%lx\n",
+             ValueName,
+             value);
+#endif
+
+    return value;
+}
+
 //
-//  MessageId       The zero-based message number of the MSI/MSI-x message
-//                  we're processing.  This device only has one MSI, so there's
-//                  no need to check the message ID that's passed to us.
+// DioUtilLoadProfile
 //
-BOOLEAN
-OsrDioEvtInterruptIsr(WDFINTERRUPT Interrupt,
-                      ULONG        MessageID)
+// Reads our line profile (see OSRDIO_LINE_PROFILE) from our device's
+// hardware key.  Values that aren't there give the lines the state they've
+// always come up in: all of them inputs, maximally filtered, reporting
+// changes in both directions.
+//
+_Use_decl_annotations_
+VOID
+DioUtilLoadProfile(POSRDIO_DEVICE_CONTEXT DevContext)
 {
-    POSRDIO_DEVICE_CONTEXT devContext;
-    ULONG                  interruptStatus;
-    ULONG                  lineState;
-    BOOLEAN                returnValue;
-    ULONG                  changeDetectReg;
+    NTSTATUS status;
+    WDFKEY   parametersKey;
+
+#pragma warning(suppress: 26485)
+    DECLARE_CONST_UNICODE_STRING(outputLinesName,
+                                 L"ProfileOutputLines");
+#pragma warning(suppress: 26485)
+    DECLARE_CONST_UNICODE_STRING(outputStateName,
+                                 L"ProfileOutputState");
+#pragma warning(suppress: 26485)
+    DECLARE_CONST_UNICODE_STRING(risingEdgesName,
+                                 L"ProfileRisingEdges");
+#pragma warning(suppress: 26485)
+    DECLARE_CONST_UNICODE_STRING(fallingEdgesName,
+                                 L"ProfileFallingEdges");
+#pragma warning(suppress: 26485)
+    DECLARE_CONST_UNICODE_STRING(filterPort0and1Name,
+                                 L"ProfileFilterPort0and1");
+#pragma warning(suppress: 26485)
+    DECLARE_CONST_UNICODE_STRING(filterPort2and3Name,
+                                 L"ProfileFilterPort2and3");
+
+    status = WdfDeviceOpenRegistryKey(DevContext->WdfDevice,
+                                      PLUGPLAY_REGKEY_DEVICE,
+                                      KEY_READ,
+                                      WDF_NO_OBJECT_ATTRIBUTES,
+                                      &parametersKey);
 
+    if (!NT_SUCCESS(status)) {
 #if DBG
-    DbgPrint("ISR...\n");
+        DbgPrint("WdfDeviceOpenRegistryKey failed 0x%0x, no line profile\n",
+                 status);
 #endif
+        parametersKey = nullptr;
+    }
 
-    UNREFERENCED_PARAMETER(MessageID);
+    DevContext->Profile.OutputLines =
+        DioUtilQueryParameter(parametersKey,
+                              &outputLinesName,
+                              0);
 
-    devContext = OsrDioGetContextFromDevice(WdfInterruptGetDevice(Interrupt));
+    DevContext->Profile.OutputState =
+        DioUtilQueryParameter(parametersKey,
+                              &outputStateName,
+                              0);
 
-    //
-    // Get the pending interrupt status
-    //
-    // If an interrupt is being request from the device to the host, this
-    // will also acknowledge (and clear) that interrupt
-    //
-    interruptStatus =
-        READ_REGISTER_ULONG(&devContext->DevBase->Volatile_Interrupt_Status_Register);
+    DevContext->Profile.RisingEdges =
+        DioUtilQueryParameter(parametersKey,
+                              &risingEdgesName,
+                              0xFFFFFFFF);
 
-#if DBG
-    DbgPrint("IntStatus = 0x%08x\n",
-             interruptStatus);
-#endif
+    DevContext->Profile.FallingEdges =
+        DioUtilQueryParameter(parametersKey,
+                              &fallingEdgesName,
+                              0xFFFFFFFF);
 
-    //
-    // Is there an interrupt pending from this device?
-    //
-    if ((interruptStatus & Vol_Int) == 0) {
+    DevContext->Profile.FilterPort0and1 =
+        DioUtilQueryParameter(parametersKey,
+                              &filterPort0and1Name,
+                              Filter_Large_All_Lines);
 
-        //
-        // Our device DID NOT cause this interrupt.  We therefore will
-        // return FALSE to the Windows Interrupt Dispatcher
-        //
-        returnValue = FALSE;
+    DevContext->Profile.FilterPort2and3 =
+        DioUtilQueryParameter(parametersKey,
+                              &filterPort2and3Name,
+                              Filter_Large_All_Lines);
 
-        DbgPrint("Not our interrupt\n");
+    if (parametersKey != nullptr) {
 
-        //
-        // The interrupt was not caused by our device
-        //
+        WdfRegistryClose(parametersKey);
+    }
+}
+
+//
+// DioUtilSaveProfile
+//
+// Writes Profile to our device's hardware key, where DioUtilLoadProfile
+// will find it the next time our device is started.  Called by the core
+// (DioCoreSaveProfile), for IOCTL_OSRDIO_SAVE_PROFILE.
+//
+_Use_decl_annotations_
+NTSTATUS
+DioUtilSaveProfile(POSRDIO_DEVICE_CONTEXT DevContext,
+                   POSRDIO_LINE_PROFILE   Profile)
+{
+    NTSTATUS status;
+    WDFKEY   parametersKey;
+
+#pragma warning(suppress: 26485)
+    DECLARE_CONST_UNICODE_STRING(outputLinesName,
+                                 L"ProfileOutputLines");
+#pragma warning(suppress: 26485)
+    DECLARE_CONST_UNICODE_STRING(outputStateName,
+                                 L"ProfileOutputState");
+#pragma warning(suppress: 26485)
+    DECLARE_CONST_UNICODE_STRING(risingEdgesName,
+                                 L"ProfileRisingEdges");
+#pragma warning(suppress: 26485)
+    DECLARE_CONST_UNICODE_STRING(fallingEdgesName,
+                                 L"ProfileFallingEdges");
+#pragma warning(suppress: 26485)
+    DECLARE_CONST_UNICODE_STRING(filterPort0and1Name,
+                                 L"ProfileFilterPort0and1");
+#pragma warning(suppress: 26485)
+    DECLARE_CONST_UNICODE_STRING(filterPort2and3Name,
+                                 L"ProfileFilterPort2and3");
+
+    PCUNICODE_STRING valueNames[] = {
+        &outputLinesName,
+        &outputStateName,
+        &risingEdgesName,
+        &fallingEdgesName,
+        &filterPort0and1Name,
+        &filterPort2and3Name
+    };
+
+    const ULONG values[] = {
+        Profile->OutputLines,
+        Profile->OutputState,
+        Profile->RisingEdges,
+        Profile->FallingEdges,
+        Profile->FilterPort0and1,
+        Profile->FilterPort2and3
+    };
+
+    status = WdfDeviceOpenRegistryKey(DevContext->WdfDevice,
+                                      PLUGPLAY_REGKEY_DEVICE,
+                                      KEY_WRITE,
+                                      WDF_NO_OBJECT_ATTRIBUTES,
+                                      &parametersKey);
+
+    if (!NT_SUCCESS(status)) {
+#if DBG
+        DbgPrint("WdfDeviceOpenRegistryKey failed 0x%0x\n",
+                 status);
+#endif
         goto done;
     }
 
-    //
-    // Our device DID cause this interrupt, so we will return TRUE to the
-    // Windows Interrupt Dispatcher
-    //
-    returnValue = TRUE;
+    for (ULONG i = 0; i < ARRAYSIZE(values); i++) {
 
-    //
-    // So... Our device interrupted.  Find out why.
-    //
-    // Is the interrupt because a Digital Input line state change was detected?
-    //
-    changeDetectReg =
-        READ_REGISTER_ULONG(&devContext->DevBase->ChangeDetectStatusRegister);
+        status = WdfRegistryAssignULong(parametersKey,
+                                        valueNames[i],
+                                        values[i]);
+
+        if (!NT_SUCCESS(status)) {
+#if DBG
+            DbgPrint("WdfRegistryAssignULong %wZ failed 0x%0x\n",
+                     valueNames[i],
+                     status);
+#endif
+            break;
+        }
+    }
 
-    if (((changeDetectReg & ChangeDetectStatus) == 1) &&
-        ((changeDetectReg & ChangeDetectError) == 0)) {
+    WdfRegistryClose(parametersKey);
 
-        //
-        // Yes... the state of one of the Digital Input lines has changed,
-        // AND the ERROR bit is not set.  So, we will notify the user, if
-        // they have asked to be notified.
-        //
+done:
+
+    return status;
+}
+
+//
+// DioUtilSetInterruptPolicy
+//
+// Ask for our interrupt to be delivered to Processor or, if that's
+// OSRDIO_ANY_PROCESSOR, according to Policy (a WDF_INTERRUPT_POLICY).
+// Called from EvtDriverDeviceAdd; the policy is applied when our
+// resources are assigned.  Settings that make no sense leave the machine
+// default in place.
+//
+_Use_decl_annotations_
+VOID
+DioUtilSetInterruptPolicy(POSRDIO_DEVICE_CONTEXT DevContext,
+                          ULONG                  Policy,
+                          ULONG                  Processor)
+{
+    WDF_INTERRUPT_EXTENDED_POLICY interruptPolicy;
+    PROCESSOR_NUMBER              processorNumber;
+    NTSTATUS                      status;
+
+    WDF_INTERRUPT_EXTENDED_POLICY_INIT(&interruptPolicy);
+
+    if (Processor != OSRDIO_ANY_PROCESSOR) {
+
+        status = KeGetProcessorNumberFromIndex(Processor,
+                                               &processorNumber);
+
+        if (!NT_SUCCESS(status)) {
 #if DBG
-        DbgPrint("ChangeDetectReg: Line state change SET and NO ERROR\n");
+            DbgPrint("ERROR! No processor %lu for our interrupt\n",
+                     Processor);
 #endif
+            return;
+        }
 
-        //
-        // Read the latched state of the DIO lines at the change
-        //
-        lineState =
-            READ_REGISTER_ULONG(&devContext->DevBase->DI_ChangeDetectLatched_Register);
+        interruptPolicy.Policy                   = WdfIrqPolicySpecifiedProcessors;
+        interruptPolicy.TargetProcessorSet.Group = processorNumber.Group;
+        interruptPolicy.TargetProcessorSet.Mask  = AFFINITY_MASK(processorNumber.Number);
+
+    } else {
 
+        if (Policy > WdfIrqPolicyAllProcessorsInMachine) {
 #if DBG
-        DbgPrint("Line state latched on change = 0x%08x\n",
-                 lineState);
+            DbgPrint("ERROR! Unsupported interrupt policy %lu\n",
+                     Policy);
 #endif
+            return;
+        }
 
-        //
-        // Save the state of the lines at change, for returning to the
-        // user
-        //
-        devContext->LatchedInputLineState = lineState;
+        interruptPolicy.Policy = static_cast<WDF_INTERRUPT_POLICY>(Policy);
+    }
 
-        //
-        // Queue a DpcForIsr to return the data to the user and notify
-        // them of this state change
-        //
-        WdfInterruptQueueDpcForIsr(Interrupt);
+    WdfInterruptSetExtendedPolicy(DevContext->WdfInterrupt,
+                                  &interruptPolicy);
+}
+
+//
+// DioUtilCallerIsAdministrator
+//
+// Whether the handle being opened by Request (the create Request given to
+// our EvtDeviceFileCreate) is being opened from kernel mode, or by a user
+// whose token is an administrator's (that is, elevated).  We look at the
+// security context of the create itself, so it doesn't matter which
+// thread we're called in.
+//
+_Use_decl_annotations_
+BOOLEAN
+DioUtilCallerIsAdministrator(WDFREQUEST Request)
+{
+    PIO_STACK_LOCATION           ioStack;
+    PIO_SECURITY_CONTEXT         securityContext;
+    PSECURITY_SUBJECT_CONTEXT    subjectContext;
+    BOOLEAN                      administrator;
+
+    if (WdfRequestGetRequestorMode(Request) == KernelMode) {
+        return TRUE;
     }
 
-    //
-    // Acknowledge (and clear) the condition that caused the interrupt.
-    // Doing this "resets" the Digital Input state change logic, and will
-    // cause it to recognize new state changes.
-    //
+    ioStack         = IoGetCurrentIrpStackLocation(WdfRequestWdmGetIrp(Request));
+    securityContext = ioStack->Parameters.Create.SecurityContext;
+
+    if (securityContext == nullptr || securityContext->AccessState == nullptr) {
+        return FALSE;
+    }
+
+    subjectContext = &securityContext->AccessState->SubjectSecurityContext;
+
+    SeLockSubjectContext(subjectContext);
+
+    administrator = SeTokenIsAdmin(SeQuerySubjectContextToken(subjectContext));
+
+    SeUnlockSubjectContext(subjectContext);
 
-    if (changeDetectReg & ChangeDetectStatus) {
+    return administrator;
+}
+
+//
+// DioUtilStartWorker
+//
+// Start the thread that does our DpcForIsr's work when it's deferred.  We
+// keep a reference to the thread (not a handle) so we can wait for it to
+// exit in DioUtilStopWorker.
+//
+_Use_decl_annotations_
+NTSTATUS
+DioUtilStartWorker(POSRDIO_DEVICE_CONTEXT DevContext)
+{
+    NTSTATUS          status;
+    HANDLE            threadHandle;
+    OBJECT_ATTRIBUTES objectAttributes;
+
+    ASSERT(DevContext->WorkerThread == nullptr);
+
+    DevContext->WorkerStop         = 0;
+    DevContext->WorkerChangedLines = 0;
+
+    KeClearEvent(&DevContext->WorkerEvent);
+
+    InitializeObjectAttributes(&objectAttributes,
+                               nullptr,
+                               OBJ_KERNEL_HANDLE,
+                               nullptr,
+                               nullptr);
+
+    status = PsCreateSystemThread(&threadHandle,
+                                  THREAD_ALL_ACCESS,
+                                  &objectAttributes,
+                                  nullptr,
+                                  nullptr,
+                                  OsrDioWorkerThread,
+                                  DevContext);
+
+    if (!NT_SUCCESS(status)) {
 #if DBG
-        DbgPrint("ACK'ing change detect\n");
+        DbgPrint("PsCreateSystemThread failed 0x%0x\n",
+                 status);
 #endif
-        //
-        // Acknowledge the state change on the Digital Input lines
-        //
-        WRITE_REGISTER_ULONG(&devContext->DevBase->ChangeDetectIRQ_Register,
-                             ChangeDetectIRQ_Acknowledge);
+        goto done;
     }
 
+    status = ObReferenceObjectByHandle(threadHandle,
+                                       SYNCHRONIZE,
+                                       *PsThreadType,
+                                       KernelMode,
+                                       (PVOID*)&DevContext->WorkerThread,
+                                       nullptr);
+
     //
-    // If there was an error on the Digital Input lines, this would also
-    // cause an interrupt. If there IS an error, ACK and clear that error
-    // (so we will get notification of subsequent line state changes)
+    // Referencing a handle we just created can't fail
     //
-    if (changeDetectReg & ChangeDetectError) {
+    ASSERT(NT_SUCCESS(status));
 
-#if DBG
-        DbgPrint("ACK'ing change detect ERROR\n");
-#endif
-        WRITE_REGISTER_ULONG(&devContext->DevBase->ChangeDetectIRQ_Register,
-                             ChangeDetectErrorIRQ_Acknowledge);
-    }
+    (void)ZwClose(threadHandle);
 
 done:
-    return returnValue;
+
+    return status;
 }
 
 //
-// OsrDioEvtInterruptDpc
-//
-// This is our DpcForIsr function, where we complete any processing that was
-// started in our ISR.
+// DioUtilStopWorker
 //
-// INPUTS:
-//  Interrupt       WDFINTERRUPT related to this call
-//  Device          WDFDEVICE handle
+// Tell our worker thread to exit, and wait for it to.  Harmless if it was
+// never started.
 //
+_Use_decl_annotations_
 VOID
-OsrDioEvtInterruptDpc(WDFINTERRUPT Interrupt,
-                      WDFOBJECT    Device)
+DioUtilStopWorker(POSRDIO_DEVICE_CONTEXT DevContext)
 {
-    POSRDIO_DEVICE_CONTEXT devContext;
-    WDFREQUEST             waitingRequest;
-    POSRDIO_COS_DATA       changeDataToReturn;
-    NTSTATUS               status;
-    ULONG_PTR              bytesReturned;
+    if (DevContext->WorkerThread == nullptr) {
+        return;
+    }
 
-    UNREFERENCED_PARAMETER(Interrupt);
+    InterlockedExchange(&DevContext->WorkerStop,
+                        1);
 
-#if DBG
-    DbgPrint("DPC for ISR...\n");
-#endif
+    KeSetEvent(&DevContext->WorkerEvent,
+               IO_NO_INCREMENT,
+               FALSE);
 
-    devContext = OsrDioGetContextFromDevice(Device);
+    (void)KeWaitForSingleObject(DevContext->WorkerThread,
+                                Executive,
+                                KernelMode,
+                                FALSE,
+                                nullptr);
+
+    ObDereferenceObject(DevContext->WorkerThread);
+
+    DevContext->WorkerThread = nullptr;
+}
+
+//
+// DioUtilCompleteChangeRequest
+//
+// Return LineState to the next IOCTL_OSRDIO_WAITFOR_CHANGE Request waiting
+// on Queue (one of the PendingQueues, or one of the PortPendingQueues), if
+// there is one.
+//
+_Use_decl_annotations_
+VOID
+DioUtilCompleteChangeRequest(WDFQUEUE Queue,
+                             ULONG    LineState)
+{
+    WDFREQUEST       waitingRequest;
+    POSRDIO_COS_DATA changeDataToReturn;
+    NTSTATUS         status;
+    ULONG_PTR        bytesReturned;
 
     //
     // IF there's a IOCTL_OSRDIO_WAITFOR_CHANGE Request that's pending,
     // get a handle to it from the Queue where we stored it earlier.
     //
-    status = WdfIoQueueRetrieveNextRequest(devContext->PendingQueue,
+    status = WdfIoQueueRetrieveNextRequest(Queue,
                                            &waitingRequest);
     //
     // If there's no Requests waiting to be notified of the state change
-    // (or if there was some other odd error) just leave the DpcForIsr.
+    // (or if there was some other odd error) there's nothing to do.
     //
     if (!NT_SUCCESS(status)) {
 
 #if DBG
         DbgPrint("RetrieveNextRequest failed.  Status = 0x%0x\n",
                  status);
-
-        DbgPrint("Leaving DPC\n");
 #endif
         goto done;
     }
@@ -1340,7 +3223,7 @@ OsrDioEvtInterruptDpc(WDFINTERRUPT Interrupt,
         //
         // Return the data to the user
         //
-        changeDataToReturn->LatchedLineState = devContext->LatchedInputLineState;
+        changeDataToReturn->LatchedLineState = LineState;
 
 #if DBG
         DbgPrint("Completing Request %p: Returning latched line state = 0x%08lx\n",
@@ -1371,179 +3254,83 @@ done:
 }
 
 //
-// Utility Routines
-//
-// We would ordinarily locate these in a separate module from the mainline
-// driver code. But given that this example driver is so short, it seems
-// more convenient to just put there here.
-//
-
-
-//
-// DioUtilProgramLineDirectionAndChangeMasks
+// DioUtilNextEventRequest
 //
-// Set the line directions (indicating which lines are used for input and
-// which for output) as well as the digtal filters for the input lines.  Also
-// program the device to interrupt whenever the state of one of the
-// input lines changes (in either direction).
+// Takes the next IOCTL_OSRDIO_READ_EVENTS Request waiting on the EventQueue,
+// with its output buffer (a batch, with room for Capacity events), for
+// DioCoreCompleteEventRequests.  A Request whose buffer we can't get is
+// completed with the error, and we try the next.  Returns FALSE if no one
+// is waiting.
 //
 _Use_decl_annotations_
-VOID
-DioUtilProgramLineDirectionAndChangeMasks(POSRDIO_DEVICE_CONTEXT DevContext)
+BOOLEAN
+DioUtilNextEventRequest(POSRDIO_DEVICE_CONTEXT DevContext,
+                        WDFREQUEST*            Request,
+                        POSRDIO_EVENT*         Events,
+                        PULONG                 Capacity)
 {
-#if DBG
-    DbgPrint("DioUtilProgramLineDirectionAndChangeMasks...\n");
-#endif
-
-    //
-    // Set digital filters on the input lines to maximum filtering, to
-    // eliminate noise-related artifacts from showing-up on input lines
-    // during state changes.
-    //
-    WRITE_REGISTER_ULONG(&DevContext->DevBase->DI_FilterRegister_Port0and1,
-                         Filter_Large_All_Lines);
+    NTSTATUS            status;
+    POSRDIO_EVENT_BATCH batch;
+    size_t              bufferLength;
 
-    WRITE_REGISTER_ULONG(&DevContext->DevBase->DI_FilterRegister_Port2and3,
-                         Filter_Large_All_Lines);
-
-    //
-    // Tell the device which lines are Digital Inputs and which are Digital
-    // Outputs
-    //
-    WRITE_REGISTER_ULONG(&DevContext->DevBase->DIO_Direction_Register,
-                         DevContext->OutputLineMask);
+    while (TRUE) {
 
-    //
-    // Having set the OUTPUT lines, set the remaining lines (which are
-    // INPUT lines) to detect state changes
-    //
+        status = WdfIoQueueRetrieveNextRequest(DevContext->EventQueue,
+                                               Request);
 
-    //
-    // Enable "rising edge" state change interrupts
-    //
-    WRITE_REGISTER_ULONG(&DevContext->DevBase->DI_ChangeIrqRE_Register,
-                         (~DevContext->OutputLineMask));
+        if (!NT_SUCCESS(status)) {
+            return FALSE;
+        }
 
-    //
-    // Enable "falling edge" state change interrupts
-    //
-    WRITE_REGISTER_ULONG(&DevContext->DevBase->DI_ChangeIrqFE_Register,
-                         (~DevContext->OutputLineMask));
-}
+        status = WdfRequestRetrieveOutputBuffer(*Request,
+                                                OSRDIO_EVENT_BATCH_SIZE(1),
+                                                (PVOID*)&batch,
+                                                &bufferLength);
 
-//
-// DioUtilResetDeviceInterrupts
-//
-// ACKs, clears, and leave DISabled all device interrupts
-//
-_Use_decl_annotations_
-VOID
-DioUtilResetDeviceInterrupts(POSRDIO_DEVICE_CONTEXT DevContext)
-{
-#if DBG
-    DbgPrint("DioUtilResetDeviceInterrupts...\n");
-#endif
+        if (NT_SUCCESS(status)) {
+            break;
+        }
 
-    //
-    // Software reset the device
-    //
-    WRITE_REGISTER_ULONG(&DevContext->DevBase->Joint_Reset_Register,
-                         Software_Reset);
+        WdfRequestCompleteWithInformation(*Request,
+                                          status,
+                                          0);
+    }
 
-    //
-    // Disable and acknowledge all interrupts (per NI Spec, section 2)
-    //
-    WRITE_REGISTER_ULONG(&DevContext->DevBase->Interrupt_Mask_Register,
-                         (Clear_CPU_Int | Clear_STC3_Int));
+    batch->TimestampFrequency = DevContext->TimestampFrequency.QuadPart;
+    batch->Flags              = 0;
 
-    WRITE_REGISTER_ULONG(&DevContext->DevBase->GlobalInterruptEnable_Register,
-                         (DI_Interrupt_Disable |
-                          WatchdogTimer_Interrupt_Disable));
+    *Events   = batch->Events;
+    *Capacity = (ULONG)((bufferLength - FIELD_OFFSET(OSRDIO_EVENT_BATCH, Events)) /
+                        sizeof(OSRDIO_EVENT));
 
-    WRITE_REGISTER_ULONG(&DevContext->DevBase->ChangeDetectIRQ_Register,
-                         (ChangeDetectIRQ_Acknowledge |
-                          ChangeDetectIRQ_Disable |
-                          ChangeDetectErrorIRQ_Acknowledge |
-                          ChangeDetectErrorIRQ_Disable));
+    return TRUE;
 }
 
 //
-// DioUtilEnableDeviceInterrupts
+// OsrDioEvtRingCanceledOnQueue
 //
-// Enables the Digital Inputs to interrupt the device's interrupt controller,
-// and the device's interrupt controller to interrupt the host.
+// The IOCTL_OSRDIO_ATTACH_EVENT_RING Request has been canceled (the
+// application asked us to, or closed its handle).  Stop using the ring
+// BEFORE we complete the Request, because completing it unlocks and unmaps
+// the ring's pages.
 //
-_Use_decl_annotations_
 VOID
-DioUtilEnableDeviceInterrupts(POSRDIO_DEVICE_CONTEXT DevContext)
+OsrDioEvtRingCanceledOnQueue(WDFQUEUE   Queue,
+                             WDFREQUEST Request)
 {
-#if DBG
-    DbgPrint("DioUtilEnableDeviceInterrupts...\n");
-#endif
-
-    //
-    // Enable interrupts from the Digital Inputs 
-    //
-    WRITE_REGISTER_ULONG(&DevContext->DevBase->GlobalInterruptEnable_Register,
-                         DI_Interrupt_Enable);
-
-    //
-    // And enable interrupts as a result of state changes on the Digital Input
-    // lines
-    //
-    WRITE_REGISTER_ULONG(&DevContext->DevBase->ChangeDetectIRQ_Register,
-                         (ChangeDetectErrorIRQ_Enable |
-                          ChangeDetectIRQ_Enable));
-
-    //
-    // Enable interrupts from the device to the host
-    //
-    WRITE_REGISTER_ULONG(&DevContext->DevBase->Interrupt_Mask_Register,
-                         (Set_CPU_Int | Set_STC3_Int));
-}
+    POSRDIO_DEVICE_CONTEXT devContext;
 
-//
-// DioUtilDeviceReset
-//
-// Puts the device in a known, pristine, condition... ready to accept user
-// commands.  All previous settings on the device are lost/reset.
-//
-_Use_decl_annotations_
-VOID
-DioUtilDeviceReset(POSRDIO_DEVICE_CONTEXT DevContext)
-{
 #if DBG
-    DbgPrint("DioUtilDeviceReset...\n");
+    DbgPrint("Event ring detached\n");
 #endif
 
-    //
-    // Reset/Clear/ACK any interrupts on the device
-    //
-    DioUtilResetDeviceInterrupts(DevContext);
-
-    //
-    // Set all lines for INPUT, and ensure the output line state is
-    // set to "all lines DEASSERTED"
-    //
-    WRITE_REGISTER_ULONG(&DevContext->DevBase->DIO_Direction_Register,
-                         0x00000000);
-
-    //
-    // Reset the device's idea of the output line state, just in case it
-    // "remembers" a previous state from when the output lines were enabled.
-    //
-    WRITE_REGISTER_ULONG(&DevContext->DevBase->Static_Digital_Output_Register,
-                         0x00000000);
+    devContext = OsrDioGetContextFromDevice(WdfIoQueueGetDevice(Queue));
 
-    //
-    // Set the change detect registers to zeros.  We set these to functional
-    // values when we set the OUTPUT mask.
-    //
-    WRITE_REGISTER_ULONG(&DevContext->DevBase->DI_ChangeIrqRE_Register,
-                         0x00000000);
+    DioCoreDetachEventRing(devContext);
 
-    WRITE_REGISTER_ULONG(&DevContext->DevBase->DI_ChangeIrqFE_Register,
-                         0x00000000);
+    WdfRequestCompleteWithInformation(Request,
+                                      STATUS_CANCELLED,
+                                      0);
 }
 
 #if DBG
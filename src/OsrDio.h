@@ -39,8 +39,8 @@
 #pragma once
 
 //
-// Standard Windows headers
-#include <wdm.h> 
+// Standard Windows headers (ntifs.h, rather than wdm.h, for SeTokenIsAdmin)
+#include <ntifs.h>
 #include <wdf.h>
 
 #define OSR_FIX_ZERO_BUG_ON_1909    1
@@ -69,157 +69,177 @@
 //
 #pragma warning(disable: 26493 26461 26494 26464 26438 26489)
 
-//
-// The size of the device memory area on the NI PCIe-6509
-//
-constexpr ULONG DIO_BAR_SIZE = 512 * 1024;
-
+// ReSharper disable once CppUnusedIncludeDirective
+#include "DioRegisters.h"
+#include "DioDriverCore.h"
 
 // ReSharper disable CppInconsistentNaming
 
 //
-// Macros for building a structure for the register map, even though
-// the map is large and non-contiguous.
+// DIO_REGISTERS
 //
-// We thank @shuffle2 via ghettoha.xxx for inspiring this technique
+// The device's BAR, as we map it.  The NI PCIe-6509 has a register map that
+// is spread-out through its 512K of Memory Mapped I/O space.  The registers
+// are described in DioRegisters.h, and they're only accessed with
+// DioRegisterRead and DioRegisterWrite, through the backend below (so the
+// structure itself is never defined).
 //
-// ReSharper disable CppClangTidyCppcoreguidelinesMacroUsage
-// ReSharper disable IdentifierTypo
+typedef struct _DIO_REGISTERS DIO_REGISTERS, *PDIO_REGISTERS;
 
-#define CAT_(x, y) x ## y
-#define CAT(x, y) CAT_(x, y)
+template <>
+struct DioRegisterBackend<PDIO_REGISTERS>
+{
+    typedef ULONG Value;
+
+    static ULONG Read(PDIO_REGISTERS Bar,
+                      ULONG          Offset)
+    {
+        return READ_REGISTER_ULONG(reinterpret_cast<PULONG>(reinterpret_cast<PUCHAR>(Bar) + Offset));
+    }
+
+    static VOID Write(PDIO_REGISTERS Bar,
+                      ULONG          Offset,
+                      ULONG          RegisterValue)
+    {
+        WRITE_REGISTER_ULONG(reinterpret_cast<PULONG>(reinterpret_cast<PUCHAR>(Bar) + Offset),
+                             RegisterValue);
+    }
+};
+
+//
+// Register profiling (see IOCTL_OSRDIO_GET_REGISTER_PROFILE)
+//
+// In builds that profile, each register is accessed through a
+// DIO_PROFILED_BAR: a DioRegisterTracer around our MMIO backend, whose
+// policy (DIO_REGISTER_PROFILER) holds the path (OSRDIO_REGISTER_PATH_xxx)
+// making the access, and counts and times the access and records it in
+// the register trace (see IOCTL_OSRDIO_GET_REGISTER_TRACE).  In other builds, a DIO_BAR is
+// just our PDIO_REGISTERS, so the profiling costs nothing.  Either way,
+// code gets its DIO_BAR from DioUtilBar.
+//
+#ifndef OSRDIO_REGISTER_PROFILING
+#define OSRDIO_REGISTER_PROFILING DBG
+#endif
 
-#define REGPAD(_size_) UCHAR CAT(_pad_, __COUNTER__)[_size_]
-#define REGSTRUCT_START(_name_, _size_) typedef struct _##_name_ { union { REGPAD(_size_);
-#define REGSTRUCT_END(_name_) };} _name_, *P##_name_  // NOLINT(bugprone-macro-parentheses)
+#if OSRDIO_REGISTER_PROFILING
 
-#define REGDEF_ULONG(_field_, _off_) struct { REGPAD(_off_); ULONG _field_; }
-#define REGDEF(_off_, _field_) struct { REGPAD(_off_); _field_; }
+static_assert(DIO_REGISTER_COUNT <= OSRDIO_PROFILE_REGISTERS,
+              "OSRDIO_REGISTER_PROFILE can't hold every register");
+
+static_assert((OSRDIO_REGISTER_TRACE_ENTRIES & (OSRDIO_REGISTER_TRACE_ENTRIES - 1)) == 0,
+              "OSRDIO_REGISTER_TRACE_ENTRIES must be a power of two");
 
 //
-// DIO_REGISTERS Structure Definition
-//
-// The NI PCIe-6509 has a register map that is spread-out through its
-// 512K of Memory Mapper I/O space. We define a typedef'ed structure
-// named "DIO_REGISTERS" that describes the register map using the
-// macros defined above.  The registers are all 32-bits wide.
-//
-// All register names are as specified in the NI documentation.
-//
-REGSTRUCT_START(DIO_REGISTERS, DIO_BAR_SIZE);
-         ULONG CHInCh_Identification_Register;    // This register is at offset 0
+// DIO_REGISTER_TRACE_RING
 //
+// The register trace: Next counts every entry ever recorded, First is what
+// it was at StartTime (when the trace was last started), and entry n is in
+// Slots[n % OSRDIO_REGISTER_TRACE_ENTRIES].  A slot's Sequence is n + 1
+// once entry n is in it, and 0 while an entry is being written to it, so
+// the trace can be copied without stopping anyone adding to it (see
+// DioUtilTraceCopy).
 //
-//                                                     OFFSET
-//              REGISTER NAME                          from BAR 0
-//              ==============================         ==========
-REGDEF_ULONG(   Static_Digital_Input_Register,         0x20530   );
+typedef struct _DIO_REGISTER_TRACE_SLOT {
+    volatile LONG64             Sequence;
+    OSRDIO_REGISTER_TRACE_ENTRY Entry;
+} DIO_REGISTER_TRACE_SLOT, *PDIO_REGISTER_TRACE_SLOT;
 
-REGDEF_ULONG(   Static_Digital_Output_Register,        0x204B0   );
-REGDEF_ULONG(   DIO_Direction_Register,                0x204B4   );
-REGDEF_ULONG(   DI_FilterRegister_Port0and1,           0x2054C   );
-REGDEF_ULONG(   DI_FilterRegister_Port2and3,           0x20550   );
+typedef struct _DIO_REGISTER_TRACE_RING {
+    LARGE_INTEGER               StartTime;
+    LONG64                      First;
+    volatile LONG64             Next;
+    DIO_REGISTER_TRACE_SLOT     Slots[OSRDIO_REGISTER_TRACE_ENTRIES];
+} DIO_REGISTER_TRACE_RING, *PDIO_REGISTER_TRACE_RING;
 
-//
-// DIO Change of State (RE = "Rising Edge", FE "Falling Edge")
-// and DIO Interrupt Registers
-//
-REGDEF_ULONG(   ChangeDetectStatusRegister,            0x20540   );  // READ
-REGDEF_ULONG(   DI_ChangeIrqRE_Register,               0x20540   );  // WRITE
-REGDEF_ULONG(   DI_ChangeIrqFE_Register,               0x20544   );  // WRITE
-REGDEF_ULONG(   DI_ChangeDetectLatched_Register,       0x20544   );
+typedef struct _DIO_REGISTER_PROFILER DIO_REGISTER_PROFILER;
 
-REGDEF_ULONG(   GlobalInterruptStatus_Register,        0x20070   );
-REGDEF_ULONG(   GlobalInterruptEnable_Register,        0x20078   );
-REGDEF_ULONG(   DI_Interrupt_Status_Register,          0x2007E   );
-REGDEF_ULONG(   ChangeDetectIRQ_Register,              0x20554   );
+VOID DioUtilProfileAccess(_In_ const DIO_REGISTER_PROFILER& Profiler,
+                          _In_ ULONG                        Offset,
+                          _In_ ULONG                        RegisterValue,
+                          _In_ LARGE_INTEGER                StartTime,
+                          _In_ BOOLEAN                      Write);
 
-//
-// Board-Wide Interrupt Controller Registers
-//
-REGDEF_ULONG(   Interrupt_Mask_Register,               0x0005C   );
-REGDEF_ULONG(   Interrupt_Status_Register,             0x00060   );
-REGDEF_ULONG(   Volatile_Interrupt_Status_Register,    0x00068   );
-REGDEF_ULONG(   IntForwarding_ControlStatus,           0x22204   );
-REGDEF_ULONG(   IntForwarding_DestinationReg,          0x22208   );
+VOID DioUtilTraceRecord(_Inout_ PDIO_REGISTER_TRACE_RING Trace,
+                        _In_ LARGE_INTEGER               Time,
+                        _In_ ULONG                       Value,
+                        _In_ UCHAR                       Register,
+                        _In_ UCHAR                       Kind,
+                        _In_ UCHAR                       Path);
 
+VOID DioUtilTraceCopy(_In_ PDIO_REGISTER_TRACE_RING Trace,
+                      _Out_ POSRDIO_REGISTER_TRACE  TraceBuffer);
+
+//
+// DIO_REGISTER_PROFILER
 //
-// Miscellaneous Board-Level Registers
+// The DioRegisterTracer policy (see DioRegisters.h) that profiles and
+// traces the accesses made by code on Path
 //
-REGDEF_ULONG(   Scrap_Register,                        0X00200   );
-REGDEF_ULONG(   PCI_Subsystem_ID_Access_Register,      0x010AC   );
-REGDEF_ULONG(   ScratchpadRegister,                    0x20004   );
-REGDEF_ULONG(   Signature_Register,                    0x20060   );
-REGDEF_ULONG(   Joint_Reset_Register,                  0x20064   );  // WRITE
-REGDEF_ULONG(   TimeSincePowerUpRegister,              0x20064   );  // READ
+struct _DIO_REGISTER_PROFILER {
+    POSRDIO_REGISTER_PROFILE    Profile;
+    PDIO_REGISTER_TRACE_RING    Trace;
+    ULONG                       Path;
 
-REGSTRUCT_END(DIO_REGISTERS);
+    typedef LARGE_INTEGER Stamp;
 
-// ReSharper disable IdentifierTypo
-// ReSharper restore CppClangTidyCppcoreguidelinesMacroUsage
+    bool Enabled() const
+    {
+        return true;
+    }
 
-constexpr ULONG BIT_NUMBER(int x)
-{
-    return (ULONG)1<<x;
-}
+    LARGE_INTEGER Begin() const
+    {
+        return KeQueryPerformanceCounter(nullptr);
+    }
 
-//
-// Bit definitions for above registers
-//
-// (all names as specified in the NI documentation)
-//
+    VOID End(ULONG         Offset,
+             ULONG         RegisterValue,
+             LARGE_INTEGER StartTime,
+             bool          Write) const
+    {
+        DioUtilProfileAccess(*this,
+                             Offset,
+                             RegisterValue,
+                             StartTime,
+                             Write ? TRUE : FALSE);
+    }
+};
 
-// Bit Definitions: Interrupt_Mask_Register
-constexpr ULONG Set_CPU_Int     = BIT_NUMBER(31);
-constexpr ULONG Clear_CPU_Int   = BIT_NUMBER(30);
-constexpr ULONG Set_STC3_Int    = BIT_NUMBER(11);
-constexpr ULONG Clear_STC3_Int  = BIT_NUMBER(10);
+typedef DioRegisterTracer<PDIO_REGISTERS, DIO_REGISTER_PROFILER> DIO_PROFILED_BAR;
 
-// Bit Definitions: GlobalInterruptEnable_Register
-constexpr ULONG WatchdogTimer_Interrupt_Disable = BIT_NUMBER(26);
-constexpr ULONG DI_Interrupt_Disable            = BIT_NUMBER(22);
-constexpr ULONG WatchdogTimer_Interrupt_Enable  = BIT_NUMBER(10);
-constexpr ULONG DI_Interrupt_Enable             = BIT_NUMBER(6);
+typedef DIO_PROFILED_BAR DIO_BAR;
 
+#else
 
-// Bit Definitions: ChangeDetectIRQ_Register
-constexpr ULONG ChangeDetectErrorIRQ_Enable         = BIT_NUMBER(7);
-constexpr ULONG ChangeDetectErrorIRQ_Disable        = BIT_NUMBER(6);
-constexpr ULONG ChangeDetectIRQ_Enable              = BIT_NUMBER(5);
-constexpr ULONG ChangeDetectIRQ_Disable             = BIT_NUMBER(4);
-constexpr ULONG ChangeDetectErrorIRQ_Acknowledge    = BIT_NUMBER(1);
-constexpr ULONG ChangeDetectIRQ_Acknowledge         = BIT_NUMBER(0);
-
-// Bit Definitions: Joint_Reset_Register
-constexpr ULONG Software_Reset  = BIT_NUMBER(0);
+typedef PDIO_REGISTERS DIO_BAR;
 
+#endif
 
-// Bit Defintions: ChangeDetectStatusRegister
-constexpr ULONG ChangeDetectError   = BIT_NUMBER(1);
-constexpr ULONG ChangeDetectStatus  = BIT_NUMBER(0);
+// ReSharper restore CppInconsistentNaming
 
 //
-// Bit Definitions: Interrupt_Status_Register
+// DIO_LINE_REGISTERS
 //
-constexpr ULONG Int             = BIT_NUMBER(31);
-constexpr ULONG Additional_Int  = BIT_NUMBER(30);
-constexpr ULONG External        = BIT_NUMBER(29);
-constexpr ULONG DAQ_STC3_Int    = BIT_NUMBER(11);
-
-//
-// Bit Definitions: Volatile_Interrupt_Status_Register
+// The registers that set up the lines (the ones that DioCoreProgramLines
+// programs), as we last wrote them
 //
-constexpr ULONG Vol_Int             = BIT_NUMBER(31);
-constexpr ULONG Vol_Additional_Int  = BIT_NUMBER(30);
-constexpr ULONG Vol_External        = BIT_NUMBER(29);
-constexpr ULONG Vol_STC3_Int        = BIT_NUMBER(11);
+typedef struct _DIO_LINE_REGISTERS {
+    ULONG   FilterPort0and1;
+    ULONG   FilterPort2and3;
+    ULONG   Output;
+    ULONG   Direction;
+    ULONG   RisingEdges;
+    ULONG   FallingEdges;
+} DIO_LINE_REGISTERS, *PDIO_LINE_REGISTERS;
 
 //
-// Bit Definitions: DI_FilterRegister_Port0and1, DI_FilterRegister_Port2and3
+// Number of entries in the ring of timestamped change events that the ISR
+// fills and IOCTL_OSRDIO_READ_EVENTS drains.  Must be a power of two.
 //
-constexpr ULONG Filter_Large_All_Lines = 0xFFFFFFFF;
+constexpr ULONG OSRDIO_EVENT_RING_SIZE = 256;
 
-// ReSharper restore CppInconsistentNaming
+static_assert((OSRDIO_EVENT_RING_SIZE & (OSRDIO_EVENT_RING_SIZE - 1)) == 0,
+              "OSRDIO_EVENT_RING_SIZE must be a power of two");
 
 //
 // Device Context
@@ -232,16 +252,173 @@ typedef struct _OSRDIO_DEVICE_CONTEXT
     PDIO_REGISTERS      DevBase;
     ULONG               MappedLength;
 
-    WDFQUEUE            PendingQueue;
-
+    //
+    // Requests from handles to the whole device are processed on
+    // DeviceQueue, and those from handles to a port (see OSRDIO_PORT_COUNT)
+    // on that port's PortQueue.  Each is a sequential Queue of its own, so
+    // a port's Requests never wait for another port's.  Our default Queue
+    // just sends each Request to the right one.
+    //
+    // IOCTL_OSRDIO_WAITFOR_CHANGE Requests wait on PendingQueue (any
+    // change) or their port's PortPendingQueue (changes on that port's
+    // lines), one for each priority class.  The ISR accumulates the lines
+    // that changed in DpcChangedLines for the DpcForIsr, which completes
+    // the realtime and normal Requests, and accumulates them again in
+    // BackgroundChangedLines (with the line state in BackgroundLineState)
+    // for BackgroundWorkItem, which completes the background ones.  The
+    // work item is only queued when a background Request is waiting, and
+    // BackgroundChangedLines was empty (otherwise it's queued already).
+    //
+    WDFQUEUE            DeviceQueue;
+    WDFQUEUE            PortQueue[OSRDIO_PORT_COUNT];
+
+    WDFQUEUE            PendingQueue[OSRDIO_PRIORITY_COUNT];
+    WDFQUEUE            PortPendingQueue[OSRDIO_PORT_COUNT][OSRDIO_PRIORITY_COUNT];
+    volatile LONG       DpcChangedLines;
+
+    WDFWORKITEM         BackgroundWorkItem;
+    volatile LONG       BackgroundChangedLines;
+    volatile LONG       BackgroundLineState;
+
+    //
+    // OutputLineMask is every line reserved for output, by any handle (see
+    // OSRDIO_FILE_CONTEXT) or by our line profile.  The reservations don't
+    // overlap, so we keep it up to date by swapping a handle's old lines
+    // for its new ones.  It, and OutputLineState, are read and changed
+    // holding OutputLock (handles can be closed while we're processing a
+    // Request).  The line registers are written holding OutputLock and
+    // then our interrupt lock, on every path, so our ISR never sees them
+    // half done.  The only exceptions are our power callbacks, which WDF
+    // never runs alongside our power-managed Queues, and which bring the
+    // device into D0 (or take it out) before FileCleanup can touch it.
+    //
+    WDFSPINLOCK         OutputLock;
     ULONG               OutputLineMask;
 
+    //
+    // What we last wrote to Static_Digital_Output_Register, so a handle can
+    // write its lines without changing anyone else's
+    //
+    ULONG               OutputLineState;
+
     ULONG               SavedOutputLineState;
 
+    //
+    // Our line profile, read from our hardware key at PrepareHardware, and
+    // the profile's output lines that no handle has reserved (these are
+    // part of OutputLineMask too)
+    //
+    OSRDIO_LINE_PROFILE Profile;
+    ULONG               ProfileOutputLines;
+
+    //
+    // What we last wrote to the line registers, so we only write the ones
+    // that change.  After a software reset we don't know, so until they've
+    // all been written again, LineRegistersValid is FALSE.  Protected as
+    // the line registers are (see OutputLock).
+    //
+    DIO_LINE_REGISTERS  LineRegisters;
+    BOOLEAN             LineRegistersValid;
+
     ULONG               LatchedInputLineState;
 
+    //
+    // Timestamped change events.  The ISR is the only producer (it advances
+    // EventRingHead) and DioCoreCompleteEventRequests is the only consumer
+    // (it advances EventRingTail, holding EventLock and the interrupt lock).
+    //
+    WDFQUEUE            EventQueue;
+    WDFSPINLOCK         EventLock;
+    LARGE_INTEGER       TimestampFrequency;
+
+    ULONG               EventRingHead;
+    ULONG               EventRingTail;
+    BOOLEAN             EventRingOverflow;
+    OSRDIO_EVENT        EventRing[OSRDIO_EVENT_RING_SIZE];
+
+    //
+    // The application's ring, attached with IOCTL_OSRDIO_ATTACH_EVENT_RING.
+    // The ATTACH Request stays on RingQueue while the ring is attached.
+    // SharedRing is only set or cleared holding the interrupt lock, and the
+    // ISR is the only one that stores events into it.  SharedRingHead is
+    // our private copy of the ring's ProducerIndex, because the application
+    // can scribble on the copy in the ring.
+    //
+    WDFQUEUE            RingQueue;
+    WDFQUEUE            RingWaitQueue;
+    POSRDIO_EVENT_RING  SharedRing;
+    ULONG               SharedRingMask;
+    ULONG               SharedRingHead;
+
+    //
+    // Deferred processing (see IOCTL_OSRDIO_GET_DPC_STATS).  With
+    // DeferredProcessing set, the DpcForIsr accumulates the lines that
+    // changed in WorkerChangedLines (and the line state in WorkerLineState)
+    // and sets WorkerEvent, and WorkerThread does the rest.  The thread
+    // runs from PrepareHardware to ReleaseHardware.
+    //
+    BOOLEAN             DeferredProcessing;
+    PKTHREAD            WorkerThread;
+    KEVENT              WorkerEvent;
+    volatile LONG       WorkerStop;
+    volatile LONG       WorkerChangedLines;
+    volatile LONG       WorkerLineState;
+
+    OSRDIO_DPC_STATS    DpcStats;
+
+#if OSRDIO_REGISTER_PROFILING
+    OSRDIO_REGISTER_PROFILE RegisterProfile;
+    DIO_REGISTER_TRACE_RING RegisterTrace;
+#endif
+
+    //
+    // Processor affinity (see OsrDio_IOCTL.h).  While DpcProcessor isn't
+    // OSRDIO_ANY_PROCESSOR, the ISR queues TargetedDpc (which is targeted
+    // at it) instead of our DpcForIsr.  DpcProcessor is only changed
+    // holding the interrupt lock.
+    //
+    WDFDPC              TargetedDpc;
+    volatile ULONG      DpcProcessor;
+
+    //
+    // Wake on input change (see OsrDioEvtDeviceArmWakeFromS0).  WakeArmed
+    // is set while we're armed to wake, and ChangeDetectLeftArmed when
+    // EvtInterruptDisable left change detection running because we were.
+    // WakeChangeLatched is set when we come back to D0 and find a change
+    // was caught while we were idle, and WakeTriggered when our device
+    // signalled the wake, so the next EvtDeviceArmWakeFromS0 can tell
+    // whether a change really wakes the device.
+    //
+    BOOLEAN             WakeOnChange;
+    BOOLEAN             WakeArmed;
+    BOOLEAN             ChangeDetectLeftArmed;
+    BOOLEAN             WakeChangeLatched;
+    BOOLEAN             WakeTriggered;
+
 }   OSRDIO_DEVICE_CONTEXT, *POSRDIO_DEVICE_CONTEXT;
 
+//
+// File Object Context
+//
+// The lines this handle has reserved for output, with
+// IOCTL_OSRDIO_SET_OUTPUTS, and the port it was opened on (OSRDIO_NO_PORT
+// for the whole device) and that port's lines.  Administrator is whether
+// it was opened by an administrator, who alone may change the device's
+// settings.
+//
+constexpr ULONG OSRDIO_NO_PORT = 0xFFFFFFFF;
+
+typedef struct _OSRDIO_FILE_CONTEXT
+{
+    ULONG               OutputLines;
+
+    ULONG               Port;
+    ULONG               PortLines;
+
+    BOOLEAN             Administrator;
+
+}   OSRDIO_FILE_CONTEXT, *POSRDIO_FILE_CONTEXT;
+
 //
 // Define data type of our device context structure, and also
 // create the helper function OsrDioGetContextFromDevice that will
@@ -249,6 +426,86 @@ typedef struct _OSRDIO_DEVICE_CONTEXT
 //
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(OSRDIO_DEVICE_CONTEXT, OsrDioGetContextFromDevice)
 
+WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(OSRDIO_FILE_CONTEXT, OsrDioGetContextFromFileObject)
+
+//
+// DioUtilBar
+//
+// The DIO_BAR for code on Path (OSRDIO_REGISTER_PATH_xxx) to access our
+// device's registers through
+//
+inline DIO_BAR
+DioUtilBar(_In_ POSRDIO_DEVICE_CONTEXT DevContext,
+           _In_ ULONG                  Path)
+{
+#if OSRDIO_REGISTER_PROFILING
+    return { DevContext->DevBase, { &DevContext->RegisterProfile, &DevContext->RegisterTrace, Path } };
+#else
+    UNREFERENCED_PARAMETER(Path);
+
+    return DevContext->DevBase;
+#endif
+}
+
+//
+// DioUtilProfileRun
+//
+// Counts one run of the code on Path, when we're profiling register
+// accesses
+//
+inline VOID
+DioUtilProfileRun(_In_ POSRDIO_DEVICE_CONTEXT DevContext,
+                  _In_ ULONG                  Path)
+{
+#if OSRDIO_REGISTER_PROFILING
+    InterlockedIncrement64((volatile LONG64*)&DevContext->RegisterProfile.Runs[Path]);
+#else
+    UNREFERENCED_PARAMETER(DevContext);
+    UNREFERENCED_PARAMETER(Path);
+#endif
+}
+
+//
+// DioUtilTraceStart, DioUtilTracePower
+//
+// Start the register trace again, empty, and record a change in the
+// device's power state (OSRDIO_TRACE_D0 and so on) in it, when we're
+// profiling register accesses
+//
+inline VOID
+DioUtilTraceStart(_In_ POSRDIO_DEVICE_CONTEXT DevContext)
+{
+#if OSRDIO_REGISTER_PROFILING
+    //
+    // Next keeps counting (rather than going back to 0), so no slot's
+    // Sequence can be mistaken for a new entry's
+    //
+    DevContext->RegisterTrace.StartTime = KeQueryPerformanceCounter(nullptr);
+    DevContext->RegisterTrace.First     = InterlockedCompareExchange64(&DevContext->RegisterTrace.Next,
+                                                                       0,
+                                                                       0);
+#else
+    UNREFERENCED_PARAMETER(DevContext);
+#endif
+}
+
+inline VOID
+DioUtilTracePower(_In_ POSRDIO_DEVICE_CONTEXT DevContext,
+                  _In_ ULONG                  PowerState)
+{
+#if OSRDIO_REGISTER_PROFILING
+    DioUtilTraceRecord(&DevContext->RegisterTrace,
+                       KeQueryPerformanceCounter(nullptr),
+                       PowerState,
+                       0,
+                       OSRDIO_TRACE_POWER,
+                       OSRDIO_REGISTER_PATH_POWER);
+#else
+    UNREFERENCED_PARAMETER(DevContext);
+    UNREFERENCED_PARAMETER(PowerState);
+#endif
+}
+
 //
 // Forward Declarations
 //
@@ -266,26 +523,416 @@ EVT_WDF_DEVICE_PREPARE_HARDWARE OsrDioEvtDevicePrepareHardware;
 EVT_WDF_DEVICE_RELEASE_HARDWARE OsrDioEvtDeviceReleaseHardware;
 EVT_WDF_DEVICE_D0_ENTRY OsrDioEvtDeviceD0Entry;
 EVT_WDF_DEVICE_D0_EXIT OsrDioEvtDeviceD0Exit;
+EVT_WDF_DEVICE_ARM_WAKE_FROM_S0 OsrDioEvtDeviceArmWakeFromS0;
+EVT_WDF_DEVICE_DISARM_WAKE_FROM_S0 OsrDioEvtDeviceDisarmWakeFromS0;
+EVT_WDF_DEVICE_WAKE_FROM_S0_TRIGGERED OsrDioEvtDeviceWakeFromS0Triggered;
+
+EVT_WDF_DEVICE_FILE_CREATE OsrDioEvtDeviceFileCreate;
+EVT_WDF_FILE_CLEANUP OsrDioEvtFileCleanup;
 
+EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL OsrDioEvtIoDispatchToQueue;
 EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL OsrDioEvtIoDeviceControl;
+EVT_WDF_IO_QUEUE_IO_CANCELED_ON_QUEUE OsrDioEvtRingCanceledOnQueue;
 
 EVT_WDF_INTERRUPT_ENABLE OsrDioEvtInterruptEnable;
 EVT_WDF_INTERRUPT_DISABLE OsrDioEvtInterruptDisable;
 EVT_WDF_INTERRUPT_ISR OsrDioEvtInterruptIsr;
 EVT_WDF_INTERRUPT_DPC OsrDioEvtInterruptDpc;
+EVT_WDF_DPC OsrDioEvtTargetedDpc;
+
+EVT_WDF_WORKITEM OsrDioEvtBackgroundWorkItem;
+
+KSTART_ROUTINE OsrDioWorkerThread;
 
 //
 // Utility functions
 //
 
-VOID DioUtilProgramLineDirectionAndChangeMasks(_In_ POSRDIO_DEVICE_CONTEXT DevContext);
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID DioUtilRecordTiming(_Inout_ POSRDIO_TIMING Timing,
+                         _In_ LONGLONG          Frequency,
+                         _In_ LONGLONG          StartTime);
+
+_IRQL_requires_(PASSIVE_LEVEL)
+ULONG DioUtilQueryParameter(_In_opt_ WDFKEY        Key,
+                            _In_ PCUNICODE_STRING ValueName,
+                            _In_ ULONG            DefaultValue);
 
-VOID DioUtilResetDeviceInterrupts(_In_ POSRDIO_DEVICE_CONTEXT DevContext);
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID DioUtilLoadProfile(_In_ POSRDIO_DEVICE_CONTEXT DevContext);
 
-VOID DioUtilEnableDeviceInterrupts(_In_ POSRDIO_DEVICE_CONTEXT DevContext);
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS DioUtilSaveProfile(_In_ POSRDIO_DEVICE_CONTEXT DevContext,
+                            _In_ POSRDIO_LINE_PROFILE   Profile);
 
-VOID DioUtilDeviceReset(_In_ POSRDIO_DEVICE_CONTEXT DevContext);
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID DioUtilSetInterruptPolicy(_In_ POSRDIO_DEVICE_CONTEXT DevContext,
+                               _In_ ULONG                  Policy,
+                               _In_ ULONG                  Processor);
+
+_IRQL_requires_(PASSIVE_LEVEL)
+BOOLEAN DioUtilCallerIsAdministrator(_In_ WDFREQUEST Request);
+
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS DioUtilStartWorker(_In_ POSRDIO_DEVICE_CONTEXT DevContext);
+
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID DioUtilStopWorker(_In_ POSRDIO_DEVICE_CONTEXT DevContext);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID DioUtilCompleteChangeRequest(_In_ WDFQUEUE Queue,
+                                  _In_ ULONG    LineState);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN DioUtilNextEventRequest(_In_ POSRDIO_DEVICE_CONTEXT DevContext,
+                                _Out_ WDFREQUEST*           Request,
+                                _Out_ POSRDIO_EVENT*        Events,
+                                _Out_ PULONG                Capacity);
 
 #if DBG
 VOID DioUtilDisplayResources(_In_ WDFCMRESLIST Resources, _In_ WDFCMRESLIST ResourcesTranslated);
 #endif
+
+//
+// The core of our driver (see DioDriverCore.h) runs against our device
+// context through this.  The core's constants are ours.
+//
+static_assert(DIO_CORE_PORT_COUNT == OSRDIO_PORT_COUNT &&
+              DIO_CORE_LINES_PER_PORT == OSRDIO_LINES_PER_PORT &&
+              DIO_CORE_NO_PORT == OSRDIO_NO_PORT,
+              "DioDriverCore.h's ports aren't ours");
+
+static_assert(DIO_CORE_PRIORITY_REALTIME == OSRDIO_PRIORITY_REALTIME &&
+              DIO_CORE_PRIORITY_NORMAL == OSRDIO_PRIORITY_NORMAL &&
+              DIO_CORE_PRIORITY_BACKGROUND == OSRDIO_PRIORITY_BACKGROUND &&
+              DIO_CORE_PRIORITY_COUNT == OSRDIO_PRIORITY_COUNT,
+              "DioDriverCore.h's priority classes aren't ours");
+
+static_assert(DIO_CORE_ANY_PROCESSOR == OSRDIO_ANY_PROCESSOR,
+              "DioDriverCore.h's untargeted DPC isn't ours");
+
+static_assert(DIO_CORE_PATH_ISR == OSRDIO_REGISTER_PATH_ISR &&
+              DIO_CORE_PATH_DPC == OSRDIO_REGISTER_PATH_DPC &&
+              DIO_CORE_PATH_IOCTL == OSRDIO_REGISTER_PATH_IOCTL &&
+              DIO_CORE_PATH_POWER == OSRDIO_REGISTER_PATH_POWER,
+              "DioDriverCore.h's register paths aren't ours");
+
+template <>
+struct DioCoreBackend<POSRDIO_DEVICE_CONTEXT>
+{
+    typedef NTSTATUS           Status;
+    typedef OSRDIO_EVENT       Event;
+    typedef POSRDIO_EVENT_RING EventRingPointer;
+    typedef WDFREQUEST         EventRequest;
+
+    static constexpr NTSTATUS Success            = STATUS_SUCCESS;
+    static constexpr NTSTATUS SharingViolation   = STATUS_SHARING_VIOLATION;
+    static constexpr NTSTATUS InvalidDeviceState = STATUS_INVALID_DEVICE_STATE;
+    static constexpr NTSTATUS InvalidParameter   = STATUS_INVALID_PARAMETER;
+
+    static constexpr ULONG EventRingSize = OSRDIO_EVENT_RING_SIZE;
+
+    static DIO_BAR Bar(POSRDIO_DEVICE_CONTEXT DevContext,
+                       ULONG                  Path)
+    {
+        return DioUtilBar(DevContext, Path);
+    }
+
+    static bool ShadowLineRegisters(POSRDIO_DEVICE_CONTEXT DevContext)
+    {
+        UNREFERENCED_PARAMETER(DevContext);
+
+        return true;
+    }
+
+    static VOID AcquireOutputLock(POSRDIO_DEVICE_CONTEXT DevContext)
+    {
+        WdfSpinLockAcquire(DevContext->OutputLock);
+    }
+
+    static VOID ReleaseOutputLock(POSRDIO_DEVICE_CONTEXT DevContext)
+    {
+        WdfSpinLockRelease(DevContext->OutputLock);
+    }
+
+    static VOID AcquireInterruptLock(POSRDIO_DEVICE_CONTEXT DevContext)
+    {
+        WdfInterruptAcquireLock(DevContext->WdfInterrupt);
+    }
+
+    static VOID ReleaseInterruptLock(POSRDIO_DEVICE_CONTEXT DevContext)
+    {
+        WdfInterruptReleaseLock(DevContext->WdfInterrupt);
+    }
+
+    static VOID AcquireEventLock(POSRDIO_DEVICE_CONTEXT DevContext)
+    {
+        WdfSpinLockAcquire(DevContext->EventLock);
+    }
+
+    static VOID ReleaseEventLock(POSRDIO_DEVICE_CONTEXT DevContext)
+    {
+        WdfSpinLockRelease(DevContext->EventLock);
+    }
+
+    static ULONG Exchange(volatile LONG* Target,
+                          ULONG          Value)
+    {
+        return (ULONG)InterlockedExchange(Target, (LONG)Value);
+    }
+
+    static ULONG Or(volatile LONG* Target,
+                    ULONG          Value)
+    {
+        return (ULONG)InterlockedOr(Target, (LONG)Value);
+    }
+
+    static ULONG Load(volatile LONG* Target)
+    {
+        return (ULONG)InterlockedCompareExchange(Target, 0, 0);
+    }
+
+    static OSRDIO_EVENT MakeEvent(POSRDIO_DEVICE_CONTEXT DevContext,
+                                  ULONG                  LineState,
+                                  ULONG                  ChangedLines)
+    {
+        OSRDIO_EVENT newEvent;
+
+        UNREFERENCED_PARAMETER(DevContext);
+
+        newEvent.Timestamp        = KeQueryPerformanceCounter(nullptr).QuadPart;
+        newEvent.LatchedLineState = LineState;
+        newEvent.ChangedLines     = ChangedLines;
+
+        return newEvent;
+    }
+
+    static ULONGLONG TimestampFrequency(POSRDIO_DEVICE_CONTEXT DevContext)
+    {
+        return DevContext->TimestampFrequency.QuadPart;
+    }
+
+    static ULONGLONG RingSize(ULONGLONG Count)
+    {
+        return OSRDIO_EVENT_RING_BUFFER_SIZE(Count);
+    }
+
+    //
+    // InterlockedExchange is a full barrier, so the event is in the ring
+    // before the application can see the new ProducerIndex
+    //
+    static VOID PublishRing(POSRDIO_DEVICE_CONTEXT DevContext,
+                            POSRDIO_EVENT_RING     Ring,
+                            ULONG                  Head)
+    {
+        UNREFERENCED_PARAMETER(DevContext);
+
+        InterlockedExchange((volatile LONG*)&Ring->ProducerIndex,
+                            (LONG)Head);
+    }
+
+    //
+    // Our DpcForIsr, or our targeted DPC if it's meant to run on a
+    // particular processor
+    //
+    static VOID QueueDpc(POSRDIO_DEVICE_CONTEXT DevContext)
+    {
+        if (DevContext->DpcProcessor == OSRDIO_ANY_PROCESSOR) {
+
+            WdfInterruptQueueDpcForIsr(DevContext->WdfInterrupt);
+
+        } else {
+
+            WdfDpcEnqueue(DevContext->TargetedDpc);
+        }
+    }
+
+    static VOID RequeueDpc(POSRDIO_DEVICE_CONTEXT DevContext)
+    {
+        QueueDpc(DevContext);
+    }
+
+    static bool ProcessorExists(POSRDIO_DEVICE_CONTEXT DevContext,
+                                ULONG                  Processor)
+    {
+        PROCESSOR_NUMBER processorNumber;
+
+        UNREFERENCED_PARAMETER(DevContext);
+
+        if (!NT_SUCCESS(KeGetProcessorNumberFromIndex(Processor,
+                                                      &processorNumber))) {
+#if DBG
+            DbgPrint("ERROR! No processor %lu for our DpcForIsr\n",
+                     Processor);
+#endif
+            return false;
+        }
+
+        return true;
+    }
+
+    static bool CancelTargetedDpc(POSRDIO_DEVICE_CONTEXT DevContext)
+    {
+        return WdfDpcCancel(DevContext->TargetedDpc,
+                            TRUE) != FALSE;
+    }
+
+    static bool TargetDpc(POSRDIO_DEVICE_CONTEXT DevContext,
+                          ULONG                  Processor)
+    {
+        PROCESSOR_NUMBER processorNumber;
+        NTSTATUS         status;
+
+        status = KeGetProcessorNumberFromIndex(Processor,
+                                               &processorNumber);
+
+        if (NT_SUCCESS(status)) {
+
+            status = KeSetTargetProcessorDpcEx(WdfDpcWdmGetDpc(DevContext->TargetedDpc),
+                                               &processorNumber);
+        }
+
+        if (!NT_SUCCESS(status)) {
+#if DBG
+            DbgPrint("KeSetTargetProcessorDpcEx failed 0x%0x\n",
+                     status);
+#endif
+            return false;
+        }
+
+        return true;
+    }
+
+    static NTSTATUS SaveProfile(POSRDIO_DEVICE_CONTEXT DevContext,
+                                POSRDIO_LINE_PROFILE   Profile)
+    {
+        return DioUtilSaveProfile(DevContext,
+                                  Profile);
+    }
+
+    //
+    // There's no worker thread unless DeferredProcessing is on
+    //
+    static VOID WakeWorker(POSRDIO_DEVICE_CONTEXT DevContext)
+    {
+        if (DevContext->WorkerThread != nullptr) {
+
+            KeSetEvent(&DevContext->WorkerEvent,
+                       IO_NO_INCREMENT,
+                       FALSE);
+        }
+    }
+
+    static VOID QueueWorkItem(POSRDIO_DEVICE_CONTEXT DevContext)
+    {
+        WdfWorkItemEnqueue(DevContext->BackgroundWorkItem);
+    }
+
+    static VOID CountInterrupt(POSRDIO_DEVICE_CONTEXT DevContext)
+    {
+        InterlockedIncrement64((volatile LONG64*)&DevContext->DpcStats.IsrCount[
+            min(KeGetCurrentProcessorIndex(), OSRDIO_STATS_PROCESSORS - 1)]);
+    }
+
+    static VOID CountMissedChange(POSRDIO_DEVICE_CONTEXT DevContext)
+    {
+        UNREFERENCED_PARAMETER(DevContext);
+    }
+
+    static VOID BeginProcessing(POSRDIO_DEVICE_CONTEXT DevContext)
+    {
+        UNREFERENCED_PARAMETER(DevContext);
+    }
+
+    static WDFQUEUE PendingQueue(POSRDIO_DEVICE_CONTEXT DevContext,
+                                 ULONG                  Priority,
+                                 ULONG                  Port)
+    {
+        return Port == OSRDIO_NO_PORT ?
+                   DevContext->PendingQueue[Priority] :
+                   DevContext->PortPendingQueue[Port][Priority];
+    }
+
+    static bool ChangeRequestsWaiting(POSRDIO_DEVICE_CONTEXT DevContext,
+                                      ULONG                  Priority,
+                                      ULONG                  Port)
+    {
+        ULONG queueRequests;
+
+        (void)WdfIoQueueGetState(PendingQueue(DevContext, Priority, Port),
+                                 &queueRequests,
+                                 nullptr);
+
+        return queueRequests != 0;
+    }
+
+    static VOID CompleteChangeRequest(POSRDIO_DEVICE_CONTEXT DevContext,
+                                      ULONG                  Priority,
+                                      ULONG                  Port,
+                                      ULONG                  LineState)
+    {
+        DioUtilCompleteChangeRequest(PendingQueue(DevContext, Priority, Port),
+                                     LineState);
+    }
+
+    static bool NextEventRequest(POSRDIO_DEVICE_CONTEXT DevContext,
+                                 WDFREQUEST*            Request,
+                                 POSRDIO_EVENT*         Events,
+                                 PULONG                 Capacity)
+    {
+        return DioUtilNextEventRequest(DevContext,
+                                       Request,
+                                       Events,
+                                       Capacity) != FALSE;
+    }
+
+    //
+    // Events is the Events array in the Request's batch (see
+    // DioUtilNextEventRequest)
+    //
+    static VOID CompleteEventRequest(POSRDIO_DEVICE_CONTEXT DevContext,
+                                     WDFREQUEST             Request,
+                                     POSRDIO_EVENT          Events,
+                                     ULONG                  Count,
+                                     bool                   Overflow)
+    {
+        POSRDIO_EVENT_BATCH batch;
+
+        UNREFERENCED_PARAMETER(DevContext);
+
+        batch = CONTAINING_RECORD(Events, OSRDIO_EVENT_BATCH, Events);
+
+        batch->EventCount = Count;
+
+        if (Overflow) {
+            batch->Flags |= OSRDIO_BATCH_FLAG_OVERFLOW;
+        }
+
+#if DBG
+        DbgPrint("Completing Request %p: Returning %lu events\n",
+                 Request,
+                 Count);
+#endif
+
+        WdfRequestCompleteWithInformation(Request,
+                                          STATUS_SUCCESS,
+                                          OSRDIO_EVENT_BATCH_SIZE(Count));
+    }
+
+    static bool CompleteRingWaitRequest(POSRDIO_DEVICE_CONTEXT DevContext,
+                                        NTSTATUS               RequestStatus)
+    {
+        WDFREQUEST request;
+
+        if (!NT_SUCCESS(WdfIoQueueRetrieveNextRequest(DevContext->RingWaitQueue,
+                                                      &request))) {
+            return false;
+        }
+
+        WdfRequestCompleteWithInformation(request,
+                                          RequestStatus,
+                                          0);
+
+        return true;
+    }
+};